@@ -0,0 +1,96 @@
+/**
+Benchmark of the node layouts of KDTree, i.e., the pre-order nodes versus 
+the descent index in the van Emde Boas layout 
+(``construct_policy_t::set_veb_layout()``), on the descents from the root 
+(``walk_down()`` and ``argsort()``) and the neighbor queries.
+
+The queries are in random order, so that each descent misses the caches
+once the tree is larger than them. To compare the cache misses, run one 
+layout at a time under a profiler, e.g.,
+
+    perf stat -e cache-references,cache-misses ./kdtree-layout.out dfs
+    perf stat -e cache-references,cache-misses ./kdtree-layout.out veb
+*/
+#include <hippnumerical.h>
+#include <cstring>
+
+using namespace HIPP;
+namespace nu = HIPP::NUMERICAL;
+
+int main(int argc, char const *argv[])
+{
+    using kd_point_t = nu::KDPoint<float, 3>;
+    using kd_tree_t = nu::KDTree<kd_point_t, int>;
+    
+    const int n_queries = 1000000, k = 8;
+    const char *only = argc > 1 ? argv[1] : nullptr;
+    
+    vector<kd_tree_t::point_t> query_pts(n_queries);
+    for(auto &p: query_pts) nu::rand(p.pos().begin(), p.pos().end());
+
+    pout << "layout, no. points, max depth, index (MB), construct (s), "
+        "walk_down (ns), argsort (s), nearest (ns), nearest_k (ns), "
+        "checksum\n";
+    for(int n_pts: {10000, 1000000, 10000000}) {
+        vector<kd_point_t> pts(n_pts);
+        for(auto &p: pts) nu::rand(p.pos().begin(), p.pos().end());
+
+        for(bool veb: {false, true}) {
+            const char *name = veb ? "veb" : "dfs";
+            if( only && std::strcmp(only, name) ) continue;
+            
+            Ticker tk;
+            tk.tick(0);
+            kd_tree_t kd_tree(pts, 
+                kd_tree_t::construct_policy_t().set_veb_layout(veb));
+            tk.tick(1);
+            const double t_cstr = tk.query_last().dur.count();
+            const auto &impl = *kd_tree.impl();
+            const double mem = impl.veb_nodes().size() 
+                * sizeof(kd_tree_t::impl_t::veb_node_t) / 1024.0 / 1024.0;
+
+            double checksum = 0.;
+            tk.tick(0);
+            for(auto &p: query_pts) {
+                int idx = 0;
+                kd_tree.walk_down(p, [](int){}, idx);
+                checksum += idx;
+            }
+            tk.tick(1);
+            const double t_walk = tk.query_last().dur.count() 
+                / n_queries * 1.0e9;
+
+            vector<kd_tree_t::idx_pair_t> idxs;
+            tk.tick(0);
+            kd_tree.argsort<kd_tree_t::point_t>(query_pts, idxs);
+            tk.tick(1);
+            const double t_argsort = tk.query_last().dur.count();
+            checksum += idxs[n_queries/2].idx_node;
+
+            kd_tree_t::nearest_query_policy_t nn_pl;
+            tk.tick(0);
+            for(auto &p: query_pts)
+                checksum += kd_tree.nearest(p, nn_pl).r_sq;
+            tk.tick(1);
+            const double t_nn = tk.query_last().dur.count() 
+                / n_queries * 1.0e9;
+
+            kd_tree_t::nearest_k_query_policy_t knn_pl;
+            vector<kd_tree_t::ngb_t> ngbs(k);
+            tk.tick(0);
+            for(auto &p: query_pts) {
+                kd_tree.nearest_k(p, ngbs, knn_pl);
+                checksum += ngbs[0].r_sq;
+            }
+            tk.tick(1);
+            const double t_knn = tk.query_last().dur.count() 
+                / n_queries * 1.0e9;
+
+            pout << name, ", ", n_pts, ", ", kd_tree.tree_info().max_depth(),
+                ", ", mem, ", ", t_cstr, ", ", t_walk, ", ", t_argsort, ", ", 
+                t_nn, ", ", t_knn, ", ", checksum, endl;
+        }
+    }
+
+    return 0;
+}
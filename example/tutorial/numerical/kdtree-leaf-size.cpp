@@ -0,0 +1,77 @@
+/**
+Benchmark of the bucketed leaves of KDTree, i.e., the effect of 
+``construct_policy_t::set_leaf_size()`` on the construction, the memory, and
+the queries.
+*/
+#include <hippnumerical.h>
+
+using namespace HIPP;
+namespace nu = HIPP::NUMERICAL;
+
+int main(int argc, char const *argv[])
+{
+    using kd_point_t = nu::KDPoint<float, 3>;
+    using kd_tree_t = nu::KDTree<kd_point_t, int>;
+    
+    const int n_pts = 1000000, n_queries = 200000, k = 8;
+    const float r_sphere = 0.02;
+    
+    vector<kd_point_t> pts(n_pts);
+    vector<kd_tree_t::point_t> query_pts(n_queries);
+    for(auto &p: pts) nu::rand(p.pos().begin(), p.pos().end());
+    for(auto &p: query_pts) nu::rand(p.pos().begin(), p.pos().end());
+
+    // Sort the queries for cache locality, as is recommended in practice.
+    {
+        kd_tree_t kd_tree(pts);
+        vector<kd_tree_t::idx_pair_t> idxs;
+        kd_tree.argsort<kd_tree_t::point_t>(query_pts, idxs);
+        vector<kd_tree_t::point_t> sorted;
+        for(auto &idx: idxs) sorted.push_back(query_pts[idx.idx_in]);
+        query_pts.swap(sorted);
+    }
+
+    pout << "leaf size, max depth, memory (MB), construct (s), "
+        "nearest_k (s), count_nodes_sphere (s), checksum\n";
+    for(int leaf_size: {1, 2, 4, 8, 16, 32, 64}) {
+        Ticker tk;
+        kd_tree_t::construct_policy_t cstr_pl;
+        cstr_pl.set_leaf_size(leaf_size);
+
+        tk.tick(0);
+        kd_tree_t kd_tree(pts, cstr_pl);
+        tk.tick(1);
+        const double t_cstr = tk.query_last().dur.count();
+        
+        const auto &impl = *kd_tree.impl();
+        const double mem = (impl.nodes().capacity() * sizeof(kd_tree_t::node_t)
+            + impl.ref_nodes().capacity() * sizeof(kd_tree_t::ref_node_t)
+            + impl.points().capacity() * sizeof(kd_tree_t::point_t)
+            + impl.points().size() * kd_tree_t::node_t::PADDING 
+            ) / 1024.0 / 1024.0;
+
+        kd_tree_t::nearest_k_query_policy_t knn_pl;
+        vector<kd_tree_t::ngb_t> ngbs(k);
+        double checksum = 0.;
+        tk.tick(0);
+        for(auto &p: query_pts) {
+            kd_tree.nearest_k(p, ngbs, knn_pl);
+            for(auto &ngb: ngbs) checksum += ngb.r_sq;
+        }
+        tk.tick(1);
+        const double t_knn = tk.query_last().dur.count();
+
+        kd_tree_t::sphere_query_policy_t sphere_pl;
+        tk.tick(0);
+        for(auto &p: query_pts)
+            checksum += kd_tree.count_nodes_sphere({p, r_sphere}, sphere_pl);
+        tk.tick(1);
+        const double t_sphere = tk.query_last().dur.count();
+
+        pout << leaf_size, ", ", kd_tree.tree_info().max_depth(), ", ", 
+            mem, ", ", t_cstr, ", ", t_knn, ", ", t_sphere, ", ", 
+            checksum, endl;
+    }
+
+    return 0;
+}
@@ -10,4 +10,5 @@ Header of geometry types of NUMERICAL module.
 #include "geometry_rect.h"
 #include "geometry_sphere.h"
 #include "geometry_mesh.h"
+#include "geometry_sfc.h"
 #endif	//_HIPPNUMERICAL_GEOMETRY_H_
\ No newline at end of file
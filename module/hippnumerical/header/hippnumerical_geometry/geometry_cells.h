@@ -229,6 +229,7 @@ idx2v_idx(index_t idx) const noexcept -> v_index_t {
         idx /= _n_cell[d];
     }
     v_idx[0] = idx;
+    return v_idx;
 }
 
 _HIPP_TEMPRET
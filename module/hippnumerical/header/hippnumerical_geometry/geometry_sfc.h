@@ -0,0 +1,266 @@
+/**
+create: Yangyao CHEN, 2026/10/17
+    [write   ] SpaceFillingCurve - Morton and Hilbert keys of points in a
+        rectangle.
+*/
+
+#ifndef _HIPPNUMERICAL_GEOMETRY_SFC_H_
+#define _HIPPNUMERICAL_GEOMETRY_SFC_H_
+
+#include "geometry_rect.h"
+#include <cstdint>
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+namespace HIPP::NUMERICAL::GEOMETRY {
+
+/**
+The non-template part of ``SpaceFillingCurve``.
+
+curve_t: the kind of the curve.
+``MORTON``: the Z-order, i.e., the bits of the cell indices interleaved.
+``HILBERT``: the Hilbert curve, whose successive cells are always adjacent,
+hence better locality at a slightly higher cost.
+*/
+class SpaceFillingCurveBase {
+public:
+    enum class curve_t : int { MORTON = 0, HILBERT = 1 };
+};
+
+/**
+Space-filling curve over a rectangle ``domain``, mapping each point to a
+64-bit key such that points close in the key are close in the space.
+
+The domain is divided into ``2^BITS`` cells along each axis, where
+``BITS = min(64/DIM, 32)``, e.g., 21 bits for 3-d and 32 bits for 2-d. A
+point is located to its cell (points outside the domain are clamped to the
+boundary cells) and the key of the cell is returned. At each level, axis 0
+takes the most significant bit.
+
+With the BMI2 instruction set (e.g., ``-mbmi2`` or ``-march=native`` on
+recent x86-64), the interleaving of bits is a single ``pdep`` per axis.
+Otherwise, the portable bit tricks are used. The keys are the same in both
+cases.
+*/
+template<typename _FloatT, int _DIM>
+class SpaceFillingCurve : public SpaceFillingCurveBase {
+public:
+    static_assert(_DIM >= 1 && _DIM <= 64,
+        "argument _DIM is not in [1, 64]");
+
+    inline static constexpr int DIM = _DIM;
+    inline static constexpr int BITS = 64/DIM < 32 ? 64/DIM : 32;
+
+    /**
+    key_t: the key and the cell index along an axis.
+    cell_t: the cell indices along all axes.
+    */
+    using float_t = _FloatT;
+    using point_t = Point<float_t, DIM>;
+    using pos_t   = typename point_t::pos_t;
+    using rect_t  = Rect<float_t, DIM>;
+    using key_t   = std::uint64_t;
+    using cell_t  = key_t[DIM];
+
+    /**
+    Constructors.
+    (1): the unit cube ``[0, 1)^DIM`` with the Hilbert curve.
+    (2): the rectangle ``domain``. Axes of non-positive sizes are not
+    divided, i.e., all points are in the cell 0 along them.
+    */
+    SpaceFillingCurve() noexcept;
+    explicit SpaceFillingCurve(const rect_t &domain,
+        curve_t curve = curve_t::HILBERT) noexcept;
+
+    ostream & info(ostream &os = cout, int fmt_cntl = 0, int level = 0) const;
+    friend ostream & operator<<(ostream &os, const SpaceFillingCurve &sfc) {
+        return sfc.info(os);
+    }
+
+    const rect_t & domain() const noexcept;
+    curve_t curve() const noexcept;
+
+    /**
+    key(): the key of point ``p`` along ``curve()``.
+    morton_key(), hilbert_key(): the key along a given curve.
+    cell_of(): the cell indices of ``p``, each in ``[0, 2^BITS)``.
+    */
+    key_t key(const point_t &p) const noexcept;
+    key_t morton_key(const point_t &p) const noexcept;
+    key_t hilbert_key(const point_t &p) const noexcept;
+    void cell_of(const point_t &p, cell_t &cell) const noexcept;
+
+    /**
+    The keys of the cell indices ``cell``. ``hilbert_encode()`` overwrites
+    ``cell``.
+    */
+    static key_t morton_encode(const cell_t &cell) noexcept;
+    static key_t hilbert_encode(cell_t &cell) noexcept;
+protected:
+    rect_t _domain;
+    curve_t _curve;
+    double _scale[DIM];
+
+    static constexpr key_t _spread_mask() noexcept;
+    static key_t _spread(key_t x) noexcept;
+};
+
+#define _HIPP_TEMPHD template<typename _FloatT, int _DIM>
+#define _HIPP_TEMPARG <_FloatT, _DIM>
+#define _HIPP_TEMPCLS SpaceFillingCurve _HIPP_TEMPARG
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPNORET
+SpaceFillingCurve() noexcept
+: SpaceFillingCurve( rect_t(point_t(pos_t(float_t(0))), 
+    point_t(pos_t(float_t(1)))) ) {}
+
+_HIPP_TEMPNORET
+SpaceFillingCurve(const rect_t &domain, curve_t curve) noexcept
+: _domain(domain), _curve(curve)
+{
+    const auto sz = domain.size();
+    for(int k=0; k<DIM; ++k)
+        _scale[k] = sz[k] > 0 ? double(key_t(1) << BITS) / sz[k] : 0.;
+}
+
+_HIPP_TEMPRET
+info(ostream &os, int fmt_cntl, int level) const -> ostream & {
+    const char *name = _curve == curve_t::MORTON ? "Morton" : "Hilbert";
+    PStream ps{os};
+    if( fmt_cntl < 1 ) {
+        ps << HIPPCNTL_CLASS_INFO_INLINE(SpaceFillingCurve),
+        "{curve=", name, ", domain=", _domain, "}";
+        return os;
+    }
+    auto ind = HIPPCNTL_CLASS_INFO_INDENT_STR(level);
+    ps << HIPPCNTL_CLASS_INFO(SpaceFillingCurve),
+    ind, "Curve = ", name, ", bits per axis = ", BITS, '\n',
+    ind, "Domain = ", _domain, '\n';
+    return os;
+}
+
+_HIPP_TEMPRET
+domain() const noexcept -> const rect_t & { return _domain; }
+
+_HIPP_TEMPRET
+curve() const noexcept -> curve_t { return _curve; }
+
+_HIPP_TEMPRET
+key(const point_t &p) const noexcept -> key_t {
+    return _curve == curve_t::MORTON ? morton_key(p) : hilbert_key(p);
+}
+
+_HIPP_TEMPRET
+morton_key(const point_t &p) const noexcept -> key_t {
+    cell_t cell;
+    cell_of(p, cell);
+    return morton_encode(cell);
+}
+
+_HIPP_TEMPRET
+hilbert_key(const point_t &p) const noexcept -> key_t {
+    cell_t cell;
+    cell_of(p, cell);
+    return hilbert_encode(cell);
+}
+
+_HIPP_TEMPRET
+cell_of(const point_t &p, cell_t &cell) const noexcept -> void {
+    constexpr double max_cell = double((key_t(1) << BITS) - 1);
+    for(int k=0; k<DIM; ++k) {
+        double c = (double(p.pos()[k]) - double(_domain.low().pos()[k]))
+            * _scale[k];
+        c = c > 0. ? c : 0.;
+        cell[k] = key_t(c < max_cell ? c : max_cell);
+    }
+}
+
+_HIPP_TEMPRET
+morton_encode(const cell_t &cell) noexcept -> key_t {
+    key_t key = 0;
+    for(int k=0; k<DIM; ++k)
+        key |= _spread(cell[k]) << (DIM-1-k);
+    return key;
+}
+
+/**
+Skilling's algorithm (AIP Conf. Proc. 707, 381, 2004) turns the cell indices
+into the "transposed" Hilbert index in place, whose bits interleaved are the
+key.
+*/
+_HIPP_TEMPRET
+hilbert_encode(cell_t &cell) noexcept -> key_t {
+    if constexpr( DIM == 1 ) return cell[0];
+
+    constexpr key_t top = key_t(1) << (BITS-1);
+    for(key_t q = top; q > 1; q >>= 1) {
+        const key_t p = q - 1;
+        for(int k=0; k<DIM; ++k) {
+            if( cell[k] & q ) {
+                cell[0] ^= p;
+            } else {
+                const key_t t = (cell[0] ^ cell[k]) & p;
+                cell[0] ^= t; cell[k] ^= t;
+            }
+        }
+    }
+    for(int k=1; k<DIM; ++k) cell[k] ^= cell[k-1];
+    key_t t = 0;
+    for(key_t q = top; q > 1; q >>= 1)
+        if( cell[DIM-1] & q ) t ^= q - 1;
+    for(int k=0; k<DIM; ++k) cell[k] ^= t;
+    return morton_encode(cell);
+}
+
+_HIPP_TEMPHD
+inline constexpr auto _HIPP_TEMPCLS::_spread_mask() noexcept -> key_t {
+    key_t m = 0;
+    for(int i=0; i<BITS; ++i) m |= key_t(1) << (i*DIM);
+    return m;
+}
+
+/**
+Move bit ``i`` of ``x`` to bit ``i*DIM``.
+*/
+_HIPP_TEMPRET
+_spread(key_t x) noexcept -> key_t {
+    if constexpr( DIM == 1 ) return x;
+#if defined(__BMI2__)
+    return _pdep_u64(x, _spread_mask());
+#else
+    if constexpr( DIM == 2 ) {
+        x &= 0xffffffffULL;
+        x = (x | x << 16) & 0x0000ffff0000ffffULL;
+        x = (x | x << 8)  & 0x00ff00ff00ff00ffULL;
+        x = (x | x << 4)  & 0x0f0f0f0f0f0f0f0fULL;
+        x = (x | x << 2)  & 0x3333333333333333ULL;
+        x = (x | x << 1)  & 0x5555555555555555ULL;
+        return x;
+    } else if constexpr( DIM == 3 ) {
+        x &= 0x1fffffULL;
+        x = (x | x << 32) & 0x001f00000000ffffULL;
+        x = (x | x << 16) & 0x001f0000ff0000ffULL;
+        x = (x | x << 8)  & 0x100f00f00f00f00fULL;
+        x = (x | x << 4)  & 0x10c30c30c30c30c3ULL;
+        x = (x | x << 2)  & 0x1249249249249249ULL;
+        return x;
+    } else {
+        key_t y = 0;
+        for(int i=0; i<BITS; ++i) y |= ((x >> i) & 1) << (i*DIM);
+        return y;
+    }
+#endif
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
+
+} // namespace HIPP::NUMERICAL::GEOMETRY
+
+#endif	//_HIPPNUMERICAL_GEOMETRY_SFC_H_
@@ -9,5 +9,17 @@ The header of the space searching algorithms of NUMERICAL module.
 #include "kdsearch_kdmesh.h"
 #include "kdsearch_kdtree.h"
 #include "kdsearch_balltree.h"
+#include "kdsearch_dynamic_kdtree.h"
+#include "kdsearch_compact_kdtree.h"
+#include "kdsearch_sfc_sort.h"
+#include "kdsearch_geometry_batch.h"
+
+#if __has_include(<hipp_config.h>)
+#include <hipp_config.h>
+#endif
+
+#ifdef HIPPMPI_ON
+#include "kdsearch_dist_kdtree.h"
+#endif
 
 #endif	//_HIPPNUMERICAL_KDSEARCH_H_
\ No newline at end of file
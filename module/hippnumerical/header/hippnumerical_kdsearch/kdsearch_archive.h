@@ -0,0 +1,284 @@
+/**
+create: Yangyao CHEN, 2026/10/17
+    [write   ] _FileArchive, _H5Archive - save/load the arrays of the
+        space-searching structures.
+*/
+
+#ifndef _HIPPNUMERICAL_KDSEARCH_ARCHIVE_H_
+#define _HIPPNUMERICAL_KDSEARCH_ARCHIVE_H_
+
+#include "kdsearch_base.h"
+#include <fstream>
+#include <cerrno>
+
+namespace HIPP::NUMERICAL::_KDSEARCH {
+
+/**
+A space-searching structure is saved as a sequence of named arrays, and 
+loaded by reading them back in the same order. The elements are copied as raw
+bytes, hence must not hold pointers or virtual functions (e.g., nodes, points
+and indices). The first array is the layout of the structure (see 
+``_put_layout()``), so that a structure is never loaded by an incompatible 
+type.
+
+The archives are
+- ``_FileArchive``: a flat binary file.
+- ``_H5Archive``: datasets under a HDF5 group.
+
+Both archives have the methods
+- ``put(name, p, n)``: write the array ``p[0], ..., p[n-1]``.
+- ``get(name, v)``: read the next array into a vector ``v`` that is resized.
+- ``get(name, p, n)``: read the next array into ``p``. Its size must be ``n``.
+*/
+
+/**
+Flat binary file. All integers are 64-bit in the native byte order. The file
+is a 64-byte head (magic ``HIPPKDS1``, followed by zeros) and the arrays, one
+by one. An array is a 64-byte head (the name as a null-terminated string
+padded to 48 bytes, element size, number of elements), followed by the raw
+elements and zero padding to a multiple of 64 bytes.
+
+Hence the elements of every array start at a 64-byte aligned offset of the
+file. A memory-mapped file can be used in place, e.g., the nodes of a tree
+are reinterpreted as the node array without any copy.
+
+Note that ``get()``, hence the ``load()`` of the structures, is a copying
+read into the buffers of the structure. A structure cannot yet be queried
+in place on the (mapped) file.
+*/
+class _FileArchive {
+public:
+    static constexpr size_t ALIGN = 64, NAME_SIZE = 48;
+    inline static constexpr char MAGIC[8] =
+        {'H', 'I', 'P', 'P', 'K', 'D', 'S', '1'};
+
+    struct head_t {
+        char name[NAME_SIZE];
+        std::uint64_t elem_size, n_elems;
+    };
+    static_assert(sizeof(head_t) == ALIGN);
+
+    /**
+    Open the file ``file_name`` for writing (truncated) or reading.
+    */
+    _FileArchive(const string &file_name, bool writable);
+
+    template<typename T>
+    void put(const string &name, const T *p, size_t n);
+
+    template<typename T>
+    void get(const string &name, vector<T> &v);
+
+    template<typename T>
+    void get(const string &name, T *p, size_t n);
+protected:
+    string _file_name;
+    std::fstream _fs;
+
+    void _write(const void *p, size_t n);
+    void _read(void *p, size_t n);
+    void _pad_write(size_t n);
+    void _pad_skip(size_t n);
+    head_t _get_head(const string &name, size_t elem_size);
+};
+
+/**
+HDF5 group. ``GroupT`` is ``IO::H5::Group`` - the hippio module is needed
+only if this archive is used.
+
+Each array is saved as a 2-D dataset of unsigned char, shaped
+``{n, sizeof(T)}``, under the group.
+*/
+template<typename GroupT>
+class _H5Archive {
+public:
+    explicit _H5Archive(GroupT g);
+
+    template<typename T>
+    void put(const string &name, const T *p, size_t n);
+
+    template<typename T>
+    void get(const string &name, vector<T> &v);
+
+    template<typename T>
+    void get(const string &name, T *p, size_t n);
+protected:
+    GroupT _g;
+
+    template<typename T, typename DatasetT>
+    static size_t _check_dims(const string &name, const DatasetT &dset);
+};
+
+/**
+Put or check the layout of a structure, i.e., the sizes that determine the
+binary content of the node type ``NodeT``. The array is named by ``kind``,
+e.g., "KDTree".
+
+If the layout in the archive does not match, an ``ErrRuntime`` is thrown.
+*/
+template<typename NodeT, typename IndexT, typename Archive>
+void _put_layout(Archive &ar, const string &kind);
+
+template<typename NodeT, typename IndexT, typename Archive>
+void _check_layout(Archive &ar, const string &kind);
+
+/* Implementation */
+
+inline _FileArchive::_FileArchive(const string &file_name, bool writable)
+: _file_name(file_name)
+{
+    const auto mode = std::ios::binary
+        | (writable ? std::ios::out | std::ios::trunc : std::ios::in);
+    _fs.open(file_name, mode);
+    if( !_fs )
+        ErrSystem::throw_(errno, emFLPFB, "  ... cannot open file ",
+            file_name, '\n');
+    char head[ALIGN] = {};
+    if( writable ) {
+        std::copy_n(MAGIC, sizeof(MAGIC), head);
+        _write(head, ALIGN);
+    } else {
+        _read(head, ALIGN);
+        if( !std::equal(MAGIC, MAGIC+sizeof(MAGIC), head) )
+            ErrRuntime::throw_(ErrRuntime::eDEFAULT, emFLPFB,
+                "  ... file ", file_name, " is not a kdsearch archive\n");
+    }
+}
+
+template<typename T>
+void _FileArchive::put(const string &name, const T *p, size_t n) {
+    if( name.size() >= NAME_SIZE )
+        ErrLogic::throw_(ErrLogic::eLENGTH, emFLPFB,
+            "  ... array name ", name, " too long\n");
+    head_t head {};
+    std::copy(name.begin(), name.end(), head.name);
+    head.elem_size = sizeof(T);
+    head.n_elems = n;
+    _write(&head, sizeof(head));
+    _write(p, n * sizeof(T));
+    _pad_write(n * sizeof(T));
+}
+
+template<typename T>
+void _FileArchive::get(const string &name, vector<T> &v) {
+    auto head = _get_head(name, sizeof(T));
+    v.resize(head.n_elems);
+    _read(v.data(), v.size() * sizeof(T));
+    _pad_skip(v.size() * sizeof(T));
+}
+
+template<typename T>
+void _FileArchive::get(const string &name, T *p, size_t n) {
+    auto head = _get_head(name, sizeof(T));
+    if( head.n_elems != n )
+        ErrRuntime::throw_(ErrRuntime::eDEFAULT, emFLPFB, "  ... array ",
+            name, " has ", head.n_elems, " elements (expect ", n, ")\n");
+    _read(p, n * sizeof(T));
+    _pad_skip(n * sizeof(T));
+}
+
+inline void _FileArchive::_write(const void *p, size_t n) {
+    _fs.write(reinterpret_cast<const char *>(p), n);
+    if( !_fs )
+        ErrSystem::throw_(errno, emFLPFB, "  ... cannot write file ",
+            _file_name, '\n');
+}
+
+inline void _FileArchive::_read(void *p, size_t n) {
+    _fs.read(reinterpret_cast<char *>(p), n);
+    if( !_fs )
+        ErrRuntime::throw_(ErrRuntime::eDEFAULT, emFLPFB,
+            "  ... file ", _file_name, " is truncated\n");
+}
+
+inline void _FileArchive::_pad_write(size_t n) {
+    const char zeros[ALIGN] = {};
+    if( size_t r = n % ALIGN ) _write(zeros, ALIGN - r);
+}
+
+inline void _FileArchive::_pad_skip(size_t n) {
+    if( size_t r = n % ALIGN ) _fs.seekg(ALIGN - r, std::ios::cur);
+}
+
+inline auto _FileArchive::_get_head(const string &name, size_t elem_size)
+-> head_t
+{
+    head_t head;
+    _read(&head, sizeof(head));
+    head.name[NAME_SIZE-1] = '\0';
+    if( name != head.name || head.elem_size != elem_size )
+        ErrRuntime::throw_(ErrRuntime::eDEFAULT, emFLPFB,
+            "  ... expect array ", name, " (element size ", elem_size,
+            "), but got ", head.name, " (element size ", head.elem_size,
+            ") in file ", _file_name, '\n');
+    return head;
+}
+
+template<typename GroupT>
+_H5Archive<GroupT>::_H5Archive(GroupT g) : _g(std::move(g)) {}
+
+template<typename GroupT>
+template<typename T>
+void _H5Archive<GroupT>::put(const string &name, const T *p, size_t n) {
+    auto dset = _g.template create_dataset<unsigned char>(name,
+        {n, sizeof(T)});
+    if( n > 0 )
+        dset.write(static_cast<const void *>(p), dset.datatype());
+}
+
+template<typename GroupT>
+template<typename T>
+void _H5Archive<GroupT>::get(const string &name, vector<T> &v) {
+    auto dset = _g.open_dataset(name);
+    v.resize(_check_dims<T>(name, dset));
+    if( !v.empty() )
+        dset.read(static_cast<void *>(v.data()), dset.datatype());
+}
+
+template<typename GroupT>
+template<typename T>
+void _H5Archive<GroupT>::get(const string &name, T *p, size_t n) {
+    auto dset = _g.open_dataset(name);
+    const size_t n_elems = _check_dims<T>(name, dset);
+    if( n_elems != n )
+        ErrRuntime::throw_(ErrRuntime::eDEFAULT, emFLPFB, "  ... dataset ",
+            name, " has ", n_elems, " elements (expect ", n, ")\n");
+    if( n > 0 )
+        dset.read(static_cast<void *>(p), dset.datatype());
+}
+
+template<typename GroupT>
+template<typename T, typename DatasetT>
+size_t _H5Archive<GroupT>::_check_dims(const string &name,
+    const DatasetT &dset)
+{
+    const auto dims = dset.dataspace().dims();
+    if( dims.ndims() != 2 || dims[1] != sizeof(T) )
+        ErrRuntime::throw_(ErrRuntime::eDEFAULT, emFLPFB, "  ... dataset ",
+            name, " has dims ", dims, " (expect {n, ", sizeof(T), "})\n");
+    return dims[0];
+}
+
+template<typename NodeT, typename IndexT, typename Archive>
+void _put_layout(Archive &ar, const string &kind) {
+    const std::uint64_t layout[5] = {NodeT::DIM, NodeT::PADDING,
+        sizeof(typename NodeT::float_t), sizeof(IndexT), sizeof(NodeT)};
+    ar.put(kind, layout, 5);
+}
+
+template<typename NodeT, typename IndexT, typename Archive>
+void _check_layout(Archive &ar, const string &kind) {
+    const std::uint64_t layout[5] = {NodeT::DIM, NodeT::PADDING,
+        sizeof(typename NodeT::float_t), sizeof(IndexT), sizeof(NodeT)};
+    std::uint64_t layout_in[5];
+    ar.get(kind, layout_in, 5);
+    if( !std::equal(layout, layout+5, layout_in) )
+        ErrRuntime::throw_(ErrRuntime::eDEFAULT, emFLPFB, "  ... ", kind,
+            " layout {dim, padding, sizeof float, sizeof index, sizeof node}"
+            " mismatch: got {", layout_in[0], ", ", layout_in[1], ", ",
+            layout_in[2], ", ", layout_in[3], ", ", layout_in[4], "}\n");
+}
+
+} // namespace HIPP::NUMERICAL::_KDSEARCH
+
+#endif	//_HIPPNUMERICAL_KDSEARCH_ARCHIVE_H_
@@ -62,6 +62,13 @@ public:
     using nearest_k_query_policy_t = typename impl_t::nearest_k_query_policy_t;
     using rect_query_policy_t      = typename impl_t::rect_query_policy_t;
     using sphere_query_policy_t    = typename impl_t::sphere_query_policy_t;
+    using batch_query_policy_t     = typename impl_t::batch_query_policy_t;
+    using all_nearest_k_policy_t   = typename impl_t::all_nearest_k_policy_t;
+    using pair_count_policy_t      = typename impl_t::pair_count_policy_t;
+    using refit_policy_t           = typename impl_t::refit_policy_t;
+    using refit_info_t             = typename impl_t::refit_info_t;
+    using gravity_policy_t         = typename impl_t::gravity_policy_t;
+    using multipole_t              = typename impl_t::multipole_t;
 
     using tree_info_t = typename impl_t::tree_info_t;
     using idx_pair_t  = typename impl_t::idx_pair_t;
@@ -126,6 +133,24 @@ public:
     void argsort(ContiguousBuffer<const PointT> pts, 
         vector<idx_pair_t> &idx_pairs) const;
 
+    /**
+    Refit the tree to moved points without a reconstruction, e.g., between 
+    the time steps of a simulation. The topology is kept, and the spheres 
+    are updated bottom-up.
+
+    ``pts[i]`` is the new point of the ``i``-th leaf in pre-order (i.e., 
+    ``pts.size()`` must be the number of leaves), typically found by 
+    looking up the padding of the leaf.
+
+    refit_info(): ``refit_info().growth()`` is the factor the total volume 
+    of the internal spheres has grown by since the construction. The 
+    queries slow down roughly in proportion, and a reconstruction may be 
+    made once it exceeds a threshold.
+    */
+    void refit(ContiguousBuffer<const kd_point_t> pts, 
+        const refit_policy_t &policy = refit_policy_t());
+    const refit_info_t & refit_info() const noexcept;
+
     /**
     Memory management methods.
     
@@ -140,6 +165,28 @@ public:
     void shrink_buffer();
     void clear();
 
+    /**
+    Persistence methods. Save the tree structure (nodes and tree info), or load it 
+    to replace the current one, e.g., to skip the construction of a tree 
+    on the same points in another run.
+
+    save(), load(): use a flat binary file named ``file_name``. The arrays in
+    the file are 64-byte aligned, raw binary copies of those in memory - 
+    loading reads them in place without any conversion.
+
+    save_h5(), load_h5(): use a HDF5 group ``g`` typed ``IO::H5::Group``, 
+    e.g., ``kdt.save_h5(file.create_group("tree"))``. Each array is a 
+    dataset of bytes in the group. The hippio module (i.e., ``hippio.h``) is 
+    needed only if they are used.
+
+    The tree must be loaded by a ``BallTree`` with the same point and index 
+    types. Otherwise, an ``ErrRuntime`` is thrown.
+    */
+    void save(const string &file_name) const;
+    void load(const string &file_name);
+    template<typename H5Group> void save_h5(H5Group g) const;
+    template<typename H5Group> void load_h5(H5Group g);
+
     std::shared_ptr<impl_t> impl() const noexcept;
 
     /**
@@ -195,6 +242,10 @@ public:
     See the API-ref of :type:`nearest_query_policy_t` and 
     :type:`nearest_k_query_policy_t` for the details on query policies.
 
+    If the tree is constructed with a periodic box (see 
+    ``construct_policy_t::set_periodic_box()``), ``r_sq`` is the squared 
+    minimum-image distance.
+
     Thread safety: these three calls do not modify the tree. 
     */
     template<typename Policy = nearest_query_policy_t>
@@ -211,6 +262,8 @@ public:
 
     count_nodes_rect(): count the exact number of leaf nodes within ``rect``.
 
+    With a periodic box, ``rect`` is wrapped into the box.
+
     See the API-ref of :type:`rect_query_policy_t` for the details on query 
     policy.
     
@@ -228,6 +281,9 @@ public:
     ``op(const node_t &node)`` is called on each node visited.
 
     count_sphere(): count the exact number of leaf nodes within ``sphere``.
+
+    With a periodic box, ``sphere`` is wrapped into the box, and its radius 
+    must be no larger than half the box size.
     
     See the API-ref of :type:`sphere_query_policy_t` for the details on query 
     policy.
@@ -240,6 +296,119 @@ public:
     template<typename Policy = sphere_query_policy_t>
     index_t count_nodes_sphere(const sphere_t &sphere,
         Policy &&policy = Policy()) const;
+
+    /**
+    Batch queries. Each of the queries are made as if calling the single-query 
+    counterpart. ``batch_policy`` specifies the number of threads and whether 
+    or not to reorder the queries by ``argsort()`` for cache locality. 
+    Each thread makes queries with its own copy of ``policy``.
+
+    nearest_k_batch(): find the first ``k`` nearest nodes to each of ``pts``.
+    ``PointT`` must be a derived type of ``point_t``.
+
+    find_nodes_sphere_batch(): find the indices of leaf nodes within each of 
+    ``spheres``.
+
+    The results are written into flat arrays in the order of the input 
+    queries, i.e., the results of query ``i`` are 
+    ``ngbs[displs[i] : displs[i+1]]`` or ``node_ids[displs[i] : displs[i+1]]``.
+    ``displs`` is resized to ``n_queries + 1``.
+
+    count_nodes_sphere_batch(): count the exact number of leaf nodes within 
+    each of ``spheres``. ``counts`` is resized to the number of spheres.
+    */
+    template<typename PointT, typename Policy = nearest_k_query_policy_t>
+    void nearest_k_batch(ContiguousBuffer<const PointT> pts, index_t k,
+        vector<index_t> &displs, vector<ngb_t> &ngbs,
+        const batch_query_policy_t &batch_policy = batch_query_policy_t(),
+        const Policy &policy = Policy()) const;
+    template<typename Policy = sphere_query_policy_t>
+    void find_nodes_sphere_batch(ContiguousBuffer<const sphere_t> spheres,
+        vector<index_t> &displs, vector<index_t> &node_ids,
+        const batch_query_policy_t &batch_policy = batch_query_policy_t(),
+        const Policy &policy = Policy()) const;
+    template<typename Policy = sphere_query_policy_t>
+    void count_nodes_sphere_batch(ContiguousBuffer<const sphere_t> spheres,
+        vector<index_t> &counts,
+        const batch_query_policy_t &batch_policy = batch_query_policy_t(),
+        const Policy &policy = Policy()) const;
+
+    /**
+    All-k-nearest-neighbor query, i.e., find the first ``k`` nearest leaf 
+    nodes of every leaf node in the tree, using the dual-tree algorithm. 
+    ``policy`` specifies the number of threads and whether or not a leaf is 
+    taken as a neighbor of itself.
+
+    On exit, the neighbors of leaf ``node_ids[i]`` are 
+    ``ngbs[i*k_used : (i+1)*k_used]``, sorted by distance, where ``k_used``
+    is the return value, i.e., ``k`` truncated by the number of available 
+    neighbors.
+
+    With a periodic box, the dual-tree bounds do not apply and each leaf is 
+    queried by ``nearest_k()`` separately.
+    */
+    index_t all_nearest_k(index_t k, vector<index_t> &node_ids, 
+        vector<ngb_t> &ngbs, const all_nearest_k_policy_t &policy 
+            = all_nearest_k_policy_t()) const;
+
+    /**
+    Count the pairs of leaf nodes in radial bins, using the dual-tree 
+    algorithm. A pair of subtrees whose separations fall entirely in one bin
+    is counted at once.
+
+    ``edges`` are the ``n_bins + 1`` strictly ascending bin edges. A pair at
+    distance ``d`` is counted in bin ``b`` if ``edges[b] <= d < edges[b+1]``.
+    On exit, ``counts`` is resized to ``n_bins``.
+
+    (1): auto-correlation - count each unordered pair of distinct leaves once.
+
+    (2): cross-correlation - count the pairs of a leaf in this tree and a 
+    leaf in ``other``.
+
+    ``policy`` specifies the number of threads, and whether or not the pairs
+    are weighted. If weighted, the weight of a leaf is a ``float_t`` value at
+    the beginning of its padding, and a pair counts as the product of the 
+    weights. With a periodic box (of this tree), the distances are the 
+    minimum-image ones.
+    */
+    void count_pairs(ContiguousBuffer<const float_t> edges, 
+        vector<double> &counts, 
+        const pair_count_policy_t &policy = pair_count_policy_t()) const;
+    void count_pairs(const BallTree &other, 
+        ContiguousBuffer<const float_t> edges, vector<double> &counts, 
+        const pair_count_policy_t &policy = pair_count_policy_t()) const;
+
+    /**
+    Barnes-Hut tree-code gravity, taking the leaf nodes as point masses. 
+    The cost is ``O(log N)`` per target for a fixed opening angle, instead 
+    of ``O(N)`` by the direct summation.
+
+    multipoles(): the upward pass, i.e., find the mass, center of mass, 
+    quadrupole moment and the extent of each subtree. On exit, ``mps[i]`` 
+    belongs to node ``i``. With ``policy.weighted_on()``, the mass of a leaf 
+    is a ``float_t`` value at the beginning of its padding. Otherwise, all
+    leaves have unit mass.
+
+    gravity(): the accelerations ``accs`` and potentials ``pots`` at 
+    ``targets``, from the moments ``mps`` of the current tree. A subtree is
+    accepted as a whole if its extent is less than ``opening_angle`` times
+    its distance to the target. Accepted subtrees contribute their monopoles
+    and, by default, quadrupoles. The targets are ordered along the tree 
+    and grouped, each group sharing a single walk. ``policy`` also specifies 
+    the group size and the number of threads. The number of accepted 
+    subtrees and leaves, summed over targets, is returned.
+
+    ``mps`` must be recomputed after the tree is constructed, refitted or 
+    loaded. A periodic tree is not supported.
+    */
+    void multipoles(vector<multipole_t> &mps, 
+        const gravity_policy_t &policy = gravity_policy_t()) const;
+
+    template<typename PointT>
+    size_t gravity(const vector<multipole_t> &mps, 
+        ContiguousBuffer<const PointT> targets, vector<pos_t> &accs, 
+        vector<float_t> &pots, 
+        const gravity_policy_t &policy = gravity_policy_t()) const;
 protected:
     std::shared_ptr<impl_t> _impl;
 };
@@ -306,6 +475,18 @@ void _HIPP_TEMPCLS::argsort(ContiguousBuffer<const PointT> pts,
     _impl->argsort(pts, idx_pairs);
 }
 
+_HIPP_TEMPRET
+refit(ContiguousBuffer<const kd_point_t> pts, const refit_policy_t &policy)
+-> void 
+{
+    _impl->refit(pts, policy);
+}
+
+_HIPP_TEMPRET
+refit_info() const noexcept -> const refit_info_t & {
+    return _impl->refit_info();
+}
+
 _HIPP_TEMPRET
 shrink_buffer() -> void {
     _impl->shrink_buffer();
@@ -316,6 +497,28 @@ clear() -> void {
     _impl->clear();
 }
 
+_HIPP_TEMPRET
+save(const string &file_name) const -> void {
+    _impl->save(file_name);
+}
+
+_HIPP_TEMPRET
+load(const string &file_name) -> void {
+    _impl->load(file_name);
+}
+
+_HIPP_TEMPHD
+template<typename H5Group>
+void _HIPP_TEMPCLS::save_h5(H5Group g) const {
+    _impl->save_h5(std::move(g));
+}
+
+_HIPP_TEMPHD
+template<typename H5Group>
+void _HIPP_TEMPCLS::load_h5(H5Group g) {
+    _impl->load_h5(std::move(g));
+}
+
 _HIPP_TEMPRET
 impl() const noexcept -> std::shared_ptr<impl_t> {
     return _impl;
@@ -432,6 +635,72 @@ auto _HIPP_TEMPCLS::count_nodes_sphere(const sphere_t &sphere,
     return _impl->count_sphere(sphere, std::forward<Policy>(policy));
 }
 
+_HIPP_TEMPHD
+template<typename PointT, typename Policy>
+void _HIPP_TEMPCLS::nearest_k_batch(ContiguousBuffer<const PointT> pts, 
+    index_t k, vector<index_t> &displs, vector<ngb_t> &ngbs,
+    const batch_query_policy_t &batch_policy, const Policy &policy) const
+{
+    _impl->nearest_k_batch(pts, k, displs, ngbs, batch_policy, policy);
+}
+
+_HIPP_TEMPHD
+template<typename Policy>
+void _HIPP_TEMPCLS::find_nodes_sphere_batch(
+    ContiguousBuffer<const sphere_t> spheres, 
+    vector<index_t> &displs, vector<index_t> &node_ids,
+    const batch_query_policy_t &batch_policy, const Policy &policy) const
+{
+    _impl->visit_sphere_batch(spheres, displs, node_ids, 
+        batch_policy, policy);
+}
+
+_HIPP_TEMPHD
+template<typename Policy>
+void _HIPP_TEMPCLS::count_nodes_sphere_batch(
+    ContiguousBuffer<const sphere_t> spheres, vector<index_t> &counts,
+    const batch_query_policy_t &batch_policy, const Policy &policy) const
+{
+    _impl->count_sphere_batch(spheres, counts, batch_policy, policy);
+}
+
+_HIPP_TEMPRET
+all_nearest_k(index_t k, vector<index_t> &node_ids, vector<ngb_t> &ngbs,
+    const all_nearest_k_policy_t &policy) const -> index_t
+{
+    return _impl->all_nearest_k(k, node_ids, ngbs, policy);
+}
+
+_HIPP_TEMPRET
+count_pairs(ContiguousBuffer<const float_t> edges, vector<double> &counts,
+    const pair_count_policy_t &policy) const -> void
+{
+    _impl->count_pairs(edges, counts, policy);
+}
+
+_HIPP_TEMPRET
+count_pairs(const BallTree &other, ContiguousBuffer<const float_t> edges, 
+    vector<double> &counts, const pair_count_policy_t &policy) const -> void
+{
+    _impl->count_pairs(*other._impl, edges, counts, policy);
+}
+
+_HIPP_TEMPRET
+multipoles(vector<multipole_t> &mps, const gravity_policy_t &policy) const 
+-> void
+{
+    _impl->multipoles(mps, policy);
+}
+
+_HIPP_TEMPHD
+template<typename PointT>
+size_t _HIPP_TEMPCLS::gravity(const vector<multipole_t> &mps, 
+    ContiguousBuffer<const PointT> targets, vector<pos_t> &accs, 
+    vector<float_t> &pots, const gravity_policy_t &policy) const
+{
+    return _impl->gravity(mps, targets, accs, pots, policy);
+}
+
 #undef _HIPP_TEMPHD
 #undef _HIPP_TEMPARG
 #undef _HIPP_TEMPCLS
@@ -185,6 +185,7 @@ void operator()()
         case alg_t::ROUGH_INSERTION:
         case alg_t::FINE_INSERTION:
         case alg_t::BOTTOM_UP:
+        case alg_t::BATCH_INSERTION:
             run_online();
             break;
         default:
@@ -225,6 +226,8 @@ The algorithm implementation for KD and TOP_DOWN.
 */
 void run_top_down() 
 {
+    verify_args();
+
     auto &ids_src = temp_ids;
     ids_src.resize(n_pts);
     for(index_t i=0; i<n_pts; ++i)
@@ -234,8 +237,41 @@ void run_top_down()
         temp_fs.resize(n_pts);
     }
 
+    if( pl._n_threads > 1 && is_deterministic_split() )
+        construct_parallel(0, n_pts, 0, pl._n_threads);
+    else
+        construct_serial(0, n_pts, 0);
+}
+
+void verify_args() const {
+    if( pl._n_threads < 1 || pl._serial_cutoff < 1 )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB, 
+            "  ... invalid no. of threads ", pl._n_threads, 
+            " or serial cutoff ", pl._serial_cutoff);
+}
+
+/**
+Whether or not the split of a range depends only on the points in it, so that
+disjoint subtrees can be built in any order.
+*/
+bool is_deterministic_split() const noexcept {
+    if( pl.algorithm() == alg_t::TOP_DOWN ) return true;
+    const auto spl_ax = pl.split_axis();
+    return spl_ax == spl_ax_t::MAX_EXTREME || spl_ax == spl_ax_t::MAX_VARIANCE;
+}
+
+/**
+Build the subtree of points in the range ``[b, e)`` of ``temp_ids``, whose 
+root node is at ``n_cur``. The subtree takes ``2*(e-b)-1`` nodes in 
+pre-order, i.e., its left and right subtrees of a split at ``pivot`` are at 
+``n_cur+1`` and ``n_cur+2*(pivot-b)``, respectively.
+*/
+void construct_serial(index_t b, index_t e, const index_t n_beg) 
+{
+    const index_t n_end = n_beg + 2*(e-b) - 1;
+
     std::stack<std::pair<index_t, index_t> > idx_ranges;
-    index_t b = 0, e = n_pts, n_cur = 0;
+    index_t n_cur = n_beg;
     while( b != e || !idx_ranges.empty() ) {
         if( b == e ) {
             std::tie(b,e) = idx_ranges.top(); idx_ranges.pop();
@@ -254,17 +290,43 @@ void run_top_down()
         idx_ranges.emplace(pivot, e);
         e = pivot;
     }
-    assert(n_cur == static_cast<index_t>(nodes.size()));
-
-    while(n_cur-- > 0) {
-        node_t &n = nodes[n_cur];
-        if( n._size > 1 ) {
-            const auto [i_lc, i_rc] = dst.children_ids(n_cur);
-            sphere_t bs = nodes[i_lc].bounding_sphere(nodes[i_rc]);
-            n._center = bs.center();
-            n._r = bs.r();
-        }
+    assert(n_cur == n_end);
+
+    while(n_cur-- > n_beg) 
+        update_bounding_sphere(n_cur);
+}
+
+/**
+Split the top levels with all the ``n_threads`` threads, and hand the two 
+subtrees of each split over to two disjoint groups of threads. The bounding
+sphere of a node is found once both of its subtrees are done.
+*/
+void construct_parallel(index_t b, index_t e, index_t n_cur, int n_threads) 
+{
+    if( n_threads <= 1 || e - b <= pl._serial_cutoff ) {
+        construct_serial(b, e, n_cur); return;
     }
+    
+    // e - b > serial_cutoff >= 1, hence both subtrees are non-empty.
+    const index_t pivot = top_down_split(b, e, n_threads);
+    nodes[n_cur]._size = 2*(e-b)-1;
+    
+    const int n_threads_l = n_threads / 2;
+    std::thread th_l(&_Impl_construct::construct_parallel, this, 
+        b, pivot, n_cur+1, n_threads_l);
+    construct_parallel(pivot, e, n_cur+2*(pivot-b), n_threads-n_threads_l);
+    th_l.join();
+
+    update_bounding_sphere(n_cur);
+}
+
+void update_bounding_sphere(index_t i) noexcept {
+    node_t &n = nodes[i];
+    if( n._size == 1 ) return;
+    const auto [i_lc, i_rc] = dst.children_ids(i);
+    sphere_t bs = nodes[i_lc].bounding_sphere(nodes[i_rc]);
+    n._center = bs.center();
+    n._r = bs.r();
 }
 
 const kd_point_t & get_point(index_t i) const noexcept {
@@ -276,26 +338,26 @@ Must be called with e - b >= 2.
 Return the pivot index. Must give [b, pivot) and [pivot, e) both non-mepty, 
 The entire [b, e) is partially sorted.
 */
-index_t top_down_split(index_t b, index_t e) {
+index_t top_down_split(index_t b, index_t e, int n_threads = 1) {
     return pl.algorithm() == alg_t::KD ? 
-        kd_pivot(b, e) : 
-        top_down_pivot(b, e);
+        kd_pivot(b, e, n_threads) : 
+        top_down_pivot(b, e, n_threads);
 }
 
-index_t kd_pivot(index_t b, index_t e) 
+index_t kd_pivot(index_t b, index_t e, int n_threads) 
 {
-    const int axis = find_best_axis(pl.split_axis(), b, e);
+    const int axis = find_best_axis(pl.split_axis(), b, e, n_threads);
     const index_t pivot = b + (e-b)/2;
     pivot_at(b, pivot, e, axis);
     return pivot;
 }
 
-int find_best_axis(spl_ax_t spl_ax, index_t b, index_t e) 
+int find_best_axis(spl_ax_t spl_ax, index_t b, index_t e, int n_threads) 
 {   
     int axis {};
     switch (spl_ax) {
         case spl_ax_t::MAX_EXTREME :
-            axis = max_extreme_axis(b, e); 
+            axis = max_extreme_axis(b, e, n_threads); 
             break;
         case spl_ax_t::MAX_VARIANCE : 
             axis = max_variance_axis(b, e); 
@@ -310,30 +372,49 @@ int find_best_axis(spl_ax_t spl_ax, index_t b, index_t e)
     return axis;
 }
 
-int max_extreme_axis(index_t b, index_t e) const noexcept 
+/**
+The extremes are reduced over the chunks of threads. Min/max are exact, 
+hence the result does not depend on ``n_threads``.
+*/
+int max_extreme_axis(index_t b, index_t e, int n_threads) const
 {
     using lim = std::numeric_limits<float_t>;
-    pos_t min_pos(lim::max()), max_pos(lim::lowest());
-    for(auto i=b; i<e; ++i){
-        const auto &pos = get_point(i).pos();
-        min_pos[ pos < min_pos ] = pos;
-        max_pos[ pos > max_pos ] = pos;
+    vector<pos_t> min_poss(n_threads, pos_t(lim::max())), 
+        max_poss(n_threads, pos_t(lim::lowest()));
+    _parallel_for(n_threads, e-b, [&](int i_th, index_t _b, index_t _e) {
+        pos_t min_pos(lim::max()), max_pos(lim::lowest());
+        for(auto i=b+_b; i<b+_e; ++i){
+            const auto &pos = get_point(i).pos();
+            min_pos[ pos < min_pos ] = pos;
+            max_pos[ pos > max_pos ] = pos;
+        }
+        min_poss[i_th] = min_pos;
+        max_poss[i_th] = max_pos;
+    });
+    auto &min_pos = min_poss[0], &max_pos = max_poss[0];
+    for(int i=1; i<n_threads; ++i) {
+        min_pos[ min_poss[i] < min_pos ] = min_poss[i];
+        max_pos[ max_poss[i] > max_pos ] = max_poss[i];
     }
     auto ret = (max_pos - min_pos).max_index();
     return static_cast<int>(ret);
 }
 
+/**
+The sums are kept serial, because a different summation order may change 
+the chosen axis.
+*/
 int max_variance_axis(index_t b, index_t e) const noexcept 
 {
     using dvec_t = SVec<double, DIM>;
     
     dvec_t mean_pos(0.0);
-    for(int i=b; i<e; ++i)
+    for(index_t i=b; i<e; ++i)
         mean_pos += dvec_t(get_point(i).pos());
     mean_pos /= static_cast<double>(e-b);
 
     dvec_t pos_var(0.0);
-    for(int i=b; i<e; ++i){
+    for(index_t i=b; i<e; ++i){
         auto dpos = dvec_t(get_point(i).pos()) - mean_pos;
         pos_var += dpos*dpos;
     }
@@ -349,8 +430,10 @@ void pivot_at(index_t b, index_t pivot, index_t e, int axis) {
         });
 }
 
-index_t top_down_pivot(index_t b, index_t e) {
-    auto [axis, pivot] = find_minimal_split_volume(b, e);
+index_t top_down_pivot(index_t b, index_t e, int n_threads) {
+    auto [axis, pivot] = n_threads > 1 ? 
+        find_minimal_split_volume(b, e, n_threads) :
+        find_minimal_split_volume(b, e);
     pivot_at(b, pivot, e, axis);
     return pivot;
 }
@@ -358,45 +441,100 @@ index_t top_down_pivot(index_t b, index_t e) {
 /** Return best direction and pivot. */
 std::pair<int, index_t> find_minimal_split_volume(index_t b, index_t e)
 {
-    vector<index_t> &ids = temp_ids;
-    vector<float_t> &vols = temp_fs;
-    
     int best_axis = 0;
     index_t pivot = b+1;
     float_t min_vol = std::numeric_limits<float_t>::max();
 
     for(int axis=0; axis<DIM; ++axis){
-        
-        // Sort points along axis. 
-        std::sort(ids.data()+b, ids.data()+e, 
-            [&](index_t i, index_t j) {
-                return p_pts[i].pos()[axis] < p_pts[j].pos()[axis];
-            });
-
-        // Fill expanding volumes.
-        sphere_t s { get_point(b), 0 }; vols[b] = 0;
-        for(int i=b+1; i<e-1; ++i){
-            s = s.bounding_sphere(get_point(i)); 
-            vols[i] = insertable_tree_t::node_t::volume(s.r());
-        }
-        s = sphere_t{ get_point(e-1), 0 };
-        for(int i=e-2; i>b; --i){
-            s = s.bounding_sphere(get_point(i));
-            vols[i-1] += insertable_tree_t::node_t::volume(s.r());
+        auto [vol, i] = minimal_split_volume_along(axis, 
+            temp_ids.data()+b, temp_fs.data()+b, e-b);
+        if( vol < min_vol ) {
+            min_vol = vol;
+            best_axis = axis;
+            pivot = b+i;
         }
+    }
+    return {best_axis, pivot};
+}
 
-        for(int i=b; i<e-1; ++i){
-            if( vols[i] < min_vol ) {
-                min_vol = vols[i]; 
-                best_axis = axis;
-                pivot = i+1;
-            }
+/**
+The same as the serial one, but the axes are tried concurrently, each on its 
+own copy of the ids. As the sorting is a strict ordering, the ids are left 
+as sorted along the last axis, as in the serial one.
+*/
+std::pair<int, index_t> find_minimal_split_volume(index_t b, index_t e, 
+    int n_threads)
+{
+    const index_t n = e - b;
+    vector<index_t> ids(n * DIM);
+    vector<float_t> vols(n * DIM);
+    std::pair<float_t, index_t> splits[DIM];
+    _parallel_tasks(n_threads, DIM, [&](int axis) {
+        index_t * const p_ids = ids.data() + n * axis;
+        std::copy_n(temp_ids.data()+b, n, p_ids);
+        splits[axis] = minimal_split_volume_along(axis, 
+            p_ids, vols.data() + n * axis, n);
+    });
+    std::copy_n(ids.data() + n * (DIM-1), n, temp_ids.data()+b);
+
+    int best_axis = 0;
+    index_t pivot = b+1;
+    float_t min_vol = std::numeric_limits<float_t>::max();
+    for(int axis=0; axis<DIM; ++axis){
+        auto [vol, i] = splits[axis];
+        if( vol < min_vol ) {
+            min_vol = vol;
+            best_axis = axis;
+            pivot = b+i;
         }
     }
-
     return {best_axis, pivot};
 }
 
+/**
+Sort ``n >= 2`` points indexed by ``ids`` along ``axis``, and find the split 
+``[0, i), [i, n)`` that minimizes the sum of volumes of the two bounding 
+spheres. ``vols`` is a buffer of ``n`` elements. Return the minimal volume 
+and ``i``.
+
+Ties of coordinates are broken by the point indices, so that the order 
+depends only on the set of points.
+*/
+std::pair<float_t, index_t> minimal_split_volume_along(int axis, 
+    index_t *ids, float_t *vols, index_t n) const
+{
+    auto pt = [&](index_t i) -> const kd_point_t & { 
+        return p_pts[ids[i]]; };
+
+    // Sort points along axis.
+    std::sort(ids, ids+n, [&](index_t i, index_t j) {
+        const float_t xi = p_pts[i].pos()[axis], xj = p_pts[j].pos()[axis];
+        return xi < xj || (xi == xj && i < j);
+    });
+
+    // Fill expanding volumes.
+    sphere_t s { pt(0), 0 }; vols[0] = 0;
+    for(index_t i=1; i<n-1; ++i){
+        s = s.bounding_sphere(pt(i)); 
+        vols[i] = insertable_tree_t::node_t::volume(s.r());
+    }
+    s = sphere_t{ pt(n-1), 0 };
+    for(index_t i=n-2; i>0; --i){
+        s = s.bounding_sphere(pt(i));
+        vols[i-1] += insertable_tree_t::node_t::volume(s.r());
+    }
+
+    float_t min_vol = std::numeric_limits<float_t>::max();
+    index_t pivot = 1;
+    for(index_t i=0; i<n-1; ++i){
+        if( vols[i] < min_vol ) {
+            min_vol = vols[i]; 
+            pivot = i+1;
+        }
+    }
+    return {min_vol, pivot};
+}
+
 
 
 /** Online-insertion based implementation. */
@@ -429,6 +567,13 @@ void insert_points(insertable_tree_t &ins_ballt)
     }
 
     // Make insertions (and refinement for BOTTOM_UP).
+    if( alg == alg_t::BATCH_INSERTION ) {
+        typename insertable_tree_t::batch_insert_policy_t batch_pl(ins_fav);
+        batch_pl.set_n_threads(pl._n_threads);
+        ins_ballt.insert_batch(
+            ContiguousBuffer<const kd_point_t>(p_pts, size_t(n_pts)), batch_pl);
+        return;
+    }
     typename insertable_tree_t::insert_policy_t ins_pl {};
     ins_pl.set_insert_favor(ins_fav);
     for(index_t i=0; i<n_pts; ++i)
@@ -480,6 +625,114 @@ void _HIPP_TEMPCLS::construct(ContiguousBuffer<const kd_point_t> pts,
     const construct_policy_t &policy)
 {
     _Impl_construct{*this, pts, policy}();
+    _refit_info.reset();
+}
+
+_HIPP_TEMPHD
+struct _HIPP_TEMPCLS::_Impl_refit {
+
+    _BallTree &dst;
+    vector<node_t> &nodes;
+    const refit_policy_t &pl;
+    const index_t n_nodes;
+    const kd_point_t * p_pts;
+
+_Impl_refit(_BallTree &_dst, const refit_policy_t &_pl)
+: dst(_dst), nodes(dst._nodes), pl(_pl), n_nodes(nodes.size()), 
+p_pts(nullptr)
+{
+    pl.verify();
+}
+
+void operator()(ContiguousBuffer<const kd_point_t> pts) {
+    const index_t n_leaves = (n_nodes + 1) / 2;
+    if( pts.get_size() != static_cast<size_t>(n_leaves) )
+        ErrLogic::throw_(ErrLogic::eLENGTH, emFLPFB, 
+            "  ... no. of points ", pts.get_size(), 
+            " != no. of leaves ", n_leaves);
+    p_pts = pts.get_cbuff();
+
+    auto &info = dst._refit_info;
+    if( n_nodes == 0 ) {
+        info.add_refit(0.); return;
+    }
+    if( info.n_refits() == 0 )
+        info.set_build_volume( find_volume() );
+    refit(0, 0, pl.n_threads());
+    info.add_refit( find_volume() );
+}
+
+/**
+Refit the subtree rooted at ``i``, whose first leaf takes the point 
+``leaf_b``. The subtrees of the top levels are handed over to disjoint 
+groups of threads, as in the parallel construction.
+*/
+void refit(index_t i, index_t leaf_b, int n_threads) {
+    const index_t s = nodes[i]._size;
+    if( n_threads <= 1 || s <= pl.serial_cutoff() || s == 1 ) {
+        refit_serial(i, leaf_b); return;
+    }
+    const auto [i_lc, i_rc] = dst.children_ids(i);
+    const int n_threads_l = n_threads / 2;
+    std::thread th_l(&_Impl_refit::refit, this, i_lc, leaf_b, n_threads_l);
+    refit(i_rc, leaf_b + (nodes[i_lc]._size+1)/2, n_threads-n_threads_l);
+    th_l.join();
+    update_bounding_sphere(i);
+}
+
+/**
+The leaves are in the same order in the nodes as in the points.
+*/
+void refit_serial(index_t i_root, index_t leaf_b) {
+    const index_t i_end = i_root + nodes[i_root]._size;
+    for(index_t i=i_root; i<i_end; ++i) {
+        if( nodes[i]._size != 1 ) continue;
+        const kd_point_t &pt = p_pts[leaf_b++];
+        nodes[i] = node_t{ pt, 0, 1, pt.pad() };
+    }
+    for(index_t i=i_end; i-- > i_root; )
+        update_bounding_sphere(i);
+}
+
+void update_bounding_sphere(index_t i) noexcept {
+    node_t &n = nodes[i];
+    if( n._size == 1 ) return;
+    const auto [i_lc, i_rc] = dst.children_ids(i);
+    sphere_t bs = nodes[i_lc].bounding_sphere(nodes[i_rc]);
+    n._center = bs.center();
+    n._r = bs.r();
+}
+
+double find_volume() const {
+    const int n_threads = pl.n_threads();
+    vector<double> vols(n_threads, 0.);
+    _parallel_for(n_threads, n_nodes, [&](int i_th, index_t b, index_t e) {
+        double vol = 0.;
+        for(index_t i=b; i<e; ++i) {
+            if( nodes[i]._size == 1 ) continue;
+            double v = 1.;
+            for(int d=0; d<DIM; ++d) v *= nodes[i]._r;
+            vol += v;
+        }
+        vols[i_th] = vol;
+    });
+    double vol = 0.;
+    for(double v: vols) vol += v;
+    return vol;
+}
+
+};
+
+_HIPP_TEMPRET
+refit(ContiguousBuffer<const kd_point_t> pts, const refit_policy_t &policy)
+-> void 
+{
+    _Impl_refit{*this, policy}(pts);
+}
+
+_HIPP_TEMPRET
+refit_info() const noexcept -> const refit_info_t & {
+    return _refit_info;
 }
 
 _HIPP_TEMPHD
@@ -514,6 +767,59 @@ clear() -> void
 {
     _nodes.clear();
     _tree_info = tree_info_t {};
+    _refit_info.reset();
+}
+
+_HIPP_TEMPRET
+save(const string &file_name) const -> void {
+    _FileArchive ar(file_name, true);
+    _save(ar);
+}
+
+_HIPP_TEMPRET
+load(const string &file_name) -> void {
+    _FileArchive ar(file_name, false);
+    _load(ar);
+}
+
+_HIPP_TEMPHD
+template<typename H5Group>
+void _HIPP_TEMPCLS::save_h5(H5Group g) const {
+    _H5Archive<H5Group> ar(std::move(g));
+    _save(ar);
+}
+
+_HIPP_TEMPHD
+template<typename H5Group>
+void _HIPP_TEMPCLS::load_h5(H5Group g) {
+    _H5Archive<H5Group> ar(std::move(g));
+    _load(ar);
+}
+
+_HIPP_TEMPHD
+template<typename Archive>
+void _HIPP_TEMPCLS::_save(Archive &ar) const {
+    _put_layout<node_t, index_t>(ar, "BallTree");
+    ar.put("periodic_box", &_construct_policy._periodic_box.size(), 1);
+    ar.put("max_depth", &_tree_info._max_depth, 1);
+    ar.put("nodes", _nodes.data(), _nodes.size());
+}
+
+_HIPP_TEMPHD
+template<typename Archive>
+void _HIPP_TEMPCLS::_load(Archive &ar) {
+    _check_layout<node_t, index_t>(ar, "BallTree");
+    pos_t box_size;
+    tree_info_t tree_info;
+    vector<node_t> nodes;
+    ar.get("periodic_box", &box_size, 1);
+    ar.get("max_depth", &tree_info._max_depth, 1);
+    ar.get("nodes", nodes);
+
+    _construct_policy.set_periodic_box(box_size);
+    _tree_info = tree_info;
+    _nodes = std::move(nodes);
+    _refit_info.reset();
 }
 
 _HIPP_TEMPRET
@@ -607,7 +913,7 @@ struct _HIPP_TEMPCLS::_Impl_query_base {
 
     const _BallTree &ballt;
     const vector<node_t> &nodes;
-    const pos_t dst_pos;
+    pos_t dst_pos;
 
 _Impl_query_base(const _BallTree &_ballt, const pos_t &_dst_pos) 
 : ballt(_ballt), nodes(ballt._nodes), dst_pos(_dst_pos)
@@ -629,13 +935,14 @@ struct _HIPP_TEMPCLS::_Impl_query_pre_order : _Impl_query_base
 {
 
     using stack_item_t = index_t;
+    typename _QueryBuffPool<index_t>::lease_t stk_lease;
     stack_item_t *const __restrict__ stk_b,
         * __restrict__ stk_e;
     
 _Impl_query_pre_order(const _BallTree &_ballt, const pos_t &_dst_pos, 
     Policy &_pl)
 : _Impl_query_base(_ballt, _dst_pos), stk_b(
-    _pl.get_buff( _ballt._tree_info.max_depth() )
+    stk_lease.get( _ballt._tree_info.max_depth() )
 ), stk_e(stk_b) {}
 
 
@@ -675,7 +982,9 @@ void walk_down(index_t idx, ContainNode &&contain_n,
             op_n(idx); idx = -1;
         } else {
             idx = this->ballt.left_child_idx(idx);
-            this->push_stack( this->ballt.right_sibling_idx(idx) );
+            const index_t r_idx = this->ballt.right_sibling_idx(idx);
+            _prefetch(&this->nodes[r_idx]);
+            this->push_stack(r_idx);
         }
         
     } while( idx >= 0 || stack_not_empty() );
@@ -690,17 +999,29 @@ struct _HIPP_TEMPCLS::_Impl_query_in_order : _Impl_query_base
 
     Policy &pl;
     using stack_item_t = std::pair<index_t, float_t>;
+    typename _QueryBuffPool<stack_item_t>::lease_t stk_lease;
     stack_item_t *const __restrict__ stk_b,
         * __restrict__ stk_e;
 
+    /**
+    prune_f: a subtree is pruned if its minimal distance times 
+    ``prune_f = 1 + eps`` is not less than the current distance.
+    n_visited: number of nodes whose distances are computed.
+    */
+    const float_t prune_f;
+    size_t n_visited;
+
 _Impl_query_in_order(const _BallTree &_ballt, const pos_t &_dst_pos, 
     Policy &_pl) 
 : _Impl_query_base(_ballt, _dst_pos), pl(_pl),
-stk_b(reinterpret_cast<stack_item_t *>(
-    _pl.get_buff(_ballt._tree_info.max_depth()*2) )
-), stk_e(stk_b)
+stk_b( stk_lease.get(_ballt._tree_info.max_depth()) ), stk_e(stk_b), 
+prune_f(1 + _pl.eps()), n_visited(0)
 {}
 
+~_Impl_query_in_order() noexcept {
+    pl._n_visited += n_visited;
+}
+
 void push_stack(const stack_item_t &item) noexcept {
     *stk_e++ = item;
 }
@@ -715,12 +1036,17 @@ bool stack_not_empty() const noexcept {
 
 /** Negative value means ``dst_pos`` is contained in ``n``. */
 float_t minimal_dist_to(const node_t &n) {
+    ++n_visited;
     return this->dist_to(n) - n.r();
 }
 
-template<typename CoverDist, typename Op>
-void walk_down(index_t idx, CoverDist &&cover, Op &&op) noexcept 
+template<typename CoverDist, typename LeafOp>
+void walk_down(index_t idx, CoverDist &&cover, LeafOp &&leaf_op) noexcept 
 {
+    auto op = [&](index_t i, const node_t &n) {
+        ++n_visited; leaf_op(i, n);
+    };
+
     // if a leaf
     const auto &n = this->nodes[idx];
     if( n.size() == 1 ) {
@@ -787,14 +1113,37 @@ dst_idx(node_t::idxNULL) {}
 void operator()() noexcept {
     if( this->nodes.size() == 0 ) return;
 
-    this->walk_down(0, 
-        [this](float_t min_dist) { return min_dist < dst_r; }, 
-        [this](index_t idx, const node_t &n) {
-            const auto r_sq = this->dist_sq_to(n);
-            if( r_sq < dst_r_sq ) {
-                dst_r_sq = r_sq; dst_r = std::sqrt(r_sq); dst_idx = idx;
-            }
-        });
+    const auto &box = this->ballt._construct_policy._periodic_box;
+    if( !box.is_periodic() ) {
+        this->walk_down(0, 
+            [this](float_t min_dist) { 
+                return min_dist * this->prune_f < dst_r; }, 
+            [this](index_t idx, const node_t &n) {
+                const auto r_sq = this->dist_sq_to(n);
+                if( r_sq < dst_r_sq ) {
+                    dst_r_sq = r_sq; dst_r = std::sqrt(r_sq); dst_idx = idx;
+                }
+            });
+        return;
+    }
+
+    // Search each image of the query. A leaf is taken only from the image
+    // nearest to it.
+    const pos_t q = box.wrap(this->dst_pos);
+    box.visit_images(q, dst_r_sq, [&](const pos_t &img, int code) {
+        this->dst_pos = img;
+        this->walk_down(0, 
+            [this](float_t min_dist) { 
+                return min_dist * this->prune_f < dst_r; }, 
+            [&](index_t idx, const node_t &n) {
+                const auto r_sq = this->dist_sq_to(n);
+                if( r_sq < dst_r_sq 
+                    && box.image_of(n.center().pos(), q) == code ) 
+                {
+                    dst_r_sq = r_sq; dst_r = std::sqrt(r_sq); dst_idx = idx;
+                }
+            });
+    });
 }
 };
 
@@ -833,12 +1182,29 @@ void operator()() noexcept {
 
     if( dst_k == 0 ) return;
 
-    this->walk_down(0, 
-        [this](float_t min_dst) { return min_dst < max_r; }, 
-        [this](index_t idx, const node_t &n) {
-            push_queue(idx, this->dist_sq_to(n));
-        }
-    );
+    const auto &box = this->ballt._construct_policy._periodic_box;
+    if( !box.is_periodic() ) {
+        this->walk_down(0, 
+            [this](float_t min_dst) { 
+                return min_dst * this->prune_f < max_r; }, 
+            [this](index_t idx, const node_t &n) {
+                push_queue(idx, this->dist_sq_to(n));
+            }
+        );
+    } else {
+        const pos_t q = box.wrap(this->dst_pos);
+        box.visit_images(q, max_r_sq, [&](const pos_t &img, int code) {
+            this->dst_pos = img;
+            this->walk_down(0, 
+                [this](float_t min_dst) { 
+                    return min_dst * this->prune_f < max_r; }, 
+                [&](index_t idx, const node_t &n) {
+                    if( box.image_of(n.center().pos(), q) == code )
+                        push_queue(idx, this->dist_sq_to(n));
+                }
+            );
+        });
+    }
 
     if( this->pl.sort_by_distance() )
         std::sort_heap(max_queue_b, max_queue_b+used_k);
@@ -917,8 +1283,16 @@ template<typename OpNode, typename OpLeaf,
 void _HIPP_TEMPCLS::visit_rect(const rect_t &rect, OpNode op_n, OpLeaf op_l,
     Policy &&policy) const
 {
-    _Impl_visit_rect<OpNode, OpLeaf, std::remove_reference_t<Policy> > 
-        {*this, policy, rect, op_n, op_l} ();
+    using impl_t = _Impl_visit_rect<OpNode, OpLeaf, 
+        std::remove_reference_t<Policy> >;
+    const auto &box = _construct_policy._periodic_box;
+    if( !box.is_periodic() ) {
+        impl_t {*this, policy, rect, op_n, op_l} ();
+        return;
+    }
+    box.visit_rect_images(rect, [&](const rect_t &img) {
+        impl_t {*this, policy, img, op_n, op_l} ();
+    });
 }
 
 _HIPP_TEMPHD
@@ -974,8 +1348,20 @@ template<typename OpNode, typename OpLeaf, typename Policy>
 void _HIPP_TEMPCLS::visit_sphere(const sphere_t &sphere, OpNode op_n, 
     OpLeaf op_l, Policy &&policy) const
 {
-    _Impl_visit_sphere<OpNode, OpLeaf, std::remove_reference_t<Policy> > 
-        {*this, policy, sphere, op_n, op_l} ();
+    using impl_t = _Impl_visit_sphere<OpNode, OpLeaf, 
+        std::remove_reference_t<Policy> >;
+    const auto &box = _construct_policy._periodic_box;
+    if( !box.is_periodic() ) {
+        impl_t {*this, policy, sphere, op_n, op_l} ();
+        return;
+    }
+    box.check_radius(sphere.r());
+    const float_t r_sq = sphere.r() * sphere.r();
+    box.visit_images(box.wrap(sphere.center().pos()), r_sq, 
+        [&](const pos_t &img, int) {
+            impl_t {*this, policy, sphere_t(point_t(img), sphere.r()), 
+                op_n, op_l} ();
+        });
 }
 
 _HIPP_TEMPHD
@@ -994,6 +1380,655 @@ auto _HIPP_TEMPCLS::count_sphere(const sphere_t &sphere,
     return (cnt_intern + n_intern)/2 + cnt_leaf;
 }
 
+_HIPP_TEMPHD
+template<typename PointT, typename Policy>
+void _HIPP_TEMPCLS::nearest_k_batch(ContiguousBuffer<const PointT> pts, 
+    index_t k, vector<index_t> &displs, vector<ngb_t> &ngbs,
+    const batch_query_policy_t &batch_policy, const Policy &policy) const
+{
+    if( k < 0 )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB, 
+            "  ... invalid k=", k);
+    
+    auto [p_pts, n_pts] = pts;
+    _BatchQuery<index_t> bq(batch_policy, n_pts);
+    bq.sort_by(*this, pts);
+    
+    vector<Policy> pls(bq.n_threads(), policy);
+    bq.gather([&](int i_th, index_t i, vector<ngb_t> &buf) {
+        const size_t b = buf.size();
+        buf.resize(b + k);
+        const index_t n = nearest_k(p_pts[i], 
+            ContiguousBuffer<ngb_t>(buf.data()+b, k), pls[i_th]);
+        buf.resize(b + n);
+    }, displs, ngbs);
+}
+
+_HIPP_TEMPHD
+template<typename Policy>
+void _HIPP_TEMPCLS::visit_sphere_batch(
+    ContiguousBuffer<const sphere_t> spheres, 
+    vector<index_t> &displs, vector<index_t> &node_ids,
+    const batch_query_policy_t &batch_policy, const Policy &policy) const
+{
+    auto [p_spheres, n_spheres] = spheres;
+    _BatchQuery<index_t> bq(batch_policy, n_spheres);
+    bq.sort_by_centers(*this, spheres);
+
+    vector<Policy> pls(bq.n_threads(), policy);
+    bq.gather([&](int i_th, index_t i, vector<index_t> &buf) {
+        visit_sphere(p_spheres[i], 
+            [&buf, this](index_t node_idx) { 
+                // Leaves of a subtree are in its depth-first range.
+                const index_t e = node_idx + _nodes[node_idx].size();
+                for(index_t j=node_idx+1; j<e; ++j)
+                    if( _nodes[j].size() == 1 ) buf.push_back(j);
+            },
+            [&buf](index_t node_idx) { buf.push_back(node_idx); }, 
+            pls[i_th]);
+    }, displs, node_ids);
+}
+
+_HIPP_TEMPHD
+template<typename Policy>
+void _HIPP_TEMPCLS::count_sphere_batch(
+    ContiguousBuffer<const sphere_t> spheres, vector<index_t> &counts,
+    const batch_query_policy_t &batch_policy, const Policy &policy) const
+{
+    auto [p_spheres, n_spheres] = spheres;
+    _BatchQuery<index_t> bq(batch_policy, n_spheres);
+    bq.sort_by_centers(*this, spheres);
+
+    counts.resize(n_spheres);
+    vector<Policy> pls(bq.n_threads(), policy);
+    bq.for_each([&](int i_th, index_t i) {
+        counts[i] = count_sphere(p_spheres[i], pls[i_th]);
+    });
+}
+
+_HIPP_TEMPHD
+struct _HIPP_TEMPCLS::_Impl_all_nearest_k {
+
+    /**
+    Pairs of subtrees with no more than BRUTE_SIZE nodes each are matched by 
+    brute force. The query tree is cut so that there are about 
+    TASKS_PER_THREAD subtrees for each thread.
+    */
+    static constexpr index_t BRUTE_SIZE = 15;
+    static constexpr index_t TASKS_PER_THREAD = 16;
+
+    using rows_t = _KNNRows<ngb_t, index_t>;
+
+    const _BallTree &ballt;
+    const vector<node_t> &nodes;
+    const index_t n_nodes;
+    const all_nearest_k_policy_t &pl;
+    const bool include_self;
+
+    index_t n_leaves, k_used;
+    std::optional<rows_t> rows;
+    
+    /**
+    first_rows[i]: the row of the first leaf in the subtree rooted at node i.
+    Leaves in a subtree are contiguous in DFS order, hence their rows.
+    */
+    vector<index_t> first_rows;
+    vector<float_t> bounds;
+
+_Impl_all_nearest_k(const _BallTree &_ballt, index_t k, 
+    const all_nearest_k_policy_t &_pl)
+: ballt(_ballt), nodes(ballt._nodes), n_nodes(nodes.size()), pl(_pl),
+include_self(pl.include_self())
+{
+    if( k < 0 || pl.n_threads() < 1 )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB, 
+            "  ... invalid k=", k, " or no. of threads ", pl.n_threads());
+    n_leaves = (n_nodes + 1) / 2;
+    k_used = std::min(k, include_self ? n_leaves : n_leaves - 1);
+    if( k_used < 0 ) k_used = 0;
+}
+
+void operator()(vector<index_t> &node_ids, vector<ngb_t> &ngbs) {
+    node_ids.clear();
+    node_ids.reserve(n_leaves);
+    first_rows.resize(n_nodes);
+    for(index_t i=0; i<n_nodes; ++i) {
+        first_rows[i] = node_ids.size();
+        if( nodes[i].size() == 1 ) node_ids.push_back(i);
+    }
+    ngbs.resize(size_t(n_leaves) * k_used);
+    if( k_used == 0 ) return;
+
+    rows.emplace(ngbs.data(), n_leaves, k_used);
+    if( ballt._construct_policy._periodic_box.is_periodic() ) {
+        periodic(node_ids);
+        rows->sort_rows(pl.n_threads());
+        return;
+    }
+    bounds.assign(n_nodes, std::numeric_limits<float_t>::max());
+    
+    vector<index_t> subtrees;
+    cut_tree(subtrees);
+    _parallel_tasks(pl.n_threads(), index_t(subtrees.size()), 
+        [&](index_t i) { dual(node_ids, subtrees[i], 0); });
+
+    rows->sort_rows(pl.n_threads());
+}
+
+/**
+The dual-tree bounds are not valid under the periodic boundary. Each leaf 
+is then queried separately.
+*/
+void periodic(const vector<index_t> &node_ids) {
+    _parallel_for(pl.n_threads(), n_leaves, [&](int, index_t b, index_t e) {
+        vector<ngb_t> buf(k_used + 1);
+        nearest_k_query_policy_t qpl;
+        for(index_t i=b; i<e; ++i) {
+            const index_t idx = node_ids[i];
+            const index_t n = ballt.nearest_k(nodes[idx].center(), 
+                ContiguousBuffer<ngb_t>(buf.data(), buf.size()), qpl);
+            for(index_t j=0; j<n; ++j) {
+                const auto &ngb = buf[j];
+                if( ngb.node_idx == idx && !include_self ) continue;
+                rows->push(i, ngb.node_idx, ngb.r_sq);
+            }
+        }
+    });
+}
+
+void cut_tree(vector<index_t> &subtrees) const {
+    const index_t n_min = pl.n_threads() > 1 ? 
+        TASKS_PER_THREAD * pl.n_threads() : 1;
+    vector<index_t> cur {0}, next;
+    while( index_t(cur.size()) < n_min ) {
+        next.clear();
+        for(auto i: cur) {
+            if( nodes[i].size() == 1 ) { subtrees.push_back(i); continue; }
+            const auto [l, r] = ballt.children_ids(i);
+            next.push_back(l); next.push_back(r);
+        }
+        if( next.empty() ) return;
+        cur.swap(next);
+    }
+    subtrees.insert(subtrees.end(), cur.begin(), cur.end());
+}
+
+float_t ball_dist_sq(index_t q, index_t r) const noexcept {
+    const auto &nq = nodes[q], &nr = nodes[r];
+    const float_t d = (nq.center().pos() - nr.center().pos()).norm() 
+        - nq.r() - nr.r();
+    return d > 0 ? d * d : float_t(0);
+}
+
+/**
+Subtree ``q`` against the subtree ``r``. ``bounds[q]`` is an upper bound of 
+the k-th neighbor distance of all leaves in ``q``.
+*/
+void dual(const vector<index_t> &node_ids, index_t q, index_t r) noexcept {
+    if( ball_dist_sq(q, r) >= bounds[q] ) return;
+
+    const index_t sz_q = nodes[q].size(), sz_r = nodes[r].size();
+    if( sz_q <= BRUTE_SIZE && sz_r <= BRUTE_SIZE ) {
+        const index_t row_b = first_rows[q], row_e = row_b + (sz_q+1)/2,
+            r_b = first_rows[r], r_e = r_b + (sz_r+1)/2;
+        float_t b = 0;
+        for(index_t i=row_b; i<row_e; ++i) {
+            const index_t qi = node_ids[i];
+            const auto &p = nodes[qi].center().pos();
+            for(index_t j=r_b; j<r_e; ++j) {
+                const index_t rj = node_ids[j];
+                if( rj == qi && !include_self ) continue;
+                const float_t r_sq = (p - nodes[rj].center().pos())
+                    .squared_norm();
+                rows->push(i, rj, r_sq);
+            }
+            b = std::max(b, rows->kth(i));
+        }
+        bounds[q] = b;
+        return;
+    }
+
+    if( sz_r == 1 || (sz_q > 1 && sz_q >= sz_r) ) {
+        const auto [l, rr] = ballt.children_ids(q);
+        dual(node_ids, l, r); 
+        dual(node_ids, rr, r);
+        bounds[q] = std::min(bounds[q], std::max(bounds[l], bounds[rr]));
+        return;
+    }
+
+    auto [l, rr] = ballt.children_ids(r);
+    if( ball_dist_sq(q, rr) < ball_dist_sq(q, l) ) std::swap(l, rr);
+    dual(node_ids, q, l); 
+    dual(node_ids, q, rr);
+}
+
+};
+
+_HIPP_TEMPRET
+all_nearest_k(index_t k, vector<index_t> &node_ids, vector<ngb_t> &ngbs, 
+    const all_nearest_k_policy_t &policy) const -> index_t
+{
+    _Impl_all_nearest_k impl {*this, k, policy};
+    impl(node_ids, ngbs);
+    return impl.k_used;
+}
+
+/**
+Adaptor of the pair counting engine. An entity is the subtree rooted at a
+node, whose points are the leaves in it.
+*/
+_HIPP_TEMPHD
+struct _HIPP_TEMPCLS::_Impl_count_pairs {
+
+    using float_t = typename _BallTree::float_t;
+    using index_t = typename _BallTree::index_t;
+
+    /**
+    Per-tree data. r_safe[i]: a radius of node i that encloses all its leaves,
+    recomputed bottom-up in double precision, as the radii of the constructed
+    nodes may be rounded down. w[i]: the weight of leaf i. w_sum[i], 
+    w_sq_sum[i]: sum of the weights and their squares in the subtree rooted at
+    node i. scale: the magnitude of the coordinates.
+    */
+    struct side_t {
+        const _BallTree &ballt;
+        vector<double> r_safe, w, w_sum, w_sq_sum;
+        double scale;
+    };
+
+    struct entity_t {
+        const side_t *s;
+        index_t i;
+    };
+
+    /**
+    Relative and absolute tolerance of the bounds, in unit of the machine 
+    epsilon of ``float_t``, to cover the rounding errors of the distances 
+    between leaves.
+    */
+    static constexpr double TOL_REL = 4 * (DIM + 3), TOL_ABS = 16;
+
+    const periodic_box_t &box;
+    const bool periodic;
+    side_t side_a;
+    std::optional<side_t> side_b;
+    double scale;
+
+_Impl_count_pairs(const _BallTree &ballt_a, const _BallTree *ballt_b, 
+    const pair_count_policy_t &pl)
+: box(ballt_a._construct_policy._periodic_box), periodic(box.is_periodic()),
+side_a{ballt_a, {}, {}, {}, {}, 0.}
+{
+    init_side(side_a, pl);
+    scale = side_a.scale;
+    if( ballt_b ) {
+        side_b.emplace(side_t{*ballt_b, {}, {}, {}, {}, 0.});
+        init_side(*side_b, pl);
+        scale = std::max(scale, side_b->scale);
+    }
+    if( periodic ) 
+        for(int k=0; k<DIM; ++k) scale = std::max(scale, double(box.size()[k]));
+}
+
+void operator()(ContiguousBuffer<const float_t> edges, 
+    vector<double> &counts, const pair_count_policy_t &pl) const
+{
+    _PairBins<float_t> bins(edges);
+    _PairCounter<_Impl_count_pairs> counter(*this, bins, pl.n_threads());
+    if( side_b ) 
+        counter.count_cross(root(side_a), root(*side_b), counts);
+    else 
+        counter.count_self(root(side_a), counts);
+}
+
+static void init_side(side_t &s, const pair_count_policy_t &pl) {
+    const auto &ballt = s.ballt;
+    const auto &nodes = ballt._nodes;
+    const index_t n_nodes = nodes.size();
+    s.w.assign(n_nodes, 1.);
+    if( pl.weighted() ) {
+        if constexpr( PADDING >= sizeof(float_t) ) {
+            for(index_t i=0; i<n_nodes; ++i)
+                if( nodes[i].size() == 1 ) 
+                    s.w[i] = nodes[i].template pad<float_t>();
+        } else {
+            ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB,
+                "  ... weighted pair counting requires a padding of at "
+                "least ", sizeof(float_t), " bytes (got ", PADDING, ")\n");
+        }
+    }
+
+    s.r_safe.assign(n_nodes, 0.);
+    s.w_sum.resize(n_nodes);
+    s.w_sq_sum.resize(n_nodes);
+    s.scale = 0.;
+    for(index_t i=n_nodes-1; i>=0; --i) {
+        const auto &c = nodes[i].center().pos();
+        for(int k=0; k<DIM; ++k) 
+            s.scale = std::max(s.scale, std::fabs(double(c[k])));
+        if( nodes[i].size() == 1 ) {
+            s.w_sum[i] = s.w[i];
+            s.w_sq_sum[i] = s.w[i] * s.w[i];
+            continue;
+        }
+        const auto [l, r] = ballt.children_ids(i);
+        double r_safe = nodes[i].r();
+        for(index_t j: {l, r}) {
+            const auto &c_j = nodes[j].center().pos();
+            double d_sq = 0.;
+            for(int k=0; k<DIM; ++k) {
+                const double dx = double(c[k]) - double(c_j[k]);
+                d_sq += dx * dx;
+            }
+            r_safe = std::max(r_safe, std::sqrt(d_sq) + s.r_safe[j]);
+        }
+        s.r_safe[i] = r_safe;
+        s.w_sum[i] = s.w_sum[l] + s.w_sum[r];
+        s.w_sq_sum[i] = s.w_sq_sum[l] + s.w_sq_sum[r];
+    }
+}
+
+static entity_t root(const side_t &s) noexcept {
+    return {&s, 0};
+}
+
+index_t size(const entity_t &e) const noexcept { 
+    const auto &nodes = e.s->ballt._nodes;
+    return nodes.empty() ? index_t(0) : (nodes[e.i].size() + 1) / 2;
+}
+
+bool is_leaf(const entity_t &e) const noexcept {
+    return e.s->ballt._nodes[e.i].size() == 1;
+}
+
+int split(const entity_t &e, entity_t *parts) const noexcept {
+    const auto [l, r] = e.s->ballt.children_ids(e.i);
+    parts[0] = {e.s, l};
+    parts[1] = {e.s, r};
+    return 2;
+}
+
+double weight(const entity_t &e) const noexcept {
+    return e.s->w_sum[e.i];
+}
+
+double weight_sq(const entity_t &e) const noexcept {
+    return e.s->w_sq_sum[e.i];
+}
+
+std::pair<float_t, float_t> bounds(const entity_t &a, 
+    const entity_t &b) const noexcept 
+{
+    const auto &c_a = a.s->ballt._nodes[a.i].center().pos(),
+        &c_b = b.s->ballt._nodes[b.i].center().pos();
+    double d_sq = 0.;
+    for(int k=0; k<DIM; ++k) {
+        double dx = std::fabs(double(c_a[k]) - double(c_b[k]));
+        const double L = box.size()[k];
+        if( periodic && L > 0 ) dx = std::min(dx, std::fabs(dx - L));
+        d_sq += dx * dx;
+    }
+    const double d = std::sqrt(d_sq), 
+        r = a.s->r_safe[a.i] + b.s->r_safe[b.i];
+    return to_bounds(d - r, d + r);
+}
+
+float_t self_bound(const entity_t &a) const noexcept {
+    const double r = a.s->r_safe[a.i];
+    return to_bounds(0., 2 * r).second;
+}
+
+std::pair<float_t, float_t> to_bounds(double d_min, double d_max) 
+const noexcept {
+    constexpr double eps = std::numeric_limits<float_t>::epsilon();
+    const double tol = eps * (TOL_REL * d_max + TOL_ABS * scale);
+    d_min = std::max(0., d_min - tol);
+    d_max += tol;
+    return {float_t(d_min * d_min), float_t(d_max * d_max)};
+}
+
+template<typename Op>
+void brute(const entity_t &a, const entity_t &b, Op &&op) const {
+    const auto &na = a.s->ballt._nodes, &nb = b.s->ballt._nodes;
+    const auto &wa = a.s->w, &wb = b.s->w;
+    const index_t e_a = a.i + na[a.i].size(), e_b = b.i + nb[b.i].size();
+    for(index_t i=a.i; i<e_a; ++i) {
+        if( na[i].size() != 1 ) continue;
+        const auto &p = na[i].center().pos();
+        for(index_t j=b.i; j<e_b; ++j) {
+            if( nb[j].size() != 1 ) continue;
+            op(r_sq_of(p, nb[j].center().pos()), wa[i] * wb[j]);
+        }
+    }
+}
+
+template<typename Op>
+void brute_self(const entity_t &a, Op &&op) const {
+    const auto &nodes = a.s->ballt._nodes;
+    const auto &w = a.s->w;
+    const index_t e = a.i + nodes[a.i].size();
+    for(index_t i=a.i; i<e; ++i) {
+        if( nodes[i].size() != 1 ) continue;
+        const auto &p = nodes[i].center().pos();
+        for(index_t j=i+1; j<e; ++j) {
+            if( nodes[j].size() != 1 ) continue;
+            op(r_sq_of(p, nodes[j].center().pos()), w[i] * w[j]);
+        }
+    }
+}
+
+float_t r_sq_of(const pos_t &p, const pos_t &q) const noexcept {
+    return periodic ? box.r_sq(p, q) : float_t((p - q).squared_norm());
+}
+
+};
+
+_HIPP_TEMPRET
+count_pairs(ContiguousBuffer<const float_t> edges, vector<double> &counts, 
+    const pair_count_policy_t &policy) const -> void
+{
+    _Impl_count_pairs impl {*this, nullptr, policy};
+    impl(edges, counts, policy);
+}
+
+_HIPP_TEMPRET
+count_pairs(const _BallTree &other, ContiguousBuffer<const float_t> edges, 
+    vector<double> &counts, const pair_count_policy_t &policy) const -> void
+{
+    _Impl_count_pairs impl {*this, &other, policy};
+    impl(edges, counts, policy);
+}
+
+_HIPP_TEMPHD
+struct _HIPP_TEMPCLS::_Impl_gravity {
+
+    const _BallTree &ballt;
+    const vector<node_t> &nodes;
+    const index_t n_nodes;
+    const gravity_policy_t &pl;
+
+_Impl_gravity(const _BallTree &_ballt, const gravity_policy_t &_pl)
+: ballt(_ballt), nodes(ballt._nodes), n_nodes(nodes.size()), pl(_pl)
+{
+    pl.verify();
+    if( ballt._construct_policy._periodic_box.is_periodic() )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB,
+            "  ... tree-code gravity requires a non-periodic tree\n");
+}
+
+/**
+Children follow their parents in DFS order, hence the moments are found in 
+the reverse order.
+*/
+void multipoles(vector<multipole_t> &mps) const {
+    mps.resize(n_nodes);
+    for(index_t i=n_nodes-1; i>=0; --i) {
+        const node_t &n = nodes[i];
+        if( n.size() == 1 ) {
+            mps[i].set_point(n.center().pos(), mass_of(n));
+            continue;
+        }
+        const auto [l, r] = ballt.children_ids(i);
+        mps[i].merge(mps[l], mps[r], n.center().pos(), n.r());
+    }
+}
+
+float_t mass_of(const node_t &n) const {
+    if( !pl.weighted() ) return float_t(1);
+    if constexpr( PADDING >= sizeof(float_t) ) {
+        return n.template pad<float_t>();
+    } else {
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB,
+            "  ... weighted gravity requires a padding of at least ", 
+            sizeof(float_t), " bytes (got ", PADDING, ")\n");
+    }
+    return float_t(0);
+}
+
+template<typename PointT>
+size_t gravity(const vector<multipole_t> &mps, 
+    ContiguousBuffer<const PointT> targets, vector<pos_t> &accs, 
+    vector<float_t> &pots) const
+{
+    if( mps.size() != size_t(n_nodes) )
+        ErrLogic::throw_(ErrLogic::eLENGTH, emFLPFB, 
+            "  ... no. of multipoles ", mps.size(), 
+            " != no. of nodes ", n_nodes);
+
+    const index_t n_tgts = targets.get_size();
+    accs.assign(n_tgts, pos_t(float_t(0)));
+    pots.assign(n_tgts, float_t(0));
+    if( n_nodes == 0 || n_tgts == 0 ) return 0;
+
+    // Targets close in the tree order are grouped.
+    vector<idx_pair_t> idx_pairs;
+    ballt.argsort(targets, idx_pairs);
+    vector<index_t> order(n_tgts);
+    for(index_t i=0; i<n_tgts; ++i) order[i] = idx_pairs[i].idx_in;
+    idx_pairs = vector<idx_pair_t>();
+
+    const index_t g_size = pl.group_size(), 
+        n_groups = (n_tgts + g_size - 1) / g_size;
+    const auto p_tgts = targets.get_cbuff();
+    vector<size_t> n_accepts(pl.n_threads(), 0);
+    _parallel_for(pl.n_threads(), n_groups, 
+        [&](int i_th, index_t b, index_t e) 
+    {
+        _GravityList<float_t, DIM> list;
+        size_t n_accept = 0;
+        for(index_t i_g=b; i_g<e; ++i_g) {
+            const index_t *ids = order.data() + i_g * g_size,
+                n_ids = std::min(g_size, n_tgts - i_g * g_size);
+            walk(mps.data(), p_tgts, ids, n_ids, list);
+            for(index_t i=0; i<n_ids; ++i) {
+                const point_t &p = p_tgts[ids[i]];
+                n_accept += eval(list, p.pos(), accs[ids[i]], pots[ids[i]]);
+            }
+        }
+        n_accepts[i_th] = n_accept;
+    });
+    size_t n_accept = 0;
+    for(auto n: n_accepts) n_accept += n;
+    return n_accept;
+}
+
+/**
+Pre-order walk from the root for a group of targets bounded by a sphere 
+``(c, r_g)``. A subtree is accepted if ``b_max < theta * (d - r_g)``, where
+``d`` is the distance from ``c`` to its center of mass, i.e., if it is 
+accepted by every target in the group. On exit, ``list`` holds the 
+accepted internal nodes and leaves.
+
+The right child of an opened node is pushed, so that the stack holds at most
+one node per level.
+*/
+template<typename PointT>
+void walk(const multipole_t *mps, const PointT *p_tgts, const index_t *ids, 
+    index_t n_ids, _GravityList<float_t, DIM> &list) const
+{
+    double c[DIM] = {}, r_g = 0.;
+    for(index_t i=0; i<n_ids; ++i) {
+        const point_t &p = p_tgts[ids[i]];
+        for(int k=0; k<DIM; ++k) c[k] += p.pos()[k];
+    }
+    for(int k=0; k<DIM; ++k) c[k] /= n_ids;
+    for(index_t i=0; i<n_ids; ++i) {
+        const point_t &p = p_tgts[ids[i]];
+        double d_sq = 0.;
+        for(int k=0; k<DIM; ++k) {
+            const double d = p.pos()[k] - c[k];
+            d_sq += d * d;
+        }
+        r_g = std::max(r_g, std::sqrt(d_sq));
+    }
+
+    const double theta = pl.opening_angle();
+    list.clear();
+    typename _QueryBuffPool<index_t>::lease_t stk_lease;
+    index_t *const stk_b = stk_lease.get(ballt._tree_info.max_depth()),
+        *stk_e = stk_b, idx = 0;
+    while( true ) {
+        if( nodes[idx].size() == 1 ) {
+            list.add_point(mps[idx]);
+        } else {
+            const multipole_t &mp = mps[idx];
+            double d_sq = 0.;
+            for(int k=0; k<DIM; ++k) {
+                const double d = c[k] - double(mp.com()[k]);
+                d_sq += d * d;
+            }
+            const double d = std::sqrt(d_sq) - r_g;
+            if( d > 0. && mp.b_max() < theta * d ) {
+                list.add_node(mp);
+            } else {
+                const auto [l, r] = ballt.children_ids(idx);
+                _prefetch(&mps[r]);
+                *stk_e++ = r;
+                idx = l; continue;
+            }
+        }
+        if( stk_e == stk_b ) break;
+        idx = *--stk_e;
+    }
+}
+
+/**
+Sum the field of the accepted nodes at target ``x``. Return the number of 
+nodes that contribute, i.e., excluding the points at ``x`` when the 
+softening is 0.
+*/
+size_t eval(const _GravityList<float_t, DIM> &list, const pos_t &x, 
+    pos_t &acc, float_t &pot) const noexcept
+{
+    const double eps_sq = pl.softening() * pl.softening();
+    const bool quadrupole = 
+        pl.order() == gravity_policy_t::order_t::QUADRUPOLE;
+    double a[DIM], phi;
+    const size_t n_accept = list.eval(x, eps_sq, quadrupole, a, phi);
+    const double G = pl.grav_const();
+    for(int k=0; k<DIM; ++k) acc[k] = G * a[k];
+    pot = G * phi;
+    return n_accept;
+}
+
+};
+
+_HIPP_TEMPRET
+multipoles(vector<multipole_t> &mps, const gravity_policy_t &policy) const 
+-> void
+{
+    _Impl_gravity{*this, policy}.multipoles(mps);
+}
+
+_HIPP_TEMPHD
+template<typename PointT>
+size_t _HIPP_TEMPCLS::gravity(const vector<multipole_t> &mps, 
+    ContiguousBuffer<const PointT> targets, vector<pos_t> &accs, 
+    vector<float_t> &pots, const gravity_policy_t &policy) const
+{
+    return _Impl_gravity{*this, policy}.gravity(mps, targets, accs, pots);
+}
+
 #undef _HIPP_TEMPHD
 #undef _HIPP_TEMPARG
 #undef _HIPP_TEMPCLS
@@ -1012,6 +2047,8 @@ construct_policy_t() : _rng(0, DIM-1, &_re) {
     set_bottom_up_insert_favor(DFLT_BOTTOM_UP_INSERT_FAVOR);
     set_split_axis(DFLT_SPLIT_AXIS);
     set_random_seed(DFLT_RANDOM_SEED);
+    set_n_threads(DFLT_N_THREADS);
+    set_serial_cutoff(DFLT_SERIAL_CUTOFF);
 }
 
 _HIPP_TEMPNORET
@@ -1020,6 +2057,9 @@ construct_policy_t(const construct_policy_t &pl) : construct_policy_t() {
     set_bottom_up_insert_favor(pl._bottom_up_insert_favor);
     set_split_axis(pl._split_axis);
     set_random_seed(pl._random_seed);
+    _periodic_box = pl._periodic_box;
+    set_n_threads(pl._n_threads);
+    set_serial_cutoff(pl._serial_cutoff);
 }
 
 _HIPP_TEMPRET
@@ -1029,6 +2069,9 @@ operator=(const construct_policy_t & pl) -> const construct_policy_t & {
         set_bottom_up_insert_favor(pl._bottom_up_insert_favor);
         set_split_axis(pl._split_axis);
         set_random_seed(pl._random_seed);
+        _periodic_box = pl._periodic_box;
+        set_n_threads(pl._n_threads);
+        set_serial_cutoff(pl._serial_cutoff);
     }
     return *this;
 }
@@ -1037,8 +2080,9 @@ _HIPP_TEMPRET
 info(ostream &os, int fmt_cntl, int level) const -> ostream & {
     PStream ps{os};
     
-    static const char * const alg_strs[5] = {
-        "KD", "TOP_DOWN", "ROUGH_INSERTION", "FINE_INSERTION", "BOTTOM_UP"};
+    static const char * const alg_strs[6] = {
+        "KD", "TOP_DOWN", "ROUGH_INSERTION", "FINE_INSERTION", "BOTTOM_UP",
+        "BATCH_INSERTION"};
     const char * const alg 
         = alg_strs[static_cast<int>(_algorithm)];
 
@@ -1054,13 +2098,18 @@ info(ostream &os, int fmt_cntl, int level) const -> ostream & {
     if( fmt_cntl < 1 ) {
         ps << HIPPCNTL_CLASS_INFO_INLINE(_BallTree::construct_policy_t),
         "{algorithm=", alg, ", bottom up insert favor=", ins_fav, 
-        ", split axis=", ax, ", random seed=", _random_seed, "}";
+        ", split axis=", ax, ", random seed=", _random_seed, 
+        ", periodic box=", _periodic_box.size(), 
+        ", n threads=", _n_threads, ", serial cutoff=", _serial_cutoff, "}";
         return os;
     }
     auto ind = HIPPCNTL_CLASS_INFO_INDENT_STR(level);
     ps << HIPPCNTL_CLASS_INFO(_BallTree::construct_policy_t),
     ind, "Algorithm = ", alg, ", bottom up insert favor = ", ins_fav, '\n',
-    ind, "Split axis = ", ax, ", random seed = ", _random_seed, '\n';
+    ind, "Split axis = ", ax, ", random seed = ", _random_seed, '\n',
+    ind, "Periodic box = ", _periodic_box.size(), '\n',
+    ind, "No. threads = ", _n_threads, 
+         ", serial cutoff = ", _serial_cutoff, '\n';
     return os;
 }
 _HIPP_TEMPRET
@@ -1115,6 +2164,45 @@ set_random_seed(random_seed_t seed) -> construct_policy_t &
     return *this;
 }
 
+_HIPP_TEMPRET
+periodic_box() const noexcept -> const periodic_box_t &
+{
+    return _periodic_box;
+}
+
+_HIPP_TEMPRET
+set_periodic_box(float_t box_size) noexcept -> construct_policy_t &
+{
+    return set_periodic_box(pos_t(box_size));
+}
+
+_HIPP_TEMPRET
+set_periodic_box(const pos_t &box_size) noexcept -> construct_policy_t &
+{
+    _periodic_box = periodic_box_t(box_size);
+    return *this;
+}
+
+_HIPP_TEMPRET
+n_threads() const noexcept -> int {
+    return _n_threads;
+}
+
+_HIPP_TEMPRET
+set_n_threads(int n_threads) noexcept -> construct_policy_t & {
+    _n_threads = n_threads; return *this;
+}
+
+_HIPP_TEMPRET
+serial_cutoff() const noexcept -> index_t {
+    return _serial_cutoff;
+}
+
+_HIPP_TEMPRET
+set_serial_cutoff(index_t serial_cutoff) noexcept -> construct_policy_t & {
+    _serial_cutoff = serial_cutoff; return *this;
+}
+
 #undef _HIPP_TEMPHD
 #undef _HIPP_TEMPARG
 #undef _HIPP_TEMPCLS
@@ -1187,7 +2275,7 @@ container() const noexcept -> const container_t &
 #define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
 
 _HIPP_TEMPNORET
-nearest_k_query_policy_t() noexcept {
+nearest_k_query_policy_t() noexcept : _eps(0), _n_visited(0) {
     sort_by_distance_off();
 }
 
@@ -1208,6 +2296,71 @@ sort_by_distance_off() noexcept -> nearest_k_query_policy_t & {
     return *this;
 }
 
+_HIPP_TEMPRET
+eps() const noexcept -> float_t {
+    return _eps;
+}
+
+_HIPP_TEMPRET
+set_eps(float_t eps) -> nearest_k_query_policy_t & {
+    if( !(eps >= 0) )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB, 
+            "  ... invalid eps=", eps, '\n');
+    _eps = eps;
+    return *this;
+}
+
+_HIPP_TEMPRET
+n_visited() const noexcept -> size_t {
+    return _n_visited;
+}
+
+_HIPP_TEMPRET
+reset_n_visited() noexcept -> nearest_k_query_policy_t & {
+    _n_visited = 0;
+    return *this;
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
+
+#define _HIPP_TEMPHD template<typename KDPointT, typename IndexT>
+#define _HIPP_TEMPARG <KDPointT, IndexT>
+#define _HIPP_TEMPCLS _BallTree _HIPP_TEMPARG::nearest_query_policy_t
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPNORET
+nearest_query_policy_t() noexcept : _eps(0), _n_visited(0) {}
+
+_HIPP_TEMPRET
+eps() const noexcept -> float_t {
+    return _eps;
+}
+
+_HIPP_TEMPRET
+set_eps(float_t eps) -> nearest_query_policy_t & {
+    if( !(eps >= 0) )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB, 
+            "  ... invalid eps=", eps, '\n');
+    _eps = eps;
+    return *this;
+}
+
+_HIPP_TEMPRET
+n_visited() const noexcept -> size_t {
+    return _n_visited;
+}
+
+_HIPP_TEMPRET
+reset_n_visited() noexcept -> nearest_query_policy_t & {
+    _n_visited = 0;
+    return *this;
+}
+
 #undef _HIPP_TEMPHD
 #undef _HIPP_TEMPARG
 #undef _HIPP_TEMPCLS
@@ -7,6 +7,13 @@ create: Yangyao CHEN, 2022/04/15
 #define _HIPPNUMERICAL_KDSEARCH_BALTREE_RAW_H_
 
 #include "kdsearch_base.h"
+#include "kdsearch_batch_query.h"
+#include "kdsearch_dual_tree.h"
+#include "kdsearch_pair_count.h"
+#include "kdsearch_archive.h"
+#include "kdsearch_periodic.h"
+#include "kdsearch_refit.h"
+#include "kdsearch_gravity.h"
 #include "kdsearch_insertable_balltree_raw_impl.h"
 
 namespace HIPP::NUMERICAL::_KDSEARCH {
@@ -90,6 +97,7 @@ public:
     using point_t  = typename node_t::point_t;
     using pos_t    = typename node_t::pos_t;
     using rect_t   = GEOMETRY::Rect<float_t, DIM>;
+    using periodic_box_t = _PeriodicBox<float_t, DIM>;
 
     using insertable_tree_t = _InsertableBallTree<kd_point_t, index_t>;
 
@@ -103,6 +111,13 @@ public:
     class nearest_k_query_policy_t;
     class rect_query_policy_t;
     class sphere_query_policy_t;
+    using batch_query_policy_t = _BatchQueryPolicy;
+    using all_nearest_k_policy_t = _AllNearestKPolicy;
+    using pair_count_policy_t = _PairCountPolicy;
+    using refit_policy_t = _RefitPolicy;
+    using refit_info_t = _RefitInfo;
+    using gravity_policy_t = _GravityPolicy;
+    using multipole_t = _Multipole<float_t, DIM>;
 
     _BallTree() noexcept;
 
@@ -135,6 +150,22 @@ public:
     void argsort(ContiguousBuffer<const PointT> pts, 
         vector<idx_pair_t> &idx_pairs) const;
 
+    /**
+    Refit the tree to moved points, keeping the topology. 
+    
+    ``pts[i]`` is the new point (position and padding) of the ``i``-th leaf
+    in pre-order, hence ``pts.size()`` must equal the number of leaves. The
+    spheres of the internal nodes are then found bottom-up, each bounding 
+    the spheres of its two children, as in the construction.
+
+    refit_info(): the growth of the total volume (``r^DIM``) of the internal 
+    spheres since the construction (see ``_RefitInfo``), to tell when a 
+    reconstruction is worth it.
+    */
+    void refit(ContiguousBuffer<const kd_point_t> pts, 
+        const refit_policy_t &policy = refit_policy_t());
+    const refit_info_t & refit_info() const noexcept;
+
     /**
     Memory management methods.
     
@@ -149,6 +180,22 @@ public:
     void shrink_buffer();
     void clear();
 
+    /**
+    Save the tree structure (nodes and tree info), or load it to replace the 
+    current one.
+
+    save(), load(): use a flat binary file named ``file_name`` (see 
+    ``_FileArchive`` for the format).
+    save_h5(), load_h5(): use a HDF5 group ``g`` typed ``IO::H5::Group``.
+
+    The tree must be loaded by a ``_BallTree`` with the same point and index 
+    types. Otherwise, an ``ErrRuntime`` is thrown.
+    */
+    void save(const string &file_name) const;
+    void load(const string &file_name);
+    template<typename H5Group> void save_h5(H5Group g) const;
+    template<typename H5Group> void load_h5(H5Group g);
+
     const construct_policy_t & construct_policy() const noexcept;
     construct_policy_t & construct_policy() noexcept;
     const vector<node_t> & nodes() const noexcept;
@@ -207,12 +254,100 @@ public:
     template<typename Policy = sphere_query_policy_t>
     index_t count_sphere(const sphere_t &sphere,
         Policy &&policy = Policy()) const;
+
+    /**
+    Batch queries. Each thread makes queries with its own copy of ``policy``.
+    The results of query ``i`` are in ``[displs[i], displs[i+1])`` of the flat
+    output array. ``visit_sphere_batch()`` gives the indices of the leaves in 
+    each query sphere.
+    */
+    template<typename PointT, typename Policy = nearest_k_query_policy_t>
+    void nearest_k_batch(ContiguousBuffer<const PointT> pts, index_t k,
+        vector<index_t> &displs, vector<ngb_t> &ngbs,
+        const batch_query_policy_t &batch_policy = batch_query_policy_t(),
+        const Policy &policy = Policy()) const;
+
+    template<typename Policy = sphere_query_policy_t>
+    void visit_sphere_batch(ContiguousBuffer<const sphere_t> spheres,
+        vector<index_t> &displs, vector<index_t> &node_ids,
+        const batch_query_policy_t &batch_policy = batch_query_policy_t(),
+        const Policy &policy = Policy()) const;
+    template<typename Policy = sphere_query_policy_t>
+    void count_sphere_batch(ContiguousBuffer<const sphere_t> spheres,
+        vector<index_t> &counts,
+        const batch_query_policy_t &batch_policy = batch_query_policy_t(),
+        const Policy &policy = Policy()) const;
+
+    /**
+    All-k-nearest-neighbor query by the dual-tree algorithm, i.e., find the 
+    first k nearest leaves of every leaf in the tree.
+
+    On exit, ``node_ids`` is resized to the number of leaves ``N`` and 
+    holds the leaf indices in DFS order. ``ngbs`` is resized to 
+    ``N * k_used``, where ``k_used = min(k, N)`` if the leaf itself is 
+    included as a neighbor, otherwise ``min(k, N-1)``. The neighbors of leaf 
+    ``node_ids[i]`` are ``ngbs[i*k_used : (i+1)*k_used]``, sorted by 
+    distance. ``k_used`` is returned.
+    */
+    index_t all_nearest_k(index_t k, vector<index_t> &node_ids, 
+        vector<ngb_t> &ngbs, const all_nearest_k_policy_t &policy 
+            = all_nearest_k_policy_t()) const;
+
+    /**
+    Binned pair counting of the leaves by the dual-tree algorithm. ``edges`` 
+    are the ascending bin edges of the pair distance (see ``_PairBins``). On 
+    exit, ``counts`` is resized to the number of bins, holding the (weighted)
+    number of pairs in each bin.
+
+    (1): auto pairs, i.e., unordered pairs of distinct leaves in the tree.
+    (2): cross pairs, i.e., pairs of a leaf in this tree and a leaf in 
+    ``other``.
+    
+    Distances are the minimum-image ones if the tree (this one, for (2)) is 
+    constructed with a periodic box.
+    */
+    void count_pairs(ContiguousBuffer<const float_t> edges, 
+        vector<double> &counts, const pair_count_policy_t &policy 
+            = pair_count_policy_t()) const;
+    void count_pairs(const _BallTree &other, 
+        ContiguousBuffer<const float_t> edges, vector<double> &counts, 
+        const pair_count_policy_t &policy = pair_count_policy_t()) const;
+
+    /**
+    Barnes-Hut tree-code gravity of the leaves, taken as point masses.
+
+    multipoles(): the upward pass. On exit, ``mps`` is resized to the number
+    of nodes, and ``mps[i]`` holds the moments of the subtree rooted at node
+    ``i`` (see ``_Multipole``). Only the masses (see ``policy.weighted()``)
+    are read from ``policy``.
+
+    gravity(): the acceleration ``accs[i]`` and potential ``pots[i]`` at 
+    ``targets[i]``, from the moments ``mps`` found by ``multipoles()`` on 
+    the current tree. Groups of targets walk the tree from the root, 
+    accepting subtrees by the opening criterion of ``policy``. Return the 
+    number of accepted subtrees and leaves, summed over targets.
+
+    The tree must not be periodic, otherwise an ``ErrLogic`` is thrown.
+    */
+    void multipoles(vector<multipole_t> &mps, 
+        const gravity_policy_t &policy = gravity_policy_t()) const;
+
+    template<typename PointT>
+    size_t gravity(const vector<multipole_t> &mps, 
+        ContiguousBuffer<const PointT> targets, vector<pos_t> &accs, 
+        vector<float_t> &pots, 
+        const gravity_policy_t &policy = gravity_policy_t()) const;
 private:
     construct_policy_t _construct_policy;
     tree_info_t _tree_info;
     vector<node_t> _nodes;
+    refit_info_t _refit_info;
 
     struct _Impl_construct;
+    struct _Impl_refit;
+
+    template<typename Archive> void _save(Archive &ar) const;
+    template<typename Archive> void _load(Archive &ar);
 
     /**
     Base classes for neighbor searching implementation. 
@@ -236,6 +371,10 @@ private:
     struct _Impl_visit_rect;
     template<typename OpNode, typename OpLeaf, typename Policy> 
     struct _Impl_visit_sphere;    
+
+    struct _Impl_all_nearest_k;
+    struct _Impl_count_pairs;
+    struct _Impl_gravity;
 };
 
 template<typename KDPointT, typename IndexT>
@@ -246,7 +385,8 @@ public:
         TOP_DOWN, 
         ROUGH_INSERTION, 
         FINE_INSERTION, 
-        BOTTOM_UP };
+        BOTTOM_UP,
+        BATCH_INSERTION };
     static constexpr algorithm_t 
         DFLT_ALGORITHM = algorithm_t::BOTTOM_UP;
     
@@ -267,6 +407,9 @@ public:
     using random_seed_t = rng_t::seed_t;
     static constexpr random_seed_t DFLT_RANDOM_SEED = 0;
 
+    static constexpr int DFLT_N_THREADS = 1;
+    static constexpr index_t DFLT_SERIAL_CUTOFF = 1 << 16;
+
     construct_policy_t();
     construct_policy_t(const construct_policy_t &pl);
     const construct_policy_t & operator=(const construct_policy_t & pl);
@@ -279,7 +422,9 @@ public:
     construct_policy_t & set_algorithm(algorithm_t algorithm) noexcept;
 
     /**
-    Control the insertion favor when using BOTTOM_UP construction.
+    Control the insertion favor when using BOTTOM_UP or BATCH_INSERTION 
+    construction. BATCH_INSERTION inserts all points as a single batch (see
+    ``_InsertableBallTree::insert_batch()``).
     */
     insert_favor_t bottom_up_insert_favor() const noexcept;
     construct_policy_t & set_bottom_up_insert_favor(
@@ -290,6 +435,35 @@ public:
 
     random_seed_t random_seed() const noexcept;
     construct_policy_t & set_random_seed(random_seed_t seed);
+
+    /**
+    Periodic boundary, with the same meaning as that of ``_KDTree``. Along 
+    each axis ``i`` with ``box_size[i] > 0``, all points must be in 
+    ``[0, box_size[i])``. Queries take the minimum-image distances. A sphere
+    query requires the radius to be no larger than half the box size.
+    */
+    const periodic_box_t & periodic_box() const noexcept;
+    construct_policy_t & set_periodic_box(float_t box_size) noexcept;
+    construct_policy_t & set_periodic_box(const pos_t &box_size) noexcept;
+
+    /**
+    Parallel construction for KD and TOP_DOWN. If ``n_threads > 1``, the 
+    subtrees are built concurrently by at most ``n_threads`` threads, and the 
+    split at each of the top levels is found by all the threads of the 
+    subtree. A range with no more than ``serial_cutoff`` points is always 
+    built by a single thread.
+
+    The resulting tree is exactly the same as the serial one. With KD, the
+    ``split_axis_t::ORDERED`` and ``split_axis_t::RANDOM`` modes depend on the 
+    depth-first visiting order, hence they are always built serially.
+
+    BATCH_INSERTION passes ``n_threads`` to the batch insertion.
+    */
+    int n_threads() const noexcept;
+    construct_policy_t & set_n_threads(int n_threads) noexcept;
+
+    index_t serial_cutoff() const noexcept;
+    construct_policy_t & set_serial_cutoff(index_t serial_cutoff) noexcept;
 private:
     friend class _BallTree;
 
@@ -302,6 +476,11 @@ private:
     random_seed_t _random_seed;
     rng_t::engine_t _re;
     rng_t _rng;
+
+    periodic_box_t _periodic_box;
+
+    int _n_threads;
+    index_t _serial_cutoff;
 };
 
 template<typename KDPointT, typename IndexT>
@@ -338,6 +517,14 @@ struct _BallTree<KDPointT, IndexT>::ngb_t {
 };
 
 
+/**
+Base of the query policies. The traversal stacks of the queries are taken 
+from a thread-local pool (see ``_QueryBuffPool``), hence a query made with a 
+temporary policy (e.g., the default argument) allocates nothing in the 
+steady state, and a policy may be shared by nested queries. ``get_buff()`` 
+and ``container()`` are a buffer owned by the policy, left for the 
+user-defined use.
+*/
 template<typename KDPointT, typename IndexT>
 class _BallTree<KDPointT, IndexT>::query_buff_policy_t {
 public:
@@ -354,7 +541,31 @@ protected:
 template<typename KDPointT, typename IndexT>
 class _BallTree<KDPointT, IndexT>::nearest_query_policy_t : 
     public query_buff_policy_t 
-{};
+{
+public:
+    nearest_query_policy_t() noexcept;
+
+    /**
+    Approximate search. A subtree is pruned if its lower-bound distance to 
+    the query, times ``1 + eps``, is not less than the distance to the 
+    current result, i.e., the result is at most ``1 + eps`` times farther 
+    than the exact one. ``eps = 0`` (default) gives the exact search.
+    */
+    float_t eps() const noexcept;
+    nearest_query_policy_t & set_eps(float_t eps);
+
+    /**
+    Number of nodes whose distances to the query are computed, accumulated 
+    over the queries made with this policy.
+    */
+    size_t n_visited() const noexcept;
+    nearest_query_policy_t & reset_n_visited() noexcept;
+protected:
+    friend class _BallTree;
+
+    float_t _eps;
+    size_t _n_visited;
+};
 
 template<typename KDPointT, typename IndexT>
 class _BallTree<KDPointT, IndexT>::nearest_k_query_policy_t : 
@@ -365,8 +576,22 @@ public:
     bool sort_by_distance() const noexcept;
     nearest_k_query_policy_t & sort_by_distance_on() noexcept;
     nearest_k_query_policy_t & sort_by_distance_off() noexcept;
+
+    /**
+    Approximate search and node-visit counts, the same as 
+    ``nearest_query_policy_t``. With ``eps > 0``, the i-th neighbor found 
+    is at most ``1 + eps`` times farther than the exact i-th one.
+    */
+    float_t eps() const noexcept;
+    nearest_k_query_policy_t & set_eps(float_t eps);
+    size_t n_visited() const noexcept;
+    nearest_k_query_policy_t & reset_n_visited() noexcept;
 protected:
+    friend class _BallTree;
+
     bool _sort_by_distance;
+    float_t _eps;
+    size_t _n_visited;
 };
 
 template<typename KDPointT, typename IndexT>
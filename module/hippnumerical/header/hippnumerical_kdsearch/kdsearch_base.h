@@ -2,6 +2,8 @@
 create: Yangyao CHEN, 2022/02/14
     [write   ] KDPoint - The spatial point type used as input of space-searching 
         algorithms.
+    [write   ] _KDSEARCH::_parallel_for, _parallel_tasks - Multithreaded loops
+        shared by the space-searching algorithms.
 */
 
 #ifndef _HIPPNUMERICAL_KDSEARCH_BASE_H_
@@ -9,6 +11,10 @@ create: Yangyao CHEN, 2022/02/14
 
 #include "../hippnumerical_geometry/geometry.h"
 #include <optional>
+#include <thread>
+#include <exception>
+#include <atomic>
+#include <type_traits>
 
 namespace HIPP::NUMERICAL {
 
@@ -127,4 +133,172 @@ const T & _HIPP_TEMPCLS::pad() const noexcept {
 
 } // namespace HIPP::NUMERICAL
 
+namespace HIPP::NUMERICAL::_KDSEARCH {
+
+/**
+Split the index range ``[0, n)`` into ``n_threads`` contiguous chunks and call 
+``op(i_thread, b, e)`` for each chunk ``[b, e)`` concurrently. The calling 
+thread processes the chunk ``0``. Empty chunks are not visited, i.e., at most 
+``n`` threads are used.
+
+Exceptions thrown by ``op`` are caught in each thread. After all threads are 
+joined, the first one (in the order of chunks) is rethrown.
+*/
+template<typename IndexT, typename Op>
+void _parallel_for(int n_threads, IndexT n, Op &&op) {
+    if( n <= 0 ) return;
+    if( static_cast<IndexT>(n_threads) > n ) 
+        n_threads = static_cast<int>(n);
+    if( n_threads <= 1 ) {
+        op(0, IndexT(0), n); return;
+    }
+
+    const IndexT chunk = n / n_threads, rem = n % n_threads;
+    vector<std::exception_ptr> errs(n_threads);
+    auto run = [&](int i) {
+        const IndexT i_ = i,
+            b = chunk * i_ + std::min(i_, rem),
+            e = b + chunk + (i_ < rem ? 1 : 0);
+        try {
+            op(i, b, e);
+        } catch( ... ) {
+            errs[i] = std::current_exception();
+        }
+    };
+
+    vector<std::thread> ths;
+    ths.reserve(n_threads-1);
+    for(int i=1; i<n_threads; ++i) ths.emplace_back(run, i);
+    run(0);
+    for(auto &th: ths) th.join();
+    for(auto &err: errs) 
+        if( err ) std::rethrow_exception(err);
+}
+
+/**
+Run ``op(i_task)`` for each ``i_task`` in ``[0, n_tasks)`` by ``n_threads``
+threads. Tasks are dynamically scheduled in ascending order.
+*/
+template<typename IndexT, typename Op>
+void _parallel_tasks(int n_threads, IndexT n_tasks, Op &&op) {
+    std::atomic<IndexT> next {0};
+    _parallel_for(n_threads, static_cast<IndexT>(n_threads),
+        [&](int, IndexT, IndexT) {
+            IndexT i;
+            while( (i = next++) < n_tasks ) op(i);
+        });
+}
+
+/**
+Hint the processor to load the cache line at ``p`` for reading, e.g., a node
+to be visited soon by a traversal. No effect if the compiler does not 
+support it.
+*/
+inline void _prefetch(const void *p) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(p, 0, 3);
+#else
+    (void)p;
+#endif
+}
+
+/**
+Whether or not a query policy type ``Policy`` defines a node filter, i.e., 
+a method ``accept_node(idx)`` that returns ``false`` for the nodes that must 
+not be taken as results.
+*/
+template<typename Policy, typename IndexT, typename = void>
+struct _HasNodeFilter : std::false_type {};
+
+template<typename Policy, typename IndexT>
+struct _HasNodeFilter<Policy, IndexT, std::void_t<decltype(
+    std::declval<const Policy &>().accept_node(std::declval<IndexT>()) )> > 
+: std::true_type {};
+
+/**
+Thread-local pool of query buffers (e.g., the traversal stacks), so that the
+queries made with temporary policy objects allocate nothing once the
+buffers of the calling thread have grown to the needed sizes.
+
+A ``lease_t`` takes a buffer from the pool of the calling thread on
+construction and returns it on destruction. Leases on a thread must be
+nested (i.e., returned in the reverse order), which is the case for a query
+made in the callback of another one. A buffer is never shrunk.
+*/
+template<typename T>
+class _QueryBuffPool {
+public:
+    class lease_t {
+    public:
+        lease_t();
+        ~lease_t() noexcept;
+        lease_t(const lease_t &) = delete;
+        lease_t & operator=(const lease_t &) = delete;
+
+        /**
+        buff(): the leased buffer. Its content is left by the last lessee.
+        get(): resize the buffer to at least ``n`` elements and return its 
+        data.
+        */
+        vector<T> & buff() noexcept;
+        T * get(size_t n);
+    protected:
+        vector<T> *_buff;
+    };
+
+    /**
+    Number of buffers created, and the number leased, on the calling thread.
+    */
+    static size_t n_buffs() noexcept;
+    static size_t n_leased() noexcept;
+protected:
+    struct _pool_t {
+        vector<std::unique_ptr<vector<T> > > buffs;
+        size_t n_leased = 0;
+    };
+    static _pool_t & _local_pool() noexcept;
+};
+
+template<typename T>
+_QueryBuffPool<T>::lease_t::lease_t() {
+    auto &pool = _local_pool();
+    if( pool.n_leased == pool.buffs.size() )
+        pool.buffs.emplace_back(std::make_unique<vector<T> >());
+    _buff = pool.buffs[pool.n_leased++].get();
+}
+
+template<typename T>
+_QueryBuffPool<T>::lease_t::~lease_t() noexcept {
+    --_local_pool().n_leased;
+}
+
+template<typename T>
+vector<T> & _QueryBuffPool<T>::lease_t::buff() noexcept {
+    return *_buff;
+}
+
+template<typename T>
+T * _QueryBuffPool<T>::lease_t::get(size_t n) {
+    if( _buff->size() < n ) _buff->resize(n);
+    return _buff->data();
+}
+
+template<typename T>
+size_t _QueryBuffPool<T>::n_buffs() noexcept {
+    return _local_pool().buffs.size();
+}
+
+template<typename T>
+size_t _QueryBuffPool<T>::n_leased() noexcept {
+    return _local_pool().n_leased;
+}
+
+template<typename T>
+auto _QueryBuffPool<T>::_local_pool() noexcept -> _pool_t & {
+    thread_local _pool_t pool;
+    return pool;
+}
+
+} // namespace HIPP::NUMERICAL::_KDSEARCH
+
 #endif	//_HIPPNUMERICAL_KDSEARCH_BASE_H_
\ No newline at end of file
@@ -0,0 +1,298 @@
+/**
+create: Yangyao CHEN, 2026/10/17
+    [write   ] _BatchQueryPolicy - policy of the batch queries.
+    [write   ] _BatchQuery - shared implementation of the batch queries of the
+        space-searching algorithms.
+*/
+
+#ifndef _HIPPNUMERICAL_KDSEARCH_BATCH_QUERY_H_
+#define _HIPPNUMERICAL_KDSEARCH_BATCH_QUERY_H_
+
+#include "kdsearch_base.h"
+
+namespace HIPP::NUMERICAL::_KDSEARCH {
+
+/**
+Policy of the batch queries.
+
+n_threads: the number of threads used to process the queries. Each thread
+keeps its own copy of the single-query policy (hence its own query buffer).
+
+sort_queries: if on, the queries are processed in the order given by the
+``argsort()`` of the searching instance, i.e., spatially close queries are
+processed successively to improve cache locality. The results are always
+stored in the order of the input queries.
+*/
+class _BatchQueryPolicy {
+public:
+    static constexpr int DFLT_N_THREADS = 1;
+    static constexpr bool DFLT_SORT_QUERIES = false;
+
+    _BatchQueryPolicy() noexcept;
+
+    ostream & info(ostream &os = cout, int fmt_cntl = 0, int level = 0) const;
+    friend ostream & operator<< (ostream &os,
+        const _BatchQueryPolicy &pl) { return pl.info(os); }
+
+    int n_threads() const noexcept;
+    _BatchQueryPolicy & set_n_threads(int n_threads) noexcept;
+
+    bool sort_queries() const noexcept;
+    _BatchQueryPolicy & sort_queries_on() noexcept;
+    _BatchQueryPolicy & sort_queries_off() noexcept;
+protected:
+    int _n_threads;
+    bool _sort_queries;
+};
+
+/**
+Shared implementation of the batch queries. ``op(i_thread, i_query, ...)``
+is called for each query, where ``i_thread`` is the index of the thread in
+``[0, pl.n_threads())`` and ``i_query`` is the index into the input queries.
+
+for_each(): call ``op(i_thread, i_query)`` on each query.
+gather(): call ``op(i_thread, i_query, buf)`` on each query, where ``op``
+appends the results of that query to the thread-local vector ``buf``.
+On exit, the results are concatenated in the order of the queries into
+``results``, with ``displs`` (size ``n_queries+1``) the CSR-style offsets,
+i.e., the results of query ``i`` are in ``[displs[i], displs[i+1])``.
+*/
+template<typename IndexT>
+class _BatchQuery {
+public:
+    using index_t = IndexT;
+    using policy_t = _BatchQueryPolicy;
+
+    _BatchQuery(const policy_t &pl, index_t n_queries);
+
+    /**
+    Set the processing order by the argsort results ``idx_pairs``, i.e.,
+    ``idx_pairs[i].idx_in`` is the i-th query to process. Queries absent in
+    ``idx_pairs`` are processed at last.
+    */
+    template<typename IdxPairT>
+    void set_order(const vector<IdxPairT> &idx_pairs);
+
+    /**
+    Set the processing order by calling ``searcher.argsort()`` on the query
+    points ``pts``, or on the centers of the query spheres ``spheres``, if the
+    policy requires so and the searcher is not empty.
+    */
+    template<typename Searcher, typename PointT>
+    void sort_by(const Searcher &searcher, ContiguousBuffer<const PointT> pts);
+
+    template<typename Searcher, typename SphereT>
+    void sort_by_centers(const Searcher &searcher, 
+        ContiguousBuffer<const SphereT> spheres);
+
+    template<typename Op>
+    void for_each(Op &&op) const;
+
+    template<typename ResultT, typename Op>
+    void gather(Op &&op, vector<index_t> &displs,
+        vector<ResultT> &results) const;
+
+    index_t query_idx(index_t i) const noexcept;
+    int n_threads() const noexcept;
+protected:
+    const policy_t &_pl;
+    index_t _n_queries;
+    vector<index_t> _order;
+
+    /**
+    Whether or not the searcher is empty. A tree is tested by its max depth,
+    because a bucketed KDTree keeps no node in ``nodes()``. Other searchers
+    are tested by their nodes.
+    */
+    template<typename Searcher>
+    static auto _is_empty(const Searcher &searcher, int) noexcept
+        -> decltype(searcher.tree_info(), bool());
+    template<typename Searcher>
+    static bool _is_empty(const Searcher &searcher, long) noexcept;
+};
+
+inline _BatchQueryPolicy::_BatchQueryPolicy() noexcept {
+    set_n_threads(DFLT_N_THREADS);
+    _sort_queries = DFLT_SORT_QUERIES;
+}
+
+inline ostream & _BatchQueryPolicy::info(ostream &os, int fmt_cntl,
+    int level) const
+{
+    PStream ps{os};
+    if( fmt_cntl < 1 ) {
+        ps << HIPPCNTL_CLASS_INFO_INLINE(_BatchQueryPolicy),
+        "{n threads=", _n_threads, ", sort queries=", _sort_queries, "}";
+        return os;
+    }
+    auto ind = HIPPCNTL_CLASS_INFO_INDENT_STR(level);
+    ps << HIPPCNTL_CLASS_INFO(_BatchQueryPolicy),
+    ind, "No. threads = ", _n_threads,
+         ", sort queries = ", _sort_queries, '\n';
+    return os;
+}
+
+inline int _BatchQueryPolicy::n_threads() const noexcept {
+    return _n_threads;
+}
+
+inline _BatchQueryPolicy &
+_BatchQueryPolicy::set_n_threads(int n_threads) noexcept {
+    _n_threads = n_threads; return *this;
+}
+
+inline bool _BatchQueryPolicy::sort_queries() const noexcept {
+    return _sort_queries;
+}
+
+inline _BatchQueryPolicy & _BatchQueryPolicy::sort_queries_on() noexcept {
+    _sort_queries = true; return *this;
+}
+
+inline _BatchQueryPolicy & _BatchQueryPolicy::sort_queries_off() noexcept {
+    _sort_queries = false; return *this;
+}
+
+#define _HIPP_TEMPHD template<typename IndexT>
+#define _HIPP_TEMPARG <IndexT>
+#define _HIPP_TEMPCLS _BatchQuery _HIPP_TEMPARG
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPNORET
+_BatchQuery(const policy_t &pl, index_t n_queries)
+: _pl(pl), _n_queries(n_queries)
+{
+    if( _pl.n_threads() < 1 )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB,
+            "  ... invalid no. of threads ", _pl.n_threads());
+}
+
+_HIPP_TEMPHD
+template<typename IdxPairT>
+void _HIPP_TEMPCLS::set_order(const vector<IdxPairT> &idx_pairs) {
+    _order.clear();
+    _order.reserve(_n_queries);
+    for(auto &idx_pr: idx_pairs)
+        _order.push_back(idx_pr.idx_in);
+
+    const index_t n_sorted = _order.size();
+    if( n_sorted == _n_queries ) return;
+
+    vector<bool> sorted(_n_queries, false);
+    for(index_t i=0; i<n_sorted; ++i)
+        sorted[_order[i]] = true;
+    for(index_t i=0; i<_n_queries; ++i)
+        if( !sorted[i] ) _order.push_back(i);
+}
+
+_HIPP_TEMPHD
+template<typename Searcher, typename PointT>
+void _HIPP_TEMPCLS::sort_by(const Searcher &searcher, 
+    ContiguousBuffer<const PointT> pts) 
+{
+    if( !_pl.sort_queries() || _n_queries == 0 
+        || _is_empty(searcher, 0) ) return;
+
+    vector<typename Searcher::idx_pair_t> idx_pairs;
+    searcher.template argsort<PointT>(pts, idx_pairs);
+    set_order(idx_pairs);
+}
+
+_HIPP_TEMPHD
+template<typename Searcher, typename SphereT>
+void _HIPP_TEMPCLS::sort_by_centers(const Searcher &searcher, 
+    ContiguousBuffer<const SphereT> spheres) 
+{
+    if( !_pl.sort_queries() || _n_queries == 0 ) return;
+
+    using point_t = typename SphereT::point_t;
+    vector<point_t> centers;
+    centers.reserve(_n_queries);
+    for(auto &sphere: spheres) 
+        centers.push_back(sphere.center());
+    sort_by<Searcher, point_t>(searcher, centers);
+}
+
+_HIPP_TEMPHD
+template<typename Op>
+void _HIPP_TEMPCLS::for_each(Op &&op) const {
+    _parallel_for(n_threads(), _n_queries,
+        [&](int i_th, index_t b, index_t e) {
+            for(index_t i=b; i<e; ++i) op(i_th, query_idx(i));
+        });
+}
+
+_HIPP_TEMPHD
+template<typename ResultT, typename Op>
+void _HIPP_TEMPCLS::gather(Op &&op, vector<index_t> &displs,
+    vector<ResultT> &results) const
+{
+    const int n_th = n_threads();
+    vector<vector<ResultT> > bufs(n_th);
+    vector<index_t> local_displs(_n_queries);
+    displs.assign(_n_queries+1, 0);
+
+    // Each thread stores the results in its own buffer. The counts are
+    // temporarily put at displs[i+1].
+    _parallel_for(n_th, _n_queries, [&](int i_th, index_t b, index_t e) {
+        auto &buf = bufs[i_th];
+        for(index_t i=b; i<e; ++i) {
+            const index_t i_q = query_idx(i);
+            const index_t old_size = buf.size();
+            op(i_th, i_q, buf);
+            local_displs[i_q] = old_size;
+            displs[i_q+1] = buf.size() - old_size;
+        }
+    });
+
+    for(index_t i=0; i<_n_queries; ++i)
+        displs[i+1] += displs[i];
+    results.resize(displs[_n_queries]);
+
+    // The same partition as above, so that thread i_th reads bufs[i_th].
+    _parallel_for(n_th, _n_queries, [&](int i_th, index_t b, index_t e) {
+        const auto &buf = bufs[i_th];
+        for(index_t i=b; i<e; ++i) {
+            const index_t i_q = query_idx(i),
+                n = displs[i_q+1] - displs[i_q];
+            std::copy_n(buf.data() + local_displs[i_q], n,
+                results.data() + displs[i_q]);
+        }
+    });
+}
+
+_HIPP_TEMPRET
+query_idx(index_t i) const noexcept -> index_t {
+    return _order.empty() ? i : _order[i];
+}
+
+_HIPP_TEMPRET
+n_threads() const noexcept -> int {
+    return _pl.n_threads();
+}
+
+_HIPP_TEMPHD
+template<typename Searcher>
+auto _HIPP_TEMPCLS::_is_empty(const Searcher &searcher, int) noexcept
+    -> decltype(searcher.tree_info(), bool())
+{
+    // An empty tree has a max depth of 0.
+    return searcher.tree_info().max_depth() == 0;
+}
+
+_HIPP_TEMPHD
+template<typename Searcher>
+bool _HIPP_TEMPCLS::_is_empty(const Searcher &searcher, long) noexcept {
+    return searcher.nodes().empty();
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
+
+} // namespace HIPP::NUMERICAL::_KDSEARCH
+
+#endif	//_HIPPNUMERICAL_KDSEARCH_BATCH_QUERY_H_
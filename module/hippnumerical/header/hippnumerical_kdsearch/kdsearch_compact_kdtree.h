@@ -0,0 +1,280 @@
+/**
+create: Yangyao CHEN, 2026/10/17
+    [write   ] CompactKDTree - K-dimensional tree with quantized positions.
+*/
+
+#ifndef _HIPPNUMERICAL_KDSEARCH_COMPACT_KDTREE_H_
+#define _HIPPNUMERICAL_KDSEARCH_COMPACT_KDTREE_H_
+
+#include "kdsearch_compact_kdtree_raw_impl.h"
+
+namespace HIPP::NUMERICAL {
+
+/**
+K-dimensional tree for very large point sets, whose nodes keep the positions
+quantized to ``BITS`` bits per axis.
+
+A node takes ``2*sizeof(IndexT)`` bytes for the id of the point and the
+packed size and split axis, plus ``DIM*2`` bytes (``BITS <= 16``) or
+``DIM*BITS`` bits rounded up to 8 bytes (``BITS > 16``). E.g., with the
+default ``int`` index, a 3-d node takes 16 bytes for both ``BITS = 16`` and
+``BITS = 21``. A ``KDTree`` node of ``float`` positions and an ``int`` id as
+padding takes 24 bytes.
+
+The positions are quantized relative to the bounding box of each subtree,
+hence the error shrinks with the depth. The queries are exact if the
+original points are passed through the query policy, otherwise the points
+are taken at the centers of their quantization slabs.
+*/
+template<typename KDPointT = KDPoint<>, typename IndexT = int, int BITS = 16>
+class CompactKDTree {
+public:
+    /**
+    Implementation detail.
+    */
+    using impl_t = _KDSEARCH::_CompactKDTree<KDPointT, IndexT, BITS>;
+
+    static constexpr int DIM         = impl_t::DIM;
+    static constexpr IndexT idxNULL  = impl_t::idxNULL;
+
+    using kd_point_t = typename impl_t::kd_point_t;
+    using node_t     = typename impl_t::node_t;
+    using point_t    = typename impl_t::point_t;
+
+    using float_t    = typename impl_t::float_t;
+    using index_t    = typename impl_t::index_t;
+    using pos_t      = typename impl_t::pos_t;
+    using rect_t     = typename impl_t::rect_t;
+    using sphere_t   = typename impl_t::sphere_t;
+
+    /**
+    ``construct_policy_t`` controls the parallel construction.
+    ``query_policy_t`` holds, optionally, the original points for the exact
+    check. The buffers of the queries are thread-local, hence a temporary 
+    policy allocates nothing in the steady state.
+    */
+    using construct_policy_t = typename impl_t::construct_policy_t;
+    using query_policy_t     = typename impl_t::query_policy_t;
+
+    /**
+    A query result, i.e., the id of a point and its squared distance to the
+    query position.
+    */
+    using ngb_t      = typename impl_t::ngb_t;
+
+    /**
+    Constructors.
+
+    (1): Default construction - an empty tree.
+
+    (2): Construct the tree from points ``pts``. The id of each point is its
+    index in ``pts``. The points are not referred to after the construction.
+
+    ``CompactKDTree`` is copyable and movable. The copied-to object shares
+    the same internal state with the source object.
+    */
+    CompactKDTree();
+    explicit CompactKDTree(ContiguousBuffer<const kd_point_t> pts,
+        const construct_policy_t &policy = construct_policy_t());
+
+    CompactKDTree(const CompactKDTree &o);
+    CompactKDTree(CompactKDTree &&o);
+    CompactKDTree & operator=(const CompactKDTree &o) noexcept;
+    CompactKDTree & operator=(CompactKDTree &&o) noexcept;
+    ~CompactKDTree() noexcept;
+
+    ostream & info(ostream &os = cout, int fmt_cntl = 0, int level = 0) const;
+    friend ostream & operator<<(ostream &os, const CompactKDTree &ckdt) {
+        return ckdt.info(os);
+    }
+
+    /**
+    Reconstruct the tree from points ``pts``, or remove all points.
+    */
+    void construct(ContiguousBuffer<const kd_point_t> pts,
+        const construct_policy_t &policy = construct_policy_t());
+    void clear();
+
+    /**
+    Getters.
+    nodes(): the nodes in pre-order.
+    size(): number of points.
+    bounding_box(): the box of all points.
+    */
+    std::shared_ptr<impl_t> impl() const noexcept;
+    const vector<node_t> & nodes() const noexcept;
+    index_t size() const noexcept;
+    const rect_t & bounding_box() const noexcept;
+    const construct_policy_t & construct_policy() const noexcept;
+
+    /**
+    Queries. The same as those of ``DynamicKDTree``, i.e., the results are
+    point ids.
+
+    nearest(): if the tree is empty, returns {idxNULL, max_of_float_t}.
+    nearest_k(): find at most ``ngbs.size()`` nearest neighbors, sorted by
+    distance. Returns the number found.
+    */
+    template<typename Policy = query_policy_t>
+    ngb_t nearest(const point_t &p, Policy &&policy = Policy()) const;
+    template<typename Policy = query_policy_t>
+    index_t nearest_k(const point_t &p, ContiguousBuffer<ngb_t> ngbs,
+        Policy &&policy = Policy()) const;
+
+    /**
+    ``op(id)`` is called on each point in the region.
+    */
+    template<typename Op, typename Policy = query_policy_t>
+    void visit_rect(const rect_t &rect, Op op,
+        Policy &&policy = Policy()) const;
+    template<typename Policy = query_policy_t>
+    index_t count_rect(const rect_t &rect,
+        Policy &&policy = Policy()) const;
+
+    template<typename Op, typename Policy = query_policy_t>
+    void visit_sphere(const sphere_t &sphere, Op op,
+        Policy &&policy = Policy()) const;
+    template<typename Policy = query_policy_t>
+    index_t count_sphere(const sphere_t &sphere,
+        Policy &&policy = Policy()) const;
+protected:
+    std::shared_ptr<impl_t> _impl;
+};
+
+#define _HIPP_TEMPHD template<typename KDPointT, typename IndexT, int BITS>
+#define _HIPP_TEMPARG <KDPointT, IndexT, BITS>
+#define _HIPP_TEMPCLS CompactKDTree _HIPP_TEMPARG
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPNORET
+CompactKDTree() : _impl( std::make_shared<impl_t>() ) {}
+
+_HIPP_TEMPNORET
+CompactKDTree(ContiguousBuffer<const kd_point_t> pts,
+    const construct_policy_t &policy)
+: _impl( std::make_shared<impl_t>(pts, policy) ) {}
+
+_HIPP_TEMPNORET
+CompactKDTree(const CompactKDTree &o) = default;
+
+_HIPP_TEMPNORET
+CompactKDTree(CompactKDTree &&o) = default;
+
+_HIPP_TEMPRET
+operator=(const CompactKDTree &o) noexcept -> CompactKDTree & = default;
+
+_HIPP_TEMPRET
+operator=(CompactKDTree &&o) noexcept -> CompactKDTree & = default;
+
+_HIPP_TEMPNORET
+~CompactKDTree() noexcept = default;
+
+_HIPP_TEMPRET
+info(ostream &os, int fmt_cntl, int level) const -> ostream & {
+    PStream ps(os);
+    if( fmt_cntl < 1 ) {
+        ps << HIPPCNTL_CLASS_INFO_INLINE(CompactKDTree),
+        "{impl=", *_impl, "}";
+        return os;
+    }
+    auto ind = HIPPCNTL_CLASS_INFO_INDENT_STR(level);
+    ps << HIPPCNTL_CLASS_INFO(CompactKDTree),
+    ind, ps.info_of(*_impl, fmt_cntl, level+1);
+    return os;
+}
+
+_HIPP_TEMPRET
+construct(ContiguousBuffer<const kd_point_t> pts,
+    const construct_policy_t &policy) -> void
+{
+    _impl->construct(pts, policy);
+}
+
+_HIPP_TEMPRET
+clear() -> void {
+    _impl->clear();
+}
+
+_HIPP_TEMPRET
+impl() const noexcept -> std::shared_ptr<impl_t> {
+    return _impl;
+}
+
+_HIPP_TEMPRET
+nodes() const noexcept -> const vector<node_t> & {
+    return _impl->nodes();
+}
+
+_HIPP_TEMPRET
+size() const noexcept -> index_t {
+    return _impl->size();
+}
+
+_HIPP_TEMPRET
+bounding_box() const noexcept -> const rect_t & {
+    return _impl->bounding_box();
+}
+
+_HIPP_TEMPRET
+construct_policy() const noexcept -> const construct_policy_t & {
+    return _impl->construct_policy();
+}
+
+_HIPP_TEMPHD
+template<typename Policy>
+auto _HIPP_TEMPCLS::nearest(const point_t &p, Policy &&policy) const
+-> ngb_t
+{
+    return _impl->nearest(p, policy);
+}
+
+_HIPP_TEMPHD
+template<typename Policy>
+auto _HIPP_TEMPCLS::nearest_k(const point_t &p, ContiguousBuffer<ngb_t> ngbs,
+    Policy &&policy) const -> index_t
+{
+    return _impl->nearest_k(p, ngbs, policy);
+}
+
+_HIPP_TEMPHD
+template<typename Op, typename Policy>
+void _HIPP_TEMPCLS::visit_rect(const rect_t &rect, Op op,
+    Policy &&policy) const
+{
+    _impl->visit_rect(rect, op, policy);
+}
+
+_HIPP_TEMPHD
+template<typename Policy>
+auto _HIPP_TEMPCLS::count_rect(const rect_t &rect,
+    Policy &&policy) const -> index_t
+{
+    return _impl->count_rect(rect, policy);
+}
+
+_HIPP_TEMPHD
+template<typename Op, typename Policy>
+void _HIPP_TEMPCLS::visit_sphere(const sphere_t &sphere, Op op,
+    Policy &&policy) const
+{
+    _impl->visit_sphere(sphere, op, policy);
+}
+
+_HIPP_TEMPHD
+template<typename Policy>
+auto _HIPP_TEMPCLS::count_sphere(const sphere_t &sphere,
+    Policy &&policy) const -> index_t
+{
+    return _impl->count_sphere(sphere, policy);
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
+
+} // namespace HIPP::NUMERICAL
+
+#endif	//_HIPPNUMERICAL_KDSEARCH_COMPACT_KDTREE_H_
@@ -0,0 +1,285 @@
+/**
+create: Yangyao CHEN, 2026/10/17
+    [write   ] _QuantizedPos, _CompactKDTreeNode, _CompactKDTree -
+        Implementation classes of CompactKDTree.
+*/
+
+#ifndef _HIPPNUMERICAL_KDSEARCH_COMPACT_KDTREE_RAW_H_
+#define _HIPPNUMERICAL_KDSEARCH_COMPACT_KDTREE_RAW_H_
+
+#include "kdsearch_base.h"
+#include <cstdint>
+
+namespace HIPP::NUMERICAL::_KDSEARCH {
+
+/**
+``DIM`` unsigned integers of ``BITS`` bits each. With ``BITS <= 16``, each
+is a 16-bit word. Otherwise, they are packed into 64-bit words, e.g., three
+21-bit integers take a single word.
+*/
+template<int DIM, int BITS>
+class _QuantizedPos {
+public:
+    static_assert(BITS >= 1 && BITS <= 31, "BITS must be in [1, 31]");
+
+    using value_t = std::uint64_t;
+    static constexpr bool PACKED = BITS > 16;
+    using word_t = std::conditional_t<PACKED, std::uint64_t, std::uint16_t>;
+    static constexpr int N_WORDS = PACKED ? (DIM*BITS + 63) / 64 : DIM;
+    static constexpr value_t MASK = (value_t(1) << BITS) - 1;
+
+    value_t get(int d) const noexcept;
+    void set(int d, value_t v) noexcept;
+protected:
+    word_t _words[N_WORDS];
+};
+
+/**
+Node of the compact tree. The split axis is packed into the lowest bits of
+the size field. The position is the quantized one, relative to the bounding
+box of the subtree rooted at the node (see ``_CompactKDTree``).
+*/
+template<int _DIM, int _BITS, typename _IndexT>
+class _CompactKDTreeNode {
+public:
+    static constexpr int DIM = _DIM;
+    static constexpr int BITS = _BITS;
+
+    using index_t = _IndexT;
+    using qpos_t = _QuantizedPos<DIM, BITS>;
+    using value_t = typename qpos_t::value_t;
+
+    static constexpr int AXIS_BITS = DIM <= 2 ? 1 : DIM <= 4 ? 2
+        : DIM <= 8 ? 3 : DIM <= 16 ? 4 : 5;
+
+    _CompactKDTreeNode() noexcept;
+    _CompactKDTreeNode(index_t id, index_t size, int axis) noexcept;
+
+    ostream & info(ostream &os = cout, int fmt_cntl = 0, int level = 0) const;
+    friend ostream & operator<<(ostream &os, const _CompactKDTreeNode &n) {
+        return n.info(os);
+    }
+
+    /**
+    id(): index of the point in the input sequence of the construction.
+    size(): number of nodes in the subtree.
+    axis(): split axis. Meaningless for a leaf node.
+    quantized(): the quantized coordinate along axis ``d``.
+    */
+    index_t id() const noexcept;
+    index_t size() const noexcept;
+    int axis() const noexcept;
+    value_t quantized(int d) const noexcept;
+    void set_quantized(int d, value_t v) noexcept;
+protected:
+    index_t _id;
+    index_t _size_axis;
+    qpos_t _qpos;
+};
+
+/**
+Memory-compact k-dimensional tree.
+
+The tree has the same topology as a ``_KDTree`` split at the median along
+the axis of maximal extreme, but each node stores only the id of its point,
+the packed size and axis, and the position quantized to ``BITS`` bits per
+axis.
+
+Quantization: the positions are first mapped to a grid of ``2^32`` cells
+over the bounding box of all points. Each subtree covers a box of grid
+cells, which is divided into ``2^BITS`` slabs along each axis to quantize
+the position of its root node. The boxes of the two children are cut from
+the parent's at the slab of the split point, hence a query recovers the
+boxes and slabs on the fly with integer arithmetics. The quantization error
+shrinks with the depth, as the boxes do. ``BITS`` is at most 31.
+
+The bounds of the boxes and slabs are conservative. A query computed with
+the original positions (see ``query_policy_t::set_exact_points()``) is
+exact. Otherwise, each point is taken at the center of its slab.
+*/
+template<typename KDPointT = KDPoint<>, typename IndexT = int, int BITS = 16>
+class _CompactKDTree {
+public:
+    using kd_point_t = KDPointT;
+
+    using float_t = typename kd_point_t::float_t;
+    using index_t = IndexT;
+
+    static constexpr int DIM         = kd_point_t::DIM;
+    static constexpr int GRID_BITS   = 32;
+    static constexpr index_t idxNULL = -1;
+
+    using node_t   = _CompactKDTreeNode<DIM, BITS, index_t>;
+    using value_t  = typename node_t::value_t;
+    using point_t  = GEOMETRY::Point<float_t, DIM>;
+    using pos_t    = typename point_t::pos_t;
+    using rect_t   = GEOMETRY::Rect<float_t, DIM>;
+    using sphere_t = GEOMETRY::Sphere<float_t, DIM>;
+
+    class construct_policy_t;
+    class query_policy_t;
+    struct ngb_t;
+
+    _CompactKDTree() noexcept;
+    _CompactKDTree(ContiguousBuffer<const kd_point_t> pts,
+        const construct_policy_t &policy = construct_policy_t());
+
+    ostream & info(ostream &os = cout, int fmt_cntl = 0, int level = 0) const;
+    friend ostream & operator<<(ostream &os, const _CompactKDTree &ckdt) {
+        return ckdt.info(os);
+    }
+
+    /**
+    construct(): build the tree from ``pts``. The points are not kept.
+    clear(): remove all nodes.
+    */
+    void construct(ContiguousBuffer<const kd_point_t> pts,
+        const construct_policy_t &policy = construct_policy_t());
+    void clear() noexcept;
+
+    /**
+    nodes(): the nodes in pre-order.
+    size(): number of points.
+    bounding_box(): the box of all points, within which the grid is laid.
+    */
+    const vector<node_t> & nodes() const noexcept;
+    index_t size() const noexcept;
+    const rect_t & bounding_box() const noexcept;
+    const construct_policy_t & construct_policy() const noexcept;
+
+    /**
+    Queries. The results are the ids of the points.
+
+    nearest(): if the tree is empty, returns {idxNULL, max_of_float_t}.
+    nearest_k(): find at most ``ngbs.size()`` nearest neighbors, sorted by
+    distance. Returns the number found.
+    visit_rect(), visit_sphere(): ``op(id)`` is called on each point in the
+    region, with the same boundary convention as ``_KDTree``.
+    */
+    template<typename Policy = query_policy_t>
+    ngb_t nearest(const point_t &p, Policy &&policy = Policy()) const;
+    template<typename Policy = query_policy_t>
+    index_t nearest_k(const point_t &p, ContiguousBuffer<ngb_t> ngbs,
+        Policy &&policy = Policy()) const;
+
+    template<typename Op, typename Policy = query_policy_t>
+    void visit_rect(const rect_t &rect, Op op,
+        Policy &&policy = Policy()) const;
+    template<typename Policy = query_policy_t>
+    index_t count_rect(const rect_t &rect,
+        Policy &&policy = Policy()) const;
+
+    template<typename Op, typename Policy = query_policy_t>
+    void visit_sphere(const sphere_t &sphere, Op op,
+        Policy &&policy = Policy()) const;
+    template<typename Policy = query_policy_t>
+    index_t count_sphere(const sphere_t &sphere,
+        Policy &&policy = Policy()) const;
+protected:
+    /**
+    Box of grid cells ``[lo, hi)`` along each axis.
+    */
+    struct _grid_box_t {
+        value_t lo[DIM], hi[DIM];
+    };
+
+    /**
+    A node to be visited, with its box of grid cells and the lower-bound of
+    squared distance from the query to the box.
+    */
+    struct _frame_t {
+        index_t idx;
+        _grid_box_t box;
+        float_t r_sq;
+    };
+
+    vector<node_t> _nodes;
+    rect_t _bound;
+    double _cell_size[DIM];
+    float_t _margin[DIM];
+    construct_policy_t _construct_policy;
+
+    struct _Impl_construct;
+    struct _Impl_query;
+
+    value_t _to_grid(int d, float_t x) const noexcept;
+    float_t _from_grid(int d, double g) const noexcept;
+    static std::pair<value_t, value_t> _slab(value_t lo, value_t hi,
+        value_t q) noexcept;
+    _grid_box_t _root_box() const noexcept;
+};
+
+template<typename KDPointT, typename IndexT, int BITS>
+class _CompactKDTree<KDPointT, IndexT, BITS>::construct_policy_t {
+public:
+    static constexpr int DFLT_N_THREADS = 1;
+    static constexpr index_t DFLT_SERIAL_CUTOFF = 1 << 16;
+
+    construct_policy_t() noexcept;
+
+    ostream & info(ostream &os = cout, int fmt_cntl = 0, int level = 0) const;
+    friend ostream & operator<< (ostream &os,
+        const construct_policy_t &pl) { return pl.info(os); }
+
+    /**
+    Parallel construction, with the same meaning as that of ``_KDTree``. The
+    resulting tree is exactly the same as the serial one.
+    */
+    int n_threads() const noexcept;
+    construct_policy_t & set_n_threads(int n_threads) noexcept;
+
+    index_t serial_cutoff() const noexcept;
+    construct_policy_t & set_serial_cutoff(index_t serial_cutoff) noexcept;
+protected:
+    friend class _CompactKDTree;
+
+    int _n_threads;
+    index_t _serial_cutoff;
+};
+
+/**
+Query policy, i.e., the original points for the exact check. The nodes to
+be visited are buffered in a thread-local pool (see ``_QueryBuffPool``).
+*/
+template<typename KDPointT, typename IndexT, int BITS>
+class _CompactKDTree<KDPointT, IndexT, BITS>::query_policy_t {
+public:
+    query_policy_t() noexcept;
+
+    /**
+    Set the points the tree was constructed from. The quantized positions
+    are then used only for pruning, and each point whose slab is not
+    entirely in (or out of) the query region is checked with its original
+    position. ``clear_exact_points()`` turns the exact check off.
+    */
+    query_policy_t & set_exact_points(
+        ContiguousBuffer<const kd_point_t> pts) noexcept;
+    query_policy_t & clear_exact_points() noexcept;
+    bool has_exact_points() const noexcept;
+
+    /**
+    Number of original points read by the exact check, accumulated over the
+    queries made with this policy.
+    */
+    size_t n_exact_checks() const noexcept;
+    query_policy_t & reset_n_exact_checks() noexcept;
+protected:
+    friend class _CompactKDTree;
+
+    const kd_point_t *_exact_pts;
+    size_t _n_exact_checks;
+};
+
+template<typename KDPointT, typename IndexT, int BITS>
+struct _CompactKDTree<KDPointT, IndexT, BITS>::ngb_t {
+    index_t id;
+    float_t r_sq;
+
+    bool operator<(const ngb_t &rhs) const noexcept {
+        return r_sq < rhs.r_sq;
+    }
+};
+
+} // namespace HIPP::NUMERICAL::_KDSEARCH
+
+#endif	//_HIPPNUMERICAL_KDSEARCH_COMPACT_KDTREE_RAW_H_
@@ -0,0 +1,794 @@
+/**
+create: Yangyao CHEN, 2026/10/17
+Implementation of kdsearch_compact_kdtree_raw.h
+*/
+
+#ifndef _HIPPNUMERICAL_KDSEARCH_COMPACT_KDTREE_RAW_IMPL_H_
+#define _HIPPNUMERICAL_KDSEARCH_COMPACT_KDTREE_RAW_IMPL_H_
+
+#include "kdsearch_compact_kdtree_raw.h"
+
+namespace HIPP::NUMERICAL::_KDSEARCH {
+
+#define _HIPP_TEMPHD template<int DIM, int BITS>
+#define _HIPP_TEMPARG <DIM, BITS>
+#define _HIPP_TEMPCLS _QuantizedPos _HIPP_TEMPARG
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPRET
+get(int d) const noexcept -> value_t {
+    if constexpr( !PACKED ) {
+        return _words[d];
+    } else {
+        const int bit = d * BITS, i = bit / 64, off = bit % 64;
+        value_t v = _words[i] >> off;
+        if( off + BITS > 64 ) v |= _words[i+1] << (64 - off);
+        return v & MASK;
+    }
+}
+
+_HIPP_TEMPRET
+set(int d, value_t v) noexcept -> void {
+    if constexpr( !PACKED ) {
+        _words[d] = static_cast<word_t>(v);
+    } else {
+        const int bit = d * BITS, i = bit / 64, off = bit % 64;
+        v &= MASK;
+        _words[i] = (_words[i] & ~(MASK << off)) | (v << off);
+        if( off + BITS > 64 ) {
+            const int sh = 64 - off;
+            _words[i+1] = (_words[i+1] & ~(MASK >> sh)) | (v >> sh);
+        }
+    }
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
+
+#define _HIPP_TEMPHD template<int _DIM, int _BITS, typename _IndexT>
+#define _HIPP_TEMPARG <_DIM, _BITS, _IndexT>
+#define _HIPP_TEMPCLS _CompactKDTreeNode _HIPP_TEMPARG
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPNORET
+_CompactKDTreeNode() noexcept : _id(0), _size_axis(0), _qpos{} {}
+
+_HIPP_TEMPNORET
+_CompactKDTreeNode(index_t id, index_t size, int axis) noexcept
+: _id(id), _size_axis( (size << AXIS_BITS) | static_cast<index_t>(axis) ),
+_qpos{} {}
+
+_HIPP_TEMPRET
+info(ostream &os, int fmt_cntl, int level) const -> ostream & {
+    PStream ps(os);
+    if( fmt_cntl < 1 ) {
+        ps << HIPPCNTL_CLASS_INFO_INLINE(_CompactKDTreeNode),
+        "{id=", id(), ", size=", size(), ", axis=", axis(), "}";
+        return os;
+    }
+    auto ind = HIPPCNTL_CLASS_INFO_INDENT_STR(level);
+    ps << HIPPCNTL_CLASS_INFO(_CompactKDTreeNode),
+    ind, "Id = ", id(), ", size = ", size(), ", axis = ", axis(), '\n',
+    ind, "Quantized position = {";
+    for(int d=0; d<DIM; ++d) ps << quantized(d), ",";
+    ps << "}\n";
+    return os;
+}
+
+_HIPP_TEMPRET
+id() const noexcept -> index_t {
+    return _id;
+}
+
+_HIPP_TEMPRET
+size() const noexcept -> index_t {
+    return _size_axis >> AXIS_BITS;
+}
+
+_HIPP_TEMPRET
+axis() const noexcept -> int {
+    return static_cast<int>( _size_axis & ((index_t(1) << AXIS_BITS) - 1) );
+}
+
+_HIPP_TEMPRET
+quantized(int d) const noexcept -> value_t {
+    return _qpos.get(d);
+}
+
+_HIPP_TEMPRET
+set_quantized(int d, value_t v) noexcept -> void {
+    _qpos.set(d, v);
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
+
+#define _HIPP_TEMPHD template<typename KDPointT, typename IndexT, int BITS>
+#define _HIPP_TEMPARG <KDPointT, IndexT, BITS>
+#define _HIPP_TEMPCLS _CompactKDTree _HIPP_TEMPARG
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPNORET
+_CompactKDTree() noexcept {
+    clear();
+}
+
+_HIPP_TEMPNORET
+_CompactKDTree(ContiguousBuffer<const kd_point_t> pts,
+    const construct_policy_t &policy)
+{
+    construct(pts, policy);
+}
+
+_HIPP_TEMPRET
+info(ostream &os, int fmt_cntl, int level) const -> ostream & {
+    PStream ps(os);
+    if( fmt_cntl < 1 ) {
+        ps << HIPPCNTL_CLASS_INFO_INLINE(_CompactKDTree),
+        "{size=", size(), ", bits=", BITS,
+        ", node size=", sizeof(node_t), "}";
+        return os;
+    }
+    auto ind = HIPPCNTL_CLASS_INFO_INDENT_STR(level);
+    ps << HIPPCNTL_CLASS_INFO(_CompactKDTree),
+    ind, "Size = ", size(), ", bits = ", BITS,
+        ", node size = ", sizeof(node_t), '\n',
+    ind, "Bounding box = ", _bound, '\n',
+    ind, ps.info_of(_construct_policy, 0, level+1), '\n';
+    return os;
+}
+
+_HIPP_TEMPHD
+struct _HIPP_TEMPCLS::_Impl_construct
+{
+    _CompactKDTree &dst;
+    vector<node_t> &nodes;
+
+    const kd_point_t * __restrict__ p_pts;
+    const index_t n_pts;
+    const construct_policy_t &pl;
+
+    vector<index_t> sorted_ids;
+
+_Impl_construct(_CompactKDTree &_dst, ContiguousBuffer<const kd_point_t> pts,
+    const construct_policy_t &_pl)
+: dst(_dst), nodes(dst._nodes), p_pts(pts.get_cbuff()),
+n_pts(pts.get_size()), pl(dst._construct_policy)
+{
+    verify_args(_pl);
+    dst._construct_policy = _pl;
+    nodes.resize(n_pts);
+}
+
+void operator()() {
+    find_bound();
+    if( n_pts == 0 ) return;
+
+    sorted_ids.resize(n_pts);
+    for(index_t i=0; i<n_pts; ++i)
+        sorted_ids[i] = i;
+
+    if( pl._n_threads > 1 )
+        construct_parallel(0, n_pts, 0, dst._root_box(), pl._n_threads);
+    else
+        construct_serial(0, n_pts, 0, dst._root_box());
+}
+
+void verify_args(const construct_policy_t &_pl) const {
+    if( _pl._n_threads < 1 || _pl._serial_cutoff < 1 )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB,
+            "  ... invalid no. of threads ", _pl._n_threads,
+            " or serial cutoff ", _pl._serial_cutoff);
+    const index_t max_size =
+        std::numeric_limits<index_t>::max() >> node_t::AXIS_BITS;
+    if( n_pts > max_size )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB,
+            "  ... too many points ", n_pts, " (max ", max_size,
+            "). Use a wider index type\n");
+}
+
+/**
+Set the bounding box of all points and the grid laid on it. The margin
+covers the rounding errors in the conversions between the positions and
+the grid cells.
+*/
+void find_bound() {
+    using lim = std::numeric_limits<float_t>;
+    pos_t low(0), high(0);
+    if( n_pts > 0 )
+        std::tie(low, high) = extremes(0, n_pts, pl._n_threads, false);
+    dst._bound = rect_t(low, high);
+
+    const double n_cells = static_cast<double>(value_t(1) << GRID_BITS);
+    for(int d=0; d<DIM; ++d) {
+        const double lo = low[d], hi = high[d];
+        dst._cell_size[d] = (hi - lo) / n_cells;
+        dst._margin[d] = static_cast<float_t>( 16 * lim::epsilon()
+            * (std::fabs(lo) + std::fabs(hi)) );
+    }
+}
+
+/**
+Build the subtree of points in ``[b, e)`` of ``sorted_ids`` at node
+``n_cur``, whose points are in the grid box ``box``. Its left and right
+subtrees are at ``n_cur+1`` and ``n_cur+1+(pivot-b)``, respectively.
+*/
+void construct_serial(index_t b, index_t e, index_t n_cur,
+    const _grid_box_t &box)
+{
+    struct range_t {
+        index_t b, e, n_cur;
+        _grid_box_t box;
+    };
+    std::stack<range_t> ranges;
+    ranges.push({b, e, n_cur, box});
+    while( !ranges.empty() ) {
+        auto r = ranges.top(); ranges.pop();
+        while( r.b != r.e ) {
+            _grid_box_t box_l, box_r;
+            const index_t pivot = split(r.b, r.e, r.n_cur, r.box,
+                box_l, box_r, 1);
+            if( pivot+1 != r.e )
+                ranges.push({pivot+1, r.e, r.n_cur+1+(pivot-r.b), box_r});
+            r.e = pivot; r.n_cur += 1; r.box = box_l;
+        }
+    }
+}
+
+void construct_parallel(index_t b, index_t e, index_t n_cur,
+    const _grid_box_t &box, int n_threads)
+{
+    if( n_threads <= 1 || e - b <= pl._serial_cutoff ) {
+        construct_serial(b, e, n_cur, box); return;
+    }
+    _grid_box_t box_l, box_r;
+    const index_t pivot = split(b, e, n_cur, box, box_l, box_r, n_threads);
+
+    const int n_threads_l = n_threads / 2;
+    std::thread th_l(&_Impl_construct::construct_parallel, this,
+        b, pivot, n_cur+1, box_l, n_threads_l);
+    construct_parallel(pivot+1, e, n_cur+1+(pivot-b), box_r,
+        n_threads-n_threads_l);
+    th_l.join();
+}
+
+/**
+Split ``[b, e)`` at the median along the axis of maximal extreme, write the
+node at ``n_cur``, and find the grid boxes of the two subtrees. Points at the
+left (right) of the median are not larger (smaller) than it, hence they are
+not beyond the upper (lower) edge of its slab.
+*/
+index_t split(index_t b, index_t e, index_t n_cur, const _grid_box_t &box,
+    _grid_box_t &box_l, _grid_box_t &box_r, int n_threads)
+{
+    int axis = 0;
+    if( e - b > 1 ) {
+        auto [min_pos, max_pos] = extremes(b, e, n_threads, true);
+        axis = static_cast<int>( (max_pos - min_pos).max_index() );
+    }
+    const index_t pivot = b + (e-b)/2;
+    index_t * const ids = sorted_ids.data();
+    std::nth_element(ids+b, ids+pivot, ids+e,
+        [axis, this] (index_t i, index_t j)-> bool {
+            return p_pts[i].pos()[axis] < p_pts[j].pos()[axis];
+        });
+
+    const index_t id = ids[pivot];
+    const auto &pos = p_pts[id].pos();
+    node_t &n = nodes[n_cur];
+    n = node_t(id, e-b, axis);
+    value_t q_axis = 0;
+    for(int d=0; d<DIM; ++d) {
+        const value_t g = dst._to_grid(d, pos[d]),
+            lo = box.lo[d], hi = box.hi[d];
+        assert(lo <= g && g < hi);
+        const value_t q = ((g - lo) << BITS) / (hi - lo);
+        n.set_quantized(d, q);
+        if( d == axis ) q_axis = q;
+    }
+
+    auto [s_lo, s_hi] = _slab(box.lo[axis], box.hi[axis], q_axis);
+    box_l = box_r = box;
+    box_l.hi[axis] = s_hi;
+    box_r.lo[axis] = s_lo;
+    return pivot;
+}
+
+/**
+Extremes of the positions of points in ``[b, e)``. If ``sorted`` is
+``true``, the points are indexed through ``sorted_ids``. Min/max are exact,
+hence the result does not depend on ``n_threads``.
+*/
+std::pair<pos_t, pos_t> extremes(index_t b, index_t e, int n_threads,
+    bool sorted) const
+{
+    using lim = std::numeric_limits<float_t>;
+    vector<pos_t> min_poss(n_threads, pos_t(lim::max())),
+        max_poss(n_threads, pos_t(lim::lowest()));
+    _parallel_for(n_threads, e-b, [&](int i_th, index_t _b, index_t _e) {
+        pos_t min_pos(lim::max()), max_pos(lim::lowest());
+        for(auto i=b+_b; i<b+_e; ++i){
+            const auto &pos = p_pts[ sorted ? sorted_ids[i] : i ].pos();
+            min_pos[ pos < min_pos ] = pos;
+            max_pos[ pos > max_pos ] = pos;
+        }
+        min_poss[i_th] = min_pos;
+        max_poss[i_th] = max_pos;
+    });
+    auto &min_pos = min_poss[0], &max_pos = max_poss[0];
+    for(int i=1; i<n_threads; ++i) {
+        min_pos[ min_poss[i] < min_pos ] = min_poss[i];
+        max_pos[ max_poss[i] > max_pos ] = max_poss[i];
+    }
+    return {min_pos, max_pos};
+}
+};
+
+_HIPP_TEMPRET
+construct(ContiguousBuffer<const kd_point_t> pts,
+    const construct_policy_t &policy) -> void
+{
+    _Impl_construct impl(*this, pts, policy);
+    impl();
+}
+
+_HIPP_TEMPRET
+clear() noexcept -> void {
+    _nodes.clear();
+    _bound = rect_t(pos_t(0), pos_t(0));
+    for(int d=0; d<DIM; ++d) {
+        _cell_size[d] = 0.;
+        _margin[d] = 0;
+    }
+}
+
+_HIPP_TEMPRET
+nodes() const noexcept -> const vector<node_t> & {
+    return _nodes;
+}
+
+_HIPP_TEMPRET
+size() const noexcept -> index_t {
+    return static_cast<index_t>(_nodes.size());
+}
+
+_HIPP_TEMPRET
+bounding_box() const noexcept -> const rect_t & {
+    return _bound;
+}
+
+_HIPP_TEMPRET
+construct_policy() const noexcept -> const construct_policy_t & {
+    return _construct_policy;
+}
+
+/**
+The traversal shared by all queries. The boxes of the subtrees and slabs are
+recovered on the fly from the quantized positions.
+*/
+_HIPP_TEMPHD
+struct _HIPP_TEMPCLS::_Impl_query
+{
+    const _CompactKDTree &ckdt;
+    const vector<node_t> &nodes;
+    query_policy_t &pl;
+    typename _QueryBuffPool<_frame_t>::lease_t frames_lease;
+    vector<_frame_t> &frames;
+
+_Impl_query(const _CompactKDTree &_ckdt, query_policy_t &_pl)
+: ckdt(_ckdt), nodes(_ckdt._nodes), pl(_pl), frames(frames_lease.buff())
+{
+    frames.clear();
+}
+
+/**
+Real bounds of a grid box, enlarged by the margin. All points in the box
+are within the bounds.
+*/
+void real_box(const _grid_box_t &b, pos_t &lo, pos_t &hi) const noexcept {
+    for(int d=0; d<DIM; ++d) {
+        lo[d] = ckdt._from_grid(d, b.lo[d]) - ckdt._margin[d];
+        hi[d] = ckdt._from_grid(d, b.hi[d]) + ckdt._margin[d];
+    }
+}
+
+_grid_box_t slab_box(const node_t &n, const _grid_box_t &b) const noexcept {
+    _grid_box_t s;
+    for(int d=0; d<DIM; ++d)
+        std::tie(s.lo[d], s.hi[d]) = _slab(b.lo[d], b.hi[d], n.quantized(d));
+    return s;
+}
+
+void children_boxes(const node_t &n, const _grid_box_t &b,
+    const _grid_box_t &s, _grid_box_t &b_l, _grid_box_t &b_r) const noexcept
+{
+    const int axis = n.axis();
+    b_l = b_r = b;
+    b_l.hi[axis] = s.hi[axis];
+    b_r.lo[axis] = s.lo[axis];
+}
+
+/**
+Position of the point of node ``n``, whose slab is ``s``. It is the
+original one if the policy has the exact points, or the slab center.
+*/
+pos_t point_pos(const node_t &n, const _grid_box_t &s) const noexcept {
+    if( pl._exact_pts ) {
+        ++pl._n_exact_checks;
+        return pl._exact_pts[n.id()].pos();
+    }
+    pos_t p;
+    for(int d=0; d<DIM; ++d)
+        p[d] = ckdt._from_grid(d, 0.5 * (double(s.lo[d]) + double(s.hi[d])));
+    return p;
+}
+
+/**
+Squared distances. The lower and upper bounds are computed in the same
+order as r_sq(), so that rounding keeps them bounds.
+*/
+static float_t r_sq(const pos_t &p, const pos_t &q) noexcept {
+    float_t r_sq = 0;
+    for(int d=0; d<DIM; ++d) {
+        const float_t dx = p[d] - q[d];
+        r_sq += dx * dx;
+    }
+    return r_sq;
+}
+
+static float_t min_r_sq(const pos_t &q, const pos_t &lo,
+    const pos_t &hi) noexcept
+{
+    float_t r_sq = 0;
+    for(int d=0; d<DIM; ++d) {
+        const float_t dx = q[d] < lo[d] ? lo[d] - q[d]
+            : ( q[d] > hi[d] ? q[d] - hi[d] : float_t(0) );
+        r_sq += dx * dx;
+    }
+    return r_sq;
+}
+
+static float_t max_r_sq(const pos_t &q, const pos_t &lo,
+    const pos_t &hi) noexcept
+{
+    float_t r_sq = 0;
+    for(int d=0; d<DIM; ++d) {
+        const float_t dx = std::max(q[d] - lo[d], hi[d] - q[d]);
+        r_sq += dx * dx;
+    }
+    return r_sq;
+}
+
+/**
+Best-first descent for the k nearest neighbors. ``push(id, r_sq)`` returns
+the current upper bound of squared distance for a candidate.
+*/
+template<typename Push>
+void nearest_k(const pos_t &q, float_t bound, Push push) {
+    if( nodes.size() == 0 ) return;
+    pos_t lo, hi;
+    frames.push_back({0, ckdt._root_box(), 0});
+    while( !frames.empty() ) {
+        const _frame_t f = frames.back(); frames.pop_back();
+        if( !(f.r_sq < bound) ) continue;
+
+        const node_t &n = nodes[f.idx];
+        const _grid_box_t s = slab_box(n, f.box);
+        real_box(s, lo, hi);
+        if( min_r_sq(q, lo, hi) < bound )
+            bound = push(n.id(), r_sq(point_pos(n, s), q));
+
+        const index_t sz = n.size();
+        if( sz == 1 ) continue;
+        _grid_box_t b_l, b_r;
+        children_boxes(n, f.box, s, b_l, b_r);
+        const index_t i_l = f.idx + 1, i_r = f.idx + 1 + sz / 2;
+
+        real_box(b_l, lo, hi);
+        const float_t r_sq_l = min_r_sq(q, lo, hi);
+        float_t r_sq_r = bound;
+        if( sz > 2 ) {
+            real_box(b_r, lo, hi);
+            r_sq_r = min_r_sq(q, lo, hi);
+        }
+        // Push the farther one first, so that the nearer one is visited
+        // next.
+        _frame_t f_l {i_l, b_l, r_sq_l}, f_r {i_r, b_r, r_sq_r};
+        if( r_sq_l <= r_sq_r ) std::swap(f_l, f_r);
+        for(const auto *p_f: {&f_l, &f_r})
+            if( p_f->r_sq < bound ) frames.push_back(*p_f);
+    }
+}
+
+/**
+Pre-order descent for a region. ``rel(lo, hi)`` tells whether a box is
+entirely out of (-1), entirely in (1) or across (0) the region.
+``in(p)`` tells whether a point is in it.
+*/
+template<typename Rel, typename In, typename Op>
+void visit(Rel rel, In in, Op &op) {
+    if( nodes.size() == 0 ) return;
+    pos_t lo, hi;
+    frames.push_back({0, ckdt._root_box(), 0});
+    while( !frames.empty() ) {
+        const _frame_t f = frames.back(); frames.pop_back();
+        const node_t &n = nodes[f.idx];
+        const index_t sz = n.size();
+
+        real_box(f.box, lo, hi);
+        const int r_box = rel(lo, hi);
+        if( r_box < 0 ) continue;
+        if( r_box > 0 ) {
+            for(index_t i=f.idx; i<f.idx+sz; ++i) op(nodes[i].id());
+            continue;
+        }
+
+        const _grid_box_t s = slab_box(n, f.box);
+        real_box(s, lo, hi);
+        const int r_slab = rel(lo, hi);
+        if( r_slab > 0 || (r_slab == 0 && in(point_pos(n, s))) )
+            op(n.id());
+
+        if( sz == 1 ) continue;
+        _grid_box_t b_l, b_r;
+        children_boxes(n, f.box, s, b_l, b_r);
+        if( sz > 2 ) frames.push_back({f.idx + 1 + sz / 2, b_r, 0});
+        frames.push_back({f.idx + 1, b_l, 0});
+    }
+}
+};
+
+_HIPP_TEMPHD
+template<typename Policy>
+auto _HIPP_TEMPCLS::nearest(const point_t &p, Policy &&policy) const
+-> ngb_t
+{
+    ngb_t ngb {idxNULL, std::numeric_limits<float_t>::max()};
+    _Impl_query impl(*this, policy);
+    impl.nearest_k(p.pos(), ngb.r_sq, [&](index_t id, float_t r_sq) {
+        if( r_sq < ngb.r_sq ) ngb = {id, r_sq};
+        return ngb.r_sq;
+    });
+    return ngb;
+}
+
+_HIPP_TEMPHD
+template<typename Policy>
+auto _HIPP_TEMPCLS::nearest_k(const point_t &p, ContiguousBuffer<ngb_t> ngbs,
+    Policy &&policy) const -> index_t
+{
+    auto [heap, k] = ngbs;
+    if( k == 0 ) return 0;
+
+    // Max-heap of the k nearest ones found so far.
+    size_t used = 0;
+    float_t bound = std::numeric_limits<float_t>::max();
+    _Impl_query impl(*this, policy);
+    impl.nearest_k(p.pos(), bound, [&, heap=heap, k=k](index_t id,
+        float_t r_sq)
+    {
+        if( used < k ) {
+            heap[used++] = {id, r_sq};
+            std::push_heap(heap, heap+used);
+            if( used == k ) bound = heap->r_sq;
+        } else if( r_sq < bound ) {
+            std::pop_heap(heap, heap+k);
+            heap[k-1] = {id, r_sq};
+            std::push_heap(heap, heap+k);
+            bound = heap->r_sq;
+        }
+        return bound;
+    });
+    std::sort_heap(heap, heap+used);
+    return static_cast<index_t>(used);
+}
+
+_HIPP_TEMPHD
+template<typename Op, typename Policy>
+void _HIPP_TEMPCLS::visit_rect(const rect_t &rect, Op op,
+    Policy &&policy) const
+{
+    const pos_t &r_lo = rect.low().pos(), &r_hi = rect.high().pos();
+    auto rel = [&](const pos_t &lo, const pos_t &hi) -> int {
+        if( (hi <= r_lo).any() || (lo >= r_hi).any() ) return -1;
+        if( (lo > r_lo).all() && (hi < r_hi).all() ) return 1;
+        return 0;
+    };
+    auto in = [&](const pos_t &p) -> bool {
+        return rect.contains(point_t(p));
+    };
+    _Impl_query impl(*this, policy);
+    impl.visit(rel, in, op);
+}
+
+_HIPP_TEMPHD
+template<typename Policy>
+auto _HIPP_TEMPCLS::count_rect(const rect_t &rect,
+    Policy &&policy) const -> index_t
+{
+    index_t cnt = 0;
+    visit_rect(rect, [&cnt](index_t id) { ++cnt; }, policy);
+    return cnt;
+}
+
+_HIPP_TEMPHD
+template<typename Op, typename Policy>
+void _HIPP_TEMPCLS::visit_sphere(const sphere_t &sphere, Op op,
+    Policy &&policy) const
+{
+    const pos_t &c = sphere.center().pos();
+    const float_t r_sq = sphere.r() * sphere.r();
+    auto rel = [&](const pos_t &lo, const pos_t &hi) -> int {
+        if( !(_Impl_query::min_r_sq(c, lo, hi) < r_sq) ) return -1;
+        if( _Impl_query::max_r_sq(c, lo, hi) < r_sq ) return 1;
+        return 0;
+    };
+    auto in = [&](const pos_t &p) -> bool {
+        return _Impl_query::r_sq(p, c) < r_sq;
+    };
+    _Impl_query impl(*this, policy);
+    impl.visit(rel, in, op);
+}
+
+_HIPP_TEMPHD
+template<typename Policy>
+auto _HIPP_TEMPCLS::count_sphere(const sphere_t &sphere,
+    Policy &&policy) const -> index_t
+{
+    index_t cnt = 0;
+    visit_sphere(sphere, [&cnt](index_t id) { ++cnt; }, policy);
+    return cnt;
+}
+
+/**
+Grid cell of ``x`` along axis ``d``. It is monotonic in ``x``.
+*/
+_HIPP_TEMPRET
+_to_grid(int d, float_t x) const noexcept -> value_t {
+    const double cell_size = _cell_size[d];
+    if( cell_size == 0. ) return 0;
+    const double max_g = static_cast<double>( (value_t(1) << GRID_BITS) - 1 ),
+        g = std::floor( (double(x) - double(_bound.low().pos()[d])) / cell_size );
+    return static_cast<value_t>( std::min(std::max(g, 0.), max_g) );
+}
+
+_HIPP_TEMPRET
+_from_grid(int d, double g) const noexcept -> float_t {
+    return static_cast<float_t>( double(_bound.low().pos()[d])
+        + _cell_size[d] * g );
+}
+
+/**
+Slab ``q`` of the grid range ``[lo, hi)``, i.e., the cells ``g`` with
+``floor((g-lo)*2^BITS/(hi-lo)) == q``.
+*/
+_HIPP_TEMPRET
+_slab(value_t lo, value_t hi, value_t q) noexcept
+-> std::pair<value_t, value_t>
+{
+    const value_t w = hi - lo, n_slabs = value_t(1) << BITS;
+    return { lo + (q * w + n_slabs - 1) / n_slabs,
+        lo + ((q + 1) * w + n_slabs - 1) / n_slabs };
+}
+
+_HIPP_TEMPRET
+_root_box() const noexcept -> _grid_box_t {
+    _grid_box_t box;
+    for(int d=0; d<DIM; ++d) {
+        box.lo[d] = 0;
+        box.hi[d] = value_t(1) << GRID_BITS;
+    }
+    return box;
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
+
+#define _HIPP_TEMPHD template<typename KDPointT, typename IndexT, int BITS>
+#define _HIPP_TEMPARG <KDPointT, IndexT, BITS>
+#define _HIPP_TEMPCLS _CompactKDTree _HIPP_TEMPARG::construct_policy_t
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPNORET
+construct_policy_t() noexcept
+: _n_threads(DFLT_N_THREADS), _serial_cutoff(DFLT_SERIAL_CUTOFF) {}
+
+_HIPP_TEMPRET
+info(ostream &os, int fmt_cntl, int level) const -> ostream & {
+    PStream ps(os);
+    if( fmt_cntl < 1 ) {
+        ps << HIPPCNTL_CLASS_INFO_INLINE(_CompactKDTree::construct_policy_t),
+        "{n threads=", _n_threads, ", serial cutoff=", _serial_cutoff, "}";
+        return os;
+    }
+    auto ind = HIPPCNTL_CLASS_INFO_INDENT_STR(level);
+    ps << HIPPCNTL_CLASS_INFO(_CompactKDTree::construct_policy_t),
+    ind, "No. threads = ", _n_threads,
+        ", serial cutoff = ", _serial_cutoff, '\n';
+    return os;
+}
+
+_HIPP_TEMPRET
+n_threads() const noexcept -> int {
+    return _n_threads;
+}
+
+_HIPP_TEMPRET
+set_n_threads(int n_threads) noexcept -> construct_policy_t & {
+    _n_threads = n_threads; return *this;
+}
+
+_HIPP_TEMPRET
+serial_cutoff() const noexcept -> index_t {
+    return _serial_cutoff;
+}
+
+_HIPP_TEMPRET
+set_serial_cutoff(index_t serial_cutoff) noexcept -> construct_policy_t & {
+    _serial_cutoff = serial_cutoff; return *this;
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
+
+#define _HIPP_TEMPHD template<typename KDPointT, typename IndexT, int BITS>
+#define _HIPP_TEMPARG <KDPointT, IndexT, BITS>
+#define _HIPP_TEMPCLS _CompactKDTree _HIPP_TEMPARG::query_policy_t
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPNORET
+query_policy_t() noexcept : _exact_pts(nullptr), _n_exact_checks(0) {}
+
+_HIPP_TEMPRET
+set_exact_points(ContiguousBuffer<const kd_point_t> pts) noexcept
+-> query_policy_t &
+{
+    _exact_pts = pts.get_cbuff(); return *this;
+}
+
+_HIPP_TEMPRET
+clear_exact_points() noexcept -> query_policy_t & {
+    _exact_pts = nullptr; return *this;
+}
+
+_HIPP_TEMPRET
+has_exact_points() const noexcept -> bool {
+    return _exact_pts != nullptr;
+}
+
+_HIPP_TEMPRET
+n_exact_checks() const noexcept -> size_t {
+    return _n_exact_checks;
+}
+
+_HIPP_TEMPRET
+reset_n_exact_checks() noexcept -> query_policy_t & {
+    _n_exact_checks = 0; return *this;
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
+
+} // namespace HIPP::NUMERICAL::_KDSEARCH
+
+#endif	//_HIPPNUMERICAL_KDSEARCH_COMPACT_KDTREE_RAW_IMPL_H_
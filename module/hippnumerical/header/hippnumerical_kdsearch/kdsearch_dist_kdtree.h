@@ -0,0 +1,296 @@
+/**
+create: Yangyao CHEN, 2026/10/17
+    [write   ] DistKDTree - K-dimensional tree distributed over MPI processes.
+*/
+
+#ifndef _HIPPNUMERICAL_KDSEARCH_DIST_KDTREE_H_
+#define _HIPPNUMERICAL_KDSEARCH_DIST_KDTREE_H_
+
+#include "kdsearch_dist_kdtree_raw_impl.h"
+
+namespace HIPP::NUMERICAL {
+
+/**
+K-dimensional tree distributed over the processes of a MPI communicator.
+
+Each process holds a local ``KDTree`` of its own points. The bounding boxes
+of the local points are replicated on all processes as a top tree, which
+determines the processes that a query is sent to.
+
+Available only if the MPI module is enabled (i.e., ``HIPPMPI_ON``).
+*/
+template<typename KDPointT = KDPoint<>, typename IndexT = int>
+class DistKDTree {
+public:
+    /**
+    Implementation detail.
+    */
+    using impl_t = _KDSEARCH::_DistKDTree<KDPointT, IndexT>;
+
+    static constexpr int DIM         = impl_t::DIM;
+    static constexpr size_t PADDING  = impl_t::PADDING;
+
+    /**
+    Types are the same as the local tree, i.e., ``KDTree<KDPointT, IndexT>``.
+    */
+    using point_t    = typename impl_t::point_t;
+    using kd_point_t = typename impl_t::kd_point_t;
+    using node_t     = typename impl_t::node_t;
+
+    using float_t    = typename impl_t::float_t;
+    using index_t    = typename impl_t::index_t;
+    using pos_t      = typename impl_t::pos_t;
+    using rect_t     = typename impl_t::rect_t;
+    using sphere_t   = typename impl_t::sphere_t;
+    using periodic_box_t = typename impl_t::periodic_box_t;
+
+    using construct_policy_t       = typename impl_t::construct_policy_t;
+    using nearest_k_query_policy_t = typename impl_t::nearest_k_query_policy_t;
+    using sphere_query_policy_t    = typename impl_t::sphere_query_policy_t;
+    using batch_query_policy_t     = typename impl_t::batch_query_policy_t;
+    using pair_count_policy_t      = typename impl_t::pair_count_policy_t;
+    using fof_policy_t             = typename impl_t::fof_policy_t;
+
+    using kdtree_t   = typename impl_t::kdtree_t;
+    using top_tree_t = typename impl_t::top_tree_t;
+
+    /**
+    A query result, i.e., the node ``node_idx`` of the local tree on process
+    ``rank``, at squared distance ``r_sq`` to the query position. ``point``
+    is a copy of the node's position and padding, so that the result can be
+    used without accessing the remote tree.
+    */
+    using ngb_t      = typename impl_t::ngb_t;
+
+    /**
+    Constructors.
+
+    (1): Default construction - an empty tree not associated with any
+    communicator. No query can be made.
+
+    (2): Construct the tree collectively. For details, see :func:`construct`.
+
+    ``DistKDTree`` is copyable and movable. The copied-to object shares the
+    same internal state with the source object.
+    */
+    DistKDTree();
+    DistKDTree(const MPI::Comm &comm, ContiguousBuffer<const kd_point_t> pts,
+        const construct_policy_t &policy = construct_policy_t());
+
+    DistKDTree(const DistKDTree &o);
+    DistKDTree(DistKDTree &&o);
+    DistKDTree & operator=(const DistKDTree &o) noexcept;
+    DistKDTree & operator=(DistKDTree &&o) noexcept;
+    ~DistKDTree() noexcept;
+
+    ostream & info(ostream &os = cout, int fmt_cntl = 0, int level = 0) const;
+    friend ostream & operator<<(ostream &os, const DistKDTree &dkdt) {
+        return dkdt.info(os);
+    }
+
+    /**
+    Collectively construct the tree over the processes in ``comm``. Each
+    process passes its local points ``pts`` (``pts.size() == 0`` is valid),
+    from which the local tree is constructed by ``policy``.
+    */
+    void construct(const MPI::Comm &comm,
+        ContiguousBuffer<const kd_point_t> pts,
+        const construct_policy_t &policy = construct_policy_t());
+
+    /**
+    Getters.
+    impl(): the implementation.
+    comm(): the communicator the tree is constructed on.
+    local_tree(): the tree of the local points. Node indices in the query
+    results from the calling process index into ``local_tree().nodes()``.
+    top_tree(): the top tree of the bounding boxes of all processes.
+    */
+    std::shared_ptr<impl_t> impl() const noexcept;
+    const MPI::Comm & comm() const noexcept;
+    const kdtree_t & local_tree() const noexcept;
+    const top_tree_t & top_tree() const noexcept;
+
+    /**
+    Collective batch queries. Each process passes its own queries (any
+    number, including 0). A query is made on the local tree and forwarded
+    only to the processes whose bounding boxes may contain a result.
+
+    nearest_k_batch(): find the ``k`` nearest neighbors of each point in
+    ``pts`` among all processes, sorted by distance (ties are broken by
+    ``(rank, node_idx)``). Less than ``k`` neighbors are found only if the
+    total number of points is less than ``k``. The ``k``-th neighbor found
+    locally bounds the search on other processes.
+
+    find_nodes_sphere_batch(): find all nodes within each sphere among all
+    processes, sorted by ``(rank, node_idx)``.
+
+    On exit, the results of query ``i`` are ``ngbs[displs[i]:displs[i+1]]``.
+    ``batch_policy`` and ``policy`` are applied to all the queries on the
+    local tree, including those forwarded from other processes.
+
+    If the local trees are constructed with a periodic box (the same on all
+    processes), the distances are the minimum-image ones.
+    */
+    template<typename PointT, typename Policy = nearest_k_query_policy_t>
+    void nearest_k_batch(ContiguousBuffer<const PointT> pts, index_t k,
+        vector<index_t> &displs, vector<ngb_t> &ngbs,
+        const batch_query_policy_t &batch_policy = batch_query_policy_t(),
+        const Policy &policy = Policy()) const;
+
+    template<typename Policy = sphere_query_policy_t>
+    void find_nodes_sphere_batch(ContiguousBuffer<const sphere_t> spheres,
+        vector<index_t> &displs, vector<ngb_t> &ngbs,
+        const batch_query_policy_t &batch_policy = batch_query_policy_t(),
+        const Policy &policy = Policy()) const;
+
+    /**
+    Collective pair counting, i.e., count the unordered pairs of distinct 
+    points among all processes in radial bins (see 
+    :func:`KDTree::count_pairs` for the bins and the ``policy``). 
+    
+    Pairs within a process are counted by its local tree. Points within the 
+    largest bin edge of the bounding box of a higher-ranked process are sent
+    to it to count the pairs across the processes. The counts are then summed
+    over the processes, so that all processes get the same ``counts``.
+    */
+    void count_pairs(ContiguousBuffer<const float_t> edges, 
+        vector<double> &counts, 
+        const pair_count_policy_t &policy = pair_count_policy_t()) const;
+
+    /**
+    Collective friends-of-friends groups with linking length ``b`` (see 
+    :func:`KDTree::fof`) over the points on all processes.
+
+    Groups are first found within each process by its local tree. The points
+    within ``b`` of the bounding box of a higher-ranked process, i.e., the
+    ghost layer, are sent to it and linked with its points there. The links 
+    are gathered by all processes to stitch the local groups across the 
+    process boundaries.
+
+    On exit, ``group_ids[i]`` is the global group of the local node ``i``, 
+    or ``-1`` if the group has less than ``policy.min_size()`` nodes in 
+    total. Groups are numbered in the order of ``(rank, node_idx)`` of their
+    first nodes. Return the total number of groups numbered, the same on 
+    all processes.
+    */
+    index_t fof(float_t b, vector<index_t> &group_ids,
+        const fof_policy_t &policy = fof_policy_t()) const;
+protected:
+    std::shared_ptr<impl_t> _impl;
+};
+
+#define _HIPP_TEMPHD template<typename KDPointT, typename IndexT>
+#define _HIPP_TEMPARG <KDPointT, IndexT>
+#define _HIPP_TEMPCLS DistKDTree _HIPP_TEMPARG
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPNORET
+DistKDTree() : _impl( std::make_shared<impl_t>() ) {}
+
+_HIPP_TEMPNORET
+DistKDTree(const MPI::Comm &comm, ContiguousBuffer<const kd_point_t> pts,
+    const construct_policy_t &policy)
+: DistKDTree()
+{
+    construct(comm, pts, policy);
+}
+
+_HIPP_TEMPNORET
+DistKDTree(const DistKDTree &o) = default;
+
+_HIPP_TEMPNORET
+DistKDTree(DistKDTree &&o) = default;
+
+_HIPP_TEMPRET
+operator=(const DistKDTree &o) noexcept -> DistKDTree & = default;
+
+_HIPP_TEMPRET
+operator=(DistKDTree &&o) noexcept -> DistKDTree & = default;
+
+_HIPP_TEMPNORET
+~DistKDTree() noexcept = default;
+
+_HIPP_TEMPRET
+info(ostream &os, int fmt_cntl, int level) const -> ostream & {
+    PStream ps(os);
+    if( fmt_cntl < 1 ) {
+        ps << HIPPCNTL_CLASS_INFO_INLINE(DistKDTree),
+        "{impl=", *_impl, "}";
+        return os;
+    }
+    auto ind = HIPPCNTL_CLASS_INFO_INDENT_STR(level);
+    ps << HIPPCNTL_CLASS_INFO(DistKDTree),
+    ind, ps.info_of(*_impl, fmt_cntl, level+1);
+    return os;
+}
+
+_HIPP_TEMPRET
+construct(const MPI::Comm &comm, ContiguousBuffer<const kd_point_t> pts,
+    const construct_policy_t &policy) -> void
+{
+    _impl->construct(comm, pts, policy);
+}
+
+_HIPP_TEMPRET
+impl() const noexcept -> std::shared_ptr<impl_t> {
+    return _impl;
+}
+
+_HIPP_TEMPRET
+comm() const noexcept -> const MPI::Comm & {
+    return _impl->comm();
+}
+
+_HIPP_TEMPRET
+local_tree() const noexcept -> const kdtree_t & {
+    return _impl->local_tree();
+}
+
+_HIPP_TEMPRET
+top_tree() const noexcept -> const top_tree_t & {
+    return _impl->top_tree();
+}
+
+_HIPP_TEMPHD
+template<typename PointT, typename Policy>
+void _HIPP_TEMPCLS::nearest_k_batch(ContiguousBuffer<const PointT> pts,
+    index_t k, vector<index_t> &displs, vector<ngb_t> &ngbs,
+    const batch_query_policy_t &batch_policy, const Policy &policy) const
+{
+    _impl->nearest_k_batch(pts, k, displs, ngbs, batch_policy, policy);
+}
+
+_HIPP_TEMPHD
+template<typename Policy>
+void _HIPP_TEMPCLS::find_nodes_sphere_batch(
+    ContiguousBuffer<const sphere_t> spheres,
+    vector<index_t> &displs, vector<ngb_t> &ngbs,
+    const batch_query_policy_t &batch_policy, const Policy &policy) const
+{
+    _impl->visit_sphere_batch(spheres, displs, ngbs, batch_policy, policy);
+}
+
+_HIPP_TEMPRET
+count_pairs(ContiguousBuffer<const float_t> edges, vector<double> &counts,
+    const pair_count_policy_t &policy) const -> void
+{
+    _impl->count_pairs(edges, counts, policy);
+}
+
+_HIPP_TEMPRET
+fof(float_t b, vector<index_t> &group_ids, const fof_policy_t &policy) const
+-> index_t
+{
+    return _impl->fof(b, group_ids, policy);
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
+
+} // namespace HIPP::NUMERICAL
+
+#endif	//_HIPPNUMERICAL_KDSEARCH_DIST_KDTREE_H_
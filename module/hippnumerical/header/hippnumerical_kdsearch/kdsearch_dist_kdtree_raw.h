@@ -0,0 +1,225 @@
+/**
+create: Yangyao CHEN, 2026/10/17
+    [write   ] _DistKDTree - Implementation class of DistKDTree.
+*/
+
+#ifndef _HIPPNUMERICAL_KDSEARCH_DIST_KDTREE_RAW_H_
+#define _HIPPNUMERICAL_KDSEARCH_DIST_KDTREE_RAW_H_
+
+#include "kdsearch_kdtree_raw_impl.h"
+#include <hippmpi.h>
+
+namespace HIPP::NUMERICAL::_KDSEARCH {
+
+template<typename KDPointT = KDPoint<>, typename IndexT = int>
+class _DistKDTree {
+public:
+    using kdtree_t   = _KDTree<KDPointT, IndexT>;
+    using kd_point_t = typename kdtree_t::kd_point_t;
+    using node_t     = typename kdtree_t::node_t;
+    using point_t    = typename kdtree_t::point_t;
+
+    using float_t    = typename kdtree_t::float_t;
+    using index_t    = typename kdtree_t::index_t;
+    using pos_t      = typename kdtree_t::pos_t;
+    using rect_t     = typename kdtree_t::rect_t;
+    using sphere_t   = typename kdtree_t::sphere_t;
+    using periodic_box_t = typename kdtree_t::periodic_box_t;
+
+    static constexpr int DIM         = kdtree_t::DIM;
+    static constexpr size_t PADDING  = kdtree_t::PADDING;
+
+    using construct_policy_t       = typename kdtree_t::construct_policy_t;
+    using nearest_k_query_policy_t = typename kdtree_t::nearest_k_query_policy_t;
+    using sphere_query_policy_t    = typename kdtree_t::sphere_query_policy_t;
+    using batch_query_policy_t     = typename kdtree_t::batch_query_policy_t;
+    using pair_count_policy_t      = typename kdtree_t::pair_count_policy_t;
+    using fof_policy_t             = typename kdtree_t::fof_policy_t;
+
+    class top_tree_t;
+    struct ngb_t;
+
+    _DistKDTree() noexcept;
+
+    ostream & info(ostream &os = cout, int fmt_cntl = 0, int level = 0) const;
+    friend ostream & operator<<(ostream &os, const _DistKDTree &dkdt) {
+        return dkdt.info(os);
+    }
+
+    /**
+    Collectively construct the tree over the processes in ``comm``. Each
+    process passes its local points ``pts`` (any number, including 0) and
+    builds its local tree by ``policy``. The bounding boxes of the local
+    points are then gathered to build the top tree on every process.
+    */
+    void construct(const MPI::Comm &comm,
+        ContiguousBuffer<const kd_point_t> pts,
+        const construct_policy_t &policy = construct_policy_t());
+
+    const MPI::Comm & comm() const noexcept;
+    const kdtree_t & local_tree() const noexcept;
+    const top_tree_t & top_tree() const noexcept;
+
+    /**
+    Collective batch queries. Each process passes its own queries. A query
+    is first made on the local tree, and then sent only to the processes
+    whose bounding boxes may hold a result, as determined by the top tree.
+
+    nearest_k_batch(): the ``k`` nearest neighbors of each point in ``pts``
+    over all processes, sorted by distance. Less than ``k`` are found only if
+    there are less than ``k`` points in total.
+
+    visit_sphere_batch(): all points within each sphere, sorted by
+    ``(rank, node_idx)``.
+
+    The results of query ``i`` are in ``[displs[i], displs[i+1])`` of
+    ``ngbs``. ``batch_policy`` and ``policy`` are used by the local tree
+    for both the local queries and the ones from other processes.
+    */
+    template<typename PointT, typename Policy = nearest_k_query_policy_t>
+    void nearest_k_batch(ContiguousBuffer<const PointT> pts, index_t k,
+        vector<index_t> &displs, vector<ngb_t> &ngbs,
+        const batch_query_policy_t &batch_policy = batch_query_policy_t(),
+        const Policy &policy = Policy()) const;
+
+    template<typename Policy = sphere_query_policy_t>
+    void visit_sphere_batch(ContiguousBuffer<const sphere_t> spheres,
+        vector<index_t> &displs, vector<ngb_t> &ngbs,
+        const batch_query_policy_t &batch_policy = batch_query_policy_t(),
+        const Policy &policy = Policy()) const;
+
+    /**
+    Collective binned pair counting over the points on all processes (auto
+    pairs). Local pairs are counted by the local tree. Each process then 
+    sends its points near the bounding box of each higher-ranked process to 
+    it, where the cross pairs are counted, so that a pair is counted once. 
+    The counts are finally summed over all processes, i.e., all processes 
+    get the same ``counts``.
+    */
+    void count_pairs(ContiguousBuffer<const float_t> edges, 
+        vector<double> &counts, const pair_count_policy_t &policy 
+            = pair_count_policy_t()) const;
+
+    /**
+    Collective friends-of-friends groups over the points on all processes.
+    Local groups are found by the local tree. Each process then sends its
+    points within ``b`` of the bounding box of each higher-ranked process to
+    it, i.e., the ghost layer, where they are linked with the local points.
+    The links across the processes are gathered to stitch the local groups
+    into the global ones.
+
+    On exit, ``group_ids[i]`` is the global group of the local node ``i``.
+    Groups are numbered ``0, 1, ...`` in the order of ``(rank, node_idx)``
+    of their first nodes, and those with less than ``policy.min_size()``
+    nodes get ``-1``. Return the total number of groups numbered.
+    */
+    index_t fof(float_t b, vector<index_t> &group_ids,
+        const fof_policy_t &policy = fof_policy_t()) const;
+private:
+    MPI::Comm _comm;
+    kdtree_t _kdt;
+    std::unique_ptr<top_tree_t> _top;
+
+    /**
+    A nearest-k query forwarded to another process: the position and the
+    squared distance to the k-th neighbor found so far. Only closer
+    neighbors are wanted.
+    */
+    struct _query_t {
+        pos_t pos;
+        float_t r_sq;
+    };
+
+    /**
+    Send ``queries[i]`` to each process in ``dests[i]``, let ``op(qs,
+    displs, ngbs)`` answer the queries ``qs`` received from all processes
+    (the results of ``qs[j]`` in ``[displs[j], displs[j+1])`` of ``ngbs``),
+    and return the answers, i.e., the results of ``queries[i]`` from all the
+    destinations are in ``[displs_out[i], displs_out[i+1])`` of ``ngbs_out``.
+    */
+    template<typename Q, typename Op>
+    void _forward(const vector<Q> &queries,
+        const vector<vector<int> > &dests, Op &&op,
+        vector<index_t> &displs_out, vector<ngb_t> &ngbs_out) const;
+
+    template<typename T>
+    void _alltoallv(const vector<T> &send, const vector<int> &send_counts,
+        vector<T> &recv, vector<int> &recv_counts) const;
+    template<typename T>
+    void _allgatherv(const vector<T> &send, vector<T> &recv) const;
+
+    ngb_t _ngb_of(index_t node_idx, float_t r_sq) const noexcept;
+};
+
+/**
+The replicated top tree, i.e., a binary tree of the bounding boxes of the
+points on all processes. Processes with no point are not in the tree.
+
+Nodes are stored in pre-order, i.e., the left child of node ``i`` is
+``i+1``, and the nodes of its subtree are ``[i, i+size)``. A leaf holds a
+single process.
+*/
+template<typename KDPointT, typename IndexT>
+class _DistKDTree<KDPointT, IndexT>::top_tree_t {
+public:
+    struct node_t {
+        rect_t rect;
+        int rank, size;
+    };
+
+    /**
+    Build the tree, with ``rects[i]`` the bounding box of process ``i`` and
+    ``n_pts[i]`` the number of points in it. With a periodic ``box``, the
+    distances to the boxes are the minimum-image ones.
+    */
+    top_tree_t(const vector<rect_t> &rects, const vector<index_t> &n_pts,
+        const periodic_box_t &box = periodic_box_t());
+
+    ostream & info(ostream &os = cout, int fmt_cntl = 0, int level = 0) const;
+    friend ostream & operator<<(ostream &os, const top_tree_t &t) {
+        return t.info(os);
+    }
+
+    const vector<node_t> & nodes() const noexcept;
+    const vector<rect_t> & rects() const noexcept;
+    const vector<index_t> & n_pts() const noexcept;
+
+    /**
+    Call ``op(rank)`` on each process whose bounding box is at a squared
+    distance less than ``r_sq`` to ``p``.
+    */
+    template<typename Op>
+    void visit_ranks_within(const pos_t &p, float_t r_sq, Op &&op) const;
+
+    /**
+    Squared distance from ``p`` to the nearest point in ``rect``, computed
+    as the squared distances between points, so that it never exceeds the
+    one to any point in ``rect``.
+    */
+    static float_t r_sq_to(const rect_t &rect, const pos_t &p) noexcept;
+private:
+    vector<rect_t> _rects;
+    vector<index_t> _n_pts;
+    vector<node_t> _nodes;
+    periodic_box_t _box;
+
+    void _build(int *b, int *e);
+};
+
+template<typename KDPointT, typename IndexT>
+struct _DistKDTree<KDPointT, IndexT>::ngb_t {
+    int rank;
+    index_t node_idx;
+    float_t r_sq;
+    kd_point_t point;
+
+    bool operator<(const ngb_t &o) const noexcept {
+        if( r_sq != o.r_sq ) return r_sq < o.r_sq;
+        if( rank != o.rank ) return rank < o.rank;
+        return node_idx < o.node_idx;
+    }
+};
+
+} // namespace HIPP::NUMERICAL::_KDSEARCH
+
+#endif	//_HIPPNUMERICAL_KDSEARCH_DIST_KDTREE_RAW_H_
@@ -0,0 +1,623 @@
+/**
+create: Yangyao CHEN, 2026/10/17
+Implementation of kdsearch_dist_kdtree_raw.h
+*/
+
+#ifndef _HIPPNUMERICAL_KDSEARCH_DIST_KDTREE_RAW_IMPL_H_
+#define _HIPPNUMERICAL_KDSEARCH_DIST_KDTREE_RAW_IMPL_H_
+
+#include "kdsearch_dist_kdtree_raw.h"
+
+namespace HIPP::NUMERICAL::_KDSEARCH {
+
+#define _HIPP_TEMPHD template<typename KDPointT, typename IndexT>
+#define _HIPP_TEMPARG <KDPointT, IndexT>
+#define _HIPP_TEMPCLS _DistKDTree _HIPP_TEMPARG
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPNORET
+_DistKDTree() noexcept
+: _comm(MPI::Comm::nullval()), _top(new top_tree_t({}, {}))
+{}
+
+_HIPP_TEMPRET
+info(ostream &os, int fmt_cntl, int level) const -> ostream & {
+    PStream ps(os);
+    const int n_procs = _comm.is_null() ? 0 : _comm.size();
+    if( fmt_cntl < 1 ) {
+        ps << HIPPCNTL_CLASS_INFO_INLINE(_DistKDTree), "{",
+        "no. processes=", n_procs, ", local tree=", _kdt,
+        ", top tree=", *_top, "}";
+    } else {
+        auto ind = HIPPCNTL_CLASS_INFO_INDENT_STR(level);
+        ps << HIPPCNTL_CLASS_INFO(_DistKDTree),
+        ind, "No. processes = ", n_procs, '\n',
+        ind, ps.info_of(_kdt, 0, level+1), '\n',
+        ind, ps.info_of(*_top, 0, level+1), '\n';
+    }
+    return os;
+}
+
+_HIPP_TEMPRET
+construct(const MPI::Comm &comm, ContiguousBuffer<const kd_point_t> pts,
+    const construct_policy_t &policy) -> void
+{
+    _kdt.construct(pts, policy);
+
+    struct bound_t {
+        rect_t rect;
+        index_t n_pts;
+    };
+    auto [p_pts, n_pts] = pts;
+    bound_t bound {rect_t(), static_cast<index_t>(n_pts)};
+    if( n_pts > 0 ) {
+        pos_t low = p_pts[0].pos(), high = low;
+        for(size_t i=1; i<n_pts; ++i) {
+            const auto &pos = p_pts[i].pos();
+            for(int j=0; j<DIM; ++j) {
+                if( pos[j] < low[j] ) low[j] = pos[j];
+                else if( pos[j] > high[j] ) high[j] = pos[j];
+            }
+        }
+        bound.rect = rect_t(point_t(low), point_t(high));
+    }
+
+    vector<bound_t> bounds(comm.size());
+    comm.allgather(&bound, bounds.data(), 1,
+        MPI::BYTE.contiguous(sizeof(bound_t)));
+
+    vector<rect_t> rects;
+    vector<index_t> n_pts_all;
+    for(const auto &b: bounds) {
+        rects.push_back(b.rect);
+        n_pts_all.push_back(b.n_pts);
+    }
+    _top.reset(new top_tree_t(rects, n_pts_all, policy.periodic_box()));
+    _comm = comm;
+}
+
+_HIPP_TEMPRET
+comm() const noexcept -> const MPI::Comm & {
+    return _comm;
+}
+
+_HIPP_TEMPRET
+local_tree() const noexcept -> const kdtree_t & {
+    return _kdt;
+}
+
+_HIPP_TEMPRET
+top_tree() const noexcept -> const top_tree_t & {
+    return *_top;
+}
+
+_HIPP_TEMPHD
+template<typename PointT, typename Policy>
+void _HIPP_TEMPCLS::nearest_k_batch(ContiguousBuffer<const PointT> pts,
+    index_t k, vector<index_t> &displs, vector<ngb_t> &ngbs,
+    const batch_query_policy_t &batch_policy, const Policy &policy) const
+{
+    using local_ngb_t = typename kdtree_t::ngb_t;
+
+    vector<index_t> l_displs;
+    vector<local_ngb_t> l_ngbs;
+    _kdt.nearest_k_batch(pts, k, l_displs, l_ngbs, batch_policy, policy);
+
+    // Forward each query to the processes that may hold a neighbor closer
+    // than the k-th one found locally.
+    auto [p_pts, n_pts] = pts;
+    const int rank = _comm.rank();
+    vector<_query_t> qs(n_pts);
+    vector<vector<int> > dests(n_pts);
+    for(size_t i=0; i<n_pts; ++i) {
+        auto &q = qs[i];
+        q.pos = p_pts[i].pos();
+        const index_t b = l_displs[i], e = l_displs[i+1];
+        if( e - b < k )
+            q.r_sq = std::numeric_limits<float_t>::infinity();
+        else {
+            q.r_sq = 0;
+            for(index_t j=b; j<e; ++j)
+                q.r_sq = std::max(q.r_sq, l_ngbs[j].r_sq);
+        }
+        if( k == 0 ) continue;
+        _top->visit_ranks_within(q.pos, q.r_sq, [&](int r) {
+            if( r != rank ) dests[i].push_back(r);
+        });
+    }
+
+    vector<index_t> r_displs;
+    vector<ngb_t> r_ngbs;
+    _forward(qs, dests, [&](const vector<_query_t> &in_qs,
+        vector<index_t> &out_displs, vector<ngb_t> &out_ngbs)
+    {
+        vector<point_t> in_pts;
+        for(const auto &q: in_qs) in_pts.emplace_back(q.pos);
+        vector<index_t> in_displs;
+        vector<local_ngb_t> in_ngbs;
+        _kdt.nearest_k_batch(ContiguousBuffer<const point_t>(in_pts), k,
+            in_displs, in_ngbs, batch_policy, policy);
+        out_displs.assign(1, 0);
+        for(size_t j=0; j<in_qs.size(); ++j) {
+            for(index_t t=in_displs[j]; t<in_displs[j+1]; ++t) {
+                const auto &ngb = in_ngbs[t];
+                if( ngb.r_sq < in_qs[j].r_sq )
+                    out_ngbs.push_back(_ngb_of(ngb.node_idx, ngb.r_sq));
+            }
+            out_displs.push_back(out_ngbs.size());
+        }
+    }, r_displs, r_ngbs);
+
+    // Merge the local and remote results.
+    displs.assign(1, 0);
+    ngbs.clear();
+    vector<ngb_t> cands;
+    for(size_t i=0; i<n_pts; ++i) {
+        cands.clear();
+        for(index_t j=l_displs[i]; j<l_displs[i+1]; ++j)
+            cands.push_back(_ngb_of(l_ngbs[j].node_idx, l_ngbs[j].r_sq));
+        cands.insert(cands.end(), r_ngbs.begin()+r_displs[i],
+            r_ngbs.begin()+r_displs[i+1]);
+        const size_t n = std::min<size_t>(k, cands.size());
+        std::partial_sort(cands.begin(), cands.begin()+n, cands.end());
+        ngbs.insert(ngbs.end(), cands.begin(), cands.begin()+n);
+        displs.push_back(ngbs.size());
+    }
+}
+
+_HIPP_TEMPHD
+template<typename Policy>
+void _HIPP_TEMPCLS::visit_sphere_batch(
+    ContiguousBuffer<const sphere_t> spheres,
+    vector<index_t> &displs, vector<ngb_t> &ngbs,
+    const batch_query_policy_t &batch_policy, const Policy &policy) const
+{
+    // The node ids found by the local tree, converted to the results.
+    auto to_ngbs = [this](const sphere_t *p_ss, size_t n_ss,
+        const vector<index_t> &ids_displs, const vector<index_t> &ids,
+        vector<index_t> &out_displs, vector<ngb_t> &out_ngbs)
+    {
+        const auto &box = _kdt.construct_policy().periodic_box();
+        out_displs.assign(1, 0);
+        for(size_t j=0; j<n_ss; ++j) {
+            const auto &c = p_ss[j].center().pos();
+            for(index_t t=ids_displs[j]; t<ids_displs[j+1]; ++t) {
+                const float_t r_sq = box.r_sq(_kdt.point_pos(ids[t]), c);
+                out_ngbs.push_back(_ngb_of(ids[t], r_sq));
+            }
+            out_displs.push_back(out_ngbs.size());
+        }
+    };
+
+    vector<index_t> ids_displs, ids;
+    _kdt.visit_sphere_batch(spheres, ids_displs, ids, batch_policy, policy);
+    vector<index_t> l_displs;
+    vector<ngb_t> l_ngbs;
+    auto [p_ss, n_ss] = spheres;
+    to_ngbs(p_ss, n_ss, ids_displs, ids, l_displs, l_ngbs);
+
+    const int rank = _comm.rank();
+    vector<sphere_t> qs(p_ss, p_ss + n_ss);
+    vector<vector<int> > dests(n_ss);
+    for(size_t i=0; i<n_ss; ++i) {
+        const auto &s = qs[i];
+        _top->visit_ranks_within(s.center().pos(), s.r() * s.r(),
+            [&](int r) { if( r != rank ) dests[i].push_back(r); });
+    }
+
+    vector<index_t> r_displs;
+    vector<ngb_t> r_ngbs;
+    _forward(qs, dests, [&](const vector<sphere_t> &in_qs,
+        vector<index_t> &out_displs, vector<ngb_t> &out_ngbs)
+    {
+        vector<index_t> in_displs, in_ids;
+        _kdt.visit_sphere_batch(ContiguousBuffer<const sphere_t>(in_qs),
+            in_displs, in_ids, batch_policy, policy);
+        to_ngbs(in_qs.data(), in_qs.size(), in_displs, in_ids,
+            out_displs, out_ngbs);
+    }, r_displs, r_ngbs);
+
+    displs.assign(1, 0);
+    ngbs.clear();
+    auto by_idx = [](const ngb_t &a, const ngb_t &b) {
+        return a.rank < b.rank || ( a.rank == b.rank
+            && a.node_idx < b.node_idx );
+    };
+    for(size_t i=0; i<n_ss; ++i) {
+        const size_t b = ngbs.size();
+        ngbs.insert(ngbs.end(), l_ngbs.begin()+l_displs[i],
+            l_ngbs.begin()+l_displs[i+1]);
+        ngbs.insert(ngbs.end(), r_ngbs.begin()+r_displs[i],
+            r_ngbs.begin()+r_displs[i+1]);
+        std::sort(ngbs.begin()+b, ngbs.end(), by_idx);
+        displs.push_back(ngbs.size());
+    }
+}
+
+_HIPP_TEMPRET
+count_pairs(ContiguousBuffer<const float_t> edges, vector<double> &counts,
+    const pair_count_policy_t &policy) const -> void
+{
+    _kdt.count_pairs(edges, counts, policy);
+
+    // Send the local points within the largest bin edge of the bounding
+    // box of each higher-ranked process.
+    const int rank = _comm.rank(), n_procs = _comm.size();
+    auto [p_edges, n_edges] = edges;
+    const float_t r_max = p_edges[n_edges-1], r_max_sq = r_max * r_max;
+    const index_t n_pts = _kdt.n_points();
+    vector<vector<index_t> > dests(n_procs);
+    for(index_t i=0; i<n_pts; ++i)
+        _top->visit_ranks_within(_kdt.point_pos(i), r_max_sq, [&](int r) {
+            if( r > rank ) dests[r].push_back(i);
+        });
+    vector<kd_point_t> send, recv;
+    vector<int> send_counts(n_procs), recv_counts;
+    for(int r=0; r<n_procs; ++r) {
+        send_counts[r] = dests[r].size();
+        for(index_t i: dests[r]) {
+            send.emplace_back(_kdt.point_pos(i));
+            send.back().fill_pad(_kdt.point_pad(i), PADDING);
+        }
+    }
+    _alltoallv(send, send_counts, recv, recv_counts);
+
+    // Cross pairs of the local points and the received ones.
+    if( !recv.empty() ) {
+        kdtree_t halo;
+        halo.construct(recv, _kdt.construct_policy());
+        vector<double> cross;
+        _kdt.count_pairs(halo, edges, cross, policy);
+        for(size_t b=0; b<counts.size(); ++b) counts[b] += cross[b];
+    }
+    _comm.allreduce(MPI::IN_PLACE, counts.data(), counts.size(),
+        MPI::DOUBLE, MPI::SUM);
+}
+
+_HIPP_TEMPRET
+fof(float_t b, vector<index_t> &group_ids, const fof_policy_t &policy) const
+-> index_t
+{
+    using union_find_t = _UnionFind<index_t>;
+    constexpr index_t idNONE = union_find_t::idNONE;
+    const int rank = _comm.rank(), n_procs = _comm.size();
+
+    // Local groups. Their labels are made global by the offset of the rank.
+    vector<index_t> loc_ids, n_locs;
+    const index_t n_loc = _kdt.fof(b, loc_ids, 
+        fof_policy_t(policy).set_min_size(1));
+    _allgatherv(vector<index_t>{n_loc}, n_locs);
+    index_t off = 0;
+    for(int r=0; r<rank; ++r) off += n_locs[r];
+
+    // Send the ghost layer, i.e., the local points within ``b`` of the 
+    // bounding box of each higher-ranked process.
+    struct ghost_t {
+        pos_t pos;
+        index_t label;
+    };
+    const float_t b_sq = b * b;
+    const index_t n_pts = _kdt.n_points();
+    vector<vector<index_t> > dests(n_procs);
+    for(index_t i=0; i<n_pts; ++i)
+        _top->visit_ranks_within(_kdt.point_pos(i), b_sq, [&](int r) {
+            if( r > rank ) dests[r].push_back(i);
+        });
+    vector<ghost_t> send, recv;
+    vector<int> send_counts(n_procs), recv_counts;
+    for(int r=0; r<n_procs; ++r) {
+        send_counts[r] = dests[r].size();
+        for(index_t i: dests[r]) 
+            send.push_back({_kdt.point_pos(i), off + loc_ids[i]});
+    }
+    _alltoallv(send, send_counts, recv, recv_counts);
+
+    // Link the ghosts with the local points, and gather the links.
+    using link_t = std::pair<index_t, index_t>;
+    vector<link_t> links, all_links;
+    const auto &box = _kdt.construct_policy().periodic_box();
+    for(const auto &g: recv) {
+        _kdt.visit_sphere(sphere_t(point_t(g.pos), b), [&](index_t j) {
+            const auto &p = _kdt.point_pos(j);
+            const float_t r_sq = box.is_periodic() ? box.r_sq(p, g.pos) 
+                : float_t( (p - g.pos).squared_norm() );
+            if( r_sq < b_sq ) links.emplace_back(g.label, off + loc_ids[j]);
+        });
+    }
+    std::sort(links.begin(), links.end());
+    links.erase(std::unique(links.begin(), links.end()), links.end());
+    _allgatherv(links, all_links);
+
+    // Stitch the local groups involved in the links. The root of a stitched
+    // group is its smallest label.
+    vector<index_t> inv;
+    for(auto &[l0, l1]: all_links) { inv.push_back(l0); inv.push_back(l1); }
+    std::sort(inv.begin(), inv.end());
+    inv.erase(std::unique(inv.begin(), inv.end()), inv.end());
+    const index_t n_inv = inv.size();
+    auto inv_idx = [&](index_t label) -> index_t {
+        return std::lower_bound(inv.begin(), inv.end(), label) - inv.begin();
+    };
+    union_find_t uf(n_inv);
+    for(auto &[l0, l1]: all_links) uf.unite(inv_idx(l0), inv_idx(l1));
+
+    // Sizes of the stitched groups, summed from the owners of the labels.
+    vector<index_t> sizes(n_loc, 0), inv_sizes, all_inv_sizes;
+    for(index_t l: loc_ids) ++sizes[l];
+    const index_t inv_b = inv_idx(off), inv_e = inv_idx(off + n_loc);
+    for(index_t k=inv_b; k<inv_e; ++k) 
+        inv_sizes.push_back(sizes[inv[k]-off]);
+    _allgatherv(inv_sizes, all_inv_sizes);
+    vector<index_t> root_sizes(n_inv, 0);
+    for(index_t k=0; k<n_inv; ++k) root_sizes[uf.find(k)] += all_inv_sizes[k];
+
+    // Each process numbers the groups whose roots it owns.
+    const index_t min_size = policy.min_size();
+    vector<index_t> ids(n_loc, idNONE), n_groups;
+    vector<link_t> root_ids, all_root_ids;
+    index_t n_own = 0;
+    for(index_t l=0, k=inv_b; l<n_loc; ++l) {
+        index_t size = sizes[l];
+        const bool is_inv = k < inv_e && inv[k] == off + l;
+        if( is_inv ) {
+            if( uf.find(k) != k ) { ++k; continue; }
+            size = root_sizes[k];
+        }
+        if( size >= min_size ) {
+            ids[l] = n_own++;
+            if( is_inv ) root_ids.emplace_back(k, ids[l]);
+        }
+        if( is_inv ) ++k;
+    }
+    _allgatherv(vector<index_t>{n_own}, n_groups);
+    index_t base = 0, n_total = 0;
+    for(int r=0; r<n_procs; ++r) {
+        if( r < rank ) base += n_groups[r];
+        n_total += n_groups[r];
+    }
+    for(auto &id: ids) if( id != idNONE ) id += base;
+    for(auto &[k, id]: root_ids) id += base;
+    _allgatherv(root_ids, all_root_ids);
+    vector<index_t> inv_ids(n_inv, idNONE);
+    for(auto &[k, id]: all_root_ids) inv_ids[k] = id;
+    for(index_t k=inv_b; k<inv_e; ++k) 
+        ids[inv[k]-off] = inv_ids[uf.find(k)];
+
+    group_ids.resize(n_pts);
+    for(index_t i=0; i<n_pts; ++i) group_ids[i] = ids[loc_ids[i]];
+    return n_total;
+}
+
+_HIPP_TEMPHD
+template<typename Q, typename Op>
+void _HIPP_TEMPCLS::_forward(const vector<Q> &queries,
+    const vector<vector<int> > &dests, Op &&op,
+    vector<index_t> &displs_out, vector<ngb_t> &ngbs_out) const
+{
+    const int n_procs = _comm.size();
+    const size_t n_qs = queries.size();
+
+    // Pack the queries by destination. Slot s is the query origin[s].
+    vector<int> send_counts(n_procs, 0), send_displs(n_procs+1, 0);
+    for(const auto &ds: dests)
+        for(int r: ds) ++send_counts[r];
+    for(int r=0; r<n_procs; ++r)
+        send_displs[r+1] = send_displs[r] + send_counts[r];
+    vector<Q> send(send_displs[n_procs]);
+    vector<index_t> origin(send.size());
+    vector<int> pos(send_displs.begin(), send_displs.end()-1);
+    for(size_t i=0; i<n_qs; ++i) {
+        for(int r: dests[i]) {
+            origin[pos[r]] = i;
+            send[pos[r]++] = queries[i];
+        }
+    }
+    vector<Q> recv;
+    vector<int> recv_counts;
+    _alltoallv(send, send_counts, recv, recv_counts);
+
+    // Answer the received queries, and send the results back in the same
+    // order.
+    vector<index_t> a_displs;
+    vector<ngb_t> a_ngbs;
+    op(recv, a_displs, a_ngbs);
+    vector<index_t> a_counts(recv.size());
+    vector<int> reply_counts(n_procs, 0);
+    for(size_t j=0, r=0, end=0; j<recv.size(); ++j) {
+        while( j == end ) end += recv_counts[r++];
+        a_counts[j] = a_displs[j+1] - a_displs[j];
+        reply_counts[r-1] += a_counts[j];
+    }
+    vector<index_t> counts;
+    vector<ngb_t> ngbs;
+    vector<int> ngb_counts;
+    _alltoallv(a_counts, recv_counts, counts, send_counts);
+    _alltoallv(a_ngbs, reply_counts, ngbs, ngb_counts);
+
+    // Unpack the results by query.
+    displs_out.assign(n_qs+1, 0);
+    for(size_t s=0; s<counts.size(); ++s)
+        displs_out[origin[s]+1] += counts[s];
+    for(size_t i=0; i<n_qs; ++i)
+        displs_out[i+1] += displs_out[i];
+    ngbs_out.resize(ngbs.size());
+    vector<index_t> dst(displs_out.begin(), displs_out.end()-1);
+    auto src = ngbs.begin();
+    for(size_t s=0; s<counts.size(); ++s) {
+        auto &d = dst[origin[s]];
+        std::copy_n(src, counts[s], ngbs_out.begin()+d);
+        src += counts[s];
+        d += counts[s];
+    }
+}
+
+_HIPP_TEMPHD
+template<typename T>
+void _HIPP_TEMPCLS::_alltoallv(const vector<T> &send,
+    const vector<int> &send_counts, vector<T> &recv,
+    vector<int> &recv_counts) const
+{
+    const int n_procs = _comm.size();
+    recv_counts.resize(n_procs);
+    _comm.alltoall(send_counts.data(), recv_counts.data(), 1, MPI::INT);
+
+    vector<int> send_displs(n_procs+1, 0), recv_displs(n_procs+1, 0);
+    for(int r=0; r<n_procs; ++r) {
+        send_displs[r+1] = send_displs[r] + send_counts[r];
+        recv_displs[r+1] = recv_displs[r] + recv_counts[r];
+    }
+    recv.resize(recv_displs[n_procs]);
+    auto dtype = MPI::BYTE.contiguous(sizeof(T));
+    _comm.alltoallv(send.data(), send_counts.data(), send_displs.data(),
+        dtype, recv.data(), recv_counts.data(), recv_displs.data(), dtype);
+}
+
+_HIPP_TEMPHD
+template<typename T>
+void _HIPP_TEMPCLS::_allgatherv(const vector<T> &send, 
+    vector<T> &recv) const 
+{
+    const int n_procs = _comm.size(), send_count = send.size();
+    vector<int> recv_counts(n_procs), recv_displs(n_procs+1, 0);
+    _comm.allgather(&send_count, recv_counts.data(), 1, MPI::INT);
+    for(int r=0; r<n_procs; ++r)
+        recv_displs[r+1] = recv_displs[r] + recv_counts[r];
+    recv.resize(recv_displs[n_procs]);
+    auto dtype = MPI::BYTE.contiguous(sizeof(T));
+    _comm.allgatherv(send.data(), send_count, dtype, recv.data(), 
+        recv_counts.data(), recv_displs.data(), dtype);
+}
+
+_HIPP_TEMPRET
+_ngb_of(index_t node_idx, float_t r_sq) const noexcept -> ngb_t {
+    ngb_t ngb {_comm.rank(), node_idx, r_sq, 
+        kd_point_t(_kdt.point_pos(node_idx))};
+    ngb.point.fill_pad(_kdt.point_pad(node_idx), PADDING);
+    return ngb;
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
+
+#define _HIPP_TEMPHD template<typename KDPointT, typename IndexT>
+#define _HIPP_TEMPARG <KDPointT, IndexT>
+#define _HIPP_TEMPCLS _DistKDTree _HIPP_TEMPARG::top_tree_t
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPNORET
+top_tree_t(const vector<rect_t> &rects, const vector<index_t> &n_pts,
+    const periodic_box_t &box)
+: _rects(rects), _n_pts(n_pts), _box(box)
+{
+    vector<int> ranks;
+    for(size_t i=0; i<_n_pts.size(); ++i)
+        if( _n_pts[i] > 0 ) ranks.push_back(i);
+    if( !ranks.empty() )
+        _build(ranks.data(), ranks.data() + ranks.size());
+}
+
+_HIPP_TEMPRET
+info(ostream &os, int fmt_cntl, int level) const -> ostream & {
+    PStream ps(os);
+    if( fmt_cntl < 1 ) {
+        ps << HIPPCNTL_CLASS_INFO_INLINE(top_tree_t), "{",
+        "no. processes=", _rects.size(), ", no. nodes=", _nodes.size(), "}";
+    } else {
+        auto ind = HIPPCNTL_CLASS_INFO_INDENT_STR(level);
+        ps << HIPPCNTL_CLASS_INFO(top_tree_t),
+        ind, "No. processes = ", _rects.size(),
+            ", no. nodes = ", _nodes.size(), '\n';
+    }
+    return os;
+}
+
+_HIPP_TEMPRET
+nodes() const noexcept -> const vector<node_t> & {
+    return _nodes;
+}
+
+_HIPP_TEMPRET
+rects() const noexcept -> const vector<rect_t> & {
+    return _rects;
+}
+
+_HIPP_TEMPRET
+n_pts() const noexcept -> const vector<index_t> & {
+    return _n_pts;
+}
+
+_HIPP_TEMPHD
+template<typename Op>
+void _HIPP_TEMPCLS::visit_ranks_within(const pos_t &p, float_t r_sq,
+    Op &&op) const
+{
+    const size_t n = _nodes.size();
+    size_t i = 0;
+    while( i < n ) {
+        const auto &node = _nodes[i];
+        const float_t d = _box.is_periodic() ? _box.r_sq_to(node.rect, p)
+            : r_sq_to(node.rect, p);
+        if( d < r_sq ) {
+            if( node.rank >= 0 ) op(node.rank);
+            ++i;
+        } else
+            i += node.size;
+    }
+}
+
+_HIPP_TEMPRET
+r_sq_to(const rect_t &rect, const pos_t &p) noexcept -> float_t {
+    const auto &low = rect.low().pos(), &high = rect.high().pos();
+    pos_t dx;
+    for(int j=0; j<DIM; ++j) {
+        if( p[j] < low[j] ) dx[j] = low[j] - p[j];
+        else if( p[j] > high[j] ) dx[j] = p[j] - high[j];
+        else dx[j] = 0;
+    }
+    return dx.squared_norm();
+}
+
+_HIPP_TEMPRET
+_build(int *b, int *e) -> void {
+    const size_t i_node = _nodes.size();
+    pos_t low = _rects[*b].low().pos(), high = _rects[*b].high().pos();
+    for(int *p=b+1; p<e; ++p) {
+        const auto &l = _rects[*p].low().pos(), &h = _rects[*p].high().pos();
+        for(int j=0; j<DIM; ++j) {
+            low[j] = std::min(low[j], l[j]);
+            high[j] = std::max(high[j], h[j]);
+        }
+    }
+    _nodes.push_back({rect_t(point_t(low), point_t(high)), -1, 1});
+    if( e - b == 1 ) {
+        _nodes[i_node].rank = *b;
+        return;
+    }
+
+    // Split the processes at the median of their centers along the longest
+    // axis.
+    const int axis = (high - low).max_index();
+    int *m = b + (e - b) / 2;
+    std::nth_element(b, m, e, [&](int r1, int r2) {
+        return _rects[r1].center().pos()[axis]
+            < _rects[r2].center().pos()[axis];
+    });
+    _build(b, m);
+    _build(m, e);
+    _nodes[i_node].size = _nodes.size() - i_node;
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
+
+} // namespace HIPP::NUMERICAL::_KDSEARCH
+
+#endif	//_HIPPNUMERICAL_KDSEARCH_DIST_KDTREE_RAW_IMPL_H_
@@ -0,0 +1,174 @@
+/**
+create: Yangyao CHEN, 2026/10/17
+    [write   ] _AllNearestKPolicy - policy of the all-k-nearest-neighbor query.
+    [write   ] _KNNRows - fixed-size max-heaps of neighbors, one per query
+        point, shared by the dual-tree algorithms.
+*/
+
+#ifndef _HIPPNUMERICAL_KDSEARCH_DUAL_TREE_H_
+#define _HIPPNUMERICAL_KDSEARCH_DUAL_TREE_H_
+
+#include "kdsearch_base.h"
+
+namespace HIPP::NUMERICAL::_KDSEARCH {
+
+/**
+Policy of the all-k-nearest-neighbor (all-kNN) query.
+
+n_threads: the number of threads. The query tree is cut at a depth such that
+there are enough independent query subtrees for all threads. Each subtree is
+processed by a single thread against the whole reference tree.
+
+include_self: whether or not a point is taken as a neighbor of itself.
+Default off, i.e., the neighbors form a kNN graph.
+*/
+class _AllNearestKPolicy {
+public:
+    static constexpr int DFLT_N_THREADS = 1;
+    static constexpr bool DFLT_INCLUDE_SELF = false;
+
+    _AllNearestKPolicy() noexcept;
+
+    ostream & info(ostream &os = cout, int fmt_cntl = 0, int level = 0) const;
+    friend ostream & operator<< (ostream &os,
+        const _AllNearestKPolicy &pl) { return pl.info(os); }
+
+    int n_threads() const noexcept;
+    _AllNearestKPolicy & set_n_threads(int n_threads) noexcept;
+
+    bool include_self() const noexcept;
+    _AllNearestKPolicy & include_self_on() noexcept;
+    _AllNearestKPolicy & include_self_off() noexcept;
+protected:
+    int _n_threads;
+    bool _include_self;
+};
+
+/**
+``n_rows`` max-heaps of neighbors, each with capacity ``k``, stored in a
+contiguous buffer so that row ``i`` is ``[i*k, (i+1)*k)``. The buffer is
+not owned.
+
+``NgbT`` must have fields ``node_idx`` and ``r_sq``, and be less-than
+comparable by ``r_sq``.
+
+Rows are independent - different rows can be pushed concurrently.
+*/
+template<typename NgbT, typename IndexT>
+class _KNNRows {
+public:
+    using ngb_t = NgbT;
+    using index_t = IndexT;
+    using float_t = decltype(ngb_t::r_sq);
+
+    _KNNRows(ngb_t *buf, index_t n_rows, index_t k);
+
+    /**
+    The k-th smallest squared distance in the row. If the row is not full,
+    return the maximum of ``float_t``.
+    */
+    float_t kth(index_t row) const noexcept;
+    void push(index_t row, index_t node_idx, float_t r_sq) noexcept;
+
+    /**
+    Sort each row by distance (ascending), using ``n_threads`` threads.
+    */
+    void sort_rows(int n_threads);
+protected:
+    ngb_t *_buf;
+    index_t _n_rows, _k;
+    vector<index_t> _used;
+};
+
+inline _AllNearestKPolicy::_AllNearestKPolicy() noexcept {
+    set_n_threads(DFLT_N_THREADS);
+    _include_self = DFLT_INCLUDE_SELF;
+}
+
+inline ostream & _AllNearestKPolicy::info(ostream &os, int fmt_cntl,
+    int level) const
+{
+    PStream ps{os};
+    if( fmt_cntl < 1 ) {
+        ps << HIPPCNTL_CLASS_INFO_INLINE(_AllNearestKPolicy),
+        "{n threads=", _n_threads, ", include self=", _include_self, "}";
+        return os;
+    }
+    auto ind = HIPPCNTL_CLASS_INFO_INDENT_STR(level);
+    ps << HIPPCNTL_CLASS_INFO(_AllNearestKPolicy),
+    ind, "No. threads = ", _n_threads,
+         ", include self = ", _include_self, '\n';
+    return os;
+}
+
+inline int _AllNearestKPolicy::n_threads() const noexcept {
+    return _n_threads;
+}
+
+inline _AllNearestKPolicy &
+_AllNearestKPolicy::set_n_threads(int n_threads) noexcept {
+    _n_threads = n_threads; return *this;
+}
+
+inline bool _AllNearestKPolicy::include_self() const noexcept {
+    return _include_self;
+}
+
+inline _AllNearestKPolicy & _AllNearestKPolicy::include_self_on() noexcept {
+    _include_self = true; return *this;
+}
+
+inline _AllNearestKPolicy & _AllNearestKPolicy::include_self_off() noexcept {
+    _include_self = false; return *this;
+}
+
+#define _HIPP_TEMPHD template<typename NgbT, typename IndexT>
+#define _HIPP_TEMPARG <NgbT, IndexT>
+#define _HIPP_TEMPCLS _KNNRows _HIPP_TEMPARG
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPNORET
+_KNNRows(ngb_t *buf, index_t n_rows, index_t k)
+: _buf(buf), _n_rows(n_rows), _k(k), _used(n_rows, 0)
+{}
+
+_HIPP_TEMPRET
+kth(index_t row) const noexcept -> float_t {
+    if( _used[row] < _k ) return std::numeric_limits<float_t>::max();
+    return _buf[size_t(row)*_k].r_sq;
+}
+
+_HIPP_TEMPRET
+push(index_t row, index_t node_idx, float_t r_sq) noexcept -> void {
+    ngb_t *b = _buf + size_t(row)*_k;
+    index_t &used = _used[row];
+    if( used < _k ) {
+        b[used++] = ngb_t{node_idx, r_sq};
+        if( used == _k ) std::make_heap(b, b+_k);
+    } else if( r_sq < b->r_sq ) {
+        std::pop_heap(b, b+_k);
+        b[_k-1] = ngb_t{node_idx, r_sq};
+        std::push_heap(b, b+_k);
+    }
+}
+
+_HIPP_TEMPRET
+sort_rows(int n_threads) -> void {
+    _parallel_for(n_threads, _n_rows, [&](int, index_t b, index_t e) {
+        for(index_t i=b; i<e; ++i) {
+            ngb_t *p = _buf + size_t(i)*_k;
+            std::sort(p, p+_used[i]);
+        }
+    });
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
+
+} // namespace HIPP::NUMERICAL::_KDSEARCH
+
+#endif	//_HIPPNUMERICAL_KDSEARCH_DUAL_TREE_H_
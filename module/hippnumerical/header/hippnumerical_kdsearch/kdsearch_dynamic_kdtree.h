@@ -0,0 +1,314 @@
+/**
+create: Yangyao CHEN, 2026/10/17
+    [write   ] DynamicKDTree - K-dimensional tree with insertion and removal.
+*/
+
+#ifndef _HIPPNUMERICAL_KDSEARCH_DYNAMIC_KDTREE_H_
+#define _HIPPNUMERICAL_KDSEARCH_DYNAMIC_KDTREE_H_
+
+#include "kdsearch_dynamic_kdtree_raw_impl.h"
+
+namespace HIPP::NUMERICAL {
+
+/**
+K-dimensional tree that supports insertion and removal of points.
+
+The points are kept in a series of static trees (blocks) of geometrically
+increasing sizes, i.e., the logarithmic method. An insertion costs amortized
+``O(log^2 N)``, a removal marks the point as dead and rebuilds its block once
+half of the block is dead. A query is made on all the ``O(log N)`` blocks.
+*/
+template<typename KDPointT = KDPoint<>, typename IndexT = int>
+class DynamicKDTree {
+public:
+    /**
+    Implementation detail.
+    */
+    using impl_t = _KDSEARCH::_DynamicKDTree<KDPointT, IndexT>;
+
+    static constexpr int DIM         = impl_t::DIM;
+    static constexpr size_t PADDING  = impl_t::PADDING;
+    static constexpr IndexT idxNULL  = impl_t::idxNULL;
+    static constexpr IndexT DFLT_BUFFER_SIZE = impl_t::DFLT_BUFFER_SIZE;
+
+    using point_t    = typename impl_t::point_t;
+    using kd_point_t = typename impl_t::kd_point_t;
+
+    using float_t    = typename impl_t::float_t;
+    using index_t    = typename impl_t::index_t;
+    using pos_t      = typename impl_t::pos_t;
+    using rect_t     = typename impl_t::rect_t;
+    using sphere_t   = typename impl_t::sphere_t;
+    using periodic_box_t = typename impl_t::periodic_box_t;
+
+    /**
+    ``construct_policy_t`` is the one of ``KDTree``, used to construct each
+    block. ``query_policy_t`` holds the buffers for the queries. Reusing it
+    across queries avoids repeated allocation.
+    */
+    using construct_policy_t = typename impl_t::construct_policy_t;
+    using query_policy_t     = typename impl_t::query_policy_t;
+
+    /**
+    A query result, i.e., the id of a point and its squared distance to the
+    query position.
+    */
+    using ngb_t      = typename impl_t::ngb_t;
+
+    /**
+    Constructors.
+
+    (1): Default construction - an empty tree.
+
+    (2): An empty tree, whose blocks are constructed by ``policy``. The
+    inserted points are first kept in a buffer of ``buffer_size`` points, and
+    are linearly scanned by the queries. A full buffer is merged into the
+    blocks.
+
+    ``DynamicKDTree`` is copyable and movable. The copied-to object shares
+    the same internal state with the source object.
+    */
+    DynamicKDTree();
+    explicit DynamicKDTree(const construct_policy_t &policy,
+        index_t buffer_size = DFLT_BUFFER_SIZE);
+
+    DynamicKDTree(const DynamicKDTree &o);
+    DynamicKDTree(DynamicKDTree &&o);
+    DynamicKDTree & operator=(const DynamicKDTree &o) noexcept;
+    DynamicKDTree & operator=(DynamicKDTree &&o) noexcept;
+    ~DynamicKDTree() noexcept;
+
+    ostream & info(ostream &os = cout, int fmt_cntl = 0, int level = 0) const;
+    friend ostream & operator<<(ostream &os, const DynamicKDTree &dkdt) {
+        return dkdt.info(os);
+    }
+
+    /**
+    Modifiers.
+
+    insert(): add a point and return its id. The id is valid until the point
+    is removed, and may be reused afterwards.
+
+    remove(): remove the point of ``id``. Throw ``ErrLogic`` if ``id`` is not
+    in the tree.
+
+    compact(): rebuild all points into a single block, e.g., after many
+    removals or before a query-intensive stage.
+
+    clear(): remove all points.
+    */
+    index_t insert(const kd_point_t &p);
+    void remove(index_t id);
+    void compact();
+    void clear();
+
+    /**
+    Getters.
+    contains(): whether or not ``id`` is the id of a point in the tree.
+    point(): the point of ``id``, as it is inserted.
+    size(): number of points.
+    n_dead(): number of removed points not yet dropped from the blocks.
+    n_blocks(): number of non-empty blocks.
+    */
+    std::shared_ptr<impl_t> impl() const noexcept;
+    bool contains(index_t id) const noexcept;
+    const kd_point_t & point(index_t id) const;
+    index_t size() const noexcept;
+    index_t n_dead() const noexcept;
+    index_t n_blocks() const noexcept;
+    const construct_policy_t & construct_policy() const noexcept;
+    index_t buffer_size() const noexcept;
+
+    /**
+    Queries. The same as those of ``KDTree``, except that the results are
+    point ids.
+
+    nearest(): if the tree is empty, returns {idxNULL, max_of_float_t}.
+    nearest_k(): find at most ``ngbs.size()`` nearest neighbors, sorted by
+    distance. Returns the number found.
+    */
+    template<typename Policy = query_policy_t>
+    ngb_t nearest(const point_t &p, Policy &&policy = Policy()) const;
+    template<typename Policy = query_policy_t>
+    index_t nearest_k(const point_t &p, ContiguousBuffer<ngb_t> ngbs,
+        Policy &&policy = Policy()) const;
+
+    /**
+    ``op(id)`` is called on each point in the region.
+    */
+    template<typename Op, typename Policy = query_policy_t>
+    void visit_rect(const rect_t &rect, Op op,
+        Policy &&policy = Policy()) const;
+    template<typename Policy = query_policy_t>
+    index_t count_rect(const rect_t &rect,
+        Policy &&policy = Policy()) const;
+
+    template<typename Op, typename Policy = query_policy_t>
+    void visit_sphere(const sphere_t &sphere, Op op,
+        Policy &&policy = Policy()) const;
+    template<typename Policy = query_policy_t>
+    index_t count_sphere(const sphere_t &sphere,
+        Policy &&policy = Policy()) const;
+protected:
+    std::shared_ptr<impl_t> _impl;
+};
+
+#define _HIPP_TEMPHD template<typename KDPointT, typename IndexT>
+#define _HIPP_TEMPARG <KDPointT, IndexT>
+#define _HIPP_TEMPCLS DynamicKDTree _HIPP_TEMPARG
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPNORET
+DynamicKDTree() : _impl( std::make_shared<impl_t>() ) {}
+
+_HIPP_TEMPNORET
+DynamicKDTree(const construct_policy_t &policy, index_t buffer_size)
+: _impl( std::make_shared<impl_t>(policy, buffer_size) ) {}
+
+_HIPP_TEMPNORET
+DynamicKDTree(const DynamicKDTree &o) = default;
+
+_HIPP_TEMPNORET
+DynamicKDTree(DynamicKDTree &&o) = default;
+
+_HIPP_TEMPRET
+operator=(const DynamicKDTree &o) noexcept -> DynamicKDTree & = default;
+
+_HIPP_TEMPRET
+operator=(DynamicKDTree &&o) noexcept -> DynamicKDTree & = default;
+
+_HIPP_TEMPNORET
+~DynamicKDTree() noexcept = default;
+
+_HIPP_TEMPRET
+info(ostream &os, int fmt_cntl, int level) const -> ostream & {
+    PStream ps(os);
+    if( fmt_cntl < 1 ) {
+        ps << HIPPCNTL_CLASS_INFO_INLINE(DynamicKDTree),
+        "{impl=", *_impl, "}";
+        return os;
+    }
+    auto ind = HIPPCNTL_CLASS_INFO_INDENT_STR(level);
+    ps << HIPPCNTL_CLASS_INFO(DynamicKDTree),
+    ind, ps.info_of(*_impl, fmt_cntl, level+1);
+    return os;
+}
+
+_HIPP_TEMPRET
+insert(const kd_point_t &p) -> index_t {
+    return _impl->insert(p);
+}
+
+_HIPP_TEMPRET
+remove(index_t id) -> void {
+    _impl->remove(id);
+}
+
+_HIPP_TEMPRET
+compact() -> void {
+    _impl->compact();
+}
+
+_HIPP_TEMPRET
+clear() -> void {
+    _impl->clear();
+}
+
+_HIPP_TEMPRET
+impl() const noexcept -> std::shared_ptr<impl_t> {
+    return _impl;
+}
+
+_HIPP_TEMPRET
+contains(index_t id) const noexcept -> bool {
+    return _impl->contains(id);
+}
+
+_HIPP_TEMPRET
+point(index_t id) const -> const kd_point_t & {
+    return _impl->point(id);
+}
+
+_HIPP_TEMPRET
+size() const noexcept -> index_t {
+    return _impl->size();
+}
+
+_HIPP_TEMPRET
+n_dead() const noexcept -> index_t {
+    return _impl->n_dead();
+}
+
+_HIPP_TEMPRET
+n_blocks() const noexcept -> index_t {
+    return _impl->n_blocks();
+}
+
+_HIPP_TEMPRET
+construct_policy() const noexcept -> const construct_policy_t & {
+    return _impl->construct_policy();
+}
+
+_HIPP_TEMPRET
+buffer_size() const noexcept -> index_t {
+    return _impl->buffer_size();
+}
+
+_HIPP_TEMPHD
+template<typename Policy>
+auto _HIPP_TEMPCLS::nearest(const point_t &p, Policy &&policy) const
+-> ngb_t
+{
+    return _impl->nearest(p, policy);
+}
+
+_HIPP_TEMPHD
+template<typename Policy>
+auto _HIPP_TEMPCLS::nearest_k(const point_t &p, ContiguousBuffer<ngb_t> ngbs,
+    Policy &&policy) const -> index_t
+{
+    return _impl->nearest_k(p, ngbs, policy);
+}
+
+_HIPP_TEMPHD
+template<typename Op, typename Policy>
+void _HIPP_TEMPCLS::visit_rect(const rect_t &rect, Op op,
+    Policy &&policy) const
+{
+    _impl->visit_rect(rect, op, policy);
+}
+
+_HIPP_TEMPHD
+template<typename Policy>
+auto _HIPP_TEMPCLS::count_rect(const rect_t &rect,
+    Policy &&policy) const -> index_t
+{
+    return _impl->count_rect(rect, policy);
+}
+
+_HIPP_TEMPHD
+template<typename Op, typename Policy>
+void _HIPP_TEMPCLS::visit_sphere(const sphere_t &sphere, Op op,
+    Policy &&policy) const
+{
+    _impl->visit_sphere(sphere, op, policy);
+}
+
+_HIPP_TEMPHD
+template<typename Policy>
+auto _HIPP_TEMPCLS::count_sphere(const sphere_t &sphere,
+    Policy &&policy) const -> index_t
+{
+    return _impl->count_sphere(sphere, policy);
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
+
+} // namespace HIPP::NUMERICAL
+
+#endif	//_HIPPNUMERICAL_KDSEARCH_DYNAMIC_KDTREE_H_
@@ -0,0 +1,193 @@
+/**
+create: Yangyao CHEN, 2026/10/17
+    [write   ] _DynamicKDTree - Implementation class of DynamicKDTree.
+*/
+
+#ifndef _HIPPNUMERICAL_KDSEARCH_DYNAMIC_KDTREE_RAW_H_
+#define _HIPPNUMERICAL_KDSEARCH_DYNAMIC_KDTREE_RAW_H_
+
+#include "kdsearch_kdtree_raw_impl.h"
+
+namespace HIPP::NUMERICAL::_KDSEARCH {
+
+/**
+K-dimensional tree that supports insertion and removal, by the logarithmic
+method (Bentley & Saxe 1980).
+
+The points are held by a small insertion buffer and a series of static
+blocks, each a ``_KDTree``. Block ``k`` holds at most ``B * 2^k`` points,
+where ``B`` is the buffer size. A full buffer is merged with the non-empty
+blocks ``0, 1, ...`` into the first empty block, like the carry of a binary
+counter. A removed point is marked as dead in its block, and a block is
+rebuilt by its live points once more than half of them are dead.
+
+Each inserted point gets an id that is stable until it is removed. Removed
+ids may be reused by later insertions.
+*/
+template<typename KDPointT = KDPoint<>, typename IndexT = int>
+class _DynamicKDTree {
+public:
+    using kd_point_t = KDPointT;
+    using float_t    = typename kd_point_t::float_t;
+    using index_t    = IndexT;
+
+    static constexpr int DIM         = kd_point_t::DIM;
+    static constexpr size_t PADDING  = kd_point_t::PADDING;
+
+    /**
+    The blocks store the id of each point as its padding.
+    */
+    using block_point_t = KDPoint<float_t, DIM, sizeof(index_t)>;
+    using kdtree_t      = _KDTree<block_point_t, index_t>;
+
+    using point_t    = typename kdtree_t::point_t;
+    using pos_t      = typename kdtree_t::pos_t;
+    using rect_t     = typename kdtree_t::rect_t;
+    using sphere_t   = typename kdtree_t::sphere_t;
+    using periodic_box_t = typename kdtree_t::periodic_box_t;
+
+    using construct_policy_t = typename kdtree_t::construct_policy_t;
+    class query_policy_t;
+    struct ngb_t;
+
+    static constexpr index_t idxNULL = -1;
+    static constexpr index_t DFLT_BUFFER_SIZE = 64;
+
+    /**
+    (1): an empty tree with the default policy.
+    (2): an empty tree, whose blocks are constructed by ``policy`` and whose
+    insertion buffer holds ``buffer_size`` points.
+    */
+    _DynamicKDTree() noexcept;
+    explicit _DynamicKDTree(const construct_policy_t &policy,
+        index_t buffer_size = DFLT_BUFFER_SIZE);
+
+    ostream & info(ostream &os = cout, int fmt_cntl = 0, int level = 0) const;
+    friend ostream & operator<<(ostream &os, const _DynamicKDTree &dkdt) {
+        return dkdt.info(os);
+    }
+
+    /**
+    insert(): add a point and return its id. Amortized ``O(log^2 N)``.
+    remove(): remove the point of ``id``.
+    compact(): merge all points into a single block, dropping the dead ones.
+    clear(): remove all points. The policy is kept.
+    */
+    index_t insert(const kd_point_t &p);
+    void remove(index_t id);
+    void compact();
+    void clear();
+
+    /**
+    contains(): whether or not ``id`` refers to a point in the tree.
+    point(): the point of ``id``.
+    size(): number of points in the tree.
+    n_dead(): number of removed points still held by the blocks.
+    n_blocks(): number of non-empty blocks.
+    */
+    bool contains(index_t id) const noexcept;
+    const kd_point_t & point(index_t id) const;
+    index_t size() const noexcept;
+    index_t n_dead() const noexcept;
+    index_t n_blocks() const noexcept;
+    const construct_policy_t & construct_policy() const noexcept;
+    index_t buffer_size() const noexcept;
+
+    /**
+    Queries are made on all blocks and the buffer. The results are the ids
+    of the points.
+
+    nearest(): if the tree is empty, returns {idxNULL, max_of_float_t}.
+    nearest_k(): the neighbors are sorted by distance.
+    */
+    template<typename Policy = query_policy_t>
+    ngb_t nearest(const point_t &p, Policy &&policy = Policy()) const;
+    template<typename Policy = query_policy_t>
+    index_t nearest_k(const point_t &p, ContiguousBuffer<ngb_t> ngbs,
+        Policy &&policy = Policy()) const;
+
+    /**
+    ``op(id)`` is called on each point in the region.
+    */
+    template<typename Op, typename Policy = query_policy_t>
+    void visit_rect(const rect_t &rect, Op op,
+        Policy &&policy = Policy()) const;
+    template<typename Policy = query_policy_t>
+    index_t count_rect(const rect_t &rect,
+        Policy &&policy = Policy()) const;
+
+    template<typename Op, typename Policy = query_policy_t>
+    void visit_sphere(const sphere_t &sphere, Op op,
+        Policy &&policy = Policy()) const;
+    template<typename Policy = query_policy_t>
+    index_t count_sphere(const sphere_t &sphere,
+        Policy &&policy = Policy()) const;
+private:
+    struct _block_t {
+        kdtree_t kdt;
+        vector<char> dead;
+        index_t n_dead;
+    };
+
+    /**
+    Location of a point: ``level = lvBUFFER`` for the buffer, ``lvNONE`` for
+    a removed (or never used) id, otherwise the block level. ``idx`` is the
+    index into the buffer or the node index in the block.
+    */
+    struct _loc_t {
+        int level;
+        index_t idx;
+    };
+    static constexpr int lvBUFFER = -1, lvNONE = -2;
+
+    construct_policy_t _policy;
+    index_t _buffer_size;
+
+    vector<kd_point_t> _pts;
+    vector<_loc_t> _locs;
+    vector<index_t> _free_ids;
+
+    vector<index_t> _buffer;
+    vector<_block_t> _blocks;
+    index_t _n_pts, _n_dead;
+
+    void _carry();
+    void _collect(int level, vector<index_t> &ids) const;
+    void _build(int level, const vector<index_t> &ids);
+    float_t _r_sq(const pos_t &p, const pos_t &q) const noexcept;
+    void _check_id(index_t id) const;
+};
+
+/**
+Query policy of the dynamic tree, i.e., the buffers for the queries on the
+blocks, and the node filter that excludes the dead points.
+*/
+template<typename KDPointT, typename IndexT>
+class _DynamicKDTree<KDPointT, IndexT>::query_policy_t
+: public kdtree_t::nearest_k_query_policy_t
+{
+public:
+    using kdtree_ngb_t = typename kdtree_t::ngb_t;
+
+    query_policy_t() noexcept;
+    bool accept_node(index_t node_idx) const noexcept;
+protected:
+    friend class _DynamicKDTree;
+
+    const vector<char> *_dead;
+    vector<kdtree_ngb_t> _ngbs;
+};
+
+template<typename KDPointT, typename IndexT>
+struct _DynamicKDTree<KDPointT, IndexT>::ngb_t {
+    index_t id;
+    float_t r_sq;
+
+    bool operator<(const ngb_t &rhs) const noexcept {
+        return r_sq < rhs.r_sq;
+    }
+};
+
+} // namespace HIPP::NUMERICAL::_KDSEARCH
+
+#endif	//_HIPPNUMERICAL_KDSEARCH_DYNAMIC_KDTREE_RAW_H_
@@ -0,0 +1,392 @@
+/**
+create: Yangyao CHEN, 2026/10/17
+Implementation of kdsearch_dynamic_kdtree_raw.h
+*/
+
+#ifndef _HIPPNUMERICAL_KDSEARCH_DYNAMIC_KDTREE_RAW_IMPL_H_
+#define _HIPPNUMERICAL_KDSEARCH_DYNAMIC_KDTREE_RAW_IMPL_H_
+
+#include "kdsearch_dynamic_kdtree_raw.h"
+
+namespace HIPP::NUMERICAL::_KDSEARCH {
+
+#define _HIPP_TEMPHD template<typename KDPointT, typename IndexT>
+#define _HIPP_TEMPARG <KDPointT, IndexT>
+#define _HIPP_TEMPCLS _DynamicKDTree _HIPP_TEMPARG
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPNORET
+_DynamicKDTree() noexcept
+: _buffer_size(DFLT_BUFFER_SIZE), _n_pts(0), _n_dead(0)
+{}
+
+_HIPP_TEMPNORET
+_DynamicKDTree(const construct_policy_t &policy, index_t buffer_size)
+: _policy(policy), _buffer_size(buffer_size), _n_pts(0), _n_dead(0)
+{
+    if( buffer_size <= 0 )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB,
+            "  ... invalid buffer size ", buffer_size, '\n');
+}
+
+_HIPP_TEMPRET
+info(ostream &os, int fmt_cntl, int level) const -> ostream & {
+    PStream ps(os);
+    if( fmt_cntl < 1 ) {
+        ps << HIPPCNTL_CLASS_INFO_INLINE(_DynamicKDTree), "{",
+        "size=", _n_pts, ", no. dead=", _n_dead,
+        ", no. blocks=", n_blocks(), "}";
+        return os;
+    }
+    auto ind = HIPPCNTL_CLASS_INFO_INDENT_STR(level);
+    ps << HIPPCNTL_CLASS_INFO(_DynamicKDTree),
+    ind, "Size = ", _n_pts, ", no. dead = ", _n_dead,
+        ", buffered = ", _buffer.size(), '\n',
+    ind, "Block sizes = {";
+    for(const auto &b: _blocks) ps << b.kdt.n_points(), ",";
+    ps << "}\n";
+    return os;
+}
+
+_HIPP_TEMPRET
+insert(const kd_point_t &p) -> index_t {
+    index_t id;
+    if( _free_ids.empty() ) {
+        id = static_cast<index_t>(_pts.size());
+        _pts.push_back(p);
+        _locs.push_back({lvNONE, idxNULL});
+    } else {
+        id = _free_ids.back();
+        _free_ids.pop_back();
+        _pts[id] = p;
+    }
+    _locs[id] = {lvBUFFER, static_cast<index_t>(_buffer.size())};
+    _buffer.push_back(id);
+    ++_n_pts;
+
+    if( static_cast<index_t>(_buffer.size()) >= _buffer_size ) _carry();
+    return id;
+}
+
+_HIPP_TEMPRET
+remove(index_t id) -> void {
+    _check_id(id);
+    auto &loc = _locs[id];
+    if( loc.level == lvBUFFER ) {
+        const index_t last = _buffer.back();
+        _buffer[loc.idx] = last;
+        _locs[last].idx = loc.idx;
+        _buffer.pop_back();
+    } else {
+        auto &b = _blocks[loc.level];
+        b.dead[loc.idx] = 1;
+        ++b.n_dead; ++_n_dead;
+        const index_t n = b.kdt.n_points();
+        if( b.n_dead * 2 > n ) {
+            vector<index_t> ids;
+            _collect(loc.level, ids);
+            _build(loc.level, ids);
+        }
+    }
+    loc = {lvNONE, idxNULL};
+    _free_ids.push_back(id);
+    --_n_pts;
+}
+
+_HIPP_TEMPRET
+compact() -> void {
+    vector<index_t> ids(_buffer);
+    for(size_t k=0; k<_blocks.size(); ++k)
+        _collect(static_cast<int>(k), ids);
+    _buffer.clear();
+    _blocks.clear();
+    _n_dead = 0;
+    if( ids.empty() ) return;
+
+    int level = 0;
+    while( (_buffer_size << level) < static_cast<index_t>(ids.size()) )
+        ++level;
+    _build(level, ids);
+}
+
+_HIPP_TEMPRET
+clear() -> void {
+    _pts.clear();
+    _locs.clear();
+    _free_ids.clear();
+    _buffer.clear();
+    _blocks.clear();
+    _n_pts = _n_dead = 0;
+}
+
+_HIPP_TEMPRET
+contains(index_t id) const noexcept -> bool {
+    return id >= 0 && static_cast<size_t>(id) < _locs.size()
+        && _locs[id].level != lvNONE;
+}
+
+_HIPP_TEMPRET
+point(index_t id) const -> const kd_point_t & {
+    _check_id(id);
+    return _pts[id];
+}
+
+_HIPP_TEMPRET
+size() const noexcept -> index_t {
+    return _n_pts;
+}
+
+_HIPP_TEMPRET
+n_dead() const noexcept -> index_t {
+    return _n_dead;
+}
+
+_HIPP_TEMPRET
+n_blocks() const noexcept -> index_t {
+    index_t n = 0;
+    for(const auto &b: _blocks)
+        if( b.kdt.n_points() > 0 ) ++n;
+    return n;
+}
+
+_HIPP_TEMPRET
+construct_policy() const noexcept -> const construct_policy_t & {
+    return _policy;
+}
+
+_HIPP_TEMPRET
+buffer_size() const noexcept -> index_t {
+    return _buffer_size;
+}
+
+_HIPP_TEMPHD
+template<typename Policy>
+auto _HIPP_TEMPCLS::nearest(const point_t &p, Policy &&policy) const
+-> ngb_t
+{
+    query_policy_t &pl = policy;
+    ngb_t ngb {idxNULL, std::numeric_limits<float_t>::max()};
+    for(const auto &b: _blocks) {
+        if( b.kdt.n_points() == 0 ) continue;
+        pl._dead = &b.dead;
+        const auto n = b.kdt.nearest(p, pl);
+        if( n.node_idx != idxNULL && n.r_sq < ngb.r_sq )
+            ngb = {b.kdt.template point_pad<index_t>(n.node_idx), n.r_sq};
+    }
+    pl._dead = nullptr;
+    for(const index_t id: _buffer) {
+        const float_t r_sq = _r_sq(_pts[id].pos(), p.pos());
+        if( r_sq < ngb.r_sq ) ngb = {id, r_sq};
+    }
+    return ngb;
+}
+
+_HIPP_TEMPHD
+template<typename Policy>
+auto _HIPP_TEMPCLS::nearest_k(const point_t &p, ContiguousBuffer<ngb_t> ngbs,
+    Policy &&policy) const -> index_t
+{
+    query_policy_t &pl = policy;
+    auto [heap, k] = ngbs;
+    if( k == 0 ) return 0;
+
+    // Max-heap of the k nearest ones found so far.
+    size_t used = 0;
+    auto push = [&, heap=heap, k=k](index_t id, float_t r_sq) {
+        if( used < k ) {
+            heap[used++] = {id, r_sq};
+            std::push_heap(heap, heap+used);
+        } else if( r_sq < heap->r_sq ) {
+            std::pop_heap(heap, heap+k);
+            heap[k-1] = {id, r_sq};
+            std::push_heap(heap, heap+k);
+        }
+    };
+
+    for(const auto &b: _blocks) {
+        const size_t n_pts = b.kdt.n_points();
+        if( n_pts == 0 ) continue;
+        pl._dead = &b.dead;
+        pl._ngbs.resize(std::min(k, n_pts));
+        const index_t n = b.kdt.nearest_k(p,
+            ContiguousBuffer<typename kdtree_t::ngb_t>(pl._ngbs), pl);
+        for(index_t i=0; i<n; ++i) {
+            const auto &ngb = pl._ngbs[i];
+            push(b.kdt.template point_pad<index_t>(ngb.node_idx), ngb.r_sq);
+        }
+    }
+    pl._dead = nullptr;
+    for(const index_t id: _buffer)
+        push(id, _r_sq(_pts[id].pos(), p.pos()));
+
+    std::sort_heap(heap, heap+used);
+    return static_cast<index_t>(used);
+}
+
+_HIPP_TEMPHD
+template<typename Op, typename Policy>
+void _HIPP_TEMPCLS::visit_rect(const rect_t &rect, Op op,
+    Policy &&policy) const
+{
+    for(const auto &b: _blocks) {
+        b.kdt.visit_rect(rect, [&](index_t idx) {
+            if( !b.dead[idx] ) op(b.kdt.template point_pad<index_t>(idx));
+        }, policy);
+    }
+    const auto &box = _policy.periodic_box();
+    for(const index_t id: _buffer) {
+        const point_t &q = _pts[id];
+        if( !box.is_periodic() ) {
+            if( rect.contains(q) ) op(id);
+            continue;
+        }
+        bool found = false;
+        box.visit_rect_images(rect, [&](const rect_t &img) {
+            if( !found && img.contains(q) ) found = true;
+        });
+        if( found ) op(id);
+    }
+}
+
+_HIPP_TEMPHD
+template<typename Policy>
+auto _HIPP_TEMPCLS::count_rect(const rect_t &rect,
+    Policy &&policy) const -> index_t
+{
+    index_t cnt = 0;
+    visit_rect(rect, [&cnt](index_t id) { ++cnt; }, policy);
+    return cnt;
+}
+
+_HIPP_TEMPHD
+template<typename Op, typename Policy>
+void _HIPP_TEMPCLS::visit_sphere(const sphere_t &sphere, Op op,
+    Policy &&policy) const
+{
+    for(const auto &b: _blocks) {
+        b.kdt.visit_sphere(sphere, [&](index_t idx) {
+            if( !b.dead[idx] ) op(b.kdt.template point_pad<index_t>(idx));
+        }, policy);
+    }
+    const auto &box = _policy.periodic_box();
+    if( box.is_periodic() ) box.check_radius(sphere.r());
+    const float_t r_sq = sphere.r() * sphere.r();
+    const pos_t &c = sphere.center().pos();
+    for(const index_t id: _buffer)
+        if( _r_sq(_pts[id].pos(), c) < r_sq ) op(id);
+}
+
+_HIPP_TEMPHD
+template<typename Policy>
+auto _HIPP_TEMPCLS::count_sphere(const sphere_t &sphere,
+    Policy &&policy) const -> index_t
+{
+    index_t cnt = 0;
+    visit_sphere(sphere, [&cnt](index_t id) { ++cnt; }, policy);
+    return cnt;
+}
+
+/**
+Merge the buffer and the non-empty blocks from level 0 up into the first
+empty level. The merged points always fit, since level ``k`` holds at most
+``B * 2^k`` points and ``B + B + 2B + ... + B * 2^(k-1) = B * 2^k``.
+*/
+_HIPP_TEMPRET
+_carry() -> void {
+    vector<index_t> ids;
+    ids.swap(_buffer);
+    int level = 0;
+    const int n_levels = static_cast<int>(_blocks.size());
+    for(; level < n_levels; ++level) {
+        auto &b = _blocks[level];
+        if( b.kdt.n_points() == 0 ) break;
+        _collect(level, ids);
+        _build(level, {});
+    }
+    _build(level, ids);
+}
+
+/**
+Append the ids of the live points in block ``level`` to ``ids``.
+*/
+_HIPP_TEMPRET
+_collect(int level, vector<index_t> &ids) const -> void {
+    const auto &b = _blocks[level];
+    const index_t n = b.kdt.n_points();
+    for(index_t i=0; i<n; ++i)
+        if( !b.dead[i] ) ids.push_back(b.kdt.template point_pad<index_t>(i));
+}
+
+/**
+Replace block ``level`` by a block of the points ``ids``. The dead points
+in the replaced block are dropped.
+*/
+_HIPP_TEMPRET
+_build(int level, const vector<index_t> &ids) -> void {
+    if( static_cast<size_t>(level) >= _blocks.size() )
+        _blocks.resize(level+1, _block_t{kdtree_t(), {}, 0});
+    auto &b = _blocks[level];
+    _n_dead -= b.n_dead;
+
+    const size_t n = ids.size();
+    vector<block_point_t> pts(n);
+    for(size_t i=0; i<n; ++i)
+        pts[i] = block_point_t(_pts[ids[i]].pos(), ids[i]);
+    if( n > 0 )
+        b.kdt.construct(pts, _policy);
+    else
+        b.kdt.clear();
+    b.dead.assign(n, 0);
+    b.n_dead = 0;
+
+    for(size_t i=0; i<n; ++i)
+        _locs[b.kdt.template point_pad<index_t>(i)] =
+            {level, static_cast<index_t>(i)};
+}
+
+_HIPP_TEMPRET
+_r_sq(const pos_t &p, const pos_t &q) const noexcept -> float_t {
+    const auto &box = _policy.periodic_box();
+    if( box.is_periodic() ) return box.r_sq(p, q);
+    return float_t( (p - q).squared_norm() );
+}
+
+_HIPP_TEMPRET
+_check_id(index_t id) const -> void {
+    if( !contains(id) )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB,
+            "  ... id ", id, " is not in the tree\n");
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
+
+#define _HIPP_TEMPHD template<typename KDPointT, typename IndexT>
+#define _HIPP_TEMPARG <KDPointT, IndexT>
+#define _HIPP_TEMPCLS _DynamicKDTree _HIPP_TEMPARG::query_policy_t
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPNORET
+query_policy_t() noexcept : _dead(nullptr) {
+    this->sort_by_distance_off();
+}
+
+_HIPP_TEMPRET
+accept_node(index_t node_idx) const noexcept -> bool {
+    return _dead == nullptr || !(*_dead)[node_idx];
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
+
+} // namespace HIPP::NUMERICAL::_KDSEARCH
+
+#endif	//_HIPPNUMERICAL_KDSEARCH_DYNAMIC_KDTREE_RAW_IMPL_H_
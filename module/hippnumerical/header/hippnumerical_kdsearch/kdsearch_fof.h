@@ -0,0 +1,432 @@
+/**
+create: Yangyao CHEN, 2026/10/17
+    [write   ] _FoFPolicy - policy of the friends-of-friends group finding.
+    [write   ] _UnionFind - concurrent disjoint sets.
+    [write   ] _FoFLinker - dual-tree friends-of-friends engine shared by the
+        trees.
+*/
+
+#ifndef _HIPPNUMERICAL_KDSEARCH_FOF_H_
+#define _HIPPNUMERICAL_KDSEARCH_FOF_H_
+
+#include "kdsearch_base.h"
+
+namespace HIPP::NUMERICAL::_KDSEARCH {
+
+/**
+Policy of the friends-of-friends (FoF) group finding.
+
+n_threads: the number of threads. The links are made concurrently into a
+shared union-find structure, so the groups do not depend on the number of
+threads.
+
+min_size: groups with less points are not labeled, i.e., the group id of
+their points is ``-1``. Default 1, i.e., each point is in a group.
+*/
+class _FoFPolicy {
+public:
+    static constexpr int DFLT_N_THREADS = 1;
+    static constexpr std::ptrdiff_t DFLT_MIN_SIZE = 1;
+
+    _FoFPolicy() noexcept;
+
+    ostream & info(ostream &os = cout, int fmt_cntl = 0, int level = 0) const;
+    friend ostream & operator<< (ostream &os,
+        const _FoFPolicy &pl) { return pl.info(os); }
+
+    int n_threads() const noexcept;
+    _FoFPolicy & set_n_threads(int n_threads) noexcept;
+
+    std::ptrdiff_t min_size() const noexcept;
+    _FoFPolicy & set_min_size(std::ptrdiff_t min_size) noexcept;
+protected:
+    int _n_threads;
+    std::ptrdiff_t _min_size;
+};
+
+/**
+Disjoint sets of ``n`` elements indexed ``0, 1, ..., n-1``, safe for
+concurrent ``find()`` and ``unite()`` (Anderson & Woll 1991).
+
+A set is linked under the other one with the smaller root, so that the root
+of a set is always its smallest element. ``find()`` halves the path by
+compare-and-swap. Both calls are lock-free.
+
+labels(): on exit, ``ids[i]`` is the label of the set of element ``i``, and
+the number of sets is returned. Sets are labeled ``0, 1, ...`` in the order
+of their smallest elements. Sets with less than ``min_size`` elements are
+labeled ``idNONE``. Not to be called concurrently with ``unite()``.
+*/
+template<typename IndexT>
+class _UnionFind {
+public:
+    using index_t = IndexT;
+
+    static constexpr index_t idNONE = -1;
+
+    explicit _UnionFind(index_t n = 0);
+
+    index_t size() const noexcept;
+    index_t find(index_t i) noexcept;
+    bool unite(index_t i, index_t j) noexcept;
+    bool same(index_t i, index_t j) noexcept;
+
+    index_t labels(vector<index_t> &ids, index_t min_size = 1,
+        int n_threads = 1);
+protected:
+    vector<std::atomic<index_t> > _parents;
+};
+
+/**
+Dual-tree FoF engine, i.e., the points at distances less than the linking
+length ``b`` are linked into the same set of a ``_UnionFind``. The adaptor
+views a tree as nested entities, as the one of ``_PairCounter``. An
+``Adaptor`` must provide:
+
+- ``entity_t``, ``float_t`` and ``index_t``.
+- ``size(e)``, ``is_leaf(e)``, ``split(e, parts)``, ``bounds(a, b)`` and
+  ``self_bound(a)``, as required by ``_PairCounter``.
+- ``range(e)``: the points of ``e`` are the elements ``[first, last)`` of
+  the union-find.
+- ``key(e)``: for ``size(e) > 1``, an index in ``[0, n_keys())`` unique to
+  ``e``.
+- ``brute_idx(a, b, op)``, ``brute_self_idx(a, op)``: call
+  ``op(i, j, r_sq)`` on each pair of points, as ``brute()`` and
+  ``brute_self()`` of ``_PairCounter`` but with the elements ``i`` and
+  ``j``.
+
+An entity is marked as linked once all its points are known to be in the
+same set. A pair of linked entities already in the same set is skipped.
+Pairs with distances all below ``b`` are linked at once.
+*/
+template<typename Adaptor>
+class _FoFLinker {
+public:
+    using adaptor_t = Adaptor;
+    using entity_t = typename adaptor_t::entity_t;
+    using float_t = typename adaptor_t::float_t;
+    using index_t = typename adaptor_t::index_t;
+    using union_find_t = _UnionFind<index_t>;
+
+    static constexpr int MAX_PARTS = 3;
+    static constexpr index_t BRUTE_SIZE = 16;
+    static constexpr index_t TASKS_PER_THREAD = 16;
+
+    _FoFLinker(const adaptor_t &ad, float_t b, union_find_t &uf,
+        int n_threads);
+
+    /**
+    link_self(): link the pairs of points in ``root``.
+    link_cross(): link the pairs of points, one in ``root_a`` and the other
+    in ``root_b``. Both entities are viewed by the same adaptor.
+    */
+    void link_self(const entity_t &root);
+    void link_cross(const entity_t &root_a, const entity_t &root_b);
+protected:
+    const adaptor_t &_ad;
+    const float_t _b_sq;
+    union_find_t &_uf;
+    int _n_threads;
+    vector<std::atomic<char> > _linked;
+
+    struct task_t {
+        entity_t a, b;
+        bool is_self;
+    };
+
+    void _run(const vector<task_t> &roots);
+
+    /**
+    Process a task by one level, as ``_PairCounter::_step()``. With
+    ``recursive``, the sub tasks are done when ``next()`` returns, so that
+    the entity of a self task may be marked as linked afterwards.
+    */
+    template<typename Next>
+    void _step(const task_t &t, bool recursive, Next &&next);
+    void _recurse(const task_t &t);
+
+    bool _is_small(const entity_t &e) const noexcept;
+    bool _is_linked(const entity_t &e) const noexcept;
+    void _mark_linked(const entity_t &e) noexcept;
+    index_t _first(const entity_t &e) const noexcept;
+
+    /**
+    Link all points of ``e`` into a single set.
+    */
+    void _link_all(const entity_t &e);
+};
+
+inline _FoFPolicy::_FoFPolicy() noexcept {
+    set_n_threads(DFLT_N_THREADS);
+    set_min_size(DFLT_MIN_SIZE);
+}
+
+inline ostream & _FoFPolicy::info(ostream &os, int fmt_cntl,
+    int level) const
+{
+    PStream ps{os};
+    if( fmt_cntl < 1 ) {
+        ps << HIPPCNTL_CLASS_INFO_INLINE(_FoFPolicy),
+        "{n threads=", _n_threads, ", min size=", _min_size, "}";
+        return os;
+    }
+    auto ind = HIPPCNTL_CLASS_INFO_INDENT_STR(level);
+    ps << HIPPCNTL_CLASS_INFO(_FoFPolicy),
+    ind, "No. threads = ", _n_threads, ", min size = ", _min_size, '\n';
+    return os;
+}
+
+inline int _FoFPolicy::n_threads() const noexcept {
+    return _n_threads;
+}
+
+inline _FoFPolicy & _FoFPolicy::set_n_threads(int n_threads) noexcept {
+    _n_threads = n_threads; return *this;
+}
+
+inline std::ptrdiff_t _FoFPolicy::min_size() const noexcept {
+    return _min_size;
+}
+
+inline _FoFPolicy & _FoFPolicy::set_min_size(std::ptrdiff_t min_size)
+noexcept
+{
+    _min_size = min_size; return *this;
+}
+
+#define _HIPP_TEMPHD template<typename IndexT>
+#define _HIPP_TEMPARG <IndexT>
+#define _HIPP_TEMPCLS _UnionFind _HIPP_TEMPARG
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPNORET
+_UnionFind(index_t n) : _parents(n) {
+    for(index_t i=0; i<n; ++i)
+        _parents[i].store(i, std::memory_order_relaxed);
+}
+
+_HIPP_TEMPRET
+size() const noexcept -> index_t {
+    return _parents.size();
+}
+
+_HIPP_TEMPRET
+find(index_t i) noexcept -> index_t {
+    while( true ) {
+        index_t p = _parents[i].load(std::memory_order_relaxed);
+        if( p == i ) return i;
+        const index_t gp = _parents[p].load(std::memory_order_relaxed);
+        if( gp != p )
+            _parents[i].compare_exchange_weak(p, gp,
+                std::memory_order_relaxed);
+        i = gp;
+    }
+}
+
+_HIPP_TEMPRET
+unite(index_t i, index_t j) noexcept -> bool {
+    while( true ) {
+        i = find(i); j = find(j);
+        if( i == j ) return false;
+        if( i < j ) std::swap(i, j);
+        // Link the larger root. Retry if it is no longer a root.
+        index_t expected = i;
+        if( _parents[i].compare_exchange_strong(expected, j,
+            std::memory_order_relaxed) ) return true;
+    }
+}
+
+_HIPP_TEMPRET
+same(index_t i, index_t j) noexcept -> bool {
+    while( true ) {
+        i = find(i); j = find(j);
+        if( i == j ) return true;
+        // i is still a root, so they were not in the same set.
+        if( _parents[i].load(std::memory_order_relaxed) == i ) return false;
+    }
+}
+
+_HIPP_TEMPRET
+labels(vector<index_t> &ids, index_t min_size, int n_threads) -> index_t {
+    const index_t n = size();
+    ids.resize(n);
+    _parallel_for(n_threads, n, [&](int, index_t b, index_t e) {
+        for(index_t i=b; i<e; ++i) ids[i] = find(i);
+    });
+
+    // Roots are the smallest elements, hence labeled in ascending order.
+    vector<index_t> sizes(n, 0);
+    for(index_t i=0; i<n; ++i) ++sizes[ids[i]];
+    index_t n_sets = 0;
+    for(index_t i=0; i<n; ++i) {
+        if( ids[i] != i ) continue;
+        sizes[i] = sizes[i] >= min_size ? n_sets++ : idNONE;
+    }
+    _parallel_for(n_threads, n, [&](int, index_t b, index_t e) {
+        for(index_t i=b; i<e; ++i) ids[i] = sizes[ids[i]];
+    });
+    return n_sets;
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
+
+#define _HIPP_TEMPHD template<typename Adaptor>
+#define _HIPP_TEMPARG <Adaptor>
+#define _HIPP_TEMPCLS _FoFLinker _HIPP_TEMPARG
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPNORET
+_FoFLinker(const adaptor_t &ad, float_t b, union_find_t &uf, int n_threads)
+: _ad(ad), _b_sq(b*b), _uf(uf), _n_threads(n_threads),
+_linked(ad.n_keys())
+{
+    if( n_threads < 1 )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB,
+            "  ... invalid no. of threads ", n_threads, '\n');
+    if( !(b >= 0) )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB,
+            "  ... invalid linking length ", b, '\n');
+    for(auto &f: _linked) f.store(0, std::memory_order_relaxed);
+}
+
+_HIPP_TEMPRET
+link_self(const entity_t &root) -> void {
+    _run({task_t{root, root, true}});
+}
+
+_HIPP_TEMPRET
+link_cross(const entity_t &root_a, const entity_t &root_b) -> void {
+    _run({task_t{root_a, root_b, false}});
+}
+
+_HIPP_TEMPRET
+_run(const vector<task_t> &roots) -> void {
+    // Expand the traversal breadth-first until there are enough tasks.
+    const size_t n_min = _n_threads > 1 ?
+        size_t(TASKS_PER_THREAD) * _n_threads : 1;
+    vector<task_t> cur, next;
+    for(auto &t: roots)
+        if( _ad.size(t.a) > 0 && _ad.size(t.b) > 0 ) cur.push_back(t);
+    while( !cur.empty() && cur.size() < n_min ) {
+        next.clear();
+        for(auto &t: cur)
+            _step(t, false, [&](const task_t &s){ next.push_back(s); });
+        cur.swap(next);
+    }
+
+    // Self tasks first, so that their entities are marked as linked before
+    // the cross tasks are checked.
+    std::stable_partition(cur.begin(), cur.end(),
+        [](const task_t &t) { return t.is_self; });
+    const index_t n_tasks = cur.size();
+    _parallel_tasks(_n_threads, n_tasks, [&](index_t i) {
+        _recurse(cur[i]);
+    });
+}
+
+_HIPP_TEMPHD
+template<typename Next>
+void _HIPP_TEMPCLS::_step(const task_t &t, bool recursive, Next &&next) {
+    const auto &a = t.a, &b = t.b;
+    entity_t parts[MAX_PARTS];
+
+    if( t.is_self ) {
+        if( _ad.size(a) < 2 || _is_linked(a) ) return;
+        if( _ad.self_bound(a) < _b_sq ) {
+            _link_all(a);
+            _mark_linked(a);
+            return;
+        }
+        if( _is_small(a) ) {
+            _ad.brute_self_idx(a, [&](index_t i, index_t j, float_t r_sq) {
+                if( r_sq < _b_sq ) _uf.unite(i, j);
+            });
+        } else {
+            const int n = _ad.split(a, parts);
+            for(int i=0; i<n; ++i) {
+                next(task_t{parts[i], parts[i], true});
+                for(int j=i+1; j<n; ++j)
+                    next(task_t{parts[i], parts[j], false});
+            }
+            if( !recursive ) return;
+        }
+        // Linked if all points are in a single set.
+        const auto [first, last] = _ad.range(a);
+        for(index_t i=first+1; i<last; ++i)
+            if( !_uf.same(first, i) ) return;
+        _mark_linked(a);
+        return;
+    }
+
+    const bool linked_a = _is_linked(a), linked_b = _is_linked(b);
+    if( linked_a && linked_b && _uf.same(_first(a), _first(b)) ) return;
+    const auto [r_sq_min, r_sq_max] = _ad.bounds(a, b);
+    if( r_sq_min >= _b_sq ) return;
+    if( r_sq_max < _b_sq ) {
+        if( !linked_a ) _link_all(a);
+        if( !linked_b ) _link_all(b);
+        _uf.unite(_first(a), _first(b));
+        return;
+    }
+    if( _is_small(a) && _is_small(b) ) {
+        _ad.brute_idx(a, b, [&](index_t i, index_t j, float_t r_sq) {
+            if( r_sq < _b_sq ) _uf.unite(i, j);
+        });
+        return;
+    }
+    const bool split_a = _ad.is_leaf(b)
+        || ( !_ad.is_leaf(a) && _ad.size(a) >= _ad.size(b) );
+    const int n = _ad.split(split_a ? a : b, parts);
+    for(int i=0; i<n; ++i)
+        next(split_a ? task_t{parts[i], b, false}
+            : task_t{a, parts[i], false});
+}
+
+_HIPP_TEMPRET
+_recurse(const task_t &t) -> void {
+    _step(t, true, [&](const task_t &s) { _recurse(s); });
+}
+
+_HIPP_TEMPRET
+_is_small(const entity_t &e) const noexcept -> bool {
+    return _ad.is_leaf(e) || _ad.size(e) <= BRUTE_SIZE;
+}
+
+_HIPP_TEMPRET
+_is_linked(const entity_t &e) const noexcept -> bool {
+    return _ad.size(e) < 2
+        || _linked[_ad.key(e)].load(std::memory_order_relaxed);
+}
+
+_HIPP_TEMPRET
+_mark_linked(const entity_t &e) noexcept -> void {
+    if( _ad.size(e) > 1 )
+        _linked[_ad.key(e)].store(1, std::memory_order_relaxed);
+}
+
+_HIPP_TEMPRET
+_first(const entity_t &e) const noexcept -> index_t {
+    return _ad.range(e).first;
+}
+
+_HIPP_TEMPRET
+_link_all(const entity_t &e) -> void {
+    const auto [first, last] = _ad.range(e);
+    for(index_t i=first+1; i<last; ++i) _uf.unite(first, i);
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
+
+} // namespace HIPP::NUMERICAL::_KDSEARCH
+
+#endif	//_HIPPNUMERICAL_KDSEARCH_FOF_H_
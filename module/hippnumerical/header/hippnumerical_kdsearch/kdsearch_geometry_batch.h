@@ -0,0 +1,475 @@
+/**
+create: Yangyao CHEN, 2026/10/17
+    [write   ] _GeometryBatchPolicy - policy of the batch geometry kernels.
+    [write   ] GeometryBatch - geometry tests and distances over arrays of
+        points.
+*/
+
+#ifndef _HIPPNUMERICAL_KDSEARCH_GEOMETRY_BATCH_H_
+#define _HIPPNUMERICAL_KDSEARCH_GEOMETRY_BATCH_H_
+
+#include "kdsearch_simd.h"
+
+namespace HIPP::NUMERICAL::_KDSEARCH {
+
+/**
+Policy of the batch geometry kernels.
+
+n_threads: the number of threads. The points are split into contiguous
+chunks, one per thread. The results do not depend on the number of threads.
+*/
+class _GeometryBatchPolicy {
+public:
+    static constexpr int DFLT_N_THREADS = 1;
+
+    _GeometryBatchPolicy() noexcept;
+
+    ostream & info(ostream &os = cout, int fmt_cntl = 0, int level = 0) const;
+    friend ostream & operator<< (ostream &os,
+        const _GeometryBatchPolicy &pl) { return pl.info(os); }
+
+    int n_threads() const noexcept;
+    _GeometryBatchPolicy & set_n_threads(int n_threads) noexcept;
+
+    /**
+    Throw ``ErrLogic`` if the values are invalid.
+    */
+    void verify() const;
+protected:
+    int _n_threads;
+};
+
+inline _GeometryBatchPolicy::_GeometryBatchPolicy() noexcept {
+    set_n_threads(DFLT_N_THREADS);
+}
+
+inline ostream & _GeometryBatchPolicy::info(ostream &os, int fmt_cntl,
+    int level) const
+{
+    PStream ps{os};
+    if( fmt_cntl < 1 ) {
+        ps << HIPPCNTL_CLASS_INFO_INLINE(_GeometryBatchPolicy),
+        "{n threads=", _n_threads, "}";
+        return os;
+    }
+    auto ind = HIPPCNTL_CLASS_INFO_INDENT_STR(level);
+    ps << HIPPCNTL_CLASS_INFO(_GeometryBatchPolicy),
+    ind, "No. threads = ", _n_threads, '\n';
+    return os;
+}
+
+inline int _GeometryBatchPolicy::n_threads() const noexcept {
+    return _n_threads;
+}
+
+inline _GeometryBatchPolicy &
+_GeometryBatchPolicy::set_n_threads(int n_threads) noexcept {
+    _n_threads = n_threads; return *this;
+}
+
+inline void _GeometryBatchPolicy::verify() const {
+    if( _n_threads < 1 )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB,
+            "  ... invalid no. of threads ", _n_threads);
+}
+
+} // namespace HIPP::NUMERICAL::_KDSEARCH
+
+namespace HIPP::NUMERICAL {
+
+/**
+Geometry tests and distances over arrays of points, i.e., the batch
+counterparts of ``GEOMETRY::Rect::contains()``, ``GEOMETRY::Sphere::contains()``
+and the point-to-point or point-to-rectangle distances.
+
+``PointT`` is the element type of the point arrays, i.e., ``GEOMETRY::Point``
+or a type derived from it (e.g., ``KDPoint`` with padding). The points are
+passed as a ``points_t`` view, which is either an array of such elements
+(AoS), or ``DIM`` arrays of coordinates (SoA).
+
+The results are exactly those of the per-object methods, e.g.,
+``mask[i] == rect.contains(pts[i])``. For AoS, the tests are made by the
+kernels of the tree scans, vectorized by the SIMD module if available (see
+``_KDSEARCH::_DistKernel``). For SoA, the loops are branch-free over
+contiguous coordinates, which the compiler vectorizes.
+*/
+template<typename PointT = GEOMETRY::Point<float, 3>, typename IndexT = int>
+class GeometryBatch {
+public:
+    static constexpr int DIM = PointT::DIM;
+
+    using point_t  = PointT;
+    using float_t  = typename point_t::float_t;
+    using pos_t    = typename point_t::pos_t;
+    using index_t  = IndexT;
+    using rect_t   = GEOMETRY::Rect<float_t, DIM>;
+    using sphere_t = GEOMETRY::Sphere<float_t, DIM>;
+    using mask_t   = unsigned char;
+    using policy_t = _KDSEARCH::_GeometryBatchPolicy;
+
+    /**
+    A view of an array of points, not owning the memory.
+    (1), (2): AoS - an array of elements.
+    (3): SoA - ``xs[k][i]`` is the coordinate ``k`` of point ``i``, ``n`` is
+    the number of points.
+    */
+    class points_t {
+    public:
+        points_t(ContiguousBuffer<const point_t> aos) noexcept;
+        points_t(const vector<point_t> &aos) noexcept;
+        points_t(const float_t * const (&xs)[DIM], size_t n) noexcept;
+
+        size_t size() const noexcept;
+        bool is_soa() const noexcept;
+        const point_t * aos() const noexcept;
+        const float_t * soa(int k) const noexcept;
+    protected:
+        const point_t *_aos;
+        const float_t *_soa[DIM];
+        size_t _n;
+        bool _is_soa;
+    };
+
+    GeometryBatch(const policy_t &policy = policy_t());
+
+    ostream & info(ostream &os = cout, int fmt_cntl = 0, int level = 0) const;
+    friend ostream & operator<<(ostream &os, const GeometryBatch &gb) {
+        return gb.info(os);
+    }
+
+    const policy_t & policy() const noexcept;
+
+    /**
+    Squared distances. ``r_sq`` is resized to the number of points.
+    (1): to a position ``pos``.
+    (2): to a rectangle ``rect``, which is 0 for points inside.
+    */
+    void dist_sq_to(const points_t &pts, const pos_t &pos,
+        vector<float_t> &r_sq) const;
+    void dist_sq_to(const points_t &pts, const rect_t &rect,
+        vector<float_t> &r_sq) const;
+
+    /**
+    ``region`` is a ``rect_t`` or a ``sphere_t``.
+
+    contains(): ``mask[i]`` is 1 if point ``i`` is in the region, or 0
+    otherwise.
+    select(): the indices of the points in the region, in ascending order.
+    count(): the number of points in the region.
+
+    intersects(): ``mask[i]`` is 1 if the sphere centered at point ``i``
+    with radius ``radii[i]`` overlaps the region, i.e., the distance from
+    the center to the region is less than the radius.
+    */
+    template<typename Region>
+    void contains(const points_t &pts, const Region &region,
+        vector<mask_t> &mask) const;
+
+    template<typename Region>
+    void select(const points_t &pts, const Region &region,
+        vector<index_t> &ids) const;
+
+    template<typename Region>
+    index_t count(const points_t &pts, const Region &region) const;
+
+    template<typename Region>
+    void intersects(const points_t &pts,
+        ContiguousBuffer<const float_t> radii, const Region &region,
+        vector<mask_t> &mask) const;
+protected:
+    policy_t _policy;
+
+    template<typename Op>
+    void _for_chunks(size_t n, Op &&op) const;
+
+    template<typename Region>
+    static void _check_region() noexcept;
+
+    static float_t _r_sq_of(const points_t &pts, size_t i,
+        const pos_t &pos) noexcept;
+    static float_t _r_sq_of(const points_t &pts, size_t i,
+        const rect_t &rect) noexcept;
+
+    /**
+    Test of point ``i`` of SoA points.
+    */
+    static bool _soa_contains(const points_t &pts, size_t i,
+        const rect_t &rect) noexcept;
+    static bool _soa_contains(const points_t &pts, size_t i,
+        const sphere_t &sphere) noexcept;
+
+    /**
+    Call ``op(i)`` on each point ``i`` in ``[b, e)`` in the region, in
+    ascending order. If ``COUNT``, return the number of hits instead.
+    */
+    template<bool COUNT, typename Region, typename Op>
+    static size_t _scan(const points_t &pts, size_t b, size_t e,
+        const Region &region, Op &&op) noexcept;
+};
+
+#define _HIPP_TEMPHD template<typename PointT, typename IndexT>
+#define _HIPP_TEMPARG <PointT, IndexT>
+#define _HIPP_TEMPCLS GeometryBatch _HIPP_TEMPARG
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPNORET
+points_t::points_t(ContiguousBuffer<const point_t> aos) noexcept
+: _aos(aos.get_cbuff()), _soa{}, _n(aos.get_size()), _is_soa(false) {}
+
+_HIPP_TEMPNORET
+points_t::points_t(const vector<point_t> &aos) noexcept
+: _aos(aos.data()), _soa{}, _n(aos.size()), _is_soa(false) {}
+
+_HIPP_TEMPNORET
+points_t::points_t(const float_t * const (&xs)[DIM], size_t n) noexcept
+: _aos(nullptr), _n(n), _is_soa(true)
+{
+    for(int k=0; k<DIM; ++k) _soa[k] = xs[k];
+}
+
+_HIPP_TEMPRET
+points_t::size() const noexcept -> size_t {
+    return _n;
+}
+
+_HIPP_TEMPRET
+points_t::is_soa() const noexcept -> bool {
+    return _is_soa;
+}
+
+_HIPP_TEMPRET
+points_t::aos() const noexcept -> const point_t * {
+    return _aos;
+}
+
+_HIPP_TEMPRET
+points_t::soa(int k) const noexcept -> const float_t * {
+    return _soa[k];
+}
+
+_HIPP_TEMPNORET
+GeometryBatch(const policy_t &policy) : _policy(policy) {
+    _policy.verify();
+}
+
+_HIPP_TEMPRET
+info(ostream &os, int fmt_cntl, int level) const -> ostream & {
+    PStream ps{os};
+    if( fmt_cntl < 1 ) {
+        ps << HIPPCNTL_CLASS_INFO_INLINE(GeometryBatch),
+        "{policy=", _policy, "}";
+        return os;
+    }
+    auto ind = HIPPCNTL_CLASS_INFO_INDENT_STR(level);
+    ps << HIPPCNTL_CLASS_INFO(GeometryBatch),
+    ind, ps.info_of(_policy, fmt_cntl, level+1);
+    return os;
+}
+
+_HIPP_TEMPRET
+policy() const noexcept -> const policy_t & {
+    return _policy;
+}
+
+_HIPP_TEMPRET
+dist_sq_to(const points_t &pts, const pos_t &pos,
+    vector<float_t> &r_sq) const -> void
+{
+    r_sq.resize(pts.size());
+    _for_chunks(pts.size(), [&](int, size_t b, size_t e) {
+        for(size_t i=b; i<e; ++i) r_sq[i] = _r_sq_of(pts, i, pos);
+    });
+}
+
+_HIPP_TEMPRET
+dist_sq_to(const points_t &pts, const rect_t &rect,
+    vector<float_t> &r_sq) const -> void
+{
+    r_sq.resize(pts.size());
+    _for_chunks(pts.size(), [&](int, size_t b, size_t e) {
+        for(size_t i=b; i<e; ++i) r_sq[i] = _r_sq_of(pts, i, rect);
+    });
+}
+
+_HIPP_TEMPHD
+template<typename Region>
+void _HIPP_TEMPCLS::contains(const points_t &pts, const Region &region,
+    vector<mask_t> &mask) const
+{
+    _check_region<Region>();
+    mask.resize(pts.size());
+    _for_chunks(pts.size(), [&](int, size_t b, size_t e) {
+        if( pts.is_soa() ) {
+            for(size_t i=b; i<e; ++i) mask[i] = _soa_contains(pts, i, region);
+            return;
+        }
+        std::fill(mask.begin()+b, mask.begin()+e, mask_t(0));
+        _scan<false>(pts, b, e, region, [&](size_t i) { mask[i] = 1; });
+    });
+}
+
+_HIPP_TEMPHD
+template<typename Region>
+void _HIPP_TEMPCLS::select(const points_t &pts, const Region &region,
+    vector<index_t> &ids) const
+{
+    _check_region<Region>();
+    // The hits of thread 0 are put into ``ids`` directly.
+    vector<vector<index_t> > ids_th(_policy.n_threads());
+    ids.clear();
+    _for_chunks(pts.size(), [&](int i_th, size_t b, size_t e) {
+        auto &out = i_th == 0 ? ids : ids_th[i_th];
+        _scan<false>(pts, b, e, region,
+            [&](size_t i) { out.push_back(index_t(i)); });
+    });
+    for(int i_th=1; i_th<_policy.n_threads(); ++i_th)
+        ids.insert(ids.end(), ids_th[i_th].begin(), ids_th[i_th].end());
+}
+
+_HIPP_TEMPHD
+template<typename Region>
+IndexT _HIPP_TEMPCLS::count(const points_t &pts,
+    const Region &region) const
+{
+    _check_region<Region>();
+    vector<size_t> cnts(_policy.n_threads(), 0);
+    _for_chunks(pts.size(), [&](int i_th, size_t b, size_t e) {
+        cnts[i_th] = _scan<true>(pts, b, e, region, [](size_t) {});
+    });
+    size_t cnt = 0;
+    for(auto c: cnts) cnt += c;
+    return index_t(cnt);
+}
+
+_HIPP_TEMPHD
+template<typename Region>
+void _HIPP_TEMPCLS::intersects(const points_t &pts,
+    ContiguousBuffer<const float_t> radii, const Region &region,
+    vector<mask_t> &mask) const
+{
+    _check_region<Region>();
+    const size_t n = pts.size();
+    if( radii.get_size() != n )
+        ErrLogic::throw_(ErrLogic::eLENGTH, emFLPFB,
+            "  ... no. of radii ", radii.get_size(),
+            " != no. of points ", n);
+    const float_t *rs = radii.get_cbuff();
+    mask.resize(n);
+    _for_chunks(n, [&](int, size_t b, size_t e) {
+        for(size_t i=b; i<e; ++i) {
+            if constexpr( std::is_same_v<Region, rect_t> ) {
+                mask[i] = _r_sq_of(pts, i, region) < rs[i] * rs[i];
+            } else {
+                const float_t r = rs[i] + region.r();
+                mask[i] = _r_sq_of(pts, i, region.center().pos()) < r * r;
+            }
+        }
+    });
+}
+
+_HIPP_TEMPHD
+template<typename Op>
+void _HIPP_TEMPCLS::_for_chunks(size_t n, Op &&op) const {
+    _KDSEARCH::_parallel_for(_policy.n_threads(), n, op);
+}
+
+_HIPP_TEMPHD
+template<typename Region>
+void _HIPP_TEMPCLS::_check_region() noexcept {
+    static_assert( std::is_same_v<Region, rect_t>
+        || std::is_same_v<Region, sphere_t>,
+        "region must be a rect_t or a sphere_t" );
+}
+
+/**
+The same as ``(p - pos).r_sq()``, i.e., the offsets in ``float_t`` and
+their squares summed in double.
+*/
+_HIPP_TEMPRET
+_r_sq_of(const points_t &pts, size_t i, const pos_t &pos) noexcept
+-> float_t
+{
+    double r_sq = 0.;
+    for(int k=0; k<DIM; ++k) {
+        const float_t x = pts.is_soa() ? pts.soa(k)[i] : pts.aos()[i].pos()[k];
+        const double d = float_t(x - pos[k]);
+        r_sq += d * d;
+    }
+    return float_t(r_sq);
+}
+
+_HIPP_TEMPRET
+_r_sq_of(const points_t &pts, size_t i, const rect_t &rect) noexcept
+-> float_t
+{
+    const auto &lo = rect.low().pos(), &hi = rect.high().pos();
+    double r_sq = 0.;
+    for(int k=0; k<DIM; ++k) {
+        const float_t x = pts.is_soa() ? pts.soa(k)[i] : pts.aos()[i].pos()[k];
+        const float_t d = std::max({lo[k] - x, float_t(0), x - hi[k]});
+        r_sq += double(d) * double(d);
+    }
+    return float_t(r_sq);
+}
+
+_HIPP_TEMPRET
+_soa_contains(const points_t &pts, size_t i, const rect_t &rect) noexcept
+-> bool
+{
+    const auto &lo = rect.low().pos(), &hi = rect.high().pos();
+    bool in = true;
+    for(int k=0; k<DIM; ++k) {
+        const float_t x = pts.soa(k)[i];
+        in &= (lo[k] < x) & (x < hi[k]);
+    }
+    return in;
+}
+
+_HIPP_TEMPRET
+_soa_contains(const points_t &pts, size_t i, const sphere_t &sphere) noexcept
+-> bool
+{
+    return _r_sq_of(pts, i, sphere.center().pos()) < sphere.r() * sphere.r();
+}
+
+_HIPP_TEMPHD
+template<bool COUNT, typename Region, typename Op>
+size_t _HIPP_TEMPCLS::_scan(const points_t &pts, size_t b, size_t e,
+    const Region &region, Op &&op) noexcept
+{
+    if( pts.is_soa() ) {
+        size_t cnt = 0;
+        for(size_t i=b; i<e; ++i) {
+            const bool in = _soa_contains(pts, i, region);
+            if constexpr( COUNT ) cnt += in;
+            else if( in ) op(i);
+        }
+        return cnt;
+    }
+
+    const point_t *p = pts.aos() + b;
+    auto op_b = [&](size_t i) { op(b + i); };
+    if constexpr( std::is_same_v<Region, rect_t> ) {
+        using kernel_t = _KDSEARCH::_RectKernel<point_t>;
+        if constexpr( COUNT ) return kernel_t::count_within(p, e-b, region);
+        else kernel_t::visit_within(p, e-b, region, op_b);
+    } else {
+        using kernel_t = _KDSEARCH::_DistKernel<point_t>;
+        const pos_t &c = region.center().pos();
+        const float_t r_sq = region.r() * region.r();
+        if constexpr( COUNT ) return kernel_t::count_within(p, e-b, c, r_sq);
+        else kernel_t::visit_within(p, e-b, c, r_sq, op_b);
+    }
+    return 0;
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
+
+} // namespace HIPP::NUMERICAL
+
+#endif	//_HIPPNUMERICAL_KDSEARCH_GEOMETRY_BATCH_H_
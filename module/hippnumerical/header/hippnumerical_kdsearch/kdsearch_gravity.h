@@ -0,0 +1,544 @@
+/**
+create: Yangyao CHEN, 2026/10/17
+    [write   ] _GravityPolicy - policy of the tree-code gravity.
+    [write   ] _Multipole - monopole and quadrupole moments of a subtree.
+    [write   ] _GravityList - interaction list of a group of targets.
+*/
+
+#ifndef _HIPPNUMERICAL_KDSEARCH_GRAVITY_H_
+#define _HIPPNUMERICAL_KDSEARCH_GRAVITY_H_
+
+#include "kdsearch_base.h"
+
+namespace HIPP::NUMERICAL::_KDSEARCH {
+
+/**
+Policy of the Barnes-Hut tree-code gravity.
+
+opening_angle: the opening criterion ``theta``. A subtree is taken as a
+whole if ``b_max < theta * d``, where ``d`` is the distance from the target
+to its center of mass and ``b_max`` bounds the distance from the center of
+mass to any of its points (see ``_Multipole``). Otherwise, it is opened.
+``theta = 0`` opens all subtrees, i.e., the direct summation.
+
+order: the highest moment of an accepted subtree, MONOPOLE or QUADRUPOLE.
+The relative error of the force from a subtree scales as ``theta^2`` or
+``theta^3``, respectively.
+
+softening: the Plummer softening length ``eps``, i.e., the potential of a
+point mass is ``-G m / sqrt(r^2 + eps^2)``. With ``eps = 0``, a point at
+exactly the target position is skipped.
+
+grav_const: the gravitational constant ``G``.
+
+weighted: if on, the mass of each point is a ``float_t`` value stored at the
+beginning of its padding (as for the weighted pair counting). Otherwise,
+each point has unit mass.
+
+group_size: the targets are ordered along the tree, and each group of 
+``group_size`` successive targets walks the tree once. A subtree is accepted
+for the group only if it is accepted for every target in the bounding sphere 
+of the group, hence the results are at least as accurate as those of 
+``group_size = 1``, i.e., a walk for each target. The accepted subtrees 
+(the interaction list) are then summed for each target in the group.
+
+n_threads: the number of threads. The groups are distributed to the threads,
+and the results do not depend on the number of threads.
+*/
+class _GravityPolicy {
+public:
+    enum class order_t { MONOPOLE, QUADRUPOLE };
+
+    static constexpr order_t DFLT_ORDER = order_t::QUADRUPOLE;
+    static constexpr double DFLT_OPENING_ANGLE = 0.5;
+    static constexpr double DFLT_SOFTENING = 0.0;
+    static constexpr double DFLT_GRAV_CONST = 1.0;
+    static constexpr bool DFLT_WEIGHTED = false;
+    static constexpr std::ptrdiff_t DFLT_GROUP_SIZE = 8;
+    static constexpr int DFLT_N_THREADS = 1;
+
+    _GravityPolicy() noexcept;
+
+    ostream & info(ostream &os = cout, int fmt_cntl = 0, int level = 0) const;
+    friend ostream & operator<< (ostream &os,
+        const _GravityPolicy &pl) { return pl.info(os); }
+
+    double opening_angle() const noexcept;
+    _GravityPolicy & set_opening_angle(double opening_angle) noexcept;
+
+    order_t order() const noexcept;
+    _GravityPolicy & set_order(order_t order) noexcept;
+
+    double softening() const noexcept;
+    _GravityPolicy & set_softening(double softening) noexcept;
+
+    double grav_const() const noexcept;
+    _GravityPolicy & set_grav_const(double grav_const) noexcept;
+
+    bool weighted() const noexcept;
+    _GravityPolicy & weighted_on() noexcept;
+    _GravityPolicy & weighted_off() noexcept;
+
+    std::ptrdiff_t group_size() const noexcept;
+    _GravityPolicy & set_group_size(std::ptrdiff_t group_size) noexcept;
+
+    int n_threads() const noexcept;
+    _GravityPolicy & set_n_threads(int n_threads) noexcept;
+
+    /**
+    Throw ``ErrLogic`` if the values are invalid.
+    */
+    void verify() const;
+protected:
+    order_t _order;
+    double _opening_angle, _softening, _grav_const;
+    bool _weighted;
+    std::ptrdiff_t _group_size;
+    int _n_threads;
+};
+
+/**
+Multipole moments of the points in a subtree, about their center of mass.
+
+mass(): the total mass ``M``.
+com(): the center of mass. For a subtree of zero mass, it is the center of
+the bounding sphere.
+second_moment(i, j): ``M_ij = sum m y_i y_j``, where ``y`` is the position of
+a point relative to the center of mass. It is stored as the upper triangle.
+quad(i, j): the quadrupole moment ``Q_ij = 3 M_ij - tr(M) d_ij``.
+b_max(): an upper bound of ``|y|`` over the points.
+
+set_point(): the moments of a single point of mass ``m`` at ``x``.
+merge(): the moments of the union of two disjoint subtrees ``l`` and ``r``,
+bounded by the sphere ``(center, r)``. ``b_max`` is the smaller one of the
+bounds given by the sphere and by the children.
+*/
+template<typename FloatT, int DIM>
+class _Multipole {
+public:
+    using float_t = FloatT;
+    using pos_t = typename GEOMETRY::Point<float_t, DIM>::pos_t;
+
+    static constexpr int N_M2 = DIM * (DIM + 1) / 2;
+
+    _Multipole() noexcept;
+
+    float_t mass() const noexcept;
+    const pos_t & com() const noexcept;
+    float_t second_moment(int i, int j) const noexcept;
+    float_t quad(int i, int j) const noexcept;
+    float_t b_max() const noexcept;
+
+    void set_point(const pos_t &x, float_t m) noexcept;
+    void merge(const _Multipole &l, const _Multipole &r,
+        const pos_t &center, float_t radius) noexcept;
+protected:
+    float_t _mass, _b_max;
+    pos_t _com;
+    float_t _m2[N_M2];
+
+    static constexpr int _m2_idx(int i, int j) noexcept;
+};
+
+/**
+Interaction list of a group of targets, i.e., the leaves and subtrees 
+accepted by the group, packed as structure of arrays so that the summation
+over the list runs through contiguous memory.
+
+add_point(): add a leaf, taken as a point mass at its center of mass.
+add_node(): add a subtree, taken as its monopole and second moments.
+
+eval(): the field of the list at the target ``x``, in units of ``G``. On 
+exit, ``acc`` and ``pot`` are the acceleration and potential. The field is 
+the expansion of the Plummer potential ``-1/s``, ``s^2 = r^2 + eps_sq``, to
+the monopole and, for the subtrees if ``quadrupole`` is on, the quadrupole 
+order. The latter is exact in ``eps``, i.e., it keeps the trace ``tr(M)`` 
+that drops out of the unsoftened field. A leaf at ``s = 0`` is skipped.
+Return the number of entries that contribute.
+
+The entries are summed in ``N_LANES`` interleaved partial sums, which are 
+independent and may be vectorized by the compiler. The results depend only
+on the list, not on the calling thread.
+*/
+template<typename FloatT, int DIM>
+class _GravityList {
+public:
+    using float_t = FloatT;
+    using multipole_t = _Multipole<float_t, DIM>;
+
+    static constexpr int N_M2 = multipole_t::N_M2, N_LANES = 4;
+
+    void clear() noexcept;
+    void add_point(const multipole_t &mp);
+    void add_node(const multipole_t &mp);
+
+    /**
+    n_points(), n_nodes(): number of leaves and subtrees in the list.
+    */
+    std::size_t n_points() const noexcept;
+    std::size_t n_nodes() const noexcept;
+
+    template<typename PosT>
+    std::size_t eval(const PosT &x, double eps_sq, bool quadrupole,
+        double (&acc)[DIM], double &pot) const noexcept;
+protected:
+    /**
+    _x_l[k][j], _m_l[j]: position and mass of leaf j.
+    _x_n[k][j], _m_n[j], _m2_n[k][j], _tr_n[j]: center of mass, mass, 
+    second moments (upper triangle) and their trace of subtree j.
+    */
+    vector<double> _x_l[DIM], _m_l, _x_n[DIM], _m_n, _m2_n[N_M2], _tr_n;
+
+    std::size_t _eval_points(const double (&x)[DIM], double eps_sq, 
+        double (&acc)[DIM], double &pot) const noexcept;
+    void _eval_nodes(const double (&x)[DIM], double eps_sq, bool quadrupole,
+        double (&acc)[DIM], double &pot) const noexcept;
+};
+
+inline _GravityPolicy::_GravityPolicy() noexcept {
+    set_order(DFLT_ORDER);
+    set_opening_angle(DFLT_OPENING_ANGLE);
+    set_softening(DFLT_SOFTENING);
+    set_grav_const(DFLT_GRAV_CONST);
+    _weighted = DFLT_WEIGHTED;
+    set_group_size(DFLT_GROUP_SIZE);
+    set_n_threads(DFLT_N_THREADS);
+}
+
+inline ostream & _GravityPolicy::info(ostream &os, int fmt_cntl,
+    int level) const
+{
+    const char *order = _order == order_t::MONOPOLE ?
+        "monopole" : "quadrupole";
+    PStream ps{os};
+    if( fmt_cntl < 1 ) {
+        ps << HIPPCNTL_CLASS_INFO_INLINE(_GravityPolicy),
+        "{order=", order, ", opening angle=", _opening_angle,
+        ", softening=", _softening, "}";
+        return os;
+    }
+    auto ind = HIPPCNTL_CLASS_INFO_INDENT_STR(level);
+    ps << HIPPCNTL_CLASS_INFO(_GravityPolicy),
+    ind, "Order = ", order, ", opening angle = ", _opening_angle, '\n',
+    ind, "Softening = ", _softening, ", G = ", _grav_const,
+        ", weighted = ", _weighted, '\n',
+    ind, "Group size = ", _group_size, ", No. threads = ", _n_threads, '\n';
+    return os;
+}
+
+inline double _GravityPolicy::opening_angle() const noexcept {
+    return _opening_angle;
+}
+
+inline _GravityPolicy &
+_GravityPolicy::set_opening_angle(double opening_angle) noexcept {
+    _opening_angle = opening_angle; return *this;
+}
+
+inline auto _GravityPolicy::order() const noexcept -> order_t {
+    return _order;
+}
+
+inline _GravityPolicy & _GravityPolicy::set_order(order_t order) noexcept {
+    _order = order; return *this;
+}
+
+inline double _GravityPolicy::softening() const noexcept {
+    return _softening;
+}
+
+inline _GravityPolicy &
+_GravityPolicy::set_softening(double softening) noexcept {
+    _softening = softening; return *this;
+}
+
+inline double _GravityPolicy::grav_const() const noexcept {
+    return _grav_const;
+}
+
+inline _GravityPolicy &
+_GravityPolicy::set_grav_const(double grav_const) noexcept {
+    _grav_const = grav_const; return *this;
+}
+
+inline bool _GravityPolicy::weighted() const noexcept {
+    return _weighted;
+}
+
+inline _GravityPolicy & _GravityPolicy::weighted_on() noexcept {
+    _weighted = true; return *this;
+}
+
+inline _GravityPolicy & _GravityPolicy::weighted_off() noexcept {
+    _weighted = false; return *this;
+}
+
+inline std::ptrdiff_t _GravityPolicy::group_size() const noexcept {
+    return _group_size;
+}
+
+inline _GravityPolicy &
+_GravityPolicy::set_group_size(std::ptrdiff_t group_size) noexcept {
+    _group_size = group_size; return *this;
+}
+
+inline int _GravityPolicy::n_threads() const noexcept {
+    return _n_threads;
+}
+
+inline _GravityPolicy & _GravityPolicy::set_n_threads(int n_threads) noexcept {
+    _n_threads = n_threads; return *this;
+}
+
+inline void _GravityPolicy::verify() const {
+    if( !(_opening_angle >= 0.) || !(_softening >= 0.) )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB,
+            "  ... invalid opening angle ", _opening_angle,
+            " or softening ", _softening);
+    if( _group_size < 1 || _n_threads < 1 )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB,
+            "  ... invalid group size ", _group_size, 
+            " or no. of threads ", _n_threads);
+}
+
+#define _HIPP_TEMPHD template<typename FloatT, int DIM>
+#define _HIPP_TEMPARG <FloatT, DIM>
+#define _HIPP_TEMPCLS _Multipole _HIPP_TEMPARG
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPNORET
+_Multipole() noexcept : _mass(0), _b_max(0), _com(float_t(0)), _m2{} {}
+
+_HIPP_TEMPRET
+mass() const noexcept -> float_t {
+    return _mass;
+}
+
+_HIPP_TEMPRET
+com() const noexcept -> const pos_t & {
+    return _com;
+}
+
+_HIPP_TEMPRET
+second_moment(int i, int j) const noexcept -> float_t {
+    return _m2[_m2_idx(i, j)];
+}
+
+_HIPP_TEMPRET
+quad(int i, int j) const noexcept -> float_t {
+    double q = 3. * _m2[_m2_idx(i, j)];
+    if( i == j ) 
+        for(int k=0; k<DIM; ++k) q -= _m2[_m2_idx(k, k)];
+    return q;
+}
+
+_HIPP_TEMPRET
+b_max() const noexcept -> float_t {
+    return _b_max;
+}
+
+_HIPP_TEMPRET
+set_point(const pos_t &x, float_t m) noexcept -> void {
+    _mass = m;
+    _b_max = 0;
+    _com = x;
+    for(int k=0; k<N_M2; ++k) _m2[k] = 0;
+}
+
+_HIPP_TEMPRET
+merge(const _Multipole &l, const _Multipole &r, const pos_t &center,
+    float_t radius) noexcept -> void
+{
+    const double m_l = l._mass, m_r = r._mass, m = m_l + m_r;
+    double com[DIM];
+    for(int k=0; k<DIM; ++k)
+        com[k] = m != 0. ? (m_l * l._com[k] + m_r * r._com[k]) / m
+            : double(center[k]);
+
+    // Shift the second moments of the children by the parallel-axis theorem.
+    double m2[N_M2] = {}, b = 0.;
+    for(const _Multipole *c: {&l, &r}) {
+        double d[DIM], d_sq = 0.;
+        for(int k=0; k<DIM; ++k) {
+            d[k] = double(c->_com[k]) - com[k];
+            d_sq += d[k] * d[k];
+        }
+        const double m_c = c->_mass;
+        for(int i=0; i<DIM; ++i) for(int j=i; j<DIM; ++j) {
+            const int k = _m2_idx(i, j);
+            m2[k] += c->_m2[k] + m_c * d[i] * d[j];
+        }
+        b = std::max(b, std::sqrt(d_sq) + c->_b_max);
+    }
+
+    double d_sq = 0.;
+    for(int k=0; k<DIM; ++k) {
+        const double d = com[k] - double(center[k]);
+        d_sq += d * d;
+    }
+    b = std::min(b, std::sqrt(d_sq) + radius);
+
+    _mass = m;
+    _b_max = b;
+    for(int k=0; k<DIM; ++k) _com[k] = com[k];
+    for(int k=0; k<N_M2; ++k) _m2[k] = m2[k];
+}
+
+_HIPP_TEMPHD
+constexpr int _HIPP_TEMPCLS::_m2_idx(int i, int j) noexcept {
+    const int lo = i < j ? i : j, hi = i < j ? j : i;
+    return lo * DIM - lo * (lo - 1) / 2 + (hi - lo);
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
+
+#define _HIPP_TEMPHD template<typename FloatT, int DIM>
+#define _HIPP_TEMPARG <FloatT, DIM>
+#define _HIPP_TEMPCLS _GravityList _HIPP_TEMPARG
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPRET
+clear() noexcept -> void {
+    for(auto &x: _x_l) x.clear();
+    _m_l.clear();
+    for(auto &x: _x_n) x.clear();
+    _m_n.clear();
+    for(auto &m2: _m2_n) m2.clear();
+    _tr_n.clear();
+}
+
+_HIPP_TEMPRET
+add_point(const multipole_t &mp) -> void {
+    for(int k=0; k<DIM; ++k) _x_l[k].push_back(mp.com()[k]);
+    _m_l.push_back(mp.mass());
+}
+
+_HIPP_TEMPRET
+add_node(const multipole_t &mp) -> void {
+    for(int k=0; k<DIM; ++k) _x_n[k].push_back(mp.com()[k]);
+    _m_n.push_back(mp.mass());
+    double tr = 0.;
+    for(int i=0, k=0; i<DIM; ++i) for(int j=i; j<DIM; ++j, ++k) {
+        const double m2 = mp.second_moment(i, j);
+        _m2_n[k].push_back(m2);
+        if( i == j ) tr += m2;
+    }
+    _tr_n.push_back(tr);
+}
+
+_HIPP_TEMPRET
+n_points() const noexcept -> std::size_t {
+    return _m_l.size();
+}
+
+_HIPP_TEMPRET
+n_nodes() const noexcept -> std::size_t {
+    return _m_n.size();
+}
+
+_HIPP_TEMPHD
+template<typename PosT>
+std::size_t _HIPP_TEMPCLS::eval(const PosT &x, double eps_sq, 
+    bool quadrupole, double (&acc)[DIM], double &pot) const noexcept
+{
+    double x_d[DIM];
+    for(int k=0; k<DIM; ++k) {
+        x_d[k] = x[k];
+        acc[k] = 0.;
+    }
+    pot = 0.;
+    const std::size_t n_zeros = _eval_points(x_d, eps_sq, acc, pot);
+    _eval_nodes(x_d, eps_sq, quadrupole, acc, pot);
+    return n_points() + n_nodes() - n_zeros;
+}
+
+_HIPP_TEMPRET
+_eval_points(const double (&x)[DIM], double eps_sq, double (&acc)[DIM], 
+    double &pot) const noexcept -> std::size_t
+{
+    const std::size_t n = n_points();
+    double a[N_LANES][DIM] = {}, phi[N_LANES] = {};
+    std::size_t n_zeros = 0;
+    auto add = [&](int w, std::size_t j) {
+        double dx[DIM], s_sq = eps_sq;
+        for(int k=0; k<DIM; ++k) {
+            dx[k] = x[k] - _x_l[k][j];
+            s_sq += dx[k] * dx[k];
+        }
+        n_zeros += s_sq == 0.;
+        const double inv_s = s_sq > 0. ? 1. / std::sqrt(s_sq) : 0.,
+            m_inv_s = _m_l[j] * inv_s, m_inv_s3 = m_inv_s * inv_s * inv_s;
+        phi[w] -= m_inv_s;
+        for(int k=0; k<DIM; ++k) a[w][k] -= m_inv_s3 * dx[k];
+    };
+    std::size_t j = 0;
+    for(; j + N_LANES <= n; j += N_LANES)
+        for(int w=0; w<N_LANES; ++w) add(w, j+w);
+    for(int w=0; j<n; ++j, ++w) add(w, j);
+
+    for(int w=0; w<N_LANES; ++w) {
+        pot += phi[w];
+        for(int k=0; k<DIM; ++k) acc[k] += a[w][k];
+    }
+    return n_zeros;
+}
+
+_HIPP_TEMPRET
+_eval_nodes(const double (&x)[DIM], double eps_sq, bool quadrupole, 
+    double (&acc)[DIM], double &pot) const noexcept -> void
+{
+    const std::size_t n = n_nodes();
+    double a[N_LANES][DIM] = {}, phi[N_LANES] = {};
+    auto add = [&](int w, std::size_t j) {
+        double dx[DIM], s_sq = eps_sq;
+        for(int k=0; k<DIM; ++k) {
+            dx[k] = x[k] - _x_n[k][j];
+            s_sq += dx[k] * dx[k];
+        }
+        const double inv_s = 1. / std::sqrt(s_sq), inv_s2 = inv_s * inv_s,
+            m_inv_s3 = _m_n[j] * inv_s * inv_s2;
+        phi[w] -= _m_n[j] * inv_s;
+        for(int k=0; k<DIM; ++k) a[w][k] -= m_inv_s3 * dx[k];
+        if( !quadrupole ) return;
+
+        // phi = -(3 x^T M x / s^5 - tr(M) / s^3) / 2, acc = -grad phi.
+        double mx[DIM] = {}, xmx = 0.;
+        for(int i=0, k=0; i<DIM; ++i) {
+            mx[i] += _m2_n[k++][j] * dx[i];
+            for(int l=i+1; l<DIM; ++l, ++k) {
+                mx[i] += _m2_n[k][j] * dx[l];
+                mx[l] += _m2_n[k][j] * dx[i];
+            }
+            xmx += mx[i] * dx[i];
+        }
+        const double tr = _tr_n[j], inv_s5 = inv_s * inv_s2 * inv_s2;
+        phi[w] -= 0.5 * (3. * xmx * inv_s2 - tr) * inv_s * inv_s2;
+        const double f = (7.5 * xmx * inv_s2 - 1.5 * tr) * inv_s5;
+        for(int k=0; k<DIM; ++k) a[w][k] += 3. * inv_s5 * mx[k] - f * dx[k];
+    };
+    std::size_t j = 0;
+    for(; j + N_LANES <= n; j += N_LANES)
+        for(int w=0; w<N_LANES; ++w) add(w, j+w);
+    for(int w=0; j<n; ++j, ++w) add(w, j);
+
+    for(int w=0; w<N_LANES; ++w) {
+        pot += phi[w];
+        for(int k=0; k<DIM; ++k) acc[k] += a[w][k];
+    }
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
+
+} // namespace HIPP::NUMERICAL::_KDSEARCH
+
+#endif	//_HIPPNUMERICAL_KDSEARCH_GRAVITY_H_
@@ -2,6 +2,8 @@
 create: Yangyao CHEN, 2022/04/15
     [write   ] _InsertableBallTreeNode, _InsertableBallTree - Implementation
         of insertion-based ball tree construction algorithms.
+update: Yangyao CHEN, 2026/10/17
+    [add     ] _InsertableBallTree::insert_batch - batch insertion.
 */
 
 #ifndef _HIPPNUMERICAL_KDSEARCH_INSERTABLE_BALLTREE_RAW_H_
@@ -132,6 +134,7 @@ public:
     
     class construct_policy_t;
     class insert_policy_t;
+    class batch_insert_policy_t;
     class preorder_traverse_policy_t;
     class inorder_traverse_policy_t;
 
@@ -215,6 +218,26 @@ public:
     */
     template<typename Policy = insert_policy_t>
     void insert(const kd_point_t &pt, Policy &&policy = Policy());
+
+    /**
+    Insert a batch of points. The result is a valid tree as if inserted one 
+    by one, but the tree structure may differ.
+
+    The batch is first ordered spatially. The insertion location of each 
+    point is searched in the tree before the batch. With the ROUGH favor, 
+    the points descend the tree as groups, so that a path shared by 
+    nearby points is walked once. The search is read-only and runs on 
+    ``policy.n_threads()`` threads, each on a contiguous part of the 
+    ordered batch. Points with the same location are then built into a 
+    subtree, attached to the location. Finally, the bounds of all the 
+    modified ancestors are refit in a single bottom-up pass, instead of
+    once per insertion.
+
+    ``bottom_up_refine()`` may be called afterwards to improve the tree.
+    */
+    template<typename Policy = batch_insert_policy_t>
+    void insert_batch(ContiguousBuffer<const kd_point_t> pts, 
+        Policy &&policy = Policy());
     
     /**
     The subtree is removed.
@@ -268,6 +291,30 @@ protected:
     index_t _find_best_insert_loc(const sphere_t &s,
         Policy &&policy = Policy()) const noexcept;
 
+    /**
+    Batch version of ``_find_best_insert_loc()``. ``locs[i]`` is set to the 
+    location of point ``p_pts[ids[i]]``, for ``i`` in ``[0, n)``. Tree 
+    must not be empty.
+    */
+    template<typename Policy>
+    void _find_batch_insert_locs(const kd_point_t *p_pts, const index_t *ids,
+        index_t n, index_t *locs, Policy &policy) const;
+
+    /**
+    Reorder ``ids[b, e)`` so that the points nearby in space are nearby in 
+    the order, by recursive median splits along the longest extents.
+    */
+    static void _spatial_order(const kd_point_t *p_pts, index_t *b, 
+        index_t *e);
+
+    /**
+    Build a subtree of the points ``p_pts[ids[i]]``, ``i`` in ``[b, e)``, 
+    by splitting the range in halves. The root index is returned, whose 
+    parent is not set.
+    */
+    index_t _build_subtree(const kd_point_t *p_pts, const index_t *ids, 
+        index_t b, index_t e);
+
     /**
     Update
         i_par - 3 pointers of;
@@ -277,6 +324,10 @@ protected:
     */
     void _insert_at(index_t i, index_t i_sibl, index_t i_par) noexcept;
     /** 
+    As ``_insert_at()``, but the ancestors are not updated.
+    */
+    void _link_at(index_t i, index_t i_sibl, index_t i_par) noexcept;
+    /** 
     root->lc, i->par are updated.
     root becomes tINTERNAL.
     */
@@ -287,6 +338,12 @@ protected:
     i must not be a leaf.
     */
     void _update_upward(index_t i) noexcept;
+    /**
+    Recompute r, pos of the ancestor chains starting at (and including) 
+    each node in ``starts``, in a single bottom-up pass, i.e., each node 
+    is recomputed once after its children.
+    */
+    void _update_upward(const vector<index_t> &starts);
 
 
     /** 
@@ -390,6 +447,33 @@ protected:
     fringe_t _fringe;
 };
 
+/**
+Policy of the batch insertion, i.e., the insertion policy with the number of
+threads to search for the insertion locations.
+*/
+template<typename KDPointT, typename IndexT>
+class _InsertableBallTree<KDPointT, IndexT>::batch_insert_policy_t 
+: public insert_policy_t {
+public:
+    using typename insert_policy_t::insert_favor_t;
+    static constexpr int DFLT_N_THREADS = 1;
+
+    batch_insert_policy_t() noexcept;
+    batch_insert_policy_t(insert_favor_t insert_favor) noexcept;
+
+    ostream & info(ostream &os = cout, int  fmt_cntl = 0, int level = 0) const;
+    friend ostream & operator<<(ostream &os, 
+        const batch_insert_policy_t &obj) 
+    {
+        return obj.info(os);
+    }
+
+    int n_threads() const noexcept;
+    batch_insert_policy_t & set_n_threads(int n_threads) noexcept;
+protected:
+    int _n_threads;
+};
+
 template<typename KDPointT, typename IndexT>
 class _InsertableBallTree<KDPointT, IndexT>::preorder_traverse_policy_t {
 public:  
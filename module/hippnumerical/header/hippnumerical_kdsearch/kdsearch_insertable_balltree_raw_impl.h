@@ -382,6 +382,60 @@ void _HIPP_TEMPCLS::insert(const kd_point_t &pt, Policy &&policy) {
     _insert_at(n_nodes+1, i_sibl, n_nodes);
 }
 
+_HIPP_TEMPHD
+template<typename Policy>
+void _HIPP_TEMPCLS::insert_batch(ContiguousBuffer<const kd_point_t> pts, 
+    Policy &&policy) 
+{
+    const int n_threads = policy.n_threads();
+    if( n_threads < 1 )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB, 
+            "  ... invalid no. of threads ", n_threads, '\n');
+    auto [p_pts, n_pts] = pts;
+    const index_t n = n_pts;
+    if( n == 0 ) return;
+
+    vector<index_t> ids(n);
+    for(index_t i=0; i<n; ++i) ids[i] = i;
+    _spatial_order(p_pts, ids.data(), ids.data()+n);
+
+    // Locations in the tree before the batch. idxNULL for an empty tree.
+    vector<index_t> locs(n, node_t::idxNULL);
+    if( !empty() ) {
+        _parallel_for(n_threads, n, [&](int, index_t b, index_t e) {
+            std::remove_reference_t<Policy> pl(policy);
+            _find_batch_insert_locs(p_pts, ids.data()+b, e-b, 
+                locs.data()+b, pl);
+        });
+    }
+
+    // Group the points by location, keeping the spatial order in a group.
+    vector<index_t> order(n), grouped(n);
+    for(index_t i=0; i<n; ++i) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), 
+        [&](index_t i, index_t j) { return locs[i] < locs[j]; });
+    for(index_t i=0; i<n; ++i) grouped[i] = ids[order[i]];
+
+    _nodes.reserve(_nodes.size() + 2*n);
+    vector<index_t> new_pars;
+    for(index_t b=0, e=0; b<n; b=e) {
+        const index_t loc = locs[order[b]];
+        while( e < n && locs[order[e]] == loc ) ++e;
+        const index_t i_sub = _build_subtree(p_pts, grouped.data(), b, e);
+        if( loc == node_t::idxNULL ) {
+            _insert_into_empty_tree(i_sub);
+            continue;
+        }
+        node_t n_par = _nodes[loc].bounding_ball(_nodes[i_sub]);
+        n_par._node_info = node_t::tINTERNAL;
+        const index_t i_par = _nodes.size();
+        _nodes.push_back(n_par);
+        _link_at(i_sub, loc, i_par);
+        new_pars.push_back(i_par);
+    }
+    _update_upward(new_pars);
+}
+
 _HIPP_TEMPHD
 template<typename PreorderTraversePolicy>
 void _HIPP_TEMPCLS::remove(index_t node_idx, PreorderTraversePolicy &&policy) {
@@ -621,9 +675,135 @@ auto _HIPP_TEMPCLS::_find_best_insert_loc(const sphere_t &s,
         decltype(f_vol) > {policy, f_vol, *this}();
 }
 
+_HIPP_TEMPHD
+template<typename Policy>
+void _HIPP_TEMPCLS::_find_batch_insert_locs(const kd_point_t *p_pts, 
+    const index_t *ids, index_t n, index_t *locs, Policy &policy) const
+{
+    using ins_fav_t = typename std::remove_reference_t<Policy>::insert_favor_t;
+    if( policy.insert_favor() != ins_fav_t::ROUGH ) {
+        for(index_t i=0; i<n; ++i)
+            locs[i] = _find_best_insert_loc(point_t(p_pts[ids[i]]), policy);
+        return;
+    }
+
+    // The state of run_rough() of _Impl_find_best_insert_loc for each 
+    // point, and the direction of its next step: -1 for stop, 0 for left 
+    // and 1 for right.
+    struct state_t {
+        index_t i;
+        float_t ances_exp, bounding_vol, dvol, min_cost;
+        int dir;
+    };
+    auto f_vol = [&](index_t idx, index_t i) {
+        const node_t &nd = _nodes[idx];
+        return nd._pow(nd.bounding_d(point_t(p_pts[ids[i]])));
+    };
+    const index_t i_top = root()._left_child_idx;
+    const float_t vol_top = _nodes[i_top].volume();
+    vector<state_t> sts(n);
+    for(index_t i=0; i<n; ++i) {
+        const float_t bv = f_vol(i_top, i);
+        sts[i] = state_t{i, float_t(0), bv, bv - vol_top, bv, -1};
+        locs[i] = i_top;
+    }
+
+    // Points at the same node make the step together, and are partitioned 
+    // by their directions.
+    std::stack<std::tuple<index_t, index_t, index_t> > stk;
+    stk.emplace(i_top, 0, n);
+    while( !stk.empty() ) {
+        const auto [idx, b, e] = stk.top(); stk.pop();
+        const node_t &nd = _nodes[idx];
+        for(index_t k=b; k<e; ++k) {
+            auto &st = sts[k];
+            st.dir = -1;
+            if( st.min_cost < st.ances_exp ) continue;
+            const float_t cost = st.ances_exp + st.bounding_vol;
+            if( cost < st.min_cost ) {
+                st.min_cost = cost;
+                locs[st.i] = idx;
+            }
+            if( nd.is_leaf() ) continue;
+            st.ances_exp += st.dvol;
+            const index_t i_lc = nd._left_child_idx, 
+                i_rc = nd._right_child_idx;
+            const float_t bv_lc = f_vol(i_lc, st.i), 
+                bv_rc = f_vol(i_rc, st.i), 
+                dv_lc = bv_lc - _nodes[i_lc].volume(),
+                dv_rc = bv_rc - _nodes[i_rc].volume();
+            if( dv_lc < dv_rc ) {
+                st.bounding_vol = bv_lc; st.dvol = dv_lc; st.dir = 0;
+            } else {
+                st.bounding_vol = bv_rc; st.dvol = dv_rc; st.dir = 1;
+            }
+        }
+        auto *p_b = sts.data()+b, *p_e = sts.data()+e;
+        auto *p_go = std::partition(p_b, p_e, 
+            [](const state_t &st) { return st.dir >= 0; });
+        auto *p_l = std::partition(p_b, p_go, 
+            [](const state_t &st) { return st.dir == 0; });
+        const index_t l = p_l - sts.data(), go = p_go - sts.data();
+        if( go > l ) stk.emplace(nd._right_child_idx, l, go);
+        if( l > b ) stk.emplace(nd._left_child_idx, b, l);
+    }
+}
+
+_HIPP_TEMPRET
+_spatial_order(const kd_point_t *p_pts, index_t *b, index_t *e) -> void
+{
+    constexpr index_t n_min = 8;
+    while( e - b > n_min ) {
+        pos_t low = p_pts[*b].pos(), high = low;
+        for(index_t *p=b+1; p<e; ++p) {
+            const auto &x = p_pts[*p].pos();
+            for(int j=0; j<DIM; ++j) {
+                low[j] = std::min(low[j], x[j]);
+                high[j] = std::max(high[j], x[j]);
+            }
+        }
+        const int axis = (high - low).max_index();
+        index_t *mid = b + (e - b) / 2;
+        std::nth_element(b, mid, e, [&](index_t i, index_t j) {
+            return p_pts[i].pos()[axis] < p_pts[j].pos()[axis];
+        });
+        _spatial_order(p_pts, b, mid);
+        b = mid;
+    }
+}
+
+_HIPP_TEMPRET
+_build_subtree(const kd_point_t *p_pts, const index_t *ids, index_t b, 
+    index_t e) -> index_t
+{
+    if( e - b == 1 ) {
+        const kd_point_t &pt = p_pts[ids[b]];
+        _nodes.emplace_back(pt, float_t(0), node_t::idxNULL, 
+            node_t::idxNULL, node_t::idxNULL, node_t::tLEAF, pt.pad());
+        return _nodes.size() - 1;
+    }
+    const index_t mid = b + (e - b) / 2,
+        i_lc = _build_subtree(p_pts, ids, b, mid),
+        i_rc = _build_subtree(p_pts, ids, mid, e), 
+        i = _nodes.size();
+    node_t n = _nodes[i_lc].bounding_ball(_nodes[i_rc]);
+    n._left_child_idx = i_lc;
+    n._right_child_idx = i_rc;
+    n._node_info = node_t::tINTERNAL;
+    _nodes.push_back(n);
+    _nodes[i_lc]._parent_idx = _nodes[i_rc]._parent_idx = i;
+    return i;
+}
 
 _HIPP_TEMPRET
 _insert_at(index_t i, index_t i_sibl, index_t i_par) noexcept -> void 
+{
+    _link_at(i, i_sibl, i_par);
+    _update_upward(_nodes[i_par]._parent_idx);
+}
+
+_HIPP_TEMPRET
+_link_at(index_t i, index_t i_sibl, index_t i_par) noexcept -> void 
 {
     node_t &n = _nodes[i],
         &n_sibl = _nodes[i_sibl],
@@ -642,8 +822,6 @@ _insert_at(index_t i, index_t i_sibl, index_t i_par) noexcept -> void
         n_par._left_child_idx = i;
     }
     n_sibl._parent_idx = n._parent_idx = i_par;
-
-    _update_upward(i_old_par);
 }
 
 _HIPP_TEMPRET
@@ -670,6 +848,37 @@ _update_upward(index_t i) noexcept -> void
     }
 }
 
+_HIPP_TEMPRET
+_update_upward(const vector<index_t> &starts) -> void 
+{
+    // Mark the ancestor chains. A chain stops at a marked node.
+    vector<char> dirty(_nodes.size(), 0);
+    for(index_t i: starts)
+        for(; i != ROOT_IDX && !dirty[i]; i = _nodes[i]._parent_idx)
+            dirty[i] = 1;
+
+    // Post-order over the marked nodes.
+    const index_t i_top = root()._left_child_idx;
+    if( i_top == node_t::idxNULL || !dirty[i_top] ) return;
+    std::stack<std::pair<index_t, bool> > stk;
+    stk.emplace(i_top, false);
+    while( !stk.empty() ) {
+        auto &[i, expanded] = stk.top();
+        node_t &n = _nodes[i];
+        if( expanded ) {
+            sphere_t bs = _nodes[n._left_child_idx].bounding_sphere(
+                _nodes[n._right_child_idx]);
+            n._r = bs.r();
+            n._center = bs.center();
+            stk.pop();
+            continue;
+        }
+        expanded = true;
+        for(index_t i_c: {n._left_child_idx, n._right_child_idx})
+            if( dirty[i_c] ) stk.emplace(i_c, false);
+    }
+}
+
 _HIPP_TEMPRET
 _find_best_leaf_pair_with(index_t i,
     std::stack<std::pair<index_t, float_t> > &workspace) const noexcept 
@@ -940,6 +1149,55 @@ fringe() noexcept -> fringe_t & {
 #undef _HIPP_TEMPRET
 #undef _HIPP_TEMPNORET
 
+#define _HIPP_TEMPHD template<typename KDPointT, typename IndexT>
+#define _HIPP_TEMPARG <KDPointT, IndexT>
+#define _HIPP_TEMPCLS _InsertableBallTree _HIPP_TEMPARG::batch_insert_policy_t
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPNORET
+batch_insert_policy_t() noexcept 
+: batch_insert_policy_t(insert_policy_t::DFLT_INSERT_FAVOR) {}
+
+_HIPP_TEMPNORET
+batch_insert_policy_t(insert_favor_t insert_favor) noexcept 
+: insert_policy_t(insert_favor), _n_threads(DFLT_N_THREADS)
+{}
+
+_HIPP_TEMPRET
+info(ostream &os, int  fmt_cntl, int level) const -> ostream & {
+    PStream ps(os);
+    if( fmt_cntl < 1 ) {
+        ps << HIPPCNTL_CLASS_INFO_INLINE(batch_insert_policy_t),
+        "{", static_cast<const insert_policy_t &>(*this), 
+        ", n threads=", _n_threads, "}";
+        return os;
+    }
+    auto ind = HIPPCNTL_CLASS_INFO_INDENT_STR(level);
+    ps << HIPPCNTL_CLASS_INFO(batch_insert_policy_t),
+    ind, "No. threads = ", _n_threads, '\n',
+    ind, ps.info_of(static_cast<const insert_policy_t &>(*this), 
+        fmt_cntl, level+1);
+    return os;
+}
+
+_HIPP_TEMPRET
+n_threads() const noexcept -> int {
+    return _n_threads;
+}
+
+_HIPP_TEMPRET
+set_n_threads(int n_threads) noexcept -> batch_insert_policy_t & {
+    _n_threads = n_threads;
+    return *this;
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
+
 #define _HIPP_TEMPHD template<typename KDPointT, typename IndexT>
 #define _HIPP_TEMPARG <KDPointT, IndexT>
 #define _HIPP_TEMPCLS _InsertableBallTree \
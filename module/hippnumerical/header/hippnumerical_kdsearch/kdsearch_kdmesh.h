@@ -57,7 +57,12 @@ public:
     using construct_policy_t    = typename impl_t::construct_policy_t;
     using rect_query_policy_t   = typename impl_t::rect_query_policy_t;
     using sphere_query_policy_t = typename impl_t::sphere_query_policy_t;
+    using batch_query_policy_t  = typename impl_t::batch_query_policy_t;
     using idx_pair_t            = typename impl_t::idx_pair_t;
+    using stencil_t             = typename impl_t::stencil_t;
+    using fof_policy_t          = typename impl_t::fof_policy_t;
+    using sph_policy_t          = typename impl_t::sph_policy_t;
+    using sph_kernel_t          = typename impl_t::sph_kernel_t;
 
     /**
     Constructors.
@@ -133,6 +138,28 @@ public:
     void shrink_buffer();
     void clear();
 
+    /**
+    Persistence methods. Save the mesh structure (mesh, nodes, cell offsets and in-cell sorting), or load it 
+    to replace the current one, e.g., to skip the construction of a mesh 
+    on the same points in another run.
+
+    save(), load(): use a flat binary file named ``file_name``. The arrays in
+    the file are 64-byte aligned, raw binary copies of those in memory - 
+    loading reads them in place without any conversion.
+
+    save_h5(), load_h5(): use a HDF5 group ``g`` typed ``IO::H5::Group``, 
+    e.g., ``kdt.save_h5(file.create_group("mesh"))``. Each array is a 
+    dataset of bytes in the group. The hippio module (i.e., ``hippio.h``) is 
+    needed only if they are used.
+
+    The mesh must be loaded by a ``KDMesh`` with the same point and index 
+    types. Otherwise, an ``ErrRuntime`` is thrown.
+    */
+    void save(const string &file_name) const;
+    void load(const string &file_name);
+    template<typename H5Group> void save_h5(H5Group g) const;
+    template<typename H5Group> void load_h5(H5Group g);
+
     std::shared_ptr<impl_t> impl() const noexcept;
 
     /**
@@ -155,6 +182,12 @@ public:
     const vector<node_t> & nodes() const noexcept;
     vector<node_t> & nodes() noexcept;
 
+    /**
+    The rank of the cell indexed ``cell_idx`` in the storage order of the 
+    nodes. It is ``cell_idx`` itself for the row-major order.
+    */
+    index_t cell_rank(index_t cell_idx) const noexcept;
+
     /**
     visit_cells_rect(): visit all cells that intersect with ``rect``. 
     @rect: a rectangle instance within which the cells are visited.
@@ -171,6 +204,11 @@ public:
 
     count_nodes_rect(): count the exact number of nodes within ``rect``.
 
+    If the mesh is constructed with a periodic box (see 
+    ``construct_policy_t::set_periodic_box()``), ``rect`` is wrapped into the
+    box. ``visit_cells_rect()`` may then visit a cell once per image of 
+    ``rect``, while each node is visited or counted once.
+
     Thread safety: these three calls do not modify the mesh.
     */
     template<typename Op, typename Policy = rect_query_policy_t>
@@ -196,6 +234,9 @@ public:
     ``op(const node_t &node)`` is called on each node visited.
 
     count_sphere(): count the exact number of nodes within ``sphere``.
+
+    With a periodic box, ``sphere`` is wrapped as ``rect`` above, and its 
+    radius must be no larger than half the box size.
     
     Thread safety: these three calls do not modify the mesh.
     */
@@ -205,6 +246,83 @@ public:
     template<typename Op>
     void visit_nodes_sphere(const sphere_t &sphere, Op op) const;
     index_t count_nodes_sphere(const sphere_t &sphere) const;
+
+    /**
+    Batch queries. Each of the queries are made as if calling the single-query 
+    counterpart. ``batch_policy`` specifies the number of threads and whether 
+    or not to reorder the queries by ``argsort()`` for cache locality. 
+
+    find_nodes_sphere_batch(): find the indices of nodes within each of 
+    ``spheres``. The results are written in the order of the input spheres, 
+    i.e., the results of sphere ``i`` are ``node_ids[displs[i] : displs[i+1]]``.
+    ``displs`` is resized to ``n_spheres + 1``.
+
+    count_nodes_sphere_batch(): count the exact number of nodes within each of
+    ``spheres``. ``counts`` is resized to the number of spheres.
+    */
+    void find_nodes_sphere_batch(ContiguousBuffer<const sphere_t> spheres,
+        vector<index_t> &displs, vector<index_t> &node_ids,
+        const batch_query_policy_t &batch_policy 
+            = batch_query_policy_t()) const;
+    void count_nodes_sphere_batch(ContiguousBuffer<const sphere_t> spheres,
+        vector<index_t> &counts,
+        const batch_query_policy_t &batch_policy 
+            = batch_query_policy_t()) const;
+
+    /**
+    Fixed-radius queries, e.g., many sphere queries with the same radius.
+
+    stencil(): precompute the cell offsets that a sphere of radius ``r`` may 
+    touch, with the bounds of their distances. The stencil is valid until 
+    the mesh is reconstructed or loaded.
+
+    visit_nodes_stencil(), count_nodes_stencil(): the same as 
+    ``visit_nodes_sphere()`` and ``count_nodes_sphere()`` on the sphere 
+    of radius ``st.r()`` centered at ``p``, but the stencil is reused instead
+    of searching for the covering cells.
+
+    find_nodes_stencil_batch(), count_nodes_stencil_batch(): the batch 
+    variants, with the outputs as the sphere ones. The queries are grouped 
+    by cells, and all queries of a cell are processed together against 
+    the stencil. Only ``n_threads`` of ``batch_policy`` is used.
+
+    A query out of the mesh falls back to the sphere query.
+    */
+    stencil_t stencil(float_t r) const;
+    template<typename Op>
+    void visit_nodes_stencil(const stencil_t &st, const point_t &p, 
+        Op op) const;
+    index_t count_nodes_stencil(const stencil_t &st, const point_t &p) const;
+    void find_nodes_stencil_batch(const stencil_t &st, 
+        ContiguousBuffer<const point_t> pts,
+        vector<index_t> &displs, vector<index_t> &node_ids,
+        const batch_query_policy_t &batch_policy 
+            = batch_query_policy_t()) const;
+    void count_nodes_stencil_batch(const stencil_t &st, 
+        ContiguousBuffer<const point_t> pts, vector<index_t> &counts,
+        const batch_query_policy_t &batch_policy 
+            = batch_query_policy_t()) const;
+
+    /**
+    Friends-of-friends (FoF) group finding with linking length ``b``. The 
+    outputs are the same as ``KDTree::fof()``, i.e., ``group_ids[i]`` is the
+    group of node ``i``.
+
+    Each cell is linked with the cells in half of the stencil of radius 
+    ``b``, and the pairs of cells already known to be in the same group 
+    are skipped. The cell size is best not much smaller than ``b``.
+    */
+    index_t fof(float_t b, vector<index_t> &group_ids, 
+        const fof_policy_t &policy = fof_policy_t()) const;
+
+    /**
+    SPH smoothing lengths and densities of the nodes. The inputs and 
+    outputs are the same as ``KDTree::sph_density()``. The neighbors are 
+    found by sphere queries on the mesh, which are efficient if the cell 
+    size is comparable to the smoothing lengths.
+    */
+    index_t sph_density(vector<float_t> &h, vector<float_t> &rho, 
+        const sph_policy_t &policy = sph_policy_t()) const;
 protected:
     std::shared_ptr<impl_t> _impl;
 
@@ -268,6 +386,28 @@ clear() -> void {
     _impl->clear();
 }
 
+_HIPP_TEMPRET
+save(const string &file_name) const -> void {
+    _impl->save(file_name);
+}
+
+_HIPP_TEMPRET
+load(const string &file_name) -> void {
+    _impl->load(file_name);
+}
+
+_HIPP_TEMPHD
+template<typename H5Group>
+void _HIPP_TEMPCLS::save_h5(H5Group g) const {
+    _impl->save_h5(std::move(g));
+}
+
+_HIPP_TEMPHD
+template<typename H5Group>
+void _HIPP_TEMPCLS::load_h5(H5Group g) {
+    _impl->load_h5(std::move(g));
+}
+
 _HIPP_TEMPRET
 impl() const noexcept -> std::shared_ptr<impl_t> {
     return _impl;
@@ -310,6 +450,11 @@ nodes() noexcept -> vector<node_t> & {
     return _impl->nodes();
 }
 
+_HIPP_TEMPRET
+cell_rank(index_t cell_idx) const noexcept -> index_t {
+    return _impl->cell_rank(cell_idx);
+}
+
 _HIPP_TEMPHD
 template<typename Op, typename Policy>
 void _HIPP_TEMPCLS::visit_cells_rect(const rect_t &rect, Op op, 
@@ -322,18 +467,8 @@ void _HIPP_TEMPCLS::visit_cells_rect(const rect_t &rect, Op op,
 _HIPP_TEMPHD
 template<typename Op>
 void _HIPP_TEMPCLS::visit_nodes_rect(const rect_t &rect, Op op) const {
-    auto op_on_cell = [&op, &rect, this](index_t cell_idx, int bound) {
-        auto [p, n] = get_nodes_in_cell(cell_idx);
-        if( bound ) {
-            for(index_t i=0; i<n; ++i) op(p[i]);
-            return;
-        }
-        for(index_t i=0; i<n; ++i){
-            auto &node = p[i];
-            if( rect.contains(node) ) op(node);
-        }
-    };
-    _impl->template visit_rect(rect, op_on_cell);
+    const auto &nodes = _impl->nodes();
+    _impl->visit_nodes_rect(rect, [&op, &nodes](index_t i) { op(nodes[i]); });
 }
 
 _HIPP_TEMPRET
@@ -353,18 +488,9 @@ void _HIPP_TEMPCLS::visit_cells_sphere(const sphere_t &sphere, Op op,
 _HIPP_TEMPHD
 template<typename Op>
 void _HIPP_TEMPCLS::visit_nodes_sphere(const sphere_t &sphere, Op op) const {
-    auto op_on_cell = [&op, &sphere, this](index_t cell_idx, int bound) {
-        auto [p, n] = get_nodes_in_cell(cell_idx);
-        if( bound ) {
-            for(index_t i=0; i<n; ++i) op(p[i]);
-            return;
-        }
-        for(index_t i=0; i<n; ++i){
-            auto &node = p[i];
-            if( sphere.contains(node) ) op(node);
-        }
-    };
-    _impl->template visit_sphere(sphere, op_on_cell);
+    const auto &nodes = _impl->nodes();
+    _impl->visit_nodes_sphere(sphere, 
+        [&op, &nodes](index_t i) { op(nodes[i]); });
 }
 
 _HIPP_TEMPRET
@@ -373,6 +499,75 @@ count_nodes_sphere(const sphere_t &sphere) const -> index_t {
 
 }
 
+_HIPP_TEMPRET
+find_nodes_sphere_batch(ContiguousBuffer<const sphere_t> spheres,
+    vector<index_t> &displs, vector<index_t> &node_ids,
+    const batch_query_policy_t &batch_policy) const -> void
+{
+    _impl->visit_sphere_batch(spheres, displs, node_ids, batch_policy);
+}
+
+_HIPP_TEMPRET
+count_nodes_sphere_batch(ContiguousBuffer<const sphere_t> spheres,
+    vector<index_t> &counts, 
+    const batch_query_policy_t &batch_policy) const -> void
+{
+    _impl->count_sphere_batch(spheres, counts, batch_policy);
+}
+
+_HIPP_TEMPRET
+stencil(float_t r) const -> stencil_t {
+    return _impl->stencil(r);
+}
+
+_HIPP_TEMPHD
+template<typename Op>
+void _HIPP_TEMPCLS::visit_nodes_stencil(const stencil_t &st, 
+    const point_t &p, Op op) const 
+{
+    const auto &nodes = _impl->nodes();
+    _impl->visit_nodes_stencil(st, p, 
+        [&op, &nodes](index_t i) { op(nodes[i]); });
+}
+
+_HIPP_TEMPRET
+count_nodes_stencil(const stencil_t &st, const point_t &p) const 
+-> index_t 
+{
+    return _impl->count_stencil(st, p);
+}
+
+_HIPP_TEMPRET
+find_nodes_stencil_batch(const stencil_t &st, 
+    ContiguousBuffer<const point_t> pts,
+    vector<index_t> &displs, vector<index_t> &node_ids,
+    const batch_query_policy_t &batch_policy) const -> void
+{
+    _impl->visit_stencil_batch(st, pts, displs, node_ids, batch_policy);
+}
+
+_HIPP_TEMPRET
+count_nodes_stencil_batch(const stencil_t &st, 
+    ContiguousBuffer<const point_t> pts, vector<index_t> &counts,
+    const batch_query_policy_t &batch_policy) const -> void
+{
+    _impl->count_stencil_batch(st, pts, counts, batch_policy);
+}
+
+_HIPP_TEMPRET
+fof(float_t b, vector<index_t> &group_ids, const fof_policy_t &policy) const
+-> index_t
+{
+    return _impl->fof(b, group_ids, policy);
+}
+
+_HIPP_TEMPRET
+sph_density(vector<float_t> &h, vector<float_t> &rho, 
+    const sph_policy_t &policy) const -> index_t
+{
+    return _impl->sph_density(h, rho, policy);
+}
+
 
 #undef _HIPP_TEMPHD
 #undef _HIPP_TEMPARG
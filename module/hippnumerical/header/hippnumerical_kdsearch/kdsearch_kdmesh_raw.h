@@ -7,6 +7,12 @@ create: Yangyao CHEN, 2022/02/14
 #define _HIPPNUMERICAL_KDSEARCH_KDMESH_RAW_H_
 
 #include "kdsearch_base.h"
+#include "kdsearch_batch_query.h"
+#include "kdsearch_simd.h"
+#include "kdsearch_archive.h"
+#include "kdsearch_periodic.h"
+#include "kdsearch_fof.h"
+#include "kdsearch_sph.h"
 
 namespace HIPP::NUMERICAL::_KDSEARCH {
 
@@ -29,11 +35,17 @@ public:
     using v_index_t = typename mesh_t::v_index_t;
     using pos_t     = typename point_t::pos_t;
     using sphere_t  = GEOMETRY::Sphere<float_t, DIM>;
+    using periodic_box_t = _PeriodicBox<float_t, DIM>;
 
     struct construct_policy_t;
     struct rect_query_policy_t;
     struct sphere_query_policy_t;
     struct idx_pair_t;
+    class stencil_t;
+    using batch_query_policy_t = _BatchQueryPolicy;
+    using fof_policy_t = _FoFPolicy;
+    using sph_policy_t = _SPHPolicy<float_t>;
+    using sph_kernel_t = _SPHKernel;
 
     _KDMesh() noexcept;
 
@@ -60,15 +72,15 @@ public:
 
     /**
     Find the indices into points ``pts`` so that they are sorted according 
-    to the cell rank. The order of points within a cell is defined by the policy 
-    when constructing the mesh.
+    to the storage order of the cells (see ``cell_rank()``). The order of 
+    points within a cell is defined by the policy when constructing the mesh.
     
     ``PointT`` must be a derived type of ``point_t``.
     
     On exit ``idx_pairs`` is resized to the number of points in ``pts`` that 
     is within the mesh. For each item ``I`` of ``idx_pairs``, ``I.idx_in`` 
-    is the index into ``pts`` and ``I.idx_cell`` is the cell rank that contains
-    this point.
+    is the index into ``pts`` and ``I.idx_cell`` is the index of the cell 
+    that contains this point.
     */
     template<typename PointT>
     void argsort(ContiguousBuffer<const PointT> pts, 
@@ -88,6 +100,22 @@ public:
     void shrink_buffer();
     void clear();
 
+    /**
+    Save the mesh structure (mesh, nodes, cell offsets and in-cell sorting),
+    or load it to replace the current one.
+
+    save(), load(): use a flat binary file named ``file_name`` (see 
+    ``_FileArchive`` for the format).
+    save_h5(), load_h5(): use a HDF5 group ``g`` typed ``IO::H5::Group``.
+
+    The mesh must be loaded by a ``_KDMesh`` with the same point and index 
+    types. Otherwise, an ``ErrRuntime`` is thrown.
+    */
+    void save(const string &file_name) const;
+    void load(const string &file_name);
+    template<typename H5Group> void save_h5(H5Group g) const;
+    template<typename H5Group> void load_h5(H5Group g);
+
     /**
     Find the contiguous buffer containing all nodes within the cell indexed 
     ``cell_idx``. Return the starting pointer of that buffer and the number 
@@ -100,6 +128,11 @@ public:
     Getters: return references to construct_policy, mesh, and nodes of the 
     instance, respectively.
     These internal states shall not be modified to avoid breaking consistency.
+
+    cell_rank(): the rank of the cell indexed ``cell_idx`` in the storage 
+    order, i.e., the nodes of cells ``i`` and ``j`` are adjacent in memory 
+    if their ranks are adjacent. The rank is ``cell_idx`` for the row-major 
+    order (see ``construct_policy_t::set_cell_order()``).
     */
     const construct_policy_t & construct_policy() const noexcept;
     construct_policy_t & construct_policy() noexcept;
@@ -107,6 +140,7 @@ public:
     mesh_t & mesh() noexcept;
     const vector<node_t> & nodes() const noexcept;
     vector<node_t> & nodes() noexcept;
+    index_t cell_rank(index_t cell_idx) const noexcept;
     
     /**
     visit_rect(): visit all cells that intersect with ``rect``. 
@@ -122,6 +156,10 @@ public:
 
     See the API-ref of ``rect_query_policy_t`` for the details on query policy.
 
+    With a periodic box, ``rect`` is wrapped into the box and ``op`` is 
+    called on the cells of each image of it. A cell may then be visited once 
+    per image, and ``bound`` refers to that image.
+
     Thread safety: these two calls do not modify the mesh.
     */
     template<typename Op, typename Policy = rect_query_policy_t>
@@ -144,18 +182,107 @@ public:
     See the API-ref of ``sphere_query_policy_t`` for the details on query 
     policy.
 
+    With a periodic box, the radius must be no larger than half the box size.
+    ``sphere`` is wrapped into the box, and the cells are visited as in 
+    ``visit_rect()``.
+
     Thread safety: these two calls do not modify the mesh.
     */
     template<typename Op, typename Policy = sphere_query_policy_t>
     void visit_sphere(const sphere_t &sphere, Op op, 
         Policy &&policy = Policy()) const;
     index_t count_sphere(const sphere_t &sphere) const;
+
+    /**
+    visit_nodes_rect(), visit_nodes_sphere(): call ``op(i)`` on each node 
+    indexed ``i`` within ``rect`` or ``sphere``. Each node is visited once,
+    also with a periodic box.
+    */
+    template<typename Op>
+    void visit_nodes_rect(const rect_t &rect, Op op) const;
+    template<typename Op>
+    void visit_nodes_sphere(const sphere_t &sphere, Op op) const;
+
+    /**
+    Batch queries. 
+    visit_sphere_batch(): find the indices of nodes within each of the 
+    ``spheres``. The results of sphere ``i`` are in 
+    ``node_ids[displs[i] : displs[i+1]]``.
+    count_sphere_batch(): count the exact number of nodes within each of the 
+    ``spheres``.
+    */
+    void visit_sphere_batch(ContiguousBuffer<const sphere_t> spheres,
+        vector<index_t> &displs, vector<index_t> &node_ids,
+        const batch_query_policy_t &batch_policy 
+            = batch_query_policy_t()) const;
+    void count_sphere_batch(ContiguousBuffer<const sphere_t> spheres,
+        vector<index_t> &counts,
+        const batch_query_policy_t &batch_policy 
+            = batch_query_policy_t()) const;
+
+    /**
+    Fixed-radius queries. 
+    stencil(): precompute the offsets of the cells that a sphere of radius 
+    ``r`` centered in any cell may touch, with the bounds of their distances.
+    The stencil is valid until the mesh is reconstructed or loaded.
+    
+    visit_nodes_stencil(), count_stencil(): the same as 
+    ``visit_nodes_sphere()`` and ``count_sphere()`` on the sphere of 
+    radius ``st.r()`` centered at ``p``. The covering cells are not searched 
+    - each cell of the stencil is tested against ``p`` by ``O(DIM)`` 
+    operations.
+
+    visit_stencil_batch(), count_stencil_batch(): the batch variants, with 
+    the results as in ``visit_sphere_batch()`` and ``count_sphere_batch()``.
+    The queries are grouped by their cells, and each group is processed 
+    against the stencil together, i.e., the nodes of a neighboring cell are 
+    loaded once for all queries in the group. The queries are always sorted 
+    in this way, i.e., ``sort_queries`` of the policy has no effect.
+
+    A query out of the mesh, or a periodic mesh with less cells than the 
+    stencil extent, falls back to the sphere query. If ``st`` is made by 
+    another mesh (with different cell sizes), ``ErrLogic`` is thrown.
+    */
+    stencil_t stencil(float_t r) const;
+    template<typename Op>
+    void visit_nodes_stencil(const stencil_t &st, const point_t &p, 
+        Op op) const;
+    index_t count_stencil(const stencil_t &st, const point_t &p) const;
+    void visit_stencil_batch(const stencil_t &st, 
+        ContiguousBuffer<const point_t> pts,
+        vector<index_t> &displs, vector<index_t> &node_ids,
+        const batch_query_policy_t &batch_policy 
+            = batch_query_policy_t()) const;
+    void count_stencil_batch(const stencil_t &st, 
+        ContiguousBuffer<const point_t> pts, vector<index_t> &counts,
+        const batch_query_policy_t &batch_policy 
+            = batch_query_policy_t()) const;
+
+    /**
+    Friends-of-friends groups with linking length ``b``, with the same 
+    outputs as ``_KDTree::fof()``, for the nodes of the mesh.
+
+    The pairs in each cell are linked first, and then those of each cell 
+    with the cells in half of the stencil of radius ``b``. A pair of cells 
+    already known to be in the same group is skipped.
+    */
+    index_t fof(float_t b, vector<index_t> &group_ids, 
+        const fof_policy_t &policy = fof_policy_t()) const;
+
+    /**
+    SPH smoothing lengths and densities of the nodes, with the same inputs 
+    and outputs as ``_KDTree::sph_density()``. The neighbors are found by 
+    ``visit_nodes_sphere()``.
+    */
+    index_t sph_density(vector<float_t> &h, vector<float_t> &rho, 
+        const sph_policy_t &policy = sph_policy_t()) const;
 protected:
     construct_policy_t _construct_policy;
     
     mesh_t _mesh;
     vector<node_t> _nodes;
     vector<index_t> _displs;
+    vector<index_t> _cell_ranks;
 
     /**
     Given a buffer of points each typed kdpoint_t, construct the meshed 
@@ -163,6 +290,24 @@ protected:
     */
     struct _Impl_construct;
 
+    /**
+    _set_cell_ranks(): find the rank of each cell in the storage order 
+    given by the policy. ``_cell_ranks`` is left empty for the row-major 
+    order.
+    
+    _bucket_sort(): two-pass counting sort of the points into the cells by
+    ``n_threads`` threads. On exit, the points in the cell at rank ``r`` are
+    ``p_pts[order[i]]`` for ``i`` in ``[displs[r], displs[r+1])``. Points 
+    outside the mesh are dropped.
+    */
+    void _set_cell_ranks();
+    template<typename PointT>
+    void _bucket_sort(const PointT *p_pts, size_t n_pts, int n_threads,
+        vector<index_t> &order, vector<index_t> &displs) const;
+
+    template<typename Archive> void _save(Archive &ar) const;
+    template<typename Archive> void _load(Archive &ar);
+
     /**
     Visit cells in row-major order within a rectangle or a sphere. 
     @Policy: see API-ref of ``rect_query_policy_t`` and 
@@ -170,6 +315,49 @@ protected:
     */
     template<typename Op, typename Policy> struct _Impl_visit_rect;
     template<typename Op, typename Policy> struct _Impl_visit_sphere;
+
+    /**
+    Call ``op(img)`` on each periodic image of the query region that may 
+    contain a node, or on the region itself if the mesh is not periodic.
+    */
+    template<typename Op> void _visit_rect_images(const rect_t &rect, 
+        Op &&op) const;
+    template<typename Op> void _visit_sphere_images(const sphere_t &sphere, 
+        Op &&op) const;
+
+    /**
+    Stencil queries.
+    _stencil_home(): check ``st`` against the mesh, and find the cell of 
+    ``p``, which is wrapped into the periodic box. Return false if the 
+    stencil cannot be applied there.
+    _visit_stencil_cells(): call ``op(i, b, e, shift)`` on each stencil 
+    offset ``i`` whose cell is in the mesh, where ``[b, e)`` is the range of
+    nodes in that cell and ``shift`` is the periodic shift of that cell.
+    _stencil_r_sq(): the minimal and maximal squared distances from a point
+    at ``u`` relative to the low corner of its cell to the cell of offset 
+    ``i``.
+    */
+    bool _stencil_home(const stencil_t &st, pos_t &p, 
+        v_index_t &home) const;
+    template<typename Op>
+    void _visit_stencil_cells(const stencil_t &st, const v_index_t &home, 
+        Op &&op) const;
+    std::pair<float_t, float_t> _stencil_r_sq(const stencil_t &st, 
+        size_t i, const pos_t &u) const noexcept;
+    pos_t _cell_low(const v_index_t &v_idx) const noexcept;
+
+    /**
+    Group the queries by their cells. Call ``cell_op(i_th, home, qs, n_q)``
+    on each group, where ``qs[0:n_q]`` are the indices of the queries in 
+    the cell ``home``, and ``single_op(i_th, i_q)`` on each query that 
+    cannot use the stencil.
+    */
+    void _link_fof(float_t b, _UnionFind<index_t> &uf, int n_threads) const;
+
+    template<typename CellOp, typename SingleOp>
+    void _stencil_batch(const stencil_t &st, const point_t *p_pts, 
+        index_t n_pts, int n_threads, CellOp &&cell_op, 
+        SingleOp &&single_op) const;
 };
 
 template<typename KDPointT, typename IndexT>
@@ -179,6 +367,7 @@ ostream & operator<< (ostream &os,
 template<typename KDPointT, typename IndexT>
 struct _KDMesh<KDPointT, IndexT>::construct_policy_t {
     enum class in_cell_sort_t : int { NONE, ALONG_AXIS };
+    enum class cell_order_t : int { ROW_MAJOR, MORTON };
     
     static constexpr float_t 
         DFLT_MARGIN_REL     = 1.0e-3,
@@ -189,6 +378,10 @@ struct _KDMesh<KDPointT, IndexT>::construct_policy_t {
         DFLT_IN_CELL_SORT   = in_cell_sort_t::NONE;
     static constexpr int 
         DFLT_DIM_SORTED     = DIM-1;
+    static constexpr cell_order_t
+        DFLT_CELL_ORDER     = cell_order_t::ROW_MAJOR;
+    static constexpr int 
+        DFLT_N_THREADS      = 1;
 
     construct_policy_t() noexcept;
 
@@ -213,6 +406,34 @@ struct _KDMesh<KDPointT, IndexT>::construct_policy_t {
 
     int dim_sorted() const noexcept;
     construct_policy_t & set_dim_sorted(int dim) noexcept;
+
+    /**
+    Storage order of the cells.
+    ROW_MAJOR: the order of the cell index, i.e., the last axis varies the 
+    fastest.
+    MORTON: the Z-order of the cell coordinates, so that the cells near in
+    all axes are also near in memory.
+    */
+    cell_order_t cell_order() const noexcept;
+    construct_policy_t & set_cell_order(cell_order_t cell_order) noexcept;
+
+    /**
+    Number of threads used to bucket the points into cells. Each thread 
+    holds a histogram of the cells, i.e., ``n_threads * total_n_cell`` 
+    indices of extra storage.
+    */
+    int n_threads() const noexcept;
+    construct_policy_t & set_n_threads(int n_threads) noexcept;
+
+    /**
+    Periodic boundary. Along each axis ``i`` with ``box_size[i] > 0``, the 
+    mesh covers exactly ``[0, box_size[i])`` (overriding the bound and 
+    margin), and all points must be in it. Queries wrap the regions into the
+    box.
+    */
+    const periodic_box_t & periodic_box() const noexcept;
+    construct_policy_t & set_periodic_box(float_t box_size) noexcept;
+    construct_policy_t & set_periodic_box(const pos_t &box_size) noexcept;
 private:
     friend class _KDMesh;
 
@@ -223,6 +444,11 @@ private:
 
     in_cell_sort_t _in_cell_sort;
     int _dim_sorted;
+
+    cell_order_t _cell_order;
+    int _n_threads;
+
+    periodic_box_t _periodic_box;
 };
 template<typename KDPointT, typename IndexT>
 struct _KDMesh<KDPointT, IndexT>::idx_pair_t { 
@@ -234,6 +460,45 @@ struct _KDMesh<KDPointT, IndexT>::idx_pair_t {
     }
 };
 
+/**
+Cell offsets touched by a fixed-radius sphere query, made by 
+``_KDMesh::stencil()``.
+
+r(): the radius.
+size(): the number of offsets. 
+offset(i): the offset of the i-th cell relative to the cell of the query.
+r_sq_min(i), r_sq_max(i): the bounds of the squared distances between the 
+cell of the query and the i-th cell, i.e., for any pair of points in these 
+two cells. ``r_sq_min(i) <= r^2`` for all offsets.
+extent(): the maximal absolute offset along each axis.
+*/
+template<typename KDPointT, typename IndexT>
+class _KDMesh<KDPointT, IndexT>::stencil_t {
+public:
+    using rect_size_t = typename mesh_t::rect_size_t;
+
+    stencil_t() noexcept;
+
+    ostream & info(ostream &os = cout, int fmt_cntl = 0, int level = 0) const;
+    friend ostream & operator<< (ostream &os, 
+        const stencil_t &st) { return st.info(os); }
+
+    float_t r() const noexcept;
+    size_t size() const noexcept;
+    const v_index_t & offset(size_t i) const noexcept;
+    float_t r_sq_min(size_t i) const noexcept;
+    float_t r_sq_max(size_t i) const noexcept;
+    const v_index_t & extent() const noexcept;
+private:
+    friend class _KDMesh;
+
+    float_t _r;
+    rect_size_t _cell_size;
+    v_index_t _extent;
+    vector<v_index_t> _offsets;
+    vector<std::pair<float_t, float_t> > _r_sq_bounds;
+};
+
 template<typename KDPointT, typename IndexT>
 struct _KDMesh<KDPointT, IndexT>::rect_query_policy_t {
 
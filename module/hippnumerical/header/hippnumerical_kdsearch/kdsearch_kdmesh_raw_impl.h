@@ -23,14 +23,15 @@ _KDMesh() noexcept {}
 _HIPP_TEMPNORET
 _KDMesh(const _KDMesh &kdm) 
 : _construct_policy(kdm._construct_policy), 
-_mesh(kdm._mesh), _nodes(kdm._nodes), _displs(kdm._displs)
+_mesh(kdm._mesh), _nodes(kdm._nodes), _displs(kdm._displs),
+_cell_ranks(kdm._cell_ranks)
 {}
 
 _HIPP_TEMPNORET
 _KDMesh(_KDMesh &&kdm) noexcept 
 : _construct_policy(kdm._construct_policy), 
  _mesh(std::move(kdm._mesh)), _nodes(std::move(kdm._nodes)),
- _displs(std::move(kdm._displs))
+ _displs(std::move(kdm._displs)), _cell_ranks(std::move(kdm._cell_ranks))
 {}
 
 _HIPP_TEMPRET
@@ -40,6 +41,7 @@ operator=(const _KDMesh &kdm) -> _KDMesh & {
         _mesh = kdm._mesh;
         _nodes = kdm._nodes;
         _displs = kdm._displs;
+        _cell_ranks = kdm._cell_ranks;
     }
     return *this;
 }
@@ -51,6 +53,7 @@ operator=(_KDMesh &&kdm) noexcept -> _KDMesh & {
         _mesh = std::move(kdm._mesh);
         _nodes = std::move(kdm._nodes);
         _displs = std::move(kdm._displs);
+        _cell_ranks = std::move(kdm._cell_ranks);
     }
     return *this;
 }
@@ -63,7 +66,7 @@ info(ostream &os, int fmt_cntl, int level) const -> ostream &  {
     PStream ps(os);
     size_t n_nodes = _nodes.size();
     size_t buf_sz = _nodes.capacity() * sizeof(kd_point_t)
-        + _displs.capacity() * sizeof(index_t);
+        + (_displs.capacity() + _cell_ranks.capacity()) * sizeof(index_t);
     if( fmt_cntl < 1 ) {
         ps << HIPPCNTL_CLASS_INFO_INLINE(_KDMesh), "{", 
             _mesh, ", no. points=", n_nodes, ", buf size=", 
@@ -94,6 +97,7 @@ _Impl_construct(_KDMesh &_dst, const kd_point_t *_p_pts, size_t _n_pts)
 void operator()() const {
     _verify_args();
     _set_mesh();
+    dst._set_cell_ranks();
     _assign_points();
 }
 
@@ -121,6 +125,10 @@ void _verify_args() const {
     if( sort_ax && (d < 0 || d >= DIM) )
         ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB, 
             "Cannot sort points along axis ", d, " (DIM=", DIM, ")");
+
+    if( pl.n_threads() <= 0 )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB, 
+            "Invalid no. of threads ", pl.n_threads());
 }
 
 void _set_mesh() const noexcept {
@@ -130,6 +138,14 @@ void _set_mesh() const noexcept {
         auto [low, high] = _find_bound();
         rect = rect_t(low, high);
     }
+    if( const auto &box = pl.periodic_box(); box.is_periodic() ) {
+        pos_t low = rect.low().pos(), high = rect.high().pos();
+        for(int i=0; i<DIM; ++i) {
+            if( box.size()[i] <= 0 ) continue;
+            low[i] = 0; high[i] = box.size()[i];
+        }
+        rect = rect_t(low, high);
+    }
     
     cells_t cells = pl.n_cell();
 
@@ -154,34 +170,16 @@ std::pair<point_t, point_t> _find_bound() const noexcept {
 }
 
 void _assign_points() const {
-    vector<idx_pair_t> i_prs;
-    dst.argsort(ContiguousBuffer{p_pts, n_pts}, i_prs);
+    vector<index_t> order;
+    dst._bucket_sort(p_pts, n_pts, pl.n_threads(), order, dst._displs);
     
     auto &nodes = dst._nodes;
-    const size_t n_pts_used = i_prs.size();
+    const index_t n_pts_used = order.size();
     nodes.resize(n_pts_used);
-    for(size_t i=0; i<n_pts_used; ++i)
-        nodes[i] = p_pts[ i_prs[i].idx_in ];
-
-    _assign_displs(i_prs);
-}
-
-void _assign_displs(const vector<idx_pair_t> &i_prs) const {
-    const auto &mesh = dst._mesh;
-    auto &displs = dst._displs;
-    
-    const index_t total_n_cell = mesh.total_n_cell();
-    displs.assign(total_n_cell+1, 0);
-
-    for(const auto &i_pr: i_prs)
-        ++ displs[ i_pr.idx_cell ];
-    
-    index_t cur_displ = 0;
-    for(auto &d: displs){
-        index_t next_displ = cur_displ + d;
-        d = cur_displ;
-        cur_displ = next_displ;
-    }
+    _parallel_for(pl.n_threads(), n_pts_used, 
+        [&](int, index_t b, index_t e) {
+            for(index_t i=b; i<e; ++i) nodes[i] = p_pts[ order[i] ];
+        });
 }
 
 };
@@ -201,48 +199,209 @@ void _HIPP_TEMPCLS::argsort(ContiguousBuffer<const PointT> pts,
     vector<idx_pair_t> &idx_pairs) const
 {
     auto [p_pts, n_pts] = pts;
-    idx_pairs.clear();
-    idx_pairs.reserve(n_pts);
-    
-    for(size_t i=0; i<n_pts; ++i){
-        auto v_idx = _mesh.v_idx_of(p_pts[i]);
-        if( _mesh.v_idx_is_bound(v_idx) )
-            idx_pairs.push_back({index_t(i), _mesh.v_idx2idx(v_idx)});
+    vector<index_t> order, displs;
+    _bucket_sort(p_pts, n_pts, _construct_policy.n_threads(), order, displs);
+
+    const index_t n_cells = _mesh.total_n_cell();
+    vector<index_t> cell_ids(n_cells);
+    for(index_t i=0; i<n_cells; ++i) cell_ids[cell_rank(i)] = i;
+
+    idx_pairs.resize(order.size());
+    for(index_t r=0; r<n_cells; ++r)
+        for(index_t i=displs[r]; i<displs[r+1]; ++i)
+            idx_pairs[i] = {order[i], cell_ids[r]};
+}
+
+_HIPP_TEMPRET
+_set_cell_ranks() -> void {
+    _cell_ranks.clear();
+    using order_t = typename construct_policy_t::cell_order_t;
+    if( _construct_policy._cell_order == order_t::ROW_MAJOR ) return;
+
+    const auto &n_cell = _mesh.n_cell();
+    int n_bits = 0;
+    for(int d=0; d<DIM; ++d)
+        while( (index_t(1) << n_bits) < n_cell[d] ) ++n_bits;
+    if( n_bits * DIM > 64 )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB, 
+            "  ... too many cells ", n_cell, " for Morton order\n");
+
+    // Interleave the bits of the cell coordinates. Axis 0 takes the most
+    // significant bit of each group, as in the row-major order.
+    const index_t n_cells = _mesh.total_n_cell();
+    vector<std::pair<std::uint64_t, index_t> > keys(n_cells);
+    for(index_t i=0; i<n_cells; ++i) {
+        const auto v_idx = _mesh.idx2v_idx(i);
+        std::uint64_t key = 0;
+        for(int b=0; b<n_bits; ++b)
+        for(int d=0; d<DIM; ++d) {
+            const std::uint64_t bit = (v_idx[d] >> b) & 1;
+            key |= bit << (b*DIM + DIM-1-d);
+        }
+        keys[i] = {key, i};
+    }
+    std::sort(keys.begin(), keys.end());
+    _cell_ranks.resize(n_cells);
+    for(index_t r=0; r<n_cells; ++r) _cell_ranks[keys[r].second] = r;
+}
+
+_HIPP_TEMPHD
+template<typename PointT>
+void _HIPP_TEMPCLS::_bucket_sort(const PointT *p_pts, size_t n_pts, 
+    int n_threads, vector<index_t> &order, vector<index_t> &displs) const
+{
+    const index_t n_cells = _mesh.total_n_cell(), 
+        n = static_cast<index_t>(n_pts);
+
+    // Pass 1: the cell rank of each point and the per-thread histograms.
+    vector<index_t> ranks(n);
+    vector<vector<index_t> > hists(n_threads);
+    _parallel_for(n_threads, n, [&](int i_th, index_t b, index_t e) {
+        auto &hist = hists[i_th];
+        hist.assign(n_cells, 0);
+        for(index_t i=b; i<e; ++i) {
+            const auto v_idx = _mesh.v_idx_of(p_pts[i]);
+            if( !_mesh.v_idx_is_bound(v_idx) ) {
+                ranks[i] = -1; continue;
+            }
+            const index_t r = cell_rank(_mesh.v_idx2idx(v_idx));
+            ranks[i] = r; ++hist[r];
+        }
+    });
+
+    // Offsets of the cells, and of each thread in the cells. Points of a 
+    // cell keep their input order.
+    displs.resize(n_cells+1);
+    index_t cur = 0;
+    for(index_t r=0; r<n_cells; ++r) {
+        displs[r] = cur;
+        for(auto &hist: hists) {
+            if( hist.empty() ) continue;
+            const index_t cnt = hist[r];
+            hist[r] = cur; cur += cnt;
+        }
     }
+    displs[n_cells] = cur;
+
+    // Pass 2: scatter, with the same chunks as pass 1.
+    order.resize(cur);
+    _parallel_for(n_threads, n, [&](int i_th, index_t b, index_t e) {
+        auto &hist = hists[i_th];
+        for(index_t i=b; i<e; ++i)
+            if( const index_t r = ranks[i]; r >= 0 ) order[hist[r]++] = i;
+    });
 
     const auto &pl = _construct_policy;
     using sort_t = typename construct_policy_t::in_cell_sort_t;
-    if( pl._in_cell_sort == sort_t::NONE ) {
-        std::sort(idx_pairs.begin(), idx_pairs.end());
-    } else {
-        const int d = pl._dim_sorted;
-        auto sort_f = [p_pts = p_pts, d](const idx_pair_t &l, 
-            const idx_pair_t &r) -> bool 
-        {
-            if( l.idx_cell == r.idx_cell ) 
-                return p_pts[l.idx_in].pos()[d] < p_pts[r.idx_in].pos()[d];
-            return l < r;
-        };
-        std::sort(idx_pairs.begin(), idx_pairs.end(), sort_f);
-    }
+    if( pl._in_cell_sort == sort_t::NONE ) return;
+    const int d = pl._dim_sorted;
+    _parallel_for(n_threads, n_cells, [&](int, index_t b, index_t e) {
+        for(index_t r=b; r<e; ++r)
+            std::sort(order.begin()+displs[r], order.begin()+displs[r+1],
+                [&](index_t i, index_t j) { 
+                    return p_pts[i].pos()[d] < p_pts[j].pos()[d]; });
+    });
 }
 
 _HIPP_TEMPRET
 shrink_buffer() -> void {
     _nodes.shrink_to_fit();
     _displs.shrink_to_fit();
+    _cell_ranks.shrink_to_fit();
 }
 
 _HIPP_TEMPRET
 clear() -> void {
     _nodes.clear();
     _displs.clear();
+    _cell_ranks.clear();
+}
+
+_HIPP_TEMPRET
+save(const string &file_name) const -> void {
+    _FileArchive ar(file_name, true);
+    _save(ar);
+}
+
+_HIPP_TEMPRET
+load(const string &file_name) -> void {
+    _FileArchive ar(file_name, false);
+    _load(ar);
+}
+
+_HIPP_TEMPHD
+template<typename H5Group>
+void _HIPP_TEMPCLS::save_h5(H5Group g) const {
+    _H5Archive<H5Group> ar(std::move(g));
+    _save(ar);
+}
+
+_HIPP_TEMPHD
+template<typename H5Group>
+void _HIPP_TEMPCLS::load_h5(H5Group g) {
+    _H5Archive<H5Group> ar(std::move(g));
+    _load(ar);
+}
+
+_HIPP_TEMPHD
+template<typename Archive>
+void _HIPP_TEMPCLS::_save(Archive &ar) const {
+    const auto &pl = _construct_policy;
+    const int in_cell_sort[2] = {static_cast<int>(pl._in_cell_sort), 
+        pl._dim_sorted};
+    const int cell_order = static_cast<int>(pl._cell_order);
+
+    _put_layout<node_t, index_t>(ar, "KDMesh");
+    ar.put("rect", &_mesh.rect(), 1);
+    ar.put("n_cell", &_mesh.n_cell(), 1);
+    ar.put("in_cell_sort", in_cell_sort, 2);
+    ar.put("cell_order", &cell_order, 1);
+    ar.put("periodic_box", &pl._periodic_box.size(), 1);
+    ar.put("nodes", _nodes.data(), _nodes.size());
+    ar.put("displs", _displs.data(), _displs.size());
+}
+
+_HIPP_TEMPHD
+template<typename Archive>
+void _HIPP_TEMPCLS::_load(Archive &ar) {
+    _check_layout<node_t, index_t>(ar, "KDMesh");
+    rect_t rect;
+    n_cell_t n_cell;
+    int in_cell_sort[2], cell_order;
+    pos_t box_size;
+    vector<node_t> nodes;
+    vector<index_t> displs;
+    ar.get("rect", &rect, 1);
+    ar.get("n_cell", &n_cell, 1);
+    ar.get("in_cell_sort", in_cell_sort, 2);
+    ar.get("cell_order", &cell_order, 1);
+    ar.get("periodic_box", &box_size, 1);
+    ar.get("nodes", nodes);
+    ar.get("displs", displs);
+    const size_t n_cells = cells_t(n_cell).total_n_cell();
+    if( !displs.empty() && displs.size() != n_cells + 1 )
+        ErrRuntime::throw_(ErrRuntime::eDEFAULT, emFLPFB, 
+            "  ... ", displs.size(), " cell offsets found for n_cell ", 
+            n_cell, '\n');
+
+    auto &pl = _construct_policy;
+    pl._in_cell_sort = static_cast<typename construct_policy_t::
+        in_cell_sort_t>(in_cell_sort[0]);
+    pl._dim_sorted = in_cell_sort[1];
+    pl._cell_order = static_cast<typename construct_policy_t::
+        cell_order_t>(cell_order);
+    pl.set_periodic_box(box_size);
+    _mesh = mesh_t(rect, cells_t(n_cell));
+    _set_cell_ranks();
+    _nodes = std::move(nodes);
+    _displs = std::move(displs);
 }
 
 _HIPP_TEMPRET
 get_nodes_in_cell(index_t cell_idx) const noexcept 
 -> std::pair<const node_t *, index_t> {
-    auto b = _displs[cell_idx], e = _displs[cell_idx+1];
+    const index_t r = cell_rank(cell_idx);
+    auto b = _displs[r], e = _displs[r+1];
     return {_nodes.data() + b, e - b};
 }
 
@@ -276,6 +435,11 @@ nodes() noexcept -> vector<node_t> & {
     return _nodes; 
 }
 
+_HIPP_TEMPRET
+cell_rank(index_t cell_idx) const noexcept -> index_t {
+    return _cell_ranks.empty() ? cell_idx : _cell_ranks[cell_idx];
+}
+
 _HIPP_TEMPHD
 template<typename Op, typename Policy> 
 struct _HIPP_TEMPCLS::_Impl_visit_rect 
@@ -384,24 +548,72 @@ template<typename Op, typename Policy>
 void _HIPP_TEMPCLS::visit_rect(const rect_t &rect, Op op, 
     Policy &&policy) const 
 {
-    _Impl_visit_rect<Op, Policy>{*this, rect, op}();
+    _visit_rect_images(rect, [&](const rect_t &img) {
+        _Impl_visit_rect<Op, Policy>{*this, img, op}();
+    });
 }
 
 _HIPP_TEMPRET 
 count_rect(const rect_t &rect) const -> index_t {
     index_t cnt = 0;
-    auto op = [&rect, &cnt, this](index_t cell_idx, int bound){
-        auto [b, n] = get_nodes_in_cell(cell_idx);
-        if(bound) {
-            cnt += n; return;
-        } 
-        while(n-- > 0)
-            if( rect.contains(b[n]) ) ++cnt;
-    };
-    visit_rect<decltype(op)>(rect, op);
+    _visit_rect_images(rect, [&cnt, this](const rect_t &img) {
+        auto op = [&img, &cnt, this](index_t cell_idx, int bound){
+            auto [b, n] = get_nodes_in_cell(cell_idx);
+            if(bound) {
+                cnt += n; return;
+            } 
+            while(n-- > 0)
+                if( img.contains(b[n]) ) ++cnt;
+        };
+        _Impl_visit_rect<decltype(op), rect_query_policy_t>{*this, img, op}();
+    });
     return cnt;
 }
 
+_HIPP_TEMPHD
+template<typename Op>
+void _HIPP_TEMPCLS::visit_nodes_rect(const rect_t &rect, Op op) const {
+    _visit_rect_images(rect, [&op, this](const rect_t &img) {
+        auto op_on_cell = [&img, &op, this](index_t cell_idx, int bound) {
+            const index_t r = cell_rank(cell_idx),
+                b = _displs[r], e = _displs[r+1];
+            if( bound ) {
+                for(index_t i=b; i<e; ++i) op(i);
+                return;
+            }
+            for(index_t i=b; i<e; ++i)
+                if( img.contains(_nodes[i]) ) op(i);
+        };
+        _Impl_visit_rect<decltype(op_on_cell), rect_query_policy_t>{
+            *this, img, op_on_cell}();
+    });
+}
+
+_HIPP_TEMPHD
+template<typename Op>
+void _HIPP_TEMPCLS::_visit_rect_images(const rect_t &rect, Op &&op) const {
+    const auto &box = _construct_policy._periodic_box;
+    if( !box.is_periodic() ) {
+        op(rect); return;
+    }
+    box.visit_rect_images(rect, op);
+}
+
+_HIPP_TEMPHD
+template<typename Op>
+void _HIPP_TEMPCLS::_visit_sphere_images(const sphere_t &sphere, 
+    Op &&op) const 
+{
+    const auto &box = _construct_policy._periodic_box;
+    if( !box.is_periodic() ) {
+        op(sphere); return;
+    }
+    box.check_radius(sphere.r());
+    const float_t r_sq = sphere.r() * sphere.r();
+    box.visit_images(box.wrap(sphere.center().pos()), r_sq, 
+        [&](const pos_t &img, int) { op(sphere_t(point_t(img), sphere.r())); });
+}
+
 _HIPP_TEMPHD
 template<typename Op, typename Policy> 
 struct _HIPP_TEMPCLS::_Impl_visit_sphere
@@ -560,24 +772,540 @@ template<typename Op, typename Policy>
 void _HIPP_TEMPCLS::visit_sphere(const sphere_t &sphere, Op op, 
     Policy &&policy) const 
 {
-    _Impl_visit_sphere<Op, Policy>{*this, sphere, op}();
+    _visit_sphere_images(sphere, [&](const sphere_t &img) {
+        _Impl_visit_sphere<Op, Policy>{*this, img, op}();
+    });
 }
 
 _HIPP_TEMPRET
 count_sphere(const sphere_t &sphere) const -> index_t {
     index_t cnt = 0;
-    auto op = [&sphere, &cnt, this](index_t cell_idx, int bound){
-        auto [b, n] = get_nodes_in_cell(cell_idx);
-        if(bound) {
-            cnt += n; return;
+    const float_t r_sq = sphere.r() * sphere.r();
+    _visit_sphere_images(sphere, [r_sq, &cnt, this](const sphere_t &img) {
+        const pos_t &cent = img.center().pos();
+        auto op = [&cent, r_sq, &cnt, this](index_t cell_idx, int bound){
+            auto [b, n] = get_nodes_in_cell(cell_idx);
+            if(bound) {
+                cnt += n; return;
+            }
+            cnt += _DistKernel<point_t>::count_within(b, n, cent, r_sq);
+        };
+        _Impl_visit_sphere<decltype(op), sphere_query_policy_t>{
+            *this, img, op}();
+    });
+    return cnt;
+}
+
+_HIPP_TEMPHD
+template<typename Op>
+void _HIPP_TEMPCLS::visit_nodes_sphere(const sphere_t &sphere, Op op) const {
+    const float_t r_sq = sphere.r() * sphere.r();
+    _visit_sphere_images(sphere, [r_sq, &op, this](const sphere_t &img) {
+        const pos_t &cent = img.center().pos();
+        auto op_on_cell = [&cent, r_sq, &op, this](index_t cell_idx, 
+            int bound)
+        {
+            const index_t r = cell_rank(cell_idx),
+                b = _displs[r], e = _displs[r+1];
+            if( bound ) {
+                for(index_t i=b; i<e; ++i) op(i);
+                return;
+            }
+            _DistKernel<point_t>::visit_within(_nodes.data()+b, e-b, 
+                cent, r_sq, [&op, b](size_t i) { op(b+index_t(i)); });
+        };
+        _Impl_visit_sphere<decltype(op_on_cell), sphere_query_policy_t>{
+            *this, img, op_on_cell}();
+    });
+}
+
+_HIPP_TEMPRET
+visit_sphere_batch(ContiguousBuffer<const sphere_t> spheres,
+    vector<index_t> &displs, vector<index_t> &node_ids,
+    const batch_query_policy_t &batch_policy) const -> void
+{
+    auto [p_spheres, n_spheres] = spheres;
+    _BatchQuery<index_t> bq(batch_policy, n_spheres);
+    bq.sort_by_centers(*this, spheres);
+
+    bq.gather([&](int i_th, index_t i, vector<index_t> &buf) {
+        visit_nodes_sphere(p_spheres[i], 
+            [&buf](index_t j) { buf.push_back(j); });
+    }, displs, node_ids);
+}
+
+_HIPP_TEMPRET
+count_sphere_batch(ContiguousBuffer<const sphere_t> spheres,
+    vector<index_t> &counts,
+    const batch_query_policy_t &batch_policy) const -> void
+{
+    auto [p_spheres, n_spheres] = spheres;
+    _BatchQuery<index_t> bq(batch_policy, n_spheres);
+    bq.sort_by_centers(*this, spheres);
+
+    counts.resize(n_spheres);
+    bq.for_each([&](int i_th, index_t i) {
+        counts[i] = count_sphere(p_spheres[i]);
+    });
+}
+
+_HIPP_TEMPRET
+stencil(float_t r) const -> stencil_t {
+    if( !(r >= 0) )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB, 
+            "  ... invalid radius ", r, '\n');
+    
+    stencil_t st;
+    const auto &cs = _mesh.cell_size();
+    const auto &n_cell = _mesh.n_cell();
+    st._r = r;
+    st._cell_size = cs;
+    for(int d=0; d<DIM; ++d) {
+        const float_t n = std::floor(r / cs[d]) + 1;
+        st._extent[d] = n < n_cell[d] ? index_t(n) : n_cell[d];
+    }
+
+    // Enumerate the offsets in the extent, keeping those whose minimal 
+    // distance is within r.
+    const float_t r_sq = r * r;
+    v_index_t off;
+    for(int d=0; d<DIM; ++d) off[d] = -st._extent[d];
+    while( true ) {
+        float_t r_sq_min = 0, r_sq_max = 0;
+        for(int d=0; d<DIM; ++d) {
+            const index_t o = off[d] < 0 ? -off[d] : off[d];
+            const float_t lo = (o > 0 ? o-1 : 0) * cs[d], hi = (o+1) * cs[d];
+            r_sq_min += lo * lo;
+            r_sq_max += hi * hi;
+        }
+        if( r_sq_min <= r_sq ) {
+            st._offsets.push_back(off);
+            st._r_sq_bounds.emplace_back(r_sq_min, r_sq_max);
+        }
+        int d = DIM-1;
+        while( d >= 0 && off[d] == st._extent[d] ) {
+            off[d] = -st._extent[d]; --d;
+        }
+        if( d < 0 ) break;
+        ++off[d];
+    }
+    return st;
+}
+
+_HIPP_TEMPHD
+template<typename Op>
+void _HIPP_TEMPCLS::visit_nodes_stencil(const stencil_t &st, 
+    const point_t &p, Op op) const 
+{
+    if( _displs.empty() ) return;
+    pos_t cent = p.pos();
+    v_index_t home;
+    if( !_stencil_home(st, cent, home) ) {
+        visit_nodes_sphere(sphere_t(p, st._r), op); return;
+    }
+    const pos_t u = cent - _cell_low(home);
+    const float_t r_sq = st._r * st._r;
+    _visit_stencil_cells(st, home, 
+        [&](size_t i, index_t b, index_t e, const pos_t &shift) 
+    {
+        const auto [r_sq_min, r_sq_max] = _stencil_r_sq(st, i, u);
+        if( r_sq_min > r_sq ) return;
+        if( r_sq_max <= r_sq ) {
+            for(index_t j=b; j<e; ++j) op(j);
+            return;
+        }
+        _DistKernel<point_t>::visit_within(_nodes.data()+b, e-b, 
+            cent - shift, r_sq, [&op, b](size_t j) { op(b+index_t(j)); });
+    });
+}
+
+_HIPP_TEMPRET
+count_stencil(const stencil_t &st, const point_t &p) const -> index_t {
+    if( _displs.empty() ) return 0;
+    pos_t cent = p.pos();
+    v_index_t home;
+    if( !_stencil_home(st, cent, home) ) 
+        return count_sphere(sphere_t(p, st._r));
+    
+    const pos_t u = cent - _cell_low(home);
+    const float_t r_sq = st._r * st._r;
+    index_t cnt = 0;
+    _visit_stencil_cells(st, home, 
+        [&](size_t i, index_t b, index_t e, const pos_t &shift) 
+    {
+        const auto [r_sq_min, r_sq_max] = _stencil_r_sq(st, i, u);
+        if( r_sq_min > r_sq ) return;
+        if( r_sq_max <= r_sq ) {
+            cnt += e - b; return;
         }
-        while(n-- > 0) 
-            if( sphere.contains(b[n]) ) ++cnt;
-    };
-    visit_sphere<decltype(op)>(sphere, op);
+        cnt += _DistKernel<point_t>::count_within(_nodes.data()+b, e-b, 
+            cent - shift, r_sq);
+    });
     return cnt;
 }
 
+_HIPP_TEMPRET
+visit_stencil_batch(const stencil_t &st, 
+    ContiguousBuffer<const point_t> pts,
+    vector<index_t> &displs, vector<index_t> &node_ids,
+    const batch_query_policy_t &batch_policy) const -> void
+{
+    auto [p_pts, n_pts] = pts;
+    const index_t n = n_pts;
+    const int n_th = batch_policy.n_threads();
+    _BatchQuery<index_t> bq(batch_policy, n);
+
+    // As in _BatchQuery::gather(), each thread puts the results in its own 
+    // buffer, at local_displs[i] for query i. The counts are temporarily 
+    // put at displs[i+1].
+    vector<vector<index_t> > bufs(n_th), tmps(n_th);
+    vector<index_t> local_displs(n), owners(n);
+    displs.assign(n+1, 0);
+    auto put = [&](int i_th, index_t i_q, const index_t *p, index_t n_res) {
+        auto &buf = bufs[i_th];
+        local_displs[i_q] = buf.size();
+        owners[i_q] = i_th;
+        displs[i_q+1] = n_res;
+        buf.insert(buf.end(), p, p+n_res);
+    };
+
+    const float_t r_sq = st._r * st._r;
+    auto cell_op = [&](int i_th, const v_index_t &home, const index_t *qs, 
+        index_t n_q) 
+    {
+        vector<vector<index_t> > res(n_q);
+        const pos_t low = _cell_low(home);
+        _visit_stencil_cells(st, home, 
+            [&](size_t i, index_t b, index_t e, const pos_t &shift) 
+        {
+            for(index_t j=0; j<n_q; ++j) {
+                const pos_t &cent = p_pts[qs[j]].pos();
+                const auto [r_sq_min, r_sq_max] 
+                    = _stencil_r_sq(st, i, cent - low);
+                if( r_sq_min > r_sq ) continue;
+                auto &out = res[j];
+                if( r_sq_max <= r_sq ) {
+                    for(index_t k=b; k<e; ++k) out.push_back(k);
+                    continue;
+                }
+                _DistKernel<point_t>::visit_within(_nodes.data()+b, e-b, 
+                    cent - shift, r_sq, 
+                    [&out, b](size_t k) { out.push_back(b+index_t(k)); });
+            }
+        });
+        for(index_t j=0; j<n_q; ++j)
+            put(i_th, qs[j], res[j].data(), res[j].size());
+    };
+    auto single_op = [&](int i_th, index_t i_q) {
+        auto &tmp = tmps[i_th];
+        tmp.clear();
+        visit_nodes_stencil(st, p_pts[i_q], 
+            [&tmp](index_t k) { tmp.push_back(k); });
+        put(i_th, i_q, tmp.data(), tmp.size());
+    };
+    _stencil_batch(st, p_pts, n, bq.n_threads(), cell_op, single_op);
+
+    for(index_t i=0; i<n; ++i)
+        displs[i+1] += displs[i];
+    node_ids.resize(displs[n]);
+    _parallel_for(n_th, n, [&](int, index_t b, index_t e) {
+        for(index_t i=b; i<e; ++i)
+            std::copy_n(bufs[owners[i]].data() + local_displs[i], 
+                displs[i+1]-displs[i], node_ids.data() + displs[i]);
+    });
+}
+
+_HIPP_TEMPRET
+count_stencil_batch(const stencil_t &st, 
+    ContiguousBuffer<const point_t> pts, vector<index_t> &counts,
+    const batch_query_policy_t &batch_policy) const -> void
+{
+    auto [p_pts, n_pts] = pts;
+    const index_t n = n_pts;
+    _BatchQuery<index_t> bq(batch_policy, n);
+    counts.assign(n, 0);
+
+    const float_t r_sq = st._r * st._r;
+    auto cell_op = [&](int, const v_index_t &home, const index_t *qs, 
+        index_t n_q) 
+    {
+        const pos_t low = _cell_low(home);
+        _visit_stencil_cells(st, home, 
+            [&](size_t i, index_t b, index_t e, const pos_t &shift) 
+        {
+            for(index_t j=0; j<n_q; ++j) {
+                const pos_t &cent = p_pts[qs[j]].pos();
+                const auto [r_sq_min, r_sq_max] 
+                    = _stencil_r_sq(st, i, cent - low);
+                if( r_sq_min > r_sq ) continue;
+                counts[qs[j]] += r_sq_max <= r_sq ? e - b 
+                    : _DistKernel<point_t>::count_within(_nodes.data()+b, 
+                        e-b, cent - shift, r_sq);
+            }
+        });
+    };
+    auto single_op = [&](int, index_t i_q) {
+        counts[i_q] = count_stencil(st, p_pts[i_q]);
+    };
+    _stencil_batch(st, p_pts, n, bq.n_threads(), cell_op, single_op);
+}
+
+_HIPP_TEMPRET
+fof(float_t b, vector<index_t> &group_ids, const fof_policy_t &policy) const 
+-> index_t 
+{
+    const int n_threads = policy.n_threads();
+    if( n_threads < 1 )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB,
+            "  ... invalid no. of threads ", n_threads, '\n');
+    if( !(b >= 0) )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB,
+            "  ... invalid linking length ", b, '\n');
+    
+    _UnionFind<index_t> uf(_nodes.size());
+    if( !_nodes.empty() ) _link_fof(b, uf, n_threads);
+    return uf.labels(group_ids, policy.min_size(), n_threads);
+}
+
+_HIPP_TEMPRET
+sph_density(vector<float_t> &h, vector<float_t> &rho, 
+    const sph_policy_t &policy) const -> index_t 
+{
+    const index_t n_nodes = _nodes.size();
+    _SPHSolver<float_t, index_t, DIM> solver(policy, n_nodes);
+    const auto &box = _construct_policy._periodic_box;
+    auto pos_of = [this](index_t i) -> const pos_t & { 
+        return _nodes[i].pos(); 
+    };
+    auto visit = [&, this](index_t i, float_t r, auto &op) {
+        const pos_t &p = _nodes[i].pos();
+        visit_nodes_sphere(sphere_t(p, r), [&](index_t j) {
+            op(j, box.r_sq(p, _nodes[j].pos()));
+        });
+    };
+    return solver.solve(pos_of, visit, h, rho);
+}
+
+_HIPP_TEMPRET
+_link_fof(float_t b, _UnionFind<index_t> &uf, int n_threads) const -> void {
+    const float_t b_sq = b * b;
+    const stencil_t st = stencil(b);
+    
+    // A periodic mesh narrower than the stencil - link by sphere queries.
+    const auto &box_size = _construct_policy._periodic_box.size();
+    const auto &n_cell = _mesh.n_cell();
+    for(int d=0; d<DIM; ++d) {
+        if( !(box_size[d] > 0 && 2*st._extent[d]+1 > n_cell[d]) ) continue;
+        const index_t n_nodes = _nodes.size();
+        _parallel_for(n_threads, n_nodes, [&](int, index_t i_b, index_t i_e) {
+            for(index_t i=i_b; i<i_e; ++i)
+                visit_nodes_sphere(sphere_t(_nodes[i], b), [&](index_t j) { 
+                    if( j > i ) uf.unite(i, j); });
+        });
+        return;
+    }
+
+    // Pass 1: pairs in each cell. A cell is marked, at its first node, if 
+    // its nodes are known to be in a single group.
+    const index_t n_cells = _mesh.total_n_cell();
+    vector<std::atomic<char> > linked(_nodes.size());
+    float_t diag_sq = 0;
+    for(int d=0; d<DIM; ++d) diag_sq += st._cell_size[d] * st._cell_size[d];
+    _parallel_for(n_threads, n_cells, [&](int, index_t c_b, index_t c_e) {
+        for(index_t r=c_b; r<c_e; ++r) {
+            const index_t b0 = _displs[r], e0 = _displs[r+1];
+            if( e0 - b0 > 1 && diag_sq < b_sq ) {
+                for(index_t i=b0+1; i<e0; ++i) uf.unite(b0, i);
+            } else {
+                for(index_t i=b0; i+1<e0; ++i)
+                    _DistKernel<point_t>::visit_within(_nodes.data()+i+1, 
+                        e0-i-1, _nodes[i].pos(), b_sq, [&](size_t j) {
+                            uf.unite(i, i+1+index_t(j)); });
+            }
+            if( b0 == e0 ) continue;
+            bool all = true;
+            for(index_t i=b0+1; i<e0 && all; ++i) all = uf.same(b0, i);
+            linked[b0].store(all, std::memory_order_relaxed);
+        }
+    });
+
+    // Pass 2: pairs of each cell and its neighbors in the half stencil, 
+    // i.e., the offsets with a positive first non-zero component.
+    vector<char> half(st.size(), 0);
+    for(size_t i=0; i<st.size(); ++i) {
+        const auto &off = st._offsets[i];
+        int d = 0;
+        while( d < DIM && off[d] == 0 ) ++d;
+        half[i] = d < DIM && off[d] > 0;
+    }
+    _parallel_for(n_threads, n_cells, [&](int, index_t c_b, index_t c_e) {
+        for(index_t c=c_b; c<c_e; ++c) {
+            const index_t r = cell_rank(c), b0 = _displs[r], 
+                e0 = _displs[r+1];
+            if( b0 == e0 ) continue;
+            const bool linked_a = linked[b0].load(std::memory_order_relaxed);
+            _visit_stencil_cells(st, _mesh.idx2v_idx(c), 
+                [&](size_t i, index_t b1, index_t e1, const pos_t &shift)
+            {
+                if( !half[i] || b1 == e1 ) return;
+                const bool linked_b = linked[b1].load(
+                    std::memory_order_relaxed);
+                if( linked_a && linked_b ) {
+                    if( uf.same(b0, b1) ) return;
+                    if( st.r_sq_max(i) < b_sq ) {
+                        uf.unite(b0, b1); return;
+                    }
+                }
+                for(index_t j=b0; j<e0; ++j)
+                    _DistKernel<point_t>::visit_within(_nodes.data()+b1, 
+                        e1-b1, _nodes[j].pos() - shift, b_sq, [&](size_t k) {
+                            uf.unite(j, b1+index_t(k)); });
+            });
+        }
+    });
+}
+
+_HIPP_TEMPRET
+_stencil_home(const stencil_t &st, pos_t &p, v_index_t &home) const 
+-> bool 
+{
+    if( !(st._cell_size == _mesh.cell_size()).all() )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB, 
+            "  ... stencil is made by another mesh (cell size=", 
+            st._cell_size, ", expected ", _mesh.cell_size(), ")\n");
+    
+    const auto &box = _construct_policy._periodic_box;
+    if( box.is_periodic() ) {
+        const auto &box_size = box.size();
+        const auto &n_cell = _mesh.n_cell();
+        for(int d=0; d<DIM; ++d)
+            if( box_size[d] > 0 && 2*st._extent[d]+1 > n_cell[d] ) 
+                return false;
+        p = box.wrap(p);
+    }
+    home = _mesh.v_idx_of(point_t(p));
+    return _mesh.v_idx_is_bound(home);
+}
+
+_HIPP_TEMPHD
+template<typename Op>
+void _HIPP_TEMPCLS::_visit_stencil_cells(const stencil_t &st, 
+    const v_index_t &home, Op &&op) const 
+{
+    const auto &box_size = _construct_policy._periodic_box.size();
+    const auto &n_cell = _mesh.n_cell();
+    const size_t n_offs = st._offsets.size();
+    for(size_t i=0; i<n_offs; ++i) {
+        const auto &off = st._offsets[i];
+        v_index_t v_idx;
+        pos_t shift(0);
+        bool in_mesh = true;
+        for(int d=0; d<DIM; ++d) {
+            index_t x = home[d] + off[d];
+            if( x < 0 || x >= n_cell[d] ) {
+                if( !(box_size[d] > 0) ) {
+                    in_mesh = false; break;
+                }
+                if( x < 0 ) {
+                    x += n_cell[d]; shift[d] = -box_size[d];
+                } else {
+                    x -= n_cell[d]; shift[d] = box_size[d];
+                }
+            }
+            v_idx[d] = x;
+        }
+        if( !in_mesh ) continue;
+        const index_t r = cell_rank(_mesh.v_idx2idx(v_idx));
+        op(i, _displs[r], _displs[r+1], shift);
+    }
+}
+
+_HIPP_TEMPRET
+_stencil_r_sq(const stencil_t &st, size_t i, const pos_t &u) 
+const noexcept -> std::pair<float_t, float_t> 
+{
+    const auto &off = st._offsets[i];
+    const auto &cs = st._cell_size;
+    float_t r_sq_min = 0, r_sq_max = 0;
+    for(int d=0; d<DIM; ++d) {
+        const index_t o = off[d];
+        float_t lo, hi;
+        if( o > 0 ) {
+            lo = o * cs[d] - u[d]; hi = lo + cs[d];
+        } else if( o < 0 ) {
+            hi = u[d] - o * cs[d]; lo = hi - cs[d];
+        } else {
+            lo = 0; hi = std::max(u[d], cs[d] - u[d]);
+        }
+        if( lo < 0 ) lo = 0;
+        r_sq_min += lo * lo;
+        r_sq_max += hi * hi;
+    }
+    return {r_sq_min, r_sq_max};
+}
+
+_HIPP_TEMPRET
+_cell_low(const v_index_t &v_idx) const noexcept -> pos_t {
+    const auto &cs = _mesh.cell_size();
+    pos_t low = _mesh.low().pos();
+    for(int d=0; d<DIM; ++d) low[d] += v_idx[d] * cs[d];
+    return low;
+}
+
+_HIPP_TEMPHD
+template<typename CellOp, typename SingleOp>
+void _HIPP_TEMPCLS::_stencil_batch(const stencil_t &st, 
+    const point_t *p_pts, index_t n_pts, int n_threads, CellOp &&cell_op, 
+    SingleOp &&single_op) const
+{
+    if( _displs.empty() ) {
+        _parallel_for(n_threads, n_pts, [&](int i_th, index_t b, index_t e) {
+            for(index_t i=b; i<e; ++i) single_op(i_th, i);
+        });
+        return;
+    }
+
+    // Queries that can use the stencil, grouped by the ranks of their 
+    // cells. A query wrapped by the periodic box is processed singly.
+    vector<std::pair<index_t, index_t> > ranks;     // {cell rank, query}
+    vector<v_index_t> homes;
+    vector<index_t> singles, qs, grp_displs;
+    ranks.reserve(n_pts);
+    for(index_t i=0; i<n_pts; ++i) {
+        pos_t cent = p_pts[i].pos();
+        v_index_t home;
+        if( _stencil_home(st, cent, home) 
+            && (cent == p_pts[i].pos()).all() )
+            ranks.emplace_back(cell_rank(_mesh.v_idx2idx(home)), i);
+        else 
+            singles.push_back(i);
+    }
+    std::stable_sort(ranks.begin(), ranks.end(), 
+        [](const auto &l, const auto &r) { return l.first < r.first; });
+    qs.reserve(ranks.size());
+    for(auto [r, i]: ranks) {
+        if( qs.empty() || ranks[qs.size()-1].first != r ) {
+            grp_displs.push_back(qs.size());
+            homes.push_back(_mesh.v_idx_of(p_pts[i]));
+        }
+        qs.push_back(i);
+    }
+    const index_t n_grps = homes.size();
+    grp_displs.push_back(qs.size());
+
+    _parallel_for(n_threads, n_grps, [&](int i_th, index_t b, index_t e) {
+        for(index_t g=b; g<e; ++g) {
+            const index_t i_b = grp_displs[g], i_e = grp_displs[g+1];
+            cell_op(i_th, homes[g], qs.data()+i_b, i_e-i_b);
+        }
+    });
+    const index_t n_singles = singles.size();
+    _parallel_for(n_threads, n_singles, 
+        [&](int i_th, index_t b, index_t e) {
+            for(index_t i=b; i<e; ++i) single_op(i_th, singles[i]);
+        });
+}
+
 
 #undef _HIPP_TEMPHD
 #undef _HIPP_TEMPARG
@@ -597,6 +1325,8 @@ construct_policy_t() noexcept {
     set_n_cell(DFLT_N_CELL);
     set_in_cell_sort(DFLT_IN_CELL_SORT);
     set_dim_sorted(DFLT_DIM_SORTED);
+    set_cell_order(DFLT_CELL_ORDER);
+    set_n_threads(DFLT_N_THREADS);
 }
 
 _HIPP_TEMPRET
@@ -613,7 +1343,10 @@ info(ostream &os, int fmt_cntl, int level) const -> ostream & {
             ps << "NONE";
         else 
             ps << "ALONG_AXIS, dim_sorted=", _dim_sorted;
-        ps << "}}";
+        ps << "}, cell order=", 
+            (_cell_order == cell_order_t::MORTON ? "MORTON" : "ROW_MAJOR"),
+            ", no. threads=", _n_threads,
+            ", periodic box=", _periodic_box.size(), "}";
         return os;
     }
     auto ind = HIPPCNTL_CLASS_INFO_INDENT_STR(level);
@@ -631,7 +1364,11 @@ info(ostream &os, int fmt_cntl, int level) const -> ostream & {
         ps << "NONE";
     else 
         ps << "ALONG_AXIS, dim_sorted=", _dim_sorted;
-    ps << "}\n";
+    ps << "}\n",
+    ind, "Cell order = ", 
+        (_cell_order == cell_order_t::MORTON ? "MORTON" : "ROW_MAJOR"), 
+        ", no. threads = ", _n_threads, '\n',
+    ind, "Periodic box = ", _periodic_box.size(), '\n';
     return os;
 }
 
@@ -706,13 +1443,110 @@ set_dim_sorted(int dim) noexcept -> construct_policy_t & {
     return *this;
 }
 
+_HIPP_TEMPRET
+cell_order() const noexcept -> cell_order_t {
+    return _cell_order;
+}
+
+_HIPP_TEMPRET
+set_cell_order(cell_order_t cell_order) noexcept -> construct_policy_t & {
+    _cell_order = cell_order;
+    return *this;
+}
+
+_HIPP_TEMPRET
+n_threads() const noexcept -> int {
+    return _n_threads;
+}
+
+_HIPP_TEMPRET
+set_n_threads(int n_threads) noexcept -> construct_policy_t & {
+    _n_threads = n_threads;
+    return *this;
+}
+
+_HIPP_TEMPRET
+periodic_box() const noexcept -> const periodic_box_t & {
+    return _periodic_box;
+}
+
+_HIPP_TEMPRET
+set_periodic_box(float_t box_size) noexcept -> construct_policy_t & {
+    return set_periodic_box(pos_t(box_size));
+}
+
+_HIPP_TEMPRET
+set_periodic_box(const pos_t &box_size) noexcept -> construct_policy_t & {
+    _periodic_box = periodic_box_t(box_size);
+    return *this;
+}
+
 #undef _HIPP_TEMPHD
 #undef _HIPP_TEMPARG
 #undef _HIPP_TEMPCLS
 #undef _HIPP_TEMPRET
 #undef _HIPP_TEMPNORET
 
+#define _HIPP_TEMPHD template<typename KDPointT, typename IndexT>
+#define _HIPP_TEMPARG <KDPointT, IndexT>
+#define _HIPP_TEMPCLS _KDMesh _HIPP_TEMPARG::stencil_t
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPNORET
+stencil_t() noexcept : _r(0), _cell_size(0), _extent(n_cell_t(0)) {}
+
+_HIPP_TEMPRET
+info(ostream &os, int fmt_cntl, int level) const -> ostream & {
+    PStream ps(os);
+    if( fmt_cntl < 1 ) {
+        ps << HIPPCNTL_CLASS_INFO_INLINE(_KDMesh::stencil_t),
+        "{r=", _r, ", no. offsets=", _offsets.size(), "}";
+        return os;
+    }
+    auto ind = HIPPCNTL_CLASS_INFO_INDENT_STR(level);
+    ps << HIPPCNTL_CLASS_INFO(_KDMesh::stencil_t),
+    ind, "Radius = ", _r, ", cell size = {", _cell_size, "}\n",
+    ind, "Extent = {", _extent.value(), "}, no. offsets = ", 
+        _offsets.size(), '\n';
+    return os;
+}
+
+_HIPP_TEMPRET
+r() const noexcept -> float_t {
+    return _r;
+}
+
+_HIPP_TEMPRET
+size() const noexcept -> size_t {
+    return _offsets.size();
+}
+
+_HIPP_TEMPRET
+offset(size_t i) const noexcept -> const v_index_t & {
+    return _offsets[i];
+}
+
+_HIPP_TEMPRET
+r_sq_min(size_t i) const noexcept -> float_t {
+    return _r_sq_bounds[i].first;
+}
+
+_HIPP_TEMPRET
+r_sq_max(size_t i) const noexcept -> float_t {
+    return _r_sq_bounds[i].second;
+}
 
+_HIPP_TEMPRET
+extent() const noexcept -> const v_index_t & {
+    return _extent;
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
 
 } // namespace HIPP::NUMERICAL::_KDSEARCH
 
@@ -36,10 +36,13 @@ public:
     user-defined extra information. 
     ``node_t`` is derived from ``point_t``, with padding to store user-defined
     extra information and fields for tree implementation.
+    ``ref_node_t`` is the node of a bucketed tree, which refers to its points
+    by offset (see ``ref_nodes()``).
     */
     using point_t    = typename impl_t::point_t;
     using kd_point_t = typename impl_t::kd_point_t;
     using node_t     = typename impl_t::node_t;
+    using ref_node_t = typename impl_t::ref_node_t;
 
     /**
     Numerical types.
@@ -63,6 +66,25 @@ public:
     using nearest_k_query_policy_t = typename impl_t::nearest_k_query_policy_t;
     using rect_query_policy_t      = typename impl_t::rect_query_policy_t;
     using sphere_query_policy_t    = typename impl_t::sphere_query_policy_t;
+    using batch_query_policy_t     = typename impl_t::batch_query_policy_t;
+    using all_nearest_k_policy_t   = typename impl_t::all_nearest_k_policy_t;
+    using pair_count_policy_t      = typename impl_t::pair_count_policy_t;
+    using fof_policy_t             = typename impl_t::fof_policy_t;
+    using sph_policy_t             = typename impl_t::sph_policy_t;
+    using sph_kernel_t             = typename impl_t::sph_kernel_t;
+    using refit_policy_t           = typename impl_t::refit_policy_t;
+    using refit_info_t             = typename impl_t::refit_info_t;
+    using out_of_core_policy_t     = typename impl_t::out_of_core_policy_t;
+
+    /**
+    Sources of points for ``construct_out_of_core()``, i.e., a file of raw 
+    points or a HDF5 dataset of positions (``DatasetT`` is 
+    ``IO::H5::Dataset``).
+    */
+    using point_run_file_t         = typename impl_t::point_run_file_t;
+    template<typename DatasetT, typename PadT = void>
+    using h5_point_source_t        = 
+        typename impl_t::template h5_point_source_t<DatasetT, PadT>;
 
     using tree_info_t = typename impl_t::tree_info_t;
     using idx_pair_t  = typename impl_t::idx_pair_t;
@@ -111,6 +133,29 @@ public:
     void construct(ContiguousBuffer<const kd_point_t> pts,
         const construct_policy_t &policy = construct_policy_t());
 
+    /**
+    Construct the tree from points streamed from the disk, for point sets 
+    larger than the memory. E.g., with a HDF5 dataset ``dset`` of positions 
+    shaped ``{N, 3}``::
+
+        using kdtree_t = KDTree<KDPoint<float, 3, sizeof(long long)>, 
+            long long>;
+        kdtree_t::h5_point_source_t<IO::H5::Dataset, long long> src(dset);
+        kdtree_t kdt;
+        kdt.construct_out_of_core(src, {}, 
+            kdtree_t::out_of_core_policy_t().set_scratch_dir("/scratch"));
+
+    The padding of each node is then its row in the dataset. The top levels 
+    are split by streaming passes, the points of the children are written 
+    into bucket files, and each bucket with no more than 
+    ``ooc_policy.max_in_core()`` points is built in memory. The split axis
+    must be ``MAX_EXTREME`` or ``MAX_VARIANCE``.
+    */
+    template<typename Source>
+    void construct_out_of_core(Source &src, 
+        const construct_policy_t &policy = construct_policy_t(),
+        const out_of_core_policy_t &ooc_policy = out_of_core_policy_t());
+
     /**
     Find the indices into points ``pts`` so that they are sorted according 
     to the rank of NN candidate node. The order of points belonging to the same 
@@ -127,6 +172,26 @@ public:
     void argsort(ContiguousBuffer<const PointT> pts, 
         vector<idx_pair_t> &idx_pairs) const;
 
+    /**
+    Refit the tree to moved points without a reconstruction, e.g., between 
+    the time steps of a simulation. The sizes and split axes of the nodes 
+    are kept.
+
+    ``pts[i]`` is the new point at point index ``i`` (i.e., ``pts.size()`` 
+    must be ``n_points()``), typically found by looking up 
+    ``point_pad(i)``. The points may then be swapped to restore the order 
+    along the split axes, hence the points should be identified by their 
+    paddings after the refit.
+
+    refit_info(): ``refit_info().growth()`` is the factor the total volume 
+    of the subtree bounds has grown by since the construction. The queries 
+    slow down roughly in proportion, and a reconstruction may be made once 
+    it exceeds a threshold.
+    */
+    void refit(ContiguousBuffer<const kd_point_t> pts, 
+        const refit_policy_t &policy = refit_policy_t());
+    const refit_info_t & refit_info() const noexcept;
+
     /**
     Memory management methods.
     
@@ -141,6 +206,29 @@ public:
     void shrink_buffer();
     void clear();
 
+    /**
+    Persistence methods. Save the tree structure (nodes, points of a 
+    bucketed tree, tree info and leaf size), or load it to replace the 
+    current one, e.g., to skip the construction of a tree on the same points
+    in another run.
+
+    save(), load(): use a flat binary file named ``file_name``. The arrays in
+    the file are 64-byte aligned, raw binary copies of those in memory - 
+    loading reads them in place without any conversion.
+
+    save_h5(), load_h5(): use a HDF5 group ``g`` typed ``IO::H5::Group``, 
+    e.g., ``kdt.save_h5(file.create_group("tree"))``. Each array is a 
+    dataset of bytes in the group. The hippio module (i.e., ``hippio.h``) is 
+    needed only if they are used.
+
+    The tree must be loaded by a ``KDTree`` with the same point and index 
+    types. Otherwise, an ``ErrRuntime`` is thrown.
+    */
+    void save(const string &file_name) const;
+    void load(const string &file_name);
+    template<typename H5Group> void save_h5(H5Group g) const;
+    template<typename H5Group> void load_h5(H5Group g);
+
     std::shared_ptr<impl_t> impl() const noexcept;
 
     /**
@@ -151,6 +239,23 @@ public:
     left_child_idx(), right_child_idx(), right_sibling_idx(): return the indices
     of left child, right child, and right sibling, respectively, of a node 
     indexed ``node_idx``.
+
+    Points. With ``leaf_size == 1`` (see 
+    ``construct_policy_t::set_leaf_size()``), each node holds its point, and
+    a point index is a node index. Otherwise, the nodes are ``ref_nodes()``,
+    each point is stored once in compact arrays, split nodes refer to their 
+    points by offset, and a leaf bucket is a single node. The queries give 
+    point indices in both cases.
+
+    ref_nodes(): nodes of a bucketed tree, or empty.
+    n_nodes(): number of nodes of either kind.
+    is_bucket(): whether or not the node is a leaf bucket, i.e., a node with
+    no child whose points are scanned together.
+    n_points(), point_pos(), point_pad(): the number of points, and the 
+    position and padding of point ``pt_idx``.
+    point_range(): the points ``[first, last)`` in the subtree rooted at node
+    ``node_idx``.
+    points(): positions of the points of a bucketed tree, or empty.
     */
     const construct_policy_t & construct_policy() const noexcept;
     construct_policy_t & construct_policy() noexcept;
@@ -161,6 +266,15 @@ public:
     index_t left_child_idx(index_t node_idx) const noexcept;
     index_t right_child_idx(index_t node_idx) const noexcept;
     index_t right_sibling_idx(index_t node_idx) const noexcept;
+    const vector<ref_node_t> & ref_nodes() const noexcept;
+    index_t n_nodes() const noexcept;
+    bool is_bucket(index_t node_idx) const noexcept;
+    index_t n_points() const noexcept;
+    const pos_t & point_pos(index_t pt_idx) const noexcept;
+    template<typename T = char[PADDING]>
+    const T & point_pad(index_t pt_idx) const noexcept;
+    std::pair<index_t, index_t> point_range(index_t node_idx) const noexcept;
+    const vector<point_t> & points() const noexcept;
 
     /**
     Walk down from a node indexed ``node_idx`` to a leaf node. 
@@ -182,7 +296,9 @@ public:
     /**
     nearest(): find the tree node nearest to a given point ``p``. 
     A :type:`ngb_t` instance is returned, whose ``node_idx`` and ``r_sq`` fields
-    are the result node and the squared distance to it.
+    are the result node and the squared distance to it. ``node_idx`` is a 
+    point index (see ``point_pos()``), i.e., a node index only if 
+    ``leaf_size == 1``.
     If tree is empty, returns {node_t::idxNULL, max_of_float_t}.
 
     nearest_k(): the same, but find the tree nodes that are the first k nearest 
@@ -196,6 +312,10 @@ public:
     See the API-ref of :type:`nearest_query_policy_t` and 
     :type:`nearest_k_query_policy_t` for the details on query policies.
 
+    If the tree is constructed with a periodic box (see 
+    ``construct_policy_t::set_periodic_box()``), ``r_sq`` is the squared 
+    minimum-image distance.
+
     Thread safety: these three calls do not modify the tree. 
     */
     template<typename Policy = nearest_query_policy_t>
@@ -208,10 +328,14 @@ public:
 
     /**
     visit_nodes_rect(): visit all nodes within ``rect``.
-    ``op(const node_t &node)`` is called on each node visited.
+    ``op(const node_t &node)`` is called on each node visited. In a 
+    bucketed tree, ``node`` is a temporary holding the position and padding
+    of a visited point.
 
     count_nodes_rect(): count the exact number of nodes within ``rect``.
 
+    With a periodic box, ``rect`` is wrapped into the box.
+
     See the API-ref of :type:`rect_query_policy_t` for the details on query 
     policy.
     
@@ -226,9 +350,13 @@ public:
 
     /**
     visit_nodes_sphere(): visit all nodes within ``sphere``. 
-    ``op(const node_t &node)`` is called on each node visited.
+    ``op(const node_t &node)`` is called on each node visited, as in 
+    ``visit_nodes_rect()``.
 
     count_sphere(): count the exact number of nodes within ``sphere``.
+
+    With a periodic box, ``sphere`` is wrapped into the box, and its radius 
+    must be no larger than half the box size.
     
     See the API-ref of :type:`sphere_query_policy_t` for the details on query 
     policy.
@@ -241,6 +369,131 @@ public:
     template<typename Policy = sphere_query_policy_t>
     index_t count_nodes_sphere(const sphere_t &sphere,
         Policy &&policy = Policy()) const;
+
+    /**
+    Batch queries. Each of the queries are made as if calling the single-query 
+    counterpart. ``batch_policy`` specifies the number of threads and whether 
+    or not to reorder the queries by ``argsort()`` for cache locality. 
+    Each thread makes queries with its own copy of ``policy``.
+
+    nearest_k_batch(): find the first ``k`` nearest nodes to each of ``pts``.
+    ``PointT`` must be a derived type of ``point_t``.
+
+    find_nodes_sphere_batch(): find the indices of nodes within each of 
+    ``spheres``.
+
+    The results are written into flat arrays in the order of the input 
+    queries, i.e., the results of query ``i`` are 
+    ``ngbs[displs[i] : displs[i+1]]`` or ``node_ids[displs[i] : displs[i+1]]``.
+    ``displs`` is resized to ``n_queries + 1``.
+
+    count_nodes_sphere_batch(): count the exact number of nodes within 
+    each of ``spheres``. ``counts`` is resized to the number of spheres.
+    */
+    template<typename PointT, typename Policy = nearest_k_query_policy_t>
+    void nearest_k_batch(ContiguousBuffer<const PointT> pts, index_t k,
+        vector<index_t> &displs, vector<ngb_t> &ngbs,
+        const batch_query_policy_t &batch_policy = batch_query_policy_t(),
+        const Policy &policy = Policy()) const;
+    template<typename Policy = sphere_query_policy_t>
+    void find_nodes_sphere_batch(ContiguousBuffer<const sphere_t> spheres,
+        vector<index_t> &displs, vector<index_t> &node_ids,
+        const batch_query_policy_t &batch_policy = batch_query_policy_t(),
+        const Policy &policy = Policy()) const;
+    template<typename Policy = sphere_query_policy_t>
+    void count_nodes_sphere_batch(ContiguousBuffer<const sphere_t> spheres,
+        vector<index_t> &counts,
+        const batch_query_policy_t &batch_policy = batch_query_policy_t(),
+        const Policy &policy = Policy()) const;
+
+    /**
+    All-k-nearest-neighbor query, i.e., find the first ``k`` nearest nodes of 
+    every node in the tree, using the dual-tree algorithm. ``policy`` 
+    specifies the number of threads and whether or not a node is taken as a 
+    neighbor of itself.
+
+    On exit, the neighbors of node ``node_ids[i]`` are 
+    ``ngbs[i*k_used : (i+1)*k_used]``, sorted by distance, where ``k_used``
+    is the return value, i.e., ``k`` truncated by the number of available 
+    neighbors.
+
+    With a periodic box, the dual-tree bounds do not apply and each node is 
+    queried by ``nearest_k()`` separately.
+    */
+    index_t all_nearest_k(index_t k, vector<index_t> &node_ids, 
+        vector<ngb_t> &ngbs, const all_nearest_k_policy_t &policy 
+            = all_nearest_k_policy_t()) const;
+
+    /**
+    Count the pairs of nodes in radial bins, using the dual-tree algorithm.
+    A pair of subtrees whose separations fall entirely in one bin is counted
+    at once.
+
+    ``edges`` are the ``n_bins + 1`` strictly ascending bin edges. A pair at
+    distance ``d`` is counted in bin ``b`` if ``edges[b] <= d < edges[b+1]``.
+    On exit, ``counts`` is resized to ``n_bins``.
+
+    (1): auto-correlation - count each unordered pair of distinct nodes once.
+
+    (2): cross-correlation - count the pairs of a node in this tree and a node
+    in ``other``.
+
+    ``policy`` specifies the number of threads, and whether or not the pairs
+    are weighted. If weighted, the weight of a node is a ``float_t`` value at
+    the beginning of its padding, and a pair counts as the product of the 
+    weights. With a periodic box (of this tree), the distances are the 
+    minimum-image ones.
+    */
+    void count_pairs(ContiguousBuffer<const float_t> edges, 
+        vector<double> &counts, 
+        const pair_count_policy_t &policy = pair_count_policy_t()) const;
+    void count_pairs(const KDTree &other, 
+        ContiguousBuffer<const float_t> edges, vector<double> &counts, 
+        const pair_count_policy_t &policy = pair_count_policy_t()) const;
+
+    /**
+    Friends-of-friends (FoF) group finding with linking length ``b``, i.e., 
+    two nodes at a distance less than ``b`` are in the same group, and so 
+    are their friends, transitively. The tree is traversed against itself 
+    as in ``count_pairs()``, and the links are made into a concurrent 
+    union-find structure. Pairs of subtrees already known to be in the same 
+    group are skipped.
+
+    On exit, ``group_ids[i]`` is the group of node ``i``. Groups are numbered 
+    ``0, 1, ...`` in the order of their first nodes, and groups with less 
+    than ``policy.min_size()`` nodes get ``-1``. Return the number of groups 
+    numbered. The result does not depend on ``policy.n_threads()``.
+    
+    With a periodic box, the distances are the minimum-image ones.
+    */
+    index_t fof(float_t b, vector<index_t> &group_ids, 
+        const fof_policy_t &policy = fof_policy_t()) const;
+
+    /**
+    Adaptive smoothing lengths and kernel-weighted densities of smoothed-
+    particle hydrodynamics (SPH). The smoothing length ``h[i]`` of node 
+    ``i`` is solved so that the kernel-weighted number of nodes within it is
+    ``policy.n_ngb()``, and ``rho[i] = sum_j m_j W(r_ij, h[i])``, where the
+    kernel ``W`` is selected by ``policy.kernel()`` (``CUBIC_SPLINE`` or 
+    ``WENDLAND_C2``) and the masses ``m_j`` are set by 
+    ``policy.set_masses()`` (default 1).
+
+    Each node is solved by the Newton iteration safe-guarded by bisection. 
+    The neighbors found by a sphere query are reused by the iterations as 
+    long as ``h[i]`` is within the search radius. The nodes are processed 
+    in blocks by ``policy.n_threads()`` threads, and the results do not 
+    depend on the number of threads.
+
+    On entry, the positive entries of ``h`` (if it has the size of the 
+    nodes) are the initial guesses, e.g., the results of the last time 
+    step. Return the number of nodes not converged within 
+    ``policy.max_iters()`` iterations.
+
+    With a periodic box, the distances are the minimum-image ones, and the 
+    search radius must be no larger than half the box size.
+    */
+    index_t sph_density(vector<float_t> &h, vector<float_t> &rho, 
+        const sph_policy_t &policy = sph_policy_t()) const;
 protected:
     std::shared_ptr<impl_t> _impl;
 };
@@ -299,6 +552,14 @@ construct(ContiguousBuffer<const kd_point_t> pts,
     _impl->construct(pts, policy);
 }
 
+_HIPP_TEMPHD
+template<typename Source>
+void _HIPP_TEMPCLS::construct_out_of_core(Source &src, 
+    const construct_policy_t &policy, const out_of_core_policy_t &ooc_policy)
+{
+    _impl->construct_out_of_core(src, policy, ooc_policy);
+}
+
 _HIPP_TEMPHD
 template<typename PointT>    
 void _HIPP_TEMPCLS::argsort(ContiguousBuffer<const PointT> pts, 
@@ -307,6 +568,18 @@ void _HIPP_TEMPCLS::argsort(ContiguousBuffer<const PointT> pts,
     _impl->argsort(pts, idx_pairs);
 }
 
+_HIPP_TEMPRET
+refit(ContiguousBuffer<const kd_point_t> pts, const refit_policy_t &policy)
+-> void 
+{
+    _impl->refit(pts, policy);
+}
+
+_HIPP_TEMPRET
+refit_info() const noexcept -> const refit_info_t & {
+    return _impl->refit_info();
+}
+
 _HIPP_TEMPRET
 shrink_buffer() -> void {
     _impl->shrink_buffer();
@@ -317,6 +590,28 @@ clear() -> void {
     _impl->clear();
 }
 
+_HIPP_TEMPRET
+save(const string &file_name) const -> void {
+    _impl->save(file_name);
+}
+
+_HIPP_TEMPRET
+load(const string &file_name) -> void {
+    _impl->load(file_name);
+}
+
+_HIPP_TEMPHD
+template<typename H5Group>
+void _HIPP_TEMPCLS::save_h5(H5Group g) const {
+    _impl->save_h5(std::move(g));
+}
+
+_HIPP_TEMPHD
+template<typename H5Group>
+void _HIPP_TEMPCLS::load_h5(H5Group g) {
+    _impl->load_h5(std::move(g));
+}
+
 _HIPP_TEMPRET
 impl() const noexcept -> std::shared_ptr<impl_t> {
     return _impl;
@@ -367,6 +662,49 @@ right_sibling_idx(index_t node_idx) const noexcept -> index_t {
     return _impl->right_sibling_idx(node_idx);
 }
 
+_HIPP_TEMPRET
+ref_nodes() const noexcept -> const vector<ref_node_t> & {
+    return _impl->ref_nodes();
+}
+
+_HIPP_TEMPRET
+n_nodes() const noexcept -> index_t {
+    return _impl->n_nodes();
+}
+
+_HIPP_TEMPRET
+is_bucket(index_t node_idx) const noexcept -> bool {
+    return _impl->is_bucket(node_idx);
+}
+
+_HIPP_TEMPRET
+n_points() const noexcept -> index_t {
+    return _impl->n_points();
+}
+
+_HIPP_TEMPRET
+point_pos(index_t pt_idx) const noexcept -> const pos_t & {
+    return _impl->point_pos(pt_idx);
+}
+
+_HIPP_TEMPHD
+template<typename T>
+auto _HIPP_TEMPCLS::point_pad(index_t pt_idx) const noexcept -> const T & {
+    return _impl->template point_pad<T>(pt_idx);
+}
+
+_HIPP_TEMPRET
+point_range(index_t node_idx) const noexcept 
+-> std::pair<index_t, index_t> 
+{
+    return _impl->point_range(node_idx);
+}
+
+_HIPP_TEMPRET
+points() const noexcept -> const vector<point_t> & {
+    return _impl->points();
+}
+
 _HIPP_TEMPHD
 template<typename Op>
 void _HIPP_TEMPCLS::walk_down(const point_t &p, Op op, index_t &node_idx) const
@@ -394,8 +732,13 @@ void _HIPP_TEMPCLS::visit_nodes_rect(const rect_t &rect, Op op,
     Policy &&policy) const
 {
     const auto &nds = nodes();
+    const auto &impl = *_impl;
     _impl->visit_rect(rect, 
-        [&op, &nds](index_t i){ op( nds[i] ); },
+        [&op, &nds, &impl](index_t i){ 
+            if( impl.points().empty() ) { op( nds[i] ); return; }
+            op( node_t(point_t(impl.point_pos(i)), 1, -1, 
+                impl.point_pad(i)) );
+        },
         std::forward<Policy>(policy));
 }
 
@@ -413,8 +756,13 @@ void _HIPP_TEMPCLS::visit_nodes_sphere(const sphere_t &sphere, Op op,
     Policy &&policy) const
 {
     const auto &nds = nodes();
+    const auto &impl = *_impl;
     _impl->visit_sphere(sphere, 
-        [&op, &nds](index_t i){ op( nds[i] ); },
+        [&op, &nds, &impl](index_t i){ 
+            if( impl.points().empty() ) { op( nds[i] ); return; }
+            op( node_t(point_t(impl.point_pos(i)), 1, -1, 
+                impl.point_pad(i)) );
+        },
         std::forward<Policy>(policy));
 }
 
@@ -426,6 +774,70 @@ auto _HIPP_TEMPCLS::count_nodes_sphere(const sphere_t &sphere,
     return _impl->count_sphere(sphere, std::forward<Policy>(policy));
 }
 
+_HIPP_TEMPHD
+template<typename PointT, typename Policy>
+void _HIPP_TEMPCLS::nearest_k_batch(ContiguousBuffer<const PointT> pts, 
+    index_t k, vector<index_t> &displs, vector<ngb_t> &ngbs,
+    const batch_query_policy_t &batch_policy, const Policy &policy) const
+{
+    _impl->nearest_k_batch(pts, k, displs, ngbs, batch_policy, policy);
+}
+
+_HIPP_TEMPHD
+template<typename Policy>
+void _HIPP_TEMPCLS::find_nodes_sphere_batch(
+    ContiguousBuffer<const sphere_t> spheres, 
+    vector<index_t> &displs, vector<index_t> &node_ids,
+    const batch_query_policy_t &batch_policy, const Policy &policy) const
+{
+    _impl->visit_sphere_batch(spheres, displs, node_ids, 
+        batch_policy, policy);
+}
+
+_HIPP_TEMPHD
+template<typename Policy>
+void _HIPP_TEMPCLS::count_nodes_sphere_batch(
+    ContiguousBuffer<const sphere_t> spheres, vector<index_t> &counts,
+    const batch_query_policy_t &batch_policy, const Policy &policy) const
+{
+    _impl->count_sphere_batch(spheres, counts, batch_policy, policy);
+}
+
+_HIPP_TEMPRET
+all_nearest_k(index_t k, vector<index_t> &node_ids, vector<ngb_t> &ngbs,
+    const all_nearest_k_policy_t &policy) const -> index_t
+{
+    return _impl->all_nearest_k(k, node_ids, ngbs, policy);
+}
+
+_HIPP_TEMPRET
+count_pairs(ContiguousBuffer<const float_t> edges, vector<double> &counts,
+    const pair_count_policy_t &policy) const -> void
+{
+    _impl->count_pairs(edges, counts, policy);
+}
+
+_HIPP_TEMPRET
+count_pairs(const KDTree &other, ContiguousBuffer<const float_t> edges, 
+    vector<double> &counts, const pair_count_policy_t &policy) const -> void
+{
+    _impl->count_pairs(*other._impl, edges, counts, policy);
+}
+
+_HIPP_TEMPRET
+fof(float_t b, vector<index_t> &group_ids, const fof_policy_t &policy) const
+-> index_t
+{
+    return _impl->fof(b, group_ids, policy);
+}
+
+_HIPP_TEMPRET
+sph_density(vector<float_t> &h, vector<float_t> &rho, 
+    const sph_policy_t &policy) const -> index_t
+{
+    return _impl->sph_density(h, rho, policy);
+}
+
 #undef _HIPP_TEMPHD
 #undef _HIPP_TEMPARG
 #undef _HIPP_TEMPCLS
@@ -1,6 +1,7 @@
 /**
 create: Yangyao CHEN, 2022/02/14
-    [write   ] _KDTreeNode, _KDTree - Implementation classes of KDTree.
+    [write   ] _KDTreeNode, _KDTreeRefNode, _KDTree - Implementation classes 
+        of KDTree.
 */
 
 
@@ -8,6 +9,17 @@ create: Yangyao CHEN, 2022/02/14
 #define _HIPPNUMERICAL_KDSEARCH_KDTREE_RAW_H_
 
 #include "kdsearch_base.h"
+#include "kdsearch_batch_query.h"
+#include "kdsearch_dual_tree.h"
+#include "kdsearch_pair_count.h"
+#include "kdsearch_fof.h"
+#include "kdsearch_sph.h"
+#include "kdsearch_refit.h"
+#include "kdsearch_veb.h"
+#include "kdsearch_simd.h"
+#include "kdsearch_archive.h"
+#include "kdsearch_periodic.h"
+#include "kdsearch_out_of_core.h"
 
 namespace HIPP::NUMERICAL::_KDSEARCH {
 
@@ -68,6 +80,42 @@ protected:
     char _pad[PADDING];
 };
 
+/**
+Node of a bucketed tree. It holds no point, but refers to the points of its
+subtree by the offset of the first one in the point arrays of the tree.
+
+first(): the first point of the subtree, i.e., the split point of a split
+node, or the first point of a leaf bucket.
+size(): number of nodes in the subtree.
+axis(): split axis, or ``-1`` for a leaf bucket.
+*/
+template<typename _IndexT>
+class _KDTreeRefNode {
+public:
+    using index_t = _IndexT;
+
+    _KDTreeRefNode() noexcept;
+    _KDTreeRefNode(index_t first, index_t size, int axis) noexcept;
+
+    ostream & info(ostream &os = cout, int fmt_cntl = 0, int level = 0) const;
+    friend ostream & operator<<(ostream &os, const _KDTreeRefNode &n) {
+        return n.info(os);
+    }
+
+    const index_t & first() const noexcept;
+    index_t & first() noexcept;
+
+    const index_t & size() const noexcept;
+    index_t & size() noexcept;
+
+    const int & axis() const noexcept;
+    int & axis() noexcept;
+protected:
+    index_t _first;
+    index_t _size;
+    int _axis;
+};
+
 template<typename KDPointT = KDPoint<>, typename IndexT = int>
 class _KDTree {
 public:
@@ -80,15 +128,18 @@ public:
     static constexpr size_t PADDING  = kd_point_t::PADDING;
 
     using node_t   = _KDTreeNode<float_t, DIM, PADDING, index_t>;
+    using ref_node_t = _KDTreeRefNode<index_t>;
     using point_t  = typename node_t::point_t;
     
     using pos_t    = typename node_t::pos_t;
     using rect_t   = GEOMETRY::Rect<float_t, DIM>;
     using sphere_t = GEOMETRY::Sphere<float_t, DIM>;
+    using periodic_box_t = _PeriodicBox<float_t, DIM>;
 
     class tree_info_t;
     struct idx_pair_t;
     struct ngb_t;
+    struct veb_node_t;
     
     class construct_policy_t;
     class query_buff_policy_t;
@@ -96,6 +147,18 @@ public:
     class nearest_k_query_policy_t;
     class rect_query_policy_t;
     class sphere_query_policy_t;
+    using batch_query_policy_t = _BatchQueryPolicy;
+    using all_nearest_k_policy_t = _AllNearestKPolicy;
+    using pair_count_policy_t = _PairCountPolicy;
+    using fof_policy_t = _FoFPolicy;
+    using sph_policy_t = _SPHPolicy<float_t>;
+    using sph_kernel_t = _SPHKernel;
+    using refit_policy_t = _RefitPolicy;
+    using refit_info_t = _RefitInfo;
+    using out_of_core_policy_t = _OutOfCorePolicy;
+    using point_run_file_t = _PointRunFile<kd_point_t>;
+    template<typename DatasetT, typename PadT = void>
+    using h5_point_source_t = _H5PointSource<kd_point_t, DatasetT, PadT>;
 
     _KDTree() noexcept;
 
@@ -120,6 +183,29 @@ public:
     void construct(ContiguousBuffer<const kd_point_t> pts, 
         const construct_policy_t &policy = construct_policy_t());
 
+    /**
+    Out-of-core construction, for points that do not fit in the memory. The 
+    points are streamed from ``src`` (e.g., ``h5_point_source_t`` or 
+    ``point_run_file_t``, see ``kdsearch_out_of_core.h`` for the requirements 
+    of a source).
+
+    The top levels are split at the exact medians found by radix selection 
+    over the streamed positions, and the points of each child are written to 
+    a bucket file under ``ooc_policy.scratch_dir()``. Once a bucket has no 
+    more than ``ooc_policy.max_in_core()`` points, its subtree is built in 
+    memory by ``construct()``. Only the nodes (and the points if 
+    ``leaf_size > 1``) are held for the whole tree.
+
+    The split axis must be ``MAX_EXTREME`` or ``MAX_VARIANCE``. With 
+    ``MAX_EXTREME`` and distinct coordinates, the tree is the same as the one
+    built by ``construct()`` on the same points, except for the order of 
+    points in each leaf bucket.
+    */
+    template<typename Source>
+    void construct_out_of_core(Source &src, 
+        const construct_policy_t &policy = construct_policy_t(),
+        const out_of_core_policy_t &ooc_policy = out_of_core_policy_t());
+
     /**
     ``I.idx_in`` is the index into ``pts`` and ``I.idx_node`` is the index 
     of NN candidate of that point.
@@ -128,6 +214,26 @@ public:
     void argsort(ContiguousBuffer<const PointT> pts, 
         vector<idx_pair_t> &idx_pairs) const;
 
+    /**
+    Refit the tree to moved points, keeping the topology, i.e., the sizes 
+    and split axes of the nodes.
+
+    ``pts[i]`` is the new point (position and padding) at point index ``i``
+    (see ``point_pos()``), hence ``pts.size()`` must equal ``n_points()``. 
+    A point is identified by its padding, as the points may be swapped to 
+    restore the order along the split axes. The swaps are minimal, i.e., a
+    node whose left subtree is still below it and right subtree above it is 
+    left as it is. As in ``construct()``, the points must be in the 
+    periodic box if there is any.
+
+    refit_info(): the growth of the total volume of the subtree bounds 
+    since the construction (see ``_RefitInfo``), to tell when a 
+    reconstruction is worth it.
+    */
+    void refit(ContiguousBuffer<const kd_point_t> pts, 
+        const refit_policy_t &policy = refit_policy_t());
+    const refit_info_t & refit_info() const noexcept;
+
     /**
     Memory management methods.
     
@@ -142,6 +248,22 @@ public:
     void shrink_buffer();
     void clear();
 
+    /**
+    Save the tree structure (nodes, points, tree info and leaf size), or 
+    load it to replace the current one.
+
+    save(), load(): use a flat binary file named ``file_name`` (see 
+    ``_FileArchive`` for the format).
+    save_h5(), load_h5(): use a HDF5 group ``g`` typed ``IO::H5::Group``.
+
+    The tree must be loaded by a ``_KDTree`` with the same point and index 
+    types. Otherwise, an ``ErrRuntime`` is thrown.
+    */
+    void save(const string &file_name) const;
+    void load(const string &file_name);
+    template<typename H5Group> void save_h5(H5Group g) const;
+    template<typename H5Group> void load_h5(H5Group g);
+
     const construct_policy_t & construct_policy() const noexcept;
     construct_policy_t & construct_policy() noexcept;
     const vector<node_t> & nodes() const noexcept;
@@ -152,13 +274,57 @@ public:
     index_t right_child_idx(index_t node_idx) const noexcept;
     index_t right_sibling_idx(index_t node_idx) const noexcept;
 
+    /**
+    Nodes and points. With ``leaf_size == 1``, the nodes are ``nodes()``, 
+    each holding its point, and a point index is a node index. Otherwise 
+    (a bucketed tree), the nodes are ``ref_nodes()``, i.e., the split nodes 
+    and one node for each leaf bucket, and each point is stored once, apart 
+    from the nodes, in compact arrays of positions and paddings in the 
+    pre-order of the tree. The indices given by the queries are always point 
+    indices.
+
+    ref_nodes(): nodes of a bucketed tree. Empty if ``leaf_size == 1``.
+    n_nodes(): number of nodes of either kind.
+    is_bucket(): whether or not the node is a leaf bucket, i.e., a node with
+    no child whose points are scanned together.
+    n_points(), point_pos(), point_pad(): the number of points, and the 
+    position and padding of point ``pt_idx``.
+    point_range(): the points ``[first, last)`` in the subtree rooted at node
+    ``node_idx``. Unless the node is a bucket, the first one is its split 
+    point.
+    points(): positions of the points of a bucketed tree. Empty if 
+    ``leaf_size == 1``.
+    */
+    const vector<ref_node_t> & ref_nodes() const noexcept;
+    index_t n_nodes() const noexcept;
+    bool is_bucket(index_t node_idx) const noexcept;
+    index_t n_points() const noexcept;
+    const pos_t & point_pos(index_t pt_idx) const noexcept;
+    template<typename T = char[PADDING]>
+    const T & point_pad(index_t pt_idx) const noexcept;
+    std::pair<index_t, index_t> point_range(index_t node_idx) const noexcept;
+    const vector<point_t> & points() const noexcept;
+
+    /**
+    The descent index, built if ``construct_policy().veb_layout()`` is on.
+    It is a copy of the split planes of the nodes in a complete binary tree 
+    of height ``tree_info().max_depth()``, in the van Emde Boas layout (see 
+    ``_VEBLayout``). Slots with no node have ``idx == -1``.
+
+    ``walk_down()`` from the root descends in this index, so that a path 
+    touches ``O(log_B N)`` cache lines of ``B`` nodes, rather than up to one
+    line per level in the pre-order of ``nodes()``.
+    */
+    const vector<veb_node_t> & veb_nodes() const noexcept;
+    const _VEBLayout & veb_layout() const noexcept;
+
     /**
     Walk down from a node indexed ``node_idx`` to a leaf node. 
     
     For a node ``n`` on the walk path, if 
     ``p.pos()[n.axis()] <= n.pos()[n.axis()]``, the left child of it is the 
-    next node to visit, otherwise the right. If no such child exists, the walk
-    is stopped.
+    next node to visit, otherwise the right. If no such child exists, or 
+    ``n`` is a leaf bucket, the walk is stopped.
 
     ``op(i)`` is called successively on each node on the path where ``i`` is the
     node index. On entry, ``node_idx`` specifies the index of the first node to
@@ -179,7 +345,7 @@ public:
         Policy &&policy = Policy()) const;
 
     /**
-    ``op(i)`` is called on each visited node indexed ``i``.
+    ``op(i)`` is called on each visited point indexed ``i``.
     */
     template<typename Op, typename Policy = rect_query_policy_t>
     void visit_rect(const rect_t &rect, Op op, 
@@ -194,12 +360,146 @@ public:
     template<typename Policy = sphere_query_policy_t>
     index_t count_sphere(const sphere_t &sphere,
         Policy &&policy = Policy()) const;
+
+    /**
+    Batch queries. Each thread makes queries with its own copy of ``policy``.
+    The results of query ``i`` are in ``[displs[i], displs[i+1])`` of the flat
+    output array.
+    */
+    template<typename PointT, typename Policy = nearest_k_query_policy_t>
+    void nearest_k_batch(ContiguousBuffer<const PointT> pts, index_t k,
+        vector<index_t> &displs, vector<ngb_t> &ngbs,
+        const batch_query_policy_t &batch_policy = batch_query_policy_t(),
+        const Policy &policy = Policy()) const;
+
+    template<typename Policy = sphere_query_policy_t>
+    void visit_sphere_batch(ContiguousBuffer<const sphere_t> spheres,
+        vector<index_t> &displs, vector<index_t> &node_ids,
+        const batch_query_policy_t &batch_policy = batch_query_policy_t(),
+        const Policy &policy = Policy()) const;
+    template<typename Policy = sphere_query_policy_t>
+    void count_sphere_batch(ContiguousBuffer<const sphere_t> spheres,
+        vector<index_t> &counts,
+        const batch_query_policy_t &batch_policy = batch_query_policy_t(),
+        const Policy &policy = Policy()) const;
+
+    /**
+    All-k-nearest-neighbor query by the dual-tree algorithm, i.e., find the 
+    first k nearest points of every point in the tree.
+
+    On exit, ``node_ids`` is resized to the number of points ``N`` and 
+    ``ngbs`` to ``N * k_used``, where 
+    ``k_used = min(k, N)`` if the point itself is included as a neighbor, 
+    otherwise ``min(k, N-1)``. The neighbors of point ``node_ids[i]`` are 
+    ``ngbs[i*k_used : (i+1)*k_used]``, sorted by distance. ``k_used`` is 
+    returned.
+    */
+    index_t all_nearest_k(index_t k, vector<index_t> &node_ids, 
+        vector<ngb_t> &ngbs, const all_nearest_k_policy_t &policy 
+            = all_nearest_k_policy_t()) const;
+
+    /**
+    Binned pair counting by the dual-tree algorithm. ``edges`` are the 
+    ascending bin edges of the pair distance (see ``_PairBins``). On exit, 
+    ``counts`` is resized to the number of bins, holding the (weighted) 
+    number of pairs in each bin.
+
+    (1): auto pairs, i.e., unordered pairs of distinct points in the tree.
+    (2): cross pairs, i.e., pairs of a point in this tree and a point in 
+    ``other``.
+    
+    Distances are the minimum-image ones if the tree (this one, for (2)) is 
+    constructed with a periodic box.
+    */
+    void count_pairs(ContiguousBuffer<const float_t> edges, 
+        vector<double> &counts, const pair_count_policy_t &policy 
+            = pair_count_policy_t()) const;
+    void count_pairs(const _KDTree &other, 
+        ContiguousBuffer<const float_t> edges, vector<double> &counts, 
+        const pair_count_policy_t &policy = pair_count_policy_t()) const;
+
+    /**
+    Friends-of-friends groups, i.e., points at a distance less than the 
+    linking length ``b`` are in the same group, transitively. On exit, 
+    ``group_ids[i]`` is the group of point ``i``, or ``-1`` if the group has
+    less than ``policy.min_size()`` points. Groups are numbered 0, 1, ... in
+    the order of their first points. Return the number of groups.
+
+    Distances are the minimum-image ones with a periodic box.
+    */
+    index_t fof(float_t b, vector<index_t> &group_ids, 
+        const fof_policy_t &policy = fof_policy_t()) const;
+
+    /**
+    SPH smoothing lengths and densities of the points (see ``_SPHSolver``). 
+    On entry, the positive entries of ``h`` (if it has the size of the 
+    points) are the initial guesses. On exit, ``h[i]`` and ``rho[i]`` are 
+    the results of point ``i``. Return the number of points not converged.
+
+    Distances are the minimum-image ones with a periodic box, where the 
+    search radius must be no larger than half the box size.
+    */
+    index_t sph_density(vector<float_t> &h, vector<float_t> &rho, 
+        const sph_policy_t &policy = sph_policy_t()) const;
 private:
     construct_policy_t _construct_policy;
     tree_info_t _tree_info;
     vector<node_t> _nodes;
+    vector<ref_node_t> _ref_nodes;
+    vector<point_t> _pts;
+    vector<char> _pads;
+    refit_info_t _refit_info;
+    _VEBLayout _veb_layout;
+    vector<veb_node_t> _veb_nodes;
 
     struct _Impl_construct;
+    struct _Impl_construct_out_of_core;
+    struct _Impl_refit;
+
+    template<typename Archive> void _save(Archive &ar) const;
+    template<typename Archive> void _load(Archive &ar);
+
+    /**
+    A bucketed tree has the nodes ``_ref_nodes`` and the points ``_pts`` 
+    (positions) and ``_pads`` (paddings). The subtree rooted at node ``i`` 
+    has the points from ``_ref_nodes[i].first()`` to the first point of the
+    node next to the subtree. All are empty if ``leaf_size == 1``.
+
+    _bucketed(): whether or not the points are kept apart from the nodes.
+    _node_size(), _node_axis(): size and split axis of a node of either kind.
+    _first_point(): the first point in the subtree of node ``node_idx``.
+    _n_nodes_of(): number of nodes of a subtree of ``n_pts`` points.
+    _resize(): allocate the nodes and points for ``n_pts`` points, by the 
+    current construct policy.
+    _put_point(): store the position and padding of a point in a bucketed 
+    tree.
+    */
+    bool _bucketed() const noexcept;
+    index_t _node_size(index_t node_idx) const noexcept;
+    int _node_axis(index_t node_idx) const noexcept;
+    index_t _first_point(index_t node_idx) const noexcept;
+    static index_t _n_nodes_of(index_t n_pts, index_t leaf_size) noexcept;
+    void _resize(index_t n_pts);
+    void _put_point(const kd_point_t &pt, index_t pt_idx) noexcept;
+
+    /**
+    Views of the nodes of either kind with the same interface (see the 
+    implementation), so that a traversal is compiled for each kind. 
+    _with_view(): call ``op(view)`` with the view of this tree.
+    */
+    struct _NodeView;
+    struct _RefNodeView;
+    template<typename Op>
+    decltype(auto) _with_view(Op &&op) const;
+
+    /**
+    _update_veb(): rebuild (or clear) the descent index after the nodes are 
+    changed.
+    _walk_down_veb(): walk_down() from the root, in the descent index.
+    */
+    void _update_veb();
+    template<typename Op>
+    void _walk_down_veb(const point_t &p, Op &op, index_t &node_idx) const;
 
     /**
     Base classes for neighbor searching implementation. 
@@ -209,18 +509,23 @@ private:
     The pre-order/in-order searching algorithms are used for fix-domain and
     adapt-domain queries, respectively.
     */
-    struct _Impl_query_base;
-    template<typename Policy> struct _Impl_query_pre_order;
-    template<typename Policy> struct _Impl_query_in_order;
+    template<typename View> struct _Impl_query_base;
+    template<typename Policy, typename View> struct _Impl_query_pre_order;
+    template<typename Policy, typename View> struct _Impl_query_in_order;
 
     /**
     Concrete classes for implementing nearest(), nearest_k(), visit_rect(), 
     and visit_sphere(), respectively.
     */
-    template<typename Policy> struct _Impl_nearest;
-    template<typename Policy> struct _Impl_nearest_k;
-    template<typename Op, typename Policy> struct _Impl_visit_rect;
-    template<typename Op, typename Policy> struct _Impl_visit_sphere;    
+    template<typename Policy, typename View> struct _Impl_nearest;
+    template<typename Policy, typename View> struct _Impl_nearest_k;
+    template<typename Op, typename Policy, typename View> 
+    struct _Impl_visit_rect;
+    template<typename Op, typename Policy, typename View> 
+    struct _Impl_visit_sphere;
+
+    struct _Impl_all_nearest_k;
+    struct _Impl_count_pairs;
 };
 
 template<typename KDPointT, typename IndexT>
@@ -235,6 +540,11 @@ public:
     using random_seed_t = rng_t::seed_t;
     static constexpr random_seed_t DFLT_RANDOM_SEED = 0;
 
+    static constexpr int DFLT_N_THREADS = 1;
+    static constexpr index_t DFLT_SERIAL_CUTOFF = 1 << 16;
+    static constexpr index_t DFLT_LEAF_SIZE = 1;
+    static constexpr bool DFLT_VEB_LAYOUT = false;
+
     construct_policy_t();
     construct_policy_t(const construct_policy_t &pl);
     const construct_policy_t & operator=(const construct_policy_t & pl);
@@ -248,6 +558,61 @@ public:
 
     random_seed_t random_seed() const noexcept;
     construct_policy_t & set_random_seed(random_seed_t seed);
+
+    /**
+    Parallel construction. If ``n_threads > 1``, the top levels of the tree are
+    split serially, and the subtrees are then built concurrently by at most 
+    ``n_threads`` threads. A range with no more than ``serial_cutoff`` points
+    is always built by a single thread.
+
+    The resulting tree is exactly the same as the serial one. The 
+    ``split_axis_t::RANDOM`` mode consumes the random number sequence in the 
+    depth-first order, hence it is always built serially.
+    */
+    int n_threads() const noexcept;
+    construct_policy_t & set_n_threads(int n_threads) noexcept;
+
+    index_t serial_cutoff() const noexcept;
+    construct_policy_t & set_serial_cutoff(index_t serial_cutoff) noexcept;
+
+    /**
+    Bucketed leaves. A range with no more than ``leaf_size`` points is not 
+    split further but stored as a leaf bucket, i.e., a single node with 
+    ``axis() == -1`` and ``size() == 1``. Each point is then stored once, 
+    apart from the nodes, in compact arrays of positions and paddings, and
+    the nodes (``_KDTree::ref_nodes()``) refer to them by offset. The 
+    queries scan a bucket linearly over the positions. The query results 
+    are point indices.
+
+    ``leaf_size == 1`` gives the classic tree where each node is a split node 
+    holding its point, and a point index is a node index.
+    */
+    index_t leaf_size() const noexcept;
+    construct_policy_t & set_leaf_size(index_t leaf_size) noexcept;
+
+    /**
+    Periodic boundary. Along each axis ``i`` with ``box_size[i] > 0``, the 
+    space is periodic with period ``box_size[i]``, and all points must be in
+    ``[0, box_size[i])``. The tree is built on the points as they are - no 
+    point is replicated. Queries take the minimum-image distances, and 
+    regions are wrapped into the box. A sphere query requires the radius 
+    to be no larger than half the box size.
+
+    The default (or ``box_size <= 0``) is not periodic. The scalar overload
+    sets all axes.
+    */
+    const periodic_box_t & periodic_box() const noexcept;
+    construct_policy_t & set_periodic_box(float_t box_size) noexcept;
+    construct_policy_t & set_periodic_box(const pos_t &box_size) noexcept;
+
+    /**
+    Build the descent index in the van Emde Boas layout (see 
+    ``_KDTree::veb_nodes()``) for ``walk_down()`` and ``argsort()``. It 
+    takes up to two entries of ``sizeof(float_t) + sizeof(int) + 
+    sizeof(index_t)`` bytes per node. Default off.
+    */
+    bool veb_layout() const noexcept;
+    construct_policy_t & set_veb_layout(bool on) noexcept;
 private:
     friend class _KDTree;
 
@@ -256,6 +621,12 @@ private:
     random_seed_t _random_seed;
     rng_t::engine_t _re;
     rng_t _rng;
+
+    int _n_threads;
+    index_t _serial_cutoff;
+    index_t _leaf_size;
+    periodic_box_t _periodic_box;
+    bool _veb_layout;
 };
 
 template<typename KDPointT, typename IndexT>
@@ -283,6 +654,17 @@ struct _KDTree<KDPointT, IndexT>::idx_pair_t {
     }
 };
 
+/**
+An entry of the descent index, i.e., the split plane ``x[axis] = split`` of 
+node ``idx``. ``axis < 0`` for a leaf bucket.
+*/
+template<typename KDPointT, typename IndexT>
+struct _KDTree<KDPointT, IndexT>::veb_node_t {
+    float_t split;
+    int axis;
+    index_t idx;
+};
+
 template<typename KDPointT, typename IndexT>
 struct _KDTree<KDPointT, IndexT>::ngb_t {
     index_t node_idx;
@@ -292,6 +674,14 @@ struct _KDTree<KDPointT, IndexT>::ngb_t {
 };
 
 
+/**
+Base of the query policies. The traversal stacks of the queries are taken 
+from a thread-local pool (see ``_QueryBuffPool``), hence a query made with a 
+temporary policy (e.g., the default argument) allocates nothing in the 
+steady state, and a policy may be shared by nested queries. ``get_buff()`` 
+and ``container()`` are a buffer owned by the policy, left for the 
+user-defined use.
+*/
 template<typename KDPointT, typename IndexT>
 class _KDTree<KDPointT, IndexT>::query_buff_policy_t {
 public:
@@ -308,7 +698,31 @@ protected:
 template<typename KDPointT, typename IndexT>
 class _KDTree<KDPointT, IndexT>::nearest_query_policy_t : 
     public query_buff_policy_t 
-{};
+{
+public:
+    nearest_query_policy_t() noexcept;
+
+    /**
+    Approximate search. A subtree is pruned if its lower-bound distance to 
+    the query, times ``1 + eps``, is not less than the distance to the 
+    current result, i.e., the result is at most ``1 + eps`` times farther 
+    than the exact one. ``eps = 0`` (default) gives the exact search.
+    */
+    float_t eps() const noexcept;
+    nearest_query_policy_t & set_eps(float_t eps);
+
+    /**
+    Number of nodes whose distances to the query are computed, accumulated 
+    over the queries made with this policy.
+    */
+    size_t n_visited() const noexcept;
+    nearest_query_policy_t & reset_n_visited() noexcept;
+protected:
+    friend class _KDTree;
+
+    float_t _eps;
+    size_t _n_visited;
+};
 
 template<typename KDPointT, typename IndexT>
 class _KDTree<KDPointT, IndexT>::nearest_k_query_policy_t : 
@@ -319,8 +733,22 @@ public:
     bool sort_by_distance() const noexcept;
     nearest_k_query_policy_t & sort_by_distance_on() noexcept;
     nearest_k_query_policy_t & sort_by_distance_off() noexcept;
+
+    /**
+    Approximate search and node-visit counts, the same as 
+    ``nearest_query_policy_t``. With ``eps > 0``, the i-th neighbor found 
+    is at most ``1 + eps`` times farther than the exact i-th one.
+    */
+    float_t eps() const noexcept;
+    nearest_k_query_policy_t & set_eps(float_t eps);
+    size_t n_visited() const noexcept;
+    nearest_k_query_policy_t & reset_n_visited() noexcept;
 protected:
+    friend class _KDTree;
+
     bool _sort_by_distance;
+    float_t _eps;
+    size_t _n_visited;
 };
 
 template<typename KDPointT, typename IndexT>
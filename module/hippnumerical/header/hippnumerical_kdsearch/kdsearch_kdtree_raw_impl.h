@@ -9,6 +9,7 @@ Implementation of kdsearch_kdtree_raw.h
 
 #include "kdsearch_kdtree_raw.h"
 #include <limits>
+#include <random>
 
 namespace HIPP::NUMERICAL::_KDSEARCH {
 
@@ -109,6 +110,69 @@ auto _HIPP_TEMPCLS::pad() const noexcept -> const T & {
 #undef _HIPP_TEMPRET
 #undef _HIPP_TEMPNORET
 
+#define _HIPP_TEMPHD template<typename _IndexT>
+#define _HIPP_TEMPARG <_IndexT>
+#define _HIPP_TEMPCLS _KDTreeRefNode _HIPP_TEMPARG
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPNORET 
+_KDTreeRefNode() noexcept {}
+
+_HIPP_TEMPNORET 
+_KDTreeRefNode(index_t first, index_t size, int axis) noexcept 
+: _first(first), _size(size), _axis(axis) {}
+
+_HIPP_TEMPRET
+info(ostream &os, int fmt_cntl, int level) const -> ostream & {
+    PStream ps{os};
+    if( fmt_cntl < 1 ) {
+        ps << HIPPCNTL_CLASS_INFO_INLINE(_KDTreeRefNode),
+        "{first=", _first, ", size=", _size, ", axis=", _axis, "}";
+        return os;
+    }
+    auto ind = HIPPCNTL_CLASS_INFO_INDENT_STR(level);
+    ps << HIPPCNTL_CLASS_INFO(_KDTreeRefNode),
+    ind, "First = ", _first, ", size = ", _size, ", axis = ", _axis, '\n';
+    return os;
+}
+
+_HIPP_TEMPRET
+first() const noexcept -> const index_t & {
+    return _first;
+}
+
+_HIPP_TEMPRET
+first() noexcept -> index_t & {
+    return _first;
+}
+
+_HIPP_TEMPRET
+size() const noexcept -> const index_t & {
+    return _size;
+}
+
+_HIPP_TEMPRET
+size() noexcept -> index_t & {
+    return _size;
+}
+
+_HIPP_TEMPRET
+axis() const noexcept -> const int & {
+    return _axis;
+}
+
+_HIPP_TEMPRET
+axis() noexcept -> int & {
+    return _axis;
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
+
 #define _HIPP_TEMPHD template<typename KDPointT, typename IndexT>
 #define _HIPP_TEMPARG <KDPointT, IndexT>
 #define _HIPP_TEMPCLS _KDTree _HIPP_TEMPARG
@@ -120,13 +184,17 @@ _HIPP_TEMPNORET _KDTree() noexcept {}
 
 _HIPP_TEMPNORET _KDTree(const _KDTree &o) 
 : _construct_policy(o._construct_policy), _tree_info(o._tree_info), 
-_nodes(o._nodes)
+_nodes(o._nodes), _ref_nodes(o._ref_nodes), _pts(o._pts), _pads(o._pads), 
+_refit_info(o._refit_info), _veb_layout(o._veb_layout), 
+_veb_nodes(o._veb_nodes)
 {}
 
 _HIPP_TEMPNORET _KDTree(_KDTree &&o) 
 : _construct_policy(std::move(o._construct_policy)), 
 _tree_info(std::move(o._tree_info)), 
-_nodes(std::move(o._nodes))
+_nodes(std::move(o._nodes)), _ref_nodes(std::move(o._ref_nodes)), 
+_pts(std::move(o._pts)), _pads(std::move(o._pads)), _refit_info(o._refit_info), _veb_layout(o._veb_layout), 
+_veb_nodes(std::move(o._veb_nodes))
 {}
 
 _HIPP_TEMPRET 
@@ -135,6 +203,12 @@ operator=(const _KDTree &o) noexcept -> _KDTree &  {
         _construct_policy = o._construct_policy;
         _tree_info = o._tree_info;
         _nodes = o._nodes;
+        _ref_nodes = o._ref_nodes;
+        _pts = o._pts;
+        _pads = o._pads;
+        _refit_info = o._refit_info;
+        _veb_layout = o._veb_layout;
+        _veb_nodes = o._veb_nodes;
     }
     return *this;
 }
@@ -145,6 +219,12 @@ operator=(_KDTree &&o) noexcept -> _KDTree &  {
         _construct_policy = std::move(o._construct_policy);
         _tree_info = std::move(o._tree_info);
         _nodes = std::move(o._nodes);
+        _ref_nodes = std::move(o._ref_nodes);
+        _pts = std::move(o._pts);
+        _pads = std::move(o._pads);
+        _refit_info = o._refit_info;
+        _veb_layout = o._veb_layout;
+        _veb_nodes = std::move(o._veb_nodes);
     }
     return *this;
 }
@@ -155,8 +235,10 @@ _HIPP_TEMPNORET
 _HIPP_TEMPRET
 info(ostream &os, int fmt_cntl, int level) const -> ostream &  {
     PStream ps(os);
-    size_t n_nodes = _nodes.size();
-    size_t buf_sz = _nodes.capacity() * sizeof(node_t);
+    size_t n_nodes = this->n_nodes();
+    size_t buf_sz = _nodes.capacity() * sizeof(node_t) 
+        + _ref_nodes.capacity() * sizeof(ref_node_t)
+        + _pts.capacity() * sizeof(point_t) + _pads.capacity();
     if( fmt_cntl < 1 ) {
         ps << HIPPCNTL_CLASS_INFO_INLINE(_KDTree), "{", 
         "no. nodes=", n_nodes, ", buf size=", 
@@ -176,23 +258,25 @@ struct _HIPP_TEMPCLS::_Impl_construct {
 
     _KDTree &dst;
     vector<node_t> &nodes;
+    vector<ref_node_t> &ref_nodes;
     tree_info_t &tree_info;
 
     const kd_point_t * __restrict__ p_pts;
     const index_t n_pts;
     construct_policy_t &pl;
+    const bool bucketed;
     
-    int cur_split_axis;
     vector<index_t> sorted_ids;
 
 _Impl_construct(_KDTree &_dst, ContiguousBuffer<const kd_point_t> _pts, 
     const construct_policy_t &_pl) 
-: dst(_dst), nodes(dst._nodes), tree_info(dst._tree_info),
-p_pts(_pts.get_cbuff()), n_pts(_pts.get_size()), pl(dst._construct_policy),
-cur_split_axis(0), sorted_ids(n_pts)
+: dst(_dst), nodes(dst._nodes), ref_nodes(dst._ref_nodes), 
+tree_info(dst._tree_info), p_pts(_pts.get_cbuff()), n_pts(_pts.get_size()), 
+pl(dst._construct_policy), bucketed(_pl._leaf_size > 1), sorted_ids(n_pts)
 {
-    nodes.resize(n_pts);
     dst._construct_policy = _pl;
+    verify_args();
+    dst._resize(n_pts);
 }
 
 void operator()() 
@@ -200,18 +284,52 @@ void operator()()
     for(index_t i=0; i<n_pts; ++i) 
         sorted_ids[i] = i;
 
+    using spl_ax_t = typename construct_policy_t::split_axis_t;
+    if( pl._n_threads > 1 && pl._split_axis != spl_ax_t::RANDOM )
+        construct_parallel(0, n_pts, 0, 0, pl._n_threads);
+    else
+        construct_serial(0, n_pts, 0, 0);
+
+    // Update tree_info. Use sorted_ids as buffer.
+    find_info();
+}
+
+void verify_args() const {
+    if( pl._n_threads < 1 || pl._serial_cutoff < 1 || pl._leaf_size < 1 )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB, 
+            "  ... invalid no. of threads ", pl._n_threads, 
+            ", serial cutoff ", pl._serial_cutoff, 
+            " or leaf size ", pl._leaf_size);
+}
+
+/**
+Build the subtree of points in the range ``[b, e)`` of ``sorted_ids``, whose 
+root node is at ``n_cur`` and first point at ``p_cur``. Its left and right 
+subtrees are at nodes ``n_cur+1`` and ``n_cur+1+n_nodes_l``, and points 
+``p_cur+1`` and ``p_cur+1+(pivot-b)``, respectively, where ``n_nodes_l`` is 
+the number of nodes of the left subtree. Hence disjoint subtrees can be 
+built independently. A range of no more than ``leaf_size`` points becomes a 
+leaf bucket if ``leaf_size > 1``.
+
+Without buckets, the points are in the nodes and ``p_cur`` is unused.
+*/
+void construct_serial(index_t b, index_t e, index_t n_cur, index_t p_cur) {
     std::stack<std::pair<index_t, index_t> > idx_ranges;
-    index_t b = 0, e = n_pts, n_cur = 0;
     while( b != e ) {
-        
-        // Update cur_split_axis.
-        const int axis = find_best_axis(b, e);            
+        if( is_bucket_range(b, e) ) {
+            construct_bucket(b, e, n_cur++, p_cur);
+            p_cur += e - b;
+            if( idx_ranges.empty() ) break;
+            std::tie(b,e) = idx_ranges.top();
+            idx_ranges.pop();
+            continue;
+        }
+        const int axis = find_best_axis(b, e, n_cur);            
 
         // Update sorted_ids.
         const index_t pivot = pivot_at(b, e, axis);
 
-        auto &pt = get_point(pivot);
-        nodes[n_cur++] = node_t{pt, e-b, axis, pt.pad()};
+        construct_split(pivot, e-b, axis, n_cur++, p_cur++);
         if( b != pivot ) {
             if( pivot+1 != e ) idx_ranges.emplace(pivot+1, e);
             e = pivot;
@@ -222,39 +340,98 @@ void operator()()
             e = b;
         }
     }
-    assert(n_cur == n_pts);
+}
+
+bool is_bucket_range(index_t b, index_t e) const noexcept {
+    return bucketed && e - b <= pl._leaf_size;
+}
+
+/**
+The split node of a subtree of ``n`` points. In a bucketed tree, the point 
+is stored at ``p_cur``, and the node refers to it.
+*/
+void construct_split(index_t pivot, index_t n, int axis, index_t n_cur, 
+    index_t p_cur) noexcept 
+{
+    auto &pt = get_point(pivot);
+    const index_t sz = _n_nodes_of(n, pl._leaf_size);
+    if( !bucketed ) {
+        nodes[n_cur] = node_t{pt, sz, axis, pt.pad()};
+        return;
+    }
+    ref_nodes[n_cur] = ref_node_t{p_cur, sz, axis};
+    dst._put_point(pt, p_cur);
+}
 
-    // Update tree_info. Use sorted_ids as buffer.
-    find_info();
+void construct_bucket(index_t b, index_t e, index_t n_cur, 
+    index_t p_cur) noexcept 
+{
+    ref_nodes[n_cur] = ref_node_t{p_cur, 1, -1};
+    for(index_t i=b; i<e; ++i) 
+        dst._put_point(get_point(i), p_cur+(i-b));
 }
 
-const kd_point_t & get_point(int i) const noexcept { 
+void construct_parallel(index_t b, index_t e, index_t n_cur, index_t p_cur,
+    int n_threads) 
+{
+    if( n_threads <= 1 || e - b <= pl._serial_cutoff 
+        || is_bucket_range(b, e) ) {
+        construct_serial(b, e, n_cur, p_cur); return;
+    }
+    const int axis = find_best_axis(b, e, n_cur, n_threads);
+    const index_t pivot = pivot_at(b, e, axis);
+    construct_split(pivot, e-b, axis, n_cur, p_cur);
+
+    // e - b > serial_cutoff >= 1, hence the left subtree is non-empty. The
+    // right one is empty if e - b == 2, which construct_serial() handles.
+    const index_t n_l = pivot - b, 
+        n_cur_r = n_cur + 1 + _n_nodes_of(n_l, pl._leaf_size);
+    const int n_threads_l = n_threads / 2;
+    std::thread th_l(&_Impl_construct::construct_parallel, this, 
+        b, pivot, n_cur+1, p_cur+1, n_threads_l);
+    construct_parallel(pivot+1, e, n_cur_r, p_cur+1+n_l, 
+        n_threads-n_threads_l);
+    th_l.join();
+}
+
+const kd_point_t & get_point(index_t i) const noexcept { 
     return p_pts[ sorted_ids[i] ]; 
 }
 
-int find_best_axis(index_t b, index_t e) {   
+int find_best_axis(index_t b, index_t e, index_t n_cur, int n_threads = 1) {   
     int axis = -1;
     using spl_ax_t = typename construct_policy_t::split_axis_t;
     switch (pl._split_axis) {
         case spl_ax_t::MAX_EXTREME :
-            axis = max_extreme_axis(b, e); break;
+            axis = max_extreme_axis(b, e, n_threads); break;
         case spl_ax_t::MAX_VARIANCE : 
             axis = max_variance_axis(b, e); break;
         case spl_ax_t::ORDERED : 
-            axis = cur_split_axis++ % DIM; break;
+            axis = static_cast<int>(n_cur % DIM); break;
         default : 
             axis = pl._rng(); break;
     }
     return axis;
 }
 
-int max_extreme_axis(index_t b, index_t e) {
+int max_extreme_axis(index_t b, index_t e, int n_threads) {
     using lim = std::numeric_limits<float_t>;
-    pos_t min_pos(lim::max()), max_pos(lim::lowest());
-    for(auto i=b; i<e; ++i){
-        const auto &pos = get_point(i).pos();
-        min_pos[ pos < min_pos ] = pos;
-        max_pos[ pos > max_pos ] = pos;
+    vector<pos_t> min_poss(n_threads, pos_t(lim::max())), 
+        max_poss(n_threads, pos_t(lim::lowest()));
+    _parallel_for(n_threads, e-b, [&](int i_th, index_t _b, index_t _e) {
+        pos_t min_pos(lim::max()), max_pos(lim::lowest());
+        for(auto i=b+_b; i<b+_e; ++i){
+            const auto &pos = get_point(i).pos();
+            min_pos[ pos < min_pos ] = pos;
+            max_pos[ pos > max_pos ] = pos;
+        }
+        min_poss[i_th] = min_pos;
+        max_poss[i_th] = max_pos;
+    });
+    auto &min_pos = min_poss[0], &max_pos = max_poss[0];
+    for(int i=1; i<n_threads; ++i) {
+        min_pos[ min_poss[i] < min_pos ] = min_poss[i];
+        max_pos[ max_poss[i] > max_pos ] = max_poss[i];
     }
     auto ret = (max_pos - min_pos).max_index();
     return static_cast<int>(ret);
@@ -264,14 +441,14 @@ int max_variance_axis(index_t b, index_t e) {
     using dvec_t = SVec<double, DIM>;
     
     dvec_t mean_pos(0.0);
-    for(int i=b; i<e; ++i){
+    for(index_t i=b; i<e; ++i){
         auto &pos = get_point(i).pos();
         mean_pos += dvec_t(pos);
     }
     mean_pos /= static_cast<double>(e-b);
 
     dvec_t pos_var(0.0);
-    for(int i=b; i<e; ++i){
+    for(index_t i=b; i<e; ++i){
         auto &pos = get_point(i).pos();
         auto dpos = dvec_t(pos) - mean_pos;
         pos_var += dpos*dpos;
@@ -298,17 +475,18 @@ void find_info() {
     index_t max_depth = 0;
     auto &depths = sorted_ids;
     depths[0] = 0;
-    for(index_t i=0; i<n_pts; ++i){
+    const index_t n_nodes = dst.n_nodes();
+    for(index_t i=0; i<n_nodes; ++i){
         auto &depth = depths[i];
         ++depth;
         if( depth > max_depth ) max_depth = depth;
 
-        const node_t &n = nodes[i];
-        if( n.size() == 1 ) continue;
+        const index_t sz = dst._node_size(i);
+        if( sz == 1 ) continue;
         
         const index_t left = dst.left_child_idx(i);
         depths[left] = depth;
-        if( n.size() == 2 ) continue;
+        if( sz == 2 ) continue;
 
         const index_t right = dst.right_sibling_idx(left);
         depths[right] = depth;
@@ -324,6 +502,509 @@ construct(ContiguousBuffer<const kd_point_t> pts,
     const construct_policy_t &policy) -> void 
 {
     _Impl_construct{*this, pts, policy}();
+    _refit_info.reset();
+    _update_veb();
+}
+
+_HIPP_TEMPHD
+struct _HIPP_TEMPCLS::_Impl_construct_out_of_core {
+
+    using radix_key_t = _RadixKey<float_t>;
+    using key_t = typename radix_key_t::key_t;
+    using run_t = point_run_file_t;
+
+    static constexpr int DIGIT_BITS = 16;
+    static constexpr key_t DIGIT_MASK = (key_t(1) << DIGIT_BITS) - 1;
+
+    _KDTree &dst;
+    vector<node_t> &nodes;
+    vector<ref_node_t> &ref_nodes;
+    const construct_policy_t &pl;
+    const out_of_core_policy_t &ooc_pl;
+
+    index_t max_depth;
+    vector<kd_point_t> buf;
+    string file_prefix;
+    size_t n_files;
+
+_Impl_construct_out_of_core(_KDTree &_dst, const construct_policy_t &_pl,
+    const out_of_core_policy_t &_ooc_pl)
+: dst(_dst), nodes(dst._nodes), ref_nodes(dst._ref_nodes), 
+pl(dst._construct_policy), ooc_pl(_ooc_pl), max_depth(0), n_files(0)
+{
+    dst._construct_policy = _pl;
+    verify_args();
+    buf.resize(ooc_pl.chunk_size());
+    std::random_device rd;
+    file_prefix = ooc_pl.scratch_dir() + "/hipp_kdtree_ooc_" 
+        + std::to_string(rd()) + "_" + std::to_string(rd()) + "_";
+}
+
+template<typename Source>
+void operator()(Source &src) {
+    dst._resize(static_cast<index_t>(src.size()));
+    build(src, 0, 0, 1);
+    dst._tree_info._max_depth = max_depth;
+}
+
+void verify_args() const {
+    using spl_ax_t = typename construct_policy_t::split_axis_t;
+    if( pl._n_threads < 1 || pl._serial_cutoff < 1 || pl._leaf_size < 1 )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB, 
+            "  ... invalid no. of threads ", pl._n_threads, 
+            ", serial cutoff ", pl._serial_cutoff, 
+            " or leaf size ", pl._leaf_size);
+    if( pl._split_axis != spl_ax_t::MAX_EXTREME 
+        && pl._split_axis != spl_ax_t::MAX_VARIANCE )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB, 
+            "  ... split axis must be MAX_EXTREME or MAX_VARIANCE\n");
+    if( ooc_pl.max_in_core() < 1 || ooc_pl.chunk_size() < 1 )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB, 
+            "  ... invalid max in core ", ooc_pl.max_in_core(), 
+            " or chunk size ", ooc_pl.chunk_size(), '\n');
+}
+
+/**
+Build the subtree of the points in ``run``, rooted at node ``n_cur`` at 
+``depth``, whose first point is at ``p_cur`` (bucketed trees only). The 
+root is split at the exact median, whose rank among the keys is found by 
+radix selection. The points with smaller keys, and the 
+ties needed to fill the left subtree, go to the left bucket. The rest, 
+except the pivot, go to the right bucket. Buckets are removed once read. 
+*/
+template<typename Run>
+void build(Run &run, index_t n_cur, index_t p_cur, index_t depth) {
+    const index_t n = static_cast<index_t>(run.size());
+    if( n == 0 ) return;
+    if( n <= ooc_pl.max_in_core() 
+        || (pl._leaf_size > 1 && n <= pl._leaf_size) ) {
+        build_in_core(run, n_cur, p_cur, depth); return;
+    }
+
+    const int axis = find_axis(run);
+    const index_t n_left = n / 2;
+    key_t pivot_key;
+    index_t n_less;
+    std::tie(pivot_key, n_less) = select(run, axis, n_left);
+
+    run_t left(new_file_name(), true), right(new_file_name(), true);
+    kd_point_t pivot;
+    {
+        vector<kd_point_t> buf_l, buf_r;
+        auto put = [&](run_t &r, vector<kd_point_t> &b, 
+            const kd_point_t &p) 
+        {
+            b.push_back(p);
+            if( b.size() == buf.size() ) {
+                r.append(b.data(), b.size()); b.clear();
+            }
+        };
+        index_t n_eq_left = n_left - n_less;
+        bool has_pivot = false;
+        for_each_chunk(run, [&](const kd_point_t &p) {
+            const key_t key = radix_key_t::key(p.pos()[axis]);
+            if( key < pivot_key ) 
+                put(left, buf_l, p);
+            else if( key > pivot_key ) 
+                put(right, buf_r, p);
+            else if( n_eq_left > 0 ) {
+                --n_eq_left; put(left, buf_l, p);
+            } else if( !has_pivot ) {
+                pivot = p; has_pivot = true;
+            } else 
+                put(right, buf_r, p);
+        });
+        left.append(buf_l.data(), buf_l.size());
+        right.append(buf_r.data(), buf_r.size());
+    }
+    drop(run, depth);
+
+    const index_t L = pl._leaf_size, sz = _n_nodes_of(n, L);
+    if( dst._bucketed() ) {
+        ref_nodes[n_cur] = ref_node_t{p_cur, sz, axis};
+        dst._put_point(pivot, p_cur);
+    } else 
+        nodes[n_cur] = node_t{pivot, sz, axis, pivot.pad()};
+    max_depth = std::max(max_depth, depth);
+    build(left, n_cur+1, p_cur+1, depth+1);
+    build(right, n_cur+1+_n_nodes_of(n_left, L), p_cur+1+n_left, depth+1);
+}
+
+template<typename Run>
+void build_in_core(Run &run, index_t n_cur, index_t p_cur, index_t depth) {
+    const size_t n = run.size(), n_chunk = buf.size();
+    vector<kd_point_t> pts(n);
+    for(size_t b=0; b<n; b+=n_chunk)
+        run.read(b, std::min(n_chunk, n-b), pts.data()+b);
+    drop(run, depth);
+
+    _KDTree sub;
+    sub.construct(pts, pl);
+    vector<kd_point_t>().swap(pts);
+    if( dst._bucketed() ) {
+        std::copy(sub._pts.begin(), sub._pts.end(), dst._pts.begin()+p_cur);
+        std::copy(sub._pads.begin(), sub._pads.end(), 
+            dst._pads.begin()+size_t(p_cur)*PADDING);
+        for(size_t i=0; i<sub._ref_nodes.size(); ++i) {
+            const auto &n = sub._ref_nodes[i];
+            ref_nodes[n_cur+i] = ref_node_t{n.first()+p_cur, n.size(), 
+                n.axis()};
+        }
+    } else 
+        std::copy(sub._nodes.begin(), sub._nodes.end(), nodes.begin()+n_cur);
+    max_depth = std::max(max_depth, depth - 1 + sub._tree_info._max_depth);
+}
+
+/**
+The buckets are owned by the construction, but the source is not.
+*/
+template<typename Run>
+void drop(Run &run, index_t depth) noexcept {
+    if constexpr( std::is_same_v<Run, run_t> ) 
+        if( depth > 1 ) run.remove();
+}
+
+template<typename Run, typename Op>
+void for_each_chunk(Run &run, Op &&op) {
+    const size_t n = run.size(), n_chunk = buf.size();
+    for(size_t b=0; b<n; b+=n_chunk) {
+        const size_t n_read = std::min(n_chunk, n-b);
+        run.read(b, n_read, buf.data());
+        for(size_t i=0; i<n_read; ++i) op(buf[i]);
+    }
+}
+
+template<typename Run>
+int find_axis(Run &run) {
+    using spl_ax_t = typename construct_policy_t::split_axis_t;
+    if( pl._split_axis == spl_ax_t::MAX_EXTREME ) {
+        using lim = std::numeric_limits<float_t>;
+        pos_t min_pos(lim::max()), max_pos(lim::lowest());
+        for_each_chunk(run, [&](const kd_point_t &p) {
+            const auto &pos = p.pos();
+            min_pos[ pos < min_pos ] = pos;
+            max_pos[ pos > max_pos ] = pos;
+        });
+        return static_cast<int>((max_pos - min_pos).max_index());
+    }
+
+    using dvec_t = SVec<double, DIM>;
+    dvec_t mean_pos(0.0), pos_var(0.0);
+    for_each_chunk(run, [&](const kd_point_t &p) {
+        mean_pos += dvec_t(p.pos());
+    });
+    mean_pos /= static_cast<double>(run.size());
+    for_each_chunk(run, [&](const kd_point_t &p) {
+        auto dpos = dvec_t(p.pos()) - mean_pos;
+        pos_var += dpos*dpos;
+    });
+    return static_cast<int>(pos_var.max_index());
+}
+
+/**
+Find the key of rank ``k`` along ``axis``, by ``DIGIT_BITS`` bits per pass 
+from the highest. Return the key and the number of smaller keys.
+*/
+template<typename Run>
+std::pair<key_t, index_t> select(Run &run, int axis, index_t k) {
+    vector<index_t> hist(size_t(1) << DIGIT_BITS);
+    key_t prefix = 0, mask = 0;
+    index_t rank = k;
+    for(int shift = radix_key_t::N_BITS - DIGIT_BITS; shift >= 0; 
+        shift -= DIGIT_BITS) 
+    {
+        std::fill(hist.begin(), hist.end(), index_t(0));
+        for_each_chunk(run, [&](const kd_point_t &p) {
+            const key_t key = radix_key_t::key(p.pos()[axis]);
+            if( (key & mask) == prefix ) ++hist[(key >> shift) & DIGIT_MASK];
+        });
+        key_t digit = 0;
+        while( hist[digit] <= rank ) rank -= hist[digit++];
+        prefix |= digit << shift;
+        mask |= DIGIT_MASK << shift;
+    }
+    return {prefix, k - rank};
+}
+
+string new_file_name() {
+    return file_prefix + std::to_string(n_files++) + ".bin";
+}
+
+};
+
+_HIPP_TEMPHD
+template<typename Source>
+void _HIPP_TEMPCLS::construct_out_of_core(Source &src, 
+    const construct_policy_t &policy, const out_of_core_policy_t &ooc_policy)
+{
+    _refit_info.reset();
+    _Impl_construct_out_of_core{*this, policy, ooc_policy}(src);
+    _update_veb();
+}
+
+_HIPP_TEMPHD
+struct _HIPP_TEMPCLS::_Impl_refit {
+
+    /**
+    Axis-aligned bounds of a subtree.
+    */
+    struct bound_t {
+        pos_t lo, hi;
+    };
+
+    _KDTree &dst;
+    vector<node_t> &nodes;
+    const refit_policy_t &pl;
+    const index_t n_nodes, n_pts;
+    const bool bucketed;
+
+    vector<bound_t> bounds;
+
+_Impl_refit(_KDTree &_dst, const refit_policy_t &_pl)
+: dst(_dst), nodes(dst._nodes), pl(_pl), n_nodes(dst.n_nodes()), 
+n_pts(dst.n_points()), bucketed(dst._bucketed())
+{
+    pl.verify();
+}
+
+/**
+Steps: (1) find the volume as built, if not yet. (2) Move the points into
+the tree. (3) Find the bounds of the subtrees bottom-up. (4) Restore the
+order along the split axes top-down, by swapping the points. (5) Find the
+exact bounds again for the volume.
+
+The bounds are indexed by nodes, the points by point indices.
+*/
+void operator()(ContiguousBuffer<const kd_point_t> pts) {
+    auto [p_pts, n_in] = pts;
+    if( n_in != static_cast<size_t>(n_pts) )
+        ErrLogic::throw_(ErrLogic::eLENGTH, emFLPFB, 
+            "  ... no. of points ", n_in, " != no. of points in tree ", 
+            n_pts);
+    
+    auto &info = dst._refit_info;
+    if( n_nodes == 0 ) {
+        info.add_refit(0.); return;
+    }
+    bounds.resize(n_nodes);
+    const int n_threads = pl.n_threads();
+    if( info.n_refits() == 0 )
+        info.set_build_volume( find_bounds(0, n_threads) );
+
+    _parallel_for(n_threads, n_pts, [&](int, index_t b, index_t e) {
+        for(index_t i=b; i<e; ++i) {
+            if( bucketed ) {
+                dst._put_point(p_pts[i], i); continue;
+            }
+            node_t &n = nodes[i];
+            n = node_t{p_pts[i], n.size(), n.axis(), p_pts[i].pad()};
+        }
+    });
+    find_bounds(0, n_threads);
+    restore(0, n_threads);
+    info.add_refit( find_bounds(0, n_threads) );
+}
+
+bool is_split(index_t i) const noexcept {
+    return dst._node_size(i) > 1 && dst._node_axis(i) >= 0;
+}
+
+index_t first_point(index_t i) const noexcept { 
+    return dst._first_point(i); 
+}
+
+index_t n_points_of(index_t i) const noexcept {
+    auto [b, e] = dst.point_range(i);
+    return e - b;
+}
+
+pos_t & pos(index_t j) noexcept {
+    return bucketed ? dst._pts[j].pos() : nodes[j].pos();
+}
+
+/**
+The right child of a split node ``i``, or ``-1`` if it has none.
+*/
+index_t right_child(index_t i) const noexcept {
+    const index_t r = i + 1 + dst._node_size(i+1);
+    return r < i + dst._node_size(i) ? r : index_t(-1);
+}
+
+/**
+Find the bounds of the subtree rooted at ``i``. Return the sum of the 
+volumes of its internal nodes and buckets. The subtrees of the top levels 
+are handed over to disjoint groups of threads, as in the parallel 
+construction.
+*/
+double find_bounds(index_t i, int n_threads) {
+    if( n_threads <= 1 || n_points_of(i) <= pl.serial_cutoff() 
+        || !is_split(i) )
+        return find_bounds_serial(i);
+
+    // n_points > serial_cutoff >= 1, hence the left subtree is non-empty.
+    const index_t r = right_child(i);
+    const int n_threads_l = n_threads / 2;
+    double vol_l = 0., vol_r = 0.;
+    std::thread th_l([&, this]{ vol_l = find_bounds(i+1, n_threads_l); });
+    if( r >= 0 ) vol_r = find_bounds(r, n_threads-n_threads_l);
+    th_l.join();
+    return vol_l + vol_r + merge_children(i);
+}
+
+double find_bounds_serial(index_t i_root) {
+    double vol = 0.;
+    for(index_t i = i_root + dst._node_size(i_root); i-- > i_root; ) {
+        if( is_split(i) ) {
+            vol += merge_children(i); continue;
+        }
+        auto [b, e] = dst.point_range(i);
+        bound_t &bd = bounds[i];
+        bd = bound_t{pos(b), pos(b)};
+        if( e - b == 1 ) continue;
+        for(index_t j=b+1; j<e; ++j) expand(bd, pos(j));
+        vol += volume(bd);
+    }
+    return vol;
+}
+
+double merge_children(index_t i) noexcept {
+    const pos_t &p = pos(first_point(i));
+    bound_t &bd = bounds[i];
+    bd = bound_t{p, p};
+    merge(bd, bounds[i+1]);
+    if( const index_t r = right_child(i); r >= 0 ) merge(bd, bounds[r]);
+    return volume(bd);
+}
+
+static void expand(bound_t &bd, const pos_t &p) noexcept {
+    for(int d=0; d<DIM; ++d) {
+        if( p[d] < bd.lo[d] ) bd.lo[d] = p[d];
+        if( p[d] > bd.hi[d] ) bd.hi[d] = p[d];
+    }
+}
+
+static void merge(bound_t &bd, const bound_t &o) noexcept {
+    for(int d=0; d<DIM; ++d) {
+        if( o.lo[d] < bd.lo[d] ) bd.lo[d] = o.lo[d];
+        if( o.hi[d] > bd.hi[d] ) bd.hi[d] = o.hi[d];
+    }
+}
+
+static double volume(const bound_t &bd) noexcept {
+    double v = 1.;
+    for(int d=0; d<DIM; ++d) v *= double(bd.hi[d]) - double(bd.lo[d]);
+    return v;
+}
+
+/**
+Restore the order of the subtree rooted at ``i`` along the split axes. The 
+node is fixed first, then its two subtrees independently.
+*/
+void restore(index_t i, int n_threads) {
+    if( !is_split(i) ) return;
+    restore_node(i);
+
+    const index_t r = right_child(i);
+    if( n_threads > 1 && n_points_of(i) > pl.serial_cutoff() && r >= 0 ) {
+        const int n_threads_l = n_threads / 2;
+        std::thread th_l(&_Impl_refit::restore, this, i+1, n_threads_l);
+        restore(r, n_threads-n_threads_l);
+        th_l.join();
+    } else {
+        restore(i+1, 1);
+        if( r >= 0 ) restore(r, 1);
+    }
+}
+
+/**
+If the left subtree of node ``i`` extends above it, or the right one below 
+it, along the split axis, select the ``np_l`` smallest points of the subtree
+and the median, move the median to the first point of node ``i``, and swap 
+the misplaced points pairwise between the two subtrees. The bounds of the 
+subtrees are grown along the paths to the swapped slots, so they remain 
+conservative.
+*/
+void restore_node(index_t i) {
+    const int axis = dst._node_axis(i);
+    const index_t p = first_point(i), np = n_points_of(i), np_l = np / 2, 
+        p_r = p + 1 + np_l, r = right_child(i);
+    const float_t x = pos(p)[axis];
+    if( bounds[i+1].hi[axis] <= x && (r < 0 || bounds[r].lo[axis] >= x) ) 
+        return;
+
+    vector<index_t> ids(np);
+    for(index_t j=0; j<np; ++j) ids[j] = p + j;
+    std::nth_element(ids.begin(), ids.begin()+np_l, ids.end(), 
+        [&](index_t a, index_t b) -> bool {
+            return pos(a)[axis] < pos(b)[axis];
+        });
+
+    // side[j-p]: 0 for the left, 1 for the median, 2 for the right.
+    vector<char> side(np, 2);
+    for(index_t j=0; j<np_l; ++j) side[ids[j]-p] = 0;
+    const index_t p_med = ids[np_l];
+    side[p_med-p] = 1;
+
+    if( p_med != p ) {
+        swap_points(p, p_med);
+        std::swap(side[0], side[p_med-p]);
+        grow_path(i, p_med);
+    }
+    for(index_t j_l = p+1, j_r = p_r; ; ++j_l, ++j_r) {
+        while( j_l < p_r && side[j_l-p] == 0 ) ++j_l;
+        if( j_l == p_r ) break;
+        while( side[j_r-p] == 2 ) ++j_r;
+        swap_points(j_l, j_r);
+        grow_path(i, j_l);
+        grow_path(i, j_r);
+    }
+}
+
+/**
+Swap the points (positions and paddings) at two point indices, leaving the 
+sizes and axes of the nodes.
+*/
+void swap_points(index_t a, index_t b) noexcept {
+    std::swap(pos(a), pos(b));
+    if constexpr ( PADDING > 0 ) {
+        char *pad_a = bucketed ? dst._pads.data() + a*PADDING 
+            : nodes[a].pad(), 
+            *pad_b = bucketed ? dst._pads.data() + b*PADDING 
+            : nodes[b].pad();
+        char buf[PADDING];
+        std::memcpy(buf, pad_a, PADDING);
+        std::memcpy(pad_a, pad_b, PADDING);
+        std::memcpy(pad_b, buf, PADDING);
+    }
+}
+
+/**
+Grow the bounds from the child of node ``i`` down to the node holding the 
+point ``j`` (a split node or a leaf bucket) to include the point.
+*/
+void grow_path(index_t i, index_t j) noexcept {
+    const pos_t &p = pos(j);
+    index_t k = i;
+    do {
+        const index_t r = right_child(k);
+        k = (r >= 0 && j >= first_point(r)) ? r : k+1;
+        expand(bounds[k], p);
+    } while( is_split(k) && first_point(k) != j );
+}
+
+};
+
+_HIPP_TEMPRET
+refit(ContiguousBuffer<const kd_point_t> pts, const refit_policy_t &policy)
+-> void 
+{
+    _Impl_refit{*this, policy}(pts);
+    _update_veb();
+}
+
+_HIPP_TEMPRET
+refit_info() const noexcept -> const refit_info_t & {
+    return _refit_info;
 }
 
 _HIPP_TEMPHD
@@ -334,7 +1015,7 @@ void _HIPP_TEMPCLS::argsort(ContiguousBuffer<const PointT> pts,
     auto [p_pts, n_pts] = pts;
     idx_pairs.resize(n_pts);
 
-    if( n_pts != 0 && _nodes.empty() ) 
+    if( n_pts != 0 && n_nodes() == 0 ) 
         ErrLogic::throw_(ErrLogic::eLENGTH, emFLPFB, 
             "  ... Cannot sort ", n_pts, " points in an empty tree");
 
@@ -350,12 +1031,95 @@ void _HIPP_TEMPCLS::argsort(ContiguousBuffer<const PointT> pts,
 _HIPP_TEMPRET
 shrink_buffer() -> void {
     _nodes.shrink_to_fit();
+    _ref_nodes.shrink_to_fit();
+    _pts.shrink_to_fit();
+    _pads.shrink_to_fit();
 }
 
 _HIPP_TEMPRET
 clear() -> void {
     _nodes.clear();
+    _ref_nodes.clear();
+    _pts.clear();
+    _pads.clear();
     _tree_info = tree_info_t{};
+    _refit_info.reset();
+    _update_veb();
+}
+
+_HIPP_TEMPRET
+save(const string &file_name) const -> void {
+    _FileArchive ar(file_name, true);
+    _save(ar);
+}
+
+_HIPP_TEMPRET
+load(const string &file_name) -> void {
+    _FileArchive ar(file_name, false);
+    _load(ar);
+}
+
+_HIPP_TEMPHD
+template<typename H5Group>
+void _HIPP_TEMPCLS::save_h5(H5Group g) const {
+    _H5Archive<H5Group> ar(std::move(g));
+    _save(ar);
+}
+
+_HIPP_TEMPHD
+template<typename H5Group>
+void _HIPP_TEMPCLS::load_h5(H5Group g) {
+    _H5Archive<H5Group> ar(std::move(g));
+    _load(ar);
+}
+
+_HIPP_TEMPHD
+template<typename Archive>
+void _HIPP_TEMPCLS::_save(Archive &ar) const {
+    _put_layout<node_t, index_t>(ar, "KDTree");
+    ar.put("leaf_size", &_construct_policy._leaf_size, 1);
+    ar.put("periodic_box", &_construct_policy._periodic_box.size(), 1);
+    ar.put("max_depth", &_tree_info._max_depth, 1);
+    ar.put("nodes", _nodes.data(), _nodes.size());
+    ar.put("ref_nodes", _ref_nodes.data(), _ref_nodes.size());
+    ar.put("points", _pts.data(), _pts.size());
+    ar.put("pads", _pads.data(), _pads.size());
+}
+
+_HIPP_TEMPHD
+template<typename Archive>
+void _HIPP_TEMPCLS::_load(Archive &ar) {
+    _check_layout<node_t, index_t>(ar, "KDTree");
+    index_t leaf_size;
+    pos_t box_size;
+    tree_info_t tree_info;
+    vector<node_t> nodes;
+    vector<ref_node_t> ref_nodes;
+    vector<point_t> pts;
+    vector<char> pads;
+    ar.get("leaf_size", &leaf_size, 1);
+    ar.get("periodic_box", &box_size, 1);
+    ar.get("max_depth", &tree_info._max_depth, 1);
+    ar.get("nodes", nodes);
+    ar.get("ref_nodes", ref_nodes);
+    ar.get("points", pts);
+    ar.get("pads", pads);
+    if( pads.size() != pts.size()*PADDING 
+        || ref_nodes.empty() != pts.empty()
+        || (!ref_nodes.empty() && !nodes.empty()) )
+        ErrRuntime::throw_(ErrRuntime::eDEFAULT, emFLPFB, 
+            "  ... inconsistent sizes of nodes (", nodes.size(), 
+            "), ref nodes (", ref_nodes.size(), "), points (", pts.size(), 
+            ") and pads (", pads.size(), ")\n");
+
+    _construct_policy.set_leaf_size(leaf_size).set_periodic_box(box_size);
+    _tree_info = tree_info;
+    _nodes = std::move(nodes);
+    _ref_nodes = std::move(ref_nodes);
+    _pts = std::move(pts);
+    _pads = std::move(pads);
+    _refit_info.reset();
+    _update_veb();
 }
 
 _HIPP_TEMPRET
@@ -378,6 +1142,16 @@ nodes() noexcept -> vector<node_t> & {
     return _nodes;
 }
 
+_HIPP_TEMPRET
+ref_nodes() const noexcept -> const vector<ref_node_t> & {
+    return _ref_nodes;
+}
+
+_HIPP_TEMPRET
+n_nodes() const noexcept -> index_t {
+    return _bucketed() ? index_t(_ref_nodes.size()) : index_t(_nodes.size());
+}
+
 _HIPP_TEMPRET
 tree_info() const noexcept -> const tree_info_t & {
     return _tree_info;
@@ -400,66 +1174,368 @@ right_child_idx(index_t node_idx) const noexcept -> index_t {
 
 _HIPP_TEMPRET
 right_sibling_idx(index_t node_idx) const noexcept -> index_t {
-    return node_idx + _nodes[node_idx].size();
+    return node_idx + _node_size(node_idx);
 }
 
-_HIPP_TEMPHD
-template<typename Op>
-void _HIPP_TEMPCLS::walk_down(const point_t &p, Op op, 
-    index_t &node_idx) const 
-{
-    const auto &pos = p.pos();
-    index_t root = node_idx;
-    do {
-        op(root);
-        const auto &n = _nodes[root];
-        const int axis = n.axis();
-        const index_t sz = n.size();
-        if( pos[axis] <= n.pos()[axis] ) {
-            if(sz == 1) break;
-            root = left_child_idx(root);
-        } else {
-            if(sz <= 2) break;
-            root = right_child_idx(root);
-        }
-    } while(true);
-    node_idx = root;
+_HIPP_TEMPRET
+is_bucket(index_t node_idx) const noexcept -> bool {
+    return _bucketed() && _ref_nodes[node_idx].axis() < 0;
 }
 
-_HIPP_TEMPHD
-struct _HIPP_TEMPCLS::_Impl_query_base {
-
-    const _KDTree &kdt;
-    const vector<node_t> &nodes;
-    const pos_t dst_pos;
-
-_Impl_query_base(const _KDTree &_kdt, const pos_t &_dst_pos) 
-: kdt(_kdt), nodes(kdt._nodes), dst_pos(_dst_pos)
-{}
-
-bool on_left_of(const node_t &n) const noexcept {
-    auto axis = n.axis();
-    return dst_pos[axis] <= n.pos()[axis];
+_HIPP_TEMPRET
+n_points() const noexcept -> index_t {
+    return _bucketed() ? index_t(_pts.size()) : index_t(_nodes.size());
 }
 
-float_t offset_from(const node_t &n) const noexcept {
-    auto axis = n.axis();
-    return dst_pos[axis] - n.pos()[axis];
+_HIPP_TEMPRET
+point_pos(index_t pt_idx) const noexcept -> const pos_t & {
+    return _bucketed() ? _pts[pt_idx].pos() : _nodes[pt_idx].pos();
+}
+
+_HIPP_TEMPHD
+template<typename T>
+auto _HIPP_TEMPCLS::point_pad(index_t pt_idx) const noexcept -> const T & {
+    if( !_bucketed() ) return _nodes[pt_idx].template pad<T>();
+    return *reinterpret_cast<const T *>(_pads.data() + pt_idx*PADDING);
+}
+
+_HIPP_TEMPRET
+point_range(index_t node_idx) const noexcept -> std::pair<index_t, index_t> {
+    const index_t e = node_idx + _node_size(node_idx);
+    if( !_bucketed() ) return {node_idx, e};
+    return {_ref_nodes[node_idx].first(), e < index_t(_ref_nodes.size()) ? 
+        _ref_nodes[e].first() : index_t(_pts.size())};
+}
+
+_HIPP_TEMPRET
+points() const noexcept -> const vector<point_t> & {
+    return _pts;
+}
+
+_HIPP_TEMPRET
+_bucketed() const noexcept -> bool {
+    return !_ref_nodes.empty();
+}
+
+_HIPP_TEMPRET
+_node_size(index_t node_idx) const noexcept -> index_t {
+    return _bucketed() ? _ref_nodes[node_idx].size() 
+        : _nodes[node_idx].size();
+}
+
+_HIPP_TEMPRET
+_node_axis(index_t node_idx) const noexcept -> int {
+    return _bucketed() ? _ref_nodes[node_idx].axis() 
+        : _nodes[node_idx].axis();
+}
+
+_HIPP_TEMPRET
+_first_point(index_t node_idx) const noexcept -> index_t {
+    return _bucketed() ? _ref_nodes[node_idx].first() : node_idx;
+}
+
+/**
+A subtree of ``n`` points has ``n_nodes(n)`` nodes, i.e., a bucket if 
+``n <= leaf_size``, otherwise a split node and the subtrees of the 
+``n/2`` and ``(n-1)/2`` points. ``n_nodes(m)`` and ``n_nodes(m+1)`` are found
+together so that only ``O(log n)`` pairs are visited.
+*/
+_HIPP_TEMPRET
+_n_nodes_of(index_t n_pts, index_t leaf_size) noexcept -> index_t {
+    if( leaf_size <= 1 ) return n_pts;
+    auto pair_of = [leaf_size](auto &self, index_t m) 
+        -> std::pair<index_t, index_t> 
+    {
+        if( m + 1 <= leaf_size ) return {m > 0, 1};
+        if( m <= leaf_size ) return {m > 0, 3};
+        const auto [a, b] = self(self, (m-1)/2);
+        return m % 2 == 0 ? std::pair<index_t, index_t>{1+a+b, 1+2*b} 
+            : std::pair<index_t, index_t>{1+2*a, 1+a+b};
+    };
+    return pair_of(pair_of, n_pts).first;
 }
 
+_HIPP_TEMPRET
+_resize(index_t n_pts) -> void {
+    const index_t n_nodes = _n_nodes_of(n_pts, _construct_policy._leaf_size);
+    if( _construct_policy._leaf_size > 1 ) {
+        _nodes.clear();
+        _ref_nodes.resize(n_nodes);
+        _pts.resize(n_pts);
+        _pads.resize(size_t(n_pts)*PADDING);
+    } else {
+        _nodes.resize(n_nodes);
+        _ref_nodes.clear(); _pts.clear(); _pads.clear();
+    }
+}
+
+_HIPP_TEMPRET
+_put_point(const kd_point_t &pt, index_t pt_idx) noexcept -> void {
+    _pts[pt_idx] = point_t(pt.pos());
+    if constexpr( PADDING > 0 ) 
+        std::memcpy(_pads.data() + pt_idx*PADDING, pt.pad(), PADDING);
+}
+
+/**
+The nodes of a tree with ``leaf_size == 1``. Each node holds its point, whose 
+index is the node index.
+*/
+_HIPP_TEMPHD
+struct _HIPP_TEMPCLS::_NodeView {
+
+    static constexpr bool BUCKETED = false;
+
+    const node_t * __restrict__ nodes;
+
+_NodeView(const _KDTree &kdt) noexcept : nodes(kdt._nodes.data()) {}
+
+index_t size(index_t i) const noexcept { return nodes[i].size(); }
+int axis(index_t i) const noexcept { return nodes[i].axis(); }
+index_t point(index_t i) const noexcept { return i; }
+const point_t & pt(index_t i) const noexcept { return nodes[i]; }
+const pos_t & pos(index_t i) const noexcept { return nodes[i].pos(); }
+const void * addr(index_t i) const noexcept { return nodes + i; }
+
 };
 
+/**
+The nodes of a bucketed tree. The point of a split node is the first one of
+its subtree. bucket() gives the points ``[b, e)`` of a leaf bucket, which end 
+at the first point of the next node.
+*/
 _HIPP_TEMPHD
-template<typename Policy>
-struct _HIPP_TEMPCLS::_Impl_query_pre_order : _Impl_query_base {
+struct _HIPP_TEMPCLS::_RefNodeView {
+
+    static constexpr bool BUCKETED = true;
+
+    const ref_node_t * __restrict__ nodes;
+    const point_t * __restrict__ pts;
+    const index_t n_nodes, n_pts;
+
+_RefNodeView(const _KDTree &kdt) noexcept 
+: nodes(kdt._ref_nodes.data()), pts(kdt._pts.data()), 
+n_nodes(kdt._ref_nodes.size()), n_pts(kdt._pts.size()) {}
+
+index_t size(index_t i) const noexcept { return nodes[i].size(); }
+int axis(index_t i) const noexcept { return nodes[i].axis(); }
+index_t point(index_t i) const noexcept { return nodes[i].first(); }
+const point_t & pt(index_t i) const noexcept { return pts[point(i)]; }
+const pos_t & pos(index_t i) const noexcept { return pt(i).pos(); }
+const void * addr(index_t i) const noexcept { return nodes + i; }
+
+std::pair<index_t, index_t> bucket(index_t i) const noexcept {
+    return {nodes[i].first(), i+1 < n_nodes ? nodes[i+1].first() : n_pts};
+}
+
+};
+
+_HIPP_TEMPHD
+template<typename Op>
+decltype(auto) _HIPP_TEMPCLS::_with_view(Op &&op) const {
+    if( _bucketed() ) return op(_RefNodeView(*this));
+    return op(_NodeView(*this));
+}
+
+_HIPP_TEMPRET
+veb_nodes() const noexcept -> const vector<veb_node_t> & {
+    return _veb_nodes;
+}
+
+_HIPP_TEMPRET
+veb_layout() const noexcept -> const _VEBLayout & {
+    return _veb_layout;
+}
+
+/**
+Each node is put into the slot of its breadth-first index. The tree is 
+(nearly) balanced, hence the complete tree of the same height has less than 
+twice the slots.
+*/
+_HIPP_TEMPRET
+_update_veb() -> void {
+    const index_t n_nodes = this->n_nodes();
+    if( !_construct_policy._veb_layout || n_nodes == 0 ) {
+        _veb_layout = _VEBLayout();
+        _veb_nodes.clear(); _veb_nodes.shrink_to_fit();
+        return;
+    }
+    _veb_layout = _VEBLayout(_tree_info._max_depth);
+    _veb_nodes.assign(_veb_layout.size(), veb_node_t{0, -1, -1});
+
+    using bfs_idx_t = _VEBLayout::index_t;
+    vector<std::pair<index_t, bfs_idx_t> > stk {{0, 1}};
+    while( !stk.empty() ) {
+        const auto [i, i_bfs] = stk.back();
+        stk.pop_back();
+        const int axis = _node_axis(i);
+        const float_t split = axis < 0 ? float_t(0) 
+            : point_pos(_first_point(i))[axis];
+        _veb_nodes[_veb_layout.pos_of(i_bfs)] = veb_node_t{split, axis, i};
+        const index_t sz = _node_size(i);
+        if( axis < 0 || sz == 1 ) continue;
+        stk.emplace_back(left_child_idx(i), 2*i_bfs);
+        if( sz > 2 ) stk.emplace_back(right_child_idx(i), 2*i_bfs+1);
+    }
+}
+
+_HIPP_TEMPHD
+template<typename Op>
+void _HIPP_TEMPCLS::walk_down(const point_t &p, Op op, 
+    index_t &node_idx) const 
+{
+    if( node_idx == 0 && !_veb_nodes.empty() ) {
+        _walk_down_veb(p, op, node_idx); return;
+    }
+    const auto &pos = p.pos();
+    _with_view([&](const auto &nodes) {
+        index_t root = node_idx;
+        do {
+            op(root);
+            const int axis = nodes.axis(root);
+            const index_t sz = nodes.size(root);
+            if( axis < 0 ) break;
+            if( pos[axis] <= nodes.pos(root)[axis] ) {
+                if(sz == 1) break;
+                root = left_child_idx(root);
+            } else {
+                if(sz <= 2) break;
+                root = root + 1 + nodes.size(root+1);
+            }
+        } while(true);
+        node_idx = root;
+    });
+}
+
+/**
+The same path as walk_down() in ``nodes()``. A slot with ``idx == -1`` is a 
+missing child. Both children are prefetched before the split is tested.
+*/
+_HIPP_TEMPHD
+template<typename Op>
+void _HIPP_TEMPCLS::_walk_down_veb(const point_t &p, Op &op, 
+    index_t &node_idx) const 
+{
+    using bfs_idx_t = _VEBLayout::index_t;
+    const auto &pos = p.pos();
+    const int height = _veb_layout.height();
+    bfs_idx_t poss[_VEBLayout::MAX_HEIGHT], i_bfs = 1;
+    poss[0] = 0;
+    for(int d=0; ; ++d) {
+        const veb_node_t &vn = _veb_nodes[poss[d]];
+        op(vn.idx);
+        if( vn.axis < 0 || d+1 == height ) {
+            node_idx = vn.idx; return;
+        }
+        const bfs_idx_t i_l = 2*i_bfs, 
+            pos_l = _veb_layout.pos_at(d+1, i_l, poss),
+            pos_r = _veb_layout.pos_at(d+1, i_l+1, poss);
+        _prefetch(&_veb_nodes[pos_l]);
+        _prefetch(&_veb_nodes[pos_r]);
+        const bool go_left = pos[vn.axis] <= vn.split;
+        const bfs_idx_t pos_c = go_left ? pos_l : pos_r;
+        if( _veb_nodes[pos_c].idx < 0 ) {
+            node_idx = vn.idx; return;
+        }
+        i_bfs = go_left ? i_l : i_l+1;
+        poss[d+1] = pos_c;
+    }
+}
+
+_HIPP_TEMPHD
+template<typename View>
+struct _HIPP_TEMPCLS::_Impl_query_base {
+
+    const _KDTree &kdt;
+    const View nodes;
+    pos_t dst_pos;
+
+_Impl_query_base(const _KDTree &_kdt, const View &_nodes, 
+    const pos_t &_dst_pos) 
+: kdt(_kdt), nodes(_nodes), dst_pos(_dst_pos)
+{}
+
+
+/**
+The point held by a split node ``idx``, i.e., its index in the query 
+results.
+*/
+index_t point_of(index_t idx) const noexcept {
+    return nodes.point(idx);
+}
+
+index_t right_sibling_of(index_t idx) const noexcept {
+    return idx + nodes.size(idx);
+}
+
+/**
+Call ``op(i, r_sq)`` on each point indexed ``i`` in the leaf bucket at node
+``idx``, whose squared distance to ``dst_pos``, ``r_sq``, is less than 
+``max_r_sq``. The distances are computed by the (possibly vectorized)
+distance kernel.
+*/
+template<typename Op>
+void scan_bucket_within(index_t idx, const float_t &max_r_sq, 
+    Op &&op) const noexcept 
+{
+    const auto [b, e] = nodes.bucket(idx);
+    const index_t n = e - b;
+    _DistKernel<point_t>::scan_within(kdt._pts.data() + b, n, dst_pos, 
+        max_r_sq, [&](size_t i, float_t r_sq) { op(b + index_t(i), r_sq); });
+}
+
+/**
+Call ``op(i)`` on each point indexed ``i`` in the leaf bucket at node 
+``idx``, whose squared distance to ``dst_pos`` is less than ``max_r_sq``.
+*/
+template<typename Op>
+void visit_bucket_within(index_t idx, float_t max_r_sq, 
+    Op &&op) const noexcept 
+{
+    const auto [b, e] = nodes.bucket(idx);
+    const index_t n = e - b;
+    _DistKernel<point_t>::visit_within(kdt._pts.data() + b, n, dst_pos, 
+        max_r_sq, [&](size_t i) { op(b + index_t(i)); });
+}
+
+/**
+Call ``op(i)`` on each point indexed ``i`` in the leaf bucket at node 
+``idx``, which is contained in ``rect``.
+*/
+template<typename Op>
+void visit_bucket_in_rect(index_t idx, const rect_t &rect, 
+    Op &&op) const noexcept 
+{
+    const auto [b, e] = nodes.bucket(idx);
+    const index_t n = e - b;
+    _RectKernel<point_t>::visit_within(kdt._pts.data() + b, n, rect, 
+        [&](size_t i) { op(b + index_t(i)); });
+}
+
+bool on_left_of(index_t idx) const noexcept {
+    auto axis = nodes.axis(idx);
+    return dst_pos[axis] <= nodes.pos(idx)[axis];
+}
+
+float_t offset_from(index_t idx) const noexcept {
+    auto axis = nodes.axis(idx);
+    return dst_pos[axis] - nodes.pos(idx)[axis];
+}
+
+};
+
+_HIPP_TEMPHD
+template<typename Policy, typename View>
+struct _HIPP_TEMPCLS::_Impl_query_pre_order : _Impl_query_base<View> {
 
     using stack_item_t = index_t;
+    typename _QueryBuffPool<index_t>::lease_t stk_lease;
     stack_item_t *const __restrict__ stk_b,
         * __restrict__ stk_e;
     
-_Impl_query_pre_order(const _KDTree &_kdt, const pos_t &_dst_pos, Policy &_pl)
-: _Impl_query_base(_kdt, _dst_pos), stk_b(
-    _pl.get_buff( _kdt._tree_info.max_depth() )
+_Impl_query_pre_order(const _KDTree &_kdt, const View &_nodes, 
+    const pos_t &_dst_pos, Policy &_pl)
+: _Impl_query_base<View>(_kdt, _nodes, _dst_pos), stk_b(
+    stk_lease.get( _kdt._tree_info.max_depth() )
 ), stk_e(stk_b) {}
 
 
@@ -475,27 +1551,38 @@ bool stack_not_empty() const noexcept {
     return stk_b != stk_e;
 }
 
-template<typename CrossSplitPlane, typename ContainNode, typename Op>
+template<typename CrossSplitPlane, typename ContainNode, typename ScanBucket,
+    typename Op>
 void walk_down(index_t idx, CrossSplitPlane &&cross,  
-    ContainNode &&contain, Op &&op) noexcept
+    ContainNode &&contain, ScanBucket &&scan, Op &&op) noexcept
 {
+    const View &nodes = this->nodes;
     do {
         if( idx < 0 ) idx = this->pop_stack();
 
-        const node_t &n = this->nodes[idx];
-        const auto sz = n.size();
+        if constexpr( View::BUCKETED ) {
+            if( nodes.axis(idx) < 0 ) {
+                scan(idx);
+                idx = -1;
+                continue;
+            }
+        }
+        const index_t sz = nodes.size(idx);
         const index_t l_child = sz > 1 ? this->kdt.left_child_idx(idx) : -1;
 
-        if( cross(n) ) {
-            if( contain(n) ) op(idx);
+        if( cross(idx) ) {
+            if( contain(nodes.pt(idx)) ) op(this->point_of(idx));
             idx = l_child;
-            if( sz > 2 )
-                this->push_stack(this->kdt.right_sibling_idx(l_child));
+            if( sz > 2 ) {
+                const index_t r_child = this->right_sibling_of(l_child);
+                _prefetch(nodes.addr(r_child));
+                this->push_stack(r_child);
+            }
         } else {
-            if( this->on_left_of(n) ) {
+            if( this->on_left_of(idx) ) {
                 idx = l_child;
             } else {
-                idx = sz > 2 ? this->kdt.right_sibling_idx(l_child) : -1;
+                idx = sz > 2 ? this->right_sibling_of(l_child) : -1;
             }
         }
     } while( idx >= 0 || this->stack_not_empty() );
@@ -504,21 +1591,34 @@ void walk_down(index_t idx, CrossSplitPlane &&cross,
 };
 
 _HIPP_TEMPHD
-template<typename Policy>
-struct _HIPP_TEMPCLS::_Impl_query_in_order : _Impl_query_base {
+template<typename Policy, typename View>
+struct _HIPP_TEMPCLS::_Impl_query_in_order : _Impl_query_base<View> {
 
     Policy &pl;
     using stack_item_t = std::pair<index_t, index_t>;
+    typename _QueryBuffPool<stack_item_t>::lease_t stk_lease;
     stack_item_t *const __restrict__ stk_b,
         * __restrict__ stk_e;
 
-_Impl_query_in_order(const _KDTree &_kdt, const pos_t &_dst_pos, Policy &_pl) 
-: _Impl_query_base(_kdt, _dst_pos), pl(_pl),
-stk_b(reinterpret_cast<stack_item_t *>(
-    _pl.get_buff(_kdt._tree_info.max_depth()*2))
-), stk_e(stk_b)
+    /**
+    prune_f: a subtree is pruned if its squared distance bound times 
+    ``prune_f = (1 + eps)^2`` is not less than the current squared distance.
+    n_visited: number of points whose distances are computed.
+    */
+    const float_t prune_f;
+    size_t n_visited;
+
+_Impl_query_in_order(const _KDTree &_kdt, const View &_nodes, 
+    const pos_t &_dst_pos, Policy &_pl) 
+: _Impl_query_base<View>(_kdt, _nodes, _dst_pos), pl(_pl),
+stk_b( stk_lease.get(_kdt._tree_info.max_depth()) ), stk_e(stk_b), 
+prune_f( (1 + _pl.eps()) * (1 + _pl.eps()) ), n_visited(0)
 {}
 
+~_Impl_query_in_order() noexcept {
+    pl._n_visited += n_visited;
+}
+
 void push_stack(const stack_item_t &item) noexcept {
     *stk_e++ = item;
 }
@@ -531,39 +1631,72 @@ bool stack_empty() const noexcept {
     return stk_b == stk_e;
 }
 
+/**
+Whether or not node ``idx`` may be taken as a result, as determined by the
+node filter of the policy, if any.
+*/
+bool accept(index_t idx) const noexcept {
+    using pl_t = std::remove_cv_t<std::remove_reference_t<Policy> >;
+    if constexpr( _HasNodeFilter<pl_t, index_t>::value )
+        return pl.accept_node(idx);
+    else
+        return true;
+}
+
 stack_item_t walk_down(index_t root) noexcept {
+    const View &nodes = this->nodes;
     do {
-        const auto &n = this->nodes[root];
-        const index_t sz = n.size();
+        const index_t sz = nodes.size(root);
         
-        if(sz == 1) return {root, -1};
+        if(sz == 1 || nodes.axis(root) < 0) return {root, -1};
         const index_t l_child = this->kdt.left_child_idx(root);
         
-        if( this->on_left_of(n) ) {
-            push_stack({ root, 
-                (sz == 2)?(-1):this->kdt.right_sibling_idx(l_child) });
+        if( this->on_left_of(root) ) {
+            const index_t r_child = (sz == 2) ? (-1) 
+                : this->right_sibling_of(l_child);
+            if( r_child >= 0 ) _prefetch(nodes.addr(r_child));
+            push_stack({root, r_child});
             root = l_child;
         } else {
             if(sz == 2) return {root, l_child};
             push_stack({root, l_child});
-            root = this->kdt.right_sibling_idx(l_child);
+            root = this->right_sibling_of(l_child);
         }
     } while(true);
 }
 
-template<typename CrossSplitPlane, typename Op>
-void walk_down(index_t idx, CrossSplitPlane &&cross, Op &&op) noexcept
+/**
+Visit the nodes in the order of increasing distance of their subtrees
+(estimated by the split planes) to ``dst_pos``, skipping the subtrees whose
+split plane is not within the squared distance ``max_r_sq / prune_f``. 
+``op(idx, r_sq)``
+is called on each visited point with its squared distance to ``dst_pos``.
+``max_r_sq`` may be shrunk by ``op``.
+*/
+template<typename Op>
+void walk_down(index_t idx, const float_t &max_r_sq, Op &&op) noexcept
 {
     index_t opp_idx;
     std::tie(idx, opp_idx) = walk_down(idx);
+    const View &nodes = this->nodes;
     do {
-        const node_t &n = this->nodes[idx];
-        if( cross(n) ) {
-            op(idx, n);
-            if( opp_idx != -1 ) {
-                std::tie(idx, opp_idx) = walk_down(opp_idx);
-                continue;
+        if( !View::BUCKETED || nodes.axis(idx) >= 0 ) {
+            if( const float_t dx = this->offset_from(idx); 
+                dx * dx * prune_f < max_r_sq ) 
+            {
+                ++n_visited;
+                const float_t r_sq = 
+                    (this->dst_pos - nodes.pos(idx)).squared_norm();
+                op(this->point_of(idx), r_sq);
+                if( opp_idx != -1 ) {
+                    std::tie(idx, opp_idx) = walk_down(opp_idx);
+                    continue;
+                }
             }
+        } else if constexpr( View::BUCKETED ) {
+            const auto [b, e] = nodes.bucket(idx);
+            n_visited += e - b;
+            this->scan_bucket_within(idx, max_r_sq, op);
         }
         if( stack_empty() ) break;
         std::tie(idx, opp_idx) = pop_stack();
@@ -573,32 +1706,46 @@ void walk_down(index_t idx, CrossSplitPlane &&cross, Op &&op) noexcept
 };
 
 _HIPP_TEMPHD
-template<typename Policy>
-struct _HIPP_TEMPCLS::_Impl_nearest : _Impl_query_in_order<Policy> {
+template<typename Policy, typename View>
+struct _HIPP_TEMPCLS::_Impl_nearest : _Impl_query_in_order<Policy, View> {
 
-    using base_t = _Impl_query_in_order<Policy>;
+    using base_t = _Impl_query_in_order<Policy, View>;
 
     float_t dst_r_sq; 
     index_t dst_idx;
     
-_Impl_nearest(const _KDTree &kdt, Policy &pl, const pos_t &dst_pos) 
-: base_t(kdt, dst_pos, pl),
+_Impl_nearest(const _KDTree &kdt, const View &nodes, Policy &pl, 
+    const pos_t &dst_pos) 
+: base_t(kdt, nodes, dst_pos, pl),
 dst_r_sq(std::numeric_limits<float_t>::max()),
 dst_idx(node_t::idxNULL) {}
 
 void operator()() noexcept {
-    if( this->nodes.size() == 0 ) return;
+    if( this->kdt.n_nodes() == 0 ) return;
 
-    this->walk_down(0, 
-        [this](const node_t &n) {
-            const auto dx = this->offset_from(n); 
-            return dx * dx < dst_r_sq; }, 
-        [this](index_t idx, const node_t &n) {
-            const auto r_sq = (this->dst_pos - n.pos()).squared_norm();
-            if( r_sq < dst_r_sq ) {
+    const auto &box = this->kdt._construct_policy._periodic_box;
+    if( !box.is_periodic() ) {
+        this->walk_down(0, dst_r_sq, [this](index_t idx, float_t r_sq) {
+            if( r_sq < dst_r_sq && this->accept(idx) ) {
+                dst_r_sq = r_sq; dst_idx = idx;
+            }
+        });
+        return;
+    }
+
+    // Search each image of the query. A point is taken only from the image
+    // nearest to it.
+    const pos_t q = box.wrap(this->dst_pos);
+    box.visit_images(q, dst_r_sq, [&](const pos_t &img, int code) {
+        this->dst_pos = img;
+        this->walk_down(0, dst_r_sq, [&](index_t idx, float_t r_sq) {
+            if( r_sq < dst_r_sq && this->accept(idx)
+                && box.image_of(this->kdt.point_pos(idx), q) == code ) 
+            {
                 dst_r_sq = r_sq; dst_idx = idx;
-            }}
-        );
+            }
+        });
+    });
 }
 };
 
@@ -607,16 +1754,19 @@ template<typename Policy>
 auto _HIPP_TEMPCLS::nearest(const point_t &p, Policy &&policy) const
 -> ngb_t 
 {
-    _Impl_nearest<Policy> impl{*this, policy, p.pos()};
-    impl();
-    return {impl.dst_idx, impl.dst_r_sq};
+    return _with_view([&](const auto &nodes) -> ngb_t {
+        using view_t = std::decay_t<decltype(nodes)>;
+        _Impl_nearest<Policy, view_t> impl{*this, nodes, policy, p.pos()};
+        impl();
+        return {impl.dst_idx, impl.dst_r_sq};
+    });
 }
 
 _HIPP_TEMPHD
-template<typename Policy>
-struct _HIPP_TEMPCLS::_Impl_nearest_k : _Impl_query_in_order<Policy> {
+template<typename Policy, typename View>
+struct _HIPP_TEMPCLS::_Impl_nearest_k : _Impl_query_in_order<Policy, View> {
 
-    using base_t = _Impl_query_in_order<Policy>;    
+    using base_t = _Impl_query_in_order<Policy, View>;    
     
     ngb_t *const max_queue_b;
     const size_t dst_k;
@@ -624,28 +1774,34 @@ struct _HIPP_TEMPCLS::_Impl_nearest_k : _Impl_query_in_order<Policy> {
     size_t used_k;
     float_t max_r_sq;
     
-_Impl_nearest_k(const _KDTree &kdt, Policy &pl, const pos_t &dst_pos,
-    ContiguousBuffer<ngb_t> ngbs) 
-: base_t(kdt, dst_pos, pl), max_queue_b(ngbs.get_buff()), 
+_Impl_nearest_k(const _KDTree &kdt, const View &nodes, Policy &pl, 
+    const pos_t &dst_pos, ContiguousBuffer<ngb_t> ngbs) 
+: base_t(kdt, nodes, dst_pos, pl), max_queue_b(ngbs.get_buff()), 
 dst_k(ngbs.get_size()), used_k(0), 
 max_r_sq(std::numeric_limits<float_t>::max())
 {}
 
 void operator()() noexcept {
-    if( this->nodes.size() == 0 ) return;
+    if( this->kdt.n_nodes() == 0 ) return;
 
     if( dst_k == 0 ) return;
 
-    this->walk_down(0, 
-        [this](const node_t &n) {
-            const auto dx = this->offset_from(n); 
-            return dx * dx < max_r_sq;
-        }, 
-        [this](index_t idx, const node_t &n) {
-            const auto r_sq = (this->dst_pos - n.pos()).squared_norm();
-            push_queue(idx, r_sq);
-        }
-    );
+    const auto &box = this->kdt._construct_policy._periodic_box;
+    if( !box.is_periodic() ) {
+        this->walk_down(0, max_r_sq, [this](index_t idx, float_t r_sq) {
+            if( this->accept(idx) ) push_queue(idx, r_sq);
+        });
+    } else {
+        const pos_t q = box.wrap(this->dst_pos);
+        box.visit_images(q, max_r_sq, [&](const pos_t &img, int code) {
+            this->dst_pos = img;
+            this->walk_down(0, max_r_sq, [&](index_t idx, float_t r_sq) {
+                if( this->accept(idx) 
+                    && box.image_of(this->kdt.point_pos(idx), q) == code )
+                    push_queue(idx, r_sq);
+            });
+        });
+    }
 
     if( this->pl.sort_by_distance() )
         std::sort_heap(max_queue_b, max_queue_b+used_k);
@@ -673,36 +1829,45 @@ template<typename Policy>
 auto _HIPP_TEMPCLS::nearest_k(const point_t &p, ContiguousBuffer<ngb_t> ngbs, 
     Policy &&policy) const -> index_t
 {
-    _Impl_nearest_k<Policy> impl {*this, policy, p.pos(), ngbs};
-    impl();
-    return impl.used_k;
+    return _with_view([&](const auto &nodes) -> index_t {
+        using view_t = std::decay_t<decltype(nodes)>;
+        _Impl_nearest_k<Policy, view_t> impl {*this, nodes, policy, p.pos(), 
+            ngbs};
+        impl();
+        return impl.used_k;
+    });
 }
 
 _HIPP_TEMPHD
-template<typename Op, typename Policy>
-struct _HIPP_TEMPCLS::_Impl_visit_rect : _Impl_query_pre_order<Policy> {
+template<typename Op, typename Policy, typename View>
+struct _HIPP_TEMPCLS::_Impl_visit_rect : _Impl_query_pre_order<Policy, View> {
 
-    using base_t = _Impl_query_pre_order<Policy>;
+    using base_t = _Impl_query_pre_order<Policy, View>;
 
     const rect_t rect;
     Op &op;
     
-_Impl_visit_rect(const _KDTree &kdt, Policy &pl, const rect_t &_rect, Op &_op) 
-: base_t(kdt, _rect.center().pos(), pl), rect(_rect), op(_op)
+_Impl_visit_rect(const _KDTree &kdt, const View &nodes, Policy &pl, 
+    const rect_t &_rect, Op &_op) 
+: base_t(kdt, nodes, _rect.center().pos(), pl), rect(_rect), op(_op)
 {}
 
+/**
+The bucket scan is generic, and compiled only for a bucketed tree.
+*/
 void operator()() noexcept {
-    if( this->nodes.size() == 0 ) return;
+    if( this->kdt.n_nodes() == 0 ) return;
     this->walk_down(0,
-        [this](const node_t &n) { return this->contains_along_axis(n); },
-        [this](const node_t &n) { return rect.contains(n); },
+        [this](index_t idx) { return this->contains_along_axis(idx); },
+        [this](const point_t &p) { return rect.contains(p); },
+        [this](auto idx) { this->visit_bucket_in_rect(idx, rect, op); },
         op
     );
 };
 
-bool contains_along_axis(const node_t &n) const noexcept {
-    const int axis = n.axis();
-    return rect.contains_along_axis(axis, n.pos()[axis]);
+bool contains_along_axis(index_t idx) const noexcept {
+    const int axis = this->nodes.axis(idx);
+    return rect.contains_along_axis(axis, this->nodes.pos(idx)[axis]);
 }
 
 };
@@ -712,8 +1877,18 @@ template<typename Op, typename Policy>
 void _HIPP_TEMPCLS::visit_rect(const rect_t &rect, Op op, 
     Policy &&policy) const
 {
-    _Impl_visit_rect<Op, std::remove_reference_t<Policy> > 
-        {*this, policy, rect, op} ();
+    _with_view([&](const auto &nodes) {
+        using impl_t = _Impl_visit_rect<Op, std::remove_reference_t<Policy>, 
+            std::decay_t<decltype(nodes)> >;
+        const auto &box = _construct_policy._periodic_box;
+        if( !box.is_periodic() ) {
+            impl_t {*this, nodes, policy, rect, op} ();
+            return;
+        }
+        box.visit_rect_images(rect, [&](const rect_t &img) {
+            impl_t {*this, nodes, policy, img, op} ();
+        });
+    });
 }
 
 _HIPP_TEMPHD
@@ -727,25 +1902,31 @@ auto _HIPP_TEMPCLS::count_rect(const rect_t &rect,
 }
 
 _HIPP_TEMPHD
-template<typename Op, typename Policy>
-struct _HIPP_TEMPCLS::_Impl_visit_sphere : _Impl_query_pre_order<Policy> {
+template<typename Op, typename Policy, typename View>
+struct _HIPP_TEMPCLS::_Impl_visit_sphere 
+: _Impl_query_pre_order<Policy, View> {
 
-    using base_t = _Impl_query_pre_order<Policy>;
+    using base_t = _Impl_query_pre_order<Policy, View>;
 
     const sphere_t sphere;
+    const float_t r_sq;
     Op &op;
     
-_Impl_visit_sphere(const _KDTree &kdt, Policy &pl, const sphere_t &_sphere, 
-    Op &_op) 
-: base_t(kdt, _sphere.center().pos(), pl), sphere(_sphere), op(_op)
+_Impl_visit_sphere(const _KDTree &kdt, const View &nodes, Policy &pl, 
+    const sphere_t &_sphere, Op &_op) 
+: base_t(kdt, nodes, _sphere.center().pos(), pl), sphere(_sphere), 
+r_sq(sphere.r() * sphere.r()), op(_op)
 {}
 
 void operator()() noexcept {
-    if( this->nodes.size() == 0 ) return;
+    if( this->kdt.n_nodes() == 0 ) return;
     this->walk_down(0, 
-        [this](const node_t &n) { 
-            return std::fabs(this->offset_from(n)) < sphere.r(); }, 
-        [this](const node_t &n) { return sphere.contains(n); },
+        [this](index_t idx) { 
+            return std::fabs(this->offset_from(idx)) < sphere.r(); }, 
+        [this](const point_t &p) { return sphere.contains(p); },
+        [this](auto idx) {
+            this->visit_bucket_within(idx, r_sq, op);
+        },
         op);
 };
 
@@ -756,8 +1937,22 @@ template<typename Op, typename Policy>
 void _HIPP_TEMPCLS::visit_sphere(const sphere_t &sphere, Op op, 
     Policy &&policy) const
 {
-    _Impl_visit_sphere<Op, std::remove_reference_t<Policy> > 
-        {*this, policy, sphere, op} ();
+    _with_view([&](const auto &nodes) {
+        using impl_t = _Impl_visit_sphere<Op, 
+            std::remove_reference_t<Policy>, std::decay_t<decltype(nodes)> >;
+        const auto &box = _construct_policy._periodic_box;
+        if( !box.is_periodic() ) {
+            impl_t {*this, nodes, policy, sphere, op} ();
+            return;
+        }
+        box.check_radius(sphere.r());
+        const float_t r_sq = sphere.r() * sphere.r();
+        box.visit_images(box.wrap(sphere.center().pos()), r_sq, 
+            [&](const pos_t &img, int) {
+                impl_t {*this, nodes, policy, 
+                    sphere_t(point_t(img), sphere.r()), op} ();
+            });
+    });
 }
 
 _HIPP_TEMPHD
@@ -770,6 +1965,702 @@ auto _HIPP_TEMPCLS::count_sphere(const sphere_t &sphere,
     return cnt;
 }
 
+_HIPP_TEMPHD
+template<typename PointT, typename Policy>
+void _HIPP_TEMPCLS::nearest_k_batch(ContiguousBuffer<const PointT> pts, 
+    index_t k, vector<index_t> &displs, vector<ngb_t> &ngbs,
+    const batch_query_policy_t &batch_policy, const Policy &policy) const
+{
+    if( k < 0 )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB, 
+            "  ... invalid k=", k);
+    
+    auto [p_pts, n_pts] = pts;
+    _BatchQuery<index_t> bq(batch_policy, n_pts);
+    bq.sort_by(*this, pts);
+    
+    vector<Policy> pls(bq.n_threads(), policy);
+    bq.gather([&](int i_th, index_t i, vector<ngb_t> &buf) {
+        const size_t b = buf.size();
+        buf.resize(b + k);
+        const index_t n = nearest_k(p_pts[i], 
+            ContiguousBuffer<ngb_t>(buf.data()+b, k), pls[i_th]);
+        buf.resize(b + n);
+    }, displs, ngbs);
+}
+
+_HIPP_TEMPHD
+template<typename Policy>
+void _HIPP_TEMPCLS::visit_sphere_batch(
+    ContiguousBuffer<const sphere_t> spheres, 
+    vector<index_t> &displs, vector<index_t> &node_ids,
+    const batch_query_policy_t &batch_policy, const Policy &policy) const
+{
+    auto [p_spheres, n_spheres] = spheres;
+    _BatchQuery<index_t> bq(batch_policy, n_spheres);
+    bq.sort_by_centers(*this, spheres);
+
+    vector<Policy> pls(bq.n_threads(), policy);
+    bq.gather([&](int i_th, index_t i, vector<index_t> &buf) {
+        visit_sphere(p_spheres[i], 
+            [&buf](index_t node_idx) { buf.push_back(node_idx); }, 
+            pls[i_th]);
+    }, displs, node_ids);
+}
+
+_HIPP_TEMPHD
+template<typename Policy>
+void _HIPP_TEMPCLS::count_sphere_batch(
+    ContiguousBuffer<const sphere_t> spheres, vector<index_t> &counts,
+    const batch_query_policy_t &batch_policy, const Policy &policy) const
+{
+    auto [p_spheres, n_spheres] = spheres;
+    _BatchQuery<index_t> bq(batch_policy, n_spheres);
+    bq.sort_by_centers(*this, spheres);
+
+    counts.resize(n_spheres);
+    vector<Policy> pls(bq.n_threads(), policy);
+    bq.for_each([&](int i_th, index_t i) {
+        counts[i] = count_sphere(p_spheres[i], pls[i_th]);
+    });
+}
+
+_HIPP_TEMPHD
+struct _HIPP_TEMPCLS::_Impl_all_nearest_k {
+
+    /**
+    Pairs of subtrees with no more than BRUTE_SIZE points each are matched by 
+    brute force. Subtrees with no more than max(SEED_SIZE, 2k+1) points are 
+    used to seed the rows. The query tree is cut so that there are about 
+    TASKS_PER_THREAD subtrees for each thread.
+    */
+    static constexpr index_t BRUTE_SIZE = 16;
+    static constexpr index_t SEED_SIZE = 16;
+    static constexpr index_t TASKS_PER_THREAD = 16;
+
+    using rows_t = _KNNRows<ngb_t, index_t>;
+
+    const _KDTree &kdt;
+    const index_t n_nodes, n_pts;
+    const all_nearest_k_policy_t &pl;
+    const bool include_self;
+    
+    index_t k_used;
+    std::optional<rows_t> rows;
+    /**
+    Rows are indexed by points, the others by nodes except ``seeds``.
+    boxes[i]: the bounding box {low, high} of the subtree rooted at node i.
+    bounds[i]: upper bound of the k-th neighbor distance of all points in 
+    the subtree rooted at node i.
+    seeds[j]: the root of the seed block containing point j, or -1.
+    */
+    vector<std::pair<pos_t, pos_t> > boxes;
+    vector<float_t> bounds;
+    vector<index_t> seeds;
+
+_Impl_all_nearest_k(const _KDTree &_kdt, index_t k, 
+    const all_nearest_k_policy_t &_pl)
+: kdt(_kdt), n_nodes(kdt.n_nodes()), n_pts(kdt.n_points()), pl(_pl), 
+include_self(pl.include_self())
+{
+    if( k < 0 || pl.n_threads() < 1 )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB, 
+            "  ... invalid k=", k, " or no. of threads ", pl.n_threads());
+    k_used = std::min(k, include_self ? n_pts : n_pts - 1);
+    if( k_used < 0 ) k_used = 0;
+}
+
+void operator()(vector<index_t> &node_ids, vector<ngb_t> &ngbs) {
+    node_ids.resize(n_pts);
+    for(index_t i=0; i<n_pts; ++i) node_ids[i] = i;
+    ngbs.resize(size_t(n_pts) * k_used);
+    if( k_used == 0 ) return;
+
+    rows.emplace(ngbs.data(), n_pts, k_used);
+    if( kdt._construct_policy._periodic_box.is_periodic() ) {
+        periodic();
+        rows->sort_rows(pl.n_threads());
+        return;
+    }
+    find_bounding_boxes();
+    bounds.assign(n_nodes, std::numeric_limits<float_t>::max());
+    seed();
+
+    // Cut the tree into query subtrees (``subtrees``) and the nodes above 
+    // them (``tops``). Each task writes disjoint rows.
+    vector<index_t> subtrees, tops;
+    cut_tree(subtrees, tops);
+    const index_t n_sub = subtrees.size(), n_tasks = n_sub + tops.size();
+    _parallel_tasks(pl.n_threads(), n_tasks, [&](index_t i) {
+        if( i < n_sub ) dual(subtrees[i], 0);
+        else single(pb(tops[i-n_sub]), 0);
+    });
+
+    rows->sort_rows(pl.n_threads());
+}
+
+/**
+The subtree bounds are not valid under the periodic boundary. Each point is
+then queried separately.
+*/
+void periodic() {
+    _parallel_for(pl.n_threads(), n_pts, [&](int, index_t b, index_t e) {
+        vector<ngb_t> buf(k_used + 1);
+        nearest_k_query_policy_t qpl;
+        for(index_t i=b; i<e; ++i) {
+            const index_t n = kdt.nearest_k(point_t(pos(i)), 
+                ContiguousBuffer<ngb_t>(buf.data(), buf.size()), qpl);
+            for(index_t j=0; j<n; ++j) {
+                const auto &ngb = buf[j];
+                if( ngb.node_idx == i && !include_self ) continue;
+                rows->push(i, ngb.node_idx, ngb.r_sq);
+            }
+        }
+    });
+}
+
+/**
+The points ``[pb(i), pe(i))`` of the subtree rooted at node ``i``, and the
+position of point ``j``.
+*/
+index_t pb(index_t i) const noexcept { return kdt._first_point(i); }
+
+index_t pe(index_t i) const noexcept { return kdt.point_range(i).second; }
+
+const pos_t & pos(index_t j) const noexcept { return kdt.point_pos(j); }
+
+/**
+The right child of a split node ``i``, or -1 if it has none.
+*/
+index_t right_child(index_t i) const noexcept {
+    const index_t r = kdt.right_child_idx(i);
+    return r < i + kdt._node_size(i) ? r : index_t(-1);
+}
+
+void find_bounding_boxes() {
+    boxes.resize(n_nodes);
+    for(index_t i=n_nodes-1; i>=0; --i) {
+        auto &[lo, hi] = boxes[i];
+        lo = hi = pos(pb(i));
+        if( is_leaf(i) ) {
+            for(index_t j=pb(i)+1, e=pe(i); j<e; ++j) {
+                const pos_t &p = pos(j);
+                lo[ p < lo ] = p;
+                hi[ p > hi ] = p;
+            }
+            continue;
+        }
+        merge_box(lo, hi, boxes[kdt.left_child_idx(i)]);
+        if( const index_t r = right_child(i); r >= 0 ) 
+            merge_box(lo, hi, boxes[r]);
+    }
+}
+
+static void merge_box(pos_t &lo, pos_t &hi, 
+    const std::pair<pos_t, pos_t> &box) noexcept 
+{
+    lo[ box.first < lo ] = box.first;
+    hi[ box.second > hi ] = box.second;
+}
+
+/**
+Fill the rows by brute force within each maximal subtree of no more than 
+max(SEED_SIZE, 2k+1) points (or a leaf bucket), so that the bounds are 
+finite from the very beginning of the traversal. Pairs in the same seed 
+block are then skipped by candidate().
+*/
+void seed() {
+    const index_t max_sz = std::max(SEED_SIZE, 2*k_used+1);
+    vector<index_t> blocks;
+    seeds.assign(n_pts, -1);
+    for(index_t i=0; i<n_nodes; ) {
+        if( pe(i) - pb(i) > max_sz && !is_leaf(i) ) { ++i; continue; }
+        blocks.push_back(i);
+        i += kdt._node_size(i);
+    }
+    
+    const index_t n_blocks = blocks.size();
+    _parallel_for(pl.n_threads(), n_blocks, 
+        [&](int, index_t b, index_t e) {
+        for(index_t ib=b; ib<e; ++ib) {
+            const index_t q = blocks[ib], q_b = pb(q), q_e = pe(q);
+            for(index_t i=q_b; i<q_e; ++i) {
+                for(index_t j=q_b; j<q_e; ++j) {
+                    if( i == j && !include_self ) continue;
+                    const float_t r_sq = (pos(i) - pos(j)).squared_norm();
+                    rows->push(i, j, r_sq);
+                }
+                seeds[i] = q;
+            }
+        }
+    });
+
+    // Bounds of subtrees, bottom-up.
+    for(index_t i=n_nodes-1; i>=0; --i) {
+        float_t b = rows->kth(pb(i));
+        if( is_leaf(i) ) {
+            for(index_t j=pb(i)+1, e=pe(i); j<e; ++j) 
+                b = std::max(b, rows->kth(j));
+        } else {
+            b = std::max(b, bounds[kdt.left_child_idx(i)]);
+            if( const index_t r = right_child(i); r >= 0 ) 
+                b = std::max(b, bounds[r]);
+        }
+        bounds[i] = b;
+    }
+}
+
+void cut_tree(vector<index_t> &subtrees, vector<index_t> &tops) const {
+    const index_t n_min = pl.n_threads() > 1 ? 
+        TASKS_PER_THREAD * pl.n_threads() : 1;
+    vector<index_t> cur {0}, next;
+    while( index_t(cur.size()) < n_min ) {
+        next.clear();
+        for(auto i: cur) {
+            if( is_leaf(i) ) { subtrees.push_back(i); continue; }
+            tops.push_back(i);
+            next.push_back(kdt.left_child_idx(i));
+            if( const index_t r = right_child(i); r >= 0 ) next.push_back(r);
+        }
+        if( next.empty() ) return;
+        cur.swap(next);
+    }
+    subtrees.insert(subtrees.end(), cur.begin(), cur.end());
+}
+
+float_t box_dist_sq(index_t q, index_t r) const noexcept {
+    return box_dist_sq(boxes[q].first, boxes[q].second, r);
+}
+
+float_t box_dist_sq(const pos_t &p, index_t r) const noexcept {
+    return box_dist_sq(p, p, r);
+}
+
+float_t box_dist_sq(const pos_t &lo, const pos_t &hi, index_t r) 
+const noexcept {
+    const auto &[lo_r, hi_r] = boxes[r];
+    float_t d_sq = 0;
+    for(int i=0; i<DIM; ++i) {
+        float_t d = 0;
+        if( lo_r[i] > hi[i] ) d = lo_r[i] - hi[i];
+        else if( lo[i] > hi_r[i] ) d = lo[i] - hi_r[i];
+        d_sq += d * d;
+    }
+    return d_sq;
+}
+
+/**
+A single point or a leaf bucket - not split in the traversal.
+*/
+bool is_leaf(index_t i) const noexcept {
+    return kdt._node_size(i) == 1;
+}
+
+void candidate(index_t q_pt, index_t r_pt) noexcept {
+    if( seeds[q_pt] >= 0 && seeds[q_pt] == seeds[r_pt] ) return;
+    if( q_pt == r_pt && !include_self ) return;
+    const float_t r_sq = (pos(q_pt) - pos(r_pt)).squared_norm();
+    rows->push(q_pt, r_pt, r_sq);
+}
+
+/** 
+Single point ``q_pt`` against the subtree ``r``. Closer children first.
+*/
+void single(index_t q_pt, index_t r) noexcept {
+    const pos_t &p = pos(q_pt);
+    if( box_dist_sq(p, r) >= rows->kth(q_pt) ) return;
+    if( is_leaf(r) ) {
+        for(index_t j=pb(r), e=pe(r); j<e; ++j) candidate(q_pt, j);
+        return;
+    }
+    candidate(q_pt, pb(r));
+    index_t l = kdt.left_child_idx(r), rr = right_child(r);
+    if( rr < 0 ) { single(q_pt, l); return; }
+    if( box_dist_sq(p, rr) < box_dist_sq(p, l) ) std::swap(l, rr);
+    single(q_pt, l); single(q_pt, rr);
+}
+
+/**
+The point ``r_pt`` against the query subtree ``q``, where ``b`` is an 
+upper bound of the k-th neighbor distance of all points in ``q``.
+*/
+void single_ref(index_t q, index_t r_pt, float_t b) noexcept {
+    b = std::min(b, bounds[q]);
+    const pos_t &p = pos(r_pt);
+    if( box_dist_sq(p, q) >= b ) return;
+    if( is_leaf(q) ) {
+        for(index_t i=pb(q), e=pe(q); i<e; ++i) candidate(i, r_pt);
+        return;
+    }
+    candidate(pb(q), r_pt);
+    single_ref(kdt.left_child_idx(q), r_pt, b);
+    if( const index_t rr = right_child(q); rr >= 0 ) 
+        single_ref(rr, r_pt, b);
+}
+
+/**
+Subtree ``q`` against the subtree ``r``. ``bounds[q]`` is an upper bound of 
+the k-th neighbor distance of all points in ``q``.
+*/
+void dual(index_t q, index_t r) noexcept {
+    if( box_dist_sq(q, r) >= bounds[q] ) return;
+
+    const index_t q_b = pb(q), q_e = pe(q), r_b = pb(r), r_e = pe(r),
+        sz_q = q_e - q_b, sz_r = r_e - r_b;
+    const bool leaf_q = is_leaf(q), leaf_r = is_leaf(r);
+    if( (sz_q <= BRUTE_SIZE || leaf_q) && (sz_r <= BRUTE_SIZE || leaf_r) ) {
+        float_t b = 0;
+        for(index_t i=q_b; i<q_e; ++i) {
+            if( box_dist_sq(pos(i), r) < rows->kth(i) )
+                for(index_t j=r_b; j<r_e; ++j) candidate(i, j);
+            b = std::max(b, rows->kth(i));
+        }
+        bounds[q] = b;
+        return;
+    }
+
+    if( leaf_r || (!leaf_q && sz_q >= sz_r) ) {
+        // Split the query: its own point, then the children.
+        single(q_b, r);
+        float_t b = rows->kth(q_b);
+        const index_t l = kdt.left_child_idx(q);
+        dual(l, r);
+        b = std::max(b, bounds[l]);
+        if( const index_t rr = right_child(q); rr >= 0 ) {
+            dual(rr, r);
+            b = std::max(b, bounds[rr]);
+        }
+        bounds[q] = std::min(bounds[q], b);
+        return;
+    }
+
+    // Split the reference: its own point, then the children, closer first.
+    single_ref(q, r_b, bounds[q]);
+    index_t l = kdt.left_child_idx(r), rr = right_child(r);
+    if( rr < 0 ) { dual(q, l); return; }
+    if( box_dist_sq(q, rr) < box_dist_sq(q, l) ) std::swap(l, rr);
+    dual(q, l); dual(q, rr);
+}
+
+};
+
+_HIPP_TEMPRET
+all_nearest_k(index_t k, vector<index_t> &node_ids, vector<ngb_t> &ngbs, 
+    const all_nearest_k_policy_t &policy) const -> index_t
+{
+    _Impl_all_nearest_k impl {*this, k, policy};
+    impl(node_ids, ngbs);
+    return impl.k_used;
+}
+
+/**
+Adaptor of the dual-tree engines, i.e., the pair counting and the FoF. An 
+entity is either the subtree rooted at node ``i`` or the point of node ``i`` 
+alone (``n == 1``). In both cases, its points are ``[b, b+n)``.
+*/
+_HIPP_TEMPHD
+struct _HIPP_TEMPCLS::_Impl_count_pairs {
+
+    using float_t = typename _KDTree::float_t;
+    using index_t = typename _KDTree::index_t;
+
+    /**
+    Per-tree data. boxes[i]: the bounding box {low, high} of the subtree 
+    rooted at node i. w[j]: the weight of point j. w_sum[i], w_sq_sum[i]: 
+    sum of the weights and their squares in the subtree rooted at node i.
+    */
+    struct side_t {
+        const _KDTree &kdt;
+        vector<std::pair<pos_t, pos_t> > boxes;
+        vector<double> w, w_sum, w_sq_sum;
+    };
+
+    struct entity_t {
+        const side_t *s;
+        index_t i, b, n;
+    };
+
+    const periodic_box_t &box;
+    const bool periodic;
+    side_t side_a;
+    std::optional<side_t> side_b;
+
+_Impl_count_pairs(const _KDTree &kdt_a, const _KDTree *kdt_b, 
+    const pair_count_policy_t &pl)
+: box(kdt_a._construct_policy._periodic_box), periodic(box.is_periodic()),
+side_a{kdt_a, {}, {}, {}, {}}
+{
+    init_side(side_a, pl);
+    if( kdt_b ) {
+        side_b.emplace(side_t{*kdt_b, {}, {}, {}, {}});
+        init_side(*side_b, pl);
+    }
+}
+
+void operator()(ContiguousBuffer<const float_t> edges, 
+    vector<double> &counts, const pair_count_policy_t &pl) const
+{
+    _PairBins<float_t> bins(edges);
+    _PairCounter<_Impl_count_pairs> counter(*this, bins, pl.n_threads());
+    if( side_b ) 
+        counter.count_cross(root(side_a), root(*side_b), counts);
+    else 
+        counter.count_self(root(side_a), counts);
+}
+
+static void init_side(side_t &s, const pair_count_policy_t &pl) {
+    const auto &kdt = s.kdt;
+    const index_t n_nodes = kdt.n_nodes(), n_pts = kdt.n_points();
+    s.w.assign(n_pts, 1.);
+    if( pl.weighted() ) {
+        if constexpr( PADDING >= sizeof(float_t) ) {
+            for(index_t j=0; j<n_pts; ++j)
+                s.w[j] = kdt.template point_pad<float_t>(j);
+        } else {
+            ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB,
+                "  ... weighted pair counting requires a padding of at "
+                "least ", sizeof(float_t), " bytes (got ", PADDING, ")\n");
+        }
+    }
+    
+    s.boxes.resize(n_nodes);
+    s.w_sum.resize(n_nodes);
+    s.w_sq_sum.resize(n_nodes);
+    for(index_t i=n_nodes-1; i>=0; --i) {
+        auto &[lo, hi] = s.boxes[i];
+        const auto [b, e] = kdt.point_range(i);
+        lo = hi = kdt.point_pos(b);
+        double w_sum = 0., w_sq_sum = 0.;
+        const index_t sz = kdt._node_size(i);
+        for(index_t j=b; j<(sz == 1 ? e : b+1); ++j) {
+            const auto &p = kdt.point_pos(j);
+            lo[ p < lo ] = p;
+            hi[ p > hi ] = p;
+            w_sum += s.w[j];
+            w_sq_sum += s.w[j] * s.w[j];
+        }
+        auto merge = [&](index_t j) {
+            const auto &[lo_j, hi_j] = s.boxes[j];
+            lo[ lo_j < lo ] = lo_j;
+            hi[ hi_j > hi ] = hi_j;
+            w_sum += s.w_sum[j];
+            w_sq_sum += s.w_sq_sum[j];
+        };
+        if( sz > 1 ) {
+            const index_t l = kdt.left_child_idx(i), r = kdt.right_child_idx(i);
+            merge(l);
+            if( r < i + sz ) merge(r);
+        }
+        s.w_sum[i] = w_sum;
+        s.w_sq_sum[i] = w_sq_sum;
+    }
+}
+
+static entity_t root(const side_t &s) noexcept {
+    return subtree(s, 0);
+}
+
+static entity_t subtree(const side_t &s, index_t i) noexcept {
+    if( s.kdt.n_nodes() == 0 ) return {&s, 0, 0, 0};
+    const auto [b, e] = s.kdt.point_range(i);
+    return {&s, i, b, e - b};
+}
+
+index_t size(const entity_t &e) const noexcept { return e.n; }
+
+bool is_leaf(const entity_t &e) const noexcept {
+    return e.n == 1 || e.s->kdt._node_size(e.i) == 1;
+}
+
+int split(const entity_t &e, entity_t *parts) const noexcept {
+    const auto &kdt = e.s->kdt;
+    parts[0] = {e.s, e.i, e.b, 1};
+    parts[1] = subtree(*e.s, kdt.left_child_idx(e.i));
+    const index_t r = kdt.right_child_idx(e.i);
+    if( r == e.i + kdt._node_size(e.i) ) return 2;
+    parts[2] = subtree(*e.s, r);
+    return 3;
+}
+
+double weight(const entity_t &e) const noexcept {
+    return e.n == 1 ? e.s->w[e.b] : e.s->w_sum[e.i];
+}
+
+double weight_sq(const entity_t &e) const noexcept {
+    if( e.n == 1 ) { const double w = e.s->w[e.b]; return w * w; }
+    return e.s->w_sq_sum[e.i];
+}
+
+std::pair<float_t, float_t> bounds(const entity_t &a, 
+    const entity_t &b) const noexcept 
+{
+    const auto &[lo_a, hi_a] = box_of(a);
+    const auto &[lo_b, hi_b] = box_of(b);
+    float_t r_sq_min = 0, r_sq_max = 0;
+    for(int k=0; k<DIM; ++k) {
+        float_t gap = axis_gap(lo_a[k], hi_a[k], lo_b[k], hi_b[k], 0),
+            far = axis_far(lo_a[k], hi_a[k], lo_b[k], hi_b[k], 0);
+        const float_t L = box.size()[k];
+        if( periodic && L > 0 ) 
+            for(float_t s: {-L, L}) {
+                gap = std::min(gap, 
+                    axis_gap(lo_a[k], hi_a[k], lo_b[k], hi_b[k], s));
+                far = std::min(far, 
+                    axis_far(lo_a[k], hi_a[k], lo_b[k], hi_b[k], s));
+            }
+        r_sq_min += gap * gap;
+        r_sq_max += far * far;
+    }
+    return {r_sq_min, r_sq_max};
+}
+
+float_t self_bound(const entity_t &a) const noexcept {
+    return bounds(a, a).second;
+}
+
+template<typename Op>
+void brute(const entity_t &a, const entity_t &b, Op &&op) const {
+    const auto &ka = a.s->kdt, &kb = b.s->kdt;
+    const auto &wa = a.s->w, &wb = b.s->w;
+    for(index_t i=a.b; i<a.b+a.n; ++i) {
+        const auto &p = ka.point_pos(i);
+        for(index_t j=b.b; j<b.b+b.n; ++j)
+            op(r_sq_of(p, kb.point_pos(j)), wa[i] * wb[j]);
+    }
+}
+
+template<typename Op>
+void brute_self(const entity_t &a, Op &&op) const {
+    const auto &kdt = a.s->kdt;
+    const auto &w = a.s->w;
+    const index_t e = a.b + a.n;
+    for(index_t i=a.b; i<e; ++i) {
+        const auto &p = kdt.point_pos(i);
+        for(index_t j=i+1; j<e; ++j)
+            op(r_sq_of(p, kdt.point_pos(j)), w[i] * w[j]);
+    }
+}
+
+std::pair<index_t, index_t> range(const entity_t &e) const noexcept {
+    return {e.b, e.b + e.n};
+}
+
+index_t key(const entity_t &e) const noexcept { return e.i; }
+
+index_t n_keys() const noexcept { return side_a.kdt.n_nodes(); }
+
+template<typename Op>
+void brute_idx(const entity_t &a, const entity_t &b, Op &&op) const {
+    const auto &ka = a.s->kdt, &kb = b.s->kdt;
+    for(index_t i=a.b; i<a.b+a.n; ++i) {
+        const auto &p = ka.point_pos(i);
+        for(index_t j=b.b; j<b.b+b.n; ++j)
+            op(i, j, r_sq_of(p, kb.point_pos(j)));
+    }
+}
+
+template<typename Op>
+void brute_self_idx(const entity_t &a, Op &&op) const {
+    const auto &kdt = a.s->kdt;
+    const index_t e = a.b + a.n;
+    for(index_t i=a.b; i<e; ++i) {
+        const auto &p = kdt.point_pos(i);
+        for(index_t j=i+1; j<e; ++j)
+            op(i, j, r_sq_of(p, kdt.point_pos(j)));
+    }
+}
+
+/**
+Squared distance between two points. It is computed in the same way as the 
+bounds of degenerate boxes, so that the rounding never moves a pair out of 
+the bounds of its entities.
+*/
+float_t r_sq_of(const pos_t &p, const pos_t &q) const noexcept {
+    float_t r_sq = 0;
+    for(int k=0; k<DIM; ++k) {
+        float_t d = axis_gap(p[k], p[k], q[k], q[k], 0);
+        const float_t L = box.size()[k];
+        if( periodic && L > 0 )
+            for(float_t s: {-L, L})
+                d = std::min(d, axis_gap(p[k], p[k], q[k], q[k], s));
+        r_sq += d * d;
+    }
+    return r_sq;
+}
+
+std::pair<pos_t, pos_t> box_of(const entity_t &e) const noexcept {
+    if( e.n == 1 ) {
+        const auto &p = e.s->kdt.point_pos(e.b);
+        return {p, p};
+    }
+    return e.s->boxes[e.i];
+}
+
+/**
+Minimal and maximal distances between ``[lo_a, hi_a]`` and 
+``[lo_b, hi_b] + s`` along an axis.
+*/
+static float_t axis_gap(float_t lo_a, float_t hi_a, float_t lo_b, 
+    float_t hi_b, float_t s) noexcept 
+{
+    lo_b += s; hi_b += s;
+    return std::max({float_t(0), lo_b - hi_a, lo_a - hi_b});
+}
+
+static float_t axis_far(float_t lo_a, float_t hi_a, float_t lo_b, 
+    float_t hi_b, float_t s) noexcept 
+{
+    lo_b += s; hi_b += s;
+    return std::max(hi_b - lo_a, hi_a - lo_b);
+}
+
+};
+
+_HIPP_TEMPRET
+count_pairs(ContiguousBuffer<const float_t> edges, vector<double> &counts, 
+    const pair_count_policy_t &policy) const -> void
+{
+    _Impl_count_pairs impl {*this, nullptr, policy};
+    impl(edges, counts, policy);
+}
+
+_HIPP_TEMPRET
+count_pairs(const _KDTree &other, ContiguousBuffer<const float_t> edges, 
+    vector<double> &counts, const pair_count_policy_t &policy) const -> void
+{
+    _Impl_count_pairs impl {*this, &other, policy};
+    impl(edges, counts, policy);
+}
+
+_HIPP_TEMPRET
+fof(float_t b, vector<index_t> &group_ids, const fof_policy_t &policy) const 
+-> index_t 
+{
+    _Impl_count_pairs ad {*this, nullptr, pair_count_policy_t()};
+    _UnionFind<index_t> uf(n_points());
+    _FoFLinker<_Impl_count_pairs> linker(ad, b, uf, policy.n_threads());
+    linker.link_self(ad.root(ad.side_a));
+    return uf.labels(group_ids, policy.min_size(), policy.n_threads());
+}
+
+_HIPP_TEMPRET
+sph_density(vector<float_t> &h, vector<float_t> &rho, 
+    const sph_policy_t &policy) const -> index_t 
+{
+    _SPHSolver<float_t, index_t, DIM> solver(policy, n_points());
+    const auto &box = _construct_policy._periodic_box;
+    auto pos_of = [this](index_t i) -> const pos_t & { 
+        return point_pos(i); 
+    };
+    auto visit = [&, this](index_t i, float_t r, auto &op) {
+        const pos_t &p = point_pos(i);
+        visit_sphere(sphere_t(p, r), [&](index_t j) {
+            op(j, box.r_sq(p, point_pos(j)));
+        });
+    };
+    return solver.solve(pos_of, visit, h, rho);
+}
+
 #undef _HIPP_TEMPHD
 #undef _HIPP_TEMPARG
 #undef _HIPP_TEMPCLS
@@ -786,12 +2677,21 @@ _HIPP_TEMPNORET
 construct_policy_t() : _rng(0, DIM-1, &_re) {
     set_split_axis(DFLT_SPLIT_AXIS);
     set_random_seed(DFLT_RANDOM_SEED);
+    set_n_threads(DFLT_N_THREADS);
+    set_serial_cutoff(DFLT_SERIAL_CUTOFF);
+    set_leaf_size(DFLT_LEAF_SIZE);
+    set_veb_layout(DFLT_VEB_LAYOUT);
 }
 
 _HIPP_TEMPNORET
 construct_policy_t(const construct_policy_t &pl) : construct_policy_t() {
     set_split_axis(pl._split_axis);
     set_random_seed(pl._random_seed);
+    set_n_threads(pl._n_threads);
+    set_serial_cutoff(pl._serial_cutoff);
+    set_leaf_size(pl._leaf_size);
+    _periodic_box = pl._periodic_box;
+    set_veb_layout(pl._veb_layout);
 }
 
 _HIPP_TEMPRET
@@ -799,6 +2699,11 @@ operator=(const construct_policy_t & pl) -> const construct_policy_t & {
     if( this != &pl ) {
         set_split_axis(pl._split_axis);
         set_random_seed(pl._random_seed);
+        set_n_threads(pl._n_threads);
+        set_serial_cutoff(pl._serial_cutoff);
+        set_leaf_size(pl._leaf_size);
+        _periodic_box = pl._periodic_box;
+        set_veb_layout(pl._veb_layout);
     }
     return *this;
 }
@@ -812,13 +2717,23 @@ info(ostream &os, int fmt_cntl, int level) const -> ostream & {
     if( fmt_cntl < 1 ) {
         ps << HIPPCNTL_CLASS_INFO_INLINE(_KDTree::construct_policy_t),
         "{split axis=", axis_split_strs[ax], 
-        ", random seed=", _random_seed, "}";
+        ", random seed=", _random_seed, 
+        ", n threads=", _n_threads, 
+        ", serial cutoff=", _serial_cutoff, 
+        ", leaf size=", _leaf_size, 
+        ", periodic box=", _periodic_box.size(), 
+        ", vEB layout=", _veb_layout, "}";
         return os;
     }
     auto ind = HIPPCNTL_CLASS_INFO_INDENT_STR(level);
     ps << HIPPCNTL_CLASS_INFO(_KDTree::construct_policy_t),
     ind, "Split axis = ", axis_split_strs[ax], 
-         ", random seed = ", _random_seed, '\n';
+         ", random seed = ", _random_seed, '\n',
+    ind, "No. threads = ", _n_threads, 
+         ", serial cutoff = ", _serial_cutoff, 
+         ", leaf size = ", _leaf_size, '\n',
+    ind, "Periodic box = ", _periodic_box.size(), 
+         ", vEB layout = ", _veb_layout, '\n';
     return os;
 }
 
@@ -844,6 +2759,61 @@ set_random_seed(random_seed_t seed) -> construct_policy_t & {
     return *this;
 }
 
+_HIPP_TEMPRET
+n_threads() const noexcept -> int {
+    return _n_threads;
+}
+
+_HIPP_TEMPRET
+set_n_threads(int n_threads) noexcept -> construct_policy_t & {
+    _n_threads = n_threads; return *this;
+}
+
+_HIPP_TEMPRET
+serial_cutoff() const noexcept -> index_t {
+    return _serial_cutoff;
+}
+
+_HIPP_TEMPRET
+set_serial_cutoff(index_t serial_cutoff) noexcept -> construct_policy_t & {
+    _serial_cutoff = serial_cutoff; return *this;
+}
+
+_HIPP_TEMPRET
+leaf_size() const noexcept -> index_t {
+    return _leaf_size;
+}
+
+_HIPP_TEMPRET
+set_leaf_size(index_t leaf_size) noexcept -> construct_policy_t & {
+    _leaf_size = leaf_size; return *this;
+}
+
+_HIPP_TEMPRET
+periodic_box() const noexcept -> const periodic_box_t & {
+    return _periodic_box;
+}
+
+_HIPP_TEMPRET
+set_periodic_box(float_t box_size) noexcept -> construct_policy_t & {
+    return set_periodic_box(pos_t(box_size));
+}
+
+_HIPP_TEMPRET
+set_periodic_box(const pos_t &box_size) noexcept -> construct_policy_t & {
+    _periodic_box = periodic_box_t(box_size); return *this;
+}
+
+_HIPP_TEMPRET
+veb_layout() const noexcept -> bool {
+    return _veb_layout;
+}
+
+_HIPP_TEMPRET
+set_veb_layout(bool on) noexcept -> construct_policy_t & {
+    _veb_layout = on; return *this;
+}
+
 #undef _HIPP_TEMPHD
 #undef _HIPP_TEMPARG
 #undef _HIPP_TEMPCLS
@@ -918,7 +2888,7 @@ container() const noexcept -> const container_t &
 #define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
 
 _HIPP_TEMPNORET
-nearest_k_query_policy_t() noexcept {
+nearest_k_query_policy_t() noexcept : _eps(0), _n_visited(0) {
     sort_by_distance_off();
 }
 
@@ -939,6 +2909,71 @@ sort_by_distance_off() noexcept -> nearest_k_query_policy_t & {
     return *this;
 }
 
+_HIPP_TEMPRET
+eps() const noexcept -> float_t {
+    return _eps;
+}
+
+_HIPP_TEMPRET
+set_eps(float_t eps) -> nearest_k_query_policy_t & {
+    if( !(eps >= 0) )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB, 
+            "  ... invalid eps=", eps, '\n');
+    _eps = eps;
+    return *this;
+}
+
+_HIPP_TEMPRET
+n_visited() const noexcept -> size_t {
+    return _n_visited;
+}
+
+_HIPP_TEMPRET
+reset_n_visited() noexcept -> nearest_k_query_policy_t & {
+    _n_visited = 0;
+    return *this;
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
+
+#define _HIPP_TEMPHD template<typename KDPointT, typename IndexT>
+#define _HIPP_TEMPARG <KDPointT, IndexT>
+#define _HIPP_TEMPCLS _KDTree _HIPP_TEMPARG::nearest_query_policy_t
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPNORET
+nearest_query_policy_t() noexcept : _eps(0), _n_visited(0) {}
+
+_HIPP_TEMPRET
+eps() const noexcept -> float_t {
+    return _eps;
+}
+
+_HIPP_TEMPRET
+set_eps(float_t eps) -> nearest_query_policy_t & {
+    if( !(eps >= 0) )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB, 
+            "  ... invalid eps=", eps, '\n');
+    _eps = eps;
+    return *this;
+}
+
+_HIPP_TEMPRET
+n_visited() const noexcept -> size_t {
+    return _n_visited;
+}
+
+_HIPP_TEMPRET
+reset_n_visited() noexcept -> nearest_query_policy_t & {
+    _n_visited = 0;
+    return *this;
+}
+
 #undef _HIPP_TEMPHD
 #undef _HIPP_TEMPARG
 #undef _HIPP_TEMPCLS
@@ -0,0 +1,352 @@
+/**
+create: Yangyao CHEN, 2026/10/17
+    [write   ] _OutOfCorePolicy - policy of the out-of-core tree construction.
+    [write   ] _PointRunFile, _H5PointSource - sources of points streamed
+        from the disk.
+    [write   ] _RadixKey - order-preserving integer keys of floating-point
+        numbers.
+*/
+
+#ifndef _HIPPNUMERICAL_KDSEARCH_OUT_OF_CORE_H_
+#define _HIPPNUMERICAL_KDSEARCH_OUT_OF_CORE_H_
+
+#include "kdsearch_base.h"
+#include <fstream>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+
+namespace HIPP::NUMERICAL::_KDSEARCH {
+
+/**
+Policy of the out-of-core (i.e., external-memory) construction.
+
+max_in_core: the maximal number of points of a subtree built in memory. The
+top levels of the tree are split by streaming passes over the disk, until
+each subtree has no more than ``max_in_core`` points. Default ``2^24``.
+
+chunk_size: the number of points read or written by each disk access.
+Default ``2^16``.
+
+scratch_dir: the directory of the temporary files of the buckets. Default
+``"."``. At most about as many points as the input are on the disk at any
+time.
+*/
+class _OutOfCorePolicy {
+public:
+    static constexpr std::ptrdiff_t DFLT_MAX_IN_CORE = 1 << 24;
+    static constexpr std::ptrdiff_t DFLT_CHUNK_SIZE = 1 << 16;
+    inline static const string DFLT_SCRATCH_DIR = ".";
+
+    _OutOfCorePolicy();
+
+    ostream & info(ostream &os = cout, int fmt_cntl = 0, int level = 0) const;
+    friend ostream & operator<< (ostream &os,
+        const _OutOfCorePolicy &pl) { return pl.info(os); }
+
+    std::ptrdiff_t max_in_core() const noexcept;
+    _OutOfCorePolicy & set_max_in_core(std::ptrdiff_t max_in_core) noexcept;
+
+    std::ptrdiff_t chunk_size() const noexcept;
+    _OutOfCorePolicy & set_chunk_size(std::ptrdiff_t chunk_size) noexcept;
+
+    const string & scratch_dir() const noexcept;
+    _OutOfCorePolicy & set_scratch_dir(const string &scratch_dir);
+protected:
+    std::ptrdiff_t _max_in_core, _chunk_size;
+    string _scratch_dir;
+};
+
+/**
+A source of points for the out-of-core construction is any type with
+- ``size()``: the number of points.
+- ``read(b, n, p)``: copy the points ``[b, b+n)`` into ``p``.
+
+Points are read in ascending order of ``b``, by blocks of at most
+``chunk_size`` points.
+*/
+
+/**
+Points stored as raw records in a binary file, i.e., a run of points that are
+appended and read back by blocks. It is both the bucket of the out-of-core
+construction and a source of points, e.g., points dumped by ``append()``
+once and used for many constructions.
+
+(1): open an existing file for reading.
+(2): create (or truncate) a file for appending and reading. If
+``auto_remove``, the file is removed on destruction.
+*/
+template<typename KDPointT>
+class _PointRunFile {
+public:
+    using kd_point_t = KDPointT;
+
+    explicit _PointRunFile(const string &file_name);
+    _PointRunFile(const string &file_name, bool auto_remove);
+    ~_PointRunFile() noexcept;
+
+    _PointRunFile(const _PointRunFile &) = delete;
+    _PointRunFile & operator=(const _PointRunFile &) = delete;
+
+    const string & file_name() const noexcept;
+    size_t size() const noexcept;
+
+    void append(const kd_point_t *p, size_t n);
+    void read(size_t b, size_t n, kd_point_t *p);
+
+    /**
+    Close and remove the file. The run becomes empty.
+    */
+    void remove() noexcept;
+protected:
+    string _file_name;
+    std::fstream _fs;
+    size_t _size;
+    bool _auto_remove;
+};
+
+/**
+Points in a HDF5 dataset of floating-point positions, shaped ``{N, DIM}``.
+``DatasetT`` is ``IO::H5::Dataset`` - the hippio module is needed only if
+this source is used. Blocks are read as hyperslabs.
+
+If ``PadT`` is not ``void``, the padding of each point is filled with its
+row index in the dataset, converted to ``PadT``, so that the nodes of the
+tree refer back to the rows. Otherwise the padding is zero-filled.
+*/
+template<typename KDPointT, typename DatasetT, typename PadT = void>
+class _H5PointSource {
+public:
+    using kd_point_t = KDPointT;
+    using float_t = typename kd_point_t::float_t;
+
+    static constexpr int DIM = kd_point_t::DIM;
+
+    static_assert(std::is_void_v<PadT>
+        || sizeof(PadT) <= kd_point_t::PADDING,
+        "PadT does not fit in the padding of the point");
+
+    explicit _H5PointSource(DatasetT dset);
+
+    size_t size() const noexcept;
+    void read(size_t b, size_t n, kd_point_t *p);
+protected:
+    DatasetT _dset;
+    size_t _size;
+    vector<float_t> _buf;
+};
+
+/**
+Order-preserving unsigned integer key of a floating-point number, i.e.,
+``x < y`` implies ``key(x) < key(y)`` for non-NaN values. Used for the
+selection by radix.
+*/
+template<typename FloatT>
+struct _RadixKey {
+    static_assert(sizeof(FloatT) == 4 || sizeof(FloatT) == 8,
+        "only 32-bit or 64-bit floating-point numbers are supported");
+
+    using key_t = std::conditional_t<sizeof(FloatT) == 4,
+        std::uint32_t, std::uint64_t>;
+    static constexpr int N_BITS = sizeof(key_t) * 8;
+    static constexpr key_t SIGN = key_t(1) << (N_BITS - 1);
+
+    static key_t key(FloatT x) noexcept {
+        key_t k;
+        std::memcpy(&k, &x, sizeof(k));
+        return (k & SIGN) ? ~k : (k | SIGN);
+    }
+};
+
+/* Implementation */
+
+inline _OutOfCorePolicy::_OutOfCorePolicy() {
+    set_max_in_core(DFLT_MAX_IN_CORE);
+    set_chunk_size(DFLT_CHUNK_SIZE);
+    set_scratch_dir(DFLT_SCRATCH_DIR);
+}
+
+inline ostream & _OutOfCorePolicy::info(ostream &os, int fmt_cntl,
+    int level) const
+{
+    PStream ps{os};
+    if( fmt_cntl < 1 ) {
+        ps << HIPPCNTL_CLASS_INFO_INLINE(_OutOfCorePolicy),
+        "{max in core=", _max_in_core, ", chunk size=", _chunk_size,
+        ", scratch dir=", _scratch_dir, "}";
+        return os;
+    }
+    auto ind = HIPPCNTL_CLASS_INFO_INDENT_STR(level);
+    ps << HIPPCNTL_CLASS_INFO(_OutOfCorePolicy),
+    ind, "Max in core = ", _max_in_core, ", chunk size = ", _chunk_size,
+        '\n',
+    ind, "Scratch dir = ", _scratch_dir, '\n';
+    return os;
+}
+
+inline std::ptrdiff_t _OutOfCorePolicy::max_in_core() const noexcept {
+    return _max_in_core;
+}
+
+inline _OutOfCorePolicy & _OutOfCorePolicy::set_max_in_core(
+    std::ptrdiff_t max_in_core) noexcept
+{
+    _max_in_core = max_in_core;
+    return *this;
+}
+
+inline std::ptrdiff_t _OutOfCorePolicy::chunk_size() const noexcept {
+    return _chunk_size;
+}
+
+inline _OutOfCorePolicy & _OutOfCorePolicy::set_chunk_size(
+    std::ptrdiff_t chunk_size) noexcept
+{
+    _chunk_size = chunk_size;
+    return *this;
+}
+
+inline const string & _OutOfCorePolicy::scratch_dir() const noexcept {
+    return _scratch_dir;
+}
+
+inline _OutOfCorePolicy & _OutOfCorePolicy::set_scratch_dir(
+    const string &scratch_dir)
+{
+    _scratch_dir = scratch_dir;
+    return *this;
+}
+
+#define _HIPP_TEMPHD template<typename KDPointT>
+#define _HIPP_TEMPARG <KDPointT>
+#define _HIPP_TEMPCLS _PointRunFile _HIPP_TEMPARG
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPNORET
+_PointRunFile(const string &file_name)
+: _file_name(file_name), _size(0), _auto_remove(false)
+{
+    _fs.open(file_name, std::ios::binary | std::ios::in);
+    if( !_fs )
+        ErrSystem::throw_(errno, emFLPFB, "  ... cannot open file ",
+            file_name, '\n');
+    _fs.seekg(0, std::ios::end);
+    const auto n_bytes = static_cast<size_t>(_fs.tellg());
+    if( n_bytes % sizeof(kd_point_t) != 0 )
+        ErrRuntime::throw_(ErrRuntime::eDEFAULT, emFLPFB, "  ... file ",
+            file_name, " of ", n_bytes, " bytes is not a run of points"
+            " sized ", sizeof(kd_point_t), '\n');
+    _size = n_bytes / sizeof(kd_point_t);
+}
+
+_HIPP_TEMPNORET
+_PointRunFile(const string &file_name, bool auto_remove)
+: _file_name(file_name), _size(0), _auto_remove(auto_remove)
+{
+    _fs.open(file_name, std::ios::binary | std::ios::in | std::ios::out
+        | std::ios::trunc);
+    if( !_fs )
+        ErrSystem::throw_(errno, emFLPFB, "  ... cannot create file ",
+            file_name, '\n');
+}
+
+_HIPP_TEMPNORET
+~_PointRunFile() noexcept {
+    if( _auto_remove ) remove();
+}
+
+_HIPP_TEMPRET
+file_name() const noexcept -> const string & {
+    return _file_name;
+}
+
+_HIPP_TEMPRET
+size() const noexcept -> size_t {
+    return _size;
+}
+
+_HIPP_TEMPRET
+append(const kd_point_t *p, size_t n) -> void {
+    _fs.seekp(0, std::ios::end);
+    _fs.write(reinterpret_cast<const char *>(p), n * sizeof(kd_point_t));
+    if( !_fs )
+        ErrSystem::throw_(errno, emFLPFB, "  ... cannot write file ",
+            _file_name, '\n');
+    _size += n;
+}
+
+_HIPP_TEMPRET
+read(size_t b, size_t n, kd_point_t *p) -> void {
+    if( b + n > _size )
+        ErrLogic::throw_(ErrLogic::eOUTOFRANGE, emFLPFB,
+            "  ... points [", b, ", ", b+n, ") out of range (size ", _size,
+            ")\n");
+    _fs.seekg(b * sizeof(kd_point_t));
+    _fs.read(reinterpret_cast<char *>(p), n * sizeof(kd_point_t));
+    if( !_fs )
+        ErrRuntime::throw_(ErrRuntime::eDEFAULT, emFLPFB,
+            "  ... file ", _file_name, " is truncated\n");
+}
+
+_HIPP_TEMPRET
+remove() noexcept -> void {
+    if( _fs.is_open() ) {
+        _fs.close();
+        std::remove(_file_name.c_str());
+    }
+    _size = 0;
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
+
+#define _HIPP_TEMPHD template<typename KDPointT, typename DatasetT, \
+    typename PadT>
+#define _HIPP_TEMPARG <KDPointT, DatasetT, PadT>
+#define _HIPP_TEMPCLS _H5PointSource _HIPP_TEMPARG
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPNORET
+_H5PointSource(DatasetT dset) : _dset(std::move(dset)) {
+    const auto dims = _dset.dataspace().dims();
+    if( dims.ndims() != 2 || dims[1] != DIM )
+        ErrRuntime::throw_(ErrRuntime::eDEFAULT, emFLPFB,
+            "  ... dataset has dims ", dims, " (expect {n, ", DIM, "})\n");
+    _size = dims[0];
+}
+
+_HIPP_TEMPRET
+size() const noexcept -> size_t {
+    return _size;
+}
+
+_HIPP_TEMPRET
+read(size_t b, size_t n, kd_point_t *p) -> void {
+    if( n == 0 ) return;
+    _dset.read_hyperslab(_buf, {{b, 0}, {n, DIM}});
+    for(size_t i=0; i<n; ++i) {
+        auto &pt = p[i];
+        for(int d=0; d<DIM; ++d) pt.pos()[d] = _buf[i*DIM+d];
+        if constexpr( kd_point_t::PADDING > 0 ) {
+            std::fill_n(pt.pad(), kd_point_t::PADDING, 0);
+            if constexpr( !std::is_void_v<PadT> )
+                pt.fill_pad(static_cast<PadT>(b+i));
+        }
+    }
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
+
+} // namespace HIPP::NUMERICAL::_KDSEARCH
+
+#endif	//_HIPPNUMERICAL_KDSEARCH_OUT_OF_CORE_H_
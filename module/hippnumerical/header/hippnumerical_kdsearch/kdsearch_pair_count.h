@@ -0,0 +1,372 @@
+/**
+create: Yangyao CHEN, 2026/10/17
+    [write   ] _PairCountPolicy - policy of the binned pair counting.
+    [write   ] _PairBins - radial bins of the pair counting.
+    [write   ] _PairCounter - dual-tree pair counting engine shared by the
+        trees.
+*/
+
+#ifndef _HIPPNUMERICAL_KDSEARCH_PAIR_COUNT_H_
+#define _HIPPNUMERICAL_KDSEARCH_PAIR_COUNT_H_
+
+#include "kdsearch_base.h"
+
+namespace HIPP::NUMERICAL::_KDSEARCH {
+
+/**
+Policy of the binned pair counting.
+
+n_threads: the number of threads. The traversal is expanded at the top into
+enough independent node pairs for all threads, each counted into its own
+histogram. Histograms are summed in a fixed order.
+
+weighted: if on, each point is weighted by a ``float_t`` value stored at the
+beginning of its padding, and a pair contributes the product of the weights
+of its points. Otherwise, each pair contributes 1.
+*/
+class _PairCountPolicy {
+public:
+    static constexpr int DFLT_N_THREADS = 1;
+    static constexpr bool DFLT_WEIGHTED = false;
+
+    _PairCountPolicy() noexcept;
+
+    ostream & info(ostream &os = cout, int fmt_cntl = 0, int level = 0) const;
+    friend ostream & operator<< (ostream &os,
+        const _PairCountPolicy &pl) { return pl.info(os); }
+
+    int n_threads() const noexcept;
+    _PairCountPolicy & set_n_threads(int n_threads) noexcept;
+
+    bool weighted() const noexcept;
+    _PairCountPolicy & weighted_on() noexcept;
+    _PairCountPolicy & weighted_off() noexcept;
+protected:
+    int _n_threads;
+    bool _weighted;
+};
+
+/**
+Radial bins defined by ``n_bins + 1`` edges ``r[0] < r[1] < ...``. A pair
+at distance ``d`` falls in bin ``b`` if ``r[b] <= d < r[b+1]``. Binning is
+made on squared distances, i.e., compared with ``r[b]*r[b]``.
+
+The constructor throws an ``ErrLogic`` if there are less than two edges, or
+if the edges are negative or not strictly ascending.
+
+bin_of(r_sq): the bin of a pair, or ``binNONE`` if out of all bins.
+bin_of(r_sq_min, r_sq_max): the bin of all pairs with squared distances in
+``[r_sq_min, r_sq_max]``, ``binNONE`` if none of them is in any bin, or
+``binMIXED`` if they may fall in different bins.
+*/
+template<typename FloatT>
+class _PairBins {
+public:
+    using float_t = FloatT;
+
+    static constexpr int binNONE = -1, binMIXED = -2;
+
+    explicit _PairBins(ContiguousBuffer<const float_t> edges);
+
+    int n_bins() const noexcept;
+    int bin_of(float_t r_sq) const noexcept;
+    int bin_of(float_t r_sq_min, float_t r_sq_max) const noexcept;
+protected:
+    vector<float_t> _edges_sq;
+};
+
+/**
+Dual-tree pair counting engine. The tree-specific parts are provided by
+the adaptor, which views a tree as nested "entities", i.e., disjoint sets of
+points with bounds. An ``Adaptor`` must provide:
+
+- ``entity_t``, ``float_t`` and ``index_t``.
+- ``size(e)``: the number of points in entity ``e``.
+- ``is_leaf(e)``: whether ``e`` cannot be split.
+- ``split(e, parts)``: split a non-leaf ``e`` into at most ``MAX_PARTS``
+  disjoint entities written into ``parts``, returning their number.
+- ``bounds(a, b)``: lower and upper bounds of the squared distances between
+  the points of ``a`` (the first tree) and ``b`` (the second tree).
+- ``self_bound(a)``: an upper bound of the squared distances within ``a``.
+- ``weight(e)``, ``weight_sq(e)``: the sum of the weights, and of their
+  squares, of the points in ``e``.
+- ``brute(a, b, op)``: call ``op(r_sq, w)`` on each pair of points in ``a``
+  and ``b``, where ``w`` is the product of the weights.
+- ``brute_self(a, op)``: the same on each unordered pair of distinct points
+  in ``a``.
+
+The bounds must be consistent with the distances given by the brute-force
+scans, i.e., a pair never falls out of the bounds due to rounding.
+
+Pairs of entities that fall entirely in a single bin are counted at once.
+Pairs of entities with no more than ``BRUTE_SIZE`` points each (or leaves)
+are scanned by brute force.
+*/
+template<typename Adaptor>
+class _PairCounter {
+public:
+    using adaptor_t = Adaptor;
+    using entity_t = typename adaptor_t::entity_t;
+    using float_t = typename adaptor_t::float_t;
+    using index_t = typename adaptor_t::index_t;
+    using bins_t = _PairBins<float_t>;
+
+    static constexpr int MAX_PARTS = 3;
+    static constexpr index_t BRUTE_SIZE = 16;
+    static constexpr index_t TASKS_PER_THREAD = 16;
+
+    _PairCounter(const adaptor_t &ad, const bins_t &bins, int n_threads);
+
+    /**
+    count_self(): count the unordered pairs of distinct points in ``root``.
+    count_cross(): count the pairs of points, one in ``root_a`` of the first
+    tree and the other in ``root_b`` of the second.
+
+    On exit, ``counts`` is resized to the number of bins, holding the
+    (weighted) number of pairs in each bin.
+    */
+    void count_self(const entity_t &root, vector<double> &counts) const;
+    void count_cross(const entity_t &root_a, const entity_t &root_b,
+        vector<double> &counts) const;
+protected:
+    const adaptor_t &_ad;
+    const bins_t &_bins;
+    int _n_threads;
+
+    struct task_t {
+        entity_t a, b;
+        bool is_self;
+    };
+
+    void _run(const vector<task_t> &roots, vector<double> &counts) const;
+
+    /**
+    Process a task by one level, i.e., count it at once if possible, or
+    split it and call ``next(sub_task)`` on each sub task.
+    */
+    template<typename Next>
+    void _step(const task_t &t, double *hist, Next &&next) const;
+    void _recurse(const task_t &t, double *hist) const;
+
+    bool _is_small(const entity_t &e) const noexcept;
+};
+
+inline _PairCountPolicy::_PairCountPolicy() noexcept {
+    set_n_threads(DFLT_N_THREADS);
+    _weighted = DFLT_WEIGHTED;
+}
+
+inline ostream & _PairCountPolicy::info(ostream &os, int fmt_cntl,
+    int level) const
+{
+    PStream ps{os};
+    if( fmt_cntl < 1 ) {
+        ps << HIPPCNTL_CLASS_INFO_INLINE(_PairCountPolicy),
+        "{n threads=", _n_threads, ", weighted=", _weighted, "}";
+        return os;
+    }
+    auto ind = HIPPCNTL_CLASS_INFO_INDENT_STR(level);
+    ps << HIPPCNTL_CLASS_INFO(_PairCountPolicy),
+    ind, "No. threads = ", _n_threads, ", weighted = ", _weighted, '\n';
+    return os;
+}
+
+inline int _PairCountPolicy::n_threads() const noexcept {
+    return _n_threads;
+}
+
+inline _PairCountPolicy &
+_PairCountPolicy::set_n_threads(int n_threads) noexcept {
+    _n_threads = n_threads; return *this;
+}
+
+inline bool _PairCountPolicy::weighted() const noexcept {
+    return _weighted;
+}
+
+inline _PairCountPolicy & _PairCountPolicy::weighted_on() noexcept {
+    _weighted = true; return *this;
+}
+
+inline _PairCountPolicy & _PairCountPolicy::weighted_off() noexcept {
+    _weighted = false; return *this;
+}
+
+#define _HIPP_TEMPHD template<typename FloatT>
+#define _HIPP_TEMPARG <FloatT>
+#define _HIPP_TEMPCLS _PairBins _HIPP_TEMPARG
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPNORET
+_PairBins(ContiguousBuffer<const float_t> edges) {
+    auto [p, n] = edges;
+    if( n < 2 )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB,
+            "  ... at least 2 bin edges are required (got ", n, ")\n");
+    for(size_t i=0; i<n; ++i) {
+        if( p[i] < 0 || (i > 0 && !(p[i] > p[i-1])) )
+            ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB,
+                "  ... bin edges must be non-negative and strictly "
+                "ascending (edge ", i, " = ", p[i], ")\n");
+        _edges_sq.push_back(p[i] * p[i]);
+    }
+}
+
+_HIPP_TEMPRET
+n_bins() const noexcept -> int {
+    return static_cast<int>(_edges_sq.size()) - 1;
+}
+
+_HIPP_TEMPRET
+bin_of(float_t r_sq) const noexcept -> int {
+    auto it = std::upper_bound(_edges_sq.begin(), _edges_sq.end(), r_sq);
+    const int b = static_cast<int>(it - _edges_sq.begin()) - 1;
+    return (b < 0 || b >= n_bins()) ? binNONE : b;
+}
+
+_HIPP_TEMPRET
+bin_of(float_t r_sq_min, float_t r_sq_max) const noexcept -> int {
+    if( r_sq_min >= _edges_sq.back() || r_sq_max < _edges_sq.front() )
+        return binNONE;
+    const int b = bin_of(r_sq_min);
+    return ( b >= 0 && r_sq_max < _edges_sq[b+1] ) ? b : binMIXED;
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
+
+#define _HIPP_TEMPHD template<typename Adaptor>
+#define _HIPP_TEMPARG <Adaptor>
+#define _HIPP_TEMPCLS _PairCounter _HIPP_TEMPARG
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPNORET
+_PairCounter(const adaptor_t &ad, const bins_t &bins, int n_threads)
+: _ad(ad), _bins(bins), _n_threads(n_threads)
+{
+    if( n_threads < 1 )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB,
+            "  ... invalid no. of threads ", n_threads, '\n');
+}
+
+_HIPP_TEMPRET
+count_self(const entity_t &root, vector<double> &counts) const -> void {
+    _run({task_t{root, root, true}}, counts);
+}
+
+_HIPP_TEMPRET
+count_cross(const entity_t &root_a, const entity_t &root_b,
+    vector<double> &counts) const -> void
+{
+    _run({task_t{root_a, root_b, false}}, counts);
+}
+
+_HIPP_TEMPRET
+_run(const vector<task_t> &roots, vector<double> &counts) const -> void {
+    const int n_bins = _bins.n_bins();
+    counts.assign(n_bins, 0.);
+
+    // Expand the traversal breadth-first until there are enough tasks.
+    // Pairs counted during the expansion go to ``counts`` directly.
+    const size_t n_min = _n_threads > 1 ?
+        size_t(TASKS_PER_THREAD) * _n_threads : 1;
+    vector<task_t> cur, next;
+    for(auto &t: roots)
+        if( _ad.size(t.a) > 0 && _ad.size(t.b) > 0 ) cur.push_back(t);
+    while( !cur.empty() && cur.size() < n_min ) {
+        next.clear();
+        for(auto &t: cur)
+            _step(t, counts.data(), [&](const task_t &s){ next.push_back(s); });
+        cur.swap(next);
+    }
+
+    const index_t n_tasks = cur.size();
+    vector<double> hists(size_t(n_tasks) * n_bins, 0.);
+    _parallel_tasks(_n_threads, n_tasks, [&](index_t i) {
+        _recurse(cur[i], hists.data() + size_t(i) * n_bins);
+    });
+    for(index_t i=0; i<n_tasks; ++i) {
+        const double *h = hists.data() + size_t(i) * n_bins;
+        for(int b=0; b<n_bins; ++b) counts[b] += h[b];
+    }
+}
+
+_HIPP_TEMPHD
+template<typename Next>
+void _HIPP_TEMPCLS::_step(const task_t &t, double *hist, Next &&next) const {
+    const auto &a = t.a, &b = t.b;
+    entity_t parts[MAX_PARTS];
+
+    if( t.is_self ) {
+        if( _ad.size(a) < 2 ) return;
+        const int bin = _bins.bin_of(float_t(0), _ad.self_bound(a));
+        if( bin == bins_t::binNONE ) return;
+        if( bin >= 0 ) {
+            const double w = _ad.weight(a);
+            hist[bin] += 0.5 * (w * w - _ad.weight_sq(a));
+            return;
+        }
+        if( _is_small(a) ) {
+            _ad.brute_self(a, [&](float_t r_sq, double w) {
+                const int bin = _bins.bin_of(r_sq);
+                if( bin >= 0 ) hist[bin] += w;
+            });
+            return;
+        }
+        const int n = _ad.split(a, parts);
+        for(int i=0; i<n; ++i) {
+            next(task_t{parts[i], parts[i], true});
+            for(int j=i+1; j<n; ++j)
+                next(task_t{parts[i], parts[j], false});
+        }
+        return;
+    }
+
+    const auto [r_sq_min, r_sq_max] = _ad.bounds(a, b);
+    const int bin = _bins.bin_of(r_sq_min, r_sq_max);
+    if( bin == bins_t::binNONE ) return;
+    if( bin >= 0 ) {
+        hist[bin] += _ad.weight(a) * _ad.weight(b);
+        return;
+    }
+    const bool small_a = _is_small(a), small_b = _is_small(b);
+    if( small_a && small_b ) {
+        _ad.brute(a, b, [&](float_t r_sq, double w) {
+            const int bin = _bins.bin_of(r_sq);
+            if( bin >= 0 ) hist[bin] += w;
+        });
+        return;
+    }
+    // Split the larger one.
+    const bool split_a = _ad.is_leaf(b)
+        || ( !_ad.is_leaf(a) && _ad.size(a) >= _ad.size(b) );
+    const int n = _ad.split(split_a ? a : b, parts);
+    for(int i=0; i<n; ++i)
+        next(split_a ? task_t{parts[i], b, false}
+            : task_t{a, parts[i], false});
+}
+
+_HIPP_TEMPRET
+_recurse(const task_t &t, double *hist) const -> void {
+    _step(t, hist, [&](const task_t &s) { _recurse(s, hist); });
+}
+
+_HIPP_TEMPRET
+_is_small(const entity_t &e) const noexcept -> bool {
+    return _ad.is_leaf(e) || _ad.size(e) <= BRUTE_SIZE;
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
+
+} // namespace HIPP::NUMERICAL::_KDSEARCH
+
+#endif	//_HIPPNUMERICAL_KDSEARCH_PAIR_COUNT_H_
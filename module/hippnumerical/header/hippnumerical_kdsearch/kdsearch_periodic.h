@@ -0,0 +1,246 @@
+/**
+create: Yangyao CHEN, 2026/10/17
+    [write   ] _PeriodicBox - periodic boundary condition of the
+        space-searching structures.
+*/
+
+#ifndef _HIPPNUMERICAL_KDSEARCH_PERIODIC_H_
+#define _HIPPNUMERICAL_KDSEARCH_PERIODIC_H_
+
+#include "kdsearch_base.h"
+
+namespace HIPP::NUMERICAL::_KDSEARCH {
+
+/**
+Periodic box ``[0, size[i])`` along each axis ``i`` with ``size[i] > 0``.
+Axes with ``size[i] <= 0`` are not periodic. All points of a structure must be
+in the box along the periodic axes. Query positions and regions may be
+anywhere - they are wrapped into the box.
+
+A query on a periodic structure is made on the periodic images of the query
+position or region, i.e., shifted by ``-size[i]``, ``0`` or ``size[i]``
+along each periodic axis, so that no point has to be replicated. An image is
+identified by a code, whose base-3 digit ``i`` is the shift along axis ``i``
+(0 for no shift, 1 for ``+size[i]``, 2 for ``-size[i]``). Image 0 is the
+query itself.
+
+visit_images(): call ``op(image, code)`` on each image of a (wrapped)
+position ``q``, whose squared distance to the box is less than
+``max_r_sq``. Image 0 is always visited first. ``max_r_sq`` is re-read
+for each image, so that ``op`` may shrink it. The squared distance to the
+box never exceeds the one to any point in the box, i.e., no image holding a
+point within ``max_r_sq`` is skipped.
+
+image_of(): the code of the image of a (wrapped) position ``q`` nearest to
+``p`` (the minimum image). A point found from several images is taken only
+from the image of this code, so that each point is found once, with its
+minimum-image distance.
+
+visit_rect_images(): call ``op(rect)`` on each image of ``rect`` that
+intersects the box. A point is in at most one of them. Along an axis where
+``rect`` is no smaller than the box, all points are in the image.
+
+r_sq(): the squared minimum-image distance between ``p`` and ``q``.
+
+r_sq_to(): a lower bound of the squared minimum-image distance from ``p`` to
+the points in ``rect``.
+
+check_radius(): throw an ``ErrLogic`` if a sphere of radius ``r`` is larger
+than half the box along any periodic axis, i.e., if a point may be covered
+by two of its images.
+*/
+template<typename FloatT, int DIM>
+class _PeriodicBox {
+public:
+    using float_t = FloatT;
+    using point_t = GEOMETRY::Point<float_t, DIM>;
+    using pos_t   = typename point_t::pos_t;
+    using rect_t  = GEOMETRY::Rect<float_t, DIM>;
+
+    static constexpr int n_images() noexcept {
+        int n = 1;
+        for(int i=0; i<DIM; ++i) n *= 3;
+        return n;
+    }
+
+    _PeriodicBox() noexcept;
+    explicit _PeriodicBox(const pos_t &size) noexcept;
+
+    bool is_periodic() const noexcept;
+    const pos_t & size() const noexcept;
+
+    pos_t wrap(const pos_t &p) const noexcept;
+    int image_of(const pos_t &p, const pos_t &q) const noexcept;
+
+    template<typename Op>
+    void visit_images(const pos_t &q, const float_t &max_r_sq,
+        Op &&op) const;
+
+    template<typename Op>
+    void visit_rect_images(const rect_t &rect, Op &&op) const;
+
+    float_t r_sq(const pos_t &p, const pos_t &q) const noexcept;
+    float_t r_sq_to(const rect_t &rect, const pos_t &p) const noexcept;
+
+    void check_radius(float_t r) const;
+protected:
+    pos_t _size;
+    bool _is_periodic;
+};
+
+#define _HIPP_TEMPHD template<typename FloatT, int DIM>
+#define _HIPP_TEMPARG <FloatT, DIM>
+#define _HIPP_TEMPCLS _PeriodicBox _HIPP_TEMPARG
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPNORET
+_PeriodicBox() noexcept : _size(0), _is_periodic(false) {}
+
+_HIPP_TEMPNORET
+_PeriodicBox(const pos_t &size) noexcept
+: _size(size), _is_periodic( (size > float_t(0)).any() ) {}
+
+_HIPP_TEMPRET
+is_periodic() const noexcept -> bool {
+    return _is_periodic;
+}
+
+_HIPP_TEMPRET
+size() const noexcept -> const pos_t & {
+    return _size;
+}
+
+_HIPP_TEMPRET
+wrap(const pos_t &p) const noexcept -> pos_t {
+    pos_t q = p;
+    for(int i=0; i<DIM; ++i) {
+        const float_t L = _size[i];
+        if( L <= 0 || (q[i] >= 0 && q[i] < L) ) continue;
+        q[i] = std::fmod(q[i], L);
+        if( q[i] < 0 ) q[i] += L;
+        if( q[i] >= L ) q[i] = 0;
+    }
+    return q;
+}
+
+_HIPP_TEMPRET
+image_of(const pos_t &p, const pos_t &q) const noexcept -> int {
+    int code = 0;
+    for(int i=DIM-1; i>=0; --i) {
+        code *= 3;
+        const float_t L = _size[i];
+        if( L <= 0 ) continue;
+        const float_t dx = p[i] - q[i];
+        if( dx >= float_t(0.5) * L ) code += 1;
+        else if( dx < float_t(-0.5) * L ) code += 2;
+    }
+    return code;
+}
+
+_HIPP_TEMPHD
+template<typename Op>
+void _HIPP_TEMPCLS::visit_images(const pos_t &q, const float_t &max_r_sq,
+    Op &&op) const
+{
+    op(q, 0);
+    for(int code=1; code<n_images(); ++code) {
+        pos_t img = q, dx(0);
+        bool valid = true;
+        for(int i=0, c=code; i<DIM; ++i, c/=3) {
+            const int digit = c % 3;
+            if( digit == 0 ) continue;
+            const float_t L = _size[i];
+            if( L <= 0 ) { valid = false; break; }
+            if( digit == 1 ) {
+                img[i] = q[i] + L; dx[i] = img[i] - L;
+            } else {
+                img[i] = q[i] - L; dx[i] = -img[i];
+            }
+        }
+        if( valid && float_t(dx.squared_norm()) < max_r_sq )
+            op(img, code);
+    }
+}
+
+_HIPP_TEMPHD
+template<typename Op>
+void _HIPP_TEMPCLS::visit_rect_images(const rect_t &rect, Op &&op) const {
+    pos_t low = rect.low().pos(), high = rect.high().pos();
+    int wrapped = 0;
+    for(int i=0; i<DIM; ++i) {
+        const float_t L = _size[i];
+        if( L <= 0 ) continue;
+        if( high[i] - low[i] >= L ) {
+            low[i] = -L; high[i] = 2 * L;
+            continue;
+        }
+        const float_t w = high[i] - low[i];
+        low[i] = wrap(low)[i];
+        high[i] = low[i] + w;
+        if( high[i] > L ) wrapped |= 1 << i;
+    }
+    for(int mask=0; mask<(1<<DIM); ++mask) {
+        if( (mask & wrapped) != mask ) continue;
+        pos_t l = low, h = high;
+        for(int i=0; i<DIM; ++i)
+            if( mask & (1 << i) ) { l[i] -= _size[i]; h[i] -= _size[i]; }
+        op(rect_t(point_t(l), point_t(h)));
+    }
+}
+
+_HIPP_TEMPRET
+r_sq(const pos_t &p, const pos_t &q) const noexcept -> float_t {
+    pos_t dx = p - q;
+    for(int i=0; i<DIM; ++i) {
+        const float_t L = _size[i];
+        if( L <= 0 ) continue;
+        float_t d = std::fabs(dx[i]);
+        if( d >= L ) d = std::fmod(d, L);
+        dx[i] = std::min(d, L - d);
+    }
+    return float_t(dx.squared_norm());
+}
+
+_HIPP_TEMPRET
+r_sq_to(const rect_t &rect, const pos_t &p) const noexcept -> float_t {
+    const auto &low = rect.low().pos(), &high = rect.high().pos();
+    const pos_t q = wrap(p);
+    pos_t dx;
+    for(int i=0; i<DIM; ++i) {
+        float_t d = 0;
+        if( q[i] < low[i] ) d = low[i] - q[i];
+        else if( q[i] > high[i] ) d = q[i] - high[i];
+        const float_t L = _size[i];
+        if( L > 0 && d > 0 ) {
+            const float_t d_wrap = q[i] < low[i] ? q[i] + L - high[i]
+                : low[i] + L - q[i];
+            d = std::max(float_t(0), std::min(d, d_wrap));
+        }
+        dx[i] = d;
+    }
+    // Images are shifted by rounded box sizes - keep a margin.
+    constexpr float_t margin = 1 - 8 * std::numeric_limits<float_t>::epsilon();
+    return float_t(dx.squared_norm()) * margin;
+}
+
+_HIPP_TEMPRET
+check_radius(float_t r) const -> void {
+    for(int i=0; i<DIM; ++i) {
+        const float_t L = _size[i];
+        if( L > 0 && 2 * r > L )
+            ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB,
+                "  ... radius ", r, " exceeds half the periodic box size ",
+                L, " along axis ", i, '\n');
+    }
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
+
+} // namespace HIPP::NUMERICAL::_KDSEARCH
+
+#endif	//_HIPPNUMERICAL_KDSEARCH_PERIODIC_H_
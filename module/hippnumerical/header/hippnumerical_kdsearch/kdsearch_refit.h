@@ -0,0 +1,193 @@
+/**
+create: Yangyao CHEN, 2026/10/17
+    [write   ] _RefitPolicy, _RefitInfo - policy and quality record of
+        refitting a tree to moved points.
+*/
+
+#ifndef _HIPPNUMERICAL_KDSEARCH_REFIT_H_
+#define _HIPPNUMERICAL_KDSEARCH_REFIT_H_
+
+#include "kdsearch_base.h"
+
+namespace HIPP::NUMERICAL::_KDSEARCH {
+
+/**
+Policy of refitting a tree, i.e., updating the nodes to moved points while
+keeping the topology.
+
+n_threads, serial_cutoff: the same meaning as those of the parallel
+construction. The top subtrees are handed over to disjoint groups of
+threads, and a subtree with no more than ``serial_cutoff`` points is
+refitted by a single thread. The refitted tree does not depend on the
+number of threads.
+*/
+class _RefitPolicy {
+public:
+    static constexpr int DFLT_N_THREADS = 1;
+    static constexpr std::ptrdiff_t DFLT_SERIAL_CUTOFF = 1 << 16;
+
+    _RefitPolicy() noexcept;
+
+    ostream & info(ostream &os = cout, int fmt_cntl = 0, int level = 0) const;
+    friend ostream & operator<< (ostream &os,
+        const _RefitPolicy &pl) { return pl.info(os); }
+
+    int n_threads() const noexcept;
+    _RefitPolicy & set_n_threads(int n_threads) noexcept;
+
+    std::ptrdiff_t serial_cutoff() const noexcept;
+    _RefitPolicy & set_serial_cutoff(std::ptrdiff_t serial_cutoff) noexcept;
+
+    /**
+    Throw ``ErrLogic`` if the values are invalid.
+    */
+    void verify() const;
+protected:
+    int _n_threads;
+    std::ptrdiff_t _serial_cutoff;
+};
+
+/**
+Quality record of the refits since the last construction.
+
+The volume of a tree is the sum of the volumes of the bounds of its internal
+nodes, i.e., the bounding rects of the subtrees of a ``_KDTree``, or
+``r^DIM`` of the spheres of a ``_BallTree``. As the points move, the bounds
+of a refitted tree overlap more and more, and the queries slow down.
+
+build_volume(): the volume of the tree as constructed (or loaded). It is
+found on the first refit.
+volume(): the volume after the last refit.
+growth(): ``volume() / build_volume()``, i.e., the factor the volume has
+grown by. A caller may reconstruct the tree once it exceeds a threshold
+(e.g., 1.5 - 2). It is 1 before any refit.
+n_refits(): the number of refits since the construction.
+*/
+class _RefitInfo {
+public:
+    _RefitInfo() noexcept;
+
+    ostream & info(ostream &os = cout, int fmt_cntl = 0, int level = 0) const;
+    friend ostream & operator<< (ostream &os,
+        const _RefitInfo &ri) { return ri.info(os); }
+
+    std::size_t n_refits() const noexcept;
+    double build_volume() const noexcept;
+    double volume() const noexcept;
+    double growth() const noexcept;
+
+    /**
+    reset(): forget the record, e.g., on a new construction.
+    set_build_volume(): record the volume before the first refit.
+    add_refit(): record a refit giving the volume ``v``.
+    */
+    void reset() noexcept;
+    void set_build_volume(double v) noexcept;
+    void add_refit(double v) noexcept;
+protected:
+    std::size_t _n_refits;
+    double _build_volume, _volume;
+};
+
+inline _RefitPolicy::_RefitPolicy() noexcept {
+    set_n_threads(DFLT_N_THREADS);
+    set_serial_cutoff(DFLT_SERIAL_CUTOFF);
+}
+
+inline ostream & _RefitPolicy::info(ostream &os, int fmt_cntl,
+    int level) const
+{
+    PStream ps{os};
+    if( fmt_cntl < 1 ) {
+        ps << HIPPCNTL_CLASS_INFO_INLINE(_RefitPolicy),
+        "{n threads=", _n_threads, ", serial cutoff=", _serial_cutoff, "}";
+        return os;
+    }
+    auto ind = HIPPCNTL_CLASS_INFO_INDENT_STR(level);
+    ps << HIPPCNTL_CLASS_INFO(_RefitPolicy),
+    ind, "No. threads = ", _n_threads,
+        ", serial cutoff = ", _serial_cutoff, '\n';
+    return os;
+}
+
+inline int _RefitPolicy::n_threads() const noexcept {
+    return _n_threads;
+}
+
+inline _RefitPolicy & _RefitPolicy::set_n_threads(int n_threads) noexcept {
+    _n_threads = n_threads; return *this;
+}
+
+inline std::ptrdiff_t _RefitPolicy::serial_cutoff() const noexcept {
+    return _serial_cutoff;
+}
+
+inline _RefitPolicy & _RefitPolicy::set_serial_cutoff(
+    std::ptrdiff_t serial_cutoff) noexcept
+{
+    _serial_cutoff = serial_cutoff; return *this;
+}
+
+inline void _RefitPolicy::verify() const {
+    if( _n_threads < 1 || _serial_cutoff < 1 )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB,
+            "  ... invalid no. of threads ", _n_threads,
+            " or serial cutoff ", _serial_cutoff);
+}
+
+inline _RefitInfo::_RefitInfo() noexcept {
+    reset();
+}
+
+inline ostream & _RefitInfo::info(ostream &os, int fmt_cntl,
+    int level) const
+{
+    PStream ps{os};
+    if( fmt_cntl < 1 ) {
+        ps << HIPPCNTL_CLASS_INFO_INLINE(_RefitInfo),
+        "{n refits=", _n_refits, ", growth=", growth(), "}";
+        return os;
+    }
+    auto ind = HIPPCNTL_CLASS_INFO_INDENT_STR(level);
+    ps << HIPPCNTL_CLASS_INFO(_RefitInfo),
+    ind, "No. refits = ", _n_refits, ", build volume = ", _build_volume,
+        ", volume = ", _volume, ", growth = ", growth(), '\n';
+    return os;
+}
+
+inline std::size_t _RefitInfo::n_refits() const noexcept {
+    return _n_refits;
+}
+
+inline double _RefitInfo::build_volume() const noexcept {
+    return _build_volume;
+}
+
+inline double _RefitInfo::volume() const noexcept {
+    return _volume;
+}
+
+inline double _RefitInfo::growth() const noexcept {
+    if( _n_refits == 0 || _volume == _build_volume ) return 1.0;
+    if( _build_volume == 0. )
+        return std::numeric_limits<double>::infinity();
+    return _volume / _build_volume;
+}
+
+inline void _RefitInfo::reset() noexcept {
+    _n_refits = 0;
+    _build_volume = _volume = 0.;
+}
+
+inline void _RefitInfo::set_build_volume(double v) noexcept {
+    _build_volume = _volume = v;
+}
+
+inline void _RefitInfo::add_refit(double v) noexcept {
+    ++_n_refits;
+    _volume = v;
+}
+
+} // namespace HIPP::NUMERICAL::_KDSEARCH
+
+#endif	//_HIPPNUMERICAL_KDSEARCH_REFIT_H_
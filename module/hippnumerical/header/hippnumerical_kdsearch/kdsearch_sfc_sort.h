@@ -0,0 +1,330 @@
+/**
+create: Yangyao CHEN, 2026/10/17
+    [write   ] _SFCSortPolicy - policy of sorting points along a space-filling
+        curve.
+    [write   ] SFCSort - sort points along a space-filling curve.
+*/
+
+#ifndef _HIPPNUMERICAL_KDSEARCH_SFC_SORT_H_
+#define _HIPPNUMERICAL_KDSEARCH_SFC_SORT_H_
+
+#include "kdsearch_base.h"
+
+namespace HIPP::NUMERICAL::_KDSEARCH {
+
+/**
+Policy of sorting points along a space-filling curve.
+
+curve: ``MORTON`` or ``HILBERT`` (default). See
+``GEOMETRY::SpaceFillingCurve``.
+
+n_threads: the number of threads for the keys, the sort and the permutation.
+The order does not depend on the number of threads.
+*/
+class _SFCSortPolicy {
+public:
+    using curve_t = GEOMETRY::SpaceFillingCurveBase::curve_t;
+
+    static constexpr curve_t DFLT_CURVE = curve_t::HILBERT;
+    static constexpr int DFLT_N_THREADS = 1;
+
+    _SFCSortPolicy() noexcept;
+
+    ostream & info(ostream &os = cout, int fmt_cntl = 0, int level = 0) const;
+    friend ostream & operator<< (ostream &os,
+        const _SFCSortPolicy &pl) { return pl.info(os); }
+
+    curve_t curve() const noexcept;
+    _SFCSortPolicy & set_curve(curve_t curve) noexcept;
+
+    int n_threads() const noexcept;
+    _SFCSortPolicy & set_n_threads(int n_threads) noexcept;
+
+    /**
+    Throw ``ErrLogic`` if the values are invalid.
+    */
+    void verify() const;
+protected:
+    curve_t _curve;
+    int _n_threads;
+};
+
+inline _SFCSortPolicy::_SFCSortPolicy() noexcept {
+    set_curve(DFLT_CURVE);
+    set_n_threads(DFLT_N_THREADS);
+}
+
+inline ostream & _SFCSortPolicy::info(ostream &os, int fmt_cntl,
+    int level) const
+{
+    const char *name = _curve == curve_t::MORTON ? "Morton" : "Hilbert";
+    PStream ps{os};
+    if( fmt_cntl < 1 ) {
+        ps << HIPPCNTL_CLASS_INFO_INLINE(_SFCSortPolicy),
+        "{curve=", name, ", n threads=", _n_threads, "}";
+        return os;
+    }
+    auto ind = HIPPCNTL_CLASS_INFO_INDENT_STR(level);
+    ps << HIPPCNTL_CLASS_INFO(_SFCSortPolicy),
+    ind, "Curve = ", name, ", No. threads = ", _n_threads, '\n';
+    return os;
+}
+
+inline auto _SFCSortPolicy::curve() const noexcept -> curve_t {
+    return _curve;
+}
+
+inline _SFCSortPolicy & _SFCSortPolicy::set_curve(curve_t curve) noexcept {
+    _curve = curve; return *this;
+}
+
+inline int _SFCSortPolicy::n_threads() const noexcept {
+    return _n_threads;
+}
+
+inline _SFCSortPolicy & _SFCSortPolicy::set_n_threads(int n_threads) noexcept {
+    _n_threads = n_threads; return *this;
+}
+
+inline void _SFCSortPolicy::verify() const {
+    if( _n_threads < 1 )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB,
+            "  ... invalid no. of threads ", _n_threads);
+}
+
+} // namespace HIPP::NUMERICAL::_KDSEARCH
+
+namespace HIPP::NUMERICAL {
+
+/**
+Sort points along a space-filling curve, so that points close in memory are
+close in space. Trees and meshes constructed from the sorted points, and
+batch queries made in the sorted order, access the memory more locally.
+
+The keys are found by ``GEOMETRY::SpaceFillingCurve`` over ``domain``, or,
+by default, the bounding box of the points. The points are ordered by a
+parallel LSD radix sort on the keys, which is stable, i.e., points of the
+same key keep their input order.
+*/
+template<typename KDPointT = KDPoint<>, typename IndexT = int>
+class SFCSort {
+public:
+    static constexpr int DIM = KDPointT::DIM;
+
+    using kd_point_t = KDPointT;
+    using float_t    = typename kd_point_t::float_t;
+    using pos_t      = typename kd_point_t::pos_t;
+    using index_t    = IndexT;
+    using rect_t     = GEOMETRY::Rect<float_t, DIM>;
+    using curve_t    = GEOMETRY::SpaceFillingCurve<float_t, DIM>;
+    using key_t      = typename curve_t::key_t;
+    using policy_t   = _KDSEARCH::_SFCSortPolicy;
+
+    SFCSort(const policy_t &policy = policy_t());
+
+    ostream & info(ostream &os = cout, int fmt_cntl = 0, int level = 0) const;
+    friend ostream & operator<<(ostream &os, const SFCSort &s) {
+        return s.info(os);
+    }
+
+    const policy_t & policy() const noexcept;
+
+    /**
+    curve_of(): the curve used for ``pts``, i.e., over ``domain`` if given,
+    otherwise the bounding box of ``pts``.
+
+    keys(): ``keys[i]`` is the key of ``pts[i]``.
+
+    argsort(): ``order`` is the permutation that sorts ``pts``, i.e.,
+    ``pts[order[0]], pts[order[1]], ...`` are along the curve. Other arrays
+    associated with the points may be permuted by it.
+
+    sort(): reorder ``pts`` in place along the curve.
+    */
+    curve_t curve_of(ContiguousBuffer<const kd_point_t> pts,
+        const std::optional<rect_t> &domain = std::nullopt) const;
+
+    void keys(ContiguousBuffer<const kd_point_t> pts, vector<key_t> &keys,
+        const std::optional<rect_t> &domain = std::nullopt) const;
+
+    void argsort(ContiguousBuffer<const kd_point_t> pts,
+        vector<index_t> &order,
+        const std::optional<rect_t> &domain = std::nullopt) const;
+
+    void sort(ContiguousBuffer<kd_point_t> pts,
+        const std::optional<rect_t> &domain = std::nullopt) const;
+protected:
+    policy_t _policy;
+
+    static constexpr int DIGIT_BITS = 8, N_DIGITS = 1 << DIGIT_BITS;
+
+    void _radix_argsort(vector<key_t> &keys, vector<index_t> &order) const;
+};
+
+#define _HIPP_TEMPHD template<typename KDPointT, typename IndexT>
+#define _HIPP_TEMPARG <KDPointT, IndexT>
+#define _HIPP_TEMPCLS SFCSort _HIPP_TEMPARG
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPNORET
+SFCSort(const policy_t &policy) : _policy(policy) {
+    _policy.verify();
+}
+
+_HIPP_TEMPRET
+info(ostream &os, int fmt_cntl, int level) const -> ostream & {
+    PStream ps{os};
+    if( fmt_cntl < 1 ) {
+        ps << HIPPCNTL_CLASS_INFO_INLINE(SFCSort),
+        "{policy=", _policy, "}";
+        return os;
+    }
+    auto ind = HIPPCNTL_CLASS_INFO_INDENT_STR(level);
+    ps << HIPPCNTL_CLASS_INFO(SFCSort),
+    ind, ps.info_of(_policy, fmt_cntl, level+1);
+    return os;
+}
+
+_HIPP_TEMPRET
+policy() const noexcept -> const policy_t & {
+    return _policy;
+}
+
+_HIPP_TEMPRET
+curve_of(ContiguousBuffer<const kd_point_t> pts,
+    const std::optional<rect_t> &domain) const -> curve_t
+{
+    if( domain ) return curve_t(*domain, _policy.curve());
+
+    const index_t n = pts.get_size();
+    if( n == 0 ) return curve_t(curve_t().domain(), _policy.curve());
+
+    const auto p = pts.get_cbuff();
+    const int n_th = _policy.n_threads();
+    vector<rect_t> boxes(n_th, rect_t(p[0].pos(), p[0].pos()));
+    _KDSEARCH::_parallel_for(n_th, n, [&](int i_th, index_t b, index_t e) {
+        auto &lo = boxes[i_th].low().pos(), &hi = boxes[i_th].high().pos();
+        for(index_t i=b; i<e; ++i) {
+            const auto &x = p[i].pos();
+            for(int k=0; k<DIM; ++k) {
+                lo[k] = std::min(lo[k], x[k]);
+                hi[k] = std::max(hi[k], x[k]);
+            }
+        }
+    });
+    rect_t box = boxes[0];
+    for(auto &bx: boxes) for(int k=0; k<DIM; ++k) {
+        box.low().pos()[k] = std::min(box.low().pos()[k], bx.low().pos()[k]);
+        box.high().pos()[k] = std::max(box.high().pos()[k],
+            bx.high().pos()[k]);
+    }
+    return curve_t(box, _policy.curve());
+}
+
+_HIPP_TEMPRET
+keys(ContiguousBuffer<const kd_point_t> pts, vector<key_t> &keys,
+    const std::optional<rect_t> &domain) const -> void
+{
+    const index_t n = pts.get_size();
+    keys.resize(n);
+    const curve_t curve = curve_of(pts, domain);
+    const auto p = pts.get_cbuff();
+    _KDSEARCH::_parallel_for(_policy.n_threads(), n,
+        [&](int, index_t b, index_t e) {
+            for(index_t i=b; i<e; ++i) keys[i] = curve.key(p[i]);
+        });
+}
+
+_HIPP_TEMPRET
+argsort(ContiguousBuffer<const kd_point_t> pts, vector<index_t> &order,
+    const std::optional<rect_t> &domain) const -> void
+{
+    vector<key_t> ks;
+    keys(pts, ks, domain);
+    _radix_argsort(ks, order);
+}
+
+_HIPP_TEMPRET
+sort(ContiguousBuffer<kd_point_t> pts,
+    const std::optional<rect_t> &domain) const -> void
+{
+    const index_t n = pts.get_size();
+    vector<index_t> order;
+    argsort(ContiguousBuffer<const kd_point_t>(pts.get_cbuff(), n),
+        order, domain);
+
+    kd_point_t *p = pts.get_buff();
+    vector<kd_point_t> sorted(n);
+    const int n_th = _policy.n_threads();
+    _KDSEARCH::_parallel_for(n_th, n, [&](int, index_t b, index_t e) {
+        for(index_t i=b; i<e; ++i) sorted[i] = p[order[i]];
+    });
+    _KDSEARCH::_parallel_for(n_th, n, [&](int, index_t b, index_t e) {
+        std::copy(sorted.begin()+b, sorted.begin()+e, p+b);
+    });
+}
+
+/**
+Each pass scatters the keys by a digit. Every thread counts the digits in
+its chunk, and then places its keys after those of the same digit in the
+preceding chunks, which keeps the sort stable. A pass is skipped if all
+keys share the digit, e.g., the unused high bits.
+*/
+_HIPP_TEMPRET
+_radix_argsort(vector<key_t> &keys, vector<index_t> &order) const -> void {
+    const index_t n = keys.size();
+    const int n_th = _policy.n_threads();
+    order.resize(n);
+    _KDSEARCH::_parallel_for(n_th, n, [&](int, index_t b, index_t e) {
+        for(index_t i=b; i<e; ++i) order[i] = i;
+    });
+
+    vector<key_t> keys_out(n);
+    vector<index_t> order_out(n);
+    vector<index_t> cnts(size_t(n_th) * N_DIGITS);
+    for(int shift = 0; shift < 64; shift += DIGIT_BITS) {
+        std::fill(cnts.begin(), cnts.end(), index_t(0));
+        _KDSEARCH::_parallel_for(n_th, n, [&](int i_th, index_t b, index_t e) {
+            index_t *cnt = cnts.data() + size_t(i_th) * N_DIGITS;
+            for(index_t i=b; i<e; ++i)
+                ++cnt[(keys[i] >> shift) & (N_DIGITS-1)];
+        });
+
+        // Turn the counts into the offsets, ordered by (digit, thread).
+        index_t off = 0;
+        bool is_trivial = false;
+        for(int d=0; d<N_DIGITS; ++d) {
+            const index_t off_d = off;
+            for(int i_th=0; i_th<n_th; ++i_th) {
+                index_t &c = cnts[size_t(i_th) * N_DIGITS + d];
+                const index_t c_th = c;
+                c = off;
+                off += c_th;
+            }
+            if( off - off_d == n ) { is_trivial = true; break; }
+        }
+        if( is_trivial ) continue;
+
+        _KDSEARCH::_parallel_for(n_th, n, [&](int i_th, index_t b, index_t e) {
+            index_t *pos = cnts.data() + size_t(i_th) * N_DIGITS;
+            for(index_t i=b; i<e; ++i) {
+                const index_t j = pos[(keys[i] >> shift) & (N_DIGITS-1)]++;
+                keys_out[j] = keys[i];
+                order_out[j] = order[i];
+            }
+        });
+        keys.swap(keys_out);
+        order.swap(order_out);
+    }
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
+
+} // namespace HIPP::NUMERICAL
+
+#endif	//_HIPPNUMERICAL_KDSEARCH_SFC_SORT_H_
@@ -0,0 +1,432 @@
+/**
+create: Yangyao CHEN, 2026/10/17
+    [write   ] _DistKernel - squared distances from a position to a
+        contiguous run of points, vectorized by the SIMD module if available.
+    [write   ] _RectKernel - containment of a contiguous run of points in a
+        rectangle.
+*/
+
+#ifndef _HIPPNUMERICAL_KDSEARCH_SIMD_H_
+#define _HIPPNUMERICAL_KDSEARCH_SIMD_H_
+
+#include "kdsearch_base.h"
+
+#if __has_include(<hipp_config.h>)
+#include <hipp_config.h>
+#endif
+
+// The gathers of hippsimd need the scale to be folded into a constant, which
+// is only done in optimized builds.
+#if defined(HIPPSIMD_ON) && defined(__AVX2__) && defined(__OPTIMIZE__) \
+    && !defined(HIPPNUMERICAL_KDSEARCH_NO_SIMD)
+#include <hippsimd.h>
+#define _HIPPNUMERICAL_KDSEARCH_SIMD
+#endif
+
+namespace HIPP::NUMERICAL::_KDSEARCH {
+
+/**
+Squared distances from a position ``pos`` to a contiguous run of points
+``pts[0], ..., pts[n-1]``, e.g., the points in a leaf bucket of a tree or
+in a cell of a mesh. The element type ``E`` can be ``PointT`` or any type
+derived from it (e.g., ``KDPoint`` with padding). 
+
+A point is a hit if its squared distance ``r_sq`` to ``pos`` satisfies 
+``r_sq < max_r_sq``. 
+
+scan_within(): call ``op(i, r_sq)`` on each hit ``pts[i]``, in ascending 
+order of ``i``. ``max_r_sq`` is re-read for each batch of points, so that 
+``op`` may shrink it (e.g., the distance to the k-th neighbor found so far). 
+In that case ``op`` must check the bound itself.
+
+visit_within(): call ``op(i)`` on each hit ``pts[i]``, in ascending order
+of ``i``.
+
+count_within(): return the number of hits.
+
+The squared distances are defined as ``(pts[i] - pos).r_sq()``, i.e., the
+squares of single-precision offsets are accumulated in double.
+
+The vectorized path processes ``BATCH`` points at once, by gathering the
+coordinates, computing the squared distances and turning the comparison
+masks into the indices of hits. For single precision, the distances are
+computed in single precision. Those close to the bound, or passed to 
+``op``, are recomputed by the scalar code, so that the vectorized and the 
+scalar paths give identical results.
+
+The vectorized path is used if the SIMD module is enabled (i.e., 
+``HIPPSIMD_ON``), AVX2 is available, optimization is on, ``float_t`` is 
+float or double, and ``DIM <= MAX_SIMD_DIM``. Define the macro 
+``HIPPNUMERICAL_KDSEARCH_NO_SIMD`` to always use the scalar path.
+*/
+template<typename PointT>
+class _DistKernel {
+public:
+    using point_t = PointT;
+    using float_t = typename point_t::float_t;
+    using pos_t = typename point_t::pos_t;
+
+    static constexpr int DIM = point_t::DIM;
+    static constexpr int MAX_SIMD_DIM = 8;
+    static constexpr bool SIMD_ON =
+#ifdef _HIPPNUMERICAL_KDSEARCH_SIMD
+        ( std::is_same_v<float_t, float> || std::is_same_v<float_t, double> )
+        && DIM <= MAX_SIMD_DIM;
+#else
+        false;
+#endif
+    static constexpr int BATCH =
+        SIMD_ON ? static_cast<int>(32 / sizeof(float_t)) : 1;
+
+    template<typename E, typename Op>
+    static void scan_within(const E *pts, size_t n, const pos_t &pos,
+        const float_t &max_r_sq, Op &&op) noexcept;
+
+    template<typename E, typename Op>
+    static void visit_within(const E *pts, size_t n, const pos_t &pos,
+        float_t max_r_sq, Op &&op) noexcept;
+
+    template<typename E>
+    static size_t count_within(const E *pts, size_t n, const pos_t &pos,
+        float_t max_r_sq) noexcept;
+protected:
+    /**
+    Modes of scan(). mSCAN: ``op(i, r_sq)`` is called on all hits. mVISIT: 
+    ``op(i)`` is called on all hits. mCOUNT: ``op(i)`` is called on the hits
+    close to the bound, and the number of other hits is returned.
+    */
+    static constexpr int mSCAN = 0, mVISIT = 1, mCOUNT = 2;
+
+    template<int MODE, typename E, typename Op>
+    static size_t scan(const E *pts, size_t n, const pos_t &pos,
+        const float_t &max_r_sq, Op &op) noexcept;
+
+    template<typename E>
+    static float_t r_sq_of(const E &p, const pos_t &pos) noexcept;
+
+#ifdef _HIPPNUMERICAL_KDSEARCH_SIMD
+    template<int MODE, typename E, typename Op>
+    static size_t scan_simd(const E *pts, size_t n, const pos_t &pos,
+        const float_t &max_r_sq, Op &op) noexcept;
+#endif
+};
+
+#define _HIPP_TEMPHD template<typename PointT>
+#define _HIPP_TEMPARG <PointT>
+#define _HIPP_TEMPCLS _DistKernel _HIPP_TEMPARG
+
+_HIPP_TEMPHD
+template<typename E, typename Op>
+void _HIPP_TEMPCLS::scan_within(const E *pts, size_t n, const pos_t &pos,
+    const float_t &max_r_sq, Op &&op) noexcept
+{
+    scan<mSCAN>(pts, n, pos, max_r_sq, op);
+}
+
+_HIPP_TEMPHD
+template<typename E, typename Op>
+void _HIPP_TEMPCLS::visit_within(const E *pts, size_t n, const pos_t &pos,
+    float_t max_r_sq, Op &&op) noexcept
+{
+    scan<mVISIT>(pts, n, pos, max_r_sq, op);
+}
+
+_HIPP_TEMPHD
+template<typename E>
+size_t _HIPP_TEMPCLS::count_within(const E *pts, size_t n, const pos_t &pos,
+    float_t max_r_sq) noexcept
+{
+    size_t cnt = 0;
+    auto op = [&cnt](size_t) { ++cnt; };
+    cnt += scan<mCOUNT>(pts, n, pos, max_r_sq, op);
+    return cnt;
+}
+
+_HIPP_TEMPHD
+template<int MODE, typename E, typename Op>
+size_t _HIPP_TEMPCLS::scan(const E *pts, size_t n, const pos_t &pos,
+    const float_t &max_r_sq, Op &op) noexcept
+{
+    static_assert(std::is_base_of_v<point_t, E>,
+        "element type must be derived from the point type");
+    if( n == 0 ) return 0;
+#ifdef _HIPPNUMERICAL_KDSEARCH_SIMD
+    if constexpr( SIMD_ON ) 
+        return scan_simd<MODE>(pts, n, pos, max_r_sq, op);
+#endif
+    for(size_t i=0; i<n; ++i) {
+        const float_t r_sq = r_sq_of(pts[i], pos);
+        if( r_sq < max_r_sq ) {
+            if constexpr( MODE == mSCAN ) op(i, r_sq);
+            else op(i);
+        }
+    }
+    return 0;
+}
+
+_HIPP_TEMPHD
+template<typename E>
+auto _HIPP_TEMPCLS::r_sq_of(const E &p, const pos_t &pos) noexcept 
+-> float_t
+{
+    return (p.pos() - pos).squared_norm();
+}
+
+#ifdef _HIPPNUMERICAL_KDSEARCH_SIMD
+
+_HIPP_TEMPHD
+template<int MODE, typename E, typename Op>
+size_t _HIPP_TEMPCLS::scan_simd(const E *pts, size_t n, const pos_t &pos,
+    const float_t &max_r_sq, Op &op) noexcept
+{
+    static_assert(sizeof(E) % sizeof(float_t) == 0);
+    constexpr int STRIDE = sizeof(E) / sizeof(float_t);
+    const float_t *x = &pts->pos()[0];
+    size_t n_sure = 0;
+
+    if constexpr( std::is_same_v<float_t, float> ) {
+        using vec_t = SIMD::Vec<float, 8>;
+        using ivec_t = vec_t::IntVec;
+        
+        // Squared distances in single precision differ from the exact ones 
+        // by a relative error less than (DIM+1)*epsilon/2. The margin of 
+        // the bound is twice that.
+        constexpr float_t margin = 
+            (DIM+2) * std::numeric_limits<float_t>::epsilon();
+
+        alignas(32) static constexpr int32_t offs[8] = {0, STRIDE, 
+            2*STRIDE, 3*STRIDE, 4*STRIDE, 5*STRIDE, 6*STRIDE, 7*STRIDE};
+        ivec_t v_offs;
+        v_offs.load(offs);
+        const vec_t lanes(7.f, 6.f, 5.f, 4.f, 3.f, 2.f, 1.f, 0.f);
+        vec_t v_pos[DIM];
+        for(int d=0; d<DIM; ++d) v_pos[d] = vec_t(pos[d]);
+
+        for(size_t b=0; b<n; b+=8, x+=8*STRIDE) {
+            const int n_lanes = static_cast<int>(std::min<size_t>(n-b, 8));
+            const vec_t lane_mask = lanes < vec_t(float(n_lanes));
+            vec_t r(0.f);
+            for(int d=0; d<DIM; ++d) {
+                vec_t v_x;
+                v_x.setzero().gatherm(v_x, x+d, v_offs, lane_mask);
+                const vec_t dx = v_x - v_pos[d];
+                r += dx * dx;
+            }
+            const int lane_bits = (1 << n_lanes) - 1;
+            int cands = (r < vec_t(max_r_sq * (1 + margin))).movemask()
+                & lane_bits;
+            // Points surely within the bound need no exact distance.
+            int sure = 0;
+            if constexpr( MODE != mSCAN ) 
+                sure = (r < vec_t(max_r_sq * (1 - margin))).movemask() 
+                    & lane_bits;
+            if constexpr( MODE == mCOUNT ) {
+                n_sure += __builtin_popcount(sure);
+                cands &= ~sure;
+            }
+            for(; cands; cands &= cands - 1) {
+                const int j = __builtin_ctz(cands);
+                const size_t i = b + j;
+                if constexpr( MODE == mVISIT ) 
+                    if( sure & (1 << j) ) { op(i); continue; }
+                const float_t r_sq = r_sq_of(pts[i], pos);
+                if( r_sq >= max_r_sq ) continue;
+                if constexpr( MODE == mSCAN ) op(i, r_sq);
+                else op(i);
+            }
+        }
+    } else {
+        using vec_t = SIMD::Vec<double, 4>;
+        using ivec_t = vec_t::IntVecHP;
+
+        alignas(16) static constexpr int32_t offs[4] = {0, STRIDE, 
+            2*STRIDE, 3*STRIDE};
+        ivec_t v_offs;
+        v_offs.load(offs);
+        const vec_t lanes(3., 2., 1., 0.);
+        vec_t v_pos[DIM];
+        for(int d=0; d<DIM; ++d) v_pos[d] = vec_t(pos[d]);
+
+        for(size_t b=0; b<n; b+=4, x+=4*STRIDE) {
+            const int n_lanes = static_cast<int>(std::min<size_t>(n-b, 4));
+            const vec_t lane_mask = lanes < vec_t(double(n_lanes));
+            vec_t r(0.);
+            for(int d=0; d<DIM; ++d) {
+                vec_t v_x;
+                v_x.setzero().gatherm(v_x, x+d, v_offs, lane_mask);
+                const vec_t dx = v_x - v_pos[d];
+                r += dx * dx;
+            }
+            int hits = (r < vec_t(max_r_sq)).movemask() & ((1 << n_lanes) - 1);
+            if constexpr( MODE == mCOUNT ) {
+                n_sure += __builtin_popcount(hits);
+                continue;
+            }
+            for(; hits; hits &= hits - 1) {
+                const int j = __builtin_ctz(hits);
+                if constexpr( MODE == mSCAN ) op(b+j, r[j]);
+                else op(b+j);
+            }
+        }
+    }
+    return n_sure;
+}
+
+#endif  // _HIPPNUMERICAL_KDSEARCH_SIMD
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+
+/**
+Containment of a contiguous run of points ``pts[0], ..., pts[n-1]`` in a 
+rectangle ``rect``, i.e., ``rect.contains(pts[i])``. The element type ``E``
+can be ``PointT`` or any type derived from it.
+
+visit_within(): call ``op(i)`` on each point in ``rect``, in ascending order
+of ``i``.
+
+count_within(): return the number of points in ``rect``.
+
+The comparisons are exact in both paths, hence the vectorized path, used 
+under the same conditions as ``_DistKernel``, gives identical results.
+*/
+template<typename PointT>
+class _RectKernel {
+public:
+    using point_t = PointT;
+    using float_t = typename point_t::float_t;
+    using rect_t = GEOMETRY::Rect<float_t, point_t::DIM>;
+
+    static constexpr int DIM = point_t::DIM;
+    static constexpr bool SIMD_ON = _DistKernel<point_t>::SIMD_ON;
+
+    template<typename E, typename Op>
+    static void visit_within(const E *pts, size_t n, const rect_t &rect,
+        Op &&op) noexcept;
+
+    template<typename E>
+    static size_t count_within(const E *pts, size_t n, 
+        const rect_t &rect) noexcept;
+protected:
+    template<bool COUNT, typename E, typename Op>
+    static size_t scan(const E *pts, size_t n, const rect_t &rect, 
+        Op &op) noexcept;
+
+#ifdef _HIPPNUMERICAL_KDSEARCH_SIMD
+    template<bool COUNT, typename E, typename Op>
+    static size_t scan_simd(const E *pts, size_t n, const rect_t &rect,
+        Op &op) noexcept;
+#endif
+};
+
+#define _HIPP_TEMPHD template<typename PointT>
+#define _HIPP_TEMPARG <PointT>
+#define _HIPP_TEMPCLS _RectKernel _HIPP_TEMPARG
+
+_HIPP_TEMPHD
+template<typename E, typename Op>
+void _HIPP_TEMPCLS::visit_within(const E *pts, size_t n, const rect_t &rect,
+    Op &&op) noexcept
+{
+    scan<false>(pts, n, rect, op);
+}
+
+_HIPP_TEMPHD
+template<typename E>
+size_t _HIPP_TEMPCLS::count_within(const E *pts, size_t n, 
+    const rect_t &rect) noexcept
+{
+    size_t cnt = 0;
+    auto op = [&cnt](size_t) { ++cnt; };
+    cnt += scan<true>(pts, n, rect, op);
+    return cnt;
+}
+
+_HIPP_TEMPHD
+template<bool COUNT, typename E, typename Op>
+size_t _HIPP_TEMPCLS::scan(const E *pts, size_t n, const rect_t &rect, 
+    Op &op) noexcept
+{
+    static_assert(std::is_base_of_v<point_t, E>,
+        "element type must be derived from the point type");
+    if( n == 0 ) return 0;
+#ifdef _HIPPNUMERICAL_KDSEARCH_SIMD
+    if constexpr( SIMD_ON ) 
+        return scan_simd<COUNT>(pts, n, rect, op);
+#endif
+    for(size_t i=0; i<n; ++i)
+        if( rect.contains(pts[i]) ) op(i);
+    return 0;
+}
+
+#ifdef _HIPPNUMERICAL_KDSEARCH_SIMD
+
+/**
+The vector type of a full AVX2 register of ``FloatT``, and the integer 
+vector type holding the gather offsets of its lanes.
+*/
+template<typename FloatT> struct _SIMDGather {};
+
+template<> struct _SIMDGather<float> {
+    using vec_t = SIMD::Vec<float, 8>;
+    using ivec_t = vec_t::IntVec;
+};
+
+template<> struct _SIMDGather<double> {
+    using vec_t = SIMD::Vec<double, 4>;
+    using ivec_t = vec_t::IntVecHP;
+};
+
+_HIPP_TEMPHD
+template<bool COUNT, typename E, typename Op>
+size_t _HIPP_TEMPCLS::scan_simd(const E *pts, size_t n, const rect_t &rect,
+    Op &op) noexcept
+{
+    static_assert(sizeof(E) % sizeof(float_t) == 0);
+    constexpr int STRIDE = sizeof(E) / sizeof(float_t),
+        W = static_cast<int>(32 / sizeof(float_t));
+    using vec_t = typename _SIMDGather<float_t>::vec_t;
+    using ivec_t = typename _SIMDGather<float_t>::ivec_t;
+
+    alignas(32) static constexpr int32_t offs[8] = {0, STRIDE, 
+        2*STRIDE, 3*STRIDE, 4*STRIDE, 5*STRIDE, 6*STRIDE, 7*STRIDE};
+    ivec_t v_offs;
+    v_offs.load(offs);
+    vec_t lanes;
+    for(int j=0; j<W; ++j) lanes[j] = float_t(j);
+    vec_t v_lo[DIM], v_hi[DIM];
+    for(int d=0; d<DIM; ++d) {
+        v_lo[d] = vec_t(rect.low().pos()[d]);
+        v_hi[d] = vec_t(rect.high().pos()[d]);
+    }
+
+    const float_t *x = &pts->pos()[0];
+    size_t n_hits = 0;
+    for(size_t b=0; b<n; b+=W, x+=W*STRIDE) {
+        const int n_lanes = static_cast<int>(std::min<size_t>(n-b, W));
+        const vec_t lane_mask = lanes < vec_t(float_t(n_lanes));
+        int hits = (1 << n_lanes) - 1;
+        for(int d=0; d<DIM && hits; ++d) {
+            vec_t v_x;
+            v_x.setzero().gatherm(v_x, x+d, v_offs, lane_mask);
+            hits &= (v_lo[d] < v_x).movemask() & (v_x < v_hi[d]).movemask();
+        }
+        if constexpr( COUNT ) {
+            n_hits += __builtin_popcount(hits);
+            continue;
+        }
+        for(; hits; hits &= hits - 1) op(b + __builtin_ctz(hits));
+    }
+    return n_hits;
+}
+
+#endif  // _HIPPNUMERICAL_KDSEARCH_SIMD
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+
+} // namespace HIPP::NUMERICAL::_KDSEARCH
+
+#endif	//_HIPPNUMERICAL_KDSEARCH_SIMD_H_
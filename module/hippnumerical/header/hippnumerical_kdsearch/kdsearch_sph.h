@@ -0,0 +1,589 @@
+/**
+create: Yangyao CHEN, 2026/10/17
+    [write   ] _SPHKernel - smoothing kernels of SPH.
+    [write   ] _SPHPolicy - policy of the SPH density estimation.
+    [write   ] _SPHSolver - smoothing-length and density solver shared by the
+        space-searching structures.
+*/
+
+#ifndef _HIPPNUMERICAL_KDSEARCH_SPH_H_
+#define _HIPPNUMERICAL_KDSEARCH_SPH_H_
+
+#include "kdsearch_base.h"
+
+namespace HIPP::NUMERICAL::_KDSEARCH {
+
+/**
+Smoothing kernel of smoothed-particle hydrodynamics (SPH) in ``dim``
+dimensions, with compact support radius ``h``, i.e.,
+``W(r, h) = norm() / h^dim * shape(r/h)``, where ``shape(q) = 0`` for
+``q >= 1``.
+
+CUBIC_SPLINE: the M4 B-spline (Monaghan & Lattanzio 1985), i.e.,
+``shape(q) = 1 - 6q^2 + 6q^3`` for ``q < 1/2`` and ``2(1-q)^3`` otherwise.
+
+WENDLAND_C2: ``shape(q) = (1-q)^4 (1+4q)`` (Wendland 1995; Dehnen & Aly
+2012). The same shape is used in any dimension.
+
+``norm()`` is found by the exact integration of the shape, so that ``W`` is
+normalized to 1 over the space, e.g., ``8/pi`` for the 3-d cubic spline.
+``ball_volume()`` is the volume of the unit ball in ``dim`` dimensions.
+*/
+class _SPHKernel {
+public:
+    enum class type_t { CUBIC_SPLINE, WENDLAND_C2 };
+
+    explicit _SPHKernel(type_t type = type_t::CUBIC_SPLINE, int dim = 3);
+
+    type_t type() const noexcept;
+    int dim() const noexcept;
+    double norm() const noexcept;
+    double ball_volume() const noexcept;
+
+    /**
+    shape(): ``shape(q)``. shape_deriv(): its derivative with respect to
+    ``q``.
+    value(): ``W(r, h)``. deriv_h(): its derivative with respect to ``h``.
+    */
+    double shape(double q) const noexcept;
+    double shape_deriv(double q) const noexcept;
+    double value(double r, double h) const noexcept;
+    double deriv_h(double r, double h) const noexcept;
+protected:
+    /**
+    The shape is a polynomial ``sum_k c[k] q^k`` in each piece
+    ``[q_lo, q_hi)``, where ``q_lo`` is the ``q_hi`` of the last piece.
+    */
+    static constexpr int N_COEFFS = 6;
+    struct piece_t {
+        double q_hi;
+        double c[N_COEFFS];
+    };
+
+    type_t _type;
+    int _dim;
+    int _n_pieces;
+    const piece_t *_pieces;
+    double _norm, _ball_volume;
+
+    const piece_t & _piece_of(double q) const noexcept;
+};
+
+/**
+Policy of the SPH density estimation.
+
+kernel: the smoothing kernel (see ``_SPHKernel``).
+
+n_ngb: the target number of neighbors. The smoothing length ``h_i`` of point
+``i`` is solved from ``N(h_i) = n_ngb``, where
+``N(h) = V_d h^d sum_j W(r_ij, h)`` is the kernel-weighted number of points
+within ``h`` (including ``i`` itself), and ``V_d`` is the volume of the unit
+ball. ``N(h)`` is smooth and non-decreasing in ``h``, and equals the number
+of points within ``h`` for a uniform distribution.
+
+tol: the relative tolerance, i.e., the iteration stops at
+``|N(h_i) - n_ngb| <= tol * n_ngb``.
+
+max_iters: the maximal number of iterations for each point.
+
+search_factor: the neighbors are searched within ``search_factor * h``, and
+are reused by the following iterations as long as ``h`` does not exceed the
+search radius. A larger factor means less queries but more candidates to
+scan in each iteration.
+
+n_threads: the number of threads.
+
+masses: the masses of the points, indexed as the results. Without masses,
+all points have unit mass. The buffer is referred to, not copied.
+*/
+template<typename FloatT>
+class _SPHPolicy {
+public:
+    using float_t = FloatT;
+    using kernel_t = _SPHKernel::type_t;
+
+    static constexpr kernel_t DFLT_KERNEL = kernel_t::CUBIC_SPLINE;
+    static constexpr double DFLT_N_NGB = 32.0;
+    static constexpr double DFLT_TOL = 1.0e-4;
+    static constexpr int DFLT_MAX_ITERS = 64;
+    static constexpr double DFLT_SEARCH_FACTOR = 1.2;
+    static constexpr int DFLT_N_THREADS = 1;
+
+    _SPHPolicy() noexcept;
+
+    ostream & info(ostream &os = cout, int fmt_cntl = 0, int level = 0) const;
+    friend ostream & operator<< (ostream &os,
+        const _SPHPolicy &pl) { return pl.info(os); }
+
+    kernel_t kernel() const noexcept;
+    _SPHPolicy & set_kernel(kernel_t kernel) noexcept;
+
+    double n_ngb() const noexcept;
+    _SPHPolicy & set_n_ngb(double n_ngb) noexcept;
+
+    double tol() const noexcept;
+    _SPHPolicy & set_tol(double tol) noexcept;
+
+    int max_iters() const noexcept;
+    _SPHPolicy & set_max_iters(int max_iters) noexcept;
+
+    double search_factor() const noexcept;
+    _SPHPolicy & set_search_factor(double search_factor) noexcept;
+
+    int n_threads() const noexcept;
+    _SPHPolicy & set_n_threads(int n_threads) noexcept;
+
+    const float_t * masses() const noexcept;
+    size_t n_masses() const noexcept;
+    _SPHPolicy & set_masses(ContiguousBuffer<const float_t> masses) noexcept;
+    _SPHPolicy & clear_masses() noexcept;
+protected:
+    kernel_t _kernel;
+    double _n_ngb, _tol;
+    int _max_iters;
+    double _search_factor;
+    int _n_threads;
+    const float_t *_masses;
+    size_t _n_masses;
+};
+
+/**
+Solver of the SPH smoothing lengths and densities of ``n`` points, shared by
+the space-searching structures. The structure is viewed by two callables:
+
+- ``pos_of(i)``: the position of point ``i``.
+- ``visit(i, r, op)``: call ``op(j, r_sq)`` on each point ``j`` (including
+  ``i`` itself) at the squared distance ``r_sq < r*r`` from point ``i``.
+
+solve(): on entry, the positive entries of ``h`` (if ``h.size() == n``) are
+the initial guesses. On exit, ``h[i]`` is the smoothing length of point
+``i`` and ``rho[i] = sum_j m_j W(r_ij, h[i])`` its density. Return the
+number of points not converged within ``max_iters`` iterations.
+
+Each point is solved by the Newton iteration on ``N(h)``, with steps limited
+to a factor of 2 and safe-guarded by the bisection of the bracket found so
+far. The candidates of neighbors are
+searched within ``search_factor * h`` and are reused until ``h`` leaves the
+search radius. Points are processed in blocks of ``BLOCK_SIZE`` successive
+indices, which are distributed to the threads. In a block, the initial
+guess of a point without one is the result of the last point, i.e., a
+spatial neighbor if the points are ordered as the nodes of a tree. The
+first point of a block starts from the mean spacing of the points in the
+bounding box. Hence, the results do not depend on the number of threads.
+
+If ``h`` cannot be refined further (e.g., where ``N(h)`` jumps over
+``n_ngb`` at a distance shared by several points), the upper end of the
+bracket is taken and the point is counted as converged. If ``h`` falls
+below ``eps * h0``, where ``h0`` is the mean spacing and ``eps`` the
+precision of ``float_t``, the iteration stops and the point is not
+converged, e.g., at more than ``n_ngb / N(0)`` duplicated points.
+*/
+template<typename FloatT, typename IndexT, int DIM>
+class _SPHSolver {
+public:
+    using float_t = FloatT;
+    using index_t = IndexT;
+    using policy_t = _SPHPolicy<float_t>;
+    using kernel_t = _SPHKernel;
+
+    static constexpr index_t BLOCK_SIZE = 64;
+
+    _SPHSolver(const policy_t &pl, index_t n);
+
+    template<typename PosOf, typename Visit>
+    index_t solve(PosOf &&pos_of, Visit &&visit, vector<float_t> &h,
+        vector<float_t> &rho) const;
+protected:
+    using cand_t = std::pair<float_t, index_t>;
+
+    const policy_t &_pl;
+    index_t _n;
+    kernel_t _kernel;
+
+    /**
+    _n_of(): ``N(h)`` and ``dN/dh`` from the candidates.
+    _density(): ``sum_j m_j W(r_ij, h)`` from the candidates.
+    */
+    std::pair<double, double> _n_of(const vector<cand_t> &cands,
+        double h) const noexcept;
+    double _density(const vector<cand_t> &cands, double h) const noexcept;
+
+    template<typename PosOf>
+    double _mean_spacing(PosOf &pos_of) const;
+};
+
+inline _SPHKernel::_SPHKernel(type_t type, int dim)
+: _type(type), _dim(dim)
+{
+    static constexpr piece_t cubic_spline[] = {
+        {0.5, {1., 0., -6., 6., 0., 0.}},
+        {1.0, {2., -6., 6., -2., 0., 0.}} },
+    wendland_c2[] = {
+        {1.0, {1., 0., -10., 20., -15., 4.}} };
+
+    switch (_type) {
+    case type_t::CUBIC_SPLINE:
+        _pieces = cubic_spline; _n_pieces = 2; break;
+    case type_t::WENDLAND_C2:
+        _pieces = wendland_c2; _n_pieces = 1; break;
+    default:
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB,
+            "  ... invalid kernel type ", int(_type), '\n');
+    }
+    if( _dim < 1 )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB,
+            "  ... invalid dimension ", _dim, '\n');
+
+    // Volume of unit ball, and the integral of shape(q) q^(dim-1) dq.
+    const double half_d = 0.5 * _dim;
+    _ball_volume = std::pow(M_PI, half_d) / std::tgamma(half_d + 1.0);
+    double integral = 0., q_lo = 0.;
+    for(int i=0; i<_n_pieces; ++i) {
+        const auto &pc = _pieces[i];
+        for(int k=0; k<N_COEFFS; ++k) {
+            const int p = k + _dim;
+            integral += pc.c[k] * (std::pow(pc.q_hi, p)
+                - std::pow(q_lo, p)) / p;
+        }
+        q_lo = pc.q_hi;
+    }
+    _norm = 1.0 / (_dim * _ball_volume * integral);
+}
+
+inline auto _SPHKernel::type() const noexcept -> type_t {
+    return _type;
+}
+
+inline int _SPHKernel::dim() const noexcept {
+    return _dim;
+}
+
+inline double _SPHKernel::norm() const noexcept {
+    return _norm;
+}
+
+inline double _SPHKernel::ball_volume() const noexcept {
+    return _ball_volume;
+}
+
+inline double _SPHKernel::shape(double q) const noexcept {
+    if( q >= 1.0 ) return 0.;
+    const auto &c = _piece_of(q).c;
+    double v = c[N_COEFFS-1];
+    for(int k=N_COEFFS-2; k>=0; --k) v = v * q + c[k];
+    return v;
+}
+
+inline double _SPHKernel::shape_deriv(double q) const noexcept {
+    if( q >= 1.0 ) return 0.;
+    const auto &c = _piece_of(q).c;
+    double v = (N_COEFFS-1) * c[N_COEFFS-1];
+    for(int k=N_COEFFS-2; k>=1; --k) v = v * q + k * c[k];
+    return v;
+}
+
+inline double _SPHKernel::value(double r, double h) const noexcept {
+    return _norm / std::pow(h, _dim) * shape(r / h);
+}
+
+inline double _SPHKernel::deriv_h(double r, double h) const noexcept {
+    const double q = r / h;
+    return - _norm / std::pow(h, _dim+1)
+        * (_dim * shape(q) + q * shape_deriv(q));
+}
+
+inline auto _SPHKernel::_piece_of(double q) const noexcept
+-> const piece_t &
+{
+    int i = 0;
+    while( i < _n_pieces-1 && q >= _pieces[i].q_hi ) ++i;
+    return _pieces[i];
+}
+
+#define _HIPP_TEMPHD template<typename FloatT>
+#define _HIPP_TEMPARG <FloatT>
+#define _HIPP_TEMPCLS _SPHPolicy _HIPP_TEMPARG
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPNORET
+_SPHPolicy() noexcept {
+    set_kernel(DFLT_KERNEL);
+    set_n_ngb(DFLT_N_NGB);
+    set_tol(DFLT_TOL);
+    set_max_iters(DFLT_MAX_ITERS);
+    set_search_factor(DFLT_SEARCH_FACTOR);
+    set_n_threads(DFLT_N_THREADS);
+    clear_masses();
+}
+
+_HIPP_TEMPRET
+info(ostream &os, int fmt_cntl, int level) const -> ostream & {
+    PStream ps{os};
+    if( fmt_cntl < 1 ) {
+        ps << HIPPCNTL_CLASS_INFO_INLINE(_SPHPolicy),
+        "{kernel=", int(_kernel), ", n ngb=", _n_ngb,
+        ", n threads=", _n_threads, "}";
+        return os;
+    }
+    auto ind = HIPPCNTL_CLASS_INFO_INDENT_STR(level);
+    ps << HIPPCNTL_CLASS_INFO(_SPHPolicy),
+    ind, "Kernel = ", int(_kernel), ", no. neighbors = ", _n_ngb,
+        ", tolerance = ", _tol, '\n',
+    ind, "Max iterations = ", _max_iters,
+        ", search factor = ", _search_factor,
+        ", no. threads = ", _n_threads, '\n',
+    ind, "Masses = ", (const void *)_masses, ", size = ", _n_masses, '\n';
+    return os;
+}
+
+_HIPP_TEMPRET
+kernel() const noexcept -> kernel_t {
+    return _kernel;
+}
+
+_HIPP_TEMPRET
+set_kernel(kernel_t kernel) noexcept -> _SPHPolicy & {
+    _kernel = kernel; return *this;
+}
+
+_HIPP_TEMPRET
+n_ngb() const noexcept -> double {
+    return _n_ngb;
+}
+
+_HIPP_TEMPRET
+set_n_ngb(double n_ngb) noexcept -> _SPHPolicy & {
+    _n_ngb = n_ngb; return *this;
+}
+
+_HIPP_TEMPRET
+tol() const noexcept -> double {
+    return _tol;
+}
+
+_HIPP_TEMPRET
+set_tol(double tol) noexcept -> _SPHPolicy & {
+    _tol = tol; return *this;
+}
+
+_HIPP_TEMPRET
+max_iters() const noexcept -> int {
+    return _max_iters;
+}
+
+_HIPP_TEMPRET
+set_max_iters(int max_iters) noexcept -> _SPHPolicy & {
+    _max_iters = max_iters; return *this;
+}
+
+_HIPP_TEMPRET
+search_factor() const noexcept -> double {
+    return _search_factor;
+}
+
+_HIPP_TEMPRET
+set_search_factor(double search_factor) noexcept -> _SPHPolicy & {
+    _search_factor = search_factor; return *this;
+}
+
+_HIPP_TEMPRET
+n_threads() const noexcept -> int {
+    return _n_threads;
+}
+
+_HIPP_TEMPRET
+set_n_threads(int n_threads) noexcept -> _SPHPolicy & {
+    _n_threads = n_threads; return *this;
+}
+
+_HIPP_TEMPRET
+masses() const noexcept -> const float_t * {
+    return _masses;
+}
+
+_HIPP_TEMPRET
+n_masses() const noexcept -> size_t {
+    return _n_masses;
+}
+
+_HIPP_TEMPRET
+set_masses(ContiguousBuffer<const float_t> masses) noexcept -> _SPHPolicy & {
+    _masses = masses.get_cbuff(); _n_masses = masses.get_size();
+    return *this;
+}
+
+_HIPP_TEMPRET
+clear_masses() noexcept -> _SPHPolicy & {
+    _masses = nullptr; _n_masses = 0; return *this;
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
+
+#define _HIPP_TEMPHD template<typename FloatT, typename IndexT, int DIM>
+#define _HIPP_TEMPARG <FloatT, IndexT, DIM>
+#define _HIPP_TEMPCLS _SPHSolver _HIPP_TEMPARG
+#define _HIPP_TEMPRET _HIPP_TEMPHD inline auto _HIPP_TEMPCLS::
+#define _HIPP_TEMPNORET _HIPP_TEMPHD inline _HIPP_TEMPCLS::
+
+_HIPP_TEMPNORET
+_SPHSolver(const policy_t &pl, index_t n)
+: _pl(pl), _n(n), _kernel(pl.kernel(), DIM)
+{
+    if( _pl.n_threads() < 1 )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB,
+            "  ... invalid no. of threads ", _pl.n_threads(), '\n');
+    if( _pl.max_iters() < 1 )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB,
+            "  ... invalid max no. of iterations ", _pl.max_iters(), '\n');
+    if( !(_pl.tol() >= 0.) || !(_pl.search_factor() >= 1.) )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB,
+            "  ... invalid tolerance ", _pl.tol(),
+            " or search factor ", _pl.search_factor(), '\n');
+    if( _pl.masses() && _pl.n_masses() != size_t(_n) )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB,
+            "  ... no. of masses ", _pl.n_masses(),
+            " != no. of points ", _n, '\n');
+
+    // N(h) is within [N(0), N(inf)] = [1, n] * V_d * norm.
+    const double n_self = _kernel.ball_volume() * _kernel.norm();
+    if( _n > 0 && !(_pl.n_ngb() > n_self && _pl.n_ngb() < _n * n_self) )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB,
+            "  ... no. of neighbors ", _pl.n_ngb(), " not in (",
+            n_self, ", ", _n * n_self, ") for ", _n, " points\n");
+}
+
+_HIPP_TEMPHD
+template<typename PosOf, typename Visit>
+auto _HIPP_TEMPCLS::solve(PosOf &&pos_of, Visit &&visit, vector<float_t> &h,
+    vector<float_t> &rho) const -> index_t
+{
+    if( h.size() != size_t(_n) ) h.assign(_n, float_t(0));
+    rho.resize(_n);
+    if( _n == 0 ) return 0;
+
+    const double h0 = _mean_spacing(pos_of), n_ngb = _pl.n_ngb(),
+        tol = _pl.tol() * n_ngb, sf = _pl.search_factor(),
+        eps = 4.0 * std::numeric_limits<float_t>::epsilon(), 
+        h_min = h0 * eps;
+    const int max_iters = _pl.max_iters();
+    const index_t n_blocks = (_n + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    std::atomic<index_t> n_failed {0};
+
+    _parallel_for(_pl.n_threads(), n_blocks,
+    [&](int, index_t b_b, index_t b_e) {
+        vector<cand_t> cands;
+        auto on_cand = [&](index_t j, float_t r_sq) {
+            cands.emplace_back(r_sq, j);
+        };
+        index_t n_failed_local = 0;
+        for(index_t i_b=b_b; i_b<b_e; ++i_b) {
+            const index_t b = i_b * BLOCK_SIZE,
+                e = std::min(b + BLOCK_SIZE, _n);
+            double h_last = h0;
+            for(index_t i=b; i<e; ++i) {
+                // h is iterated in float_t, as it is stored.
+                double h_i = h[i] > 0 ? h[i] : float_t(h_last),
+                    lo = 0., up = std::numeric_limits<double>::infinity(),
+                    r_search = 0.;
+                bool converged = false;
+                for(int it=0; it<max_iters && h_i >= h_min; ++it) {
+                    if( h_i > r_search ) {
+                        r_search = h_i * sf;
+                        cands.clear();
+                        visit(i, float_t(r_search), on_cand);
+                    }
+                    const auto [n_h, dn_h] = _n_of(cands, h_i);
+                    const double dev = n_h - n_ngb;
+                    if( std::fabs(dev) <= tol ) {
+                        converged = true; break;
+                    }
+                    (dev < 0 ? lo : up) = h_i;
+                    if( !std::isinf(up) && up - lo <= eps * up ) {
+                        h_i = up; converged = true; break;
+                    }
+                    // Newton step, by a factor of 2 at most.
+                    double h_next = dn_h > 0 ? h_i - dev / dn_h : 2.0 * h_i;
+                    h_next = std::clamp(h_next, 0.5 * h_i, 2.0 * h_i);
+                    if( !(h_next > lo && h_next < up) )
+                        h_next = 0.5 * (lo + up);
+                    h_i = float_t(h_next);
+                }
+                if( h_i > r_search ) {
+                    cands.clear();
+                    visit(i, float_t(h_i * sf), on_cand);
+                }
+                if( !converged ) ++n_failed_local;
+                h[i] = float_t(h_i);
+                rho[i] = float_t(_density(cands, h_i));
+                h_last = h_i;
+            }
+        }
+        n_failed += n_failed_local;
+    });
+    return n_failed;
+}
+
+_HIPP_TEMPRET
+_n_of(const vector<cand_t> &cands, double h) const noexcept
+-> std::pair<double, double>
+{
+    double s = 0., ds = 0.;
+    const double h_sq = h * h;
+    for(auto &[r_sq, j]: cands) {
+        if( !(r_sq < h_sq) ) continue;
+        const double q = std::sqrt(r_sq / h_sq);
+        s += _kernel.shape(q);
+        ds -= _kernel.shape_deriv(q) * q;
+    }
+    const double c = _kernel.ball_volume() * _kernel.norm();
+    return {c * s, c * ds / h};
+}
+
+_HIPP_TEMPRET
+_density(const vector<cand_t> &cands, double h) const noexcept -> double {
+    const float_t *ms = _pl.masses();
+    double s = 0.;
+    const double h_sq = h * h;
+    for(auto &[r_sq, j]: cands) {
+        if( !(r_sq < h_sq) ) continue;
+        const double w = _kernel.shape(std::sqrt(r_sq / h_sq));
+        s += ms ? w * ms[j] : w;
+    }
+    return s * _kernel.norm() / std::pow(h, DIM);
+}
+
+_HIPP_TEMPHD
+template<typename PosOf>
+double _HIPP_TEMPCLS::_mean_spacing(PosOf &pos_of) const {
+    auto lo = pos_of(0), hi = lo;
+    for(index_t i=1; i<_n; ++i) {
+        const auto &p = pos_of(i);
+        for(int d=0; d<DIM; ++d) {
+            lo[d] = std::min(lo[d], p[d]); hi[d] = std::max(hi[d], p[d]);
+        }
+    }
+    double vol = 1., ext_max = 0.;
+    for(int d=0; d<DIM; ++d) {
+        const double ext = double(hi[d]) - double(lo[d]);
+        vol *= ext; ext_max = std::max(ext_max, ext);
+    }
+    double h = std::pow(vol * _pl.n_ngb() / (_n * _kernel.ball_volume()),
+        1.0 / DIM);
+    if( !(h > 0) || std::isinf(h) ) h = ext_max > 0 ? ext_max : 1.;
+    return h;
+}
+
+#undef _HIPP_TEMPHD
+#undef _HIPP_TEMPARG
+#undef _HIPP_TEMPCLS
+#undef _HIPP_TEMPRET
+#undef _HIPP_TEMPNORET
+
+} // namespace HIPP::NUMERICAL::_KDSEARCH
+
+#endif	//_HIPPNUMERICAL_KDSEARCH_SPH_H_
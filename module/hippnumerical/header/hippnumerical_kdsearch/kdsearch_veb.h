@@ -0,0 +1,113 @@
+/**
+create: Yangyao CHEN, 2026/10/17
+    [write   ] _VEBLayout - van Emde Boas layout of a complete binary tree.
+*/
+
+#ifndef _HIPPNUMERICAL_KDSEARCH_VEB_H_
+#define _HIPPNUMERICAL_KDSEARCH_VEB_H_
+
+#include "kdsearch_base.h"
+
+namespace HIPP::NUMERICAL::_KDSEARCH {
+
+/**
+The van Emde Boas (vEB) layout of a complete binary tree of height ``H``, 
+i.e., ``2^H - 1`` slots. The tree is cut at the middle level into a top tree
+and the bottom trees under it. The top tree is stored first, followed by the
+bottom trees one after another, each laid out recursively in the same way. 
+A path from the root to a leaf then crosses ``O(log_B N)`` blocks of size 
+``B`` for any ``B``, i.e., the layout is cache-oblivious.
+
+Nodes are identified by their depths ``d`` (the root at 0) and breadth-first
+indices ``i`` (the root at 1, the children of ``i`` at ``2i`` and 
+``2i+1``). The position of a node is found from those of its ancestors 
+by the tables of the depths (Brodal, Fagerberg & Jacob 2002):
+
+    pos[d] = pos[D[d]] + T[d] + (i & T[d]) * B[d]
+
+where ``T[d]`` and ``B[d]`` are the sizes of the top tree and each bottom 
+tree of the cut that has the bottom roots at depth ``d``, and ``D[d]`` is 
+the depth of the root of that top tree. A descent keeps the positions 
+``pos[0..d]`` of the path, so each step takes O(1).
+*/
+class _VEBLayout {
+public:
+    using index_t = std::ptrdiff_t;
+
+    static constexpr int MAX_HEIGHT = 48;
+
+    explicit _VEBLayout(int height = 0);
+
+    /**
+    height(): ``H``. size(): ``2^H - 1``, the number of slots.
+    */
+    int height() const noexcept;
+    index_t size() const noexcept;
+
+    /**
+    pos_at(): the position of the node at depth ``d >= 1`` with breadth-first
+    index ``i``, given the positions of its ancestors, ``poss[0..d-1]``.
+    pos_of(): the position of the node with breadth-first index ``i``, found
+    from the root in O(H).
+    */
+    index_t pos_at(int d, index_t i, const index_t *poss) const noexcept;
+    index_t pos_of(index_t i) const noexcept;
+protected:
+    int _height;
+    index_t _top[MAX_HEIGHT], _bot[MAX_HEIGHT];
+    int _top_depth[MAX_HEIGHT];
+
+    void _cut(int d0, int h) noexcept;
+};
+
+inline _VEBLayout::_VEBLayout(int height) : _height(height) {
+    if( height < 0 || height > MAX_HEIGHT )
+        ErrLogic::throw_(ErrLogic::eDOMAIN, emFLPFB,
+            "  ... invalid height ", height, " (max ", MAX_HEIGHT, ")");
+    for(int d=0; d<MAX_HEIGHT; ++d) {
+        _top[d] = _bot[d] = 0; _top_depth[d] = 0;
+    }
+    _cut(0, height);
+}
+
+inline int _VEBLayout::height() const noexcept {
+    return _height;
+}
+
+inline auto _VEBLayout::size() const noexcept -> index_t {
+    return (index_t(1) << _height) - 1;
+}
+
+inline auto _VEBLayout::pos_at(int d, index_t i, const index_t *poss) const 
+noexcept -> index_t 
+{
+    return poss[_top_depth[d]] + _top[d] + (i & _top[d]) * _bot[d];
+}
+
+inline auto _VEBLayout::pos_of(index_t i) const noexcept -> index_t {
+    int d = 0;
+    while( (i >> (d+1)) != 0 ) ++d;
+    index_t poss[MAX_HEIGHT];
+    poss[0] = 0;
+    for(int dd=1; dd<=d; ++dd) 
+        poss[dd] = pos_at(dd, i >> (d-dd), poss);
+    return poss[d];
+}
+
+/**
+Cut the subtree of height ``h`` rooted at depth ``d0``, and the top and 
+bottom trees recursively.
+*/
+inline void _VEBLayout::_cut(int d0, int h) noexcept {
+    if( h <= 1 ) return;
+    const int h_top = h / 2, h_bot = h - h_top, d = d0 + h_top;
+    _top[d] = (index_t(1) << h_top) - 1;
+    _bot[d] = (index_t(1) << h_bot) - 1;
+    _top_depth[d] = d0;
+    _cut(d0, h_top);
+    _cut(d, h_bot);
+}
+
+} // namespace HIPP::NUMERICAL::_KDSEARCH
+
+#endif	//_HIPPNUMERICAL_KDSEARCH_VEB_H_
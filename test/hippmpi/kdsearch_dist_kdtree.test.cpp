@@ -0,0 +1,279 @@
+#include <mpi_test_incl.h>
+#include <hippnumerical.h>
+#include <random>
+#include <map>
+
+namespace HIPP::MPI {
+
+struct DistKDTreeTest : MPITestFixture {
+    using kd_point_t = NUMERICAL::KDPoint<float, 3, sizeof(int)>;
+    using tree_t = NUMERICAL::DistKDTree<kd_point_t>;
+    using sphere_t = tree_t::sphere_t;
+    using ngb_t = tree_t::ngb_t;
+
+    vector<kd_point_t> pts, all_pts;
+
+    DistKDTreeTest(Comm _comm) : MPITestFixture("DistKDTreeTest", _comm) {
+        HIPPMPI_TEST_F_ADD_CASE(construct);
+        HIPPMPI_TEST_F_ADD_CASE(nearest_k_batch);
+        HIPPMPI_TEST_F_ADD_CASE(find_nodes_sphere_batch);
+        HIPPMPI_TEST_F_ADD_CASE(periodic);
+        HIPPMPI_TEST_F_ADD_CASE(count_pairs);
+        HIPPMPI_TEST_F_ADD_CASE(fof);
+    }
+
+    /**
+    Points of rank ``r`` are in ``[r, r+1.5) x [0,1) x [0,1)``, so that the
+    boxes of neighboring ranks overlap. The last rank has no point. The
+    padding of a point is its global index, i.e., its index in ``all_pts``.
+    */
+    void init_points(int n_each) {
+        const int n = (rank == n_procs-1 && n_procs > 1) ? 0 : n_each;
+        std::mt19937 eng(rank);
+        std::uniform_real_distribution<float> rng(0.f, 1.f);
+        pts.resize(n);
+        for(int i=0; i<n; ++i) {
+            pts[i] = kd_point_t({rank + 1.5f*rng(eng), rng(eng), rng(eng)},
+                rank*n_each + i);
+        }
+        vector<int> counts(n_procs), displs(n_procs+1, 0);
+        comm.allgather(&n, counts.data(), 1, INT);
+        for(int i=0; i<n_procs; ++i) displs[i+1] = displs[i] + counts[i];
+        all_pts.resize(displs[n_procs]);
+        auto dtype = BYTE.contiguous(sizeof(kd_point_t));
+        comm.allgatherv(pts.data(), n, dtype, all_pts.data(), counts.data(),
+            displs.data(), dtype);
+    }
+
+    vector<kd_point_t> random_queries(int n) {
+        std::mt19937 eng(1000 + rank);
+        std::uniform_real_distribution<float> rng(-0.5f, 1.f);
+        vector<kd_point_t> qs(n);
+        for(auto &q: qs)
+            q = kd_point_t({(n_procs+1)*rng(eng), rng(eng), rng(eng)});
+        return qs;
+    }
+
+    void construct() {
+        init_points(100);
+        tree_t dkdt(comm, pts);
+        const auto &top = dkdt.top_tree();
+        expect_eq(top.rects().size(), size_t(n_procs));
+        expect_eq(dkdt.local_tree().nodes().size(), pts.size());
+
+        // Non-empty ranks are the leaves of the top tree.
+        const auto &nodes = top.nodes();
+        vector<int> ranks;
+        for(auto &n: nodes) if( n.rank >= 0 ) ranks.push_back(n.rank);
+        std::sort(ranks.begin(), ranks.end());
+        const int n_nonempty = n_procs > 1 ? n_procs-1 : 1;
+        expect_eq(ranks.size(), size_t(n_nonempty));
+        expect_eq(nodes.size(), size_t(2*n_nonempty-1));
+        for(int r=0; r<n_nonempty; ++r) expect_eq(ranks[r], r);
+        expect_eq(nodes[0].size, int(nodes.size()));
+    }
+
+    void nearest_k_batch() {
+        init_points(200);
+        tree_t dkdt(comm, pts);
+        const auto qs = random_queries(50);
+        for(int k: {0, 1, 8, 64, int(all_pts.size())+3}) {
+            vector<int> displs;
+            vector<ngb_t> ngbs;
+            dkdt.nearest_k_batch(ContiguousBuffer<const kd_point_t>(qs), k,
+                displs, ngbs);
+            assert_eq(displs.size(), qs.size()+1);
+            for(size_t i=0; i<qs.size(); ++i) {
+                auto ref = brute_force_r_sq(qs[i]);
+                ref.resize(std::min<size_t>(k, ref.size()));
+                const int b = displs[i], e = displs[i+1];
+                if( !expect_eq(size_t(e-b), ref.size(),
+                    "k=", k, ", query ", i) ) continue;
+                for(int j=b; j<e; ++j) {
+                    const auto &ngb = ngbs[j];
+                    expect_eq(ngb.r_sq, ref[j-b], "k=", k, ", query ", i);
+                    const int id = ngb.point.pad<int>();
+                    expect_eq(ngb.r_sq, r_sq_of(ngb.point, qs[i]));
+                    expect_eq(ngb.r_sq, r_sq_of(all_pts[id], qs[i]));
+                }
+            }
+        }
+    }
+
+    void find_nodes_sphere_batch() {
+        init_points(200);
+        tree_t dkdt(comm, pts);
+        const auto qs = random_queries(50);
+        vector<sphere_t> ss;
+        for(size_t i=0; i<qs.size(); ++i)
+            ss.emplace_back(qs[i], 0.05f * (i % 10));
+        vector<int> displs;
+        vector<ngb_t> ngbs;
+        dkdt.find_nodes_sphere_batch(ContiguousBuffer<const sphere_t>(ss),
+            displs, ngbs);
+        assert_eq(displs.size(), ss.size()+1);
+        for(size_t i=0; i<ss.size(); ++i) {
+            const float r_sq = ss[i].r() * ss[i].r();
+            vector<int> ref, got;
+            for(auto &p: all_pts)
+                if( r_sq_of(p, qs[i]) < r_sq )
+                    ref.push_back(p.pad<int>());
+            for(int j=displs[i]; j<displs[i+1]; ++j) {
+                got.push_back(ngbs[j].point.pad<int>());
+                if( j > displs[i] )
+                    expect_true(ngbs[j-1].rank < ngbs[j].rank
+                        || ( ngbs[j-1].rank == ngbs[j].rank
+                            && ngbs[j-1].node_idx < ngbs[j].node_idx ));
+            }
+            std::sort(got.begin(), got.end());
+            expect_eq_range(got, ref, "sphere ", i);
+        }
+    }
+
+    /**
+    Periodic along all axes. All points are in ``[0, n_procs+1) x [0,1) x 
+    [0,1)``.
+    */
+    void periodic() {
+        init_points(200);
+        using box_t = tree_t::periodic_box_t;
+        const box_t box({n_procs+1.f, 1.f, 1.f});
+        tree_t dkdt(comm, pts, 
+            tree_t::construct_policy_t().set_periodic_box(box.size()));
+        const auto qs = random_queries(50);
+        auto r_sq_of = [&](const kd_point_t &p, const kd_point_t &q) {
+            return box.r_sq(p.pos(), q.pos());
+        };
+
+        const int k = 16;
+        vector<int> displs;
+        vector<ngb_t> ngbs;
+        dkdt.nearest_k_batch(ContiguousBuffer<const kd_point_t>(qs), k,
+            displs, ngbs);
+        for(size_t i=0; i<qs.size(); ++i) {
+            vector<float> ref;
+            for(auto &p: all_pts) ref.push_back(r_sq_of(p, qs[i]));
+            std::sort(ref.begin(), ref.end());
+            ref.resize(std::min<size_t>(k, ref.size()));
+            if( !expect_eq(size_t(displs[i+1]-displs[i]), ref.size(), 
+                "query ", i) ) continue;
+            for(int j=displs[i]; j<displs[i+1]; ++j)
+                expect_true(std::fabs(ngbs[j].r_sq - ref[j-displs[i]]) 
+                    < 1.0e-5f, "query ", i);
+        }
+
+        vector<sphere_t> ss;
+        for(size_t i=0; i<qs.size(); ++i)
+            ss.emplace_back(qs[i], 0.05f * (i % 10));
+        dkdt.find_nodes_sphere_batch(ContiguousBuffer<const sphere_t>(ss),
+            displs, ngbs);
+        for(size_t i=0; i<ss.size(); ++i) {
+            const float r_sq = ss[i].r() * ss[i].r();
+            vector<int> ref, got;
+            for(auto &p: all_pts)
+                if( r_sq_of(p, qs[i]) < r_sq )
+                    ref.push_back(p.pad<int>());
+            for(int j=displs[i]; j<displs[i+1]; ++j)
+                got.push_back(ngbs[j].point.pad<int>());
+            std::sort(got.begin(), got.end());
+            expect_eq_range(got, ref, "sphere ", i);
+        }
+    }
+
+    void count_pairs() {
+        init_points(300);
+        tree_t dkdt(comm, pts);
+        const vector<float> edges {0.02f, 0.1f, 0.2f, 0.4f, 0.8f};
+        const int n_bins = edges.size() - 1;
+        vector<double> ref(n_bins, 0.);
+        for(size_t i=0; i<all_pts.size(); ++i)
+        for(size_t j=i+1; j<all_pts.size(); ++j) {
+            const float r_sq = r_sq_of(all_pts[i], all_pts[j]);
+            for(int b=0; b<n_bins; ++b)
+                if( r_sq >= edges[b]*edges[b] && r_sq < edges[b+1]*edges[b+1] )
+                    ref[b] += 1.;
+        }
+        for(int n_threads: {1, 2}) {
+            vector<double> counts;
+            dkdt.count_pairs(edges, counts, 
+                tree_t::pair_count_policy_t().set_n_threads(n_threads));
+            expect_eq_range(counts, ref, "n_threads=", n_threads);
+        }
+    }
+
+    /**
+    Groups of the distributed tree are compared with the ones of a serial 
+    tree of all points, by the partitions of the global indices.
+    */
+    void fof() {
+        init_points(300);
+        using pos_t = tree_t::pos_t;
+        using kdtree_t = NUMERICAL::KDTree<kd_point_t>;
+        auto dtype = BYTE.contiguous(sizeof(std::pair<int, int>));
+        auto canonical = [](vector<int> ids) {
+            std::map<int, int> relabel;
+            for(auto &id: ids)
+                if( id >= 0 ) id = relabel.emplace(id, relabel.size())
+                    .first->second;
+            return ids;
+        };
+        for(const pos_t box: {pos_t(0.f), pos_t{n_procs+1.f, 1.f, 1.f}}) {
+            tree_t dkdt(comm, pts, 
+                tree_t::construct_policy_t().set_periodic_box(box));
+            kdtree_t kdt(all_pts, 
+                kdtree_t::construct_policy_t().set_periodic_box(box));
+            for(float b: {0.05f, 0.12f, 0.3f})
+            for(int min_size: {1, 5}) {
+                const auto pl = tree_t::fof_policy_t().set_min_size(min_size);
+                vector<int> ids, ids_ref;
+                const int n_groups = dkdt.fof(b, ids, pl), 
+                    n_ref = kdt.fof(b, ids_ref, pl);
+                expect_eq(n_groups, n_ref, "b=", b, ", min_size=", min_size);
+
+                const auto &nodes = dkdt.local_tree().nodes();
+                const int n = nodes.size();
+                vector<std::pair<int, int> > loc, all(all_pts.size());
+                for(int i=0; i<n; ++i) 
+                    loc.emplace_back(nodes[i].pad<int>(), ids[i]);
+                vector<int> counts(n_procs), displs(n_procs+1, 0);
+                comm.allgather(&n, counts.data(), 1, INT);
+                for(int r=0; r<n_procs; ++r) 
+                    displs[r+1] = displs[r] + counts[r];
+                comm.allgatherv(loc.data(), n, dtype, all.data(), 
+                    counts.data(), displs.data(), dtype);
+                vector<int> got(all_pts.size()), ref(all_pts.size());
+                for(auto [i, id]: all) got[i] = id;
+                const auto &ref_nodes = kdt.nodes();
+                for(size_t i=0; i<ref_nodes.size(); ++i) 
+                    ref[ref_nodes[i].pad<int>()] = ids_ref[i];
+                expect_eq_range(canonical(got), canonical(ref), 
+                    "b=", b, ", min_size=", min_size);
+            }
+        }
+    }
+
+    static float r_sq_of(const kd_point_t &p, const kd_point_t &q) {
+        return (p.pos() - q.pos()).squared_norm();
+    }
+
+    vector<float> brute_force_r_sq(const kd_point_t &q) {
+        vector<float> r_sqs;
+        for(auto &p: all_pts)
+            r_sqs.push_back(r_sq_of(p, q));
+        std::sort(r_sqs.begin(), r_sqs.end());
+        return r_sqs;
+    }
+};
+
+} // namespace HIPP::MPI
+
+int main(int argc, char const *argv[]){
+    using namespace HIPP::MPI;
+
+    Env env;
+    auto comm = env.world();
+
+    DistKDTreeTest{comm}();
+
+    return 0;
+}
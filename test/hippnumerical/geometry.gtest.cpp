@@ -67,6 +67,107 @@ TEST_F(PointTest, Arithmetics) {
     }
 }
 
+class SpaceFillingCurveTest : public gt::Test {
+protected:
+    using sfc3_t = SpaceFillingCurve<double, 3>;
+    using sfc2_t = SpaceFillingCurve<float, 2>;
+    using sfc4_t = SpaceFillingCurve<double, 4>;
+    using key_t = sfc3_t::key_t;
+
+    /**
+    Sort the cells of a coarse grid of ``2^level`` cells per axis by the
+    Hilbert keys, and count the successive pairs that are not adjacent.
+    */
+    template<typename SFC>
+    int n_hilbert_jumps(int level) {
+        constexpr int D = SFC::DIM;
+        const int n_side = 1 << level, n = 1 << (level*D);
+        vector<std::pair<key_t, std::array<int, D> > > cells;
+        for(int i=0; i<n; ++i) {
+            std::array<int, D> v;
+            typename SFC::cell_t c;
+            for(int k=0, r=i; k<D; ++k, r /= n_side) {
+                v[k] = r % n_side;
+                c[k] = key_t(v[k]) << (SFC::BITS - level);
+            }
+            cells.emplace_back(SFC::hilbert_encode(c), v);
+        }
+        std::sort(cells.begin(), cells.end());
+        int n_jumps = 0;
+        for(int i=1; i<n; ++i) {
+            int d = 0;
+            for(int k=0; k<D; ++k) 
+                d += std::abs(cells[i].second[k] - cells[i-1].second[k]);
+            n_jumps += d != 1;
+        }
+        return n_jumps;
+    }
+};
+
+TEST_F(SpaceFillingCurveTest, Morton) {
+    EXPECT_EQ(sfc3_t::BITS, 21);
+    EXPECT_EQ(sfc2_t::BITS, 32);
+
+    sfc3_t::cell_t c1 {1, 0, 0}, c2 {0, 1, 0}, c3 {0, 0, 1}, c4 {3, 5, 6};
+    EXPECT_EQ(sfc3_t::morton_encode(c1), sfc3_t::key_t(4));
+    EXPECT_EQ(sfc3_t::morton_encode(c2), sfc3_t::key_t(2));
+    EXPECT_EQ(sfc3_t::morton_encode(c3), sfc3_t::key_t(1));
+    // x = 011, y = 101, z = 110 -> 011 101 110 by levels.
+    EXPECT_EQ(sfc3_t::morton_encode(c4), sfc3_t::key_t(0b011101110));
+
+    const key_t top = (key_t(1) << 21) - 1;
+    sfc3_t::cell_t c5 {top, top, top};
+    EXPECT_EQ(sfc3_t::morton_encode(c5), (key_t(1) << 63) - 1);
+
+    sfc2_t::cell_t c6 {0xffffffff, 0};
+    EXPECT_EQ(sfc2_t::morton_encode(c6), 0xaaaaaaaaaaaaaaaaULL);
+}
+
+TEST_F(SpaceFillingCurveTest, Hilbert) {
+    EXPECT_EQ(n_hilbert_jumps<sfc2_t>(5), 0);
+    EXPECT_EQ(n_hilbert_jumps<sfc3_t>(4), 0);
+    EXPECT_EQ(n_hilbert_jumps<sfc4_t>(3), 0);
+
+    // The keys of the grid are distinct, and the curve starts at the origin.
+    sfc3_t::cell_t c0 {0, 0, 0};
+    EXPECT_EQ(sfc3_t::hilbert_encode(c0), sfc3_t::key_t(0));
+}
+
+TEST_F(SpaceFillingCurveTest, Keys) {
+    sfc3_t::rect_t dom {sfc3_t::point_t{-1., 0., 2.}, 
+        sfc3_t::point_t{1., 4., 3.}};
+    sfc3_t sfc_m(dom, sfc3_t::curve_t::MORTON), sfc_h(dom);
+    EXPECT_EQ(sfc_h.curve(), sfc3_t::curve_t::HILBERT);
+
+    sfc3_t::cell_t c;
+    sfc_m.cell_of(sfc3_t::point_t{0., 1., 2.5}, c);
+    const key_t half = key_t(1) << 20;
+    EXPECT_EQ(c[0], half);
+    EXPECT_EQ(c[1], half / 2);
+    EXPECT_EQ(c[2], half);
+
+    // Points outside the domain are clamped.
+    sfc_m.cell_of(sfc3_t::point_t{-5., 10., 3.}, c);
+    EXPECT_EQ(c[0], 0);
+    EXPECT_EQ(c[1], 2*half-1);
+    EXPECT_EQ(c[2], 2*half-1);
+
+    sfc3_t::point_t p {0.3, 3.1, 2.2};
+    sfc_m.cell_of(p, c);
+    EXPECT_EQ(sfc_m.key(p), sfc3_t::morton_encode(c));
+    EXPECT_EQ(sfc_m.key(p), sfc_h.morton_key(p));
+    EXPECT_EQ(sfc_h.key(p), sfc3_t::hilbert_encode(c));
+
+    // A degenerate axis is not divided.
+    sfc2_t::rect_t dom2 {sfc2_t::point_t{0.f, 1.f}, 
+        sfc2_t::point_t{1.f, 1.f}};
+    sfc2_t sfc2(dom2, sfc2_t::curve_t::MORTON);
+    sfc2_t::cell_t c2;
+    sfc2.cell_of(sfc2_t::point_t{0.5f, 1.f}, c2);
+    EXPECT_EQ(c2[0], key_t(1) << 31);
+    EXPECT_EQ(c2[1], 0);
+}
+
 } // namespace
 
 } // namespace HIPP::NUMERICAL::GEOMETRY
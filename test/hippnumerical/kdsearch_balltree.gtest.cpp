@@ -1,5 +1,6 @@
 #include <hippnumerical.h>
 #include <gmock/gmock.h>
+#include "kdsearch_h5_mock.h"
 
 namespace HIPP::NUMERICAL {
 
@@ -59,6 +60,12 @@ public:
             cstr_pl.set_algorithm(alg_t::BOTTOM_UP);
             cstr_pl.set_bottom_up_insert_favor(ins_fav);
         }
+        for( auto ins_fav: { ins_fav_t::ROUGH, ins_fav_t::FINE } ) {
+            pl_t cstr_pl;
+            cstr_pl.set_algorithm(alg_t::BATCH_INSERTION);
+            cstr_pl.set_bottom_up_insert_favor(ins_fav);
+            out.push_back(cstr_pl);
+        }
 
         return out;
     }
@@ -428,6 +435,356 @@ for(int i=0; i<n_repeat_min; ++i){
     EXPECT_EQ(cnt_leaves, index_t(pts.size()));
 }}
 
+TEST_F(BallTreeRawEmptyPaddingTest, ConstructionParallel){
+    using pl_t = balltree_t::construct_policy_t;
+    using alg_t = pl_t::algorithm_t;
+    using spl_t = pl_t::split_axis_t;
+    
+    pl_t pl;
+    EXPECT_EQ(pl.n_threads(), pl_t::DFLT_N_THREADS);
+    EXPECT_EQ(pl.serial_cutoff(), pl_t::DFLT_SERIAL_CUTOFF);
+
+    vector<kdp_t> pts;
+    for(int i=0; i<3000; ++i){
+        pos_t pos; rand(pos.begin(), pos.end());
+        pts.emplace_back(pos);
+    }
+    // Ties along an axis.
+    for(int i=0; i<200; ++i) 
+        pts[i+200].pos()[0] = pts[i].pos()[0];
+
+    pl.set_algorithm(alg_t::KD);
+    EXPECT_THROW(balltree_t(pts, pl_t(pl).set_n_threads(0)), ErrLogic);
+    EXPECT_THROW(balltree_t(pts, pl_t(pl).set_serial_cutoff(0)), ErrLogic);
+
+    vector<pl_t> pls;
+    for(auto spl: {spl_t::MAX_EXTREME, spl_t::MAX_VARIANCE, 
+        spl_t::ORDERED, spl_t::RANDOM})
+        pls.push_back(pl_t(pl).set_split_axis(spl));
+    pls.push_back(pl_t(pl).set_algorithm(alg_t::TOP_DOWN));
+
+    for(auto &pl_serial: pls) {
+        balltree_t ballt_serial(pts, pl_serial);
+        const auto &nds_serial = ballt_serial.nodes();
+        vector<balltree_t::idx_pair_t> iprs_serial;
+        ballt_serial.argsort<kdp_t>(pts, iprs_serial);
+
+        for(auto [n_th, cutoff]: vector<std::pair<int, index_t> >{
+            {2, 1}, {3, 100}, {4, 1}, {7, 50000}})
+        {
+            auto pl = pl_t(pl_serial).set_n_threads(n_th)
+                .set_serial_cutoff(cutoff);
+            balltree_t ballt(pts, pl);
+            EXPECT_EQ(ballt.construct_policy().n_threads(), n_th);
+            EXPECT_EQ(ballt.construct_policy().serial_cutoff(), cutoff);
+            EXPECT_EQ(ballt.tree_info().max_depth(), 
+                ballt_serial.tree_info().max_depth());
+
+            const auto &nds = ballt.nodes();
+            ASSERT_EQ(nds.size(), nds_serial.size());
+            for(size_t i=0; i<nds.size(); ++i){
+                auto &n = nds[i], &n_serial = nds_serial[i];
+                ASSERT_EQ(n.size(), n_serial.size());
+                ASSERT_EQ(n.r(), n_serial.r());
+                ASSERT_TRUE( (n.center().pos() == n_serial.center().pos()).all() );
+            }
+
+            vector<balltree_t::idx_pair_t> iprs;
+            ballt.argsort<kdp_t>(pts, iprs);
+            ASSERT_EQ(iprs.size(), iprs_serial.size());
+            for(size_t i=0; i<iprs.size(); ++i){
+                ASSERT_EQ(iprs[i].idx_in, iprs_serial[i].idx_in);
+                ASSERT_EQ(iprs[i].idx_node, iprs_serial[i].idx_node);
+            }
+        }
+    }
+}
+
+TEST_F(BallTreeRawEmptyPaddingTest, Refit){
+    using pl_t = balltree_t::construct_policy_t;
+    using alg_t = pl_t::algorithm_t;
+    using rpl_t = balltree_t::refit_policy_t;
+    using sphere_t = balltree_t::sphere_t;
+
+    const index_t n = 3000;
+    auto pts = get_random_points(n);
+    vector<pos_t> offsets(n);
+    for(auto &dx: offsets) { 
+        rand(dx.begin(), dx.end()); 
+        dx -= 0.5f; 
+    }
+    // Leaves in pre-order, moved by at most ``step`` along each axis.
+    auto moved_leaves = [&](const balltree_t &ballt, float_t step) {
+        vector<kdp_t> out;
+        for(auto &nd: ballt.nodes()) if( nd.size() == 1 ) {
+            out.emplace_back( nd.center().pos() 
+                + offsets[out.size()] * (2 * step) );
+        }
+        return out;
+    };
+    auto check_tree = [&](const balltree_t &ballt, const vector<kdp_t> &lvs) {
+        const auto &nds = ballt.nodes();
+        index_t k = 0;
+        for(index_t i=0; i<index_t(nds.size()); ++i) {
+            auto &nd = nds[i];
+            if( nd.size() == 1 ) {
+                ASSERT_TRUE( (nd.center().pos() == lvs[k++].pos()).all() );
+                ASSERT_EQ(nd.r(), 0.f);
+                continue;
+            }
+            auto [i_lc, i_rc] = ballt.children_ids(i);
+            for(index_t j: {i_lc, i_rc}) {
+                const float_t d = (nd.center() - nds[j].center()).r();
+                ASSERT_LE(d + nds[j].r(), nd.r() * (1.0f + 1.0e-5f) + 1.0e-6f);
+            }
+        }
+        ASSERT_EQ(k, n);
+
+        for(int i=0; i<20; ++i) {
+            point_t q; rand(q.pos().begin(), q.pos().end());
+            EXPECT_FLOAT_EQ(ballt.nearest(q).r_sq, 
+                brute_force_nearest(nds, q).r_sq);
+            sphere_t s(q, 0.05f * (i % 4 + 1));
+            EXPECT_EQ(ballt.count_nodes_sphere(s), 
+                brute_force_count_nodes_sphere(nds, s));
+        }
+    };
+
+    for(auto alg: {alg_t::KD, alg_t::TOP_DOWN, alg_t::ROUGH_INSERTION}) {
+        const auto pl = pl_t().set_algorithm(alg);
+        balltree_t ballt(pts, pl);
+        EXPECT_EQ(ballt.refit_info().n_refits(), 0);
+        EXPECT_EQ(ballt.refit_info().growth(), 1.0);
+        
+        // Refit to the same points. The top-down trees are kept exactly.
+        auto lvs = moved_leaves(ballt, 0.f);
+        const auto nds_ref = ballt.nodes();
+        ballt.refit(lvs);
+        check_tree(ballt, lvs);
+        EXPECT_EQ(ballt.refit_info().n_refits(), 1);
+        EXPECT_GT(ballt.refit_info().build_volume(), 0.);
+        if( alg != alg_t::ROUGH_INSERTION ) {
+            EXPECT_DOUBLE_EQ(ballt.refit_info().growth(), 1.0);
+            for(size_t i=0; i<nds_ref.size(); ++i)
+                ASSERT_EQ(ballt.nodes()[i].r(), nds_ref[i].r());
+        }
+
+        // The volume grows with the motion.
+        lvs = moved_leaves(ballt, 0.002f);
+        ballt.refit(lvs);
+        check_tree(ballt, lvs);
+        const double growth_s = ballt.refit_info().growth();
+        lvs = moved_leaves(ballt, 0.05f);
+        ballt.refit(lvs);
+        check_tree(ballt, lvs);
+        EXPECT_EQ(ballt.refit_info().n_refits(), 3);
+        EXPECT_GT(ballt.refit_info().growth(), growth_s);
+
+        // Independent of the number of threads.
+        balltree_t ballt_p(pts, pl), ballt_s(pts, pl);
+        lvs = moved_leaves(ballt_s, 0.05f);
+        ballt_p.refit(lvs, rpl_t().set_n_threads(4).set_serial_cutoff(100));
+        ballt_s.refit(lvs);
+        for(size_t i=0; i<ballt_s.nodes().size(); ++i) {
+            auto &n_p = ballt_p.nodes()[i], &n_s = ballt_s.nodes()[i];
+            ASSERT_EQ(n_p.r(), n_s.r());
+            ASSERT_TRUE( (n_p.center().pos() == n_s.center().pos()).all() );
+        }
+        
+        ballt.construct(pts, pl);
+        EXPECT_EQ(ballt.refit_info().n_refits(), 0);
+    }
+
+    balltree_t ballt(pts);
+    auto few_pts = get_random_points(10);
+    EXPECT_THROW(ballt.refit(few_pts), ErrLogic);
+    EXPECT_THROW(ballt.refit(pts, rpl_t().set_serial_cutoff(0)), ErrLogic);
+    balltree_t ballt_e;
+    vector<kdp_t> no_pts;
+    ballt_e.refit(no_pts);
+    EXPECT_EQ(ballt_e.refit_info().growth(), 1.0);
+}
+
+TEST_F(BallTreeRawEmptyPaddingTest, Gravity){
+    using gpl_t = balltree_t::gravity_policy_t;
+    using order_t = gpl_t::order_t;
+    using wkdp_t = KDPoint<float, 3, sizeof(float)>;
+    using wballtree_t = BallTree<wkdp_t, int>;
+    using mp_t = wballtree_t::multipole_t;
+
+    const index_t n = 3000, n_tgts = 300;
+    const double eps = 0.01, G = 2.0;
+    vector<wkdp_t> pts(n);
+    for(index_t i=0; i<n; ++i){
+        // A clustered distribution, with masses in the padding.
+        auto p = get_random_points(1)[0].pos();
+        p = (i % 3 == 0) ? p : p * p * p;
+        pts[i] = wkdp_t(p, 0.5f + 0.25f*(i%4));
+    }
+    vector<point_t> tgts;
+    for(index_t i=0; i<n_tgts; ++i)
+        tgts.push_back( i % 2 ? point_t(pts[i*7].pos()) 
+            : get_random_points(1)[0] );
+
+    // Direct summation.
+    vector<std::array<double, 4> > refs(n_tgts);
+    for(index_t i=0; i<n_tgts; ++i){
+        std::array<double, 4> ref {};
+        for(auto &pt: pts){
+            double dx[3], r_sq = eps*eps;
+            for(int k=0; k<3; ++k){
+                dx[k] = double(tgts[i].pos()[k]) - double(pt.pos()[k]);
+                r_sq += dx[k] * dx[k];
+            }
+            const double m = pt.pad<float_t>(), inv_r = 1.0 / std::sqrt(r_sq);
+            for(int k=0; k<3; ++k) ref[k] -= G * m * inv_r*inv_r*inv_r * dx[k];
+            ref[3] -= G * m * inv_r;
+        }
+        refs[i] = ref;
+    }
+    auto rms_err = [&](const vector<pos_t> &accs, const vector<float_t> &pots,
+        double &pot_err)
+    {
+        double err = 0., norm = 0.;
+        pot_err = 0.;
+        for(index_t i=0; i<n_tgts; ++i){
+            for(int k=0; k<3; ++k){
+                const double d = accs[i][k] - refs[i][k];
+                err += d * d;
+                norm += refs[i][k] * refs[i][k];
+            }
+            pot_err = std::max(pot_err, 
+                std::fabs(pots[i] / refs[i][3] - 1.0));
+        }
+        return std::sqrt(err / norm);
+    };
+
+    using wcstr_pl_t = wballtree_t::construct_policy_t;
+    for(auto alg: {wcstr_pl_t::algorithm_t::KD, 
+        wcstr_pl_t::algorithm_t::BOTTOM_UP})
+    {
+        wcstr_pl_t cstr_pl;
+        cstr_pl.set_algorithm(alg);
+        wballtree_t tr(pts, cstr_pl);
+        auto gpl = gpl_t().set_softening(eps).set_grav_const(G).weighted_on();
+        vector<mp_t> mps;
+        tr.multipoles(mps, gpl);
+        ASSERT_EQ(mps.size(), tr.nodes().size());
+
+        // Moments of the root against the direct ones.
+        double m_tot = 0., com[3] = {};
+        for(auto &pt: pts){
+            const double m = pt.pad<float_t>();
+            m_tot += m;
+            for(int k=0; k<3; ++k) com[k] += m * pt.pos()[k];
+        }
+        for(int k=0; k<3; ++k) com[k] /= m_tot;
+        double quad[3][3] = {}, b = 0.;
+        for(auto &pt: pts){
+            const double m = pt.pad<float_t>();
+            double y[3], y_sq = 0.;
+            for(int k=0; k<3; ++k) { y[k] = pt.pos()[k] - com[k]; y_sq += y[k]*y[k]; }
+            for(int j=0; j<3; ++j) for(int k=0; k<3; ++k)
+                quad[j][k] += m * (3*y[j]*y[k] - (j == k ? y_sq : 0.));
+            b = std::max(b, std::sqrt(y_sq));
+        }
+        const auto &root = mps[0];
+        EXPECT_NEAR(root.mass(), m_tot, 1.0e-5 * m_tot);
+        for(int j=0; j<3; ++j){
+            EXPECT_NEAR(root.com()[j], com[j], 1.0e-5);
+            for(int k=0; k<3; ++k)
+                EXPECT_NEAR(root.quad(j, k), quad[j][k], 1.0e-3 * m_tot);
+        }
+        EXPECT_GE(root.b_max(), b * (1 - 1.0e-5));
+        EXPECT_LE(root.b_max(), std::sqrt(3.0) + 1.0e-5);
+
+        // theta = 0 is the direct summation.
+        vector<pos_t> accs;
+        vector<float_t> pots;
+        double pot_err;
+        auto n_acc = tr.gravity(mps, ContiguousBuffer<const point_t>(tgts), 
+            accs, pots, gpl_t(gpl).set_opening_angle(0.));
+        EXPECT_EQ(n_acc, size_t(n) * n_tgts);
+        EXPECT_LT(rms_err(accs, pots, pot_err), 1.0e-5);
+        EXPECT_LT(pot_err, 1.0e-5);
+
+        // Errors drop with the opening angle and the order.
+        double errs[2][2];
+        size_t n_accs[2];
+        for(int i=0; i<2; ++i) for(auto order: {order_t::MONOPOLE, 
+            order_t::QUADRUPOLE})
+        {
+            const double theta = i == 0 ? 0.8 : 0.4;
+            n_acc = tr.gravity(mps, ContiguousBuffer<const point_t>(tgts), 
+                accs, pots, 
+                gpl_t(gpl).set_opening_angle(theta).set_order(order));
+            const int j = order == order_t::QUADRUPOLE;
+            errs[i][j] = rms_err(accs, pots, pot_err);
+            EXPECT_LT(pot_err, 5.0e-2);
+            if( j ) n_accs[i] = n_acc;
+        }
+        EXPECT_LT(errs[0][1], errs[0][0]);
+        EXPECT_LT(errs[1][1], errs[1][0]);
+        EXPECT_LT(errs[1][1], errs[0][1]);
+        EXPECT_LT(errs[1][0], errs[0][0] / 2);
+        EXPECT_LT(errs[0][0], 0.15);
+        EXPECT_LT(errs[1][1], 1.0e-2);
+        EXPECT_LT(n_accs[0], n_accs[1]);
+        EXPECT_LT(n_accs[1], size_t(n) * n_tgts / 2);
+
+        // A walk for each target is less accurate than a walk for each group.
+        vector<pos_t> accs_p;
+        vector<float_t> pots_p;
+        auto n_acc_g = tr.gravity(mps, ContiguousBuffer<const point_t>(tgts), 
+            accs, pots, gpl_t(gpl).set_opening_angle(0.8));
+        const double err_g = rms_err(accs, pots, pot_err);
+        n_acc = tr.gravity(mps, ContiguousBuffer<const point_t>(tgts), 
+            accs, pots, gpl_t(gpl).set_opening_angle(0.8).set_group_size(1));
+        EXPECT_LE(err_g, rms_err(accs, pots, pot_err));
+        EXPECT_GE(n_acc_g, n_acc);
+
+        // Independent of the number of threads.
+        tr.gravity(mps, ContiguousBuffer<const point_t>(tgts), accs_p, 
+            pots_p, gpl_t(gpl).set_n_threads(4).set_group_size(7));
+        tr.gravity(mps, ContiguousBuffer<const point_t>(tgts), accs, pots, 
+            gpl_t(gpl).set_group_size(7));
+        for(index_t i=0; i<n_tgts; ++i){
+            ASSERT_TRUE( (accs[i] == accs_p[i]).all() );
+            ASSERT_EQ(pots[i], pots_p[i]);
+        }
+    }
+
+    // Unsoftened: a target at a point skips the point itself.
+    vector<kdp_t> two_pts {kdp_t{0.f, 0.f, 0.f}, kdp_t{1.f, 0.f, 0.f}};
+    balltree_t tr2(two_pts);
+    vector<balltree_t::multipole_t> mps2;
+    tr2.multipoles(mps2);
+    vector<pos_t> accs;
+    vector<float_t> pots;
+    tr2.gravity(mps2, ContiguousBuffer<const kdp_t>(two_pts), accs, pots);
+    EXPECT_FLOAT_EQ(accs[0][0], 1.f);
+    EXPECT_FLOAT_EQ(accs[1][0], -1.f);
+    EXPECT_FLOAT_EQ(pots[0], -1.f);
+
+    // Empty tree, and errors.
+    balltree_t tr_e;
+    vector<balltree_t::multipole_t> mps_e;
+    tr_e.multipoles(mps_e);
+    EXPECT_EQ(tr_e.gravity(mps_e, ContiguousBuffer<const kdp_t>(two_pts), 
+        accs, pots), 0);
+    EXPECT_TRUE( (accs[1] == 0.f).all() );
+    EXPECT_EQ(pots[1], 0.f);
+    EXPECT_THROW(tr2.gravity(mps_e, ContiguousBuffer<const kdp_t>(two_pts), 
+        accs, pots), ErrLogic);
+    EXPECT_THROW(tr2.multipoles(mps2, gpl_t().weighted_on()), ErrLogic);
+    EXPECT_THROW(tr2.multipoles(mps2, gpl_t().set_opening_angle(-1.)), 
+        ErrLogic);
+    EXPECT_THROW(tr2.gravity(mps2, ContiguousBuffer<const kdp_t>(two_pts), 
+        accs, pots, gpl_t().set_group_size(0)), ErrLogic);
+    balltree_t tr_p(two_pts, cstr_pl_t().set_periodic_box(2.0f));
+    EXPECT_THROW(tr_p.multipoles(mps2), ErrLogic);
+}
+
 TEST_F(BallTreeRawEmptyPaddingTest, ConstructionWithInsertionPolicy){
 for(int i=0; i<n_repeat_min; ++i){
     using pl_t = balltree_t::construct_policy_t;
@@ -563,6 +920,66 @@ for(int i_repeat=0; i_repeat<n_repeat_min; ++i_repeat){
 }
 }
 
+TEST_F(BallTreeRawEmptyPaddingTest, SaveLoad){
+    const string file_name = gt::TempDir() + "kdsearch_balltree_save_load.bin";
+    for(auto pl: get_cstr_policy_table()){
+        auto tr = get_tree_with_random_points(500, pl.set_periodic_box(1.0f));
+        tr.save(file_name);
+        
+        balltree_t tr_in;
+        tr_in.load(file_name);
+        EXPECT_TRUE( (tr_in.construct_policy().periodic_box().size() 
+            == 1.0f).all() );
+        ASSERT_EQ(tr_in.nodes().size(), tr.nodes().size());
+        ASSERT_EQ(tr_in.tree_info().max_depth(), tr.tree_info().max_depth());
+        index_t n_nds = (index_t)tr.nodes().size();
+        for(index_t i=0; i<n_nds; ++i){
+            auto &n1 = tr.nodes()[i], &n2 = tr_in.nodes()[i];
+            ASSERT_EQ(n1.size(), n2.size());
+            ASSERT_EQ(n1.r(), n2.r());
+            ASSERT_TRUE( (n1.center().pos() == n2.center().pos()).all() );
+        }
+        for(auto &pt: get_random_points(50)){
+            auto ngb1 = tr.nearest(pt), ngb2 = tr_in.nearest(pt);
+            ASSERT_EQ(ngb1.node_idx, ngb2.node_idx);
+            ASSERT_EQ(ngb1.r_sq, ngb2.r_sq);
+        }
+    }
+    BallTree<KDPoint<float, 3>, long> tr_l;
+    EXPECT_THROW(tr_l.load(file_name), ErrRuntime);
+    std::remove(file_name.c_str());
+}
+
+TEST_F(BallTreeRawEmptyPaddingTest, SaveLoadH5){
+    for(auto pl: get_cstr_policy_table()){
+        auto tr = get_tree_with_random_points(500, pl.set_periodic_box(1.0f));
+        TEST::MockH5Group g;
+        tr.save_h5(g);
+        
+        balltree_t tr_in;
+        tr_in.load_h5(g);
+        EXPECT_TRUE( (tr_in.construct_policy().periodic_box().size() 
+            == 1.0f).all() );
+        ASSERT_EQ(tr_in.nodes().size(), tr.nodes().size());
+        ASSERT_EQ(tr_in.tree_info().max_depth(), tr.tree_info().max_depth());
+        index_t n_nds = (index_t)tr.nodes().size();
+        for(index_t i=0; i<n_nds; ++i){
+            auto &n1 = tr.nodes()[i], &n2 = tr_in.nodes()[i];
+            ASSERT_EQ(n1.size(), n2.size());
+            ASSERT_EQ(n1.r(), n2.r());
+            ASSERT_TRUE( (n1.center().pos() == n2.center().pos()).all() );
+        }
+        for(auto &pt: get_random_points(50)){
+            auto ngb1 = tr.nearest(pt), ngb2 = tr_in.nearest(pt);
+            ASSERT_EQ(ngb1.node_idx, ngb2.node_idx);
+            ASSERT_EQ(ngb1.r_sq, ngb2.r_sq);
+        }
+
+        BallTree<KDPoint<float, 3>, long> tr_l;
+        EXPECT_THROW(tr_l.load_h5(g), ErrRuntime);
+    }
+}
+
 TEST_F(BallTreeRawEmptyPaddingTest, NodeIndexAccess){
 for(int i_repeat=0; i_repeat<n_repeat_min; ++i_repeat){
     auto tr = get_tree_with_random_points(500);
@@ -888,6 +1305,45 @@ for(int i_repeat=0; i_repeat<n_repeat_min; ++i_repeat){
 
 }}
 
+TEST_F(BallTreeRawEmptyPaddingTest, QueryNearestApprox){
+    using npl_t = balltree_t::nearest_query_policy_t;
+    using kpl_t = balltree_t::nearest_k_query_policy_t;
+    EXPECT_THROW(npl_t().set_eps(-0.1f), ErrLogic);
+    EXPECT_THROW(kpl_t().set_eps(-0.1f), ErrLogic);
+
+    const index_t n_pts = 5000, k = 16;
+    auto tr = get_tree_with_random_points(n_pts);
+    const auto &nds = tr.nodes();
+    auto pts = get_random_points(200);
+    size_t n_exact = 0, n_exact_k = 0;
+    for(float eps: {0.0f, 0.5f, 2.0f}) {
+        npl_t npl; npl.set_eps(eps);
+        kpl_t kpl; kpl.set_eps(eps).sort_by_distance_on();
+        const float f = (1 + eps) * (1 + eps), tol = 1.0e-4f;
+        for(auto &pt: pts) {
+            auto ngb = tr.nearest(pt, npl);
+            auto ngb_dst = brute_force_nearest(nds, pt);
+            EXPECT_LE(ngb.r_sq, ngb_dst.r_sq * f + tol);
+            if( eps == 0 ){
+                EXPECT_NEAR(ngb.r_sq, ngb_dst.r_sq, tol);
+            }
+
+            vector<balltree_t::ngb_t> ngbs(k);
+            ASSERT_EQ(tr.nearest_k(pt, ngbs, kpl), k);
+            auto ngbs_dst = brute_force_nearest_k(nds, pt, k);
+            for(index_t i=0; i<k; ++i)
+                EXPECT_LE(ngbs[i].r_sq, ngbs_dst[i].r_sq * f + tol);
+        }
+        EXPECT_GT(npl.n_visited(), 0u);
+        if( eps == 0 ) {
+            n_exact = npl.n_visited(); n_exact_k = kpl.n_visited();
+        } else {
+            EXPECT_LE(npl.n_visited(), n_exact);
+            EXPECT_LT(kpl.n_visited(), n_exact_k);
+        }
+    }
+}
+
 TEST_F(BallTreeRawEmptyPaddingTest, QueryCountRectWithEmptyTree){
 for(int i_repeat=0; i_repeat<n_repeat_min; ++i_repeat){
 
@@ -1118,6 +1574,280 @@ for(int i_repeat=0; i_repeat<n_repeat_min; ++i_repeat){
     }
 }}
 
+TEST_F(BallTreeRawEmptyPaddingTest, QueryBatch){
+    using bpl_t = balltree_t::batch_query_policy_t;
+    using ngb_t = balltree_t::ngb_t;
+    const index_t n_pts = 2000, n_dst = 500, k = 8;
+    auto tr = get_tree_with_random_points(n_pts);
+    const auto &nds = tr.nodes();
+
+    auto pts = get_random_points(n_dst);
+    vector<balltree_t::sphere_t> spheres;
+    for(index_t i=0; i<n_dst; ++i)
+        spheres.emplace_back(pts[i], 0.05f * (1 + i % 4));
+
+    vector<bpl_t> bpls(4);
+    bpls[1].set_n_threads(3);
+    bpls[2].sort_queries_on();
+    bpls[3].set_n_threads(4).sort_queries_on();
+    for(auto &bpl: bpls){
+        vector<index_t> displs, node_ids, counts;
+        vector<ngb_t> ngbs;
+        tr.nearest_k_batch<kdp_t>(pts, k, displs, ngbs, bpl);
+        ASSERT_EQ(displs.size(), n_dst+1);
+        for(index_t i=0; i<n_dst; ++i){
+            ASSERT_EQ(displs[i+1]-displs[i], k);
+            vector<ngb_t> ngb(ngbs.begin()+displs[i], 
+                ngbs.begin()+displs[i+1]);
+            std::sort(ngb.begin(), ngb.end());
+            auto ngb_dst = brute_force_nearest_k(nds, pts[i], k);
+            for(index_t j=0; j<k; ++j)
+                EXPECT_LT(std::fabs(ngb[j].r_sq-ngb_dst[j].r_sq), 1.0e-4);
+        }
+
+        tr.find_nodes_sphere_batch(spheres, displs, node_ids, bpl);
+        tr.count_nodes_sphere_batch(spheres, counts, bpl);
+        ASSERT_EQ(displs.size(), n_dst+1);
+        ASSERT_EQ(counts.size(), n_dst);
+        for(index_t i=0; i<n_dst; ++i){
+            const auto &s = spheres[i];
+            vector<index_t> ids_dst;
+            for(auto &n: nds)
+                if( n.size() == 1 && s.contains(n.center()) ) 
+                    ids_dst.push_back(index_t(&n - nds.data()));
+            vector<index_t> ids(node_ids.begin()+displs[i], 
+                node_ids.begin()+displs[i+1]);
+            EXPECT_THAT(ids, gt::UnorderedElementsAreArray(ids_dst));
+            EXPECT_EQ(counts[i], (index_t)ids_dst.size());
+        }
+    }
+}
+
+TEST_F(BallTreeRawEmptyPaddingTest, QueryAllNearestK){
+    using apl_t = balltree_t::all_nearest_k_policy_t;
+    using ngb_t = balltree_t::ngb_t;
+    const index_t n_pts = 1000, k = 6;
+
+    vector<apl_t> apls(4);
+    apls[1].set_n_threads(4);
+    apls[2].include_self_on();
+    apls[3].set_n_threads(3).include_self_on();
+    for(auto &cstr_pl: get_cstr_policy_table()){
+        auto tr = get_tree_with_random_points(n_pts, cstr_pl);
+        const auto &nds = tr.nodes();
+        for(auto &apl: apls){
+            vector<index_t> node_ids;
+            vector<ngb_t> ngbs;
+            ASSERT_EQ(tr.all_nearest_k(k, node_ids, ngbs, apl), k);
+            ASSERT_EQ(node_ids.size(), n_pts);
+            ASSERT_EQ(ngbs.size(), n_pts*k);
+            const index_t off = apl.include_self() ? 0 : 1;
+            for(index_t i=0; i<n_pts; ++i){
+                const auto &n = nds[node_ids[i]];
+                ASSERT_EQ(n.size(), 1);
+                auto ngb_dst = brute_force_nearest_k(nds, n.center(), k+1);
+                for(index_t j=0; j<k; ++j){
+                    EXPECT_LT(std::fabs(ngbs[i*k+j].r_sq
+                        - ngb_dst[j+off].r_sq), 1.0e-4);
+                    if( !apl.include_self() ){
+                        EXPECT_NE(ngbs[i*k+j].node_idx, node_ids[i]);
+                    }
+                }
+            }
+        }
+    }
+
+    auto tr = get_tree_with_random_points(3);
+    vector<index_t> node_ids;
+    vector<ngb_t> ngbs;
+    EXPECT_EQ(tr.all_nearest_k(k, node_ids, ngbs), 2);
+    EXPECT_EQ(tr.all_nearest_k(k, node_ids, ngbs, apls[2]), 3);
+    EXPECT_EQ(ngbs.size(), 3*3);
+    EXPECT_THROW(tr.all_nearest_k(k, node_ids, ngbs, 
+        apl_t().set_n_threads(0)), ErrLogic);
+}
+
+TEST_F(BallTreeRawEmptyPaddingTest, QueryPeriodicBox){
+    using ngb_t = balltree_t::ngb_t;
+    using rect_t = balltree_t::rect_t;
+    using sphere_t = balltree_t::sphere_t;
+    const index_t n_pts = 1000, n_dst = 50, k = 6;
+
+    // Points are in [0, 1). Fully periodic, and periodic along x and z only.
+    for(const pos_t &box: {pos_t(1.0f), pos_t{1.0f, 0.0f, 1.0f}})
+    for(auto cstr_pl: get_cstr_policy_table()){
+        auto pts = get_random_points(n_pts);
+        balltree_t tr(pts, cstr_pl.set_periodic_box(box));
+        const auto &nds = tr.nodes();
+        auto r_sq_of = [&](const pos_t &p, const pos_t &q) {
+            pos_t dx = p - q;
+            for(int d=0; d<3; ++d) {
+                if( box[d] <= 0 ) continue;
+                dx[d] = std::fmod(std::fabs(dx[d]), box[d]);
+                dx[d] = std::min(dx[d], box[d] - dx[d]);
+            }
+            return float_t(dx.squared_norm());
+        };
+
+        for(index_t i=0; i<n_dst; ++i){
+            pos_t q; rand(q.begin(), q.end());
+            q = q * 3.0f - 1.0f;
+            vector<float_t> ref;
+            for(auto &n: nds)
+                if( n.size() == 1 ) 
+                    ref.push_back(r_sq_of(n.center().pos(), q));
+            std::sort(ref.begin(), ref.end());
+
+            auto ngb = tr.nearest(point_t(q));
+            EXPECT_NEAR(ngb.r_sq, ref[0], 1.0e-5);
+            EXPECT_NEAR(ngb.r_sq, r_sq_of(nds[ngb.node_idx].center().pos(), 
+                q), 1.0e-5);
+
+            vector<ngb_t> ngbs(k);
+            ASSERT_EQ(tr.nearest_k(point_t(q), ngbs), k);
+            std::sort(ngbs.begin(), ngbs.end());
+            for(index_t j=0; j<k; ++j)
+                EXPECT_NEAR(ngbs[j].r_sq, ref[j], 1.0e-5);
+
+            const float_t r = 0.05f * (i % 10);
+            const index_t cnt = std::count_if(ref.begin(), ref.end(), 
+                [&](float_t r_sq) { return r_sq < r*r; });
+            EXPECT_EQ(tr.count_nodes_sphere(sphere_t(point_t(q), r)), cnt);
+
+            // A rect of size 0.3 (wrapped around the box if periodic).
+            const rect_t rect(point_t(q), point_t(q + 0.3f));
+            index_t cnt_rect = 0;
+            for(auto &n: nds){
+                if( n.size() != 1 ) continue;
+                bool in = true;
+                for(int d=0; d<3; ++d){
+                    float_t x = n.center().pos()[d] - q[d];
+                    if( box[d] > 0 ) {
+                        x = std::fmod(x, box[d]);
+                        if( x < 0 ) x += box[d];
+                    }
+                    in = in && x > 0 && x < 0.3f;
+                }
+                cnt_rect += in;
+            }
+            EXPECT_EQ(tr.count_nodes_rect(rect), cnt_rect);
+        }
+        EXPECT_THROW(tr.count_nodes_sphere(sphere_t(point_t(pos_t(0.0f)), 
+            0.6f)), ErrLogic);
+
+        vector<index_t> node_ids;
+        vector<ngb_t> all_ngbs;
+        ASSERT_EQ(tr.all_nearest_k(k, node_ids, all_ngbs), k);
+        for(index_t i=0; i<n_pts; i+=20){
+            const auto &c = nds[node_ids[i]].center().pos();
+            vector<float_t> ref;
+            for(auto &n: nds)
+                if( n.size() == 1 && &n != &nds[node_ids[i]] ) 
+                    ref.push_back(r_sq_of(n.center().pos(), c));
+            std::sort(ref.begin(), ref.end());
+            for(index_t j=0; j<k; ++j)
+                EXPECT_NEAR(all_ngbs[i*k+j].r_sq, ref[j], 1.0e-5);
+        }
+    }
+}
+
+TEST_F(BallTreeRawEmptyPaddingTest, CountPairs){
+    using ppl_t = balltree_t::pair_count_policy_t;
+    using wkdp_t = KDPoint<float, 3, sizeof(float)>;
+    using wballtree_t = BallTree<wkdp_t, int>;
+    const index_t n1 = 1500, n2 = 1000;
+    const vector<float_t> edges {0.01f, 0.05f, 0.1f, 0.2f, 0.3f};
+    const int n_bins = edges.size() - 1;
+
+    // Points in [0, 1), weighted by the padding.
+    vector<wkdp_t> pts1(n1), pts2(n2);
+    for(index_t i=0; i<n1; ++i) 
+        pts1[i] = wkdp_t(get_random_points(1)[0].pos(), 1.0f + 0.25f*(i%5));
+    for(index_t i=0; i<n2; ++i) 
+        pts2[i] = wkdp_t(get_random_points(1)[0].pos(), 2.0f - 0.25f*(i%3));
+
+    for(const pos_t &box: {pos_t(0.0f), pos_t{1.0f, 0.0f, 1.0f}}){
+        auto r_sq_of = [&](const pos_t &p, const pos_t &q) {
+            pos_t dx = p - q;
+            for(int d=0; d<3; ++d) {
+                if( box[d] <= 0 ) continue;
+                dx[d] = std::fmod(std::fabs(dx[d]), box[d]);
+                dx[d] = std::min(dx[d], box[d] - dx[d]);
+            }
+            return float_t(dx.squared_norm());
+        };
+        auto bin_of = [&](float_t r_sq) {
+            for(int b=0; b<n_bins; ++b)
+                if( r_sq >= edges[b]*edges[b] && r_sq < edges[b+1]*edges[b+1] )
+                    return b;
+            return -1;
+        };
+        vector<double> ref_auto(n_bins, 0.), ref_cross(n_bins, 0.),
+            ref_auto_w(n_bins, 0.), ref_cross_w(n_bins, 0.);
+        for(index_t i=0; i<n1; ++i){
+            const double w = pts1[i].pad<float_t>();
+            for(index_t j=i+1; j<n1; ++j){
+                const int b = bin_of(r_sq_of(pts1[i].pos(), pts1[j].pos()));
+                if( b < 0 ) continue;
+                ref_auto[b] += 1.;
+                ref_auto_w[b] += w * pts1[j].pad<float_t>();
+            }
+            for(index_t j=0; j<n2; ++j){
+                const int b = bin_of(r_sq_of(pts1[i].pos(), pts2[j].pos()));
+                if( b < 0 ) continue;
+                ref_cross[b] += 1.;
+                ref_cross_w[b] += w * pts2[j].pad<float_t>();
+            }
+        }
+
+        vector<kdp_t> upts1, upts2;
+        for(auto &p: pts1) upts1.emplace_back(p.pos());
+        for(auto &p: pts2) upts2.emplace_back(p.pos());
+        for(auto cstr_pl: get_cstr_policy_table()){
+            cstr_pl.set_periodic_box(box);
+            balltree_t tr1(upts1, cstr_pl), tr2(upts2, cstr_pl);
+            for(int n_threads: {1, 3}){
+                ppl_t ppl;
+                ppl.set_n_threads(n_threads);
+                vector<double> counts;
+                tr1.count_pairs(edges, counts, ppl);
+                EXPECT_THAT(counts, gt::ElementsAreArray(ref_auto));
+                tr1.count_pairs(tr2, edges, counts, ppl);
+                EXPECT_THAT(counts, gt::ElementsAreArray(ref_cross));
+            }
+        }
+
+        wballtree_t::construct_policy_t wcstr_pl;
+        wcstr_pl.set_periodic_box(box);
+        wballtree_t tr1(pts1, wcstr_pl), tr2(pts2, wcstr_pl);
+        for(int n_threads: {1, 3}){
+            ppl_t ppl;
+            ppl.set_n_threads(n_threads).weighted_on();
+            vector<double> counts;
+            tr1.count_pairs(edges, counts, ppl);
+            ASSERT_EQ(counts.size(), n_bins);
+            for(int b=0; b<n_bins; ++b)
+                EXPECT_NEAR(counts[b], ref_auto_w[b], 1.0e-9*ref_auto_w[b]);
+            tr1.count_pairs(tr2, edges, counts, ppl);
+            ASSERT_EQ(counts.size(), n_bins);
+            for(int b=0; b<n_bins; ++b)
+                EXPECT_NEAR(counts[b], ref_cross_w[b], 1.0e-9*ref_cross_w[b]);
+        }
+    }
+
+    vector<double> counts;
+    balltree_t tr_empty;
+    tr_empty.count_pairs(edges, counts);
+    EXPECT_THAT(counts, gt::Each(0.));
+    EXPECT_EQ(counts.size(), n_bins);
+    auto tr = get_tree_with_random_points(100);
+    const vector<float_t> edges_all {0.0f, 2.0f};
+    tr.count_pairs(edges_all, counts);
+    EXPECT_THAT(counts, gt::ElementsAre(100.*99./2.));
+    EXPECT_THROW(tr.count_pairs(edges, counts, ppl_t().weighted_on()), 
+        ErrLogic);
+}
+
 class BallTreeRawIntPaddingTest : public gt::Test {
 public:
     using kdp_t = KDPoint<float, 3, sizeof(int)>;
@@ -4448,6 +5178,55 @@ for(int i_repeat=0; i_repeat<n_repeat_min; ++i_repeat){
 
 
 
+TEST(BallTreeLongLongTest, ConstructAndQuery) {
+    using kdp_t = KDPoint<float, 3, sizeof(long long)>;
+    using balltree_t = BallTree<kdp_t, long long>;
+    using index_t = balltree_t::index_t;
+    using ngb_t = balltree_t::ngb_t;
+    using pl_t = balltree_t::construct_policy_t;
+    using alg_t = pl_t::algorithm_t;
+    static_assert(std::is_same_v<index_t, long long>);
+
+    UniformRealRandomNumber<> rng(0.0f, 100.0f);
+    const long long pad_base = 1LL << 40;
+    vector<kdp_t> pts(5000);
+    for(size_t i=0; i<pts.size(); ++i) {
+        rng(pts[i].pos().begin(), pts[i].pos().end());
+        pts[i].fill_pad(pad_base + (long long)i);
+    }
+
+    for(auto alg: {alg_t::KD, alg_t::TOP_DOWN}) {
+        balltree_t bt(pts, pl_t().set_algorithm(alg).set_n_threads(2)
+            .set_serial_cutoff(500));
+        const auto &nds = bt.nodes();
+        EXPECT_EQ(index_t(nds.size()), 2*index_t(pts.size())-1);
+
+        vector<ngb_t> ngbs(8);
+        for(int i=0; i<50; ++i) {
+            balltree_t::pos_t q;
+            rng(q.begin(), q.end());
+            vector<float> ref;
+            for(auto &p: pts) ref.push_back((p.pos()-q).squared_norm());
+            std::sort(ref.begin(), ref.end());
+
+            ASSERT_EQ(bt.nearest_k(q, ngbs), 8);
+            std::sort(ngbs.begin(), ngbs.end());
+            for(int j=0; j<8; ++j) {
+                EXPECT_FLOAT_EQ(ngbs[j].r_sq, ref[j]);
+                const auto &n = nds[ngbs[j].node_idx];
+                const index_t id = n.pad<long long>() - pad_base;
+                ASSERT_GE(id, 0);
+                ASSERT_LT(id, index_t(pts.size()));
+                EXPECT_FLOAT_EQ((pts[id].pos()-q).squared_norm(), 
+                    ngbs[j].r_sq);
+            }
+            const index_t cnt = std::lower_bound(ref.begin(), ref.end(), 
+                25.0f) - ref.begin();
+            EXPECT_EQ(bt.count_nodes_sphere({q, 5.0f}), cnt);
+        }
+    }
+}
+
 } // namespace
 
 } // namespace HIPP::NUMERICAL
\ No newline at end of file
@@ -433,7 +433,8 @@ for(int i=0; i<n_repeat_min; ++i){
     using pl_t = balltree_t::construct_policy_t;
     using alg_t = pl_t::algorithm_t;
 
-    for( auto alg: { alg_t::ROUGH_INSERTION, alg_t::FINE_INSERTION } ) {
+    for( auto alg: { alg_t::ROUGH_INSERTION, alg_t::FINE_INSERTION, 
+        alg_t::BATCH_INSERTION } ) {
         pl_t cstr_pl;
         cstr_pl.set_algorithm(alg);
 
@@ -1543,7 +1544,8 @@ for(int i=0; i<n_repeat_min; ++i){
     using pl_t = balltree_t::construct_policy_t;
     using alg_t = pl_t::algorithm_t;
 
-    for( auto alg: { alg_t::ROUGH_INSERTION, alg_t::FINE_INSERTION } ) {
+    for( auto alg: { alg_t::ROUGH_INSERTION, alg_t::FINE_INSERTION, 
+        alg_t::BATCH_INSERTION } ) {
         pl_t cstr_pl;
         cstr_pl.set_algorithm(alg);
 
@@ -2652,7 +2654,8 @@ for(int i=0; i<n_repeat_min; ++i){
     using pl_t = balltree_t::construct_policy_t;
     using alg_t = pl_t::algorithm_t;
 
-    for( auto alg: { alg_t::ROUGH_INSERTION, alg_t::FINE_INSERTION } ) {
+    for( auto alg: { alg_t::ROUGH_INSERTION, alg_t::FINE_INSERTION, 
+        alg_t::BATCH_INSERTION } ) {
         pl_t cstr_pl;
         cstr_pl.set_algorithm(alg);
 
@@ -3761,7 +3764,8 @@ for(int i=0; i<n_repeat_min; ++i){
     using pl_t = balltree_t::construct_policy_t;
     using alg_t = pl_t::algorithm_t;
 
-    for( auto alg: { alg_t::ROUGH_INSERTION, alg_t::FINE_INSERTION } ) {
+    for( auto alg: { alg_t::ROUGH_INSERTION, alg_t::FINE_INSERTION, 
+        alg_t::BATCH_INSERTION } ) {
         pl_t cstr_pl;
         cstr_pl.set_algorithm(alg);
 
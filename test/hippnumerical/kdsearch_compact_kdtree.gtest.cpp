@@ -0,0 +1,254 @@
+#include <hippnumerical.h>
+#include <gmock/gmock.h>
+#include <cstdint>
+
+namespace HIPP::NUMERICAL {
+
+namespace {
+
+namespace gt = ::testing;
+
+template<typename TreeT>
+class CompactKDTreeTestBase {
+public:
+    using tree_t = TreeT;
+    using kdp_t = typename tree_t::kd_point_t;
+    using float_t = typename tree_t::float_t;
+    using index_t = typename tree_t::index_t;
+    using pos_t = typename tree_t::pos_t;
+    using point_t = typename tree_t::point_t;
+    using ngb_t = typename tree_t::ngb_t;
+    using rect_t = typename tree_t::rect_t;
+    using sphere_t = typename tree_t::sphere_t;
+    using pl_t = typename tree_t::query_policy_t;
+
+    using rng_t = UniformRealRandomNumber<>;
+
+    inline static const rng_t::seed_t seed = 0;
+    inline static const float box_size = 100.0;
+
+    CompactKDTreeTestBase() : _eng(seed), _rng(0.0f, box_size, &_eng) {}
+
+    pos_t random_pos() {
+        pos_t p;
+        _rng(p.begin(), p.end());
+        return p;
+    }
+
+    void fill(index_t n) {
+        pts.clear();
+        for(index_t i=0; i<n; ++i) pts.emplace_back(random_pos());
+    }
+
+    float_t r_sq_of(const pos_t &p, const pos_t &q) const {
+        return float_t( (p - q).squared_norm() );
+    }
+
+    /**
+    With the exact points, the results are the same as the brute-force ones.
+    */
+    void check_exact(const tree_t &tree) {
+        pl_t pl;
+        pl.set_exact_points(pts);
+        const int k = 8;
+        const float_t tol = 1.0e-3f;
+        for(int i=0; i<50; ++i) {
+            const pos_t q = random_pos();
+            vector<std::pair<float_t, index_t> > ref;
+            for(size_t j=0; j<pts.size(); ++j)
+                ref.emplace_back(r_sq_of(pts[j].pos(), q), j);
+            std::sort(ref.begin(), ref.end());
+
+            auto ngb = tree.nearest(q, pl);
+            if( ref.empty() ) {
+                EXPECT_EQ(ngb.id, tree_t::idxNULL);
+            } else {
+                EXPECT_NEAR(ngb.r_sq, ref[0].first, tol);
+                EXPECT_NEAR(ngb.r_sq, r_sq_of(pts[ngb.id].pos(), q), tol);
+            }
+
+            vector<ngb_t> ngbs(k);
+            const index_t n = tree.nearest_k(q, ngbs, pl);
+            ASSERT_EQ(n, std::min<index_t>(k, ref.size()));
+            for(index_t j=0; j<n; ++j) {
+                EXPECT_NEAR(ngbs[j].r_sq, ref[j].first, tol);
+                EXPECT_NEAR(ngbs[j].r_sq, r_sq_of(pts[ngbs[j].id].pos(), q),
+                    tol);
+            }
+
+            const sphere_t s(q, 10.0f);
+            vector<index_t> got, want;
+            tree.visit_sphere(s, [&](index_t id) { got.push_back(id); }, pl);
+            for(auto &[r_sq, id]: ref)
+                if( r_sq < 100.0f ) want.push_back(id);
+            std::sort(got.begin(), got.end());
+            std::sort(want.begin(), want.end());
+            EXPECT_THAT(got, gt::ContainerEq(want));
+            EXPECT_EQ(tree.count_sphere(s, pl), index_t(want.size()));
+
+            const rect_t r(q, point_t(pos_t(q + 15.0f)));
+            got.clear(); want.clear();
+            tree.visit_rect(r, [&](index_t id) { got.push_back(id); }, pl);
+            for(size_t j=0; j<pts.size(); ++j)
+                if( r.contains(pts[j]) ) want.push_back(j);
+            std::sort(got.begin(), got.end());
+            EXPECT_THAT(got, gt::ContainerEq(want));
+            EXPECT_EQ(tree.count_rect(r, pl), index_t(want.size()));
+        }
+    }
+
+    vector<kdp_t> pts;
+    rng_t::engine_t _eng;
+    rng_t _rng;
+};
+
+class CompactKDTreeTest: public gt::Test,
+    public CompactKDTreeTestBase<CompactKDTree<KDPoint<float, 3>, int> > {};
+
+TEST_F(CompactKDTreeTest, NodeSize) {
+    using node16_t = CompactKDTree<KDPoint<float, 3>, int, 16>::node_t;
+    using node21_t = CompactKDTree<KDPoint<float, 3>, int, 21>::node_t;
+    using kdt_node_t = KDTree<KDPoint<float, 3, sizeof(int)> >::node_t;
+    EXPECT_EQ(sizeof(node16_t), 16);
+    EXPECT_EQ(sizeof(node21_t), 16);
+    EXPECT_LT(sizeof(node16_t), sizeof(kdt_node_t));
+
+    node21_t n(7, 1000, 2);
+    for(int d=0; d<3; ++d) n.set_quantized(d, (1u << 21) - 1 - d);
+    n.set_quantized(1, 12345);
+    EXPECT_EQ(n.id(), 7);
+    EXPECT_EQ(n.size(), 1000);
+    EXPECT_EQ(n.axis(), 2);
+    EXPECT_EQ(n.quantized(0), (1u << 21) - 1);
+    EXPECT_EQ(n.quantized(1), 12345u);
+    EXPECT_EQ(n.quantized(2), (1u << 21) - 3);
+
+    // 25-bit integers cross the word boundary.
+    _KDSEARCH::_QuantizedPos<3, 25> qp {};
+    for(int d=0; d<3; ++d) qp.set(d, (1u << 25) - 1 - 1000*d);
+    qp.set(1, 54321);
+    EXPECT_EQ(qp.get(0), (1u << 25) - 1);
+    EXPECT_EQ(qp.get(1), 54321u);
+    EXPECT_EQ(qp.get(2), (1u << 25) - 2001);
+}
+
+TEST_F(CompactKDTreeTest, Empty) {
+    tree_t tree;
+    EXPECT_EQ(tree.size(), 0);
+    check_exact(tree);
+    tree.construct(pts);
+    EXPECT_EQ(tree.size(), 0);
+    check_exact(tree);
+}
+
+TEST_F(CompactKDTreeTest, Exact) {
+    for(index_t n: {1, 2, 3, 10, 3000}) {
+        fill(n);
+        tree_t tree(pts);
+        ASSERT_EQ(tree.size(), n);
+        ASSERT_EQ(index_t(tree.nodes().size()), n);
+        EXPECT_EQ(tree.nodes()[0].size(), n);
+        check_exact(tree);
+    }
+
+    // The slabs prune most of the exact checks.
+    pl_t pl;
+    pl.set_exact_points(pts);
+    tree_t tree(pts);
+    vector<ngb_t> ngbs(8);
+    for(int i=0; i<100; ++i) tree.nearest_k(random_pos(), ngbs, pl);
+    EXPECT_LT(pl.n_exact_checks(), 100 * pts.size() / 10);
+    pl.reset_n_exact_checks();
+    EXPECT_EQ(pl.n_exact_checks(), 0);
+}
+
+TEST_F(CompactKDTreeTest, Degenerate) {
+    // Duplicated points and flat distributions.
+    fill(1000);
+    for(int i=0; i<300; ++i) pts[i+300] = pts[i];
+    for(int i=0; i<1000; ++i) pts[i].pos()[2] = 50.0f;
+    check_exact(tree_t(pts));
+
+    pts.assign(100, kdp_t(pos_t(-3.0f)));
+    tree_t tree(pts);
+    check_exact(tree);
+    EXPECT_EQ(tree.count_sphere(sphere_t(pos_t(-3.0f), 1.0e-3f)), 100);
+}
+
+TEST_F(CompactKDTreeTest, Approximate) {
+    fill(3000);
+    tree_t tree(pts);
+    pl_t pl;
+    EXPECT_FALSE(pl.has_exact_points());
+
+    // A slab at the root is 2^-16 of the bounding box.
+    const float_t err = box_size * std::sqrt(3.0f) / (1 << 16);
+    const int k = 8;
+    for(int i=0; i<50; ++i) {
+        const pos_t q = random_pos();
+        vector<float_t> ref;
+        for(auto &p: pts) ref.push_back(std::sqrt(r_sq_of(p.pos(), q)));
+        std::sort(ref.begin(), ref.end());
+
+        vector<ngb_t> ngbs(k);
+        ASSERT_EQ(tree.nearest_k(q, ngbs, pl), k);
+        for(int j=0; j<k; ++j)
+            EXPECT_NEAR(std::sqrt(ngbs[j].r_sq), ref[j], err);
+        EXPECT_NEAR(std::sqrt(tree.nearest(q, pl).r_sq), ref[0], err);
+
+        const float_t r = 10.0f;
+        const index_t cnt = tree.count_sphere(sphere_t(q, r), pl);
+        const index_t n_lo = std::lower_bound(ref.begin(), ref.end(),
+            r - err) - ref.begin(),
+            n_hi = std::upper_bound(ref.begin(), ref.end(), r + err)
+            - ref.begin();
+        EXPECT_GE(cnt, n_lo);
+        EXPECT_LE(cnt, n_hi);
+    }
+    EXPECT_EQ(pl.n_exact_checks(), 0);
+}
+
+TEST_F(CompactKDTreeTest, Parallel) {
+    using cpl_t = tree_t::construct_policy_t;
+    cpl_t cpl;
+    EXPECT_EQ(cpl.n_threads(), cpl_t::DFLT_N_THREADS);
+    EXPECT_EQ(cpl.serial_cutoff(), cpl_t::DFLT_SERIAL_CUTOFF);
+    fill(5000);
+    EXPECT_THROW(tree_t(pts, cpl_t(cpl).set_n_threads(0)), ErrLogic);
+    EXPECT_THROW(tree_t(pts, cpl_t(cpl).set_serial_cutoff(0)), ErrLogic);
+
+    tree_t tree_serial(pts);
+    const auto &nds_serial = tree_serial.nodes();
+    for(auto [n_th, cutoff]: vector<std::pair<int, index_t> >{
+        {2, 1}, {3, 100}, {4, 1}})
+    {
+        tree_t tree(pts, cpl_t().set_n_threads(n_th)
+            .set_serial_cutoff(cutoff));
+        const auto &nds = tree.nodes();
+        ASSERT_EQ(nds.size(), nds_serial.size());
+        for(size_t i=0; i<nds.size(); ++i) {
+            ASSERT_EQ(nds[i].id(), nds_serial[i].id());
+            ASSERT_EQ(nds[i].size(), nds_serial[i].size());
+            ASSERT_EQ(nds[i].axis(), nds_serial[i].axis());
+            for(int d=0; d<3; ++d)
+                ASSERT_EQ(nds[i].quantized(d), nds_serial[i].quantized(d));
+        }
+    }
+}
+
+class CompactKDTree21BitTest: public gt::Test,
+    public CompactKDTreeTestBase<
+        CompactKDTree<KDPoint<double, 2>, std::int64_t, 21> > {};
+
+TEST_F(CompactKDTree21BitTest, Exact) {
+    for(index_t n: {1, 5, 2000}) {
+        fill(n);
+        tree_t tree(pts);
+        ASSERT_EQ(tree.size(), n);
+        check_exact(tree);
+    }
+}
+
+} // namespace
+
+} // namespace HIPP::NUMERICAL
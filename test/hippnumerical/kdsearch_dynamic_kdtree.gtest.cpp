@@ -0,0 +1,198 @@
+#include <hippnumerical.h>
+#include <gmock/gmock.h>
+#include <map>
+
+namespace HIPP::NUMERICAL {
+
+namespace {
+
+namespace gt = ::testing;
+
+class DynamicKDTreeTest: public ::testing::Test {
+protected:
+    using kdp_t = KDPoint<float, 3, sizeof(int)>;
+    using tree_t = DynamicKDTree<kdp_t, int>;
+    using float_t = tree_t::float_t;
+    using pos_t = tree_t::pos_t;
+    using ngb_t = tree_t::ngb_t;
+    using rect_t = tree_t::rect_t;
+    using sphere_t = tree_t::sphere_t;
+
+    using rng_t = UniformRealRandomNumber<>;
+    using idx_rng_t = UniformIntRandomNumber<int>;
+
+    DynamicKDTreeTest() : _eng(seed), _rng(0.0f, box_size, &_eng) {}
+
+    kdp_t random_point(int pad) {
+        kdp_t p;
+        _rng(p.pos().begin(), p.pos().end());
+        p.fill_pad(pad);
+        return p;
+    }
+
+    /**
+    Insert ``n_insert`` points and remove ``n_remove`` randomly chosen ones,
+    interleaved, recording the live points in ``live``.
+    */
+    void fill(tree_t &tree, int n_insert, int n_remove) {
+        idx_rng_t coin(0, 3, &_eng);
+        int n_ins = 0, n_rm = 0;
+        while( n_ins < n_insert || n_rm < n_remove ) {
+            const bool do_rm = n_rm < n_remove && !live.empty()
+                && (n_ins == n_insert || coin() == 0);
+            if( do_rm ) {
+                idx_rng_t pick(0, int(live.size())-1, &_eng);
+                auto it = std::next(live.begin(), pick());
+                tree.remove(it->first);
+                live.erase(it);
+                ++n_rm;
+            } else {
+                auto p = random_point(n_ins);
+                const int id = tree.insert(p);
+                ASSERT_EQ(live.count(id), 0);
+                live[id] = p;
+                ++n_ins;
+            }
+        }
+    }
+
+    float_t r_sq_of(const pos_t &p, const pos_t &q,
+        const tree_t::periodic_box_t &box) const
+    {
+        return box.is_periodic() ? box.r_sq(p, q)
+            : float_t((p - q).squared_norm());
+    }
+
+    void check_queries(const tree_t &tree) {
+        ASSERT_EQ(tree.size(), int(live.size()));
+        for(auto &[id, p]: live) {
+            ASSERT_TRUE(tree.contains(id));
+            EXPECT_EQ(tree.point(id).pad<int>(), p.pad<int>());
+        }
+        const auto &box = tree.construct_policy().periodic_box();
+        tree_t::query_policy_t pl;
+        const int k = 10;
+        // Periodic distances are computed from the images of the query.
+        const float_t tol = 1.0e-3f;
+        for(int i=0; i<50; ++i) {
+            auto q = random_point(-1);
+            vector<std::pair<float_t, int> > ref;
+            for(auto &[id, p]: live)
+                ref.emplace_back(r_sq_of(p.pos(), q.pos(), box), id);
+            std::sort(ref.begin(), ref.end());
+
+            auto ngb = tree.nearest(q, pl);
+            if( ref.empty() ) {
+                EXPECT_EQ(ngb.id, tree_t::idxNULL);
+            } else {
+                EXPECT_NEAR(ngb.r_sq, ref[0].first, tol);
+            }
+
+            vector<ngb_t> ngbs(k);
+            const int n = tree.nearest_k(q, ngbs, pl);
+            ASSERT_EQ(n, std::min<int>(k, ref.size()));
+            for(int j=0; j<n; ++j) {
+                EXPECT_NEAR(ngbs[j].r_sq, ref[j].first, tol);
+                ASSERT_EQ(live.count(ngbs[j].id), 1);
+                EXPECT_NEAR(ngbs[j].r_sq,
+                    r_sq_of(live[ngbs[j].id].pos(), q.pos(), box), tol);
+            }
+
+            const sphere_t s(q, 10.0f);
+            vector<int> got, want;
+            tree.visit_sphere(s, [&](int id) { got.push_back(id); }, pl);
+            for(auto &[r_sq, id]: ref)
+                if( r_sq < 100.0f ) want.push_back(id);
+            std::sort(got.begin(), got.end());
+            std::sort(want.begin(), want.end());
+            EXPECT_THAT(got, gt::ContainerEq(want));
+            EXPECT_EQ(tree.count_sphere(s, pl), int(want.size()));
+
+            if( box.is_periodic() ) continue;
+            const rect_t r(q, point_t(q.pos() + 15.0f));
+            int n_in = 0;
+            for(auto &[id, p]: live) if( r.contains(p) ) ++n_in;
+            EXPECT_EQ(tree.count_rect(r, pl), n_in);
+        }
+    }
+
+    using point_t = tree_t::point_t;
+
+    inline static const rng_t::seed_t seed = 0;
+    inline static const float box_size = 100.0;
+
+    rng_t::engine_t _eng;
+    rng_t _rng;
+    std::map<int, kdp_t> live;
+};
+
+TEST_F(DynamicKDTreeTest, Empty) {
+    tree_t tree;
+    EXPECT_EQ(tree.size(), 0);
+    EXPECT_EQ(tree.n_blocks(), 0);
+    check_queries(tree);
+    EXPECT_FALSE(tree.contains(0));
+    EXPECT_THROW(tree.remove(0), ErrLogic);
+}
+
+TEST_F(DynamicKDTreeTest, InsertOnly) {
+    tree_t tree(tree_t::construct_policy_t(), 16);
+    fill(tree, 3000, 0);
+    EXPECT_EQ(tree.n_dead(), 0);
+    // The blocks follow the binary representation of the no. of merges.
+    EXPECT_LE(tree.n_blocks(), 8);
+    check_queries(tree);
+}
+
+TEST_F(DynamicKDTreeTest, InsertRemove) {
+    for(int leaf_size: {1, 8}) {
+        live.clear();
+        tree_t tree(tree_t::construct_policy_t().set_leaf_size(leaf_size),
+            32);
+        fill(tree, 4000, 2500);
+        // A block is rebuilt before half of it is dead.
+        EXPECT_LE(tree.n_dead()*2, tree.size() + tree.n_dead());
+        check_queries(tree);
+
+        fill(tree, 500, 1000);
+        check_queries(tree);
+
+        tree.compact();
+        EXPECT_EQ(tree.n_dead(), 0);
+        EXPECT_LE(tree.n_blocks(), 1);
+        check_queries(tree);
+
+        // Removed ids are reused.
+        const int id = live.begin()->first;
+        tree.remove(id);
+        live.erase(id);
+        EXPECT_FALSE(tree.contains(id));
+        EXPECT_THROW(tree.remove(id), ErrLogic);
+        auto p = random_point(-2);
+        EXPECT_EQ(tree.insert(p), id);
+        live[id] = p;
+        check_queries(tree);
+    }
+}
+
+TEST_F(DynamicKDTreeTest, RemoveAll) {
+    tree_t tree(tree_t::construct_policy_t(), 8);
+    fill(tree, 1000, 1000);
+    EXPECT_EQ(tree.size(), 0);
+    check_queries(tree);
+    fill(tree, 100, 0);
+    check_queries(tree);
+    tree.clear();
+    live.clear();
+    check_queries(tree);
+}
+
+TEST_F(DynamicKDTreeTest, Periodic) {
+    tree_t tree(tree_t::construct_policy_t().set_periodic_box(box_size), 16);
+    fill(tree, 2000, 800);
+    check_queries(tree);
+}
+
+} // namespace
+
+} // namespace HIPP::NUMERICAL
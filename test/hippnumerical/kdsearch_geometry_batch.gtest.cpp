@@ -0,0 +1,224 @@
+#include <hippnumerical.h>
+#include <gmock/gmock.h>
+
+namespace HIPP::NUMERICAL {
+
+namespace {
+
+namespace gt = ::testing;
+
+template<typename PointT>
+class GeometryBatchTestBase {
+public:
+    using batch_t = GeometryBatch<PointT>;
+    using point_t = PointT;
+    using float_t = typename batch_t::float_t;
+    using pos_t = typename batch_t::pos_t;
+    using rect_t = typename batch_t::rect_t;
+    using sphere_t = typename batch_t::sphere_t;
+    using mask_t = typename batch_t::mask_t;
+    using pl_t = typename batch_t::policy_t;
+    using geo_point_t = GEOMETRY::Point<float_t, batch_t::DIM>;
+
+    static constexpr int DIM = batch_t::DIM;
+
+    using rng_t = UniformRealRandomNumber<double>;
+
+    inline static const rng_t::seed_t seed = 0;
+    inline static const float_t box_size = 100.0;
+
+    GeometryBatchTestBase() : _eng(seed), _rng(0., box_size, &_eng) {}
+
+    pos_t random_pos() {
+        pos_t p;
+        for(auto &x: p) x = float_t(_rng());
+        return p;
+    }
+
+    /**
+    ``n`` random points, kept in both AoS and SoA. The points on the grid of
+    ``box_size/10`` are included, which fall on the boundaries of the test
+    regions.
+    */
+    void fill(int n) {
+        pts.clear();
+        for(auto &x: xs) x.clear();
+        for(int i=0; i<n; ++i) {
+            pos_t p = random_pos();
+            if( i % 7 == 0 )
+                for(auto &x: p) x = std::round(x / 10) * 10;
+            pts.emplace_back(p);
+            for(int k=0; k<DIM; ++k) xs[k].push_back(p[k]);
+        }
+    }
+
+    typename batch_t::points_t soa() const {
+        const float_t *ps[DIM];
+        for(int k=0; k<DIM; ++k) ps[k] = xs[k].data();
+        return {ps, pts.size()};
+    }
+
+    vector<rect_t> rects() {
+        return {
+            rect_t{pos_t(float_t(20)), pos_t(float_t(60))},
+            rect_t{pos_t(float_t(-10)), pos_t(float_t(200))},
+            rect_t{pos_t(float_t(50)), pos_t(float_t(40))},
+            rect_t{random_pos(), random_pos() + float_t(30)},
+        };
+    }
+
+    vector<sphere_t> spheres() {
+        return {
+            sphere_t{geo_point_t(pos_t(float_t(50))), float_t(30)},
+            sphere_t{geo_point_t(pos_t(float_t(0))), float_t(0)},
+            sphere_t{geo_point_t(random_pos()), float_t(25)},
+        };
+    }
+
+    /**
+    Check all the tests of ``region`` against the per-object ``contains()``,
+    for AoS and SoA and a number of threads.
+    */
+    template<typename Region>
+    void check_region(const Region &region, int n_threads) {
+        const size_t n = pts.size();
+        vector<mask_t> mask_ref(n);
+        vector<int> ids_ref;
+        for(size_t i=0; i<n; ++i) {
+            mask_ref[i] = region.contains(pts[i]);
+            if( mask_ref[i] ) ids_ref.push_back(int(i));
+        }
+
+        batch_t batch(pl_t().set_n_threads(n_threads));
+        for(int is_soa=0; is_soa<2; ++is_soa) {
+            auto view = is_soa ? soa() : typename batch_t::points_t(pts);
+            vector<mask_t> mask;
+            vector<int> ids {-1};
+            batch.contains(view, region, mask);
+            batch.select(view, region, ids);
+            EXPECT_EQ(mask, mask_ref) << "SoA " << is_soa;
+            EXPECT_EQ(ids, ids_ref) << "SoA " << is_soa;
+            EXPECT_EQ(batch.count(view, region), int(ids_ref.size()));
+        }
+    }
+
+    vector<point_t> pts;
+    vector<float_t> xs[DIM];
+    rng_t::engine_t _eng;
+    rng_t _rng;
+};
+
+class GeometryBatchTest : public gt::Test,
+    public GeometryBatchTestBase<KDPoint<float, 3, sizeof(int)> > {};
+
+class GeometryBatchDoubleTest : public gt::Test,
+    public GeometryBatchTestBase<GEOMETRY::Point<double, 2> > {};
+
+TEST_F(GeometryBatchTest, Contains) {
+    fill(10003);
+    for(int n_threads: {1, 4}) {
+        for(auto &rect: rects()) check_region(rect, n_threads);
+        for(auto &sphere: spheres()) check_region(sphere, n_threads);
+    }
+}
+
+TEST_F(GeometryBatchDoubleTest, Contains) {
+    fill(5001);
+    for(int n_threads: {1, 3}) {
+        for(auto &rect: rects()) check_region(rect, n_threads);
+        for(auto &sphere: spheres()) check_region(sphere, n_threads);
+    }
+}
+
+TEST_F(GeometryBatchTest, Distances) {
+    fill(2000);
+    batch_t batch(pl_t().set_n_threads(3));
+    const pos_t pos = random_pos();
+    const rect_t rect {pos_t(float_t(20)), pos_t(float_t(60))};
+    for(int is_soa=0; is_soa<2; ++is_soa) {
+        auto view = is_soa ? soa() : batch_t::points_t(pts);
+        vector<float_t> r_sq;
+        batch.dist_sq_to(view, pos, r_sq);
+        ASSERT_EQ(r_sq.size(), pts.size());
+        for(size_t i=0; i<pts.size(); ++i)
+            EXPECT_EQ(r_sq[i], (pts[i] - geo_point_t(pos)).r_sq());
+
+        batch.dist_sq_to(view, rect, r_sq);
+        ASSERT_EQ(r_sq.size(), pts.size());
+        for(size_t i=0; i<pts.size(); ++i) {
+            double d_sq = 0.;
+            for(int k=0; k<DIM; ++k) {
+                const double x = pts[i].pos()[k],
+                    d = std::max({20. - x, 0., x - 60.});
+                d_sq += d * d;
+            }
+            EXPECT_FLOAT_EQ(r_sq[i], d_sq);
+            if( rect.contains(pts[i]) ){
+                EXPECT_EQ(r_sq[i], 0.f);
+            }
+        }
+    }
+}
+
+TEST_F(GeometryBatchTest, Intersects) {
+    fill(3000);
+    vector<float_t> radii;
+    for(size_t i=0; i<pts.size(); ++i) radii.push_back(float_t(i % 13));
+
+    batch_t batch(pl_t().set_n_threads(2));
+    const rect_t rect {pos_t(float_t(20)), pos_t(float_t(60))};
+    const sphere_t sphere {geo_point_t(pos_t(float_t(50))), float_t(20)};
+    for(int is_soa=0; is_soa<2; ++is_soa) {
+        auto view = is_soa ? soa() : batch_t::points_t(pts);
+        vector<mask_t> mask_r, mask_s;
+        batch.intersects(view, radii, rect, mask_r);
+        batch.intersects(view, radii, sphere, mask_s);
+        vector<float_t> d_r, d_s;
+        batch.dist_sq_to(view, rect, d_r);
+        batch.dist_sq_to(view, sphere.center().pos(), d_s);
+        int n_r = 0, n_s = 0;
+        for(size_t i=0; i<pts.size(); ++i) {
+            const float_t r = radii[i], r_s = r + sphere.r();
+            EXPECT_EQ(mask_r[i], d_r[i] < r * r);
+            EXPECT_EQ(mask_s[i], d_s[i] < r_s * r_s);
+            n_r += mask_r[i];
+            n_s += mask_s[i];
+            // A sphere intersects the region if its center is inside.
+            if( rect.contains(pts[i]) && r > 0 ){
+                EXPECT_TRUE(mask_r[i]);
+            }
+            if( sphere.contains(pts[i]) ){
+                EXPECT_TRUE(mask_s[i]);
+            }
+        }
+        EXPECT_GT(n_r, batch.count(view, rect));
+        EXPECT_GT(n_s, batch.count(view, sphere));
+    }
+
+    vector<mask_t> mask;
+    EXPECT_THROW(batch.intersects(pts,
+        ContiguousBuffer<const float_t>(radii.data(), 10), rect, mask),
+        ErrLogic);
+}
+
+TEST_F(GeometryBatchTest, Edges) {
+    pts.clear();
+    batch_t batch(pl_t().set_n_threads(4));
+    const rect_t rect {pos_t(float_t(20)), pos_t(float_t(60))};
+    vector<mask_t> mask {1};
+    vector<int> ids {1};
+    vector<float_t> r_sq {1.f};
+    batch.contains(pts, rect, mask);
+    batch.select(pts, rect, ids);
+    batch.dist_sq_to(pts, rect, r_sq);
+    EXPECT_TRUE(mask.empty());
+    EXPECT_TRUE(ids.empty());
+    EXPECT_TRUE(r_sq.empty());
+    EXPECT_EQ(batch.count(pts, rect), 0);
+
+    EXPECT_THROW(batch_t(pl_t().set_n_threads(0)), ErrLogic);
+}
+
+} // namespace
+
+} // namespace HIPP::NUMERICAL
@@ -0,0 +1,101 @@
+/**
+In-memory stand-in for ``IO::H5::Group``, for testing the ``save_h5()`` and
+``load_h5()`` of the space-searching structures without the hippio module.
+
+Only the subset used by ``_KDSEARCH::_H5Archive`` is provided. Copies of a
+group refer to the same datasets, as the handles of HDF5 do.
+*/
+
+#ifndef _HIPPNUMERICAL_TEST_KDSEARCH_H5_MOCK_H_
+#define _HIPPNUMERICAL_TEST_KDSEARCH_H5_MOCK_H_
+
+#include <hippnumerical.h>
+#include <map>
+#include <memory>
+
+namespace HIPP::NUMERICAL::TEST {
+
+class MockH5Group {
+public:
+    using hsize_t = unsigned long long;
+
+    class Dims {
+    public:
+        Dims(std::initializer_list<hsize_t> dims) : _dims(dims) {}
+        size_t ndims() const noexcept { return _dims.size(); }
+        hsize_t operator[](size_t i) const noexcept { return _dims[i]; }
+        hsize_t n_elems() const noexcept {
+            hsize_t n = 1;
+            for(auto d: _dims) n *= d;
+            return n;
+        }
+        friend ostream & operator<<(ostream &os, const Dims &dims) {
+            os << '{';
+            for(size_t i=0; i<dims.ndims(); ++i)
+                os << (i ? ", " : "") << dims[i];
+            return os << '}';
+        }
+    private:
+        vector<hsize_t> _dims;
+    };
+
+    class Dataspace {
+    public:
+        explicit Dataspace(Dims dims) : _dims(std::move(dims)) {}
+        const Dims & dims() const noexcept { return _dims; }
+    private:
+        Dims _dims;
+    };
+
+    struct Datatype {};
+
+    struct store_t {
+        Dims dims;
+        vector<unsigned char> bytes;
+    };
+
+    class Dataset {
+    public:
+        explicit Dataset(store_t &s) : _s(&s) {}
+        Dataspace dataspace() const { return Dataspace(_s->dims); }
+        Datatype datatype() const noexcept { return {}; }
+        void write(const void *p, const Datatype &) {
+            auto b = static_cast<const unsigned char *>(p);
+            _s->bytes.assign(b, b + _s->dims.n_elems());
+        }
+        void read(void *p, const Datatype &) const {
+            std::copy(_s->bytes.begin(), _s->bytes.end(),
+                static_cast<unsigned char *>(p));
+        }
+    private:
+        store_t *_s;
+    };
+
+    MockH5Group() : _dsets(std::make_shared<std::map<string, store_t> >()) {}
+
+    template<typename T>
+    Dataset create_dataset(const string &name, const Dims &dims) {
+        static_assert(sizeof(T) == 1, "only byte datasets are mocked");
+        auto [it, inserted] = _dsets->emplace(name, store_t{dims, {}});
+        if( !inserted )
+            ErrRuntime::throw_(ErrRuntime::eDEFAULT, emFLPFB,
+                "  ... dataset ", name, " exists\n");
+        return Dataset(it->second);
+    }
+
+    Dataset open_dataset(const string &name) const {
+        auto it = _dsets->find(name);
+        if( it == _dsets->end() )
+            ErrRuntime::throw_(ErrRuntime::eDEFAULT, emFLPFB,
+                "  ... dataset ", name, " not found\n");
+        return Dataset(it->second);
+    }
+
+    size_t n_datasets() const noexcept { return _dsets->size(); }
+private:
+    std::shared_ptr<std::map<string, store_t> > _dsets;
+};
+
+} // namespace HIPP::NUMERICAL::TEST
+
+#endif	//_HIPPNUMERICAL_TEST_KDSEARCH_H5_MOCK_H_
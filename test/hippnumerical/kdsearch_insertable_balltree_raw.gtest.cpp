@@ -1,5 +1,6 @@
 #include <hippnumerical.h>
 #include <gmock/gmock.h>
+#include <numeric>
 
 namespace HIPP::NUMERICAL {
 
@@ -517,6 +518,72 @@ TEST_F(InsertableBallTreeRawIntPaddingTest,
     pout << "Volume after refinement = ", ballt.volume(), endl;
 }
 
+TEST_F(InsertableBallTreeRawIntPaddingTest, InsertBatch) {
+    using bpl_t = balltree_t::batch_insert_policy_t;
+    using fav_t = bpl_t::insert_favor_t;
+
+    // Check the links and the bounds. Return the sorted pads of the leaves.
+    auto check = [](const balltree_t &ballt) {
+        const auto &nds = ballt.nodes();
+        vector<int> pads;
+        ballt.preorder_traverse([&](index_t i) {
+            const auto &n = nds[i];
+            if( n.is_leaf() ) {
+                pads.push_back(n.pad<int>());
+                return;
+            }
+            EXPECT_TRUE(n.is_internal());
+            for(index_t i_c: {n.left_child_idx(), n.right_child_idx()}) {
+                const auto &n_c = nds[i_c];
+                EXPECT_EQ(n_c.parent_idx(), i);
+                const float d = (n_c.center() - n.center()).r() + n_c.r();
+                EXPECT_LE(d, n.r() * 1.0001f + 1.0e-5f);
+            }
+        });
+        std::sort(pads.begin(), pads.end());
+        return pads;
+    };
+    auto batch_of = [](int b, int e) {
+        vector<kdp_t> pts(e-b);
+        for(int i=b; i<e; ++i) {
+            auto &p = pts[i-b];
+            rand(p.pos().begin(), p.pos().end());
+            p.fill_pad(i);
+        }
+        return pts;
+    };
+
+    const vector<int> ends {2000, 2001, 2003, 5000};
+    for(auto fav: {fav_t::ROUGH, fav_t::FINE})
+    for(int n_threads: {1, 3}) {
+        balltree_t ballt;
+        ballt.insert_batch({});
+        ASSERT_TRUE(ballt.empty());
+        bpl_t pl(fav);
+        pl.set_n_threads(n_threads);
+        int b = 0;
+        for(int e: ends) {
+            const auto pts = batch_of(b, e);
+            ballt.insert_batch(pts, pl);
+            ASSERT_EQ(ballt.size(), e);
+            vector<int> pads(e);
+            std::iota(pads.begin(), pads.end(), 0);
+            EXPECT_THAT(check(ballt), gt::ContainerEq(pads));
+            b = e;
+        }
+        ASSERT_TRUE(pl.fringe().empty());
+
+        balltree_t ballt_one;
+        for(auto &p: batch_of(0, ends.back())) ballt_one.insert(p, pl);
+        pout << "Volume after batch insertion = ", ballt.volume(), 
+            ", one by one = ", ballt_one.volume(), endl;
+    }
+
+    balltree_t ballt;
+    const auto pts = batch_of(0, 10);
+    EXPECT_THROW(ballt.insert_batch(pts, bpl_t().set_n_threads(0)), ErrLogic);
+}
+
 class InsertableBallTreeLargePaddingTest : public gt::Test {
 public:
     using kdp_t = KDPoint<float, 3, 1024>;
@@ -1,5 +1,8 @@
 #include <hippnumerical.h>
 #include <gmock/gmock.h>
+#include "kdsearch_h5_mock.h"
+#include <map>
+#include <set>
 
 namespace HIPP::NUMERICAL {
 
@@ -157,6 +160,92 @@ TEST_F(KDMeshTest, Clear) {
     EXPECT_EQ(kdm.nodes().capacity(), _kdpts2.size());
 }
 
+TEST_F(KDMeshTest, SaveLoad) {
+    using cstr_pl_t = kdm_t::construct_policy_t;
+    const string file_name = gt::TempDir() + "kdsearch_kdmesh_save_load.bin";
+    
+    cstr_pl_t pl;
+    pl.set_n_cell({8, 16, 4}).set_in_cell_sort(
+        cstr_pl_t::in_cell_sort_t::ALONG_AXIS).set_dim_sorted(1)
+        .set_periodic_box({box_size, 0.f, 0.f})
+        .set_cell_order(cstr_pl_t::cell_order_t::MORTON);
+    kdm_t kdm(_kdpts1, pl);
+    kdm.save(file_name);
+
+    kdm_t kdm_in;
+    kdm_in.load(file_name);
+    const auto &m1 = kdm.mesh(), &m2 = kdm_in.mesh();
+    EXPECT_TRUE( (m1.low().pos() == m2.low().pos()).all() );
+    EXPECT_TRUE( (m1.high().pos() == m2.high().pos()).all() );
+    EXPECT_TRUE( (m1.n_cell() == m2.n_cell()).all() );
+    EXPECT_EQ(kdm_in.construct_policy().in_cell_sort(), 
+        cstr_pl_t::in_cell_sort_t::ALONG_AXIS);
+    EXPECT_EQ(kdm_in.construct_policy().dim_sorted(), 1);
+    EXPECT_EQ(kdm_in.construct_policy().cell_order(), 
+        cstr_pl_t::cell_order_t::MORTON);
+    EXPECT_TRUE( (kdm_in.construct_policy().periodic_box().size() 
+        == kdm_t::pos_t{box_size, 0.f, 0.f}).all() );
+    
+    ASSERT_EQ(kdm_in.nodes().size(), kdm.nodes().size());
+    for(size_t i=0; i<kdm.nodes().size(); ++i){
+        const auto &n1 = kdm.nodes()[i], &n2 = kdm_in.nodes()[i];
+        ASSERT_TRUE( (n1.pos() == n2.pos()).all() );
+        ASSERT_EQ(n1.pad<int>(), n2.pad<int>());
+    }
+    for(index_t i=0; i<m1.total_n_cell(); ++i){
+        auto [p1, n1] = kdm.get_nodes_in_cell(i);
+        auto [p2, n2] = kdm_in.get_nodes_in_cell(i);
+        ASSERT_EQ(n1, n2);
+        ASSERT_EQ(p1 - kdm.nodes().data(), p2 - kdm_in.nodes().data());
+    }
+    for(int i=0; i<100; ++i){
+        kdm_t::sphere_t s {_kdpts2[i].pos(), 5.0f};
+        EXPECT_EQ(kdm.count_nodes_sphere(s), kdm_in.count_nodes_sphere(s));
+    }
+
+    KDMesh<KDPoint<float, 2, sizeof(int)>, int> kdm_2d;
+    EXPECT_THROW(kdm_2d.load(file_name), ErrRuntime);
+    std::remove(file_name.c_str());
+}
+
+TEST_F(KDMeshTest, SaveLoadH5) {
+    using cstr_pl_t = kdm_t::construct_policy_t;
+    
+    cstr_pl_t pl;
+    pl.set_n_cell({8, 16, 4}).set_in_cell_sort(
+        cstr_pl_t::in_cell_sort_t::ALONG_AXIS).set_dim_sorted(1)
+        .set_periodic_box({box_size, 0.f, 0.f})
+        .set_cell_order(cstr_pl_t::cell_order_t::MORTON);
+    kdm_t kdm(_kdpts1, pl);
+    TEST::MockH5Group g;
+    kdm.save_h5(g);
+
+    kdm_t kdm_in;
+    kdm_in.load_h5(g);
+    const auto &m1 = kdm.mesh(), &m2 = kdm_in.mesh();
+    EXPECT_TRUE( (m1.low().pos() == m2.low().pos()).all() );
+    EXPECT_TRUE( (m1.high().pos() == m2.high().pos()).all() );
+    EXPECT_TRUE( (m1.n_cell() == m2.n_cell()).all() );
+    EXPECT_EQ(kdm_in.construct_policy().cell_order(), 
+        cstr_pl_t::cell_order_t::MORTON);
+    EXPECT_TRUE( (kdm_in.construct_policy().periodic_box().size() 
+        == kdm_t::pos_t{box_size, 0.f, 0.f}).all() );
+    
+    ASSERT_EQ(kdm_in.nodes().size(), kdm.nodes().size());
+    for(size_t i=0; i<kdm.nodes().size(); ++i){
+        const auto &n1 = kdm.nodes()[i], &n2 = kdm_in.nodes()[i];
+        ASSERT_TRUE( (n1.pos() == n2.pos()).all() );
+        ASSERT_EQ(n1.pad<int>(), n2.pad<int>());
+    }
+    for(int i=0; i<100; ++i){
+        kdm_t::sphere_t s {_kdpts2[i].pos(), 5.0f};
+        EXPECT_EQ(kdm.count_nodes_sphere(s), kdm_in.count_nodes_sphere(s));
+    }
+
+    KDMesh<KDPoint<float, 2, sizeof(int)>, int> kdm_2d;
+    EXPECT_THROW(kdm_2d.load_h5(g), ErrRuntime);
+}
+
 TEST_F(KDMeshTest, QueryNodesInCell) {
     kdm_t kdm(_kdpts1);
     auto &nodes = kdm.nodes();
@@ -173,6 +262,58 @@ TEST_F(KDMeshTest, QueryNodesInCell) {
     EXPECT_EQ(cnt_nodes, nodes.size());
 }
 
+TEST_F(KDMeshTest, CellOrderAndThreads) {
+    using cstr_pl_t = kdm_t::construct_policy_t;
+    using order_t = cstr_pl_t::cell_order_t;
+    cstr_pl_t pl0;
+    pl0.set_n_cell({8, 16, 5});
+    kdm_t kdm0(_kdpts1, pl0);
+
+    for(auto order: {order_t::ROW_MAJOR, order_t::MORTON})
+    for(int n_threads: {1, 3}) {
+        auto pl = pl0;
+        pl.set_cell_order(order).set_n_threads(n_threads);
+        kdm_t kdm(_kdpts1, pl);
+        ASSERT_EQ(kdm.nodes().size(), kdm0.nodes().size());
+
+        /* Same cell contents, in the input order. Ranks are a permutation. */
+        const index_t tot_n_cell = kdm.mesh().total_n_cell();
+        vector<index_t> ranks;
+        for(index_t i=0; i<tot_n_cell; ++i){
+            auto [p1, n1] = kdm0.get_nodes_in_cell(i);
+            auto [p2, n2] = kdm.get_nodes_in_cell(i);
+            ASSERT_EQ(n1, n2);
+            for(index_t j=0; j<n1; ++j)
+                ASSERT_EQ(p1[j].pad<int>(), p2[j].pad<int>());
+            ranks.push_back(kdm.cell_rank(i));
+        }
+        std::sort(ranks.begin(), ranks.end());
+        for(index_t i=0; i<tot_n_cell; ++i) ASSERT_EQ(ranks[i], i);
+
+        /* Morton order: the 2x2x2 blocks of cells are contiguous. */
+        if( order == order_t::MORTON ) {
+            EXPECT_EQ(kdm.cell_rank(kdm.mesh().v_idx2idx({1,1,1})), 7);
+            EXPECT_EQ(kdm.cell_rank(kdm.mesh().v_idx2idx({0,0,2})), 8);
+        }
+
+        vector<kdm_t::idx_pair_t> prs;
+        kdm.argsort<kdp_t>(_kdpts2, prs);
+        for(size_t i=1; i<prs.size(); ++i)
+            EXPECT_LE(kdm.cell_rank(prs[i-1].idx_cell), 
+                kdm.cell_rank(prs[i].idx_cell));
+
+        for(int i=0; i<200; ++i){
+            kdm_t::sphere_t s {_kdpts2[i].pos(), 6.0f};
+            EXPECT_EQ(kdm.count_nodes_sphere(s), kdm0.count_nodes_sphere(s));
+            const auto &q = _kdpts2[i].pos();
+            kdm_t::rect_t r {q, q + 8.0f};
+            EXPECT_EQ(kdm.count_nodes_rect(r), kdm0.count_nodes_rect(r));
+        }
+    }
+
+    EXPECT_THROW(kdm_t(_kdpts1, cstr_pl_t().set_n_threads(0)), ErrLogic);
+}
+
 TEST_F(KDMeshTest, VisitRectCompleteCheck) {
     kdm_t kdm(_kdpts1);
     kdp_t::point_t p = {50.0f, 50.0f, 50.0f};
@@ -457,6 +598,402 @@ TEST_F(KDMeshTest, VisitSphereNodes) {
     }
 }
 
+TEST_F(KDMeshTest, BatchQuery) {
+    using bpl_t = kdm_t::batch_query_policy_t;
+    kdm_t kdm(_kdpts1);
+    const int n_dst = 2000;
+    vector<kdm_t::sphere_t> spheres;
+    for(int i=0; i<n_dst; ++i)
+        spheres.emplace_back(_kdpts2[i], 1.0f + (i % 5));
+    // A sphere centered outside the mesh.
+    spheres.emplace_back(kdm_t::point_t{-10.f, -10.f, -10.f}, 25.0f);
+
+    vector<bpl_t> bpls(4);
+    bpls[1].set_n_threads(3);
+    bpls[2].sort_queries_on();
+    bpls[3].set_n_threads(4).sort_queries_on();
+    const auto &nds = kdm.nodes();
+    for(auto &bpl: bpls){
+        vector<index_t> displs, node_ids, counts;
+        kdm.find_nodes_sphere_batch(spheres, displs, node_ids, bpl);
+        kdm.count_nodes_sphere_batch(spheres, counts, bpl);
+        ASSERT_EQ(displs.size(), spheres.size()+1);
+        ASSERT_EQ(counts.size(), spheres.size());
+        for(size_t i=0; i<spheres.size(); ++i){
+            const auto &s = spheres[i];
+            vector<int> pads, pads_dst;
+            for(index_t j=displs[i]; j<displs[i+1]; ++j)
+                pads.push_back(nds[node_ids[j]].pad<int>());
+            kdm.visit_nodes_sphere(s, [&pads_dst](const kdm_t::node_t &n){
+                pads_dst.push_back(n.pad<int>()); });
+            EXPECT_THAT(pads, gt::UnorderedElementsAreArray(pads_dst));
+            EXPECT_EQ(counts[i], kdm.count_nodes_sphere(s));
+        }
+        EXPECT_GT(counts.back(), 0);
+    }
+}
+
+TEST_F(KDMeshTest, StencilQuery) {
+    using cstr_pl_t = kdm_t::construct_policy_t;
+    using order_t = cstr_pl_t::cell_order_t;
+    vector<kdm_t::point_t> qs;
+    for(int i=0; i<2000; ++i) qs.push_back(_kdpts2[i]);
+    qs.push_back(kdm_t::point_t{-3.0f, 50.0f, 50.0f});      // out of mesh
+    qs.push_back(kdm_t::point_t{50.0f, 103.0f, 50.0f});
+
+    auto pl_periodic = cstr_pl_t().set_n_cell(16).set_periodic_box(box_size);
+    for(auto pl: {cstr_pl_t().set_n_cell(20), 
+        cstr_pl_t().set_n_cell(20).set_cell_order(order_t::MORTON),
+        pl_periodic})
+    for(float r: {0.5f, 3.0f, 7.5f}) {
+        kdm_t kdm(_kdpts1, pl);
+        auto st = kdm.stencil(r);
+        EXPECT_FLOAT_EQ(st.r(), r);
+        ASSERT_GT(st.size(), 0);
+        for(size_t i=0; i<st.size(); ++i)
+            EXPECT_LE(st.r_sq_min(i), r*r);
+        
+        kdm_t::batch_query_policy_t bpl;
+        bpl.set_n_threads(3);
+        vector<index_t> cnts, displs, ids;
+        kdm.count_nodes_stencil_batch(st, qs, cnts, bpl);
+        kdm.find_nodes_stencil_batch(st, qs, displs, ids, bpl);
+        ASSERT_EQ(cnts.size(), qs.size());
+        ASSERT_EQ(displs.size(), qs.size()+1);
+
+        for(size_t i=0; i<qs.size(); ++i){
+            kdm_t::sphere_t s(qs[i], r);
+            const index_t cnt = kdm.count_nodes_sphere(s);
+            EXPECT_EQ(kdm.count_nodes_stencil(st, qs[i]), cnt);
+            EXPECT_EQ(cnts[i], cnt);
+
+            vector<int> pads, pads_st, pads_batch;
+            kdm.visit_nodes_sphere(s, [&](const kdm_t::node_t &n){ 
+                pads.push_back(n.pad<int>()); });
+            kdm.visit_nodes_stencil(st, qs[i], [&](const kdm_t::node_t &n){
+                pads_st.push_back(n.pad<int>()); });
+            for(index_t j=displs[i]; j<displs[i+1]; ++j)
+                pads_batch.push_back(kdm.nodes()[ids[j]].pad<int>());
+            EXPECT_THAT(pads_st, gt::UnorderedElementsAreArray(pads));
+            EXPECT_THAT(pads_batch, gt::UnorderedElementsAreArray(pads));
+        }
+    }
+    
+    /* Stencil wider than the periodic mesh - falls back to sphere query. */
+    {
+        kdm_t kdm(_kdpts1, cstr_pl_t().set_n_cell(4)
+            .set_periodic_box(box_size));
+        auto st = kdm.stencil(30.0f);
+        vector<index_t> cnts;
+        kdm.count_nodes_stencil_batch(st, {qs.data(), 20}, cnts);
+        for(int i=0; i<20; ++i)
+            EXPECT_EQ(cnts[i], kdm.count_nodes_sphere({qs[i], 30.0f}));
+    }
+
+    kdm_t kdm1(_kdpts1), kdm2(_kdpts1, cstr_pl_t().set_n_cell(7));
+    auto st = kdm1.stencil(2.0f);
+    EXPECT_THROW(kdm2.count_nodes_stencil(st, qs[0]), ErrLogic);
+    EXPECT_THROW(kdm1.stencil(-1.0f), ErrLogic);
+}
+
+TEST_F(KDMeshTest, FoF) {
+    using cstr_pl_t = kdm_t::construct_policy_t;
+    using order_t = cstr_pl_t::cell_order_t;
+    using fpl_t = kdm_t::fof_policy_t;
+    using kdt_t = KDTree<kdp_t, int>;
+    using pos_t = kdm_t::pos_t;
+    const int n = 20000;
+    vector<kdp_t> pts(_kdpts1.begin(), _kdpts1.begin()+n);
+
+    // Group ids indexed by the points, relabeled in the order of the first 
+    // points of the groups.
+    auto by_point = [&](const auto &nodes, const vector<index_t> &ids) {
+        vector<index_t> out(n, -1);
+        std::map<index_t, index_t> relabel;
+        for(int i=0; i<n; ++i) 
+            out[nodes[i].template pad<int>()] = ids[i];
+        for(auto &id: out) 
+            if( id >= 0 ) id = relabel.emplace(id, relabel.size()).first->second;
+        return out;
+    };
+
+    const pos_t no_box(0.f), box_xz {box_size, 0.f, box_size};
+    struct case_t { cstr_pl_t pl; pos_t box; float b; };
+    const vector<case_t> cases {
+        {cstr_pl_t().set_n_cell(20), no_box, 0.f},
+        {cstr_pl_t().set_n_cell(20), no_box, 1.5f},
+        {cstr_pl_t().set_n_cell(40), no_box, 4.f},
+        {cstr_pl_t().set_n_cell(20).set_cell_order(order_t::MORTON), 
+            no_box, 4.f},
+        {cstr_pl_t().set_n_cell(16).set_periodic_box(box_size), 
+            pos_t(box_size), 4.f},
+        {cstr_pl_t().set_n_cell(16).set_periodic_box(box_xz), box_xz, 3.f},
+        // Stencil wider than the periodic mesh.
+        {cstr_pl_t().set_n_cell(4).set_periodic_box(box_size), 
+            pos_t(box_size), 30.f},
+    };
+    for(auto &c: cases) {
+        kdm_t kdm(pts, c.pl);
+        kdt_t kdt(pts, kdt_t::construct_policy_t().set_periodic_box(c.box));
+        for(index_t min_size: {1, 4}) {
+            vector<index_t> ids_t, ids_m;
+            const index_t n_t = kdt.fof(c.b, ids_t, 
+                fpl_t().set_min_size(min_size));
+            const auto ref = by_point(kdt.nodes(), ids_t);
+            for(int n_threads: {1, 3}) {
+                const index_t n_m = kdm.fof(c.b, ids_m, 
+                    fpl_t().set_min_size(min_size).set_n_threads(n_threads));
+                EXPECT_EQ(n_m, n_t);
+                ASSERT_EQ(ids_m.size(), n);
+                EXPECT_THAT(by_point(kdm.nodes(), ids_m), 
+                    gt::ContainerEq(ref)) << "b=" << c.b 
+                    << ", min_size=" << min_size 
+                    << ", n_threads=" << n_threads;
+            }
+        }
+    }
+
+    kdm_t kdm(pts);
+    vector<index_t> ids;
+    EXPECT_THROW(kdm.fof(-1.f, ids), ErrLogic);
+    EXPECT_THROW(kdm.fof(1.f, ids, fpl_t().set_n_threads(0)), ErrLogic);
+}
+
+TEST_F(KDMeshTest, SPHDensity) {
+    using cstr_pl_t = kdm_t::construct_policy_t;
+    using spl_t = kdm_t::sph_policy_t;
+    using type_t = kdm_t::sph_kernel_t::type_t;
+    using kdt_t = KDTree<kdp_t, int>;
+    using float_t = kdm_t::float_t;
+    using pos_t = kdm_t::pos_t;
+    const int n = 5000;
+    vector<kdp_t> pts(_kdpts1.begin(), _kdpts1.begin()+n);
+
+    // Results indexed by the points.
+    auto by_point = [&](const auto &nodes, const vector<float_t> &v) {
+        vector<float_t> out(n);
+        for(int i=0; i<n; ++i) out[nodes[i].template pad<int>()] = v[i];
+        return out;
+    };
+
+    for(const pos_t &box: {pos_t(0.f), pos_t(box_size)})
+    for(auto type: {type_t::CUBIC_SPLINE, type_t::WENDLAND_C2}) {
+        kdm_t kdm(pts, cstr_pl_t().set_n_cell(8).set_periodic_box(box));
+        kdt_t kdt(pts, kdt_t::construct_policy_t().set_periodic_box(box));
+        const spl_t pl = spl_t().set_kernel(type).set_n_threads(2);
+        vector<float_t> h_t, rho_t, h_m, rho_m;
+        ASSERT_EQ(kdt.sph_density(h_t, rho_t, pl), 0);
+        ASSERT_EQ(kdm.sph_density(h_m, rho_m, pl), 0);
+        ASSERT_EQ(h_m.size(), n);
+        ASSERT_EQ(rho_m.size(), n);
+
+        // Both converge to the tolerance, from different initial guesses.
+        const auto h_t_p = by_point(kdt.nodes(), h_t), 
+            rho_t_p = by_point(kdt.nodes(), rho_t),
+            h_m_p = by_point(kdm.nodes(), h_m), 
+            rho_m_p = by_point(kdm.nodes(), rho_m);
+        for(int i=0; i<n; ++i) {
+            ASSERT_NEAR(h_m_p[i], h_t_p[i], 1.0e-3 * h_t_p[i]);
+            ASSERT_NEAR(rho_m_p[i], rho_t_p[i], 1.0e-3 * rho_t_p[i]);
+        }
+    }
+
+    kdm_t kdm(pts);
+    vector<float_t> h, rho;
+    EXPECT_THROW(kdm.sph_density(h, rho, spl_t().set_n_threads(0)), 
+        ErrLogic);
+}
+
+TEST_F(KDMeshTest, PeriodicBox) {
+    using cstr_pl_t = kdm_t::construct_policy_t;
+    using pos_t = kdm_t::pos_t;
+    using rect_t = kdm_t::rect_t;
+    using sphere_t = kdm_t::sphere_t;
+    const int n = 20000, n_dst = 200;
+    vector<kdp_t> pts(_kdpts1.begin(), _kdpts1.begin()+n);
+
+    // Fully periodic, and periodic along x and z only.
+    for(const pos_t &box: {pos_t(box_size), pos_t{box_size, 0.f, box_size}}){
+        kdm_t kdm(pts, cstr_pl_t().set_n_cell(8).set_periodic_box(box));
+        ASSERT_EQ(kdm.nodes().size(), n);
+        for(int d=0; d<3; ++d) if( box[d] > 0 ) {
+            EXPECT_EQ(kdm.mesh().low().pos()[d], 0.f);
+            EXPECT_EQ(kdm.mesh().high().pos()[d], box[d]);
+        }
+        auto r_sq_of = [&](const pos_t &p, const pos_t &q) {
+            pos_t dx = p - q;
+            for(int d=0; d<3; ++d) {
+                if( box[d] <= 0 ) continue;
+                dx[d] = std::fmod(std::fabs(dx[d]), box[d]);
+                dx[d] = std::min(dx[d], box[d] - dx[d]);
+            }
+            return float(dx.squared_norm());
+        };
+
+        vector<sphere_t> spheres;
+        for(int i=0; i<n_dst; ++i){
+            // Centers inside and outside the box.
+            const pos_t q = _kdpts2[i].pos() + box_size * float(i % 3 - 1);
+            const float r = 5.0f * (i % 10);
+            const sphere_t s(q, r);
+            spheres.push_back(s);
+            vector<int> pads, pads_dst;
+            for(auto &p: pts){
+                // Skip the points on the sphere boundary up to round-off.
+                const float r_sq = r_sq_of(p.pos(), q);
+                if( std::fabs(r_sq - r*r) < 1.0e-3 ) continue;
+                if( r_sq < r*r ) pads_dst.push_back(p.pad<int>());
+            }
+            kdm.visit_nodes_sphere(s, [&](const kdm_t::node_t &node){
+                const float r_sq = r_sq_of(node.pos(), q);
+                if( std::fabs(r_sq - r*r) >= 1.0e-3 ) 
+                    pads.push_back(node.pad<int>());
+            });
+            EXPECT_THAT(pads, gt::UnorderedElementsAreArray(pads_dst));
+            index_t cnt = 0;
+            kdm.visit_nodes_sphere(s, [&cnt](const kdm_t::node_t &){ ++cnt; });
+            EXPECT_EQ(kdm.count_nodes_sphere(s), cnt);
+
+            const pos_t w = pos_t{10.f, 30.f, 60.f} * float(i % 4);
+            const rect_t rect(q - w, q + w);
+            index_t cnt_rect = 0, cnt_dst = 0;
+            kdm.visit_nodes_rect(rect, [&](const kdm_t::node_t &){ 
+                ++cnt_rect; });
+            for(auto &p: pts){
+                bool in = true;
+                for(int d=0; d<3; ++d){
+                    float x = p.pos()[d], lo = q[d] - w[d];
+                    if( box[d] > 0 && 2*w[d] < box[d] ) {
+                        x = std::fmod(x - lo, box[d]);
+                        if( x < 0 ) x += box[d];
+                        in = in && x > 0 && x < 2*w[d];
+                    } else if( box[d] <= 0 )
+                        in = in && x > lo && x < q[d] + w[d];
+                }
+                cnt_dst += in;
+            }
+            EXPECT_EQ(cnt_rect, cnt_dst);
+            EXPECT_EQ(kdm.count_nodes_rect(rect), cnt_dst);
+        }
+        EXPECT_THROW(kdm.count_nodes_sphere(sphere_t(pos_t(0.f), box_size)), 
+            ErrLogic);
+
+        vector<index_t> displs, node_ids, counts;
+        kdm.find_nodes_sphere_batch(spheres, displs, node_ids);
+        kdm.count_nodes_sphere_batch(spheres, counts);
+        for(int i=0; i<n_dst; ++i){
+            EXPECT_EQ(displs[i+1] - displs[i], counts[i]);
+            EXPECT_EQ(counts[i], kdm.count_nodes_sphere(spheres[i]));
+        }
+    }
+}
+
+TEST_F(KDMeshTest, DistKernel) {
+    auto check = [](const auto *pts, size_t n, const auto &pos, 
+        auto max_r_sq) 
+    {
+        using pt_t = std::decay_t<decltype(pos)>;
+        using kernel_t = _KDSEARCH::_DistKernel<pt_t>;
+        using float_t = typename kernel_t::float_t;
+        vector<size_t> ids, ids_dst;
+        vector<float_t> r_sqs, r_sqs_dst;
+        for(size_t i=0; i<n; ++i){
+            const float_t r_sq = (pts[i] - pos).r_sq();
+            if( r_sq < max_r_sq ) {
+                ids_dst.push_back(i); r_sqs_dst.push_back(r_sq);
+            }
+        }
+        kernel_t::scan_within(pts, n, pos.pos(), max_r_sq, 
+            [&](size_t i, float_t r_sq) { 
+                ids.push_back(i); r_sqs.push_back(r_sq); });
+        ASSERT_EQ(ids, ids_dst);
+        ASSERT_EQ(r_sqs, r_sqs_dst);
+        ids.clear();
+        kernel_t::visit_within(pts, n, pos.pos(), max_r_sq, 
+            [&](size_t i) { ids.push_back(i); });
+        ASSERT_EQ(ids, ids_dst);
+        ASSERT_EQ(kernel_t::count_within(pts, n, pos.pos(), max_r_sq), 
+            ids_dst.size());
+    };
+    
+    // Padded float points, all tail lengths.
+    const kdm_t::point_t pos = _kdpts2[0];
+    for(size_t n=0; n<=40; ++n)
+    for(float r: {0.f, 30.f, 60.f, 200.f})
+        check(_kdpts1.data()+n, n, pos, r*r);
+    check(_kdpts1.data(), _kdpts1.size(), pos, 900.f);
+    // Bounds exactly at the distances of points.
+    for(size_t i=0; i<40; ++i) {
+        const float r_sq = (_kdpts1[i] - pos).r_sq();
+        check(_kdpts1.data(), 40, pos, r_sq);
+        check(_kdpts1.data(), 40, pos, std::nextafter(r_sq, 1.0e10f));
+    }
+
+    // Double points, other dimensions.
+    vector<KDPoint<double, 2, 3> > pts_d2(37);
+    vector<GEOMETRY::Point<double, 5> > pts_d5(37);
+    UniformRealRandomNumber<double> rng_d(0., 1.);
+    for(auto &p: pts_d2) rng_d(p.pos().begin(), p.pos().end());
+    for(auto &p: pts_d5) rng_d(p.pos().begin(), p.pos().end());
+    for(size_t n=0; n<=pts_d2.size(); ++n) {
+        check(pts_d2.data(), n, GEOMETRY::Point<double, 2>(pts_d2.back()), 
+            0.1);
+        check(pts_d5.data(), n, pts_d5.back(), 0.5);
+    }
+
+    // The bound may be shrunk by the callback.
+    using kernel_t = _KDSEARCH::_DistKernel<kdm_t::point_t>;
+    float max_r_sq = 1.0e4f;
+    size_t i_min = 0;
+    kernel_t::scan_within(_kdpts1.data(), 1000, pos.pos(), max_r_sq, 
+        [&](size_t i, float r_sq) {
+            if( r_sq < max_r_sq ) { max_r_sq = r_sq; i_min = i; } });
+    const auto it = std::min_element(_kdpts1.begin(), _kdpts1.begin()+1000, 
+        [&](const kdp_t &a, const kdp_t &b) { 
+            return (a - pos).r_sq() < (b - pos).r_sq(); });
+    EXPECT_EQ(i_min, size_t(it - _kdpts1.begin()));
+}
+
+TEST(KDMeshLongLongTest, ConstructAndQuery) {
+    using kdp_t = KDPoint<float, 3, sizeof(long long)>;
+    using kdm_t = KDMesh<kdp_t, long long>;
+    using index_t = kdm_t::index_t;
+    static_assert(std::is_same_v<index_t, long long>);
+
+    UniformRealRandomNumber<> rng(0.0f, 100.0f);
+    const long long pad_base = 1LL << 40;
+    vector<kdp_t> pts(20000);
+    for(size_t i=0; i<pts.size(); ++i) {
+        rng(pts[i].pos().begin(), pts[i].pos().end());
+        pts[i].fill_pad(pad_base + (long long)i);
+    }
+    kdm_t kdm(pts);
+    ASSERT_EQ(index_t(kdm.nodes().size()), index_t(pts.size()));
+
+    for(int i=0; i<50; ++i) {
+        kdm_t::pos_t q;
+        rng(q.begin(), q.end());
+        const kdm_t::sphere_t s(q, 5.0f);
+        const kdm_t::rect_t r(q, kdm_t::point_t(kdm_t::pos_t(q+8.0f)));
+        std::set<long long> want_s, want_r, got_s, got_r;
+        for(size_t j=0; j<pts.size(); ++j) {
+            if( (pts[j].pos()-q).squared_norm() < 25.0f ) 
+                want_s.insert(pad_base + (long long)j);
+            if( r.contains(pts[j]) ) want_r.insert(pad_base + (long long)j);
+        }
+        kdm.visit_nodes_sphere(s, [&](const kdm_t::node_t &n) {
+            got_s.insert(n.pad<long long>());
+        });
+        kdm.visit_nodes_rect(r, [&](const kdm_t::node_t &n) {
+            got_r.insert(n.pad<long long>());
+        });
+        EXPECT_THAT(got_s, gt::ContainerEq(want_s));
+        EXPECT_THAT(got_r, gt::ContainerEq(want_r));
+        EXPECT_EQ(kdm.count_nodes_sphere(s), index_t(want_s.size()));
+        EXPECT_EQ(kdm.count_nodes_rect(r), index_t(want_r.size()));
+    }
+}
+
 } // namespace
 
 } // namespace HIPP::NUMERICAL
\ No newline at end of file
@@ -1,5 +1,11 @@
 #include <hippnumerical.h>
 #include <gmock/gmock.h>
+#include "kdsearch_h5_mock.h"
+#include <functional>
+#include <map>
+#include <numeric>
+#include <filesystem>
+#include <thread>
 
 namespace HIPP::NUMERICAL {
 
@@ -38,6 +44,17 @@ protected:
     }
     void TearDown() override {}
 
+    /**
+    The size and split axis of node ``i``, in a tree of either kind.
+    */
+    static std::pair<index_t, int> node_shape(const kdtree_t &kdt, 
+        index_t i) 
+    {
+        if( kdt.ref_nodes().empty() ) 
+            return {kdt.nodes()[i].size(), kdt.nodes()[i].axis()};
+        return {kdt.ref_nodes()[i].size(), kdt.ref_nodes()[i].axis()};
+    }
+
     inline static const rng_t::seed_t seed = 0;
     inline static const float box_size = 100.0;
 
@@ -281,6 +298,150 @@ TEST_F(KDTreeTest, TreeConstructPolicySplitAxisOrdered) {
     }
 }
 
+TEST_F(KDTreeTest, TreeConstructPolicyParallel) {
+    using pl_t = kdtree_t::construct_policy_t;
+    using spl_t = pl_t::split_axis_t;
+    pl_t pl;
+    EXPECT_EQ(pl.n_threads(), pl_t::DFLT_N_THREADS);
+    EXPECT_EQ(pl.serial_cutoff(), pl_t::DFLT_SERIAL_CUTOFF);
+
+    EXPECT_THROW(kdtree_t(_kdpts1, pl_t(pl).set_n_threads(0)), ErrLogic);
+    EXPECT_THROW(kdtree_t(_kdpts1, pl_t(pl).set_serial_cutoff(0)), ErrLogic);
+
+    for(spl_t spl: {spl_t::MAX_EXTREME,
+        spl_t::MAX_VARIANCE, spl_t::ORDERED, spl_t::RANDOM})
+    {
+        pl.set_split_axis(spl).set_n_threads(1);
+        kdtree_t kdt_serial(_kdpts2, pl);
+        const auto &nds_serial = kdt_serial.nodes();
+
+        for(auto [n_th, cutoff]: vector<std::pair<int, index_t> >{
+            {2, 1}, {3, 1000}, {4, 1}, {7, 50000}})
+        {
+            pl.set_n_threads(n_th).set_serial_cutoff(cutoff);
+            kdtree_t kdt(_kdpts2, pl);
+            EXPECT_EQ(kdt.construct_policy().n_threads(), n_th);
+            EXPECT_EQ(kdt.construct_policy().serial_cutoff(), cutoff);
+            EXPECT_EQ(kdt.tree_info().max_depth(),
+                kdt_serial.tree_info().max_depth());
+
+            const auto &nds = kdt.nodes();
+            ASSERT_EQ(nds.size(), nds_serial.size());
+            for(size_t i=0; i<nds.size(); ++i){
+                auto &n = nds[i], &n_serial = nds_serial[i];
+                ASSERT_EQ(n.pad<int>(), n_serial.pad<int>());
+                ASSERT_EQ(n.size(), n_serial.size());
+                ASSERT_EQ(n.axis(), n_serial.axis());
+                ASSERT_TRUE( (n.pos() == n_serial.pos()).all() );
+            }
+        }
+    }
+}
+
+TEST_F(KDTreeTest, TreeConstructPolicyLeafSize) {
+    using pl_t = kdtree_t::construct_policy_t;
+    pl_t pl;
+    EXPECT_EQ(pl.leaf_size(), pl_t::DFLT_LEAF_SIZE);
+    EXPECT_THROW(kdtree_t(_kdpts1, pl_t(pl).set_leaf_size(0)), ErrLogic);
+
+    kdtree_t kdt_1(_kdpts1);
+    EXPECT_TRUE(kdt_1.points().empty());
+    EXPECT_TRUE(kdt_1.ref_nodes().empty());
+    EXPECT_EQ(kdt_1.n_points(), kdt_1.nodes().size());
+    EXPECT_EQ(kdt_1.n_nodes(), kdt_1.nodes().size());
+    for(auto &n: kdt_1.nodes()) ASSERT_GE(n.axis(), 0);
+
+    for(index_t leaf_sz: {2, 7, 64}) for(int n_th: {1, 3}) {
+        pl.set_leaf_size(leaf_sz).set_n_threads(n_th).set_serial_cutoff(1000);
+        kdtree_t kdt(_kdpts1, pl);
+        EXPECT_EQ(kdt.construct_policy().leaf_size(), leaf_sz);
+        EXPECT_LE(kdt.tree_info().max_depth(), kdt_1.tree_info().max_depth());
+
+        // A node is either a split node or a whole bucket. Each point is 
+        // stored once, in exactly one of them.
+        const auto &nds = kdt.ref_nodes();
+        const index_t n_pts = _kdpts1.size();
+        EXPECT_TRUE(kdt.nodes().empty());
+        ASSERT_EQ(kdt.n_nodes(), nds.size());
+        ASSERT_EQ(kdt.n_points(), n_pts);
+        ASSERT_EQ(kdt.points().size(), n_pts);
+        std::function<index_t(index_t)> n_nodes_of = [&](index_t n) {
+            if( n <= leaf_sz ) return index_t(n > 0);
+            return 1 + n_nodes_of(n/2) + n_nodes_of((n-1)/2);
+        };
+        ASSERT_EQ(nds.size(), n_nodes_of(n_pts));
+        EXPECT_EQ(kdt.point_range(0), std::make_pair(index_t(0), n_pts));
+        for(index_t i=0; i<index_t(nds.size()); ++i){
+            const auto [b, e] = kdt.point_range(i);
+            ASSERT_EQ(nds[i].first(), b);
+            if( !kdt.is_bucket(i) ) {
+                ASSERT_GE(nds[i].axis(), 0);
+                ASSERT_GT(e-b, leaf_sz);
+                continue;
+            }
+            ASSERT_EQ(nds[i].size(), 1);
+            ASSERT_GE(e-b, 1);
+            ASSERT_LE(e-b, leaf_sz);
+        }
+        vector<int> pads;
+        for(index_t j=0; j<n_pts; ++j) {
+            pads.push_back(kdt.point_pad<int>(j));
+            ASSERT_TRUE( (kdt.points()[j].pos() == kdt.point_pos(j)).all() );
+        }
+        std::sort(pads.begin(), pads.end());
+        for(int i=0; i<int(pads.size()); ++i) ASSERT_EQ(pads[i], i);
+        
+        // Queries give the same points as the classic tree.
+        using ngb_t = kdtree_t::ngb_t;
+        for(int i=0; i<200; ++i){
+            const auto &p = _kdpts2[i];
+            EXPECT_FLOAT_EQ(kdt.nearest(p).r_sq, kdt_1.nearest(p).r_sq);
+            
+            vector<ngb_t> ngbs(8), ngbs_1(8);
+            kdt.nearest_k(p, ngbs); kdt_1.nearest_k(p, ngbs_1);
+            std::sort(ngbs.begin(), ngbs.end());
+            std::sort(ngbs_1.begin(), ngbs_1.end());
+            for(int j=0; j<8; ++j)
+                EXPECT_FLOAT_EQ(ngbs[j].r_sq, ngbs_1[j].r_sq);
+
+            kdtree_t::sphere_t s(p, 5.0f);
+            kdtree_t::rect_t r(p-4.0f, p+4.0f);
+            vector<int> ids, ids_1;
+            auto add_to = [](vector<int> &v) {
+                return [&v](const kdtree_t::node_t &n){ 
+                    v.push_back(n.pad<int>()); };
+            };
+            kdt.visit_nodes_sphere(s, add_to(ids));
+            kdt_1.visit_nodes_sphere(s, add_to(ids_1));
+            EXPECT_THAT(ids, gt::UnorderedElementsAreArray(ids_1));
+            EXPECT_EQ(kdt.count_nodes_sphere(s), ids_1.size());
+            ids.clear(); ids_1.clear();
+            kdt.visit_nodes_rect(r, add_to(ids));
+            kdt_1.visit_nodes_rect(r, add_to(ids_1));
+            EXPECT_THAT(ids, gt::UnorderedElementsAreArray(ids_1));
+        }
+
+        // The path of walk_down() ends at a bucket.
+        index_t idx = 0;
+        kdt.walk_down(_kdpts2[0], [](index_t){}, idx);
+        EXPECT_TRUE(kdt.is_bucket(idx));
+
+        vector<index_t> node_ids;
+        vector<ngb_t> ngbs;
+        const int k = 5;
+        kdt.all_nearest_k(k, node_ids, ngbs, 
+            kdtree_t::all_nearest_k_policy_t().set_n_threads(n_th));
+        ASSERT_EQ(node_ids.size(), n_pts);
+        for(index_t i=0; i<n_pts; i+=97){
+            vector<ngb_t> ngbs_dst(k+1);
+            kdt.nearest_k(kdtree_t::point_t(kdt.point_pos(node_ids[i])), 
+                ngbs_dst);
+            std::sort(ngbs_dst.begin(), ngbs_dst.end());
+            for(int j=0; j<k; ++j)
+                EXPECT_FLOAT_EQ(ngbs[i*k+j].r_sq, ngbs_dst[j+1].r_sq);
+        }
+    }
+}
 
 TEST_F(KDTreeTest, ArgSort) {
     kdtree_t kdt(_kdpts1);
@@ -355,6 +516,136 @@ TEST_F(KDTreeTest, Clear) {
 }
 
 
+TEST_F(KDTreeTest, SaveLoad) {
+    using ngb_t = kdtree_t::ngb_t;
+    using cstr_pl_t = kdtree_t::construct_policy_t;
+    const string file_name = gt::TempDir() + "kdsearch_kdtree_save_load.bin";
+    
+    for(index_t leaf_size: {1, 16}){
+        const float_t box = leaf_size > 1 ? box_size : 0.f;
+        kdtree_t kdt(_kdpts1, 
+            cstr_pl_t().set_leaf_size(leaf_size).set_periodic_box(box));
+        kdt.save(file_name);
+
+        kdtree_t kdt_in;
+        kdt_in.load(file_name);
+        EXPECT_EQ(kdt_in.construct_policy().leaf_size(), leaf_size);
+        EXPECT_TRUE( (kdt_in.construct_policy().periodic_box().size() 
+            == box).all() );
+        EXPECT_EQ(kdt_in.tree_info().max_depth(), kdt.tree_info().max_depth());
+        ASSERT_EQ(kdt_in.nodes().size(), kdt.nodes().size());
+        for(size_t i=0; i<kdt.nodes().size(); ++i){
+            const auto &n1 = kdt.nodes()[i], &n2 = kdt_in.nodes()[i];
+            ASSERT_TRUE( (n1.pos() == n2.pos()).all() );
+            ASSERT_EQ(n1.size(), n2.size());
+            ASSERT_EQ(n1.axis(), n2.axis());
+            ASSERT_EQ(n1.pad<int>(), n2.pad<int>());
+        }
+        ASSERT_EQ(kdt_in.ref_nodes().size(), kdt.ref_nodes().size());
+        for(size_t i=0; i<kdt.ref_nodes().size(); ++i){
+            const auto &n1 = kdt.ref_nodes()[i], &n2 = kdt_in.ref_nodes()[i];
+            ASSERT_EQ(n1.first(), n2.first());
+            ASSERT_EQ(n1.size(), n2.size());
+            ASSERT_EQ(n1.axis(), n2.axis());
+        }
+        ASSERT_EQ(kdt_in.n_points(), kdt.n_points());
+        ASSERT_EQ(kdt_in.points().size(), kdt.points().size());
+        for(index_t j=0; j<kdt.n_points(); ++j){
+            ASSERT_TRUE( (kdt.point_pos(j) == kdt_in.point_pos(j)).all() );
+            ASSERT_EQ(kdt.point_pad<int>(j), kdt_in.point_pad<int>(j));
+        }
+        for(index_t i=0; i<kdt.n_nodes(); ++i)
+            ASSERT_EQ(kdt.point_range(i), kdt_in.point_range(i));
+
+        vector<ngb_t> ngbs1(8), ngbs2(8);
+        for(int i=0; i<100; ++i){
+            const auto &p = _kdpts2[i];
+            kdt.nearest_k(p, ngbs1);
+            kdt_in.nearest_k(p, ngbs2);
+            for(int j=0; j<8; ++j){
+                EXPECT_EQ(ngbs1[j].node_idx, ngbs2[j].node_idx);
+                EXPECT_EQ(ngbs1[j].r_sq, ngbs2[j].r_sq);
+            }
+        }
+    }
+
+    kdtree_t kdt_empty, kdt_in(_kdpts1);
+    kdt_empty.save(file_name);
+    kdt_in.load(file_name);
+    EXPECT_EQ(kdt_in.n_nodes(), 0);
+    EXPECT_EQ(kdt_in.nearest(_kdpts2[0]).node_idx, kdtree_t::node_t::idxNULL);
+
+    // Incompatible types or files.
+    KDTree<KDPoint<double, 3, sizeof(int)>, int> kdt_d;
+    EXPECT_THROW(kdt_d.load(file_name), ErrRuntime);
+    BallTree<kdp_t, int> bt;
+    EXPECT_THROW(bt.load(file_name), ErrRuntime);
+    EXPECT_THROW(kdt_in.load(file_name + ".not-exist"), ErrSystem);
+    std::remove(file_name.c_str());
+}
+
+TEST_F(KDTreeTest, SaveLoadH5) {
+    using ngb_t = kdtree_t::ngb_t;
+    using cstr_pl_t = kdtree_t::construct_policy_t;
+    using group_t = TEST::MockH5Group;
+
+    for(index_t leaf_size: {1, 16}){
+        const float_t box = leaf_size > 1 ? box_size : 0.f;
+        kdtree_t kdt(_kdpts1, 
+            cstr_pl_t().set_leaf_size(leaf_size).set_periodic_box(box));
+        group_t g;
+        kdt.save_h5(g);
+
+        kdtree_t kdt_in;
+        kdt_in.load_h5(g);
+        EXPECT_EQ(kdt_in.construct_policy().leaf_size(), leaf_size);
+        EXPECT_TRUE( (kdt_in.construct_policy().periodic_box().size() 
+            == box).all() );
+        EXPECT_EQ(kdt_in.tree_info().max_depth(), kdt.tree_info().max_depth());
+        ASSERT_EQ(kdt_in.nodes().size(), kdt.nodes().size());
+        for(size_t i=0; i<kdt.nodes().size(); ++i){
+            const auto &n1 = kdt.nodes()[i], &n2 = kdt_in.nodes()[i];
+            ASSERT_TRUE( (n1.pos() == n2.pos()).all() );
+            ASSERT_EQ(n1.size(), n2.size());
+            ASSERT_EQ(n1.axis(), n2.axis());
+            ASSERT_EQ(n1.pad<int>(), n2.pad<int>());
+        }
+        ASSERT_EQ(kdt_in.ref_nodes().size(), kdt.ref_nodes().size());
+        for(size_t i=0; i<kdt.ref_nodes().size(); ++i){
+            const auto &n1 = kdt.ref_nodes()[i], &n2 = kdt_in.ref_nodes()[i];
+            ASSERT_EQ(n1.first(), n2.first());
+            ASSERT_EQ(n1.size(), n2.size());
+            ASSERT_EQ(n1.axis(), n2.axis());
+        }
+        ASSERT_EQ(kdt_in.points().size(), kdt.points().size());
+        for(index_t j=0; j<kdt.n_points(); ++j){
+            ASSERT_TRUE( (kdt.point_pos(j) == kdt_in.point_pos(j)).all() );
+            ASSERT_EQ(kdt.point_pad<int>(j), kdt_in.point_pad<int>(j));
+        }
+
+        vector<ngb_t> ngbs1(8), ngbs2(8);
+        for(int i=0; i<100; ++i){
+            const auto &p = _kdpts2[i];
+            kdt.nearest_k(p, ngbs1);
+            kdt_in.nearest_k(p, ngbs2);
+            for(int j=0; j<8; ++j){
+                EXPECT_EQ(ngbs1[j].node_idx, ngbs2[j].node_idx);
+                EXPECT_EQ(ngbs1[j].r_sq, ngbs2[j].r_sq);
+            }
+        }
+
+        KDTree<KDPoint<double, 3, sizeof(int)>, int> kdt_d;
+        EXPECT_THROW(kdt_d.load_h5(g), ErrRuntime);
+    }
+
+    kdtree_t kdt_empty, kdt_in(_kdpts1);
+    group_t g;
+    kdt_empty.save_h5(g);
+    kdt_in.load_h5(g);
+    EXPECT_EQ(kdt_in.n_nodes(), 0);
+    EXPECT_EQ(kdt_in.nearest(_kdpts2[0]).node_idx, kdtree_t::node_t::idxNULL);
+}
+
 TEST_F(KDTreeTest, VisitRectCompleteCheck) {
     kdtree_t kdt(_kdpts1);
     kdp_t::point_t p = {50.0f, 50.0f, 50.0f};
@@ -481,6 +772,1040 @@ TEST_F(KDTreeTest, VisitSphereNodes) {
     }
 }
 
+TEST_F(KDTreeTest, BatchQuery) {
+    using bpl_t = kdtree_t::batch_query_policy_t;
+    using ngb_t = kdtree_t::ngb_t;
+    kdtree_t kdt(_kdpts1);
+    const int n_dst = 2000, k = 8;
+    vector<kdp_t> pts(_kdpts2.begin(), _kdpts2.begin()+n_dst);
+    vector<kdtree_t::sphere_t> spheres;
+    for(int i=0; i<n_dst; ++i)
+        spheres.emplace_back(pts[i], 1.0f + (i % 5));
+
+    vector<bpl_t> bpls(4);
+    bpls[1].set_n_threads(3);
+    bpls[2].sort_queries_on();
+    bpls[3].set_n_threads(4).sort_queries_on();
+    {
+        vector<index_t> counts;
+        EXPECT_THROW(kdt.count_nodes_sphere_batch(spheres, counts, 
+            bpl_t().set_n_threads(0)), ErrLogic);
+    }
+
+    for(auto &bpl: bpls){
+        vector<index_t> displs, node_ids, counts;
+        vector<ngb_t> ngbs;
+        kdt.nearest_k_batch<kdp_t>(pts, k, displs, ngbs, bpl);
+        ASSERT_EQ(displs.size(), n_dst+1);
+        ASSERT_EQ(ngbs.size(), n_dst*k);
+        for(int i=0; i<n_dst; ++i){
+            vector<ngb_t> ngbs_dst(k);
+            kdt.nearest_k(pts[i], ngbs_dst);
+            ASSERT_EQ(displs[i+1]-displs[i], k);
+            vector<index_t> ids, ids_dst;
+            for(int j=0; j<k; ++j){
+                ids.push_back(ngbs[displs[i]+j].node_idx);
+                ids_dst.push_back(ngbs_dst[j].node_idx);
+            }
+            EXPECT_THAT(ids, gt::UnorderedElementsAreArray(ids_dst));
+        }
+
+        kdt.find_nodes_sphere_batch(spheres, displs, node_ids, bpl);
+        kdt.count_nodes_sphere_batch(spheres, counts, bpl);
+        ASSERT_EQ(displs.size(), n_dst+1);
+        ASSERT_EQ(counts.size(), n_dst);
+        ASSERT_EQ(node_ids.size(), displs[n_dst]);
+        for(int i=0; i<n_dst; ++i){
+            vector<index_t> ids_dst;
+            kdt.impl()->visit_sphere(spheres[i], 
+                [&ids_dst](index_t j){ ids_dst.push_back(j); });
+            vector<index_t> ids(node_ids.begin()+displs[i], 
+                node_ids.begin()+displs[i+1]);
+            EXPECT_THAT(ids, gt::UnorderedElementsAreArray(ids_dst));
+            EXPECT_EQ(counts[i], kdt.count_nodes_sphere(spheres[i]));
+        }
+    }
+
+    // Empty tree.
+    kdtree_t kdt_empty;
+    vector<index_t> displs, counts;
+    vector<ngb_t> ngbs;
+    kdt_empty.nearest_k_batch<kdp_t>(pts, k, displs, ngbs, bpls[3]);
+    EXPECT_EQ(displs, vector<index_t>(n_dst+1, 0));
+    EXPECT_TRUE(ngbs.empty());
+    kdt_empty.count_nodes_sphere_batch(spheres, counts, bpls[3]);
+    EXPECT_EQ(counts, vector<index_t>(n_dst, 0));
+}
+
+TEST_F(KDTreeTest, QueryBuffPool) {
+    using ngb_t = kdtree_t::ngb_t;
+    using pool_t = _KDSEARCH::_QueryBuffPool<index_t>;
+    kdtree_t kdt(_kdpts1);
+    const int n_dst = 200, k = 8;
+    vector<kdp_t> pts(_kdpts2.begin(), _kdpts2.begin()+n_dst);
+
+    // Nested queries lease distinct buffers, and give the same results.
+    vector<index_t> counts_ref(n_dst);
+    for(int i=0; i<n_dst; ++i)
+        counts_ref[i] = kdt.count_nodes_sphere({pts[i], 3.0f});
+    size_t n_buffs = 0;
+    kdt.visit_nodes_sphere({pts[0], 5.0f}, [&](const auto &){
+        EXPECT_EQ(pool_t::n_leased(), 1);
+        for(int i=0; i<n_dst; ++i)
+            EXPECT_EQ(kdt.count_nodes_sphere({pts[i], 3.0f}), counts_ref[i]);
+        n_buffs = pool_t::n_buffs();
+    });
+    EXPECT_EQ(pool_t::n_leased(), 0);
+    EXPECT_EQ(n_buffs, 2);
+
+    // Steady state: no buffer is created by further queries.
+    for(int i=0; i<n_dst; ++i)
+        kdt.count_nodes_sphere({pts[i], 3.0f});
+    EXPECT_EQ(pool_t::n_buffs(), n_buffs);
+    EXPECT_EQ(pool_t::n_leased(), 0);
+
+    // Each thread has its own pool.
+    vector<vector<index_t> > ids_ref(n_dst);
+    for(int i=0; i<n_dst; ++i){
+        vector<ngb_t> ngbs(k);
+        kdt.nearest_k(pts[i], ngbs);
+        for(auto &ngb: ngbs) ids_ref[i].push_back(ngb.node_idx);
+    }
+    vector<vector<index_t> > ids_th(n_dst);
+    vector<std::thread> ths;
+    const int n_th = 4;
+    for(int r=0; r<n_th; ++r) ths.emplace_back([&, r](){
+        for(int i=r; i<n_dst; i+=n_th){
+            vector<ngb_t> ngbs(k);
+            kdt.nearest_k(pts[i], ngbs);
+            for(auto &ngb: ngbs) ids_th[i].push_back(ngb.node_idx);
+        }
+    });
+    for(auto &th: ths) th.join();
+    for(int i=0; i<n_dst; ++i)
+        EXPECT_THAT(ids_th[i], gt::UnorderedElementsAreArray(ids_ref[i]));
+    EXPECT_EQ(pool_t::n_buffs(), n_buffs);
+}
+
+TEST_F(KDTreeTest, ApproxNearest) {
+    using ngb_t = kdtree_t::ngb_t;
+    using npl_t = kdtree_t::nearest_query_policy_t;
+    using kpl_t = kdtree_t::nearest_k_query_policy_t;
+    EXPECT_THROW(npl_t().set_eps(-0.1f), ErrLogic);
+    EXPECT_THROW(kpl_t().set_eps(-0.1f), ErrLogic);
+
+    const int n_dst = 500, k = 16;
+    for(int leaf_size: {1, 8}) {
+        kdtree_t kdt(_kdpts1, 
+            kdtree_t::construct_policy_t().set_leaf_size(leaf_size));
+        size_t n_exact = 0, n_exact_k = 0;
+        for(float eps: {0.0f, 0.5f, 2.0f}) {
+            npl_t npl; npl.set_eps(eps);
+            kpl_t kpl; kpl.set_eps(eps).sort_by_distance_on();
+            const float f = (1 + eps) * (1 + eps) * (1 + 1.0e-5f);
+            for(int i=0; i<n_dst; ++i) {
+                const auto &p = _kdpts2[i];
+                auto ngb = kdt.nearest(p, npl), 
+                    ngb_exact = kdt.nearest(p);
+                EXPECT_LE(ngb.r_sq, ngb_exact.r_sq * f);
+                EXPECT_FLOAT_EQ(ngb.r_sq, 
+                    (p.pos() - kdt.point_pos(ngb.node_idx)).squared_norm());
+                if( eps == 0 ){
+                    EXPECT_EQ(ngb.r_sq, ngb_exact.r_sq);
+                }
+
+                vector<ngb_t> ngbs(k), ngbs_exact(k);
+                ASSERT_EQ(kdt.nearest_k(p, ngbs, kpl), k);
+                kdt.nearest_k(p, ngbs_exact, 
+                    kpl_t().sort_by_distance_on());
+                for(int j=0; j<k; ++j)
+                    EXPECT_LE(ngbs[j].r_sq, ngbs_exact[j].r_sq * f);
+            }
+            EXPECT_GT(npl.n_visited(), 0u);
+            if( eps == 0 ) {
+                n_exact = npl.n_visited(); n_exact_k = kpl.n_visited();
+            } else {
+                EXPECT_LE(npl.n_visited(), n_exact);
+                EXPECT_LT(kpl.n_visited(), n_exact_k);
+            }
+            EXPECT_EQ(kpl.reset_n_visited().n_visited(), 0u);
+        }
+    }
+}
+
+TEST_F(KDTreeTest, AllNearestK) {
+    using apl_t = kdtree_t::all_nearest_k_policy_t;
+    using ngb_t = kdtree_t::ngb_t;
+    const int n = 20000, k = 6;
+    vector<kdp_t> pts(_kdpts1.begin(), _kdpts1.begin()+n);
+    kdtree_t kdt(pts);
+    const auto &nodes = kdt.nodes();
+
+    vector<apl_t> apls(4);
+    apls[1].set_n_threads(4);
+    apls[2].include_self_on();
+    apls[3].set_n_threads(3).include_self_on();
+    for(auto &apl: apls){
+        vector<index_t> node_ids;
+        vector<ngb_t> ngbs;
+        index_t k_used = kdt.all_nearest_k(k, node_ids, ngbs, apl);
+        ASSERT_EQ(k_used, k);
+        ASSERT_EQ(node_ids.size(), n);
+        ASSERT_EQ(ngbs.size(), n*k);
+        
+        const int off = apl.include_self() ? 0 : 1;
+        vector<ngb_t> ngbs_dst(k+1);
+        for(int i=0; i<n; ++i){
+            const index_t node_idx = node_ids[i];
+            kdt.nearest_k(nodes[node_idx], ngbs_dst);
+            std::sort(ngbs_dst.begin(), ngbs_dst.end());
+            for(int j=0; j<k; ++j){
+                const auto &ngb = ngbs[i*k+j];
+                EXPECT_FLOAT_EQ(ngb.r_sq, ngbs_dst[j+off].r_sq);
+                EXPECT_FLOAT_EQ(ngb.r_sq, 
+                    (nodes[ngb.node_idx].pos() 
+                    - nodes[node_idx].pos()).squared_norm());
+                if( !apl.include_self() ){
+                    EXPECT_NE(ngb.node_idx, node_idx);
+                }
+            }
+        }
+    }
+
+    // k truncated by the number of points.
+    vector<kdp_t> pts_small(pts.begin(), pts.begin()+3);
+    kdtree_t kdt_small(pts_small);
+    vector<index_t> node_ids;
+    vector<ngb_t> ngbs;
+    EXPECT_EQ(kdt_small.all_nearest_k(k, node_ids, ngbs), 2);
+    EXPECT_EQ(ngbs.size(), 3*2);
+    EXPECT_EQ(kdt_small.all_nearest_k(k, node_ids, ngbs, apls[2]), 3);
+    EXPECT_THROW(kdt_small.all_nearest_k(-1, node_ids, ngbs), ErrLogic);
+
+    kdtree_t kdt_empty;
+    EXPECT_EQ(kdt_empty.all_nearest_k(k, node_ids, ngbs), 0);
+    EXPECT_TRUE(node_ids.empty());
+    EXPECT_TRUE(ngbs.empty());
+}
+
+TEST_F(KDTreeTest, PeriodicBox) {
+    using ngb_t = kdtree_t::ngb_t;
+    using cstr_pl_t = kdtree_t::construct_policy_t;
+    using rect_t = kdtree_t::rect_t;
+    using sphere_t = kdtree_t::sphere_t;
+    using apl_t = kdtree_t::all_nearest_k_policy_t;
+    const int n = 5000, n_q = 50, k = 8;
+    vector<kdp_t> pts(_kdpts1.begin(), _kdpts1.begin()+n);
+
+    // Fully periodic, and periodic along x and z only.
+    for(const pos_t &box: {pos_t(box_size), pos_t{box_size, 0.f, box_size}})
+    for(index_t leaf_size: {1, 16}) {
+        kdtree_t kdt(pts, 
+            cstr_pl_t().set_leaf_size(leaf_size).set_periodic_box(box));
+        EXPECT_TRUE( (kdt.construct_policy().periodic_box().size() 
+            == box).all() );
+        auto r_sq_of = [&](const pos_t &p, const pos_t &q) {
+            pos_t dx = p - q;
+            for(int d=0; d<3; ++d) {
+                if( box[d] <= 0 ) continue;
+                dx[d] = std::fmod(std::fabs(dx[d]), box[d]);
+                dx[d] = std::min(dx[d], box[d] - dx[d]);
+            }
+            return float_t(dx.squared_norm());
+        };
+
+        for(int i=0; i<n_q; ++i) {
+            // Queries inside and outside the box.
+            pos_t q = _kdpts2[i].pos() + box_size * float_t(i % 3 - 1);
+            vector<float_t> ref;
+            for(auto &p: pts) ref.push_back(r_sq_of(p.pos(), q));
+            std::sort(ref.begin(), ref.end());
+
+            auto ngb = kdt.nearest(kdp_t(q));
+            EXPECT_NEAR(ngb.r_sq, ref[0], 1.0e-3);
+            EXPECT_NEAR(ngb.r_sq, r_sq_of(kdt.point_pos(ngb.node_idx), q), 
+                1.0e-3);
+
+            vector<ngb_t> ngbs(k);
+            ASSERT_EQ(kdt.nearest_k(kdp_t(q), ngbs, 
+                kdtree_t::nearest_k_query_policy_t().sort_by_distance_on()),
+                k);
+            for(int j=0; j<k; ++j) {
+                EXPECT_NEAR(ngbs[j].r_sq, ref[j], 1.0e-3);
+                EXPECT_NEAR(ngbs[j].r_sq, 
+                    r_sq_of(kdt.point_pos(ngbs[j].node_idx), q), 1.0e-3);
+            }
+
+            const float_t r = 5.0f * (i % 10);
+            const index_t cnt_ref = std::count_if(ref.begin(), ref.end(), 
+                [&](float_t r_sq){ return r_sq < r*r; });
+            EXPECT_EQ(kdt.count_nodes_sphere(sphere_t(kdp_t(q), r)), cnt_ref);
+
+            const pos_t w = pos_t{10.f, 30.f, 60.f} * float_t(i % 4);
+            const rect_t rect(kdp_t(q - w), kdp_t(q + w));
+            index_t rect_ref = 0;
+            for(auto &p: pts) {
+                bool in = true;
+                for(int d=0; d<3; ++d) {
+                    float_t x = p.pos()[d], lo = q[d] - w[d];
+                    if( box[d] > 0 && 2*w[d] < box[d] ) {
+                        x = std::fmod(x - lo, box[d]);
+                        if( x < 0 ) x += box[d];
+                        in = in && x > 0 && x < 2*w[d];
+                    } else if( box[d] <= 0 )
+                        in = in && x > lo && x < q[d] + w[d];
+                }
+                rect_ref += in;
+            }
+            EXPECT_EQ(kdt.count_nodes_rect(rect), rect_ref);
+        }
+        EXPECT_THROW(kdt.count_nodes_sphere(sphere_t(kdp_t(pos_t(0.f)),
+            box_size)), ErrLogic);
+
+        vector<index_t> node_ids;
+        vector<ngb_t> all_ngbs;
+        ASSERT_EQ(kdt.all_nearest_k(k, node_ids, all_ngbs, 
+            apl_t().set_n_threads(2)), k);
+        for(int i=0; i<n; i+=50) {
+            vector<float_t> ref;
+            for(int j=0; j<n; ++j) if( j != node_ids[i] )
+                ref.push_back(r_sq_of(kdt.point_pos(j), 
+                    kdt.point_pos(node_ids[i])));
+            std::sort(ref.begin(), ref.end());
+            for(int j=0; j<k; ++j) {
+                EXPECT_NEAR(all_ngbs[i*k+j].r_sq, ref[j], 1.0e-3);
+                EXPECT_NE(all_ngbs[i*k+j].node_idx, node_ids[i]);
+            }
+        }
+    }
+}
+
+TEST_F(KDTreeTest, CountPairs) {
+    using cstr_pl_t = kdtree_t::construct_policy_t;
+    using ppl_t = kdtree_t::pair_count_policy_t;
+    const int n1 = 3000, n2 = 2000;
+    const vector<float_t> edges {0.5f, 2.f, 5.f, 10.f, 20.f, 30.f};
+    const int n_bins = edges.size() - 1;
+
+    // Weights are stored in the padding.
+    vector<kdp_t> pts1(_kdpts1.begin(), _kdpts1.begin()+n1), 
+        pts2(_kdpts2.begin(), _kdpts2.begin()+n2);
+    auto weight_of = [](int i) { return 1.0f + 0.5f * (i % 7); };
+    for(int i=0; i<n1; ++i) pts1[i].fill_pad(weight_of(i));
+    for(int i=0; i<n2; ++i) pts2[i].fill_pad(weight_of(i+1));
+
+    for(const pos_t &box: {pos_t(0.f), pos_t{box_size, 0.f, box_size}}) {
+        auto r_sq_of = [&](const pos_t &p, const pos_t &q) {
+            float_t r_sq = 0;
+            for(int d=0; d<3; ++d) {
+                float_t dx = std::fabs(p[d] - q[d]);
+                if( box[d] > 0 )
+                    for(float_t s: {-box[d], box[d]})
+                        dx = std::min(dx, std::fabs(p[d] - (q[d] + s)));
+                r_sq += dx * dx;
+            }
+            return r_sq;
+        };
+        auto bin_of = [&](float_t r_sq) {
+            for(int b=0; b<n_bins; ++b)
+                if( r_sq >= edges[b]*edges[b] && r_sq < edges[b+1]*edges[b+1] )
+                    return b;
+            return -1;
+        };
+        vector<double> ref_auto(n_bins, 0.), ref_cross(n_bins, 0.),
+            ref_auto_w(n_bins, 0.), ref_cross_w(n_bins, 0.);
+        for(int i=0; i<n1; ++i) {
+            const auto &p = pts1[i];
+            const double w = p.pad<float_t>();
+            for(int j=i+1; j<n1; ++j) {
+                const int b = bin_of(r_sq_of(p.pos(), pts1[j].pos()));
+                if( b < 0 ) continue;
+                ref_auto[b] += 1.;
+                ref_auto_w[b] += w * pts1[j].pad<float_t>();
+            }
+            for(int j=0; j<n2; ++j) {
+                const int b = bin_of(r_sq_of(p.pos(), pts2[j].pos()));
+                if( b < 0 ) continue;
+                ref_cross[b] += 1.;
+                ref_cross_w[b] += w * pts2[j].pad<float_t>();
+            }
+        }
+
+        for(index_t leaf_size: {1, 16}) {
+            const auto cpl = cstr_pl_t().set_leaf_size(leaf_size)
+                .set_periodic_box(box);
+            kdtree_t kdt1(pts1, cpl), kdt2(pts2, cpl);
+            for(int n_threads: {1, 4}) {
+                ppl_t ppl;
+                ppl.set_n_threads(n_threads);
+                vector<double> counts;
+                kdt1.count_pairs(edges, counts, ppl);
+                EXPECT_THAT(counts, gt::ElementsAreArray(ref_auto));
+                kdt1.count_pairs(kdt2, edges, counts, ppl);
+                EXPECT_THAT(counts, gt::ElementsAreArray(ref_cross));
+
+                ppl.weighted_on();
+                kdt1.count_pairs(edges, counts, ppl);
+                ASSERT_EQ(counts.size(), n_bins);
+                for(int b=0; b<n_bins; ++b)
+                    EXPECT_NEAR(counts[b], ref_auto_w[b], 1.0e-9*ref_auto_w[b]);
+                kdt1.count_pairs(kdt2, edges, counts, ppl);
+                ASSERT_EQ(counts.size(), n_bins);
+                for(int b=0; b<n_bins; ++b)
+                    EXPECT_NEAR(counts[b], ref_cross_w[b], 
+                        1.0e-9*ref_cross_w[b]);
+            }
+        }
+    }
+
+    // A single bin covering all pairs, empty trees and invalid arguments.
+    kdtree_t kdt(pts2), kdt_empty;
+    vector<double> counts;
+    const vector<float_t> edges_all {0.f, 2*box_size};
+    kdt.count_pairs(edges_all, counts);
+    EXPECT_THAT(counts, gt::ElementsAre(double(n2)*(n2-1)/2));
+    kdt.count_pairs(kdt_empty, edges_all, counts);
+    EXPECT_THAT(counts, gt::ElementsAre(0.));
+    kdt_empty.count_pairs(edges, counts);
+    EXPECT_THAT(counts, gt::Each(0.));
+    EXPECT_EQ(counts.size(), n_bins);
+
+    const vector<float_t> edges_short {1.f}, edges_dup {1.f, 1.f};
+    EXPECT_THROW(kdt.count_pairs(edges_short, counts), ErrLogic);
+    EXPECT_THROW(kdt.count_pairs(edges_dup, counts), ErrLogic);
+    EXPECT_THROW(kdt.count_pairs(edges, counts, ppl_t().set_n_threads(0)), 
+        ErrLogic);
+    KDTree<KDPoint<float, 3> > kdt_no_pad;
+    EXPECT_THROW(kdt_no_pad.count_pairs(edges, counts, 
+        ppl_t().weighted_on()), ErrLogic);
+}
+
+TEST_F(KDTreeTest, FoF) {
+    using cstr_pl_t = kdtree_t::construct_policy_t;
+    using fpl_t = kdtree_t::fof_policy_t;
+    const int n = 3000;
+    vector<kdp_t> pts(_kdpts1.begin(), _kdpts1.begin()+n);
+
+    // Relabel groups in the order of their first points, so that partitions
+    // can be compared regardless of the numbering.
+    auto canonical = [](const vector<index_t> &ids) {
+        std::map<index_t, index_t> relabel;
+        vector<index_t> out(ids.size(), -1);
+        for(size_t i=0; i<ids.size(); ++i) {
+            if( ids[i] < 0 ) continue;
+            auto it = relabel.emplace(ids[i], relabel.size()).first;
+            out[i] = it->second;
+        }
+        return out;
+    };
+
+    for(const pos_t &box: {pos_t(0.f), pos_t{box_size, 0.f, box_size}}) {
+        auto r_sq_of = [&](const pos_t &p, const pos_t &q) {
+            float_t r_sq = 0;
+            for(int d=0; d<3; ++d) {
+                float_t dx = std::fabs(p[d] - q[d]);
+                if( box[d] > 0 )
+                    for(float_t s: {-box[d], box[d]})
+                        dx = std::min(dx, std::fabs(p[d] - (q[d] + s)));
+                r_sq += dx * dx;
+            }
+            return r_sq;
+        };
+        for(float_t b: {0.f, 2.f, 5.f}) {
+            // Brute-force groups, indexed by the point.
+            vector<index_t> parent(n);
+            std::iota(parent.begin(), parent.end(), 0);
+            std::function<index_t(index_t)> find = [&](index_t i) {
+                return parent[i] == i ? i : parent[i] = find(parent[i]);
+            };
+            for(int i=0; i<n; ++i)
+            for(int j=i+1; j<n; ++j)
+                if( r_sq_of(pts[i].pos(), pts[j].pos()) < b*b )
+                    parent[find(i)] = find(j);
+            vector<index_t> sizes(n, 0);
+            for(int i=0; i<n; ++i) ++sizes[find(i)];
+
+            for(index_t min_size: {1, 3}) {
+                vector<index_t> ref(n);
+                index_t n_ref = 0;
+                for(int i=0; i<n; ++i) {
+                    ref[i] = sizes[find(i)] >= min_size ? find(i) : -1;
+                    if( ref[i] == i ) ++n_ref;
+                }
+                ref = canonical(ref);
+                for(index_t leaf_size: {1, 16}) {
+                    kdtree_t kdt(pts, cstr_pl_t().set_leaf_size(leaf_size)
+                        .set_periodic_box(box));
+                    for(int n_threads: {1, 4}) {
+                        vector<index_t> ids, got(n);
+                        const index_t n_got = kdt.fof(b, ids, fpl_t()
+                            .set_n_threads(n_threads).set_min_size(min_size));
+                        EXPECT_EQ(n_got, n_ref);
+                        ASSERT_EQ(ids.size(), n);
+                        for(int i=0; i<n; ++i) 
+                            got[kdt.point_pad<int>(i)] = ids[i];
+                        for(auto id: got) ASSERT_LT(id, n_got);
+                        EXPECT_THAT(canonical(got), gt::ContainerEq(ref))
+                            << "b=" << b << ", min_size=" << min_size
+                            << ", leaf_size=" << leaf_size
+                            << ", n_threads=" << n_threads;
+                        // Groups are numbered by their first points.
+                        EXPECT_THAT(canonical(ids), gt::ContainerEq(ids));
+                    }
+                }
+            }
+        }
+    }
+
+    kdtree_t kdt_empty;
+    vector<index_t> ids {1, 2};
+    EXPECT_EQ(kdt_empty.fof(1.f, ids), 0);
+    EXPECT_TRUE(ids.empty());
+    kdtree_t kdt(pts);
+    EXPECT_THROW(kdt.fof(-1.f, ids), ErrLogic);
+    EXPECT_THROW(kdt.fof(1.f, ids, fpl_t().set_n_threads(0)), ErrLogic);
+}
+
+TEST_F(KDTreeTest, SPHDensity) {
+    using cstr_pl_t = kdtree_t::construct_policy_t;
+    using spl_t = kdtree_t::sph_policy_t;
+    using kernel_t = kdtree_t::sph_kernel_t;
+    using type_t = kernel_t::type_t;
+
+    // Kernels are normalized, and deriv_h() is the derivative of value().
+    EXPECT_NEAR(kernel_t(type_t::CUBIC_SPLINE, 3).norm(), 8.0/M_PI, 1.0e-12);
+    EXPECT_NEAR(kernel_t(type_t::CUBIC_SPLINE, 2).norm(), 40.0/(7.0*M_PI), 
+        1.0e-12);
+    EXPECT_NEAR(kernel_t(type_t::CUBIC_SPLINE, 1).norm(), 4.0/3.0, 1.0e-12);
+    EXPECT_NEAR(kernel_t(type_t::WENDLAND_C2, 3).norm(), 21.0/(2.0*M_PI), 
+        1.0e-12);
+    EXPECT_NEAR(kernel_t(type_t::WENDLAND_C2, 2).norm(), 7.0/M_PI, 1.0e-12);
+    for(auto type: {type_t::CUBIC_SPLINE, type_t::WENDLAND_C2}) {
+        kernel_t w(type);
+        EXPECT_DOUBLE_EQ(w.shape(0.), 1.);
+        EXPECT_DOUBLE_EQ(w.shape(1.), 0.);
+        for(double r: {0.1, 0.45, 0.55, 0.9}) {
+            const double dh = 1.0e-6, 
+                fd = (w.value(r, 1.+dh) - w.value(r, 1.-dh)) / (2*dh);
+            EXPECT_NEAR(w.deriv_h(r, 1.), fd, 1.0e-6);
+        }
+    }
+
+    const int n = 5000;
+    vector<kdp_t> pts(_kdpts1.begin(), _kdpts1.begin()+n);
+    vector<float_t> masses(n);
+    for(int i=0; i<n; ++i) masses[i] = 1.0f + (i % 3);
+    {
+        vector<float_t> h, rho;
+        kdtree_t kdt(pts);
+        EXPECT_THROW(kdt.sph_density(h, rho, spl_t().set_n_ngb(5.)), 
+            ErrLogic);
+        EXPECT_THROW(kdt.sph_density(h, rho, spl_t().set_masses(masses)
+            .set_n_threads(0)), ErrLogic);
+        EXPECT_THROW(kdt.sph_density(h, rho, 
+            spl_t().set_masses({masses.data(), 10})), ErrLogic);
+    }
+
+    for(const pos_t &box: {pos_t(0.f), pos_t(box_size)})
+    for(auto type: {type_t::CUBIC_SPLINE, type_t::WENDLAND_C2}) {
+        kdtree_t kdt(pts, cstr_pl_t().set_periodic_box(box));
+        const auto &nodes = kdt.nodes();
+        const kernel_t w(type);
+        const spl_t pl = spl_t().set_kernel(type).set_n_ngb(40.);
+        vector<float_t> h, rho;
+        ASSERT_EQ(kdt.sph_density(h, rho, pl), 0);
+        ASSERT_EQ(h.size(), n);
+        ASSERT_EQ(rho.size(), n);
+
+        // Brute-force N(h) and density, with the masses of the points.
+        vector<float_t> h_m, rho_m;
+        ASSERT_EQ(kdt.sph_density(h_m, rho_m, 
+            spl_t(pl).set_masses(masses)), 0);
+        EXPECT_EQ(h_m, h);
+        for(int i=0; i<n; i+=50) {
+            const pos_t &p = nodes[i].pos();
+            double n_h = 0., rho_i = 0., rho_mi = 0.;
+            for(int j=0; j<n; ++j) {
+                pos_t dx = p - nodes[j].pos();
+                for(int d=0; d<3; ++d) 
+                    if( box[d] > 0 ) {
+                        dx[d] = std::fabs(dx[d]);
+                        dx[d] = std::min(dx[d], box[d] - dx[d]);
+                    }
+                const double wij = w.value(dx.norm(), h[i]);
+                n_h += wij; rho_i += wij;
+                rho_mi += wij * masses[j];
+            }
+            n_h *= w.ball_volume() * std::pow(h[i], 3);
+            EXPECT_NEAR(n_h, 40., 40. * 1.0e-3);
+            EXPECT_NEAR(rho[i], rho_i, rho_i * 1.0e-4);
+            EXPECT_NEAR(rho_m[i], rho_mi, rho_mi * 1.0e-4);
+        }
+
+        // Results do not depend on threads. Good initial guesses converge.
+        vector<float_t> h_th, rho_th;
+        ASSERT_EQ(kdt.sph_density(h_th, rho_th, spl_t(pl).set_n_threads(3)), 
+            0);
+        EXPECT_EQ(h_th, h);
+        EXPECT_EQ(rho_th, rho);
+
+        ASSERT_EQ(kdt.sph_density(h_th, rho_th, spl_t(pl).set_max_iters(1)), 
+            0);
+        for(int i=0; i<n; ++i) 
+            ASSERT_NEAR(h_th[i], h[i], h[i] * 1.0e-3);
+    }
+
+    // Periodic lattice, i.e., the density is the number density.
+    {
+        const int n_side = 20;
+        const float_t dx = box_size / n_side;
+        pts.clear();
+        for(int i=0; i<n_side; ++i)
+        for(int j=0; j<n_side; ++j)
+        for(int k=0; k<n_side; ++k)
+            pts.emplace_back(pos_t{(i+.5f)*dx, (j+.5f)*dx, (k+.5f)*dx});
+        kdtree_t kdt(pts, cstr_pl_t().set_periodic_box(box_size));
+        const double rho_ref = 1.0 / (dx*dx*dx);
+        // Wendland C2 needs more neighbors for the same accuracy.
+        for(auto [type, n_ngb]: {std::pair{type_t::CUBIC_SPLINE, 32.}, 
+            std::pair{type_t::WENDLAND_C2, 100.}}) 
+        {
+            vector<float_t> h, rho;
+            ASSERT_EQ(kdt.sph_density(h, rho, 
+                spl_t().set_kernel(type).set_n_ngb(n_ngb)), 0);
+            for(auto &r: rho) ASSERT_NEAR(r, rho_ref, 0.01 * rho_ref);
+        }
+    }
+
+    // Duplicated points have no solution.
+    pts.assign(100, pts[0]);
+    vector<float_t> h, rho;
+    EXPECT_EQ(kdtree_t(pts).sph_density(h, rho), 100);
+
+    // Empty tree.
+    EXPECT_EQ(kdtree_t().sph_density(h, rho), 0);
+    EXPECT_TRUE(h.empty());
+    EXPECT_TRUE(rho.empty());
+}
+
+TEST_F(KDTreeTest, Refit) {
+    using cstr_pl_t = kdtree_t::construct_policy_t;
+    using rpl_t = kdtree_t::refit_policy_t;
+    using sphere_t = kdtree_t::sphere_t;
+    const int n = 20000, n_q = 30;
+    vector<kdp_t> pts(_kdpts1.begin(), _kdpts1.begin()+n);
+    vector<pos_t> offsets(n);
+    for(auto &dx: offsets) {
+        _rng(dx.begin(), dx.end());
+        dx = dx / box_size - 0.5f;
+    }
+    // Points moved by at most ``step`` along each axis, kept in the box.
+    auto moved = [&](float_t step) {
+        vector<kdp_t> out = pts;
+        for(int i=0; i<n; ++i) {
+            auto &x = out[i].pos();
+            x += offsets[i] * (2 * step);
+            for(int d=0; d<3; ++d) 
+                x[d] = std::clamp(x[d], 0.f, std::nextafter(box_size, 0.f));
+        }
+        return out;
+    };
+    // New points in the order of the point indices, looked up by the 
+    // paddings.
+    auto in_point_order = [](const kdtree_t &kdt, const vector<kdp_t> &src) {
+        vector<kdp_t> out;
+        for(index_t j=0; j<kdt.n_points(); ++j) 
+            out.push_back(src[kdt.point_pad<int>(j)]);
+        return out;
+    };
+    // The subtree of each split node is ordered along the split axis.
+    auto check_tree = [&](const kdtree_t &kdt, const vector<kdp_t> &src, 
+        const vector<int> &sizes, const vector<int> &axes) 
+    {
+        ASSERT_EQ(kdt.n_nodes(), index_t(sizes.size()));
+        ASSERT_EQ(kdt.n_points(), n);
+        std::unordered_set<int> pads;
+        for(index_t j=0; j<n; ++j) {
+            const int pad = kdt.point_pad<int>(j);
+            pads.insert(pad);
+            ASSERT_TRUE( (kdt.point_pos(j) == src[pad].pos()).all() );
+        }
+        EXPECT_EQ(pads.size(), size_t(n));
+        for(index_t i=0; i<kdt.n_nodes(); ++i) {
+            const auto [sz, a] = node_shape(kdt, i);
+            const auto [b, e] = kdt.point_range(i);
+            ASSERT_EQ(sz, sizes[i]);
+            ASSERT_EQ(a, axes[i]);
+            if( sz == 1 || kdt.is_bucket(i) ) continue;
+            const float_t x = kdt.point_pos(b)[a];
+            const index_t np_l = (e - b) / 2;
+            for(index_t j=b+1; j<e; ++j) {
+                if( j <= b+np_l ) ASSERT_LE(kdt.point_pos(j)[a], x);
+                else ASSERT_GE(kdt.point_pos(j)[a], x);
+            }
+        }
+        
+        for(int i=0; i<n_q; ++i) {
+            const auto &q = _kdpts2[i];
+            const float_t r = 2.0f * (i % 5 + 1);
+            index_t cnt_ref = 0;
+            float_t r_sq_min = std::numeric_limits<float_t>::max();
+            for(auto &p: src) {
+                const float_t r_sq = (p.pos() - q.pos()).squared_norm();
+                cnt_ref += r_sq < r*r;
+                r_sq_min = std::min(r_sq_min, r_sq);
+            }
+            EXPECT_EQ(kdt.count_nodes_sphere(sphere_t(q, r)), cnt_ref);
+            EXPECT_FLOAT_EQ(kdt.nearest(q).r_sq, r_sq_min);
+        }
+    };
+
+    for(index_t leaf_size: {1, 8}) {
+        const auto cstr_pl = cstr_pl_t().set_leaf_size(leaf_size);
+        kdtree_t kdt(pts, cstr_pl);
+        EXPECT_EQ(kdt.refit_info().n_refits(), 0);
+        EXPECT_EQ(kdt.refit_info().growth(), 1.0);
+        vector<int> sizes, axes;
+        for(index_t i=0; i<kdt.n_nodes(); ++i) {
+            const auto [sz, a] = node_shape(kdt, i);
+            sizes.push_back(sz); axes.push_back(a);
+        }
+
+        // Refit to the same points keeps the tree.
+        auto new_pts = in_point_order(kdt, pts);
+        kdt.refit(new_pts);
+        EXPECT_EQ(kdt.refit_info().n_refits(), 1);
+        EXPECT_DOUBLE_EQ(kdt.refit_info().growth(), 1.0);
+        EXPECT_GT(kdt.refit_info().build_volume(), 0.);
+        check_tree(kdt, pts, sizes, axes);
+
+        // Small and large motions. The volume grows with the motion, but 
+        // only slightly, as the swaps restore the median splits.
+        const auto pts_s = moved(0.5f), pts_l = moved(10.f);
+        new_pts = in_point_order(kdt, pts_s);
+        kdt.refit(new_pts);
+        check_tree(kdt, pts_s, sizes, axes);
+        const double growth_s = kdt.refit_info().growth();
+        EXPECT_NEAR(growth_s, 1.0, 0.1);
+
+        new_pts = in_point_order(kdt, pts_l);
+        kdt.refit(new_pts);
+        check_tree(kdt, pts_l, sizes, axes);
+        EXPECT_EQ(kdt.refit_info().n_refits(), 3);
+        EXPECT_GT(kdt.refit_info().growth(), growth_s);
+
+        // Independent of the number of threads.
+        kdtree_t kdt_p(pts, cstr_pl), kdt_s(pts, cstr_pl);
+        new_pts = in_point_order(kdt_s, pts_l);
+        kdt_p.refit(new_pts, rpl_t().set_n_threads(4).set_serial_cutoff(100));
+        kdt_s.refit(new_pts);
+        check_tree(kdt_p, pts_l, sizes, axes);
+        for(index_t j=0; j<n; ++j) {
+            ASSERT_EQ(kdt_p.point_pad<int>(j), kdt_s.point_pad<int>(j));
+        }
+        EXPECT_NEAR(kdt_p.refit_info().growth(), 
+            kdt_s.refit_info().growth(), 1.0e-10);
+
+        // A new construction resets the record.
+        kdt.construct(pts_l, cstr_pl);
+        EXPECT_EQ(kdt.refit_info().n_refits(), 0);
+        EXPECT_EQ(kdt.refit_info().growth(), 1.0);
+    }
+
+    // Invalid arguments.
+    kdtree_t kdt(pts);
+    EXPECT_THROW(kdt.refit(_kdpts2), ErrLogic);
+    EXPECT_THROW(kdt.refit(pts, rpl_t().set_n_threads(0)), ErrLogic);
+    
+    kdtree_t kdt_e;
+    vector<kdp_t> no_pts;
+    kdt_e.refit(no_pts);
+    EXPECT_EQ(kdt_e.refit_info().n_refits(), 1);
+    EXPECT_EQ(kdt_e.refit_info().growth(), 1.0);
+}
+
+TEST_F(KDTreeTest, VEBLayout) {
+    using cstr_pl_t = kdtree_t::construct_policy_t;
+    using layout_t = _KDSEARCH::_VEBLayout;
+    using lidx_t = layout_t::index_t;
+
+    // The layout is a permutation, cut at the middle level recursively.
+    for(int h=0; h<=12; ++h) {
+        layout_t layout(h);
+        ASSERT_EQ(layout.size(), (lidx_t(1) << h) - 1);
+        vector<char> used(layout.size(), 0);
+        for(lidx_t i=1; i<=layout.size(); ++i) {
+            const lidx_t pos = layout.pos_of(i);
+            ASSERT_GE(pos, 0);
+            ASSERT_LT(pos, layout.size());
+            ASSERT_FALSE(used[pos]);
+            used[pos] = 1;
+        }
+    }
+    layout_t layout(4);
+    for(auto [i, pos]: vector<std::pair<lidx_t, lidx_t> >{
+        {1, 0}, {2, 1}, {3, 2}, {4, 3}, {8, 4}, {9, 5}, {5, 6}, {11, 8}, 
+        {7, 12}, {15, 14}})
+        EXPECT_EQ(layout.pos_of(i), pos);
+    EXPECT_THROW(layout_t(-1), ErrLogic);
+    EXPECT_THROW(layout_t(layout_t::MAX_HEIGHT+1), ErrLogic);
+
+    EXPECT_EQ(cstr_pl_t().veb_layout(), cstr_pl_t::DFLT_VEB_LAYOUT);
+    EXPECT_FALSE(cstr_pl_t::DFLT_VEB_LAYOUT);
+    EXPECT_TRUE(cstr_pl_t(cstr_pl_t().set_veb_layout(true)).veb_layout());
+
+    // Descents in the index give the same paths as in the nodes.
+    auto check_walk = [&](const kdtree_t &kdt, const kdtree_t &kdt_ref) {
+        for(int i=0; i<2000; ++i) {
+            const auto &p = _kdpts2[i];
+            vector<index_t> path, path_ref;
+            index_t idx = 0, idx_ref = 0;
+            kdt.walk_down(p, [&](index_t j){ path.push_back(j); }, idx);
+            kdt_ref.walk_down(p, [&](index_t j){ path_ref.push_back(j); }, 
+                idx_ref);
+            ASSERT_EQ(idx, idx_ref);
+            ASSERT_EQ(path, path_ref);
+        }
+    };
+    const int n = 20000;
+    vector<kdp_t> pts(_kdpts1.begin(), _kdpts1.begin()+n);
+    for(index_t leaf_size: {1, 8}) 
+    for(int n_pts: {1, 2, 3, 1000, n}) {
+        vector<kdp_t> sub(pts.begin(), pts.begin()+n_pts);
+        const auto pl = cstr_pl_t().set_leaf_size(leaf_size);
+        kdtree_t kdt(sub, cstr_pl_t(pl).set_veb_layout(true)), kdt_ref(sub, pl);
+        EXPECT_TRUE(kdt_ref.impl()->veb_nodes().empty());
+
+        const auto &impl = *kdt.impl();
+        const auto &vnodes = impl.veb_nodes();
+        ASSERT_EQ(vnodes.size(), 
+            (size_t(1) << kdt.tree_info().max_depth()) - 1);
+        index_t n_indexed = 0;
+        for(auto &vn: vnodes) {
+            if( vn.idx < 0 ) continue;
+            ++n_indexed;
+            ASSERT_EQ(vn.axis, node_shape(kdt, vn.idx).second);
+            if( vn.axis >= 0 ){
+                const auto &pos = kdt.point_pos(kdt.point_range(vn.idx).first);
+                ASSERT_EQ(vn.split, pos[vn.axis]);
+            }
+        }
+        EXPECT_EQ(n_indexed, kdt.n_nodes());
+        check_walk(kdt, kdt_ref);
+
+        vector<kdtree_t::idx_pair_t> iprs, iprs_ref;
+        kdt.argsort<kdp_t>(_kdpts2, iprs);
+        kdt_ref.argsort<kdp_t>(_kdpts2, iprs_ref);
+        ASSERT_EQ(iprs.size(), iprs_ref.size());
+        for(size_t i=0; i<iprs.size(); ++i) {
+            ASSERT_EQ(iprs[i].idx_in, iprs_ref[i].idx_in);
+            ASSERT_EQ(iprs[i].idx_node, iprs_ref[i].idx_node);
+        }
+    }
+
+    // The index follows the refit, the load and the clearance.
+    kdtree_t kdt(pts, cstr_pl_t().set_veb_layout(true)), kdt_ref(pts);
+    vector<kdp_t> new_pts;
+    for(auto &nd: kdt.nodes()) {
+        new_pts.emplace_back(nd.pos() + 0.5f, nd.pad<int>());
+        new_pts.back().pos()[0] = std::min(new_pts.back().pos()[0], 99.f);
+    }
+    kdt.refit(new_pts);
+    kdt_ref.refit(new_pts);
+    check_walk(kdt, kdt_ref);
+
+    const string file_name = gt::TempDir() + "kdsearch_kdtree_veb.bin";
+    kdt_ref.save(file_name);
+    kdtree_t kdt_in(pts, cstr_pl_t().set_veb_layout(true));
+    kdt_in.load(file_name);
+    EXPECT_FALSE(kdt_in.impl()->veb_nodes().empty());
+    check_walk(kdt_in, kdt_ref);
+    std::filesystem::remove(file_name);
+
+    kdt.clear();
+    EXPECT_TRUE(kdt.impl()->veb_nodes().empty());
+}
+
+TEST_F(KDTreeTest, OutOfCore) {
+    using cstr_pl_t = kdtree_t::construct_policy_t;
+    using spl_t = cstr_pl_t::split_axis_t;
+    using ooc_pl_t = kdtree_t::out_of_core_policy_t;
+    using run_t = kdtree_t::point_run_file_t;
+
+    const string dir = gt::TempDir() + "kdsearch_kdtree_out_of_core";
+    std::filesystem::create_directories(dir);
+    const string file_name = dir + "/points.bin";
+
+    // Distinct coordinates, so that the medians are unique.
+    const int n = 100000;
+    vector<kdp_t> pts(n);
+    vector<int> perm(n);
+    for(int d=0; d<kdtree_t::DIM; ++d) {
+        std::iota(perm.begin(), perm.end(), 0);
+        std::shuffle(perm.begin(), perm.end(), _eng);
+        for(int i=0; i<n; ++i) pts[i].pos()[d] = float_t(perm[i]);
+    }
+    for(int i=0; i<n; ++i) pts[i].fill_pad(i);
+    {
+        run_t run(file_name, false);
+        run.append(pts.data(), pts.size());
+    }
+    run_t src(file_name);
+    ASSERT_EQ(src.size(), pts.size());
+
+    ooc_pl_t ooc_pl;
+    EXPECT_EQ(ooc_pl.max_in_core(), ooc_pl_t::DFLT_MAX_IN_CORE);
+    EXPECT_EQ(ooc_pl.chunk_size(), ooc_pl_t::DFLT_CHUNK_SIZE);
+    EXPECT_EQ(ooc_pl.scratch_dir(), ooc_pl_t::DFLT_SCRATCH_DIR);
+    ooc_pl.set_scratch_dir(dir).set_chunk_size(1000);
+
+    auto check_same = [](const kdtree_t &kdt, const kdtree_t &kdt_ref) {
+        EXPECT_EQ(kdt.tree_info().max_depth(), kdt_ref.tree_info().max_depth());
+        EXPECT_EQ(kdt.points().size(), kdt_ref.points().size());
+        EXPECT_EQ(kdt.nodes().size(), kdt_ref.nodes().size());
+        ASSERT_EQ(kdt.n_nodes(), kdt_ref.n_nodes());
+        for(index_t i=0; i<kdt.n_nodes(); ++i){
+            ASSERT_EQ(node_shape(kdt, i), node_shape(kdt_ref, i));
+            const auto [b, e] = kdt.point_range(i);
+            ASSERT_EQ(kdt_ref.point_range(i), std::make_pair(b, e));
+            if( !kdt_ref.is_bucket(i) ) {
+                ASSERT_EQ(kdt.point_pad<int>(b), kdt_ref.point_pad<int>(b));
+                continue;
+            }
+            // Points in a bucket are in arbitrary order.
+            ASSERT_TRUE(kdt.is_bucket(i));
+            vector<int> pads, pads_ref;
+            for(index_t j=b; j<e; ++j) {
+                pads.push_back(kdt.point_pad<int>(j));
+                pads_ref.push_back(kdt_ref.point_pad<int>(j));
+            }
+            EXPECT_THAT(pads, gt::UnorderedElementsAreArray(pads_ref));
+        }
+    };
+
+    // The same tree as the in-memory construction.
+    for(index_t leaf_size: {1, 8}) 
+    for(index_t max_in_core: {100000, 5000, 7}) {
+        cstr_pl_t pl;
+        pl.set_leaf_size(leaf_size).set_n_threads(2);
+        kdtree_t kdt, kdt_ref(pts, pl);
+        kdt.construct_out_of_core(src, pl, 
+            ooc_pl_t(ooc_pl).set_max_in_core(max_in_core));
+        check_same(kdt, kdt_ref);
+    }
+
+    // Ties at the medians, and the variance as the split criterion.
+    pts.assign(_kdpts1.begin(), _kdpts1.begin() + 20000);
+    for(auto &p: pts) 
+        for(auto &x: p.pos()) x = std::floor(x) / 4;
+    run_t src_ties(dir + "/ties.bin", true);
+    src_ties.append(pts.data(), pts.size());
+    for(spl_t spl: {spl_t::MAX_EXTREME, spl_t::MAX_VARIANCE}) {
+        kdtree_t kdt;
+        kdt.construct_out_of_core(src_ties, cstr_pl_t().set_split_axis(spl), 
+            ooc_pl_t(ooc_pl).set_max_in_core(1000));
+        const auto &nds = kdt.nodes();
+        ASSERT_EQ(nds.size(), pts.size());
+        std::unordered_set<int> pads;
+        for(size_t i=0; i<nds.size(); ++i){
+            const auto &n = nds[i];
+            EXPECT_TRUE(pads.insert(n.pad<int>()).second);
+            if( n.size() < 2 ) continue;
+            const index_t l = kdt.left_child_idx(i), r = i+1+nds[l].size();
+            for(index_t j=l; j<l+nds[l].size(); ++j)
+                ASSERT_LE(nds[j].pos()[n.axis()], n.pos()[n.axis()]);
+            for(index_t j=r; j<index_t(i)+n.size(); ++j)
+                ASSERT_GE(nds[j].pos()[n.axis()], n.pos()[n.axis()]);
+        }
+        EXPECT_EQ(pads.size(), pts.size());
+        // The out-of-core splits may pick other pivots among ties, but the
+        // balance is the same.
+        kdtree_t kdt_ref(pts, cstr_pl_t().set_split_axis(spl));
+        for(size_t i=0; i<nds.size(); ++i)
+            ASSERT_EQ(nds[i].size(), kdt_ref.nodes()[i].size());
+    }
+    src_ties.remove();
+
+    kdtree_t kdt;
+    run_t src_empty(dir + "/empty.bin", true);
+    kdt.construct_out_of_core(src_empty, {}, ooc_pl);
+    EXPECT_EQ(kdt.n_nodes(), 0);
+    EXPECT_EQ(kdt.tree_info().max_depth(), 0);
+    EXPECT_THROW(kdt.construct_out_of_core(src, 
+        cstr_pl_t().set_split_axis(spl_t::ORDERED), ooc_pl), ErrLogic);
+    EXPECT_THROW(kdt.construct_out_of_core(src, {}, 
+        ooc_pl_t(ooc_pl).set_max_in_core(0)), ErrLogic);
+    EXPECT_THROW(run_t(dir + "/not-exist.bin"), ErrSystem);
+    src_empty.remove();
+
+    // All buckets are removed.
+    src.remove();
+    std::remove(file_name.c_str());
+    EXPECT_TRUE(std::filesystem::is_empty(dir));
+    std::filesystem::remove(dir);
+}
+
+TEST(KDTreeLongLongTest, ConstructAndQuery) {
+    using kdp_t = KDPoint<float, 3, sizeof(long long)>;
+    using kdtree_t = KDTree<kdp_t, long long>;
+    using index_t = kdtree_t::index_t;
+    using ngb_t = kdtree_t::ngb_t;
+    static_assert(std::is_same_v<index_t, long long>);
+
+    UniformRealRandomNumber<> rng(0.0f, 100.0f);
+    vector<kdp_t> pts(20000);
+    for(size_t i=0; i<pts.size(); ++i) {
+        rng(pts[i].pos().begin(), pts[i].pos().end());
+        pts[i].fill_pad((long long)i + (1LL << 40));
+    }
+
+    for(index_t leaf_size: {1, 8}) {
+        kdtree_t kdt(pts, kdtree_t::construct_policy_t()
+            .set_leaf_size(leaf_size).set_n_threads(2)
+            .set_serial_cutoff(1000));
+        ASSERT_EQ(kdt.n_points(), index_t(pts.size()));
+        EXPECT_EQ(leaf_size > 1 ? kdt.ref_nodes()[0].size() 
+            : kdt.nodes()[0].size(), kdt.n_nodes());
+        EXPECT_EQ(kdt.point_range(0).second, index_t(pts.size()));
+        
+        vector<ngb_t> ngbs(8);
+        for(int i=0; i<50; ++i) {
+            kdtree_t::pos_t q;
+            rng(q.begin(), q.end());
+            vector<std::pair<float, long long> > ref;
+            for(auto &p: pts) 
+                ref.emplace_back((p.pos()-q).squared_norm(), p.pad<long long>());
+            std::sort(ref.begin(), ref.end());
+
+            ASSERT_EQ(kdt.nearest_k(q, ngbs, 
+                kdtree_t::nearest_k_query_policy_t().sort_by_distance_on()), 
+                8);
+            for(int j=0; j<8; ++j) {
+                EXPECT_FLOAT_EQ(ngbs[j].r_sq, ref[j].first);
+                EXPECT_EQ(kdt.point_pad<long long>(ngbs[j].node_idx), 
+                    ref[j].second);
+            }
+            const index_t cnt = std::count_if(ref.begin(), ref.end(), 
+                [](auto &r) { return r.first < 25.0f; });
+            EXPECT_EQ(kdt.count_nodes_sphere(kdtree_t::sphere_t(q, 5.0f)), cnt);
+        }
+    }
+
+    // The out-of-core construction with 64-bit indices.
+    const string file_name = gt::TempDir() + "kdsearch_kdtree_ll.bin";
+    kdtree_t::point_run_file_t src(file_name, true);
+    src.append(pts.data(), pts.size());
+    kdtree_t kdt, kdt_ref(pts);
+    kdt.construct_out_of_core(src, {}, kdtree_t::out_of_core_policy_t()
+        .set_max_in_core(3000).set_scratch_dir(gt::TempDir()));
+    ASSERT_EQ(kdt.nodes().size(), kdt_ref.nodes().size());
+    for(size_t i=0; i<pts.size(); ++i) {
+        ASSERT_EQ(kdt.nodes()[i].pad<long long>(), 
+            kdt_ref.nodes()[i].pad<long long>());
+        ASSERT_EQ(kdt.nodes()[i].size(), kdt_ref.nodes()[i].size());
+    }
+}
+
 } // namespace
 
 } // namespace HIPP::NUMERICAL
\ No newline at end of file
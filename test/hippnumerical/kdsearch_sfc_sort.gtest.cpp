@@ -0,0 +1,171 @@
+#include <hippnumerical.h>
+#include <gmock/gmock.h>
+#include <numeric>
+
+namespace HIPP::NUMERICAL {
+
+namespace {
+
+namespace gt = ::testing;
+
+class SFCSortTest : public gt::Test {
+protected:
+    using kdp_t = KDPoint<float, 3, sizeof(int)>;
+    using sorter_t = SFCSort<kdp_t>;
+    using pl_t = sorter_t::policy_t;
+    using curve_t = pl_t::curve_t;
+    using key_t = sorter_t::key_t;
+    using rect_t = sorter_t::rect_t;
+    using pos_t = sorter_t::pos_t;
+
+    using rng_t = UniformRealRandomNumber<>;
+
+    inline static const rng_t::seed_t seed = 0;
+    inline static const float box_size = 100.0;
+
+    SFCSortTest() : _eng(seed), _rng(0.0f, box_size, &_eng) {}
+
+    /**
+    ``n`` random points, each padded by its index. If ``n_dup > 0``, every
+    ``n_dup`` successive points are at the same position.
+    */
+    void fill(int n, int n_dup = 0) {
+        pts.clear();
+        pos_t p;
+        for(int i=0; i<n; ++i) {
+            if( n_dup <= 0 || i % n_dup == 0 ) _rng(p.begin(), p.end());
+            pts.emplace_back(p, i);
+        }
+    }
+
+    ContiguousBuffer<const kdp_t> cbuff() const {
+        return ContiguousBuffer<const kdp_t>(pts);
+    }
+
+    vector<kdp_t> pts;
+    rng_t::engine_t _eng;
+    rng_t _rng;
+};
+
+TEST_F(SFCSortTest, Argsort) {
+    fill(10000, 3);
+    for(auto curve: {curve_t::MORTON, curve_t::HILBERT}) {
+        sorter_t sorter(pl_t().set_curve(curve));
+        vector<key_t> keys;
+        vector<int> order;
+        sorter.keys(cbuff(), keys);
+        sorter.argsort(cbuff(), order);
+        ASSERT_EQ(keys.size(), pts.size());
+        ASSERT_EQ(order.size(), pts.size());
+
+        // The same as a stable sort by the keys.
+        vector<int> order_ref(pts.size());
+        std::iota(order_ref.begin(), order_ref.end(), 0);
+        std::stable_sort(order_ref.begin(), order_ref.end(),
+            [&](int a, int b) { return keys[a] < keys[b]; });
+        EXPECT_EQ(order, order_ref);
+
+        auto curve_obj = sorter.curve_of(cbuff());
+        EXPECT_EQ(curve_obj.curve(), curve);
+        for(size_t i=0; i<pts.size(); i+=97)
+            EXPECT_EQ(keys[i], curve_obj.key(pts[i]));
+    }
+}
+
+TEST_F(SFCSortTest, Sort) {
+    fill(20000);
+    sorter_t sorter;
+    vector<int> order;
+    sorter.argsort(cbuff(), order);
+
+    auto sorted = pts;
+    sorter.sort(ContiguousBuffer<kdp_t>(sorted));
+    for(size_t i=0; i<pts.size(); ++i) {
+        const auto &p = sorted[i], &p_ref = pts[order[i]];
+        ASSERT_EQ(p.pad<int>(), p_ref.pad<int>());
+        ASSERT_TRUE( (p.pos() == p_ref.pos()).all() );
+    }
+
+    // Successive points are close, i.e., much closer than random pairs.
+    double d_sorted = 0., d_input = 0.;
+    for(size_t i=1; i<pts.size(); ++i) {
+        d_sorted += (sorted[i].pos() - sorted[i-1].pos()).norm();
+        d_input += (pts[i].pos() - pts[i-1].pos()).norm();
+    }
+    EXPECT_LT(d_sorted, d_input / 10.);
+
+    // Trees see the same points.
+    using tree_t = KDTree<kdp_t>;
+    tree_t tree(pts), tree_sorted(sorted);
+    for(int i=0; i<100; ++i) {
+        const auto &q = pts[i*37];
+        auto ngb = tree.nearest(q), ngb_sorted = tree_sorted.nearest(q);
+        EXPECT_EQ(tree.nodes()[ngb.node_idx].pad<int>(),
+            tree_sorted.nodes()[ngb_sorted.node_idx].pad<int>());
+    }
+}
+
+TEST_F(SFCSortTest, Threads) {
+    fill(30001, 2);
+    for(auto curve: {curve_t::MORTON, curve_t::HILBERT}) {
+        vector<int> order1, order4;
+        sorter_t(pl_t().set_curve(curve)).argsort(cbuff(), order1);
+        sorter_t(pl_t().set_curve(curve).set_n_threads(4))
+            .argsort(cbuff(), order4);
+        EXPECT_EQ(order1, order4);
+    }
+    vector<int> order;
+    sorter_t(pl_t().set_n_threads(8)).argsort(
+        ContiguousBuffer<const kdp_t>(pts.data(), 5), order);
+    EXPECT_EQ(order.size(), 5);
+}
+
+TEST_F(SFCSortTest, Domain) {
+    fill(1000);
+    sorter_t sorter(pl_t().set_curve(curve_t::MORTON));
+
+    // Points in the lower half of the first axis come first.
+    rect_t dom {pos_t(0.f), pos_t(box_size)};
+    vector<int> order;
+    sorter.argsort(cbuff(), order, dom);
+    bool upper = false;
+    for(int i: order) {
+        const bool u = pts[i].pos()[0] >= box_size / 2;
+        EXPECT_TRUE(u || !upper);
+        upper = upper || u;
+    }
+    EXPECT_TRUE( (sorter.curve_of(cbuff(), dom).domain().high().pos() 
+        == pos_t(box_size)).all() );
+
+    // The bounding box by default.
+    auto box = sorter.curve_of(cbuff()).domain();
+    for(int k=0; k<3; ++k) {
+        float lo = box_size, hi = 0.f;
+        for(auto &p: pts) {
+            lo = std::min(lo, p.pos()[k]);
+            hi = std::max(hi, p.pos()[k]);
+        }
+        EXPECT_EQ(box.low().pos()[k], lo);
+        EXPECT_EQ(box.high().pos()[k], hi);
+    }
+}
+
+TEST_F(SFCSortTest, Edges) {
+    pts.clear();
+    sorter_t sorter;
+    vector<int> order {1, 2};
+    sorter.argsort(cbuff(), order);
+    EXPECT_TRUE(order.empty());
+    sorter.sort(ContiguousBuffer<kdp_t>(pts));
+
+    // All at a single position - the input order is kept.
+    fill(100, 100);
+    sorter.argsort(cbuff(), order);
+    for(int i=0; i<100; ++i) EXPECT_EQ(order[i], i);
+
+    EXPECT_THROW(sorter_t(pl_t().set_n_threads(0)), ErrLogic);
+}
+
+} // namespace
+
+} // namespace HIPP::NUMERICAL